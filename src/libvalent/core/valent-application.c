@@ -130,8 +130,23 @@ quit_action (GSimpleAction *action,
   g_application_quit (application);
 }
 
+static void
+tracing_action (GSimpleAction *action,
+                GVariant      *value,
+                gpointer       user_data)
+{
+  gboolean enabled = g_variant_get_boolean (value);
+
+  g_assert (G_IS_SIMPLE_ACTION (action));
+
+  valent_trace_set_enabled (enabled);
+  g_simple_action_set_state (action,
+                             g_variant_new_boolean (valent_trace_get_enabled ()));
+}
+
 static const GActionEntry app_actions[] = {
-  { "quit", quit_action, NULL, NULL, NULL },
+  { "quit",    quit_action, NULL, NULL,    NULL           },
+  { "tracing", NULL,        NULL, "false", tracing_action },
 };
 
 
@@ -197,6 +212,7 @@ valent_application_startup (GApplication *application)
   ValentApplication *self = VALENT_APPLICATION (application);
   GHashTableIter iter;
   ValentPlugin *plugin;
+  GAction *action;
 
   g_assert (VALENT_IS_APPLICATION (application));
 
@@ -209,6 +225,14 @@ valent_application_startup (GApplication *application)
                                    G_N_ELEMENTS (app_actions),
                                    application);
 
+  /* Tracing can be toggled over D-Bus, if it was compiled in */
+  action = g_action_map_lookup_action (G_ACTION_MAP (application), "tracing");
+  g_simple_action_set_state (G_SIMPLE_ACTION (action),
+                             g_variant_new_boolean (valent_trace_get_enabled ()));
+#ifndef VALENT_ENABLE_TRACE
+  g_simple_action_set_enabled (G_SIMPLE_ACTION (action), FALSE);
+#endif /* VALENT_ENABLE_TRACE */
+
   g_hash_table_iter_init (&iter, self->plugins);
 
   while (g_hash_table_iter_next (&iter, NULL, (void **)&plugin))
@@ -8,6 +8,8 @@
 # define _GNU_SOURCE
 #endif /* _GNU_SOURCE */
 
+#include <errno.h>
+#include <stdio.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -61,30 +63,369 @@ valent_trace_log (const char     *log_domain,
 #endif /* HAVE_SYSPROF */
 }
 
-void
-valent_trace_mark (const char *strfunc,
-                   int64_t     begin_time_usec,
-                   int64_t     end_time_usec)
+
+#ifdef VALENT_ENABLE_TRACE
+/*
+ * Each thread that records an event is given a single-producer ring buffer,
+ * which is registered with the writer thread. The producer only ever advances
+ * `head` and the writer only ever advances `tail`, so recording an event never
+ * takes a lock. If the writer falls behind, events are dropped and counted.
+ */
+#define TRACE_RING_SIZE     (4096)
+#define TRACE_RING_MASK     (TRACE_RING_SIZE - 1)
+#define TRACE_DETAIL_LEN    (48)
+#define TRACE_DRAIN_USEC    (50 * G_TIME_SPAN_MILLISECOND)
+
+typedef struct
+{
+  const char       *strfunc;
+  int64_t           begin_time;
+  int64_t           end_time;
+  int64_t           value;
+  ValentTraceEvent  type;
+  char              detail[TRACE_DETAIL_LEN];
+} TraceRecord;
+
+typedef struct
 {
+  TraceRecord   records[TRACE_RING_SIZE];
+  unsigned int  head;
+  unsigned int  tail;
+  unsigned int  dropped;
+  int           closed;
+  int           tid;
+} TraceRing;
+
+static const char * const trace_event_names[] = {
+  [VALENT_TRACE_FUNCTION] =        "function",
+  [VALENT_TRACE_PACKET_RX] =       "packet-rx",
+  [VALENT_TRACE_PACKET_TX] =       "packet-tx",
+  [VALENT_TRACE_PLUGIN_DISPATCH] = "plugin-dispatch",
+  [VALENT_TRACE_TRANSFER] =        "transfer",
+};
+
+int valent_trace_enabled = FALSE;
+
+G_LOCK_DEFINE_STATIC (trace_mutex);
+G_LOCK_DEFINE_STATIC (trace_state_mutex);
+static GPtrArray *trace_rings = NULL;
+static GThread   *trace_writer = NULL;
+static GCond      trace_cond;
+static gboolean   trace_stopping = FALSE;
+static FILE      *trace_file = NULL;
+
+static void   trace_ring_release (gpointer data);
+
+static GPrivate trace_ring = G_PRIVATE_INIT (trace_ring_release);
+
+
+static void
+trace_ring_release (gpointer data)
+{
+  TraceRing *ring = data;
+
+  /* If the writer is running it frees the ring once it has been drained,
+   * otherwise any events left in the ring were recorded after tracing was
+   * stopped and the ring can be freed immediately. */
+  G_LOCK (trace_mutex);
+  if (g_atomic_pointer_get (&trace_writer) != NULL)
+    g_atomic_int_set (&ring->closed, TRUE);
+  else
+    g_ptr_array_remove_fast (trace_rings, ring);
+  G_UNLOCK (trace_mutex);
+}
+
+static TraceRing *
+trace_ring_get (void)
+{
+  TraceRing *ring = g_private_get (&trace_ring);
+
+  if G_UNLIKELY (ring == NULL)
+    {
+      ring = g_new0 (TraceRing, 1);
+#ifdef __linux__
+      ring->tid = (int)gettid ();
+#else
+      ring->tid = GPOINTER_TO_INT (g_thread_self ());
+#endif /* __linux__ */
+      g_private_set (&trace_ring, ring);
+
+      G_LOCK (trace_mutex);
+      if (trace_rings == NULL)
+        trace_rings = g_ptr_array_new_with_free_func (g_free);
+      g_ptr_array_add (trace_rings, ring);
+      G_UNLOCK (trace_mutex);
+    }
+
+  return ring;
+}
+
+static void
+trace_write_escaped (FILE       *file,
+                     const char *str)
+{
+  for (const char *c = str; *c != '\0'; c++)
+    {
+      if (*c == '"' || *c == '\\' || (unsigned char)*c < 0x20)
+        fputc ('_', file);
+      else
+        fputc (*c, file);
+    }
+}
+
+static void
+trace_write_record (const TraceRecord *record,
+                    int                tid)
+{
+  const char *category = trace_event_names[record->type];
+
 #ifdef HAVE_SYSPROF
-  G_LOCK (sysprof_mutex);
-  if G_LIKELY (sysprof)
+  if (sysprof != NULL)
     {
-      /* In case our clock is not reliable */
-      if (end_time_usec < begin_time_usec)
-        end_time_usec = begin_time_usec;
+      g_autofree char *message = NULL;
+
+      message = record->detail[0] != '\0'
+        ? g_strdup_printf ("%s: %s", record->strfunc, record->detail)
+        : NULL;
 
       sysprof_capture_writer_add_mark (sysprof,
-                                       begin_time_usec * 1000L,
+                                       record->begin_time * 1000L,
                                        current_cpu (),
                                        getpid (),
-                                       (end_time_usec - begin_time_usec) * 1000L,
+                                       (record->end_time - record->begin_time) * 1000L,
                                        "tracing",
-                                       "function",
-                                       strfunc);
+                                       category,
+                                       message ? message : record->strfunc);
+    }
+#endif /* HAVE_SYSPROF */
+
+  if (trace_file != NULL)
+    {
+      fputs (",\n{\"name\":\"", trace_file);
+      trace_write_escaped (trace_file, record->strfunc);
+      fprintf (trace_file,
+               "\",\"cat\":\"%s\",\"ph\":\"X\","
+               "\"ts\":%"G_GINT64_FORMAT",\"dur\":%"G_GINT64_FORMAT","
+               "\"pid\":%d,\"tid\":%d,"
+               "\"args\":{\"value\":%"G_GINT64_FORMAT",\"detail\":\"",
+               category,
+               record->begin_time,
+               record->end_time - record->begin_time,
+               (int)getpid (),
+               tid,
+               record->value);
+      trace_write_escaped (trace_file, record->detail);
+      fputs ("\"}}", trace_file);
+    }
+}
+
+static void
+trace_drain (void)
+{
+  G_LOCK (trace_mutex);
+#ifdef HAVE_SYSPROF
+  G_LOCK (sysprof_mutex);
+#endif /* HAVE_SYSPROF */
+
+  for (unsigned int i = trace_rings ? trace_rings->len : 0; i-- > 0;)
+    {
+      TraceRing *ring = g_ptr_array_index (trace_rings, i);
+      gboolean closed = g_atomic_int_get (&ring->closed);
+      unsigned int head = g_atomic_int_get (&ring->head);
+      unsigned int dropped;
+
+      for (unsigned int tail = ring->tail; tail != head; tail++)
+        trace_write_record (&ring->records[tail & TRACE_RING_MASK], ring->tid);
+
+      g_atomic_int_set (&ring->tail, head);
+
+      if ((dropped = g_atomic_int_and (&ring->dropped, 0)) > 0)
+        g_debug ("%s(): dropped %u events on thread %d",
+                   G_STRFUNC, dropped, ring->tid);
+
+      if (closed)
+        g_ptr_array_remove_index_fast (trace_rings, i);
     }
+
+  if (trace_file != NULL)
+    fflush (trace_file);
+
+#ifdef HAVE_SYSPROF
   G_UNLOCK (sysprof_mutex);
 #endif /* HAVE_SYSPROF */
+  G_UNLOCK (trace_mutex);
+}
+
+static gpointer
+trace_writer_thread (gpointer data)
+{
+  GMutex mutex;
+
+  g_mutex_init (&mutex);
+  g_mutex_lock (&mutex);
+
+  while (!g_atomic_int_get (&trace_stopping))
+    {
+      g_cond_wait_until (&trace_cond,
+                         &mutex,
+                         g_get_monotonic_time () + TRACE_DRAIN_USEC);
+      trace_drain ();
+    }
+
+  g_mutex_unlock (&mutex);
+  g_mutex_clear (&mutex);
+
+  return NULL;
+}
+
+static void
+trace_start (void)
+{
+  const char *path;
+
+  if (trace_writer != NULL)
+    return;
+
+  if (trace_file == NULL && (path = g_getenv ("VALENT_TRACE_FILE")) != NULL)
+    {
+      /* Chrome's trace format tolerates a missing closing bracket, so the
+       * file is valid even if the process exits unexpectedly. */
+      if ((trace_file = fopen (path, "w")) != NULL)
+        fprintf (trace_file, "[{\"name\":\"valent\",\"ph\":\"M\",\"pid\":%d}",
+                 (int)getpid ());
+      else
+        g_warning ("%s(): %s: %s", G_STRFUNC, path, g_strerror (errno));
+    }
+
+  g_atomic_int_set (&trace_stopping, FALSE);
+  trace_writer = g_thread_new ("valent-trace", trace_writer_thread, NULL);
+}
+
+static void
+trace_stop (void)
+{
+  if (trace_writer == NULL)
+    return;
+
+  g_atomic_int_set (&trace_stopping, TRUE);
+  g_cond_signal (&trace_cond);
+  g_clear_pointer (&trace_writer, g_thread_join);
+
+  /* Drain anything recorded since the last pass */
+  trace_drain ();
+
+  if (trace_file != NULL)
+    {
+      fputs ("\n]\n", trace_file);
+      g_clear_pointer (&trace_file, fclose);
+    }
+}
+
+void
+valent_trace_event (ValentTraceEvent  type,
+                    const char       *strfunc,
+                    const char       *detail,
+                    int64_t           begin_time_usec,
+                    int64_t           end_time_usec,
+                    int64_t           value)
+{
+  TraceRing *ring = trace_ring_get ();
+  TraceRecord *record;
+  unsigned int head;
+
+  head = ring->head;
+
+  if G_UNLIKELY (head - g_atomic_int_get (&ring->tail) >= TRACE_RING_SIZE)
+    {
+      g_atomic_int_inc (&ring->dropped);
+      return;
+    }
+
+  /* An instant event, or in case our clock is not reliable */
+  if (begin_time_usec == 0 || end_time_usec < begin_time_usec)
+    begin_time_usec = end_time_usec;
+
+  record = &ring->records[head & TRACE_RING_MASK];
+  record->type = type;
+  record->strfunc = strfunc;
+  record->begin_time = begin_time_usec;
+  record->end_time = end_time_usec;
+  record->value = value;
+
+  if (detail != NULL)
+    g_strlcpy (record->detail, detail, sizeof (record->detail));
+  else
+    record->detail[0] = '\0';
+
+  g_atomic_int_set (&ring->head, head + 1);
+}
+
+void
+valent_trace_mark (const char *strfunc,
+                   int64_t     begin_time_usec,
+                   int64_t     end_time_usec)
+{
+  if (!g_atomic_int_get (&valent_trace_enabled))
+    return;
+
+  valent_trace_event (VALENT_TRACE_FUNCTION,
+                      strfunc,
+                      NULL,
+                      begin_time_usec,
+                      end_time_usec,
+                      0);
+}
+#endif /* VALENT_ENABLE_TRACE */
+
+/**
+ * valent_trace_get_enabled:
+ *
+ * Get whether tracing is enabled.
+ *
+ * This always returns %FALSE if Valent was built without tracing support.
+ *
+ * Returns: %TRUE if tracing is enabled, or %FALSE if not
+ *
+ * Since: 1.0
+ */
+gboolean
+valent_trace_get_enabled (void)
+{
+#ifdef VALENT_ENABLE_TRACE
+  return g_atomic_int_get (&valent_trace_enabled);
+#else
+  return FALSE;
+#endif /* VALENT_ENABLE_TRACE */
+}
+
+/**
+ * valent_trace_set_enabled:
+ * @enabled: whether tracing should be enabled
+ *
+ * Enable or disable tracing at runtime.
+ *
+ * When enabled, trace events are recorded and periodically written to sysprof,
+ * if available, or the file named by the `VALENT_TRACE_FILE` environment
+ * variable in Chrome's trace event format.
+ *
+ * This does nothing if Valent was built without tracing support.
+ *
+ * Since: 1.0
+ */
+void
+valent_trace_set_enabled (gboolean enabled)
+{
+#ifdef VALENT_ENABLE_TRACE
+  G_LOCK (trace_state_mutex);
+  if (enabled)
+    trace_start ();
+
+  g_atomic_int_set (&valent_trace_enabled, !!enabled);
+
+  if (!enabled)
+    trace_stop ();
+  G_UNLOCK (trace_state_mutex);
+#endif /* VALENT_ENABLE_TRACE */
 }
 
 
@@ -184,6 +525,27 @@ valent_log_handler (const char     *log_domain,
   g_free (buffer);
 }
 
+#ifdef VALENT_ENABLE_DEBUG
+/*
+ * valent_debug_would_drop:
+ * @log_domain: (nullable): a log domain
+ *
+ * Check if a debug message for @log_domain would be dropped. Valent's log
+ * handler writes debug messages regardless of `G_MESSAGES_DEBUG`, so the
+ * default writer is only consulted if it is not installed.
+ *
+ * Returns: %TRUE if the message would be dropped
+ */
+gboolean
+valent_debug_would_drop (const char *log_domain)
+{
+  if (g_atomic_pointer_get (&log_channel) != NULL)
+    return log_domain != NULL && g_strv_contains (ignored_domains, log_domain);
+
+  return g_log_writer_default_would_drop (G_LOG_LEVEL_DEBUG, log_domain);
+}
+#endif /* VALENT_ENABLE_DEBUG */
+
 /**
  * valent_debug_init:
  *
@@ -195,9 +557,10 @@ valent_log_handler (const char     *log_domain,
  * If %VALENT_DEBUG_ENABLE is defined, debugging messages only useful for
  * development will be printed to the log.
  *
- * If %VALENT_TRACE_ENABLE is defined, tracing will be performed at the log
- * level %VALENT_LOG_LEVEL_TRACE. These will be passed to sysprof for profiling,
- * if available.
+ * If %VALENT_ENABLE_TRACE is defined, tracing can be enabled at runtime with
+ * valent_trace_set_enabled(). If the `VALENT_TRACE` environment variable is
+ * set, tracing will be enabled immediately. Trace events are passed to sysprof
+ * for profiling, if available.
  *
  * Since: 1.0
  */
@@ -217,7 +580,7 @@ valent_debug_init (void)
     }
   G_UNLOCK (log_mutex);
 
-#if defined(VALENT_TRACE_ENABLE) && defined(HAVE_SYSPROF)
+#if defined(VALENT_ENABLE_TRACE) && defined(HAVE_SYSPROF)
   G_LOCK (sysprof_mutex);
   if (sysprof == NULL)
     {
@@ -226,7 +589,12 @@ valent_debug_init (void)
       sysprof = sysprof_capture_writer_new_from_env (0);
     }
   G_UNLOCK (sysprof_mutex);
-#endif /* VALENT_ENABLETRACE && HAVE_SYSPROF */
+#endif /* VALENT_ENABLE_TRACE && HAVE_SYSPROF */
+
+#ifdef VALENT_ENABLE_TRACE
+  if (g_getenv ("VALENT_TRACE") != NULL)
+    valent_trace_set_enabled (TRUE);
+#endif /* VALENT_ENABLE_TRACE */
 }
 
 /**
@@ -250,7 +618,9 @@ valent_debug_clear (void)
     }
   G_UNLOCK (log_mutex);
 
-#if defined(VALENT_TRACE_ENABLE) && defined(HAVE_SYSPROF)
+  valent_trace_set_enabled (FALSE);
+
+#if defined(VALENT_ENABLE_TRACE) && defined(HAVE_SYSPROF)
   G_LOCK (sysprof_mutex);
   if (sysprof != NULL)
     {
@@ -258,7 +628,7 @@ valent_debug_clear (void)
       g_clear_pointer (&sysprof, sysprof_capture_writer_unref);
     }
   G_UNLOCK (sysprof_mutex);
-#endif /* VALENT_ENABLETRACE && HAVE_SYSPROF */
+#endif /* VALENT_ENABLE_TRACE && HAVE_SYSPROF */
 }
 
 /* LCOV_EXCL_STOP */
@@ -15,9 +15,14 @@
 #include "valent-version.h"
 
 
+#define USER_FILES_MAX (1024)
+
 static GThread *main_thread;
 static PeasEngine *default_engine = NULL;
 
+G_LOCK_DEFINE_STATIC (user_files);
+static GHashTable *user_files = NULL;
+
 
 /*
  * libvalent Constructor
@@ -159,9 +164,12 @@ valent_get_user_directory (GUserDirectory directory)
  *
  * A convenience for creating a [iface@Gio.File].
  *
- * If @unique is true, the returned file is guaranteed not to exist. If
+ * If @unique is true, the returned file is guaranteed not to have existed. If
  * @basename exists in @dirname, the resulting file's name will have a
- * parenthesized number appended to it (e.g. `image.png (2)`).
+ * parenthesized number appended to it (e.g. `image.png (2)`). The name is
+ * reserved by exclusively creating an empty file, so concurrent callers will
+ * never be given the same file. If the caller fails to write the file, it
+ * should delete it so the placeholder is not left behind.
  *
  * Returns: (transfer full): a #GFile
  *
@@ -173,23 +181,66 @@ valent_get_user_file (const char *dirname,
                       gboolean    unique)
 {
   g_autofree char *basepath = NULL;
-  g_autofree char *filepath = NULL;
   unsigned int copy_num = 0;
 
   g_return_val_if_fail (dirname != NULL, NULL);
   g_return_val_if_fail (basename != NULL, NULL);
 
   basepath = g_build_filename (dirname, basename, NULL);
-  filepath = g_strdup (basepath);
 
-  /* If a unique path is requested, loop until we find a free name */
-  while (unique && g_file_test (filepath, G_FILE_TEST_EXISTS))
+  if (!unique)
+    return g_file_new_for_path (basepath);
+
+  /* Resume from the last number allocated for this path, so that receiving
+   * many files with the same name doesn't probe every previous copy */
+  G_LOCK (user_files);
+  if (user_files == NULL)
+    user_files = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  copy_num = GPOINTER_TO_UINT (g_hash_table_lookup (user_files, basepath));
+  G_UNLOCK (user_files);
+
+  while (TRUE)
     {
-      g_free (filepath);
-      filepath = g_strdup_printf ("%s (%d)", basepath, ++copy_num);
-    }
+      g_autofree char *filepath = NULL;
+      g_autoptr (GFile) file = NULL;
+      g_autoptr (GFileOutputStream) stream = NULL;
+      g_autoptr (GError) error = NULL;
+
+      if (copy_num == 0)
+        filepath = g_strdup (basepath);
+      else
+        filepath = g_strdup_printf ("%s (%u)", basepath, copy_num);
+
+      file = g_file_new_for_path (filepath);
+      stream = g_file_create (file, G_FILE_CREATE_NONE, NULL, &error);
+
+      if (stream != NULL)
+        {
+          g_output_stream_close (G_OUTPUT_STREAM (stream), NULL, NULL);
+
+          G_LOCK (user_files);
+          if (g_hash_table_size (user_files) >= USER_FILES_MAX)
+            g_hash_table_remove_all (user_files);
+
+          g_hash_table_replace (user_files,
+                                g_strdup (basepath),
+                                GUINT_TO_POINTER (copy_num + 1));
+          G_UNLOCK (user_files);
+
+          return g_steal_pointer (&file);
+        }
 
-  return g_file_new_for_path (filepath);
+      /* If the name can't be reserved for any other reason, leave it to the
+       * caller to report the error when writing to the file */
+      if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_EXISTS))
+        {
+          g_debug ("%s(): %s", G_STRFUNC, error->message);
+          return g_steal_pointer (&file);
+        }
+
+      copy_num++;
+    }
 }
 
 /**
@@ -6,6 +6,7 @@
 
 #include "config.h"
 
+#include "valent-debug.h"
 #include "valent-macros.h"
 #include "valent-object.h"
 
@@ -22,6 +23,10 @@
  * valent_object_ref_cancellable() is called. When the object is destroyed, the
  * #GCancellable::cancel signal is emitted.
  *
+ * Property notifications emitted from other threads with
+ * valent_object_notify() are deferred to the main thread, and any properties
+ * changed before the next main loop iteration are emitted together.
+ *
  * Since: 1.0
  */
 
@@ -31,6 +36,10 @@ typedef struct
   GCancellable *cancellable;
   unsigned int  in_destruction : 1;
   unsigned int  destroyed : 1;
+
+  /* Notifications pending from other threads */
+  GPtrArray    *notify_pending;
+  int64_t       notify_queued;
 } ValentObjectPrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE (ValentObject, valent_object, G_TYPE_OBJECT)
@@ -96,39 +105,106 @@ valent_object_private_unlock (ValentObjectPrivate *priv)
 /*
  * GObject.Object::notify
  */
-typedef struct
-{
-  GRecMutex   mutex;
-  GWeakRef    object;
-  GParamSpec *pspec;
-  char       *property_name;
-} NotifyEmission;
+#ifdef VALENT_ENABLE_TRACE
+static int notify_n_sources = 0;
+static int notify_n_coalesced = 0;
+#endif
 
 static gboolean
 valent_object_notify_main (gpointer data)
 {
-  NotifyEmission *emission = data;
+  GWeakRef *ref = data;
   g_autoptr (GObject) object = NULL;
+  g_autoptr (GPtrArray) pending = NULL;
+  ValentObjectPrivate *priv;
+  G_GNUC_UNUSED int64_t queued;
+
+  g_assert (VALENT_IS_MAIN_THREAD ());
+
+  if ((object = g_weak_ref_get (ref)) == NULL)
+    return G_SOURCE_REMOVE;
+
+  priv = valent_object_get_instance_private (VALENT_OBJECT (object));
+
+  valent_object_private_lock (priv);
+  pending = g_steal_pointer (&priv->notify_pending);
+  queued = priv->notify_queued;
+  priv->notify_queued = 0;
+  valent_object_private_unlock (priv);
+
+  if (pending == NULL)
+    return G_SOURCE_REMOVE;
+
+#ifdef VALENT_ENABLE_TRACE
+  valent_trace_mark (G_STRFUNC, queued, g_get_monotonic_time ());
+  VALENT_NOTE ("%s: %u properties after %"G_GINT64_FORMAT"µs "
+               "(%i sources, %i coalesced)",
+               G_OBJECT_TYPE_NAME (object),
+               pending->len,
+               g_get_monotonic_time () - queued,
+               g_atomic_int_get (&notify_n_sources),
+               g_atomic_int_get (&notify_n_coalesced));
+#endif
+
+  /* Notifications are queued and emitted as a group, which also defers them
+   * until thawed if the object is frozen */
+  g_object_freeze_notify (object);
+  for (unsigned int i = 0; i < pending->len; i++)
+    g_object_notify_by_pspec (object, g_ptr_array_index (pending, i));
+  g_object_thaw_notify (object);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+valent_object_notify_free (gpointer data)
+{
+  GWeakRef *ref = data;
+
+  g_weak_ref_clear (ref);
+  g_free (ref);
+}
 
-  g_assert (emission != NULL);
+static void
+valent_object_notify_queue (ValentObject *object,
+                            GParamSpec   *pspec)
+{
+  ValentObjectPrivate *priv = valent_object_get_instance_private (object);
+  gboolean schedule = FALSE;
 
-  g_rec_mutex_lock (&emission->mutex);
-  if ((object = g_weak_ref_get (&emission->object)) != NULL)
+  valent_object_private_lock (priv);
+  if (priv->notify_pending == NULL)
     {
-      if (emission->pspec != NULL)
-        g_object_notify_by_pspec (object, emission->pspec);
-      else
-        g_object_notify (object, emission->property_name);
+      priv->notify_pending = g_ptr_array_new_with_free_func ((GDestroyNotify)g_param_spec_unref);
+      priv->notify_queued = g_get_monotonic_time ();
+      schedule = TRUE;
     }
 
-  g_weak_ref_clear (&emission->object);
-  g_clear_pointer (&emission->property_name, g_free);
-  g_clear_pointer (&emission->pspec, g_param_spec_unref);
-  g_rec_mutex_unlock (&emission->mutex);
-  g_rec_mutex_clear (&emission->mutex);
-  g_clear_pointer (&emission, g_free);
+  if (!g_ptr_array_find (priv->notify_pending, pspec, NULL))
+    g_ptr_array_add (priv->notify_pending, g_param_spec_ref (pspec));
+  valent_object_private_unlock (priv);
 
-  return G_SOURCE_REMOVE;
+  /* A single source is scheduled for each batch of notifications */
+  if (schedule)
+    {
+      GWeakRef *ref = g_new0 (GWeakRef, 1);
+
+      g_weak_ref_init (ref, object);
+      g_idle_add_full (G_PRIORITY_DEFAULT,
+                       valent_object_notify_main,
+                       ref,
+                       valent_object_notify_free);
+
+#ifdef VALENT_ENABLE_TRACE
+      g_atomic_int_inc (&notify_n_sources);
+#endif
+    }
+#ifdef VALENT_ENABLE_TRACE
+  else
+    {
+      g_atomic_int_inc (&notify_n_coalesced);
+    }
+#endif
 }
 
 /*
@@ -196,6 +272,7 @@ valent_object_finalize (GObject *object)
   ValentObjectPrivate *priv = valent_object_get_instance_private (self);
 
   g_clear_object (&priv->cancellable);
+  g_clear_pointer (&priv->notify_pending, g_ptr_array_unref);
   g_rec_mutex_clear (&priv->mutex);
 
   G_OBJECT_CLASS (valent_object_parent_class)->finalize (object);
@@ -515,7 +592,9 @@ valent_object_in_destruction (ValentObject *object)
  * Emit [signal@GObject.Object::notify] on @object, on the main thread.
  *
  * Like [method@GObject.Object.notify] if the caller is in the main thread,
- * otherwise the invocation is deferred to the main thread.
+ * otherwise the invocation is deferred to the main thread. Notifications from
+ * other threads are coalesced, so each property is notified once per main
+ * loop iteration.
  *
  * Since: 1.0
  */
@@ -523,7 +602,7 @@ void
 valent_object_notify (ValentObject *object,
                       const char   *property_name)
 {
-  NotifyEmission *emission = NULL;
+  GParamSpec *pspec;
 
   g_return_if_fail (VALENT_IS_OBJECT (object));
   g_return_if_fail (property_name != NULL);
@@ -534,17 +613,19 @@ valent_object_notify (ValentObject *object,
       return;
     }
 
-  emission = g_new0 (NotifyEmission, 1);
-  g_rec_mutex_init (&emission->mutex);
-  g_rec_mutex_lock (&emission->mutex);
-  g_weak_ref_init (&emission->object, object);
-  emission->property_name = g_strdup (property_name);
-  g_rec_mutex_unlock (&emission->mutex);
-
-  g_idle_add_full (G_PRIORITY_DEFAULT,
-                   valent_object_notify_main,
-                   g_steal_pointer (&emission),
-                   NULL);
+  pspec = g_object_class_find_property (G_OBJECT_GET_CLASS (object),
+                                        property_name);
+
+  if G_UNLIKELY (pspec == NULL)
+    {
+      g_critical ("%s: object class '%s' has no property named '%s'",
+                  G_STRFUNC,
+                  G_OBJECT_TYPE_NAME (object),
+                  property_name);
+      return;
+    }
+
+  valent_object_notify_queue (object, pspec);
 }
 
 /**
@@ -556,6 +637,8 @@ valent_object_notify (ValentObject *object,
  *
  * Like [method@GObject.Object.notify_by_pspec] if the caller is in the main
  * thread, otherwise the invocation is deferred to the main thread.
+ * Notifications from other threads are coalesced, so each property is
+ * notified once per main loop iteration.
  *
  * Since: 1.0
  */
@@ -563,8 +646,6 @@ void
 valent_object_notify_by_pspec (ValentObject *object,
                                GParamSpec   *pspec)
 {
-  NotifyEmission *emission = NULL;
-
   g_return_if_fail (VALENT_IS_OBJECT (object));
   g_return_if_fail (G_IS_PARAM_SPEC (pspec));
 
@@ -574,15 +655,5 @@ valent_object_notify_by_pspec (ValentObject *object,
       return;
     }
 
-  emission = g_new0 (NotifyEmission, 1);
-  g_rec_mutex_init (&emission->mutex);
-  g_rec_mutex_lock (&emission->mutex);
-  g_weak_ref_init (&emission->object, object);
-  emission->pspec = g_param_spec_ref (pspec);
-  g_rec_mutex_unlock (&emission->mutex);
-
-  g_idle_add_full (G_PRIORITY_DEFAULT,
-                   valent_object_notify_main,
-                   g_steal_pointer (&emission),
-                   NULL);
+  valent_object_notify_queue (object, pspec);
 }
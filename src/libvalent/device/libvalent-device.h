@@ -14,6 +14,7 @@ G_BEGIN_DECLS
 #include "valent-device-plugin.h"
 #include "valent-device-transfer.h"
 #include "valent-packet.h"
+#include "valent-packet-stream.h"
 
 G_END_DECLS
 
@@ -0,0 +1,45 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#pragma once
+
+#include "valent-channel.h"
+#include "valent-device-metrics.h"
+#include "valent-packet-stream.h"
+#include "valent-packet-view.h"
+
+G_BEGIN_DECLS
+
+/**
+ * ValentChannelStreamFunc:
+ * @channel: a `ValentChannel`
+ * @stream: a `ValentPacketStream`
+ * @user_data: user supplied data
+ *
+ * Called when a packet read by valent_channel_read_view() begins streaming.
+ */
+typedef void (*ValentChannelStreamFunc) (ValentChannel      *channel,
+                                         ValentPacketStream *stream,
+                                         gpointer            user_data);
+
+_VALENT_EXTERN
+unsigned int       valent_channel_get_queue_depth  (ValentChannel            *channel,
+                                                    unsigned int             *max_depth);
+_VALENT_EXTERN
+void               valent_channel_set_metrics      (ValentChannel            *channel,
+                                                    ValentDeviceMetrics      *metrics);
+_VALENT_EXTERN
+void               valent_channel_read_view        (ValentChannel            *channel,
+                                                    GHashTable               *streams,
+                                                    ValentChannelStreamFunc   stream_func,
+                                                    GCancellable             *cancellable,
+                                                    GAsyncReadyCallback       callback,
+                                                    gpointer                  user_data);
+_VALENT_EXTERN
+ValentPacketView * valent_channel_read_view_finish (ValentChannel            *channel,
+                                                    GAsyncResult             *result,
+                                                    gboolean                 *streamed,
+                                                    GError                  **error);
+
+G_END_DECLS
+
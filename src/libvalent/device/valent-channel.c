@@ -12,7 +12,15 @@
 #include <libvalent-core.h>
 
 #include "valent-channel.h"
+#include "valent-channel-private.h"
+#include "valent-device-metrics.h"
 #include "valent-packet.h"
+#include "valent-packet-stream-private.h"
+#include "valent-packet-view.h"
+#include "valent-transfer-scheduler.h"
+
+/* Payloads this size or larger, or of an unknown size, are bulk transfers */
+#define TRANSFER_BULK_SIZE (1024 * 1024)
 
 
 /**
@@ -46,6 +54,25 @@
  * Since: 1.0
  */
 
+/*< private >
+ * ChannelWriter:
+ * @loop: the loop of the writer thread
+ * @bulk: bulk packets waiting to be serialized
+ * @bulk_task: (nullable): the bulk packet being serialized
+ *
+ * The state of the writer thread, shared with the channel.
+ *
+ * Bulk packets are serialized in a thread of their own, one at a time, so that
+ * packets of a higher priority can be written in the meantime. Except for
+ * @loop, the members are only accessed from the writer thread.
+ */
+typedef struct
+{
+  GMainLoop *loop;
+  GQueue     bulk;
+  GTask     *bulk_task;
+} ChannelWriter;
+
 typedef struct
 {
   GIOStream        *base_stream;
@@ -54,7 +81,12 @@ typedef struct
 
   /* Packet Buffer */
   GDataInputStream *input_buffer;
-  GMainLoop        *output_buffer;
+  ChannelWriter    *output_buffer;
+  int               queue_depth;
+  int               queue_depth_max;
+
+  /* Metrics */
+  ValentDeviceMetrics *metrics;
 } ValentChannelPrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE (ValentChannel, valent_channel, VALENT_TYPE_OBJECT)
@@ -115,10 +147,7 @@ valent_channel_real_download_task (GTask        *task,
   if (g_task_return_error_if_cancelled (task))
     return;
 
-  stream = VALENT_CHANNEL_GET_CLASS (self)->download (self,
-                                                      packet,
-                                                      cancellable,
-                                                      &error);
+  stream = valent_channel_download (self, packet, cancellable, &error);
 
   if (stream == NULL)
     return g_task_return_error (task, error);
@@ -187,10 +216,7 @@ valent_channel_upload_task (GTask        *task,
   if (g_task_return_error_if_cancelled (task))
     return;
 
-  stream = VALENT_CHANNEL_GET_CLASS (self)->upload (self,
-                                                    packet,
-                                                    cancellable,
-                                                    &error);
+  stream = valent_channel_upload (self, packet, cancellable, &error);
 
   if (stream == NULL)
     return g_task_return_error (task, error);
@@ -241,9 +267,180 @@ valent_channel_real_store_data (ValentChannel *channel,
 /* LCOV_EXCL_STOP */
 
 
+/*
+ * ChannelWriter
+ */
+static ChannelWriter *
+channel_writer_new (void)
+{
+  g_autoptr (GMainContext) context = NULL;
+  ChannelWriter *writer;
+
+  context = g_main_context_new ();
+  writer = g_atomic_rc_box_new0 (ChannelWriter);
+  writer->loop = g_main_loop_new (context, FALSE);
+  g_queue_init (&writer->bulk);
+
+  return writer;
+}
+
+static ChannelWriter *
+channel_writer_ref (ChannelWriter *writer)
+{
+  return g_atomic_rc_box_acquire (writer);
+}
+
+static void
+channel_writer_clear (gpointer data)
+{
+  ChannelWriter *writer = data;
+
+  g_assert (writer->bulk_task == NULL);
+
+  g_queue_clear_full (&writer->bulk, g_object_unref);
+  g_clear_pointer (&writer->loop, g_main_loop_unref);
+}
+
+static void
+channel_writer_unref (gpointer data)
+{
+  g_atomic_rc_box_release_full (data, channel_writer_clear);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (ChannelWriter, channel_writer_unref)
+
+/*
+ * Outgoing packets are sorted into priority classes, so a large packet queued
+ * before a small, interactive one does not delay it. Packets of the same class
+ * are written in the order they were queued.
+ */
+typedef enum
+{
+  PACKET_CLASS_INTERACTIVE,
+  PACKET_CLASS_STATE,
+  PACKET_CLASS_BULK,
+} PacketClass;
+
+static const char * const packet_class_names[] = {
+  [PACKET_CLASS_INTERACTIVE] = "interactive",
+  [PACKET_CLASS_STATE]       = "state",
+  [PACKET_CLASS_BULK]        = "bulk",
+};
+
+static const int packet_class_priorities[] = {
+  [PACKET_CLASS_INTERACTIVE] = G_PRIORITY_HIGH,
+  [PACKET_CLASS_STATE]       = G_PRIORITY_DEFAULT,
+  [PACKET_CLASS_BULK]        = G_PRIORITY_LOW,
+};
+
+static const struct
+{
+  const char  *type;
+  PacketClass  packet_class;
+} packet_classes[] = {
+  { "kdeconnect.findmyphone.request",               PACKET_CLASS_INTERACTIVE },
+  { "kdeconnect.mousepad.echo",                     PACKET_CLASS_INTERACTIVE },
+  { "kdeconnect.mousepad.keyboardstate",            PACKET_CLASS_INTERACTIVE },
+  { "kdeconnect.mousepad.request",                  PACKET_CLASS_INTERACTIVE },
+  { "kdeconnect.mpris.request",                     PACKET_CLASS_INTERACTIVE },
+  { "kdeconnect.pair",                              PACKET_CLASS_INTERACTIVE },
+  { "kdeconnect.ping",                              PACKET_CLASS_INTERACTIVE },
+  { "kdeconnect.presenter",                         PACKET_CLASS_INTERACTIVE },
+  { "kdeconnect.runcommand.request",                PACKET_CLASS_INTERACTIVE },
+  { "kdeconnect.telephony.request_mute",            PACKET_CLASS_INTERACTIVE },
+  { "kdeconnect.contacts.response_uids_timestamps", PACKET_CLASS_BULK        },
+  { "kdeconnect.contacts.response_vcards",          PACKET_CLASS_BULK        },
+  { "kdeconnect.sms.attachment_file",               PACKET_CLASS_BULK        },
+  { "kdeconnect.sms.messages",                      PACKET_CLASS_BULK        },
+};
+
+static PacketClass
+packet_class_lookup (const char *type)
+{
+  if G_UNLIKELY (type == NULL)
+    return PACKET_CLASS_STATE;
+
+  for (size_t i = 0; i < G_N_ELEMENTS (packet_classes); i++)
+    {
+      if (g_str_equal (type, packet_classes[i].type))
+        return packet_classes[i].packet_class;
+    }
+
+  return PACKET_CLASS_STATE;
+}
+
+/*
+ * Packets are queued either as a JSON node, or already serialized by
+ * valent_channel_write_bytes() with the packet type held separately.
+ */
+typedef struct
+{
+  JsonNode    *packet;
+  GBytes      *bytes;
+  char        *type;
+  PacketClass  packet_class;
+  int64_t      queued_time;
+} WritePacketData;
+
+static void
+write_packet_data_free (gpointer data)
+{
+  WritePacketData *write_data = data;
+
+  g_clear_pointer (&write_data->packet, json_node_unref);
+  g_clear_pointer (&write_data->bytes, g_bytes_unref);
+  g_clear_pointer (&write_data->type, g_free);
+  g_free (write_data);
+}
+
+static inline const char *
+write_packet_data_get_type (WritePacketData *write_data)
+{
+  if (write_data->packet != NULL)
+    return valent_packet_get_type (write_data->packet);
+
+  return write_data->type;
+}
+
+
 /*
  * ValentChannel
  */
+static GIOStream *
+valent_channel_shape_stream (ValentChannel *self,
+                             JsonNode      *packet,
+                             GIOStream     *stream)
+{
+  ValentChannelPrivate *priv = valent_channel_get_instance_private (self);
+  g_autoptr (ValentDeviceMetrics) metrics = NULL;
+  g_autofree char *device_id = NULL;
+  const char *id = NULL;
+  goffset payload_size;
+  GIOStream *ret;
+
+  valent_object_lock (VALENT_OBJECT (self));
+  if (priv->peer_identity != NULL &&
+      valent_packet_get_string (priv->peer_identity, "deviceId", &id))
+    device_id = g_strdup (id);
+  if (priv->metrics != NULL)
+    metrics = valent_device_metrics_ref (priv->metrics);
+  valent_object_unlock (VALENT_OBJECT (self));
+
+  if (device_id == NULL)
+    return stream;
+
+  payload_size = valent_packet_get_payload_size (packet);
+  ret = valent_transfer_scheduler_wrap_stream (valent_transfer_scheduler_get_default (),
+                                               stream,
+                                               device_id,
+                                               (payload_size < 0 ||
+                                                payload_size >= TRANSFER_BULK_SIZE),
+                                               metrics);
+  g_object_unref (stream);
+
+  return ret;
+}
+
 static inline gboolean
 valent_channel_return_error_if_closed (ValentChannel *self,
                                        GTask         *task)
@@ -257,8 +454,8 @@ valent_channel_return_error_if_closed (ValentChannel *self,
   if (priv->base_stream == NULL || g_io_stream_is_closed (priv->base_stream))
     {
       if (priv->output_buffer != NULL)
-        g_main_loop_quit (priv->output_buffer);
-      g_clear_pointer (&priv->output_buffer, g_main_loop_unref);
+        g_main_loop_quit (priv->output_buffer->loop);
+      g_clear_pointer (&priv->output_buffer, channel_writer_unref);
       g_clear_object (&priv->input_buffer);
       valent_object_unlock (VALENT_OBJECT (self));
 
@@ -272,22 +469,47 @@ valent_channel_return_error_if_closed (ValentChannel *self,
   return FALSE;
 }
 
+static inline void
+valent_channel_queue_push (ValentChannel *self)
+{
+  ValentChannelPrivate *priv = valent_channel_get_instance_private (self);
+  int depth, max_depth;
+
+  depth = g_atomic_int_add (&priv->queue_depth, 1) + 1;
+
+  do
+    max_depth = g_atomic_int_get (&priv->queue_depth_max);
+  while (depth > max_depth &&
+         !g_atomic_int_compare_and_exchange (&priv->queue_depth_max,
+                                             max_depth,
+                                             depth));
+}
+
+static inline void
+valent_channel_queue_pop (ValentChannel *self)
+{
+  ValentChannelPrivate *priv = valent_channel_get_instance_private (self);
+
+  g_atomic_int_add (&priv->queue_depth, -1);
+}
+
 static gpointer
 valent_channel_write_packet_worker (gpointer data)
 {
-  g_autoptr (GMainLoop) loop = (GMainLoop *)data;
-  GMainContext *context = g_main_loop_get_context (loop);
+  ChannelWriter *writer = data;
+  GMainContext *context = g_main_loop_get_context (writer->loop);
 
   /* The loop quits when the channel is closed, then the context is drained to
-   * ensure all tasks return. */
+   * ensure all tasks return, including a bulk packet being serialized. */
   g_main_context_push_thread_default (context);
 
-  g_main_loop_run (loop);
+  g_main_loop_run (writer->loop);
 
-  while (g_main_context_pending (context))
-    g_main_context_iteration (NULL, FALSE);
+  while (g_main_context_pending (context) || writer->bulk_task != NULL)
+    g_main_context_iteration (context, TRUE);
 
   g_main_context_pop_thread_default (context);
+  channel_writer_unref (writer);
 
   return NULL;
 }
@@ -302,7 +524,6 @@ valent_channel_set_base_stream (ValentChannel *self,
 
   if (base_stream != NULL)
     {
-      g_autoptr (GMainContext) context = NULL;
       GInputStream *input_stream;
       GThread *thread;
 
@@ -315,11 +536,10 @@ valent_channel_set_base_stream (ValentChannel *self,
                                          "close-base-stream", FALSE,
                                          NULL);
 
-      context = g_main_context_new ();
-      priv->output_buffer = g_main_loop_new (context, FALSE);
+      priv->output_buffer = channel_writer_new ();
       thread = g_thread_new ("valent-channel",
                              valent_channel_write_packet_worker,
-                             g_main_loop_ref (priv->output_buffer));
+                             channel_writer_ref (priv->output_buffer));
       g_clear_pointer (&thread, g_thread_unref);
       valent_object_unlock (VALENT_OBJECT (self));
     }
@@ -336,11 +556,12 @@ valent_channel_finalize (GObject *object)
   ValentChannelPrivate *priv = valent_channel_get_instance_private (self);
 
   valent_object_lock (VALENT_OBJECT (self));
-  g_clear_pointer (&priv->output_buffer, g_main_loop_unref);
+  g_clear_pointer (&priv->output_buffer, channel_writer_unref);
   g_clear_object (&priv->input_buffer);
   g_clear_object (&priv->base_stream);
   g_clear_pointer (&priv->identity, json_node_unref);
   g_clear_pointer (&priv->peer_identity, json_node_unref);
+  g_clear_pointer (&priv->metrics, valent_device_metrics_unref);
   valent_object_unlock (VALENT_OBJECT (self));
 
   G_OBJECT_CLASS (valent_channel_parent_class)->finalize (object);
@@ -610,8 +831,8 @@ valent_channel_close (ValentChannel  *channel,
       ret = g_io_stream_close (priv->base_stream, cancellable, error);
 
       if (priv->output_buffer != NULL)
-        g_main_loop_quit (priv->output_buffer);
-      g_clear_pointer (&priv->output_buffer, g_main_loop_unref);
+        g_main_loop_quit (priv->output_buffer->loop);
+      g_clear_pointer (&priv->output_buffer, channel_writer_unref);
       g_clear_object (&priv->input_buffer);
     }
   valent_object_unlock (VALENT_OBJECT (channel));
@@ -709,7 +930,9 @@ valent_channel_read_packet_task (GTask        *task,
   ValentChannel *self = VALENT_CHANNEL (source_object);
   ValentChannelPrivate *priv = valent_channel_get_instance_private (self);
   g_autoptr (GDataInputStream) stream = NULL;
+  g_autoptr (ValentDeviceMetrics) metrics = NULL;
   g_autofree char *line = NULL;
+  size_t line_len = 0;
   JsonNode *packet = NULL;
   GError *error = NULL;
 
@@ -717,9 +940,11 @@ valent_channel_read_packet_task (GTask        *task,
       return;
 
   stream = g_object_ref (priv->input_buffer);
+  if (priv->metrics != NULL)
+    metrics = valent_device_metrics_ref (priv->metrics);
   valent_object_unlock (VALENT_OBJECT (self));
 
-  line = g_data_input_stream_read_line_utf8 (stream, NULL, cancellable, &error);
+  line = g_data_input_stream_read_line_utf8 (stream, &line_len, cancellable, &error);
 
   if (error != NULL)
     return g_task_return_error (task, error);
@@ -733,6 +958,12 @@ valent_channel_read_packet_task (GTask        *task,
   if ((packet = valent_packet_deserialize (line, &error)) == NULL)
     return g_task_return_error (task, error);
 
+  /* The line terminator is counted, as it was read from the stream */
+  if (metrics != NULL)
+    valent_device_metrics_add_rx (metrics,
+                                  valent_packet_get_type (packet),
+                                  line_len + 1);
+
   g_task_return_pointer (task, packet, (GDestroyNotify)json_node_unref);
 }
 
@@ -799,33 +1030,406 @@ valent_channel_read_packet_finish (ValentChannel  *channel,
   VALENT_RETURN (ret);
 }
 
+typedef struct
+{
+  GHashTable              *streams;
+  ValentChannelStreamFunc  stream_func;
+  gpointer                 stream_data;
+  gboolean                 streamed;
+} ReadViewData;
+
+static void
+read_view_data_free (gpointer data)
+{
+  ReadViewData *view_data = data;
+
+  g_clear_pointer (&view_data->streams, g_hash_table_unref);
+  g_free (view_data);
+}
+
+typedef struct
+{
+  GTask              *task;
+  ValentPacketStream *stream;
+} StreamDispatch;
+
+static void
+stream_dispatch_free (gpointer data)
+{
+  StreamDispatch *dispatch = data;
+
+  g_clear_object (&dispatch->task);
+  g_clear_object (&dispatch->stream);
+  g_free (dispatch);
+}
+
+static gboolean
+valent_channel_read_view_dispatch (gpointer data)
+{
+  StreamDispatch *dispatch = data;
+  ValentChannel *self = g_task_get_source_object (dispatch->task);
+  ReadViewData *view_data = g_task_get_task_data (dispatch->task);
+
+  view_data->stream_func (self, dispatch->stream, view_data->stream_data);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Called from the reading thread when a packet begins streaming. The stream is
+ * handed to the context the read was started in, so that it can be consumed
+ * while the thread continues reading. */
+static void
+valent_channel_read_view_stream (ValentPacketStream *stream,
+                                 gpointer            user_data)
+{
+  GTask *task = G_TASK (user_data);
+  StreamDispatch *dispatch;
+
+  dispatch = g_new0 (StreamDispatch, 1);
+  dispatch->task = g_object_ref (task);
+  dispatch->stream = g_object_ref (stream);
+
+  g_main_context_invoke_full (g_task_get_context (task),
+                              g_task_get_priority (task),
+                              valent_channel_read_view_dispatch,
+                              g_steal_pointer (&dispatch),
+                              stream_dispatch_free);
+}
+
+static void
+valent_channel_read_view_task (GTask        *task,
+                               gpointer      source_object,
+                               gpointer      task_data,
+                               GCancellable *cancellable)
+{
+  ValentChannel *self = VALENT_CHANNEL (source_object);
+  ValentChannelPrivate *priv = valent_channel_get_instance_private (self);
+  ReadViewData *view_data = task_data;
+  g_autoptr (GDataInputStream) stream = NULL;
+  g_autoptr (ValentDeviceMetrics) metrics = NULL;
+  ValentPacketView *view = NULL;
+  size_t n_read = 0;
+  GError *error = NULL;
+
+  if (valent_channel_return_error_if_closed (self, task))
+      return;
+
+  stream = g_object_ref (priv->input_buffer);
+  if (priv->metrics != NULL)
+    metrics = valent_device_metrics_ref (priv->metrics);
+  valent_object_unlock (VALENT_OBJECT (self));
+
+  view = valent_packet_stream_read_line (G_BUFFERED_INPUT_STREAM (stream),
+                                         view_data->streams,
+                                         valent_channel_read_view_stream,
+                                         task,
+                                         &n_read,
+                                         &view_data->streamed,
+                                         cancellable,
+                                         &error);
+
+  if (view == NULL)
+    return g_task_return_error (task, error);
+
+  if (metrics != NULL)
+    valent_device_metrics_add_rx (metrics,
+                                  valent_packet_view_get_type (view),
+                                  n_read);
+
+  g_task_return_pointer (task, view, (GDestroyNotify)valent_packet_view_unref);
+}
+
+/*< private >
+ * valent_channel_read_view:
+ * @channel: a #ValentChannel
+ * @streams: (nullable): a table of packet types to streamed fields
+ * @stream_func: (nullable) (scope async): a `ValentChannelStreamFunc`
+ * @cancellable: (nullable): a #GCancellable
+ * @callback: (scope async): a #GAsyncReadyCallback
+ * @user_data: (closure): user supplied data
+ *
+ * Read the next KDE Connect packet from @channel, as a compact view.
+ *
+ * This is like [method@Valent.Channel.read_packet], except the packet is not
+ * parsed into a `JsonNode` tree, so the type can be inspected before deciding
+ * whether to build one.
+ *
+ * If the packet type is in @streams, @stream_func is invoked with a
+ * `ValentPacketStream` in the thread-default main context as soon as the body
+ * begins, and the elements of the streamed field are omitted from the result.
+ * See valent_packet_stream_read_line() for the format of @streams.
+ *
+ * Call valent_channel_read_view_finish() to get the result.
+ */
+void
+valent_channel_read_view (ValentChannel           *channel,
+                          GHashTable              *streams,
+                          ValentChannelStreamFunc  stream_func,
+                          GCancellable            *cancellable,
+                          GAsyncReadyCallback      callback,
+                          gpointer                 user_data)
+{
+  g_autoptr (GTask) task = NULL;
+  ReadViewData *view_data = NULL;
+
+  VALENT_ENTRY;
+
+  g_return_if_fail (VALENT_IS_CHANNEL (channel));
+  g_return_if_fail (streams == NULL || stream_func != NULL);
+  g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+
+  view_data = g_new0 (ReadViewData, 1);
+  view_data->streams = streams ? g_hash_table_ref (streams) : NULL;
+  view_data->stream_func = stream_func;
+  view_data->stream_data = user_data;
+
+  task = g_task_new (channel, cancellable, callback, user_data);
+  g_task_set_source_tag (task, valent_channel_read_view);
+  g_task_set_task_data (task, view_data, read_view_data_free);
+  g_task_run_in_thread (task, valent_channel_read_view_task);
+
+  VALENT_EXIT;
+}
+
+/*< private >
+ * valent_channel_read_view_finish:
+ * @channel: a #ValentChannel
+ * @result: a #GAsyncResult
+ * @streamed: (out) (optional): whether the packet was streamed
+ * @error: (nullable): a #GError
+ *
+ * Finish an operation started by valent_channel_read_view().
+ *
+ * If @streamed is %TRUE, the packet was passed to the `ValentChannelStreamFunc`
+ * and should not be handled again.
+ *
+ * Returns: (transfer full): a `ValentPacketView`, or %NULL with @error set
+ */
+ValentPacketView *
+valent_channel_read_view_finish (ValentChannel  *channel,
+                                 GAsyncResult   *result,
+                                 gboolean       *streamed,
+                                 GError        **error)
+{
+  ValentPacketView *ret;
+
+  VALENT_ENTRY;
+
+  g_return_val_if_fail (VALENT_IS_CHANNEL (channel), NULL);
+  g_return_val_if_fail (g_task_is_valid (result, channel), NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  if (streamed != NULL)
+    {
+      ReadViewData *view_data = g_task_get_task_data (G_TASK (result));
+
+      *streamed = view_data->streamed;
+    }
+
+  ret = g_task_propagate_pointer (G_TASK (result), error);
+
+  VALENT_RETURN (ret);
+}
+
+/*
+ * Write a serialized packet to the output stream, from the writer thread.
+ */
+static void
+valent_channel_write_line (ValentChannel *self,
+                           GTask         *task,
+                           const char    *packet_str,
+                           size_t         packet_len)
+{
+  ValentChannelPrivate *priv = valent_channel_get_instance_private (self);
+  WritePacketData *data = g_task_get_task_data (task);
+  g_autoptr (GOutputStream) stream = NULL;
+  g_autoptr (ValentDeviceMetrics) metrics = NULL;
+  GError *error = NULL;
+
+  if (valent_channel_return_error_if_closed (self, task))
+    return;
+
+  stream = g_object_ref (g_io_stream_get_output_stream (priv->base_stream));
+  if (priv->metrics != NULL)
+    metrics = valent_device_metrics_ref (priv->metrics);
+  valent_object_unlock (VALENT_OBJECT (self));
+
+  if (!g_output_stream_write_all (stream,
+                                  packet_str,
+                                  packet_len,
+                                  NULL,
+                                  g_task_get_cancellable (task),
+                                  &error))
+    {
+      g_task_return_error (task, error);
+      return;
+    }
+
+  if (metrics != NULL)
+    {
+      valent_device_metrics_add_tx (metrics,
+                                    write_packet_data_get_type (data),
+                                    packet_len);
+      valent_device_metrics_add_latency (metrics,
+                                         packet_class_names[data->packet_class],
+                                         g_get_monotonic_time () - data->queued_time);
+    }
+
+  g_task_return_boolean (task, TRUE);
+}
+
+static void
+valent_channel_serialize_task (GTask        *task,
+                               gpointer      source_object,
+                               gpointer      task_data,
+                               GCancellable *cancellable)
+{
+  WritePacketData *data = g_task_get_task_data (G_TASK (task_data));
+  GError *error = NULL;
+
+  if (g_task_return_error_if_cancelled (task))
+    return;
+
+  if (!valent_packet_validate (data->packet, &error))
+    {
+      g_task_return_error (task, error);
+      return;
+    }
+
+  g_task_return_pointer (task, valent_packet_serialize (data->packet), g_free);
+}
+
+static void valent_channel_write_bulk_next (ValentChannel *self,
+                                            ChannelWriter *writer);
+
+static void
+valent_channel_write_bulk_cb (ValentChannel *self,
+                              GAsyncResult  *result,
+                              ChannelWriter *writer)
+{
+  g_autoptr (GTask) task = g_steal_pointer (&writer->bulk_task);
+  g_autofree char *packet_str = NULL;
+  GError *error = NULL;
+
+  /* Dispatched at a low priority, so any packets of a higher priority queued
+   * while this one was being serialized have already been written. Like other
+   * packets, it leaves the queue when the writer thread starts writing it. */
+  valent_channel_queue_pop (self);
+  packet_str = g_task_propagate_pointer (G_TASK (result), &error);
+
+  if (packet_str != NULL)
+    valent_channel_write_line (self, task, packet_str, strlen (packet_str));
+  else
+    g_task_return_error (task, error);
+
+  if (!g_queue_is_empty (&writer->bulk))
+    valent_channel_write_bulk_next (self, writer);
+
+  channel_writer_unref (writer);
+}
+
+static void
+valent_channel_write_bulk_next (ValentChannel *self,
+                                ChannelWriter *writer)
+{
+  g_autoptr (GTask) task = NULL;
+  WritePacketData *write_data;
+
+  g_assert (writer->bulk_task == NULL);
+
+  /* Packets that are already serialized are written in turn, until one must
+   * be serialized first */
+  while ((task = g_queue_pop_head (&writer->bulk)) != NULL)
+    {
+      write_data = g_task_get_task_data (task);
+
+      if (write_data->bytes == NULL)
+        break;
+
+      valent_channel_queue_pop (self);
+      valent_channel_write_line (self,
+                                 task,
+                                 g_bytes_get_data (write_data->bytes, NULL),
+                                 g_bytes_get_size (write_data->bytes));
+      g_clear_object (&task);
+    }
+
+  if (task == NULL)
+    return;
+
+  writer->bulk_task = g_steal_pointer (&task);
+
+  task = g_task_new (self,
+                     g_task_get_cancellable (writer->bulk_task),
+                     (GAsyncReadyCallback)valent_channel_write_bulk_cb,
+                     channel_writer_ref (writer));
+  g_task_set_source_tag (task, valent_channel_write_bulk_next);
+  g_task_set_priority (task, G_PRIORITY_LOW);
+  g_task_set_task_data (task,
+                        g_object_ref (writer->bulk_task),
+                        g_object_unref);
+  g_task_run_in_thread (task, valent_channel_serialize_task);
+}
+
 static gboolean
 valent_channel_write_packet_func (gpointer data)
 {
   GTask *task = G_TASK (data);
   ValentChannel *self = g_task_get_source_object (task);
   ValentChannelPrivate *priv = valent_channel_get_instance_private (self);
-  g_autoptr (GOutputStream) stream = NULL;
-  JsonNode *packet = NULL;
-  GCancellable *cancellable = NULL;
+  WritePacketData *write_data = g_task_get_task_data (task);
+  g_autoptr (ChannelWriter) writer = NULL;
+  g_autofree char *packet_str = NULL;
   GError *error = NULL;
 
   g_assert (G_IS_TASK (task));
   g_assert (VALENT_IS_CHANNEL (self));
 
   if (valent_channel_return_error_if_closed (self, task))
-    return G_SOURCE_REMOVE;
+    {
+      valent_channel_queue_pop (self);
+      return G_SOURCE_REMOVE;
+    }
 
-  stream = g_object_ref (g_io_stream_get_output_stream (priv->base_stream));
+  /* Bulk packets remain in the queue until they are written */
+  if (write_data->packet_class != PACKET_CLASS_BULK)
+    valent_channel_queue_pop (self);
+
+  writer = channel_writer_ref (priv->output_buffer);
   valent_object_unlock (VALENT_OBJECT (self));
 
-  packet = g_task_get_task_data (task);
-  cancellable = g_task_get_cancellable (task);
+  /* Bulk packets are serialized in another thread, one at a time, so the
+   * writer thread is free to write packets of a higher priority. Those that
+   * are already serialized still wait their turn, to keep them in order. */
+  if (write_data->packet_class == PACKET_CLASS_BULK)
+    {
+      g_queue_push_tail (&writer->bulk, g_object_ref (task));
 
-  if (valent_packet_to_stream (stream, packet, cancellable, &error))
-    g_task_return_boolean (task, TRUE);
-  else
-    g_task_return_error (task, error);
+      if (writer->bulk_task == NULL)
+        valent_channel_write_bulk_next (self, writer);
+
+      return G_SOURCE_REMOVE;
+    }
+
+  if (write_data->bytes != NULL)
+    {
+      valent_channel_write_line (self,
+                                 task,
+                                 g_bytes_get_data (write_data->bytes, NULL),
+                                 g_bytes_get_size (write_data->bytes));
+      return G_SOURCE_REMOVE;
+    }
+
+  /* Serialize the packet here, rather than with valent_packet_to_stream(), so
+   * the size is known for the metrics */
+  if (!valent_packet_validate (write_data->packet, &error))
+    {
+      g_task_return_error (task, error);
+      return G_SOURCE_REMOVE;
+    }
+
+  packet_str = valent_packet_serialize (write_data->packet);
+  valent_channel_write_line (self, task, packet_str, strlen (packet_str));
 
   return G_SOURCE_REMOVE;
 }
@@ -843,6 +1447,12 @@ valent_channel_write_packet_func (gpointer data)
  * Internally [class@Valent.Channel] uses an outgoing packet buffer, so
  * multiple requests can be started safely from any thread.
  *
+ * Packets are written by priority, according to their type. Interactive
+ * packets, such as `kdeconnect.ping` or `kdeconnect.mousepad.request`, are
+ * written before others, while bulk packets, such as
+ * `kdeconnect.contacts.response_vcards`, are serialized in the background and
+ * written after others. Packets of the same priority are written in order.
+ *
  * Call [method@Valent.Channel.write_packet_finish] to get the result.
  *
  * Since: 1.0
@@ -856,6 +1466,7 @@ valent_channel_write_packet (ValentChannel       *channel,
 {
   ValentChannelPrivate *priv = valent_channel_get_instance_private (channel);
   g_autoptr (GTask) task = NULL;
+  WritePacketData *data = NULL;
 
   VALENT_ENTRY;
 
@@ -863,16 +1474,21 @@ valent_channel_write_packet (ValentChannel       *channel,
   g_return_if_fail (VALENT_IS_PACKET (packet));
   g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
 
+  data = g_new0 (WritePacketData, 1);
+  data->packet = json_node_ref (packet);
+  data->packet_class = packet_class_lookup (valent_packet_get_type (packet));
+  data->queued_time = g_get_monotonic_time ();
+
   task = g_task_new (channel, cancellable, callback, user_data);
   g_task_set_source_tag (task, valent_channel_write_packet);
-  g_task_set_task_data (task,
-                        json_node_ref (packet),
-                        (GDestroyNotify)json_node_unref);
+  g_task_set_priority (task, packet_class_priorities[data->packet_class]);
+  g_task_set_task_data (task, data, write_packet_data_free);
 
   if (valent_channel_return_error_if_closed (channel, task))
     VALENT_EXIT;
 
-  g_main_context_invoke_full (g_main_loop_get_context (priv->output_buffer),
+  valent_channel_queue_push (channel);
+  g_main_context_invoke_full (g_main_loop_get_context (priv->output_buffer->loop),
                               g_task_get_priority (task),
                               valent_channel_write_packet_func,
                               g_object_ref (task),
@@ -913,6 +1529,104 @@ valent_channel_write_packet_finish (ValentChannel  *channel,
   VALENT_RETURN (ret);
 }
 
+/**
+ * valent_channel_write_bytes:
+ * @channel: a #ValentChannel
+ * @type: the KDE Connect packet type of @bytes
+ * @bytes: a serialized KDE Connect packet
+ * @cancellable: (nullable): a #GCancellable
+ * @callback: (scope async): a #GAsyncReadyCallback
+ * @user_data: (closure): user supplied data
+ *
+ * Send a serialized packet over the channel.
+ *
+ * This is a variant of [method@Valent.Channel.write_packet] for packets that
+ * have already been serialized, such as by [func@Valent.packet_serialize], so
+ * that a packet sent to several channels is only serialized once. @bytes must
+ * hold a complete, newline-terminated packet without payload information.
+ *
+ * The packet is queued with the same priority as a packet of @type passed to
+ * [method@Valent.Channel.write_packet], and counted in the same metrics.
+ *
+ * Call [method@Valent.Channel.write_bytes_finish] to get the result.
+ *
+ * Since: 1.0
+ */
+void
+valent_channel_write_bytes (ValentChannel       *channel,
+                            const char          *type,
+                            GBytes              *bytes,
+                            GCancellable        *cancellable,
+                            GAsyncReadyCallback  callback,
+                            gpointer             user_data)
+{
+  ValentChannelPrivate *priv = valent_channel_get_instance_private (channel);
+  g_autoptr (GTask) task = NULL;
+  WritePacketData *data = NULL;
+
+  VALENT_ENTRY;
+
+  g_return_if_fail (VALENT_IS_CHANNEL (channel));
+  g_return_if_fail (type != NULL && *type != '\0');
+  g_return_if_fail (bytes != NULL);
+  g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+
+  data = g_new0 (WritePacketData, 1);
+  data->bytes = g_bytes_ref (bytes);
+  data->type = g_strdup (type);
+  data->packet_class = packet_class_lookup (type);
+  data->queued_time = g_get_monotonic_time ();
+
+  task = g_task_new (channel, cancellable, callback, user_data);
+  g_task_set_source_tag (task, valent_channel_write_bytes);
+  g_task_set_priority (task, packet_class_priorities[data->packet_class]);
+  g_task_set_task_data (task, data, write_packet_data_free);
+
+  if (valent_channel_return_error_if_closed (channel, task))
+    VALENT_EXIT;
+
+  valent_channel_queue_push (channel);
+  g_main_context_invoke_full (g_main_loop_get_context (priv->output_buffer->loop),
+                              g_task_get_priority (task),
+                              valent_channel_write_packet_func,
+                              g_object_ref (task),
+                              g_object_unref);
+
+  valent_object_unlock (VALENT_OBJECT (channel));
+
+  VALENT_EXIT;
+}
+
+/**
+ * valent_channel_write_bytes_finish:
+ * @channel: a #ValentChannel
+ * @result: a #GAsyncResult
+ * @error: (nullable): a #GError
+ *
+ * Finish an operation started by [method@Valent.Channel.write_bytes].
+ *
+ * Returns: %TRUE if successful, or %FALSE with @error set
+ *
+ * Since: 1.0
+ */
+gboolean
+valent_channel_write_bytes_finish (ValentChannel  *channel,
+                                   GAsyncResult   *result,
+                                   GError        **error)
+{
+  gboolean ret;
+
+  VALENT_ENTRY;
+
+  g_return_val_if_fail (VALENT_IS_CHANNEL (channel), FALSE);
+  g_return_val_if_fail (g_task_is_valid (result, channel), FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  ret = g_task_propagate_boolean (G_TASK (result), error);
+
+  VALENT_RETURN (ret);
+}
+
 /**
  * valent_channel_store_data: (virtual store_data)
  * @channel: a #ValentChannel
@@ -959,6 +1673,9 @@ valent_channel_store_data (ValentChannel *channel,
  * `payloadTransferInfo` dictionary on the same host as the channel. When the
  * connection is accepted the caller can perform operations on it as required.
  *
+ * Reads from the resulting stream are scheduled with other payload transfers,
+ * subject to rate limits and pausing on metered networks.
+ *
  * Returns: (transfer full) (nullable): a #GIOStream
  *
  * Since: 1.0
@@ -983,6 +1700,9 @@ valent_channel_download (ValentChannel  *channel,
                                                       cancellable,
                                                       error);
 
+  if (ret != NULL)
+    ret = valent_channel_shape_stream (channel, packet, ret);
+
   VALENT_RETURN (ret);
 }
 
@@ -1076,6 +1796,9 @@ valent_channel_download_finish (ValentChannel  *channel,
  * send the packet with that port in the `payloadTransferInfo` dictionary. When
  * a connection is accepted the caller can perform operations on it as required.
  *
+ * Writes to the resulting stream are scheduled with other payload transfers,
+ * subject to rate limits and pausing on metered networks.
+ *
  * Returns: (transfer full) (nullable): a #GIOStream
  *
  * Since: 1.0
@@ -1100,6 +1823,9 @@ valent_channel_upload (ValentChannel  *channel,
                                                     cancellable,
                                                     error);
 
+  if (ret != NULL)
+    ret = valent_channel_shape_stream (channel, packet, ret);
+
   VALENT_RETURN (ret);
 }
 
@@ -1175,3 +1901,49 @@ valent_channel_upload_finish (ValentChannel  *channel,
   VALENT_RETURN (ret);
 }
 
+
+/*< private >
+ * valent_channel_get_queue_depth:
+ * @channel: a #ValentChannel
+ * @max_depth: (out) (optional): the deepest the queue has been
+ *
+ * Get the number of packets waiting to be written to @channel.
+ *
+ * Returns: the number of queued packets
+ */
+unsigned int
+valent_channel_get_queue_depth (ValentChannel *channel,
+                                unsigned int  *max_depth)
+{
+  ValentChannelPrivate *priv = valent_channel_get_instance_private (channel);
+
+  g_return_val_if_fail (VALENT_IS_CHANNEL (channel), 0);
+
+  if (max_depth != NULL)
+    *max_depth = MAX (g_atomic_int_get (&priv->queue_depth_max), 0);
+
+  return MAX (g_atomic_int_get (&priv->queue_depth), 0);
+}
+
+/*< private >
+ * valent_channel_set_metrics:
+ * @channel: a #ValentChannel
+ * @metrics: (nullable): a `ValentDeviceMetrics`
+ *
+ * Set the metrics that packets read from and written to @channel are counted
+ * in. This is usually the metrics of the device that owns @channel.
+ */
+void
+valent_channel_set_metrics (ValentChannel       *channel,
+                            ValentDeviceMetrics *metrics)
+{
+  ValentChannelPrivate *priv = valent_channel_get_instance_private (channel);
+
+  g_return_if_fail (VALENT_IS_CHANNEL (channel));
+
+  valent_object_lock (VALENT_OBJECT (channel));
+  g_clear_pointer (&priv->metrics, valent_device_metrics_unref);
+  if (metrics != NULL)
+    priv->metrics = valent_device_metrics_ref (metrics);
+  valent_object_unlock (VALENT_OBJECT (channel));
+}
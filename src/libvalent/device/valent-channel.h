@@ -117,6 +117,17 @@ gboolean     valent_channel_write_packet_finish  (ValentChannel        *channel,
                                                   GAsyncResult         *result,
                                                   GError              **error);
 VALENT_AVAILABLE_IN_1_0
+void         valent_channel_write_bytes          (ValentChannel        *channel,
+                                                  const char           *type,
+                                                  GBytes               *bytes,
+                                                  GCancellable         *cancellable,
+                                                  GAsyncReadyCallback   callback,
+                                                  gpointer              user_data);
+VALENT_AVAILABLE_IN_1_0
+gboolean     valent_channel_write_bytes_finish   (ValentChannel        *channel,
+                                                  GAsyncResult         *result,
+                                                  GError              **error);
+VALENT_AVAILABLE_IN_1_0
 gboolean     valent_channel_close                (ValentChannel        *channel,
                                                   GCancellable         *cancellable,
                                                   GError              **error);
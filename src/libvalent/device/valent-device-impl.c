@@ -7,6 +7,7 @@
 
 #include "valent-device.h"
 #include "valent-device-impl.h"
+#include "valent-device-private.h"
 
 
 struct _ValentDeviceImpl
@@ -73,10 +74,35 @@ static const GDBusPropertyInfo * const iface_properties[] = {
   NULL,
 };
 
+static const GDBusArgInfo iface_method_get_metrics_out_metrics = {
+  -1,
+  "metrics",
+  "a{sv}",
+  NULL
+};
+
+static const GDBusArgInfo * const iface_method_get_metrics_out[] = {
+  &iface_method_get_metrics_out_metrics,
+  NULL,
+};
+
+static const GDBusMethodInfo iface_method_get_metrics = {
+  -1,
+  "GetMetrics",
+  NULL,
+  (GDBusArgInfo **)&iface_method_get_metrics_out,
+  NULL
+};
+
+static const GDBusMethodInfo * const iface_methods[] = {
+  &iface_method_get_metrics,
+  NULL,
+};
+
 static const GDBusInterfaceInfo iface_info = {
   -1,
   "ca.andyholmes.Valent.Device",
-  NULL,
+  (GDBusMethodInfo **)&iface_methods,
   NULL,
   (GDBusPropertyInfo **)&iface_properties,
   NULL
@@ -196,6 +222,17 @@ valent_device_impl_method_call (GDBusConnection       *connection,
                                 GDBusMethodInvocation *invocation,
                                 void                  *user_data)
 {
+  ValentDeviceImpl *self = VALENT_DEVICE_IMPL (user_data);
+
+  if (g_str_equal (method_name, "GetMetrics"))
+    {
+      GVariant *metrics = valent_device_dup_metrics (self->device);
+
+      g_dbus_method_invocation_return_value (invocation,
+                                             g_variant_new ("(@a{sv})", metrics));
+      return;
+    }
+
   g_dbus_method_invocation_return_error (invocation,
                                          G_DBUS_ERROR,
                                          G_DBUS_ERROR_UNKNOWN_METHOD,
@@ -5,7 +5,11 @@
 
 #include "config.h"
 
+#include <errno.h>
+
+#include <glib/gstdio.h>
 #include <gio/gio.h>
+#include <gio/gfiledescriptorbased.h>
 #include <libvalent-core.h>
 
 #include "../core/valent-component-private.h"
@@ -17,9 +21,18 @@
 #include "valent-device-manager.h"
 #include "valent-device-private.h"
 #include "valent-packet.h"
+#include "valent-transfer-scheduler.h"
 
 #define DEVICE_UNPAIRED_MAX (10)
 
+/* Remembered devices are stored as a log of newline-delimited JSON records,
+ * each either an identity or a tombstone for a device ID. The log is rewritten
+ * once it holds this many records per remembered device. */
+#define STATE_FILE          "devices.log"
+#define STATE_FILE_LEGACY   "devices.json"
+#define STATE_COMPACT_RATIO (4)
+#define STATE_COMPACT_MIN   (64)
+
 
 /**
  * ValentDeviceManager:
@@ -49,11 +62,18 @@ struct _ValentDeviceManager
   GHashTable               *plugins;
   ValentContext            *plugins_context;
   JsonNode                 *state;
+  JsonObject               *state_pending;
+  GThreadPool              *state_writer;
+  unsigned int              state_records;
+  unsigned int              state_loading : 1;
 
   GDBusObjectManagerServer *dbus;
   GHashTable               *exported;
 };
 
+static void           valent_device_manager_state_set     (ValentDeviceManager *manager,
+                                                           const char          *device_id,
+                                                           JsonNode            *identity);
 static void           valent_device_manager_add_device    (ValentDeviceManager *manager,
                                                            ValentDevice        *device);
 static void           valent_device_manager_remove_device (ValentDeviceManager *manager,
@@ -478,18 +498,18 @@ on_device_state (ValentDevice        *device,
         return;
 
       identity = valent_channel_get_peer_identity (channel);
-
-      json_object_set_object_member (json_node_get_object (self->state),
-                                     valent_device_get_id (device),
-                                     json_node_dup_object (identity));
+      valent_device_manager_state_set (self,
+                                       valent_device_get_id (device),
+                                       identity);
     }
 
   /* Devices that become disconnected and unpaired are forgotten */
   if ((state & VALENT_DEVICE_STATE_CONNECTED) == 0 &&
       (state & VALENT_DEVICE_STATE_PAIRED) == 0)
     {
-      json_object_remove_member (json_node_get_object (self->state),
-                                 valent_device_get_id (device));
+      valent_device_manager_state_set (self,
+                                       valent_device_get_id (device),
+                                       NULL);
       valent_device_manager_remove_device (self, device);
     }
 }
@@ -603,61 +623,517 @@ valent_device_manager_ensure_device (ValentDeviceManager *manager,
   return valent_device_manager_lookup (manager, device_id);
 }
 
+/*
+ * Device State
+ */
+typedef struct
+{
+  GFile    *file;
+  GBytes   *data;
+  GFile    *obsolete;
+  gboolean  replace;
+} StateWrite;
+
 static void
-valent_device_manager_load_state (ValentDeviceManager *self)
+state_write_free (gpointer data)
+{
+  StateWrite *op = data;
+
+  g_clear_object (&op->file);
+  g_clear_object (&op->obsolete);
+  g_clear_pointer (&op->data, g_bytes_unref);
+  g_free (op);
+}
+
+static void
+valent_device_manager_state_worker (gpointer data,
+                                    gpointer user_data)
 {
+  StateWrite *op = data;
+  g_autoptr (GFileOutputStream) stream = NULL;
+  g_autoptr (GError) error = NULL;
+
+  /* Replacing the file is atomic, and GIO syncs the new file before renaming
+   * it over the old one */
+  if (op->replace)
+    {
+      g_file_replace_contents (op->file,
+                               g_bytes_get_data (op->data, NULL),
+                               g_bytes_get_size (op->data),
+                               NULL,
+                               FALSE,
+                               G_FILE_CREATE_PRIVATE,
+                               NULL,
+                               NULL,
+                               &error);
+      goto out;
+    }
+
+  stream = g_file_append_to (op->file, G_FILE_CREATE_PRIVATE, NULL, &error);
+
+  if (stream == NULL)
+    goto out;
+
+  if (!g_output_stream_write_all (G_OUTPUT_STREAM (stream),
+                                  g_bytes_get_data (op->data, NULL),
+                                  g_bytes_get_size (op->data),
+                                  NULL,
+                                  NULL,
+                                  &error))
+    goto out;
+
+  if (G_IS_FILE_DESCRIPTOR_BASED (stream))
+    {
+      int fd = g_file_descriptor_based_get_fd (G_FILE_DESCRIPTOR_BASED (stream));
+
+      if (g_fsync (fd) == -1)
+        g_debug ("%s(): %s", G_STRFUNC, g_strerror (errno));
+    }
+
+  g_output_stream_close (G_OUTPUT_STREAM (stream), NULL, &error);
+
+out:
+  if (error != NULL)
+    g_warning ("%s(): %s", G_STRFUNC, error->message);
+  else if (op->obsolete != NULL)
+    g_file_delete (op->obsolete, NULL, NULL);
+
+  state_write_free (op);
+}
+
+/*
+ * Queue @data to be written to the log, replacing it if @replace is %TRUE. If
+ * given, @obsolete is deleted once the write succeeds.
+ */
+static void
+valent_device_manager_state_write (ValentDeviceManager *self,
+                                   GBytes              *data,
+                                   gboolean             replace,
+                                   GFile               *obsolete)
+{
+  StateWrite *op;
+
+  g_assert (VALENT_IS_DEVICE_MANAGER (self));
+
+  /* A single worker keeps writes in order, off the main thread */
+  if (self->state_writer == NULL)
+    {
+      self->state_writer = g_thread_pool_new (valent_device_manager_state_worker,
+                                              NULL,
+                                              1,
+                                              FALSE,
+                                              NULL);
+    }
+
+  op = g_new0 (StateWrite, 1);
+  op->file = valent_context_get_cache_file (self->context, STATE_FILE);
+  op->data = g_bytes_ref (data);
+  op->obsolete = obsolete ? g_object_ref (obsolete) : NULL;
+  op->replace = replace;
+  g_thread_pool_push (self->state_writer, op, NULL);
+}
+
+static GBytes *
+valent_device_manager_state_record (const char *device_id,
+                                    JsonNode   *identity)
+{
+  g_autoptr (JsonBuilder) builder = NULL;
+  g_autoptr (JsonNode) record = NULL;
+  g_autofree char *line = NULL;
+
+  builder = json_builder_new ();
+  json_builder_begin_object (builder);
+  json_builder_set_member_name (builder, "id");
+  json_builder_add_string_value (builder, device_id);
+
+  if (identity != NULL)
+    {
+      json_builder_set_member_name (builder, "identity");
+      json_builder_add_value (builder, json_node_copy (identity));
+    }
+
+  json_builder_end_object (builder);
+  record = json_builder_get_root (builder);
+
+  line = json_to_string (record, FALSE);
+
+  return g_bytes_new_take (g_strconcat (line, "\n", NULL), strlen (line) + 1);
+}
+
+/*
+ * Rewrite the log with a single record for each remembered device.
+ */
+static void
+valent_device_manager_state_compact (ValentDeviceManager *self,
+                                     GFile               *obsolete)
+{
+  g_autoptr (GString) log = NULL;
+  g_autoptr (GBytes) data = NULL;
   JsonObjectIter iter;
   const char *device_id;
   JsonNode *identity;
 
   g_assert (VALENT_IS_DEVICE_MANAGER (self));
 
-  if (self->state == NULL)
+  log = g_string_new (NULL);
+  json_object_iter_init (&iter, json_node_get_object (self->state));
+
+  while (json_object_iter_next (&iter, &device_id, &identity))
     {
-      g_autoptr (JsonParser) parser = NULL;
-      g_autoptr (GFile) file = NULL;
+      g_autoptr (GBytes) record = NULL;
+
+      record = valent_device_manager_state_record (device_id, identity);
+      g_string_append_len (log,
+                           g_bytes_get_data (record, NULL),
+                           g_bytes_get_size (record));
+    }
+
+  self->state_records = json_object_get_size (json_node_get_object (self->state));
+
+  data = g_string_free_to_bytes (g_steal_pointer (&log));
+  valent_device_manager_state_write (self, data, TRUE, obsolete);
+}
+
+static inline void
+valent_device_manager_state_maybe_compact (ValentDeviceManager *self)
+{
+  unsigned int n_devices;
+
+  n_devices = json_object_get_size (json_node_get_object (self->state));
+
+  if (self->state_records > STATE_COMPACT_MIN &&
+      self->state_records > n_devices * STATE_COMPACT_RATIO)
+    valent_device_manager_state_compact (self, NULL);
+}
+
+/*
+ * Compare two identity packets, ignoring the `id` field, which is a timestamp
+ * that differs for every identity packet a device sends.
+ */
+static inline gboolean
+valent_device_manager_state_equal (JsonNode *identity1,
+                                   JsonNode *identity2)
+{
+  return g_str_equal (valent_packet_get_type (identity1),
+                      valent_packet_get_type (identity2)) &&
+         json_object_equal (valent_packet_get_body (identity1),
+                            valent_packet_get_body (identity2));
+}
+
+/*
+ * Update the remembered identity for @device_id, or forget it if @identity is
+ * %NULL. Only changes are written to the log.
+ */
+static void
+valent_device_manager_state_set (ValentDeviceManager *self,
+                                 const char          *device_id,
+                                 JsonNode            *identity)
+{
+  JsonObject *state;
+  JsonNode *current;
+  g_autoptr (GBytes) record = NULL;
+
+  g_assert (VALENT_IS_DEVICE_MANAGER (self));
+  g_assert (device_id != NULL);
+
+  /* Changes made while the log is being read are applied once it is loaded,
+   * with a null member standing in for a forgotten device */
+  if (self->state_loading)
+    {
+      if (identity != NULL)
+        json_object_set_member (self->state_pending,
+                                device_id,
+                                json_node_copy (identity));
+      else
+        json_object_set_null_member (self->state_pending, device_id);
+
+      return;
+    }
+
+  state = json_node_get_object (self->state);
+  current = json_object_get_member (state, device_id);
+
+  if (identity != NULL)
+    {
+      if (current != NULL && valent_device_manager_state_equal (current, identity))
+        return;
+
+      json_object_set_member (state, device_id, json_node_copy (identity));
+    }
+  else
+    {
+      if (current == NULL)
+        return;
+
+      json_object_remove_member (state, device_id);
+    }
+
+  record = valent_device_manager_state_record (device_id, identity);
+  valent_device_manager_state_write (self, record, FALSE, NULL);
+  self->state_records++;
+
+  valent_device_manager_state_maybe_compact (self);
+}
+
+/*
+ * Reading the log happens in a thread, so the state of a load is kept apart
+ * from the manager until it completes. The manager is held weakly, so it can
+ * still be finalized during a load.
+ */
+typedef struct
+{
+  GWeakRef      manager;
+  GFile        *file;
+  GFile        *legacy;
+  JsonNode     *state;
+  unsigned int  records;
+  gboolean      migrate;
+  gboolean      rewrite;
+} StateLoad;
+
+static void
+state_load_free (gpointer data)
+{
+  StateLoad *load = data;
+
+  g_weak_ref_clear (&load->manager);
+  g_clear_object (&load->file);
+  g_clear_object (&load->legacy);
+  g_clear_pointer (&load->state, json_node_unref);
+  g_free (load);
+}
+
+static gboolean
+valent_device_manager_state_load_legacy (StateLoad *load)
+{
+  g_autoptr (JsonParser) parser = NULL;
+  JsonNode *root;
+
+  if (!g_file_query_exists (load->legacy, NULL))
+    return FALSE;
+
+  parser = json_parser_new ();
+
+  if (json_parser_load_from_file (parser, g_file_peek_path (load->legacy), NULL) &&
+      (root = json_parser_get_root (parser)) != NULL &&
+      JSON_NODE_HOLDS_OBJECT (root))
+    {
+      load->state = json_parser_steal_root (parser);
+    }
+
+  /* There is nothing to migrate from an invalid file */
+  if (load->state == NULL)
+    g_file_delete (load->legacy, NULL, NULL);
+
+  return load->state != NULL;
+}
+
+/*
+ * Replay the log into the state. Returns %FALSE if the log needs to be
+ * rewritten, because the final record was interrupted and the next append
+ * would otherwise be joined to it.
+ */
+static gboolean
+valent_device_manager_state_load_log (StateLoad *load)
+{
+  g_autofree char *contents = NULL;
+  size_t length = 0;
+  JsonObject *state;
+  char *line, *next;
 
-      file = valent_context_get_cache_file (self->context, "devices.json");
+  state = json_node_get_object (load->state);
 
-      /* Try to load the state file */
-      parser = json_parser_new ();
+  if (!g_file_get_contents (g_file_peek_path (load->file), &contents, &length, NULL))
+    return TRUE;
 
-      if (json_parser_load_from_file (parser, g_file_peek_path (file), NULL))
-        self->state = json_parser_steal_root (parser);
+  for (line = contents; line < contents + length; line = next)
+    {
+      g_autoptr (JsonNode) record = NULL;
+      JsonObject *object;
+      const char *device_id;
+      JsonNode *identity;
+
+      if ((next = strchr (line, '\n')) != NULL)
+        *next++ = '\0';
+      else
+        next = contents + length;
 
-      if (self->state == NULL || !JSON_NODE_HOLDS_OBJECT (self->state))
+      if (*line == '\0')
+        continue;
+
+      /* A partial record is expected if a write was interrupted */
+      if ((record = json_from_string (line, NULL)) == NULL ||
+          !JSON_NODE_HOLDS_OBJECT (record))
         {
-          g_clear_pointer (&self->state, json_node_unref);
-          self->state = json_node_new (JSON_NODE_OBJECT);
-          json_node_take_object (self->state, json_object_new ());
+          g_debug ("%s(): skipping invalid record", G_STRFUNC);
+          continue;
         }
+
+      object = json_node_get_object (record);
+
+      if ((device_id = json_object_get_string_member_with_default (object, "id", NULL)) == NULL)
+        continue;
+
+      identity = json_object_get_member (object, "identity");
+
+      if (identity != NULL && VALENT_IS_PACKET (identity))
+        json_object_set_member (state, device_id, json_node_copy (identity));
+      else
+        json_object_remove_member (state, device_id);
+
+      load->records++;
     }
 
-  /* Load devices */
+  return length == 0 || contents[length - 1] == '\n';
+}
+
+static void
+valent_device_manager_state_load_task (GTask        *task,
+                                       gpointer      source_object,
+                                       gpointer      task_data,
+                                       GCancellable *cancellable)
+{
+  StateLoad *load = task_data;
+
+  /* The legacy file is migrated if it exists, otherwise the log is replayed */
+  if (valent_device_manager_state_load_legacy (load))
+    {
+      load->migrate = TRUE;
+    }
+  else
+    {
+      load->state = json_node_new (JSON_NODE_OBJECT);
+      json_node_take_object (load->state, json_object_new ());
+      load->rewrite = !valent_device_manager_state_load_log (load);
+    }
+
+  g_task_return_boolean (task, TRUE);
+}
+
+/*
+ * Create a device for each remembered identity.
+ */
+static void
+valent_device_manager_state_ensure_devices (ValentDeviceManager *self)
+{
+  JsonObjectIter iter;
+  const char *device_id;
+  JsonNode *identity;
+
+  g_assert (VALENT_IS_DEVICE_MANAGER (self));
+
   json_object_iter_init (&iter, json_node_get_object (self->state));
 
+  /* Devices are dormant until connected or used, so this should scale with
+   * the number of remembered identities rather than the number of plugins */
   while (json_object_iter_next (&iter, &device_id, &identity))
     valent_device_manager_ensure_device (self, identity);
+
+  VALENT_NOTE ("Loaded %u remembered devices", self->devices->len);
 }
 
 static void
-valent_device_manager_save_state (ValentDeviceManager *self)
+valent_device_manager_load_state_cb (GObject      *object,
+                                     GAsyncResult *result,
+                                     gpointer      user_data)
 {
-  g_autoptr (JsonGenerator) generator = NULL;
-  g_autoptr (GFile) file = NULL;
-  g_autoptr (GError) error = NULL;
+  StateLoad *load = g_task_get_task_data (G_TASK (result));
+  g_autoptr (ValentDeviceManager) self = NULL;
+  g_autoptr (JsonObject) pending = NULL;
+  JsonObjectIter iter;
+  const char *device_id;
+  JsonNode *identity;
+
+  VALENT_ENTRY;
+
+  if ((self = g_weak_ref_get (&load->manager)) == NULL)
+    VALENT_EXIT;
+
+  self->state = g_steal_pointer (&load->state);
+  self->state_records = load->records;
+  self->state_loading = FALSE;
+
+  /* The legacy file is removed once the compacted log is written */
+  if (load->migrate)
+    valent_device_manager_state_compact (self, load->legacy);
+  else if (load->rewrite)
+    valent_device_manager_state_compact (self, NULL);
+  else
+    valent_device_manager_state_maybe_compact (self);
+
+  /* Apply changes made while loading, in case a remembered device was paired
+   * or forgotten in the meantime */
+  pending = g_steal_pointer (&self->state_pending);
+  json_object_iter_init (&iter, pending);
+
+  while (json_object_iter_next (&iter, &device_id, &identity))
+    {
+      valent_device_manager_state_set (self,
+                                       device_id,
+                                       JSON_NODE_HOLDS_NULL (identity) ? NULL : identity);
+    }
+
+  /* The manager may have been stopped while loading */
+  if (self->cancellable != NULL)
+    valent_device_manager_state_ensure_devices (self);
+
+  VALENT_EXIT;
+}
+
+/*
+ * Load the remembered devices. The log is read and replayed in a thread, since
+ * it grows with the history of every device ever paired, then devices are
+ * created for the remembered identities when it completes.
+ */
+static void
+valent_device_manager_load_state (ValentDeviceManager *self)
+{
+  g_autoptr (GTask) task = NULL;
+  StateLoad *load;
+
+  VALENT_ENTRY;
 
   g_assert (VALENT_IS_DEVICE_MANAGER (self));
 
-  generator = g_object_new (JSON_TYPE_GENERATOR,
-                            "pretty", TRUE,
-                            "root",   self->state,
-                            NULL);
+  /* The state is kept after the manager is stopped, so a restart only has to
+   * recreate the devices. If an earlier load is still running, it will. */
+  if (self->state != NULL)
+    {
+      valent_device_manager_state_ensure_devices (self);
+      VALENT_EXIT;
+    }
+
+  if (self->state_loading)
+    VALENT_EXIT;
 
-  file = valent_context_get_cache_file (self->context, "devices.json");
+  load = g_new0 (StateLoad, 1);
+  g_weak_ref_init (&load->manager, self);
+  load->file = valent_context_get_cache_file (self->context, STATE_FILE);
+  load->legacy = valent_context_get_cache_file (self->context, STATE_FILE_LEGACY);
 
-  if (!json_generator_to_file (generator, g_file_peek_path (file), &error))
-    g_warning ("%s(): %s", G_STRFUNC, error->message);
+  self->state_loading = TRUE;
+  self->state_pending = json_object_new ();
+
+  task = g_task_new (NULL, NULL, valent_device_manager_load_state_cb, NULL);
+  g_task_set_source_tag (task, valent_device_manager_load_state);
+  g_task_set_task_data (task, load, state_load_free);
+  g_task_run_in_thread (task, valent_device_manager_state_load_task);
+
+  VALENT_EXIT;
+}
+
+static void
+valent_device_manager_save_state (ValentDeviceManager *self)
+{
+  g_assert (VALENT_IS_DEVICE_MANAGER (self));
+
+  /* Changes are written as they happen, so this only waits for any pending
+   * writes to complete */
+  if (self->state_writer != NULL)
+    {
+      g_thread_pool_free (self->state_writer, FALSE, TRUE);
+      self->state_writer = NULL;
+    }
 }
 
 /*
@@ -804,6 +1280,25 @@ valent_device_manager_shutdown (ValentApplicationPlugin *plugin)
     }
 }
 
+static void
+on_transfer_settings_changed (GSettings           *settings,
+                              const char          *key,
+                              ValentDeviceManager *self)
+{
+  ValentTransferScheduler *scheduler = valent_transfer_scheduler_get_default ();
+  uint64_t rate_limit;
+  gboolean pause_metered;
+
+  g_assert (G_IS_SETTINGS (settings));
+  g_assert (VALENT_IS_DEVICE_MANAGER (self));
+
+  rate_limit = g_settings_get_uint (settings, "transfer-rate-limit");
+  valent_transfer_scheduler_set_rate_limit (scheduler, NULL, rate_limit * 1024);
+
+  pause_metered = g_settings_get_boolean (settings, "pause-metered-transfers");
+  valent_transfer_scheduler_set_pause_metered (scheduler, pause_metered);
+}
+
 static void
 valent_device_manager_startup (ValentApplicationPlugin *plugin)
 {
@@ -828,6 +1323,18 @@ valent_device_manager_startup (ValentApplicationPlugin *plugin)
   valent_device_manager_set_name (self, name);
   valent_device_manager_load_state (self);
 
+  g_signal_connect_object (self->settings,
+                           "changed::transfer-rate-limit",
+                           G_CALLBACK (on_transfer_settings_changed),
+                           self,
+                           0);
+  g_signal_connect_object (self->settings,
+                           "changed::pause-metered-transfers",
+                           G_CALLBACK (on_transfer_settings_changed),
+                           self,
+                           0);
+  on_transfer_settings_changed (self->settings, NULL, self);
+
   /* Setup services */
   engine = valent_get_plugin_engine ();
   plugins = peas_engine_get_plugin_list (engine);
@@ -907,11 +1414,14 @@ valent_device_manager_finalize (GObject *object)
 {
   ValentDeviceManager *self = VALENT_DEVICE_MANAGER (object);
 
+  valent_device_manager_save_state (self);
+
   g_clear_pointer (&self->exported, g_hash_table_unref);
   g_clear_pointer (&self->plugins, g_hash_table_unref);
   g_clear_pointer (&self->plugins_context, g_object_unref);
   g_clear_pointer (&self->devices, g_ptr_array_unref);
   g_clear_pointer (&self->state, json_node_unref);
+  g_clear_pointer (&self->state_pending, json_object_unref);
 
   g_clear_object (&self->certificate);
   g_clear_object (&self->context);
@@ -1093,3 +1603,61 @@ valent_device_manager_refresh (ValentDeviceManager *manager)
   VALENT_EXIT;
 }
 
+/**
+ * valent_device_manager_broadcast_packet:
+ * @manager: a #ValentDeviceManager
+ * @packet: a KDE Connect packet
+ *
+ * Send @packet to every device that can receive it.
+ *
+ * The packet is serialized once and the same buffer is queued on the channel
+ * of each device that is connected, paired and lists the packet type in its
+ * incoming capabilities. This is more efficient than sending the same packet
+ * to each device with [method@Valent.Device.send_packet].
+ *
+ * The `id` field of @packet is updated when it is serialized. Packets with
+ * payloads can not be broadcast, since payload information is specific to
+ * each channel.
+ *
+ * Returns: the number of devices the packet was queued for
+ *
+ * Since: 1.0
+ */
+unsigned int
+valent_device_manager_broadcast_packet (ValentDeviceManager *manager,
+                                        JsonNode            *packet)
+{
+  g_autoptr (GBytes) bytes = NULL;
+  g_autoptr (GError) error = NULL;
+  const char *type;
+  char *data;
+  unsigned int n_queued = 0;
+
+  VALENT_ENTRY;
+
+  g_return_val_if_fail (VALENT_IS_DEVICE_MANAGER (manager), 0);
+  g_return_val_if_fail (VALENT_IS_PACKET (packet), 0);
+  g_return_val_if_fail (!valent_packet_has_payload (packet), 0);
+
+  if (!valent_packet_validate (packet, &error))
+    {
+      g_critical ("%s(): %s", G_STRFUNC, error->message);
+      VALENT_RETURN (0);
+    }
+
+  type = valent_packet_get_type (packet);
+  data = valent_packet_serialize (packet);
+  bytes = g_bytes_new_take (data, strlen (data));
+
+  for (unsigned int i = 0, len = manager->devices->len; i < len; i++)
+    {
+      ValentDevice *device = g_ptr_array_index (manager->devices, i);
+
+      if (valent_device_send_bytes (device, type, bytes))
+        n_queued++;
+    }
+
+  VALENT_NOTE ("%s: queued for %u devices", type, n_queued);
+
+  VALENT_RETURN (n_queued);
+}
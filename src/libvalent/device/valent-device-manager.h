@@ -7,6 +7,8 @@
 # error "Only <valent.h> can be included directly."
 #endif
 
+#include <json-glib/json-glib.h>
+
 #include "../core/valent-application-plugin.h"
 
 G_BEGIN_DECLS
@@ -26,5 +28,8 @@ void                  valent_device_manager_set_name    (ValentDeviceManager  *m
                                                          const char           *name);
 VALENT_AVAILABLE_IN_1_0
 void                  valent_device_manager_refresh     (ValentDeviceManager  *manager);
+VALENT_AVAILABLE_IN_1_0
+unsigned int          valent_device_manager_broadcast_packet (ValentDeviceManager  *manager,
+                                                              JsonNode             *packet);
 
 G_END_DECLS
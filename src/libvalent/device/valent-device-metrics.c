@@ -0,0 +1,514 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#define G_LOG_DOMAIN "valent-device-metrics"
+
+#include "config.h"
+
+#include <glib.h>
+
+#include "valent-device-metrics.h"
+
+/* The number of packet types counted separately; any others are counted
+ * together, so a remote device can not grow the table without bound. */
+#define METRICS_MAX_TYPES   (256)
+#define METRICS_OTHER_TYPE  "other"
+
+/* Handler durations are counted in buckets of powers of four, from 16µs */
+#define HANDLER_N_BUCKETS   (8)
+#define HANDLER_BUCKET_BASE (16)
+
+
+/*< private >
+ * ValentDeviceMetrics:
+ *
+ * Traffic counters for a device.
+ *
+ * Counters are updated from the channel threads and the main thread with
+ * atomic operations. The tables of packet types and handlers are guarded by a
+ * mutex, but entries are never removed, so the lock is only held to find an
+ * entry.
+ *
+ * The counters are 64-bit on all platforms, so they don't wrap at 4GiB on
+ * 32-bit systems. If the platform has no lock-free 64-bit atomics, a lock is
+ * taken instead.
+ */
+#ifdef __GCC_HAVE_SYNC_COMPARE_AND_SWAP_8
+typedef uint64_t Counter __attribute__ ((aligned (8)));
+#else
+typedef uint64_t Counter;
+
+G_LOCK_DEFINE_STATIC (counter_lock);
+#endif /* __GCC_HAVE_SYNC_COMPARE_AND_SWAP_8 */
+
+typedef struct
+{
+  Counter  rx_packets;
+  Counter  rx_bytes;
+  Counter  tx_packets;
+  Counter  tx_bytes;
+} PacketCounters;
+
+typedef struct
+{
+  Counter  n_calls;
+  Counter  total_time;
+  Counter  max_time;
+  Counter  buckets[HANDLER_N_BUCKETS];
+} HandlerCounters;
+
+typedef struct
+{
+  Counter  n_transfers;
+  Counter  n_bytes;
+  Counter  total_time;
+} TransferCounters;
+
+struct _ValentDeviceMetrics
+{
+  GMutex            mutex;
+  GHashTable       *packets;
+  GHashTable       *handlers;
+  GHashTable       *latency;
+
+  PacketCounters    total;
+  TransferCounters  downloads;
+  TransferCounters  uploads;
+  Counter           throttle_time;
+};
+
+
+static inline void
+counter_add (Counter  *counter,
+             uint64_t  value)
+{
+#ifdef __GCC_HAVE_SYNC_COMPARE_AND_SWAP_8
+  __atomic_fetch_add (counter, value, __ATOMIC_RELAXED);
+#else
+  G_LOCK (counter_lock);
+  *counter += value;
+  G_UNLOCK (counter_lock);
+#endif /* __GCC_HAVE_SYNC_COMPARE_AND_SWAP_8 */
+}
+
+static inline void
+counter_set (Counter  *counter,
+             uint64_t  value)
+{
+#ifdef __GCC_HAVE_SYNC_COMPARE_AND_SWAP_8
+  __atomic_store_n (counter, value, __ATOMIC_RELAXED);
+#else
+  G_LOCK (counter_lock);
+  *counter = value;
+  G_UNLOCK (counter_lock);
+#endif /* __GCC_HAVE_SYNC_COMPARE_AND_SWAP_8 */
+}
+
+static inline uint64_t
+counter_get (Counter *counter)
+{
+#ifdef __GCC_HAVE_SYNC_COMPARE_AND_SWAP_8
+  return __atomic_load_n (counter, __ATOMIC_RELAXED);
+#else
+  uint64_t value;
+
+  G_LOCK (counter_lock);
+  value = *counter;
+  G_UNLOCK (counter_lock);
+
+  return value;
+#endif /* __GCC_HAVE_SYNC_COMPARE_AND_SWAP_8 */
+}
+
+static void
+valent_device_metrics_clear (gpointer data)
+{
+  ValentDeviceMetrics *self = data;
+
+  g_clear_pointer (&self->packets, g_hash_table_unref);
+  g_clear_pointer (&self->handlers, g_hash_table_unref);
+  g_clear_pointer (&self->latency, g_hash_table_unref);
+  g_mutex_clear (&self->mutex);
+}
+
+static PacketCounters *
+valent_device_metrics_lookup_packet (ValentDeviceMetrics *self,
+                                     const char          *type)
+{
+  PacketCounters *counters;
+
+  g_mutex_lock (&self->mutex);
+  if ((counters = g_hash_table_lookup (self->packets, type)) == NULL)
+    {
+      if (g_hash_table_size (self->packets) >= METRICS_MAX_TYPES)
+        type = METRICS_OTHER_TYPE;
+
+      if ((counters = g_hash_table_lookup (self->packets, type)) == NULL)
+        {
+          counters = g_new0 (PacketCounters, 1);
+          g_hash_table_insert (self->packets, g_strdup (type), counters);
+        }
+    }
+  g_mutex_unlock (&self->mutex);
+
+  return counters;
+}
+
+/**
+ * valent_device_metrics_new:
+ *
+ * Create a new set of device metrics.
+ *
+ * Returns: (transfer full): a `ValentDeviceMetrics`
+ */
+ValentDeviceMetrics *
+valent_device_metrics_new (void)
+{
+  ValentDeviceMetrics *self;
+
+  self = g_atomic_rc_box_new0 (ValentDeviceMetrics);
+  g_mutex_init (&self->mutex);
+  self->packets = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                         g_free, g_free);
+  self->handlers = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                          g_free, g_free);
+  self->latency = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                         g_free, g_free);
+
+  return self;
+}
+
+/**
+ * valent_device_metrics_ref:
+ * @metrics: a `ValentDeviceMetrics`
+ *
+ * Acquire a reference on @metrics.
+ *
+ * Returns: (transfer full): @metrics
+ */
+ValentDeviceMetrics *
+valent_device_metrics_ref (ValentDeviceMetrics *metrics)
+{
+  g_return_val_if_fail (metrics != NULL, NULL);
+
+  return g_atomic_rc_box_acquire (metrics);
+}
+
+/**
+ * valent_device_metrics_unref:
+ * @metrics: a `ValentDeviceMetrics`
+ *
+ * Release a reference on @metrics.
+ */
+void
+valent_device_metrics_unref (ValentDeviceMetrics *metrics)
+{
+  g_return_if_fail (metrics != NULL);
+
+  g_atomic_rc_box_release_full (metrics, valent_device_metrics_clear);
+}
+
+/**
+ * valent_device_metrics_add_rx:
+ * @metrics: a `ValentDeviceMetrics`
+ * @type: a KDE Connect packet type
+ * @n_bytes: the size of the serialized packet
+ *
+ * Count a packet of @type received from the device.
+ *
+ * This method is thread-safe.
+ */
+void
+valent_device_metrics_add_rx (ValentDeviceMetrics *metrics,
+                              const char          *type,
+                              size_t               n_bytes)
+{
+  PacketCounters *counters;
+
+  g_return_if_fail (metrics != NULL);
+  g_return_if_fail (type != NULL);
+
+  counters = valent_device_metrics_lookup_packet (metrics, type);
+  counter_add (&counters->rx_packets, 1);
+  counter_add (&counters->rx_bytes, n_bytes);
+  counter_add (&metrics->total.rx_packets, 1);
+  counter_add (&metrics->total.rx_bytes, n_bytes);
+}
+
+/**
+ * valent_device_metrics_add_tx:
+ * @metrics: a `ValentDeviceMetrics`
+ * @type: a KDE Connect packet type
+ * @n_bytes: the size of the serialized packet
+ *
+ * Count a packet of @type sent to the device.
+ *
+ * This method is thread-safe.
+ */
+void
+valent_device_metrics_add_tx (ValentDeviceMetrics *metrics,
+                              const char          *type,
+                              size_t               n_bytes)
+{
+  PacketCounters *counters;
+
+  g_return_if_fail (metrics != NULL);
+  g_return_if_fail (type != NULL);
+
+  counters = valent_device_metrics_lookup_packet (metrics, type);
+  counter_add (&counters->tx_packets, 1);
+  counter_add (&counters->tx_bytes, n_bytes);
+  counter_add (&metrics->total.tx_packets, 1);
+  counter_add (&metrics->total.tx_bytes, n_bytes);
+}
+
+static void
+valent_device_metrics_add_duration (ValentDeviceMetrics *self,
+                                    GHashTable          *table,
+                                    const char          *name,
+                                    int64_t              duration)
+{
+  HandlerCounters *counters;
+  unsigned int bucket = 0;
+  int64_t bound = HANDLER_BUCKET_BASE;
+
+  g_mutex_lock (&self->mutex);
+  if ((counters = g_hash_table_lookup (table, name)) == NULL)
+    {
+      counters = g_new0 (HandlerCounters, 1);
+      g_hash_table_insert (table, g_strdup (name), counters);
+    }
+  g_mutex_unlock (&self->mutex);
+
+  duration = MAX (duration, 0);
+
+  while (bucket < HANDLER_N_BUCKETS - 1 && duration >= bound)
+    {
+      bucket++;
+      bound *= 4;
+    }
+
+  counter_add (&counters->n_calls, 1);
+  counter_add (&counters->total_time, duration);
+  counter_add (&counters->buckets[bucket], 1);
+
+  if ((uint64_t)duration > counter_get (&counters->max_time))
+    counter_set (&counters->max_time, (uint64_t)duration);
+}
+
+/**
+ * valent_device_metrics_add_handler:
+ * @metrics: a `ValentDeviceMetrics`
+ * @name: the name of the packet handler
+ * @duration: the time spent handling the packet, in microseconds
+ *
+ * Count a packet handled by @name.
+ *
+ * Packets are only dispatched from the main thread, so the maximum duration is
+ * not updated atomically.
+ */
+void
+valent_device_metrics_add_handler (ValentDeviceMetrics *metrics,
+                                   const char          *name,
+                                   int64_t              duration)
+{
+  g_return_if_fail (metrics != NULL);
+  g_return_if_fail (name != NULL);
+
+  valent_device_metrics_add_duration (metrics,
+                                      metrics->handlers,
+                                      name,
+                                      duration);
+}
+
+/**
+ * valent_device_metrics_add_latency:
+ * @metrics: a `ValentDeviceMetrics`
+ * @name: the name of the packet priority class
+ * @duration: the time from queueing the packet until it was written, in
+ *   microseconds
+ *
+ * Count a packet of the priority class @name sent to the device.
+ *
+ * Packets are only written from the channel thread, so the maximum duration is
+ * not updated atomically.
+ */
+void
+valent_device_metrics_add_latency (ValentDeviceMetrics *metrics,
+                                   const char          *name,
+                                   int64_t              duration)
+{
+  g_return_if_fail (metrics != NULL);
+  g_return_if_fail (name != NULL);
+
+  valent_device_metrics_add_duration (metrics,
+                                      metrics->latency,
+                                      name,
+                                      duration);
+}
+
+/**
+ * valent_device_metrics_add_transfer:
+ * @metrics: a `ValentDeviceMetrics`
+ * @is_download: %TRUE if the payload was received
+ * @n_bytes: the size of the payload
+ * @duration: the time spent transferring the payload, in microseconds
+ *
+ * Count a payload transferred to or from the device.
+ *
+ * This method is thread-safe.
+ */
+void
+valent_device_metrics_add_transfer (ValentDeviceMetrics *metrics,
+                                    gboolean             is_download,
+                                    uint64_t             n_bytes,
+                                    int64_t              duration)
+{
+  TransferCounters *counters;
+
+  g_return_if_fail (metrics != NULL);
+
+  counters = is_download ? &metrics->downloads : &metrics->uploads;
+  counter_add (&counters->n_transfers, 1);
+  counter_add (&counters->n_bytes, n_bytes);
+  counter_add (&counters->total_time, MAX (duration, 0));
+}
+
+static void
+serialize_durations (GHashTable      *table,
+                     GVariantBuilder *builder)
+{
+  GHashTableIter iter;
+  const char *name;
+  HandlerCounters *counters;
+
+  g_hash_table_iter_init (&iter, table);
+
+  while (g_hash_table_iter_next (&iter, (void **)&name, (void **)&counters))
+    {
+      GVariantBuilder buckets;
+
+      g_variant_builder_init (&buckets, G_VARIANT_TYPE ("at"));
+
+      for (unsigned int i = 0; i < HANDLER_N_BUCKETS; i++)
+        g_variant_builder_add (&buckets, "t", counter_get (&counters->buckets[i]));
+
+      g_variant_builder_add (builder, "{s(tttat)}", name,
+                             counter_get (&counters->n_calls),
+                             counter_get (&counters->total_time),
+                             counter_get (&counters->max_time),
+                             &buckets);
+    }
+}
+
+/**
+ * valent_device_metrics_add_throttle:
+ * @metrics: a `ValentDeviceMetrics`
+ * @duration: the time a payload transfer was held back, in microseconds
+ *
+ * Count time spent waiting for the transfer scheduler.
+ *
+ * This method is thread-safe.
+ */
+void
+valent_device_metrics_add_throttle (ValentDeviceMetrics *metrics,
+                                    int64_t              duration)
+{
+  g_return_if_fail (metrics != NULL);
+
+  if (duration > 0)
+    counter_add (&metrics->throttle_time, duration);
+}
+
+/**
+ * valent_device_metrics_serialize:
+ * @metrics: a `ValentDeviceMetrics`
+ *
+ * Serialize @metrics into a dictionary.
+ *
+ * The dictionary holds the totals for the device as `t` values, named
+ * `rx-packets`, `rx-bytes`, `tx-packets` and `tx-bytes`. Payload transfers are
+ * held as `(ttt)` values of the count, bytes and microseconds, named
+ * `downloads` and `uploads`, and the microseconds they were held back by rate
+ * limits or a metered network as a `t` value named `throttled`.
+ *
+ * The `packets` member is a dictionary of `(tttt)` values by packet type,
+ * holding the received packets and bytes, then the sent packets and bytes.
+ *
+ * The `handlers` member is a dictionary of `(tttat)` values by handler name,
+ * holding the number of packets handled, the total and maximum microseconds
+ * spent, and a histogram of the durations, in buckets of powers of four from
+ * 16µs.
+ *
+ * The `latency` member is a dictionary of the same `(tttat)` values by packet
+ * priority class, for the time from queueing a packet until it was written.
+ *
+ * Returns: (transfer floating): a `GVariant` of type `a{sv}`
+ */
+GVariant *
+valent_device_metrics_serialize (ValentDeviceMetrics *metrics)
+{
+  GVariantBuilder builder;
+  GVariantBuilder packets;
+  GVariantBuilder handlers;
+  GVariantBuilder latency;
+  GHashTableIter iter;
+  const char *name;
+  gpointer value;
+
+  g_return_val_if_fail (metrics != NULL, NULL);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add (&builder, "{sv}", "rx-packets",
+                         g_variant_new_uint64 (counter_get (&metrics->total.rx_packets)));
+  g_variant_builder_add (&builder, "{sv}", "rx-bytes",
+                         g_variant_new_uint64 (counter_get (&metrics->total.rx_bytes)));
+  g_variant_builder_add (&builder, "{sv}", "tx-packets",
+                         g_variant_new_uint64 (counter_get (&metrics->total.tx_packets)));
+  g_variant_builder_add (&builder, "{sv}", "tx-bytes",
+                         g_variant_new_uint64 (counter_get (&metrics->total.tx_bytes)));
+  g_variant_builder_add (&builder, "{sv}", "downloads",
+                         g_variant_new ("(ttt)",
+                                        counter_get (&metrics->downloads.n_transfers),
+                                        counter_get (&metrics->downloads.n_bytes),
+                                        counter_get (&metrics->downloads.total_time)));
+  g_variant_builder_add (&builder, "{sv}", "uploads",
+                         g_variant_new ("(ttt)",
+                                        counter_get (&metrics->uploads.n_transfers),
+                                        counter_get (&metrics->uploads.n_bytes),
+                                        counter_get (&metrics->uploads.total_time)));
+  g_variant_builder_add (&builder, "{sv}", "throttled",
+                         g_variant_new_uint64 (counter_get (&metrics->throttle_time)));
+
+  g_variant_builder_init (&packets, G_VARIANT_TYPE ("a{s(tttt)}"));
+  g_variant_builder_init (&handlers, G_VARIANT_TYPE ("a{s(tttat)}"));
+  g_variant_builder_init (&latency, G_VARIANT_TYPE ("a{s(tttat)}"));
+
+  g_mutex_lock (&metrics->mutex);
+  g_hash_table_iter_init (&iter, metrics->packets);
+
+  while (g_hash_table_iter_next (&iter, (void **)&name, &value))
+    {
+      PacketCounters *counters = value;
+
+      g_variant_builder_add (&packets, "{s(tttt)}", name,
+                             counter_get (&counters->rx_packets),
+                             counter_get (&counters->rx_bytes),
+                             counter_get (&counters->tx_packets),
+                             counter_get (&counters->tx_bytes));
+    }
+
+  serialize_durations (metrics->handlers, &handlers);
+  serialize_durations (metrics->latency, &latency);
+  g_mutex_unlock (&metrics->mutex);
+
+  g_variant_builder_add (&builder, "{sv}", "packets",
+                         g_variant_builder_end (&packets));
+  g_variant_builder_add (&builder, "{sv}", "handlers",
+                         g_variant_builder_end (&handlers));
+  g_variant_builder_add (&builder, "{sv}", "latency",
+                         g_variant_builder_end (&latency));
+
+  return g_variant_builder_end (&builder);
+}
+
@@ -0,0 +1,50 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#pragma once
+
+#include <glib.h>
+
+#include "../core/valent-version.h"
+
+G_BEGIN_DECLS
+
+typedef struct _ValentDeviceMetrics ValentDeviceMetrics;
+
+_VALENT_EXTERN
+ValentDeviceMetrics * valent_device_metrics_new          (void);
+_VALENT_EXTERN
+ValentDeviceMetrics * valent_device_metrics_ref          (ValentDeviceMetrics *metrics);
+_VALENT_EXTERN
+void                  valent_device_metrics_unref        (ValentDeviceMetrics *metrics);
+_VALENT_EXTERN
+void                  valent_device_metrics_add_rx       (ValentDeviceMetrics *metrics,
+                                                          const char          *type,
+                                                          size_t               n_bytes);
+_VALENT_EXTERN
+void                  valent_device_metrics_add_tx       (ValentDeviceMetrics *metrics,
+                                                          const char          *type,
+                                                          size_t               n_bytes);
+_VALENT_EXTERN
+void                  valent_device_metrics_add_handler  (ValentDeviceMetrics *metrics,
+                                                          const char          *name,
+                                                          int64_t              duration);
+_VALENT_EXTERN
+void                  valent_device_metrics_add_latency  (ValentDeviceMetrics *metrics,
+                                                          const char          *name,
+                                                          int64_t              duration);
+_VALENT_EXTERN
+void                  valent_device_metrics_add_transfer (ValentDeviceMetrics *metrics,
+                                                          gboolean             is_download,
+                                                          uint64_t             n_bytes,
+                                                          int64_t              duration);
+_VALENT_EXTERN
+void                  valent_device_metrics_add_throttle (ValentDeviceMetrics *metrics,
+                                                          int64_t              duration);
+_VALENT_EXTERN
+GVariant            * valent_device_metrics_serialize    (ValentDeviceMetrics *metrics);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (ValentDeviceMetrics, valent_device_metrics_unref)
+
+G_END_DECLS
+
@@ -0,0 +1,18 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#pragma once
+
+#include "valent-device-plugin.h"
+
+G_BEGIN_DECLS
+
+_VALENT_EXTERN
+ValentDevicePluginPacketFunc valent_device_plugin_lookup_packet_handler (ValentDevicePlugin  *plugin,
+                                                                         GQuark               type);
+_VALENT_EXTERN
+ValentDevicePluginStreamFunc valent_device_plugin_lookup_stream_handler (ValentDevicePlugin  *plugin,
+                                                                         GQuark               type,
+                                                                         const char         **field);
+
+G_END_DECLS
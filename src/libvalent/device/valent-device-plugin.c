@@ -11,8 +11,11 @@
 #include <libvalent-core.h>
 
 #include "valent-device.h"
+#include "valent-device-private.h"
 #include "valent-device-plugin.h"
+#include "valent-device-plugin-private.h"
 #include "valent-packet.h"
+#include "valent-packet-stream-private.h"
 
 #define PLUGIN_SETTINGS_KEY "X-DevicePluginSettings"
 
@@ -55,9 +58,14 @@
  * ## Implementation Notes
  *
  * Implementations that define `X-DevicePluginIncoming` in the `.plugin` file
- * must override [vfunc@Valent.DevicePlugin.handle_packet] to handle incoming
- * packets. Implementations that depend on the device state, especially those
- * that define `X-DevicePluginOutgoing` in the `.plugin` file, should override
+ * should call [func@Valent.DevicePluginClass.install_packet_handler] for each
+ * packet type, or override [vfunc@Valent.DevicePlugin.handle_packet] to handle
+ * incoming packets. Packets holding a large array, such as a list of messages,
+ * may instead be consumed element by element with
+ * [func@Valent.DevicePluginClass.install_stream_handler].
+ *
+ * Implementations that depend on the device state, especially those that
+ * define `X-DevicePluginOutgoing` in the `.plugin` file, should override
  * [vfunc@Valent.DevicePlugin.update_state].
  *
  * For device plugin preferences see [class@Valent.DevicePreferencesGroup].
@@ -82,6 +90,12 @@
  *     A list of packet types (eg. `kdeconnect.share.request`) separated by
  *     semi-colons indicating the packets that the plugin may send.
  *
+ * - `X-DevicePluginActions`
+ *
+ *     A list of stateless actions separated by semi-colons, each with an
+ *     optional parameter type (eg. `ping;message:s;`). These are listed by the
+ *     device as disabled actions while the plugin is not instantiated.
+ *
  * - `X-DevicePluginSettings`
  *
  *     A [class@Gio.Settings] schema ID for the plugin's settings. See
@@ -97,6 +111,16 @@ typedef struct
 
 G_DEFINE_ABSTRACT_TYPE (ValentDevicePlugin, valent_device_plugin, VALENT_TYPE_EXTENSION)
 
+typedef struct
+{
+  GQuark                        type;
+  ValentDevicePluginPacketFunc  handler;
+  ValentDevicePluginStreamFunc  stream_handler;
+  const char                   *field;
+} PacketHandler;
+
+static GQuark packet_handlers_quark = 0;
+
 /**
  * ValentDevicePluginClass:
  * @handle_packet: the virtual function pointer for valent_device_plugin_handle_packet()
@@ -153,6 +177,8 @@ valent_device_send_packet_cb (ValentDevice *device,
 static void
 valent_device_plugin_class_init (ValentDevicePluginClass *klass)
 {
+  packet_handlers_quark = g_quark_from_static_string ("valent-packet-handlers");
+
   klass->handle_packet = valent_device_plugin_real_handle_packet;
   klass->update_state = valent_device_plugin_real_update_state;
 }
@@ -162,6 +188,183 @@ valent_device_plugin_init (ValentDevicePlugin *self)
 {
 }
 
+static void
+valent_device_plugin_class_add_handler (ValentDevicePluginClass *plugin_class,
+                                        const PacketHandler     *entry)
+{
+  GType gtype;
+  GArray *handlers;
+
+  gtype = G_TYPE_FROM_CLASS (plugin_class);
+  handlers = g_type_get_qdata (gtype, packet_handlers_quark);
+
+  if (handlers == NULL)
+    {
+      handlers = g_array_new (FALSE, FALSE, sizeof (PacketHandler));
+      g_type_set_qdata (gtype, packet_handlers_quark, handlers);
+    }
+
+  for (unsigned int i = 0; i < handlers->len; i++)
+    {
+      if (g_array_index (handlers, PacketHandler, i).type == entry->type)
+        {
+          g_array_index (handlers, PacketHandler, i) = *entry;
+          return;
+        }
+    }
+
+  g_array_append_vals (handlers, entry, 1);
+}
+
+/**
+ * valent_device_plugin_class_install_packet_handler: (skip)
+ * @plugin_class: a `ValentDevicePluginClass`
+ * @type: a KDE Connect packet type
+ * @handler: (scope forever): a `ValentDevicePluginPacketFunc`
+ *
+ * Install a handler for packets of @type.
+ *
+ * This should be called from the class initializer of a `ValentDevicePlugin`
+ * implementation, once for each packet type listed in the
+ * `X-DevicePluginIncoming` field of the `.plugin` file. The device will call
+ * @handler directly for matching packets, instead of dispatching them through
+ * [vfunc@Valent.DevicePlugin.handle_packet].
+ *
+ * Since: 1.0
+ */
+void
+valent_device_plugin_class_install_packet_handler (ValentDevicePluginClass      *plugin_class,
+                                                   const char                   *type,
+                                                   ValentDevicePluginPacketFunc  handler)
+{
+  PacketHandler entry = { 0, };
+
+  g_return_if_fail (VALENT_IS_DEVICE_PLUGIN_CLASS (plugin_class));
+  g_return_if_fail (type != NULL && *type != '\0');
+  g_return_if_fail (handler != NULL);
+
+  entry.type = g_quark_from_string (type);
+  entry.handler = handler;
+  valent_device_plugin_class_add_handler (plugin_class, &entry);
+}
+
+/**
+ * valent_device_plugin_class_install_stream_handler: (skip)
+ * @plugin_class: a `ValentDevicePluginClass`
+ * @type: a KDE Connect packet type
+ * @field: (nullable): a field name in the packet body
+ * @handler: (scope forever): a `ValentDevicePluginStreamFunc`
+ *
+ * Install a streaming handler for packets of @type.
+ *
+ * This is like [func@Valent.DevicePluginClass.install_packet_handler], except
+ * that @handler is called with a [class@Valent.PacketStream] as soon as the
+ * packet begins arriving, yielding the elements of the array or object in
+ * @field, or the members of the body if @field is %NULL. The rest of the packet
+ * is never passed to the plugin.
+ *
+ * Since: 1.0
+ */
+void
+valent_device_plugin_class_install_stream_handler (ValentDevicePluginClass      *plugin_class,
+                                                   const char                   *type,
+                                                   const char                   *field,
+                                                   ValentDevicePluginStreamFunc  handler)
+{
+  PacketHandler entry = { 0, };
+
+  g_return_if_fail (VALENT_IS_DEVICE_PLUGIN_CLASS (plugin_class));
+  g_return_if_fail (type != NULL && *type != '\0');
+  g_return_if_fail (field == NULL || *field != '\0');
+  g_return_if_fail (handler != NULL);
+
+  entry.type = g_quark_from_string (type);
+  entry.stream_handler = handler;
+  entry.field = g_intern_string (field);
+  valent_device_plugin_class_add_handler (plugin_class, &entry);
+}
+
+static const PacketHandler *
+valent_device_plugin_lookup_handler (ValentDevicePlugin *plugin,
+                                     GQuark              type)
+{
+  if (type == 0)
+    return NULL;
+
+  for (GType gtype = G_OBJECT_TYPE (plugin);
+       gtype != VALENT_TYPE_DEVICE_PLUGIN;
+       gtype = g_type_parent (gtype))
+    {
+      GArray *handlers = g_type_get_qdata (gtype, packet_handlers_quark);
+
+      if (handlers == NULL)
+        continue;
+
+      for (unsigned int i = 0; i < handlers->len; i++)
+        {
+          const PacketHandler *entry = &g_array_index (handlers, PacketHandler, i);
+
+          if (entry->type == type)
+            return entry;
+        }
+    }
+
+  return NULL;
+}
+
+/*< private >
+ * valent_device_plugin_lookup_packet_handler:
+ * @plugin: a `ValentDevicePlugin`
+ * @type: a packet type quark
+ *
+ * Find the handler installed for @type by the class of @plugin, or one of its
+ * ancestors.
+ *
+ * Returns: (nullable): a `ValentDevicePluginPacketFunc`
+ */
+ValentDevicePluginPacketFunc
+valent_device_plugin_lookup_packet_handler (ValentDevicePlugin *plugin,
+                                            GQuark              type)
+{
+  const PacketHandler *entry;
+
+  g_assert (VALENT_IS_DEVICE_PLUGIN (plugin));
+
+  if ((entry = valent_device_plugin_lookup_handler (plugin, type)) == NULL)
+    return NULL;
+
+  return entry->handler;
+}
+
+/*< private >
+ * valent_device_plugin_lookup_stream_handler:
+ * @plugin: a `ValentDevicePlugin`
+ * @type: a packet type quark
+ * @field: (out) (optional) (nullable): the streamed field
+ *
+ * Find the streaming handler installed for @type by the class of @plugin, or
+ * one of its ancestors.
+ *
+ * Returns: (nullable): a `ValentDevicePluginStreamFunc`
+ */
+ValentDevicePluginStreamFunc
+valent_device_plugin_lookup_stream_handler (ValentDevicePlugin  *plugin,
+                                            GQuark               type,
+                                            const char         **field)
+{
+  const PacketHandler *entry;
+
+  g_assert (VALENT_IS_DEVICE_PLUGIN (plugin));
+
+  if ((entry = valent_device_plugin_lookup_handler (plugin, type)) == NULL)
+    return NULL;
+
+  if (field != NULL)
+    *field = entry->field;
+
+  return entry->stream_handler;
+}
+
 /**
  * valent_device_plugin_queue_packet:
  * @plugin: a `ValentDevicePlugin`
@@ -195,6 +398,43 @@ valent_device_plugin_queue_packet (ValentDevicePlugin *plugin,
                              NULL);
 }
 
+/**
+ * valent_device_plugin_queue_bytes:
+ * @plugin: a `ValentDevicePlugin`
+ * @type: the KDE Connect packet type of @bytes
+ * @bytes: a serialized KDE Connect packet
+ *
+ * Queue a serialized KDE Connect packet to be sent to the device this plugin is
+ * bound to.
+ *
+ * This is a variant of [method@Valent.DevicePlugin.queue_packet] for packets
+ * describing local state shared by every device, so that each instance of a
+ * plugin can send the same packet without serializing it again. @bytes must
+ * hold a complete, newline-terminated packet without payload information, such
+ * as one returned by [func@Valent.packet_serialize].
+ *
+ * The packet is only sent if the device is connected, paired and accepts
+ * packets of @type.
+ *
+ * Since: 1.0
+ */
+void
+valent_device_plugin_queue_bytes (ValentDevicePlugin *plugin,
+                                  const char         *type,
+                                  GBytes             *bytes)
+{
+  ValentDevice *device = NULL;
+
+  g_return_if_fail (VALENT_IS_DEVICE_PLUGIN (plugin));
+  g_return_if_fail (type != NULL && *type != '\0');
+  g_return_if_fail (bytes != NULL);
+
+  if ((device = valent_extension_get_object (VALENT_EXTENSION (plugin))) == NULL)
+    return;
+
+  valent_device_send_bytes (device, type, bytes);
+}
+
 /**
  * valent_device_plugin_show_notification:
  * @plugin: a `ValentDevicePlugin`
@@ -288,7 +528,11 @@ valent_device_plugin_hide_notification (ValentDevicePlugin *plugin,
  * Handle a packet from the device the plugin is bound to.
  *
  * This is called when the device receives a packet type included in the
- * `X-DevicePluginIncoming` field of the `.plugin` file.
+ * `X-DevicePluginIncoming` field of the `.plugin` file. If a handler was
+ * installed for the packet type with
+ * [func@Valent.DevicePluginClass.install_packet_handler], it will be called
+ * instead of the virtual function. If a streaming handler was installed, it
+ * will be called with a stream of the elements already in @packet.
  *
  * This is optional for implementations which do not register any incoming
  * capabilities, such as plugins that do not provide packet-based functionality.
@@ -300,13 +544,31 @@ valent_device_plugin_handle_packet (ValentDevicePlugin *plugin,
                                     const char         *type,
                                     JsonNode           *packet)
 {
+  const PacketHandler *entry;
+
   VALENT_ENTRY;
 
   g_return_if_fail (VALENT_IS_DEVICE_PLUGIN (plugin));
   g_return_if_fail (type != NULL && *type != '\0');
   g_return_if_fail (VALENT_IS_PACKET (packet));
 
-  VALENT_DEVICE_PLUGIN_GET_CLASS (plugin)->handle_packet (plugin, type, packet);
+  entry = valent_device_plugin_lookup_handler (plugin, g_quark_try_string (type));
+
+  if (entry != NULL && entry->handler != NULL)
+    {
+      entry->handler (plugin, packet);
+    }
+  else if (entry != NULL && entry->stream_handler != NULL)
+    {
+      g_autoptr (ValentPacketStream) stream = NULL;
+
+      stream = valent_packet_stream_new_for_packet (packet, entry->field);
+      entry->stream_handler (plugin, stream);
+    }
+  else
+    {
+      VALENT_DEVICE_PLUGIN_GET_CLASS (plugin)->handle_packet (plugin, type, packet);
+    }
 
   VALENT_EXIT;
 }
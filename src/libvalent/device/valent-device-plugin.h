@@ -11,6 +11,7 @@
 
 #include "../core/valent-extension.h"
 #include "valent-device.h"
+#include "valent-packet-stream.h"
 
 G_BEGIN_DECLS
 
@@ -19,6 +20,32 @@ G_BEGIN_DECLS
 VALENT_AVAILABLE_IN_1_0
 G_DECLARE_DERIVABLE_TYPE (ValentDevicePlugin, valent_device_plugin, VALENT, DEVICE_PLUGIN, ValentObject)
 
+/**
+ * ValentDevicePluginPacketFunc:
+ * @plugin: a `ValentDevicePlugin`
+ * @packet: a KDE Connect packet
+ *
+ * The prototype for functions registered with
+ * [func@Valent.DevicePluginClass.install_packet_handler].
+ *
+ * Since: 1.0
+ */
+typedef void (*ValentDevicePluginPacketFunc) (ValentDevicePlugin *plugin,
+                                              JsonNode           *packet);
+
+/**
+ * ValentDevicePluginStreamFunc:
+ * @plugin: a `ValentDevicePlugin`
+ * @stream: a `ValentPacketStream`
+ *
+ * The prototype for functions registered with
+ * [func@Valent.DevicePluginClass.install_stream_handler].
+ *
+ * Since: 1.0
+ */
+typedef void (*ValentDevicePluginStreamFunc) (ValentDevicePlugin *plugin,
+                                              ValentPacketStream *stream);
+
 struct _ValentDevicePluginClass
 {
   ValentExtensionClass   parent_class;
@@ -34,6 +61,15 @@ struct _ValentDevicePluginClass
   gpointer            padding[8];
 };
 
+VALENT_AVAILABLE_IN_1_0
+void   valent_device_plugin_class_install_packet_handler (ValentDevicePluginClass      *plugin_class,
+                                                          const char                   *type,
+                                                          ValentDevicePluginPacketFunc  handler);
+VALENT_AVAILABLE_IN_1_0
+void   valent_device_plugin_class_install_stream_handler (ValentDevicePluginClass      *plugin_class,
+                                                          const char                   *type,
+                                                          const char                   *field,
+                                                          ValentDevicePluginStreamFunc  handler);
 VALENT_AVAILABLE_IN_1_0
 void   valent_device_plugin_handle_packet     (ValentDevicePlugin *plugin,
                                                const char         *type,
@@ -42,6 +78,10 @@ VALENT_AVAILABLE_IN_1_0
 void   valent_device_plugin_queue_packet      (ValentDevicePlugin *plugin,
                                                JsonNode           *packet);
 VALENT_AVAILABLE_IN_1_0
+void   valent_device_plugin_queue_bytes       (ValentDevicePlugin *plugin,
+                                               const char         *type,
+                                               GBytes             *bytes);
+VALENT_AVAILABLE_IN_1_0
 void   valent_device_plugin_update_state      (ValentDevicePlugin *plugin,
                                                ValentDeviceState   state);
 
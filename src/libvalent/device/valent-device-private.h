@@ -4,20 +4,33 @@
 #pragma once
 
 #include "valent-device.h"
+#include "valent-device-metrics.h"
 
 G_BEGIN_DECLS
 
 _VALENT_EXTERN
-ValentDevice * valent_device_new_full      (JsonNode      *identity,
-                                            ValentContext *context);
+ValentDevice        * valent_device_new_full      (JsonNode      *identity,
+                                                   ValentContext *context);
 _VALENT_EXTERN
-void           valent_device_handle_packet (ValentDevice  *device,
-                                            JsonNode      *packet);
+void                  valent_device_handle_packet (ValentDevice  *device,
+                                                   JsonNode      *packet);
 _VALENT_EXTERN
-void           valent_device_set_channel   (ValentDevice  *device,
-                                            ValentChannel *channel);
+gboolean              valent_device_send_bytes    (ValentDevice  *device,
+                                                   const char    *type,
+                                                   GBytes        *bytes);
 _VALENT_EXTERN
-void           valent_device_set_paired    (ValentDevice  *device,
-                                            gboolean       paired);
+void                  valent_device_set_channel   (ValentDevice  *device,
+                                                   ValentChannel *channel);
+_VALENT_EXTERN
+void                  valent_device_set_paired    (ValentDevice  *device,
+                                                   gboolean       paired);
+_VALENT_EXTERN
+void                  valent_device_hold          (ValentDevice  *device);
+_VALENT_EXTERN
+void                  valent_device_release       (ValentDevice  *device);
+_VALENT_EXTERN
+ValentDeviceMetrics * valent_device_get_metrics   (ValentDevice  *device);
+_VALENT_EXTERN
+GVariant            * valent_device_dup_metrics   (ValentDevice  *device);
 
 G_END_DECLS
@@ -5,15 +5,25 @@
 
 #include "config.h"
 
+#include <errno.h>
+#include <fcntl.h>
 #include <math.h>
 
+#include <gio/gfiledescriptorbased.h>
 #include <libvalent-core.h>
 
 #include "valent-channel.h"
 #include "valent-device.h"
+#include "valent-device-private.h"
 #include "valent-device-transfer.h"
 #include "valent-packet.h"
 
+/* The size of the buffer used to copy payloads. This is much larger than the
+ * default used by g_output_stream_splice(), so that each write to a TLS
+ * connection can fill several records and fewer calls are made per byte. */
+#define TRANSFER_BUFFER_SIZE  (256 * 1024)
+#define TRANSFER_BUFFER_ALIGN (4096)
+
 
 /**
  * ValentDeviceTransfer:
@@ -83,6 +93,212 @@ valent_device_transfer_update_packet (JsonNode  *packet,
   valent_packet_set_payload_size (packet, payload_size);
 }
 
+/*
+ * Create a hidden, temporary file beside @file to download into, so that
+ * @file only appears once the transfer has completed. If @size is known,
+ * space for the file is allocated up front.
+ */
+static GOutputStream *
+valent_device_transfer_create_temporary (GFile         *file,
+                                         goffset        size,
+                                         GFile        **temporary,
+                                         GCancellable  *cancellable,
+                                         GError       **error)
+{
+  g_autoptr (GFile) parent = NULL;
+  g_autofree char *basename = NULL;
+
+  g_assert (G_IS_FILE (file));
+  g_assert (temporary != NULL && *temporary == NULL);
+
+  parent = g_file_get_parent (file);
+  basename = g_file_get_basename (file);
+
+  for (unsigned int i = 0; i < 16; i++)
+    {
+      g_autofree char *name = NULL;
+      g_autoptr (GFile) candidate = NULL;
+      g_autoptr (GFileOutputStream) stream = NULL;
+      g_autoptr (GError) warn = NULL;
+
+      name = g_strdup_printf (".%s.%08x.part", basename, g_random_int ());
+      candidate = g_file_get_child (parent, name);
+      stream = g_file_create (candidate,
+                              G_FILE_CREATE_NONE,
+                              cancellable,
+                              &warn);
+
+      if (stream == NULL)
+        {
+          if (g_error_matches (warn, G_IO_ERROR, G_IO_ERROR_EXISTS))
+            continue;
+
+          g_propagate_error (error, g_steal_pointer (&warn));
+          return NULL;
+        }
+
+#ifdef HAVE_POSIX_FALLOCATE
+      if (size > 0 && G_IS_FILE_DESCRIPTOR_BASED (stream))
+        {
+          int fd;
+          int ret;
+
+          fd = g_file_descriptor_based_get_fd (G_FILE_DESCRIPTOR_BASED (stream));
+          ret = posix_fallocate (fd, 0, size);
+
+          /* Fail early if there's no room, but otherwise this is only a hint */
+          if (ret == ENOSPC)
+            {
+              g_output_stream_close (G_OUTPUT_STREAM (stream), NULL, NULL);
+              g_file_delete (candidate, NULL, NULL);
+              g_set_error_literal (error,
+                                   G_IO_ERROR,
+                                   G_IO_ERROR_NO_SPACE,
+                                   g_strerror (ret));
+              return NULL;
+            }
+          else if (ret != 0)
+            {
+              g_debug ("%s(): %s", G_STRFUNC, g_strerror (ret));
+            }
+        }
+#endif /* HAVE_POSIX_FALLOCATE */
+
+      *temporary = g_steal_pointer (&candidate);
+      return G_OUTPUT_STREAM (g_steal_pointer (&stream));
+    }
+
+  g_set_error (error,
+               G_IO_ERROR,
+               G_IO_ERROR_EXISTS,
+               "Failed to create temporary file for \"%s\"",
+               basename);
+  return NULL;
+}
+
+/*
+ * Transfers run in a GTask thread pool, so each worker keeps its buffer for
+ * reuse by the next transfer it runs.
+ */
+static GPrivate transfer_buffer = G_PRIVATE_INIT (g_aligned_free);
+
+static inline void *
+valent_device_transfer_get_buffer (void)
+{
+  void *buffer = g_private_get (&transfer_buffer);
+
+  if G_UNLIKELY (buffer == NULL)
+    {
+      buffer = g_aligned_alloc (1, TRANSFER_BUFFER_SIZE, TRANSFER_BUFFER_ALIGN);
+      g_private_set (&transfer_buffer, buffer);
+    }
+
+  return buffer;
+}
+
+static inline void
+valent_device_transfer_advise (GInputStream *stream)
+{
+#ifdef HAVE_POSIX_FADVISE
+  if (G_IS_FILE_DESCRIPTOR_BASED (stream))
+    {
+      int fd;
+      int ret;
+
+      fd = g_file_descriptor_based_get_fd (G_FILE_DESCRIPTOR_BASED (stream));
+      ret = posix_fadvise (fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+      if (ret != 0)
+        g_debug ("%s(): %s", G_STRFUNC, g_strerror (ret));
+    }
+#endif /* HAVE_POSIX_FADVISE */
+}
+
+/*
+ * Copy @source into @target with a large, reusable buffer, closing both
+ * streams before returning. Returns the number of bytes transferred, or `-1`
+ * with @error set.
+ */
+static gssize
+valent_device_transfer_splice (GOutputStream  *target,
+                               GInputStream   *source,
+                               GCancellable   *cancellable,
+                               GError        **error)
+{
+  uint8_t *buffer = valent_device_transfer_get_buffer ();
+  gssize transferred = 0;
+  gboolean ret = TRUE;
+
+  g_assert (G_IS_OUTPUT_STREAM (target));
+  g_assert (G_IS_INPUT_STREAM (source));
+
+  valent_device_transfer_advise (source);
+
+  while (ret)
+    {
+      gssize n_read;
+
+      n_read = g_input_stream_read (source,
+                                    buffer,
+                                    TRANSFER_BUFFER_SIZE,
+                                    cancellable,
+                                    error);
+
+      if (n_read < 0)
+        ret = FALSE;
+      else if (n_read == 0)
+        break;
+      else if (!g_output_stream_write_all (target,
+                                           buffer,
+                                           n_read,
+                                           NULL,
+                                           cancellable,
+                                           error))
+        ret = FALSE;
+      else if G_UNLIKELY (transferred > G_MAXSSIZE - n_read)
+        transferred = G_MAXSSIZE;
+      else
+        transferred += n_read;
+    }
+
+  g_input_stream_close (source, cancellable, NULL);
+
+  /* Only report a failure to close the target if the copy succeeded, since
+   * that may be the point where buffered data is actually written. */
+  if (ret)
+    ret = g_output_stream_close (target, cancellable, error);
+  else
+    g_output_stream_close (target, cancellable, NULL);
+
+  return ret ? transferred : -1;
+}
+
+/*
+ * Remove the files left by a failed download: the partial @temporary, and
+ * @file if it is still the empty placeholder reserved by valent_get_user_file().
+ */
+static void
+valent_device_transfer_discard (GFile *file,
+                                GFile *temporary)
+{
+  g_autoptr (GFileInfo) info = NULL;
+
+  if (temporary != NULL)
+    g_file_delete (temporary, NULL, NULL);
+
+  info = g_file_query_info (file,
+                            G_FILE_ATTRIBUTE_STANDARD_TYPE","
+                            G_FILE_ATTRIBUTE_STANDARD_SIZE,
+                            G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                            NULL,
+                            NULL);
+
+  if (info != NULL &&
+      g_file_info_get_file_type (info) == G_FILE_TYPE_REGULAR &&
+      g_file_info_get_size (info) == 0)
+    g_file_delete (file, NULL, NULL);
+}
+
 /*
  * ValentDeviceTransfer
  */
@@ -95,6 +311,7 @@ valent_device_transfer_execute_task (GTask        *task,
   ValentDeviceTransfer *self = VALENT_DEVICE_TRANSFER (source_object);
   g_autoptr (ValentChannel) channel = NULL;
   g_autoptr (GFile) file = NULL;
+  g_autoptr (GFile) temporary = NULL;
   g_autoptr (JsonNode) packet = NULL;
   g_autoptr (GIOStream) stream = NULL;
   g_autoptr (GInputStream) source = NULL;
@@ -104,19 +321,33 @@ valent_device_transfer_execute_task (GTask        *task,
   int64_t last_modified = 0;
   int64_t creation_time = 0;
   goffset payload_size;
+  int64_t begin_time;
   GError *error = NULL;
 
-  if (g_task_return_error_if_cancelled (task))
-    return;
-
   valent_object_lock (VALENT_OBJECT (self));
   channel = valent_device_ref_channel (self->device);
   file = g_object_ref (self->file);
   packet = json_node_ref (self->packet);
   valent_object_unlock (VALENT_OBJECT (self));
 
+  /* Determine if this is a download or an upload. This should be reliable,
+   * given that the channel service must set the `payloadTransferInfo` field in
+   * its valent_channel_upload() implementation. */
+  is_download = valent_packet_has_payload (packet);
+
+  if (g_task_return_error_if_cancelled (task))
+    {
+      if (is_download)
+        valent_device_transfer_discard (file, NULL);
+
+      return;
+    }
+
   if (channel == NULL)
     {
+      if (is_download)
+        valent_device_transfer_discard (file, NULL);
+
       g_task_return_new_error (task,
                                G_IO_ERROR,
                                G_IO_ERROR_NOT_CONNECTED,
@@ -124,27 +355,30 @@ valent_device_transfer_execute_task (GTask        *task,
       return;
     }
 
-  /* Determine if this is a download or an upload. This should be reliable,
-   * given that the channel service must set the `payloadTransferInfo` field in
-   * its valent_channel_upload() implementation. */
-  is_download = valent_packet_has_payload (packet);
+  begin_time = VALENT_TRACE_TIME ();
 
   if (is_download)
     {
-      target = (GOutputStream *)g_file_replace (file,
-                                                NULL,
-                                                FALSE,
-                                                G_FILE_CREATE_REPLACE_DESTINATION,
-                                                cancellable,
-                                                &error);
+      target = valent_device_transfer_create_temporary (file,
+                                                        valent_packet_get_payload_size (packet),
+                                                        &temporary,
+                                                        cancellable,
+                                                        &error);
 
       if (target == NULL)
-        return g_task_return_error (task, error);
+        {
+          valent_device_transfer_discard (file, NULL);
+          return g_task_return_error (task, error);
+        }
 
       stream = valent_channel_download (channel, packet, cancellable, &error);
 
       if (stream == NULL)
-        return g_task_return_error (task, error);
+        {
+          g_output_stream_close (target, NULL, NULL);
+          valent_device_transfer_discard (file, temporary);
+          return g_task_return_error (task, error);
+        }
 
       source = g_object_ref (g_io_stream_get_input_stream (stream));
     }
@@ -179,22 +413,29 @@ valent_device_transfer_execute_task (GTask        *task,
       target = g_object_ref (g_io_stream_get_output_stream (stream));
     }
 
+  VALENT_TRACE_EVENT (VALENT_TRACE_TRANSFER, "open", begin_time, is_download);
+
   /* Transfer the payload */
-  transferred = g_output_stream_splice (target,
-                                        source,
-                                        (G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE |
-                                         G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET),
-                                        cancellable,
-                                        &error);
+  begin_time = g_get_monotonic_time ();
+  transferred = valent_device_transfer_splice (target,
+                                               source,
+                                               cancellable,
+                                               &error);
+  VALENT_TRACE_EVENT (VALENT_TRACE_TRANSFER, "splice", begin_time, transferred);
 
   if (error != NULL)
     {
       if (is_download)
-        g_file_delete (file, NULL, NULL);
+        valent_device_transfer_discard (file, temporary);
 
       return g_task_return_error (task, error);
     }
 
+  valent_device_metrics_add_transfer (valent_device_get_metrics (self->device),
+                                      is_download,
+                                      transferred,
+                                      g_get_monotonic_time () - begin_time);
+
   /* If possible, confirm the transferred size with the payload size */
   payload_size = valent_packet_get_payload_size (packet);
 
@@ -210,7 +451,7 @@ valent_device_transfer_execute_task (GTask        *task,
                G_STRFUNC, transferred, payload_size);
 
       if (is_download)
-        g_file_delete (file, NULL, NULL);
+        valent_device_transfer_discard (file, temporary);
 
       g_task_return_new_error (task,
                                G_IO_ERROR,
@@ -219,6 +460,24 @@ valent_device_transfer_execute_task (GTask        *task,
       return;
     }
 
+  /* Move the completed download into place */
+  begin_time = VALENT_TRACE_TIME ();
+
+  if (is_download)
+    {
+      if (!g_file_move (temporary,
+                        file,
+                        G_FILE_COPY_OVERWRITE | G_FILE_COPY_NOFOLLOW_SYMLINKS,
+                        cancellable,
+                        NULL,
+                        NULL,
+                        &error))
+        {
+          valent_device_transfer_discard (file, temporary);
+          return g_task_return_error (task, error);
+        }
+    }
+
   /* Attempt to set file attributes for downloaded files. */
   if (is_download)
     {
@@ -276,6 +535,7 @@ valent_device_transfer_execute_task (GTask        *task,
         }
     }
 
+  VALENT_TRACE_EVENT (VALENT_TRACE_TRANSFER, "finish", begin_time, is_download);
   g_task_return_boolean (task, TRUE);
 }
 
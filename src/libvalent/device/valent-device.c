@@ -5,6 +5,8 @@
 
 #include "config.h"
 
+#include <string.h>
+
 #include <glib/gi18n.h>
 #include <gio/gio.h>
 #include <libvalent-core.h>
@@ -13,10 +15,16 @@
 
 #include "../core/valent-component-private.h"
 #include "valent-channel.h"
+#include "valent-channel-private.h"
 #include "valent-device.h"
+#include "valent-device-metrics.h"
 #include "valent-device-plugin.h"
+#include "valent-device-plugin-private.h"
 #include "valent-device-private.h"
 #include "valent-packet.h"
+#include "valent-packet-stream.h"
+#include "valent-packet-view.h"
+#include "valent-transfer-scheduler.h"
 
 #define DEVICE_TYPE_DESKTOP  "desktop"
 #define DEVICE_TYPE_LAPTOP   "laptop"
@@ -27,6 +35,8 @@
 #define PAIR_REQUEST_ID      "pair-request"
 #define PAIR_REQUEST_TIMEOUT 30
 
+#define PLUGIN_IDLE_TIMEOUT  120
+
 
 /**
  * ValentDevice:
@@ -36,6 +46,14 @@
  * Device functionality is limited to pairing and sending packets, while other
  * functionality is delegated to [class@Valent.DevicePlugin] extensions.
  *
+ * Plugin extensions are only instantiated while the device is connected and
+ * paired, while it is held, or when one of its actions is activated. Listing or
+ * querying actions does not wake a dormant device; instead, the stateless
+ * actions a plugin declares with `X-DevicePluginActions` are listed as disabled
+ * until its extension is instantiated. A device that is offline or unpaired
+ * remains dormant, and any extensions are destroyed after being idle for a
+ * short period.
+ *
  * #ValentDevice implements the [iface@Gio.ActionGroup] interface, acting as an
  * aggregate action group for plugins. Plugin actions are automatically included
  * in the device action group with the plugin module name as a prefix
@@ -58,25 +76,44 @@ struct _ValentDevice
   char           *type;
   char          **incoming_capabilities;
   char          **outgoing_capabilities;
+  GHashTable     *incoming_types;
+  GArray         *incoming_bits;
+  GArray         *outgoing_bits;
+  unsigned int    capability_serial;
 
   /* State */
   ValentChannel  *channel;
   gboolean        paired;
   unsigned int    incoming_pair;
   unsigned int    outgoing_pair;
+  ValentDeviceMetrics *metrics;
 
   /* Plugins */
   PeasEngine     *engine;
   GHashTable     *plugins;
   GHashTable     *handlers;
+  GHashTable     *streams;
   GHashTable     *actions;
+  GHashTable     *dormant_actions;
   GMenu          *menu;
+  gboolean        plugins_active;
+  unsigned int    plugins_hold;
+  unsigned int    plugins_idle_id;
 };
 
-static void       valent_device_reload_plugins  (ValentDevice   *device);
-static void       valent_device_update_plugins  (ValentDevice   *device);
-static gboolean   valent_device_supports_plugin (ValentDevice   *device,
-                                                 PeasPluginInfo *info);
+static void       valent_device_reload_plugins  (ValentDevice     *device);
+static void       valent_device_wake_plugins    (ValentDevice     *device);
+static void       valent_device_update_plugins  (ValentDevice     *device);
+static gboolean   valent_device_supports_plugin (ValentDevice     *device,
+                                                 PeasPluginInfo   *info);
+static void       valent_device_route_packet    (ValentDevice     *device,
+                                                 const char       *type,
+                                                 JsonNode         *packet,
+                                                 ValentPacketView *view);
+static void       valent_device_update_streams  (ValentDevice     *device);
+static void       read_view_cb                  (ValentChannel    *channel,
+                                                 GAsyncResult     *result,
+                                                 ValentDevice     *device);
 
 static void       g_action_group_iface_init     (GActionGroupInterface *iface);
 
@@ -98,6 +135,202 @@ enum {
 static GParamSpec *properties[N_PROPERTIES] = { NULL, };
 
 
+/*< private >
+ * PacketHandler:
+ * @plugin: a `ValentDevicePlugin`
+ * @handler: (nullable): a `ValentDevicePluginPacketFunc`
+ * @stream_handler: (nullable): a `ValentDevicePluginStreamFunc`
+ * @stream_field: (nullable): the field streamed by @stream_handler
+ *
+ * An entry in the packet dispatch table. If @handler is %NULL, the packet will
+ * be passed to [vfunc@Valent.DevicePlugin.handle_packet].
+ */
+typedef struct
+{
+  ValentDevicePlugin           *plugin;
+  ValentDevicePluginPacketFunc  handler;
+  ValentDevicePluginStreamFunc  stream_handler;
+  const char                   *stream_field;
+} PacketHandler;
+
+
+/*
+ * Capabilities
+ *
+ * Packet types declared by plugins are assigned an index in a process-wide
+ * registry, so that device and plugin capabilities can be compared as bitsets.
+ * Types only declared by remote devices are never registered, since no plugin
+ * could match them anyway.
+ */
+typedef struct
+{
+  GArray       *incoming;
+  GArray       *outgoing;
+  GQuark       *incoming_types;
+  unsigned int  n_incoming_types;
+  gboolean      packetless;
+  char        **action_names;
+  GVariantType **action_types;
+  unsigned int  n_actions;
+} PluginCapabilities;
+
+G_LOCK_DEFINE_STATIC (capability_lock);
+static GHashTable   *capability_index = NULL;
+static GHashTable   *plugin_capabilities = NULL;
+static unsigned int  capability_serial = 1;
+
+static inline void
+capabilities_set (GArray       *bits,
+                  unsigned int  index)
+{
+  unsigned int word = index / 64;
+
+  if (bits->len <= word)
+    g_array_set_size (bits, word + 1);
+
+  g_array_index (bits, uint64_t, word) |= ((uint64_t)1 << (index % 64));
+}
+
+static inline gboolean
+capabilities_intersect (GArray *a,
+                        GArray *b)
+{
+  unsigned int len;
+
+  if (a == NULL || b == NULL)
+    return FALSE;
+
+  len = MIN (a->len, b->len);
+
+  for (unsigned int i = 0; i < len; i++)
+    {
+      if ((g_array_index (a, uint64_t, i) & g_array_index (b, uint64_t, i)) != 0)
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+/* Must be called with the capability lock held */
+static GArray *
+capabilities_from_strv (const char * const *types,
+                        gboolean            register_types)
+{
+  GArray *bits = g_array_new (FALSE, TRUE, sizeof (uint64_t));
+
+  if (types == NULL)
+    return bits;
+
+  if (capability_index == NULL)
+    capability_index = g_hash_table_new (g_str_hash, g_str_equal);
+
+  for (unsigned int i = 0; types[i] != NULL; i++)
+    {
+      gpointer value = NULL;
+
+      if (*types[i] == '\0')
+        continue;
+
+      if (!g_hash_table_lookup_extended (capability_index, types[i], NULL, &value))
+        {
+          if (!register_types)
+            continue;
+
+          value = GUINT_TO_POINTER (g_hash_table_size (capability_index));
+          g_hash_table_insert (capability_index,
+                               (char *)g_intern_string (types[i]),
+                               value);
+          capability_serial++;
+        }
+
+      capabilities_set (bits, GPOINTER_TO_UINT (value));
+    }
+
+  return bits;
+}
+
+/*
+ * Get the capabilities of the plugin described by @info, registering them the
+ * first time the plugin is seen. The result is valid for the process lifetime.
+ */
+static const PluginCapabilities *
+valent_device_get_plugin_capabilities (PeasPluginInfo *info)
+{
+  PluginCapabilities *ret = NULL;
+
+  G_LOCK (capability_lock);
+  if (plugin_capabilities == NULL)
+    plugin_capabilities = g_hash_table_new (NULL, NULL);
+
+  if ((ret = g_hash_table_lookup (plugin_capabilities, info)) == NULL)
+    {
+      const char *in_str, *out_str, *act_str;
+      g_auto (GStrv) incoming = NULL;
+      g_auto (GStrv) outgoing = NULL;
+      g_auto (GStrv) actions = NULL;
+
+      in_str = peas_plugin_info_get_external_data (info, "DevicePluginIncoming");
+      out_str = peas_plugin_info_get_external_data (info, "DevicePluginOutgoing");
+
+      if (in_str != NULL)
+        incoming = g_strsplit (in_str, ";", -1);
+
+      if (out_str != NULL)
+        outgoing = g_strsplit (out_str, ";", -1);
+
+      ret = g_new0 (PluginCapabilities, 1);
+      ret->packetless = (in_str == NULL && out_str == NULL);
+      ret->incoming = capabilities_from_strv ((const char * const *)incoming, TRUE);
+      ret->outgoing = capabilities_from_strv ((const char * const *)outgoing, TRUE);
+      ret->incoming_types = g_new0 (GQuark, incoming ? g_strv_length (incoming) : 0);
+
+      for (unsigned int i = 0; incoming != NULL && incoming[i] != NULL; i++)
+        {
+          if (*incoming[i] != '\0')
+            ret->incoming_types[ret->n_incoming_types++] = g_quark_from_string (incoming[i]);
+        }
+
+      /* Actions are declared as `name` or `name:type` */
+      act_str = peas_plugin_info_get_external_data (info, "DevicePluginActions");
+
+      if (act_str != NULL)
+        actions = g_strsplit (act_str, ";", -1);
+
+      ret->action_names = g_new0 (char *, actions ? g_strv_length (actions) + 1 : 1);
+      ret->action_types = g_new0 (GVariantType *, actions ? g_strv_length (actions) : 0);
+
+      for (unsigned int i = 0; actions != NULL && actions[i] != NULL; i++)
+        {
+          const char *name = actions[i];
+          char *type = strchr (actions[i], ':');
+
+          if (type != NULL)
+            *type++ = '\0';
+
+          if (!g_action_name_is_valid (name) ||
+              (type != NULL && !g_variant_type_string_is_valid (type)))
+            {
+              if (*name != '\0')
+                g_warning ("%s(): invalid action \"%s\" declared by \"%s\"",
+                           G_STRFUNC,
+                           name,
+                           peas_plugin_info_get_module_name (info));
+              continue;
+            }
+
+          ret->action_names[ret->n_actions] = g_strdup (name);
+          ret->action_types[ret->n_actions] = type ? g_variant_type_new (type) : NULL;
+          ret->n_actions++;
+        }
+
+      g_hash_table_insert (plugin_capabilities, info, ret);
+    }
+  G_UNLOCK (capability_lock);
+
+  return ret;
+}
+
+
 /*
  * GActionGroup
  */
@@ -109,6 +342,8 @@ valent_device_activate_action (GActionGroup *action_group,
   ValentDevice *self = VALENT_DEVICE (action_group);
   GAction *action;
 
+  valent_device_wake_plugins (self);
+
   if ((action = g_hash_table_lookup (self->actions, action_name)) != NULL)
     g_action_activate (action, parameter);
 }
@@ -121,6 +356,8 @@ valent_device_change_action_state (GActionGroup *action_group,
   ValentDevice *self = VALENT_DEVICE (action_group);
   GAction *action;
 
+  valent_device_wake_plugins (self);
+
   if ((action = g_hash_table_lookup (self->actions, action_name)) != NULL)
     g_action_change_state (action, value);
 }
@@ -134,10 +371,16 @@ valent_device_list_actions (GActionGroup *action_group)
   gpointer key;
   unsigned int i = 0;
 
-  actions = g_new0 (char *, g_hash_table_size (self->actions) + 1);
+  actions = g_new0 (char *, g_hash_table_size (self->actions) +
+                            g_hash_table_size (self->dormant_actions) + 1);
 
   g_hash_table_iter_init (&iter, self->actions);
 
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    actions[i++] = g_strdup (key);
+
+  g_hash_table_iter_init (&iter, self->dormant_actions);
+
   while (g_hash_table_iter_next (&iter, &key, NULL))
     actions[i++] = g_strdup (key);
 
@@ -156,7 +399,8 @@ valent_device_query_action (GActionGroup        *action_group,
   ValentDevice *self = VALENT_DEVICE (action_group);
   GAction *action;
 
-  if ((action = g_hash_table_lookup (self->actions, action_name)) == NULL)
+  if ((action = g_hash_table_lookup (self->actions, action_name)) == NULL &&
+      (action = g_hash_table_lookup (self->dormant_actions, action_name)) == NULL)
     return FALSE;
 
   if (enabled)
@@ -271,12 +515,60 @@ on_plugin_action_state_changed (GActionGroup *action_group,
                                        value);
 }
 
+/*< private >
+ * valent_device_update_dormant_actions:
+ * @device: a #ValentDevice
+ * @plugin: a #ValentPlugin
+ * @dormant: %TRUE if @plugin is enabled, but not instantiated
+ *
+ * Add or remove the disabled actions standing in for the declared actions of
+ * @plugin, so that they are listed while its extension is not instantiated.
+ */
+static void
+valent_device_update_dormant_actions (ValentDevice *device,
+                                      ValentPlugin *plugin,
+                                      gboolean      dormant)
+{
+  const PluginCapabilities *capabilities = NULL;
+  const char *module;
+
+  g_assert (VALENT_IS_DEVICE (device));
+  g_assert (plugin != NULL);
+
+  capabilities = valent_device_get_plugin_capabilities (plugin->info);
+  module = peas_plugin_info_get_module_name (plugin->info);
+
+  for (unsigned int i = 0; i < capabilities->n_actions; i++)
+    {
+      g_autofree char *full_name = NULL;
+
+      full_name = g_strdup_printf ("%s.%s", module, capabilities->action_names[i]);
+
+      if (dormant && !g_hash_table_contains (device->dormant_actions, full_name))
+        {
+          GSimpleAction *action;
+
+          action = g_simple_action_new (full_name, capabilities->action_types[i]);
+          g_simple_action_set_enabled (action, FALSE);
+          g_hash_table_replace (device->dormant_actions,
+                                g_strdup (full_name),
+                                action);
+          g_action_group_action_added (G_ACTION_GROUP (device), full_name);
+        }
+      else if (!dormant && g_hash_table_contains (device->dormant_actions, full_name))
+        {
+          g_action_group_action_removed (G_ACTION_GROUP (device), full_name);
+          g_hash_table_remove (device->dormant_actions, full_name);
+        }
+    }
+}
+
 static void
 valent_device_enable_plugin (ValentDevice *device,
                              ValentPlugin *plugin)
 {
   g_auto (GStrv) actions = NULL;
-  const char *incoming = NULL;
+  const PluginCapabilities *capabilities = NULL;
 
   g_assert (VALENT_IS_DEVICE (device));
   g_assert (plugin != NULL);
@@ -291,31 +583,34 @@ valent_device_enable_plugin (ValentDevice *device,
   g_return_if_fail (G_IS_OBJECT (plugin->extension));
 
   /* Register packet handlers */
-  incoming = peas_plugin_info_get_external_data (plugin->info,
-                                                 "DevicePluginIncoming");
+  capabilities = valent_device_get_plugin_capabilities (plugin->info);
 
-  if (incoming != NULL)
+  for (unsigned int i = 0; i < capabilities->n_incoming_types; i++)
     {
-      g_auto (GStrv) capabilities = NULL;
+      GQuark type = capabilities->incoming_types[i];
+      GArray *handlers = NULL;
+      PacketHandler entry;
 
-      capabilities = g_strsplit (incoming, ";", -1);
-
-      for (unsigned int i = 0; capabilities[i] != NULL; i++)
+      if ((handlers = g_hash_table_lookup (device->handlers, GUINT_TO_POINTER (type))) == NULL)
         {
-          GPtrArray *handlers = NULL;
-          const char *type = capabilities[i];
-
-          if ((handlers = g_hash_table_lookup (device->handlers, type)) == NULL)
-            {
-              handlers = g_ptr_array_new ();
-              g_hash_table_insert (device->handlers, g_strdup (type), handlers);
-            }
-
-          g_ptr_array_add (handlers, plugin->extension);
+          handlers = g_array_new (FALSE, FALSE, sizeof (PacketHandler));
+          g_hash_table_insert (device->handlers, GUINT_TO_POINTER (type), handlers);
         }
+
+      entry.plugin = VALENT_DEVICE_PLUGIN (plugin->extension);
+      entry.handler = valent_device_plugin_lookup_packet_handler (entry.plugin,
+                                                                  type);
+      entry.stream_handler = valent_device_plugin_lookup_stream_handler (entry.plugin,
+                                                                         type,
+                                                                         &entry.stream_field);
+      g_array_append_val (handlers, entry);
     }
 
+  if (capabilities->n_incoming_types > 0)
+    valent_device_update_streams (device);
+
   /* Register plugin actions */
+  valent_device_update_dormant_actions (device, plugin, FALSE);
   actions = g_action_group_list_actions (G_ACTION_GROUP (plugin->extension));
 
   for (unsigned int i = 0; actions[i] != NULL; i++)
@@ -352,7 +647,7 @@ valent_device_disable_plugin (ValentDevice *device,
                               ValentPlugin *plugin)
 {
   g_auto (GStrv) actions = NULL;
-  const char *incoming = NULL;
+  const PluginCapabilities *capabilities = NULL;
 
   g_assert (VALENT_IS_DEVICE (device));
   g_assert (plugin != NULL);
@@ -370,43 +665,176 @@ valent_device_disable_plugin (ValentDevice *device,
     }
 
   /* Unregister packet handlers */
-  incoming = peas_plugin_info_get_external_data (plugin->info,
-                                                 "DevicePluginIncoming");
+  capabilities = valent_device_get_plugin_capabilities (plugin->info);
 
-  if (incoming != NULL)
+  for (unsigned int i = 0; i < capabilities->n_incoming_types; i++)
     {
-      g_auto (GStrv) capabilities = NULL;
+      GQuark type = capabilities->incoming_types[i];
+      GArray *handlers = NULL;
 
-      capabilities = g_strsplit (incoming, ";", -1);
+      if ((handlers = g_hash_table_lookup (device->handlers, GUINT_TO_POINTER (type))) == NULL)
+        continue;
 
-      for (unsigned int i = 0; capabilities[i] != NULL; i++)
+      for (unsigned int j = 0; j < handlers->len; j++)
         {
-          const char *type = capabilities[i];
-          GPtrArray *handlers = NULL;
-
-          if ((handlers = g_hash_table_lookup (device->handlers, type)) == NULL)
-            continue;
-
-          if (g_ptr_array_remove (handlers, plugin->extension) && handlers->len == 0)
-            g_hash_table_remove (device->handlers, type);
+          if (g_array_index (handlers, PacketHandler, j).plugin == (gpointer)plugin->extension)
+            {
+              g_array_remove_index (handlers, j);
+              break;
+            }
         }
+
+      if (handlers->len == 0)
+        g_hash_table_remove (device->handlers, GUINT_TO_POINTER (type));
     }
 
+  if (capabilities->n_incoming_types > 0)
+    valent_device_update_streams (device);
+
   /* `::action-removed` needs to be emitted before the plugin is freed */
   valent_object_destroy (VALENT_OBJECT (plugin->extension));
   g_clear_object (&plugin->extension);
+
+  valent_device_update_dormant_actions (device,
+                                        plugin,
+                                        valent_plugin_get_enabled (plugin));
 }
 
 static void
 on_plugin_enabled_changed (ValentPlugin *plugin)
 {
+  ValentDevice *device = VALENT_DEVICE (plugin->parent);
+
   g_assert (plugin != NULL);
   g_assert (VALENT_IS_DEVICE (plugin->parent));
 
   if (valent_plugin_get_enabled (plugin))
-    valent_device_enable_plugin (plugin->parent, plugin);
+    {
+      if (device->plugins_active && plugin->extension == NULL)
+        valent_device_enable_plugin (device, plugin);
+      else if (plugin->extension == NULL)
+        valent_device_update_dormant_actions (device, plugin, TRUE);
+    }
+  else if (plugin->extension != NULL)
+    {
+      valent_device_disable_plugin (device, plugin);
+    }
   else
-    valent_device_disable_plugin (plugin->parent, plugin);
+    {
+      valent_device_update_dormant_actions (device, plugin, FALSE);
+    }
+}
+
+static gboolean
+valent_device_sleep_plugins (gpointer data)
+{
+  ValentDevice *self = VALENT_DEVICE (data);
+  GHashTableIter iter;
+  ValentPlugin *plugin;
+
+  g_assert (VALENT_IS_DEVICE (self));
+
+  self->plugins_idle_id = 0;
+
+  if (!self->plugins_active)
+    return G_SOURCE_REMOVE;
+
+  VALENT_NOTE ("%s: releasing idle plugins", self->name);
+
+  self->plugins_active = FALSE;
+  g_hash_table_iter_init (&iter, self->plugins);
+
+  while (g_hash_table_iter_next (&iter, NULL, (void **)&plugin))
+    {
+      if (plugin->extension != NULL)
+        valent_device_disable_plugin (self, plugin);
+    }
+
+  return G_SOURCE_REMOVE;
+}
+
+/*< private >
+ * valent_device_activate_plugins:
+ * @device: a #ValentDevice
+ *
+ * Instantiate the extension for each enabled plugin, if @device is dormant.
+ */
+static void
+valent_device_activate_plugins (ValentDevice *device)
+{
+  GHashTableIter iter;
+  ValentPlugin *plugin;
+
+  g_assert (VALENT_IS_DEVICE (device));
+
+  if (device->plugins_active)
+    return;
+
+  VALENT_NOTE ("%s: activating plugins", device->name);
+
+  device->plugins_active = TRUE;
+  g_hash_table_iter_init (&iter, device->plugins);
+
+  while (g_hash_table_iter_next (&iter, NULL, (void **)&plugin))
+    {
+      if (plugin->extension == NULL && valent_plugin_get_enabled (plugin))
+        valent_device_enable_plugin (device, plugin);
+    }
+}
+
+/*< private >
+ * valent_device_check_plugins:
+ * @device: a #ValentDevice
+ *
+ * Check whether plugin extensions are in use.
+ *
+ * Plugins are active while the device is connected and paired, or while held
+ * with valent_device_hold(). Otherwise they are released after
+ * %PLUGIN_IDLE_TIMEOUT seconds without being used.
+ */
+static void
+valent_device_check_plugins (ValentDevice *device)
+{
+  gboolean in_use;
+
+  g_assert (VALENT_IS_DEVICE (device));
+
+  valent_object_lock (VALENT_OBJECT (device));
+  in_use = (device->channel != NULL && device->paired) ||
+           device->plugins_hold > 0;
+  valent_object_unlock (VALENT_OBJECT (device));
+
+  if (in_use)
+    valent_device_activate_plugins (device);
+
+  g_clear_handle_id (&device->plugins_idle_id, g_source_remove);
+
+  if (device->plugins_active && !in_use)
+    {
+      device->plugins_idle_id = g_timeout_add_seconds (PLUGIN_IDLE_TIMEOUT,
+                                                       valent_device_sleep_plugins,
+                                                       device);
+      g_source_set_name_by_id (device->plugins_idle_id,
+                               "[valent] valent_device_sleep_plugins");
+    }
+}
+
+/*< private >
+ * valent_device_wake_plugins:
+ * @device: a #ValentDevice
+ *
+ * Activate plugins on first use and reset the idle timeout.
+ */
+static void
+valent_device_wake_plugins (ValentDevice *device)
+{
+  g_assert (VALENT_IS_DEVICE (device));
+
+  if (device->plugins_active && device->plugins_idle_id == 0)
+    return;
+
+  valent_device_activate_plugins (device);
+  valent_device_check_plugins (device);
 }
 
 
@@ -660,14 +1088,26 @@ valent_device_handle_identity (ValentDevice *device,
 
   /* Generally, these should be static, but could change if the connection type
    * changes between eg. TCP and Bluetooth */
+  g_hash_table_remove_all (device->incoming_types);
   g_clear_pointer (&device->incoming_capabilities, g_strfreev);
   device->incoming_capabilities = valent_packet_dup_strv (packet,
                                                           "incomingCapabilities");
 
+  if (device->incoming_capabilities != NULL)
+    {
+      for (unsigned int i = 0; device->incoming_capabilities[i] != NULL; i++)
+        g_hash_table_add (device->incoming_types,
+                          device->incoming_capabilities[i]);
+    }
+
   g_clear_pointer (&device->outgoing_capabilities, g_strfreev);
   device->outgoing_capabilities = valent_packet_dup_strv (packet,
                                                           "outgoingCapabilities");
 
+  /* Capability bitsets are recomputed on the next eligibility check */
+  g_clear_pointer (&device->incoming_bits, g_array_unref);
+  g_clear_pointer (&device->outgoing_bits, g_array_unref);
+
   valent_object_unlock (VALENT_OBJECT (device));
 
   /* Recheck plugins and load or unload if capabilities have changed */
@@ -706,8 +1146,10 @@ on_load_plugin (PeasEngine     *engine,
                               G_CALLBACK (on_plugin_enabled_changed));
   g_hash_table_insert (self->plugins, info, plugin);
 
-  if (valent_plugin_get_enabled (plugin))
+  if (self->plugins_active && valent_plugin_get_enabled (plugin))
     valent_device_enable_plugin (self, plugin);
+  else
+    valent_device_update_dormant_actions (self, plugin, valent_plugin_get_enabled (plugin));
 
   g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_PLUGINS]);
 }
@@ -728,10 +1170,29 @@ on_unload_plugin (PeasEngine     *engine,
                device->name,
                peas_plugin_info_get_module_name (info));
 
+  valent_device_update_dormant_actions (device,
+                                        g_hash_table_lookup (device->plugins, info),
+                                        FALSE);
   g_hash_table_remove (device->plugins, info);
   g_object_notify_by_pspec (G_OBJECT (device), properties [PROP_PLUGINS]);
 }
 
+static void
+on_transfer_rate_limit_changed (GSettings    *settings,
+                                const char   *key,
+                                ValentDevice *device)
+{
+  uint64_t rate_limit;
+
+  g_assert (G_IS_SETTINGS (settings));
+  g_assert (VALENT_IS_DEVICE (device));
+
+  rate_limit = g_settings_get_uint (settings, "transfer-rate-limit");
+  valent_transfer_scheduler_set_rate_limit (valent_transfer_scheduler_get_default (),
+                                            device->id,
+                                            rate_limit * 1024);
+}
+
 
 /*
  * GActions
@@ -789,9 +1250,18 @@ valent_device_destroy (ValentObject *object)
 
   /* Plugins */
   g_signal_handlers_disconnect_by_data (self->engine, self);
+  g_clear_handle_id (&self->plugins_idle_id, g_source_remove);
   g_hash_table_remove_all (self->plugins);
   g_hash_table_remove_all (self->actions);
+  g_hash_table_remove_all (self->dormant_actions);
   g_hash_table_remove_all (self->handlers);
+  valent_device_update_streams (self);
+
+  /* Transfers */
+  g_signal_handlers_disconnect_by_data (self->settings, self);
+  valent_transfer_scheduler_set_rate_limit (valent_transfer_scheduler_get_default (),
+                                            self->id,
+                                            0);
 
   VALENT_OBJECT_CLASS (valent_device_parent_class)->destroy (object);
 }
@@ -817,6 +1287,12 @@ valent_device_constructed (GObject *object)
   path = g_strdup_printf ("/ca/andyholmes/valent/device/%s/", self->id);
   self->settings = g_settings_new_with_path ("ca.andyholmes.Valent.Device", path);
   self->paired = g_settings_get_boolean (self->settings, "paired");
+  g_signal_connect_object (self->settings,
+                           "changed::transfer-rate-limit",
+                           G_CALLBACK (on_transfer_rate_limit_changed),
+                           self,
+                           0);
+  on_transfer_rate_limit_changed (self->settings, NULL, self);
 
   /* Load plugins and watch for changes */
   plugins = peas_engine_get_plugin_list (self->engine);
@@ -855,16 +1331,23 @@ valent_device_finalize (GObject *object)
   g_clear_pointer (&self->id, g_free);
   g_clear_pointer (&self->name, g_free);
   g_clear_pointer (&self->type, g_free);
+  g_clear_pointer (&self->incoming_types, g_hash_table_unref);
+  g_clear_pointer (&self->incoming_bits, g_array_unref);
+  g_clear_pointer (&self->outgoing_bits, g_array_unref);
   g_clear_pointer (&self->incoming_capabilities, g_strfreev);
   g_clear_pointer (&self->outgoing_capabilities, g_strfreev);
 
   /* State */
   g_clear_object (&self->channel);
+  g_clear_pointer (&self->metrics, valent_device_metrics_unref);
 
   /* Plugins */
+  g_clear_handle_id (&self->plugins_idle_id, g_source_remove);
   g_clear_pointer (&self->plugins, g_hash_table_unref);
   g_clear_pointer (&self->actions, g_hash_table_unref);
+  g_clear_pointer (&self->dormant_actions, g_hash_table_unref);
   g_clear_pointer (&self->handlers, g_hash_table_unref);
+  g_clear_pointer (&self->streams, g_hash_table_unref);
   g_clear_object (&self->menu);
 
   G_OBJECT_CLASS (valent_device_parent_class)->finalize (object);
@@ -937,17 +1420,27 @@ valent_device_init (ValentDevice *self)
 {
   GSimpleAction *action;
 
+  /* Properties */
+  self->incoming_types = g_hash_table_new (g_str_hash, g_str_equal);
+
+  /* State */
+  self->metrics = valent_device_metrics_new ();
+
   /* Plugins */
   self->engine = valent_get_plugin_engine ();
   self->plugins = g_hash_table_new_full (NULL, NULL, NULL, device_plugin_free);
-  self->handlers = g_hash_table_new_full (g_str_hash,
-                                          g_str_equal,
-                                          g_free,
-                                          (GDestroyNotify)g_ptr_array_unref);
+  self->handlers = g_hash_table_new_full (NULL,
+                                          NULL,
+                                          NULL,
+                                          (GDestroyNotify)g_array_unref);
   self->actions = g_hash_table_new_full (g_str_hash,
                                          g_str_equal,
                                          g_free,
                                          g_object_unref);
+  self->dormant_actions = g_hash_table_new_full (g_str_hash,
+                                                 g_str_equal,
+                                                 g_free,
+                                                 g_object_unref);
   self->menu = g_menu_new ();
 
   /* Stock Actions */
@@ -1203,6 +1696,9 @@ valent_device_send_packet (ValentDevice        *device,
   g_task_set_source_tag (task, valent_device_send_packet);
 
   VALENT_JSON (packet, device->name);
+  VALENT_TRACE_EVENT (VALENT_TRACE_PACKET_TX,
+                      valent_packet_get_type (packet),
+                      0, 0);
   valent_channel_write_packet (device->channel,
                                packet,
                                cancellable,
@@ -1212,6 +1708,100 @@ valent_device_send_packet (ValentDevice        *device,
   valent_object_unlock (VALENT_OBJECT (device));
 }
 
+typedef struct
+{
+  ValentDevice *device;
+  char         *type;
+  size_t        n_bytes;
+} SendBytesData;
+
+static void
+send_bytes_data_free (gpointer data)
+{
+  SendBytesData *op = data;
+
+  g_clear_object (&op->device);
+  g_clear_pointer (&op->type, g_free);
+  g_free (op);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (SendBytesData, send_bytes_data_free)
+
+static void
+valent_device_send_bytes_cb (ValentChannel *channel,
+                             GAsyncResult  *result,
+                             gpointer       user_data)
+{
+  g_autoptr (SendBytesData) op = user_data;
+  ValentDevice *device = op->device;
+  g_autoptr (GError) error = NULL;
+
+  /* Like packets written by the channel, only count packets once written */
+  if (valent_channel_write_bytes_finish (channel, result, &error))
+    {
+      valent_device_metrics_add_tx (device->metrics, op->type, op->n_bytes);
+      return;
+    }
+
+  VALENT_NOTE ("%s: %s", device->name, error->message);
+
+  valent_object_lock (VALENT_OBJECT (device));
+  if (device->channel == channel)
+    valent_device_set_channel (device, NULL);
+  valent_object_unlock (VALENT_OBJECT (device));
+}
+
+/*< private >
+ * valent_device_send_bytes:
+ * @device: a #ValentDevice
+ * @type: a KDE Connect packet type
+ * @bytes: a serialized KDE Connect packet
+ *
+ * Queue a serialized packet of @type for @device.
+ *
+ * The packet is only sent if @device is connected, paired and has @type in its
+ * incoming capabilities.
+ *
+ * Returns: %TRUE if the packet was queued, or %FALSE otherwise
+ */
+gboolean
+valent_device_send_bytes (ValentDevice *device,
+                          const char   *type,
+                          GBytes       *bytes)
+{
+  gboolean ret = FALSE;
+
+  g_return_val_if_fail (VALENT_IS_DEVICE (device), FALSE);
+  g_return_val_if_fail (type != NULL && *type != '\0', FALSE);
+  g_return_val_if_fail (bytes != NULL, FALSE);
+
+  valent_object_lock (VALENT_OBJECT (device));
+  if (device->channel != NULL && device->paired &&
+      g_hash_table_contains (device->incoming_types, type))
+    {
+      SendBytesData *op;
+
+      VALENT_TRACE_EVENT (VALENT_TRACE_PACKET_TX,
+                          type,
+                          0, g_bytes_get_size (bytes));
+
+      op = g_new0 (SendBytesData, 1);
+      op->device = g_object_ref (device);
+      op->type = g_strdup (type);
+      op->n_bytes = g_bytes_get_size (bytes);
+      valent_channel_write_bytes (device->channel,
+                                  type,
+                                  bytes,
+                                  NULL,
+                                  (GAsyncReadyCallback)valent_device_send_bytes_cb,
+                                  op);
+      ret = TRUE;
+    }
+  valent_object_unlock (VALENT_OBJECT (device));
+
+  return ret;
+}
+
 /**
  * valent_device_send_packet_finish:
  * @device: a #ValentDevice
@@ -1261,28 +1851,106 @@ valent_device_ref_channel (ValentDevice *device)
   return ret;
 }
 
+/*
+ * Called when a packet begins streaming, before the rest of it has been read.
+ * The table of streamed types is only a snapshot, so the handlers are checked
+ * again in case a plugin was disabled while the packet was being read.
+ */
 static void
-read_packet_cb (ValentChannel *channel,
-                GAsyncResult  *result,
-                ValentDevice  *device)
+valent_device_handle_stream (ValentChannel      *channel,
+                             ValentPacketStream *stream,
+                             ValentDevice       *device)
+{
+  const char *type;
+  GArray *handlers = NULL;
+  GQuark type_quark;
+
+  g_assert (VALENT_IS_CHANNEL (channel));
+  g_assert (VALENT_IS_PACKET_STREAM (stream));
+  g_assert (VALENT_IS_DEVICE (device));
+
+  type = valent_packet_stream_get_packet_type (stream);
+  type_quark = g_quark_try_string (type);
+  VALENT_TRACE_EVENT (VALENT_TRACE_PACKET_RX, type, 0, 0);
+
+  if G_UNLIKELY (!device->paired)
+    {
+      valent_device_send_pair (device, FALSE);
+    }
+  else if ((handlers = g_hash_table_lookup (device->handlers, GUINT_TO_POINTER (type_quark))) != NULL)
+    {
+      for (unsigned int i = 0, len = handlers->len; i < len; i++)
+        {
+          const PacketHandler *entry = &g_array_index (handlers, PacketHandler, i);
+          int64_t begin_time = g_get_monotonic_time ();
+
+          if (entry->stream_handler == NULL)
+            continue;
+
+          entry->stream_handler (entry->plugin, stream);
+
+          valent_device_metrics_add_handler (device->metrics,
+                                             G_OBJECT_TYPE_NAME (entry->plugin),
+                                             g_get_monotonic_time () - begin_time);
+          VALENT_TRACE_EVENT (VALENT_TRACE_PLUGIN_DISPATCH,
+                              G_OBJECT_TYPE_NAME (entry->plugin),
+                              begin_time,
+                              type_quark);
+        }
+    }
+  else
+    {
+      VALENT_NOTE ("%s: Unsupported packet \"%s\"", device->name, type);
+    }
+}
+
+static void
+valent_device_read_view (ValentDevice  *device,
+                         ValentChannel *channel)
+{
+  g_autoptr (GHashTable) streams = NULL;
+
+  /* Packets from an unpaired device are never streamed */
+  valent_object_lock (VALENT_OBJECT (device));
+  if (device->paired && device->streams != NULL)
+    streams = g_hash_table_ref (device->streams);
+  valent_object_unlock (VALENT_OBJECT (device));
+
+  valent_channel_read_view (channel,
+                            streams,
+                            (ValentChannelStreamFunc)valent_device_handle_stream,
+                            NULL,
+                            (GAsyncReadyCallback)read_view_cb,
+                            g_object_ref (device));
+}
+
+static void
+read_view_cb (ValentChannel *channel,
+              GAsyncResult  *result,
+              ValentDevice  *device)
 {
   g_autoptr (GError) error = NULL;
-  g_autoptr (JsonNode) packet = NULL;
+  g_autoptr (ValentPacketView) view = NULL;
+  gboolean streamed = FALSE;
 
   g_assert (VALENT_IS_CHANNEL (channel));
   g_assert (VALENT_IS_DEVICE (device));
 
-  packet = valent_channel_read_packet_finish (channel, result, &error);
+  view = valent_channel_read_view_finish (channel, result, &streamed, &error);
 
-  /* On success, queue another read before handling the packet */
-  if (packet != NULL)
+  /* On success, queue another read before handling the packet. Streamed
+   * packets have already been passed to their handler. */
+  if (view != NULL)
     {
-      valent_channel_read_packet (channel,
-                                  NULL,
-                                  (GAsyncReadyCallback)read_packet_cb,
-                                  g_object_ref (device));
+      valent_device_read_view (device, channel);
 
-      valent_device_handle_packet (device, packet);
+      if (!streamed)
+        {
+          valent_device_route_packet (device,
+                                      valent_packet_view_get_type (view),
+                                      NULL,
+                                      view);
+        }
     }
 
   /* On failure, drop our reference if it's still the active channel */
@@ -1343,12 +2011,10 @@ valent_device_set_channel (ValentDevice  *device,
       /* Handle the peer identity packet */
       peer_identity = valent_channel_get_peer_identity (channel);
       valent_device_handle_identity (device, peer_identity);
+      valent_channel_set_metrics (channel, device->metrics);
 
       /* Start receiving packets */
-      valent_channel_read_packet (channel,
-                                  NULL,
-                                  (GAsyncReadyCallback)read_packet_cb,
-                                  g_object_ref (device));
+      valent_device_read_view (device, channel);
     }
 
   valent_object_unlock (VALENT_OBJECT (device));
@@ -1357,10 +2023,63 @@ valent_device_set_channel (ValentDevice  *device,
   if (is_connected == was_connected)
     return;
 
+  valent_device_check_plugins (device);
   valent_device_update_plugins (device);
   g_object_notify_by_pspec (G_OBJECT (device), properties [PROP_STATE]);
 }
 
+/*< private >
+ * valent_device_get_metrics:
+ * @device: a #ValentDevice
+ *
+ * Get the traffic metrics for @device.
+ *
+ * Returns: (transfer none): a `ValentDeviceMetrics`
+ */
+ValentDeviceMetrics *
+valent_device_get_metrics (ValentDevice *device)
+{
+  g_return_val_if_fail (VALENT_IS_DEVICE (device), NULL);
+
+  return device->metrics;
+}
+
+/*< private >
+ * valent_device_dup_metrics:
+ * @device: a #ValentDevice
+ *
+ * Get a snapshot of the traffic metrics for @device.
+ *
+ * The result holds the members described for valent_device_metrics_serialize(),
+ * with the current and maximum depth of the outgoing packet queue for the
+ * active channel as `u` values, named `queue-depth` and `queue-depth-max`.
+ *
+ * Returns: (transfer floating): a `GVariant` of type `a{sv}`
+ */
+GVariant *
+valent_device_dup_metrics (ValentDevice *device)
+{
+  g_autoptr (GVariant) metrics = NULL;
+  GVariantDict dict;
+  unsigned int depth = 0;
+  unsigned int max_depth = 0;
+
+  g_return_val_if_fail (VALENT_IS_DEVICE (device), NULL);
+
+  metrics = g_variant_ref_sink (valent_device_metrics_serialize (device->metrics));
+  g_variant_dict_init (&dict, metrics);
+
+  valent_object_lock (VALENT_OBJECT (device));
+  if (device->channel != NULL)
+    depth = valent_channel_get_queue_depth (device->channel, &max_depth);
+  valent_object_unlock (VALENT_OBJECT (device));
+
+  g_variant_dict_insert (&dict, "queue-depth", "u", depth);
+  g_variant_dict_insert (&dict, "queue-depth-max", "u", max_depth);
+
+  return g_variant_dict_end (&dict);
+}
+
 /**
  * valent_device_get_context: (get-property context)
  * @device: a #ValentDevice
@@ -1493,6 +2212,7 @@ valent_device_set_paired (ValentDevice *device,
   valent_object_unlock (VALENT_OBJECT (device));
 
   /* Update plugins and notify */
+  valent_device_check_plugins (device);
   valent_device_update_plugins (device);
   valent_device_reset_pair (device);
 }
@@ -1561,49 +2281,147 @@ valent_device_get_state (ValentDevice *device)
   return state;
 }
 
-/**
- * valent_device_handle_packet:
+/*< private >
+ * valent_device_hold:
  * @device: a #ValentDevice
- * @packet: a KDE Connect packet
  *
- * Handle a packet from the remote device.
+ * Keep the plugins for @device active, even if it is disconnected or unpaired.
  *
- * Pairing packets are handled by the device and the only packets accepted if
- * the device is unpaired. Any other packets received from an unpaired device
- * are ignored and a request to unpair will be sent to the remote device.
+ * This should be called while the device is being presented to the user. Each
+ * call must be balanced by a call to valent_device_release().
+ */
+void
+valent_device_hold (ValentDevice *device)
+{
+  g_assert (VALENT_IS_DEVICE (device));
+
+  device->plugins_hold++;
+  valent_device_check_plugins (device);
+}
+
+/*< private >
+ * valent_device_release:
+ * @device: a #ValentDevice
  *
- * Any other packets received from a paired device will be routed to each plugin
- * claiming to support it.
+ * Release a hold acquired with valent_device_hold().
  */
 void
-valent_device_handle_packet (ValentDevice *device,
-                             JsonNode     *packet)
+valent_device_release (ValentDevice *device)
 {
-  GPtrArray *handlers = NULL;
-  const char *type;
+  g_assert (VALENT_IS_DEVICE (device));
+  g_return_if_fail (device->plugins_hold > 0);
+
+  device->plugins_hold--;
+  valent_device_check_plugins (device);
+}
+
+/*< private >
+ * valent_device_update_streams:
+ * @device: a #ValentDevice
+ *
+ * Update the table of packet types that are streamed as they are read.
+ *
+ * A type is only streamed if its sole handler is a streaming handler, since
+ * any other handler would require the packet in full. The table is replaced,
+ * rather than modified, because reads in progress hold a reference to it.
+ */
+static void
+valent_device_update_streams (ValentDevice *device)
+{
+  g_autoptr (GHashTable) streams = NULL;
+  GHashTableIter iter;
+  gpointer type;
+  GArray *handlers;
 
   g_assert (VALENT_IS_DEVICE (device));
-  g_assert (VALENT_IS_PACKET (packet));
 
-  VALENT_JSON (packet, device->name);
+  streams = g_hash_table_new (g_str_hash, g_str_equal);
+  g_hash_table_iter_init (&iter, device->handlers);
 
-  type = valent_packet_get_type (packet);
+  while (g_hash_table_iter_next (&iter, &type, (void **)&handlers))
+    {
+      const PacketHandler *entry = &g_array_index (handlers, PacketHandler, 0);
+
+      if (handlers->len == 1 && entry->stream_handler != NULL)
+        {
+          g_hash_table_insert (streams,
+                               (char *)g_quark_to_string (GPOINTER_TO_UINT (type)),
+                               (char *)entry->stream_field);
+        }
+    }
+
+  valent_object_lock (VALENT_OBJECT (device));
+  g_clear_pointer (&device->streams, g_hash_table_unref);
+  if (g_hash_table_size (streams) > 0)
+    device->streams = g_steal_pointer (&streams);
+  valent_object_unlock (VALENT_OBJECT (device));
+}
+
+/*< private >
+ * valent_device_route_packet:
+ * @device: a #ValentDevice
+ * @type: the packet type
+ * @packet: (nullable): a KDE Connect packet
+ * @view: (nullable): a `ValentPacketView`
+ *
+ * Route a packet, given as either a `JsonNode` or a `ValentPacketView`.
+ *
+ * When a view is given, a `JsonNode` tree is only built once a handler has
+ * been found, so packets from an unpaired device or of an unsupported type
+ * are dropped at the cost of the view.
+ */
+static void
+valent_device_route_packet (ValentDevice     *device,
+                            const char       *type,
+                            JsonNode         *packet,
+                            ValentPacketView *view)
+{
+  g_autoptr (JsonNode) node = NULL;
+  GArray *handlers = NULL;
+  GQuark type_quark;
+
+  g_assert (VALENT_IS_DEVICE (device));
+  g_assert (type != NULL);
+  g_assert ((packet == NULL) != (view == NULL));
+
+  /* Types are resolved to quarks, which are only interned for types
+   * registered by plugins, so unknown types are dropped without allocating. */
+  type_quark = g_quark_try_string (type);
+  VALENT_TRACE_EVENT (VALENT_TRACE_PACKET_RX, type, 0, 0);
 
   if G_UNLIKELY (g_str_equal (type, "kdeconnect.pair"))
     {
-      valent_device_handle_pair (device, packet);
+      node = packet ? json_node_ref (packet) : valent_packet_view_to_node (view);
+      VALENT_JSON (node, device->name);
+
+      valent_device_handle_pair (device, node);
     }
   else if G_UNLIKELY (!device->paired)
     {
       valent_device_send_pair (device, FALSE);
     }
-  else if ((handlers = g_hash_table_lookup (device->handlers, type)) != NULL)
+  else if ((handlers = g_hash_table_lookup (device->handlers, GUINT_TO_POINTER (type_quark))) != NULL)
     {
+      node = packet ? json_node_ref (packet) : valent_packet_view_to_node (view);
+      VALENT_JSON (node, device->name);
+
       for (unsigned int i = 0, len = handlers->len; i < len; i++)
         {
-          ValentDevicePlugin *handler = g_ptr_array_index (handlers, i);
-
-          valent_device_plugin_handle_packet (handler, type, packet);
+          const PacketHandler *entry = &g_array_index (handlers, PacketHandler, i);
+          int64_t begin_time = g_get_monotonic_time ();
+
+          if (entry->handler != NULL)
+            entry->handler (entry->plugin, node);
+          else
+            valent_device_plugin_handle_packet (entry->plugin, type, node);
+
+          valent_device_metrics_add_handler (device->metrics,
+                                             G_OBJECT_TYPE_NAME (entry->plugin),
+                                             g_get_monotonic_time () - begin_time);
+          VALENT_TRACE_EVENT (VALENT_TRACE_PLUGIN_DISPATCH,
+                              G_OBJECT_TYPE_NAME (entry->plugin),
+                              begin_time,
+                              type_quark);
         }
     }
   else
@@ -1612,6 +2430,33 @@ valent_device_handle_packet (ValentDevice *device,
     }
 }
 
+/**
+ * valent_device_handle_packet:
+ * @device: a #ValentDevice
+ * @packet: a KDE Connect packet
+ *
+ * Handle a packet from the remote device.
+ *
+ * Pairing packets are handled by the device and the only packets accepted if
+ * the device is unpaired. Any other packets received from an unpaired device
+ * are ignored and a request to unpair will be sent to the remote device.
+ *
+ * Any other packets received from a paired device will be routed to each plugin
+ * claiming to support it.
+ */
+void
+valent_device_handle_packet (ValentDevice *device,
+                             JsonNode     *packet)
+{
+  g_assert (VALENT_IS_DEVICE (device));
+  g_assert (VALENT_IS_PACKET (packet));
+
+  valent_device_route_packet (device,
+                              valent_packet_get_type (packet),
+                              packet,
+                              NULL);
+}
+
 /*< private >
  * valent_device_reload_plugins:
  * @device: a #ValentDevice
@@ -1683,9 +2528,7 @@ static gboolean
 valent_device_supports_plugin (ValentDevice   *device,
                                PeasPluginInfo *info)
 {
-  const char **device_incoming;
-  const char **device_outgoing;
-  const char *in_str, *out_str;
+  const PluginCapabilities *capabilities;
 
   g_assert (VALENT_IS_DEVICE (device));
   g_assert (info != NULL);
@@ -1696,47 +2539,36 @@ valent_device_supports_plugin (ValentDevice   *device,
     return FALSE;
 
   /* Packet-less plugins aren't dependent on device capabilities */
-  in_str = peas_plugin_info_get_external_data (info, "DevicePluginIncoming");
-  out_str = peas_plugin_info_get_external_data (info, "DevicePluginOutgoing");
+  capabilities = valent_device_get_plugin_capabilities (info);
 
-  if (in_str == NULL && out_str == NULL)
+  if (capabilities->packetless)
     return TRUE;
 
   /* Device hasn't supplied an identity packet yet */
-  device_incoming = (const char **)device->incoming_capabilities;
-  device_outgoing = (const char **)device->outgoing_capabilities;
-
-  if (device_incoming == NULL || device_outgoing == NULL)
+  if (device->incoming_capabilities == NULL ||
+      device->outgoing_capabilities == NULL)
     return FALSE;
 
-  /* Check if outgoing from plugin matches incoming from device */
-  if (out_str != NULL)
+  /* Recompute the device bitsets if the identity changed, or if plugins have
+   * registered new capabilities since they were computed */
+  G_LOCK (capability_lock);
+  if (device->incoming_bits == NULL ||
+      device->outgoing_bits == NULL ||
+      device->capability_serial != capability_serial)
     {
-      g_auto (GStrv) plugin_outgoing = NULL;
-
-      plugin_outgoing = g_strsplit(out_str, ";", -1);
-
-      for (int i = 0; plugin_outgoing[i]; i++)
-        {
-          if (g_strv_contains (device_incoming, plugin_outgoing[i]))
-            return TRUE;
-        }
+      g_clear_pointer (&device->incoming_bits, g_array_unref);
+      device->incoming_bits = capabilities_from_strv ((const char * const *)device->incoming_capabilities,
+                                                      FALSE);
+      g_clear_pointer (&device->outgoing_bits, g_array_unref);
+      device->outgoing_bits = capabilities_from_strv ((const char * const *)device->outgoing_capabilities,
+                                                      FALSE);
+      device->capability_serial = capability_serial;
     }
+  G_UNLOCK (capability_lock);
 
-  /* Check if incoming from plugin matches outgoing from device */
-  if (in_str != NULL)
-    {
-      g_auto (GStrv) plugin_incoming = NULL;
-
-      plugin_incoming = g_strsplit(in_str, ";", -1);
-
-      for (int i = 0; plugin_incoming[i]; i++)
-        {
-          if (g_strv_contains (device_outgoing, plugin_incoming[i]))
-            return TRUE;
-        }
-    }
-
-  return FALSE;
+  /* Check if outgoing from plugin matches incoming from device, or incoming
+   * from plugin matches outgoing from device */
+  return capabilities_intersect (capabilities->outgoing, device->incoming_bits) ||
+         capabilities_intersect (capabilities->incoming, device->outgoing_bits);
 }
 
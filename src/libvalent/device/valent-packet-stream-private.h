@@ -0,0 +1,53 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#pragma once
+
+#include "valent-packet-stream.h"
+#include "valent-packet-view.h"
+
+G_BEGIN_DECLS
+
+typedef struct _ValentPacketStreamWriter ValentPacketStreamWriter;
+
+/**
+ * ValentPacketStreamFunc:
+ * @stream: a `ValentPacketStream`
+ * @user_data: user supplied data
+ *
+ * Called from the reading thread when a packet begins streaming.
+ */
+typedef void (*ValentPacketStreamFunc) (ValentPacketStream *stream,
+                                        gpointer            user_data);
+
+_VALENT_EXTERN
+ValentPacketStream       * valent_packet_stream_new            (const char                *type,
+                                                                const char                *field);
+_VALENT_EXTERN
+ValentPacketStream       * valent_packet_stream_new_for_packet (JsonNode                  *packet,
+                                                                const char                *field);
+_VALENT_EXTERN
+ValentPacketStreamWriter * valent_packet_stream_ref_writer     (ValentPacketStream        *stream);
+_VALENT_EXTERN
+gboolean                   valent_packet_stream_writer_push    (ValentPacketStreamWriter  *writer,
+                                                                char                      *name,
+                                                                JsonNode                  *element);
+_VALENT_EXTERN
+void                       valent_packet_stream_writer_close   (ValentPacketStreamWriter  *writer,
+                                                                const GError              *error);
+_VALENT_EXTERN
+void                       valent_packet_stream_writer_unref   (ValentPacketStreamWriter  *writer);
+_VALENT_EXTERN
+ValentPacketView         * valent_packet_stream_read_line      (GBufferedInputStream      *input,
+                                                                GHashTable                *fields,
+                                                                ValentPacketStreamFunc     stream_func,
+                                                                gpointer                   stream_data,
+                                                                size_t                    *n_read,
+                                                                gboolean                  *streamed,
+                                                                GCancellable              *cancellable,
+                                                                GError                   **error);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (ValentPacketStreamWriter, valent_packet_stream_writer_unref)
+
+G_END_DECLS
+
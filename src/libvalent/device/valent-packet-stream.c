@@ -0,0 +1,1182 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#define G_LOG_DOMAIN "valent-packet-stream"
+
+#include "config.h"
+
+#include <string.h>
+
+#include <gio/gio.h>
+#include <json-glib/json-glib.h>
+
+#include "valent-packet.h"
+#include "valent-packet-stream.h"
+#include "valent-packet-stream-private.h"
+#include "valent-packet-view.h"
+
+/* The number of parsed elements that may be waiting for the consumer, before
+ * the reading thread blocks and stops reading from the channel. */
+#define STREAM_CAPACITY  (64)
+#define STREAM_MAX_DEPTH (128)
+
+
+/**
+ * ValentPacketStream:
+ *
+ * A stream of elements from a KDE Connect packet.
+ *
+ * `ValentPacketStream` delivers the elements of an array, or the members of an
+ * object, in the body of a packet while the rest of the packet is still being
+ * received. Plugins receive one by calling
+ * [func@Valent.DevicePluginClass.install_stream_handler] for a packet type.
+ *
+ * Elements are read with [method@Valent.PacketStream.read]. The channel only
+ * reads ahead a small number of elements, so a consumer that is slow to read,
+ * for example because it is committing each batch to a database, will slow
+ * the channel instead of accumulating the packet in memory. Dropping the last
+ * reference, or calling [method@Valent.PacketStream.close], discards the rest
+ * of the elements.
+ *
+ * Since: 1.0
+ */
+
+struct _ValentPacketStream
+{
+  GObject                   parent_instance;
+
+  char                     *packet_type;
+  const char               *field;
+  ValentPacketStreamWriter *writer;
+};
+
+G_DEFINE_FINAL_TYPE (ValentPacketStream, valent_packet_stream, G_TYPE_OBJECT)
+
+enum {
+  PROP_0,
+  PROP_FIELD,
+  PROP_PACKET_TYPE,
+  N_PROPERTIES
+};
+
+static GParamSpec *properties[N_PROPERTIES] = { NULL, };
+
+
+/*< private >
+ * ValentPacketStreamWriter:
+ *
+ * The producing end of a `ValentPacketStream`.
+ *
+ * The writer is shared between the stream and the thread reading from the
+ * channel, so that the stream can be finalized while a packet is still being
+ * read. Once the stream is closed, further elements are discarded.
+ */
+struct _ValentPacketStreamWriter
+{
+  GMutex        mutex;
+  GCond         cond;
+  GQueue        elements;
+  unsigned int  capacity;
+  GTask        *pending;
+  GError       *error;
+  unsigned int  finished : 1;
+  unsigned int  closed : 1;
+};
+
+typedef struct
+{
+  char     *name;
+  JsonNode *node;
+} StreamElement;
+
+static void
+stream_element_free (gpointer data)
+{
+  StreamElement *element = data;
+
+  g_clear_pointer (&element->name, g_free);
+  g_clear_pointer (&element->node, json_node_unref);
+  g_free (element);
+}
+
+static void
+valent_packet_stream_writer_clear (gpointer data)
+{
+  ValentPacketStreamWriter *self = data;
+
+  g_queue_clear_full (&self->elements, stream_element_free);
+  g_clear_object (&self->pending);
+  g_clear_error (&self->error);
+  g_cond_clear (&self->cond);
+  g_mutex_clear (&self->mutex);
+}
+
+static ValentPacketStreamWriter *
+valent_packet_stream_writer_new (unsigned int capacity)
+{
+  ValentPacketStreamWriter *self;
+
+  self = g_atomic_rc_box_new0 (ValentPacketStreamWriter);
+  g_mutex_init (&self->mutex);
+  g_cond_init (&self->cond);
+  g_queue_init (&self->elements);
+  self->capacity = capacity;
+
+  return self;
+}
+
+/*< private >
+ * valent_packet_stream_writer_unref:
+ * @writer: a `ValentPacketStreamWriter`
+ *
+ * Release a reference on @writer.
+ */
+void
+valent_packet_stream_writer_unref (ValentPacketStreamWriter *writer)
+{
+  g_atomic_rc_box_release_full (writer, valent_packet_stream_writer_clear);
+}
+
+/*< private >
+ * valent_packet_stream_writer_push:
+ * @writer: a `ValentPacketStreamWriter`
+ * @name: (transfer full) (nullable): a member name
+ * @element: (transfer full): a `JsonNode`
+ *
+ * Append an element to the stream.
+ *
+ * If the stream is bounded and full, this blocks until the consumer has read
+ * an element, so it must not be called from the consumer's thread.
+ *
+ * Returns: %TRUE, or %FALSE if the stream was closed by the consumer
+ */
+gboolean
+valent_packet_stream_writer_push (ValentPacketStreamWriter *writer,
+                                  char                     *name,
+                                  JsonNode                 *element)
+{
+  StreamElement *item;
+  GTask *task = NULL;
+
+  g_assert (writer != NULL);
+  g_assert (element != NULL);
+
+  item = g_new0 (StreamElement, 1);
+  item->name = name;
+  item->node = element;
+
+  g_mutex_lock (&writer->mutex);
+  while (!writer->closed &&
+         writer->capacity > 0 &&
+         writer->elements.length >= writer->capacity)
+    g_cond_wait (&writer->cond, &writer->mutex);
+
+  if (writer->closed)
+    {
+      g_mutex_unlock (&writer->mutex);
+      stream_element_free (item);
+      return FALSE;
+    }
+
+  if (writer->pending != NULL)
+    task = g_steal_pointer (&writer->pending);
+  else
+    g_queue_push_tail (&writer->elements, g_steal_pointer (&item));
+  g_mutex_unlock (&writer->mutex);
+
+  if (task != NULL)
+    {
+      g_task_return_pointer (task, item, stream_element_free);
+      g_object_unref (task);
+    }
+
+  return TRUE;
+}
+
+/*< private >
+ * valent_packet_stream_writer_close:
+ * @writer: a `ValentPacketStreamWriter`
+ * @error: (nullable): a #GError
+ *
+ * Mark the end of the stream. If @error is not %NULL, a copy will be returned
+ * to the consumer after any elements already in the stream.
+ */
+void
+valent_packet_stream_writer_close (ValentPacketStreamWriter *writer,
+                                   const GError             *error)
+{
+  GTask *task = NULL;
+
+  g_assert (writer != NULL);
+
+  g_mutex_lock (&writer->mutex);
+  if (writer->finished)
+    {
+      g_mutex_unlock (&writer->mutex);
+      return;
+    }
+
+  writer->finished = TRUE;
+  if (error != NULL)
+    writer->error = g_error_copy (error);
+  task = g_steal_pointer (&writer->pending);
+  g_mutex_unlock (&writer->mutex);
+
+  if (task != NULL)
+    {
+      if (error != NULL)
+        g_task_return_error (task, g_error_copy (error));
+      else
+        g_task_return_pointer (task, NULL, NULL);
+      g_object_unref (task);
+    }
+}
+
+/*
+ * Line Scanner
+ *
+ * The scanner tracks the structure of a packet as it is read, without parsing
+ * it. Once the packet type is known and the body begins, it checks whether
+ * the type is being streamed. If so, each element of the streamed container is
+ * collected and parsed on its own, while everything else is collected into a
+ * "skeleton" of the packet, which is validated as usual once the line ends.
+ *
+ * Packets that are not streamed, or that hold the body before the type, are
+ * copied into the skeleton without further scanning.
+ */
+enum
+{
+  ROOT_MEMBER_OTHER,
+  ROOT_MEMBER_TYPE,
+  ROOT_MEMBER_BODY,
+};
+
+typedef struct
+{
+  GByteArray               *skeleton;
+  GByteArray               *element;
+  size_t                    offset;
+
+  /* Structure */
+  char                      stack[STREAM_MAX_DEPTH];
+  unsigned int              depth;
+  size_t                    string_start;
+  unsigned int              root_member;
+  char                     *type;
+  unsigned int              in_string : 1;
+  unsigned int              escape : 1;
+  unsigned int              key_next : 1;
+  unsigned int              is_key : 1;
+  unsigned int              field_member : 1;
+  unsigned int              passthrough : 1;
+  unsigned int              discard : 1;
+  unsigned int              after_comma : 1;
+  unsigned int              space : 1;
+
+  /* Streaming */
+  GHashTable               *fields;
+  ValentPacketStreamFunc    stream_func;
+  gpointer                  stream_data;
+  const char               *field;
+  ValentPacketStreamWriter *writer;
+  unsigned int              container;
+} LineScanner;
+
+static inline GByteArray *
+line_scanner_target (LineScanner *self)
+{
+  if (self->container != 0 && self->depth >= self->container)
+    return self->element;
+
+  return self->skeleton;
+}
+
+static gboolean
+line_scanner_error (LineScanner  *self,
+                    const char   *message,
+                    GError      **error)
+{
+  g_set_error (error,
+               JSON_PARSER_ERROR,
+               JSON_PARSER_ERROR_PARSE,
+               "%s at offset %" G_GSIZE_FORMAT,
+               message,
+               self->offset);
+
+  return FALSE;
+}
+
+static inline gboolean
+line_scanner_match (const char *value,
+                    size_t      len,
+                    const char *string)
+{
+  return strlen (string) == len && memcmp (value, string, len) == 0;
+}
+
+static void
+line_scanner_end_string (LineScanner *self)
+{
+  const char *value;
+  size_t len;
+
+  /* Strings in the streamed container are parsed with the element */
+  if (self->container != 0 && self->depth >= self->container)
+    return;
+
+  value = (const char *)self->skeleton->data + self->string_start + 1;
+  len = self->skeleton->len - self->string_start - 2;
+
+  if (self->is_key)
+    {
+      if (self->depth == 1)
+        {
+          if (line_scanner_match (value, len, "type"))
+            self->root_member = ROOT_MEMBER_TYPE;
+          else if (line_scanner_match (value, len, "body"))
+            self->root_member = ROOT_MEMBER_BODY;
+          else
+            self->root_member = ROOT_MEMBER_OTHER;
+        }
+      else if (self->depth == 2 && self->root_member == ROOT_MEMBER_BODY)
+        {
+          self->field_member = (self->field != NULL &&
+                                line_scanner_match (value, len, self->field));
+        }
+    }
+  else if (self->depth == 1 &&
+           self->root_member == ROOT_MEMBER_TYPE &&
+           self->type == NULL)
+    {
+      self->type = g_strndup (value, len);
+    }
+}
+
+static gboolean
+line_scanner_begin_stream (LineScanner *self)
+{
+  g_autoptr (ValentPacketStream) stream = NULL;
+  gpointer field = NULL;
+
+  if (self->type == NULL ||
+      !g_hash_table_lookup_extended (self->fields, self->type, NULL, &field))
+    return FALSE;
+
+  stream = valent_packet_stream_new (self->type, field);
+  self->writer = valent_packet_stream_ref_writer (stream);
+  self->field = field;
+  self->stream_func (stream, self->stream_data);
+
+  return TRUE;
+}
+
+static gboolean
+line_scanner_flush (LineScanner  *self,
+                    gboolean      final,
+                    GError      **error)
+{
+  GByteArray *element = self->element;
+  gboolean is_member;
+  g_autoptr (JsonNode) node = NULL;
+  g_autofree char *name = NULL;
+
+  if (element->len == 0)
+    {
+      if (final && !self->after_comma)
+        return TRUE;
+
+      return line_scanner_error (self, "Expected a value", error);
+    }
+
+  self->after_comma = !final;
+
+  if (self->discard)
+    {
+      g_byte_array_set_size (element, 0);
+      return TRUE;
+    }
+
+  /* Object members are parsed as an object holding only that member */
+  is_member = (self->stack[self->container - 1] == '{');
+
+  if (is_member)
+    {
+      g_byte_array_prepend (element, (const guint8 *)"{", 1);
+      g_byte_array_append (element, (const guint8 *)"}", 1);
+    }
+
+  g_byte_array_append (element, (const guint8 *)"", 1);
+  node = valent_packet_view_parse_value ((char *)element->data,
+                                         element->len - 1,
+                                         error);
+  g_byte_array_set_size (element, 0);
+
+  if (node == NULL)
+    return FALSE;
+
+  if (is_member)
+    {
+      JsonObjectIter iter;
+      const char *member_name;
+      JsonNode *member_node;
+
+      json_object_iter_init (&iter, json_node_get_object (node));
+
+      if (!json_object_iter_next (&iter, &member_name, &member_node))
+        return line_scanner_error (self, "Expected an object member", error);
+
+      name = g_strdup (member_name);
+      json_node_ref (member_node);
+      g_clear_pointer (&node, json_node_unref);
+      node = member_node;
+    }
+
+  if (!valent_packet_stream_writer_push (self->writer,
+                                         g_steal_pointer (&name),
+                                         g_steal_pointer (&node)))
+    self->discard = TRUE;
+
+  return TRUE;
+}
+
+static gboolean
+line_scanner_open (LineScanner  *self,
+                   char          c,
+                   GError      **error)
+{
+  if G_UNLIKELY (self->depth >= STREAM_MAX_DEPTH)
+    return line_scanner_error (self, "Maximum nesting depth exceeded", error);
+
+  g_byte_array_append (line_scanner_target (self), (const guint8 *)&c, 1);
+  self->stack[self->depth++] = c;
+  self->key_next = (c == '{');
+
+  /* The body; either stream its members, or copy the remainder */
+  if (self->writer == NULL &&
+      self->depth == 2 &&
+      self->root_member == ROOT_MEMBER_BODY)
+    {
+      if (c != '{' || !line_scanner_begin_stream (self))
+        self->passthrough = TRUE;
+      else if (self->field == NULL)
+        self->container = self->depth;
+    }
+
+  /* A field of the body being streamed */
+  else if (self->writer != NULL &&
+           self->container == 0 &&
+           self->depth == 3 &&
+           self->root_member == ROOT_MEMBER_BODY &&
+           self->field_member)
+    {
+      self->container = self->depth;
+    }
+
+  return TRUE;
+}
+
+static gboolean
+line_scanner_close (LineScanner  *self,
+                    char          c,
+                    GError      **error)
+{
+  char expected = (c == '}') ? '{' : '[';
+
+  if G_UNLIKELY (self->depth == 0 || self->stack[self->depth - 1] != expected)
+    return line_scanner_error (self, "Unexpected closing bracket", error);
+
+  if (self->container != 0 && self->depth == self->container)
+    {
+      if (!line_scanner_flush (self, TRUE, error))
+        return FALSE;
+
+      /* The rest of the packet is only copied into the skeleton. The stream
+       * is left open until the line has been validated, so that an invalid
+       * packet still ends it with an error. */
+      self->container = 0;
+      self->passthrough = TRUE;
+    }
+
+  g_byte_array_append (line_scanner_target (self), (const guint8 *)&c, 1);
+  self->depth--;
+  self->key_next = FALSE;
+
+  return TRUE;
+}
+
+static gboolean
+line_scanner_feed (LineScanner  *self,
+                   const char   *data,
+                   size_t        len,
+                   GError      **error)
+{
+  size_t base = self->offset;
+  size_t i = 0;
+
+  while (i < len && !self->passthrough)
+    {
+      GByteArray *target = line_scanner_target (self);
+      char c = data[i];
+
+      /* Copy strings in runs, stopping only for escapes and the terminator */
+      if (self->in_string)
+        {
+          size_t start = i;
+
+          if (self->escape)
+            {
+              self->escape = FALSE;
+              i++;
+            }
+
+          while (i < len && data[i] != '"' && data[i] != '\\')
+            i++;
+
+          if (i < len)
+            {
+              self->escape = (data[i] == '\\');
+              self->in_string = self->escape;
+              i++;
+            }
+
+          g_byte_array_append (target, (const guint8 *)&data[start], i - start);
+
+          if (!self->in_string)
+            line_scanner_end_string (self);
+
+          continue;
+        }
+
+      self->offset = base + i;
+
+      /* Whitespace is dropped, except between two scalars where removing it
+       * would join them into one (e.g. `1 2` or `tru e`) */
+      if (self->space && c != ' ' && c != '\t' && c != '\r')
+        {
+          self->space = FALSE;
+
+          if (target->len > 0 &&
+              strchr ("{}[],:\"", c) == NULL &&
+              strchr ("{[,:", target->data[target->len - 1]) == NULL)
+            g_byte_array_append (target, (const guint8 *)" ", 1);
+        }
+
+      switch (c)
+        {
+        case '"':
+          self->in_string = TRUE;
+          self->is_key = self->key_next;
+          self->key_next = FALSE;
+          self->string_start = target->len;
+          g_byte_array_append (target, (const guint8 *)&c, 1);
+          break;
+
+        case '{':
+        case '[':
+          if (!line_scanner_open (self, c, error))
+            return FALSE;
+          break;
+
+        case '}':
+        case ']':
+          if (!line_scanner_close (self, c, error))
+            return FALSE;
+          break;
+
+        case ',':
+          if (self->container != 0 && self->depth == self->container)
+            {
+              if (!line_scanner_flush (self, FALSE, error))
+                return FALSE;
+            }
+          else
+            {
+              g_byte_array_append (target, (const guint8 *)&c, 1);
+            }
+
+          self->key_next = (self->depth > 0 && self->stack[self->depth - 1] == '{');
+          break;
+
+        case ' ':
+        case '\t':
+        case '\r':
+          self->space = TRUE;
+          break;
+
+        default:
+          g_byte_array_append (target, (const guint8 *)&c, 1);
+          break;
+        }
+
+      i++;
+    }
+
+  if (i < len)
+    g_byte_array_append (self->skeleton, (const guint8 *)&data[i], len - i);
+
+  self->offset = base + len;
+
+  return TRUE;
+}
+
+/*< private >
+ * valent_packet_stream_read_line:
+ * @input: a `GBufferedInputStream`
+ * @fields: (nullable): a table of packet types to streamed fields
+ * @stream_func: (scope call): a `ValentPacketStreamFunc`
+ * @stream_data: user supplied data for @stream_func
+ * @n_read: (out): the number of bytes read, including the line terminator
+ * @streamed: (out): whether a stream was started for the packet
+ * @cancellable: (nullable): a `GCancellable`
+ * @error: (nullable): a `GError`
+ *
+ * Read a KDE Connect packet from @input, streaming its elements if the packet
+ * type is in @fields.
+ *
+ * Each entry in @fields maps a packet type to the name of an array or object
+ * in the body of the packet, or %NULL to stream the members of the body. When
+ * a matching packet is read, @stream_func is called with a new
+ * `ValentPacketStream` from the reading thread, before the container is read.
+ *
+ * The result is a view of the packet, with the streamed container left empty.
+ * If the line can not be parsed or validated, the stream ends with the same
+ * error.
+ *
+ * Returns: (transfer full) (nullable): a `ValentPacketView`
+ */
+ValentPacketView *
+valent_packet_stream_read_line (GBufferedInputStream    *input,
+                                GHashTable              *fields,
+                                ValentPacketStreamFunc   stream_func,
+                                gpointer                 stream_data,
+                                size_t                  *n_read,
+                                gboolean                *streamed,
+                                GCancellable            *cancellable,
+                                GError                 **error)
+{
+  LineScanner scanner = { 0, };
+  ValentPacketView *view = NULL;
+  size_t total = 0;
+  size_t line_len;
+  char *line;
+  GError *local_error = NULL;
+
+  g_return_val_if_fail (G_IS_BUFFERED_INPUT_STREAM (input), NULL);
+  g_return_val_if_fail (fields == NULL || stream_func != NULL, NULL);
+  g_return_val_if_fail (n_read != NULL && streamed != NULL, NULL);
+
+  scanner.skeleton = g_byte_array_new ();
+  scanner.element = g_byte_array_new ();
+  scanner.fields = fields;
+  scanner.stream_func = stream_func;
+  scanner.stream_data = stream_data;
+  scanner.passthrough = (fields == NULL || g_hash_table_size (fields) == 0);
+
+  while (TRUE)
+    {
+      const char *buffer;
+      const char *newline;
+      gsize available = 0;
+      gsize count;
+
+      buffer = g_buffered_input_stream_peek_buffer (input, &available);
+
+      if (available == 0)
+        {
+          gssize n_filled;
+
+          n_filled = g_buffered_input_stream_fill (input,
+                                                   -1,
+                                                   cancellable,
+                                                   &local_error);
+
+          if (n_filled < 0)
+            goto out;
+
+          /* As with g_data_input_stream_read_line(), the end of the stream
+           * terminates a partial line. */
+          if (n_filled == 0)
+            {
+              if (total == 0)
+                {
+                  g_set_error_literal (&local_error,
+                                       G_IO_ERROR,
+                                       G_IO_ERROR_CONNECTION_CLOSED,
+                                       "Channel is closed");
+                  goto out;
+                }
+
+              break;
+            }
+
+          continue;
+        }
+
+      newline = memchr (buffer, '\n', available);
+      count = (newline != NULL) ? (gsize)(newline - buffer) : available;
+
+      if (!line_scanner_feed (&scanner, buffer, count, &local_error))
+        goto out;
+
+      if (newline != NULL)
+        count += 1;
+
+      g_input_stream_skip (G_INPUT_STREAM (input), count, NULL, NULL);
+      total += count;
+
+      if (newline != NULL)
+        break;
+    }
+
+  line_len = scanner.skeleton->len;
+  g_byte_array_append (scanner.skeleton, (const guint8 *)"", 1);
+  line = (char *)g_byte_array_free (g_steal_pointer (&scanner.skeleton), FALSE);
+  line = g_realloc (line, line_len + 1);
+  view = valent_packet_view_new (line, line_len, &local_error);
+
+out:
+  if (scanner.writer != NULL)
+    {
+      if (local_error == NULL && scanner.container != 0)
+        line_scanner_error (&scanner, "Unexpected end of packet", &local_error);
+
+      valent_packet_stream_writer_close (scanner.writer, local_error);
+      g_clear_pointer (&scanner.writer, valent_packet_stream_writer_unref);
+      *streamed = TRUE;
+    }
+  else
+    {
+      *streamed = FALSE;
+    }
+
+  g_clear_pointer (&scanner.skeleton, g_byte_array_unref);
+  g_clear_pointer (&scanner.element, g_byte_array_unref);
+  g_clear_pointer (&scanner.type, g_free);
+  *n_read = total;
+
+  if (local_error != NULL)
+    {
+      g_clear_pointer (&view, valent_packet_view_unref);
+      g_propagate_error (error, local_error);
+    }
+
+  return view;
+}
+
+/*
+ * GObject
+ */
+static void
+valent_packet_stream_finalize (GObject *object)
+{
+  ValentPacketStream *self = VALENT_PACKET_STREAM (object);
+
+  valent_packet_stream_close (self);
+  g_clear_pointer (&self->writer, valent_packet_stream_writer_unref);
+  g_clear_pointer (&self->packet_type, g_free);
+
+  G_OBJECT_CLASS (valent_packet_stream_parent_class)->finalize (object);
+}
+
+static void
+valent_packet_stream_get_property (GObject    *object,
+                                   guint       prop_id,
+                                   GValue     *value,
+                                   GParamSpec *pspec)
+{
+  ValentPacketStream *self = VALENT_PACKET_STREAM (object);
+
+  switch (prop_id)
+    {
+    case PROP_FIELD:
+      g_value_set_string (value, self->field);
+      break;
+
+    case PROP_PACKET_TYPE:
+      g_value_set_string (value, self->packet_type);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+valent_packet_stream_set_property (GObject      *object,
+                                   guint         prop_id,
+                                   const GValue *value,
+                                   GParamSpec   *pspec)
+{
+  ValentPacketStream *self = VALENT_PACKET_STREAM (object);
+
+  switch (prop_id)
+    {
+    case PROP_FIELD:
+      self->field = g_intern_string (g_value_get_string (value));
+      break;
+
+    case PROP_PACKET_TYPE:
+      self->packet_type = g_value_dup_string (value);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+valent_packet_stream_class_init (ValentPacketStreamClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = valent_packet_stream_finalize;
+  object_class->get_property = valent_packet_stream_get_property;
+  object_class->set_property = valent_packet_stream_set_property;
+
+  /**
+   * ValentPacketStream:field: (getter get_field)
+   *
+   * The name of the streamed field in the packet body, or %NULL if the
+   * members of the body are streamed.
+   *
+   * Since: 1.0
+   */
+  properties [PROP_FIELD] =
+    g_param_spec_string ("field", NULL, NULL,
+                         NULL,
+                         (G_PARAM_READWRITE |
+                          G_PARAM_CONSTRUCT_ONLY |
+                          G_PARAM_EXPLICIT_NOTIFY |
+                          G_PARAM_STATIC_STRINGS));
+
+  /**
+   * ValentPacketStream:packet-type: (getter get_packet_type)
+   *
+   * The KDE Connect packet type.
+   *
+   * Since: 1.0
+   */
+  properties [PROP_PACKET_TYPE] =
+    g_param_spec_string ("packet-type", NULL, NULL,
+                         NULL,
+                         (G_PARAM_READWRITE |
+                          G_PARAM_CONSTRUCT_ONLY |
+                          G_PARAM_EXPLICIT_NOTIFY |
+                          G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_properties (object_class, N_PROPERTIES, properties);
+}
+
+static void
+valent_packet_stream_init (ValentPacketStream *self)
+{
+  self->writer = valent_packet_stream_writer_new (STREAM_CAPACITY);
+}
+
+/*< private >
+ * valent_packet_stream_new:
+ * @type: a KDE Connect packet type
+ * @field: (nullable): a field name
+ *
+ * Create a new stream for a packet of @type, to be filled by the writer
+ * returned from valent_packet_stream_ref_writer().
+ *
+ * Returns: (transfer full): a new `ValentPacketStream`
+ */
+ValentPacketStream *
+valent_packet_stream_new (const char *type,
+                          const char *field)
+{
+  g_return_val_if_fail (type != NULL && *type != '\0', NULL);
+
+  return g_object_new (VALENT_TYPE_PACKET_STREAM,
+                       "field",       field,
+                       "packet-type", type,
+                       NULL);
+}
+
+/*< private >
+ * valent_packet_stream_new_for_packet:
+ * @packet: a KDE Connect packet
+ * @field: (nullable): a field name
+ *
+ * Create a new stream holding the elements of @field in the body of @packet,
+ * or the members of the body if @field is %NULL.
+ *
+ * This is used to deliver packets that were received in full, such as those
+ * that hold the body before the type, to a stream handler.
+ *
+ * Returns: (transfer full): a new `ValentPacketStream`
+ */
+ValentPacketStream *
+valent_packet_stream_new_for_packet (JsonNode   *packet,
+                                     const char *field)
+{
+  ValentPacketStream *ret;
+  ValentPacketStreamWriter *writer;
+  JsonObject *body;
+  JsonNode *node;
+
+  g_return_val_if_fail (VALENT_IS_PACKET (packet), NULL);
+
+  ret = valent_packet_stream_new (valent_packet_get_type (packet), field);
+  writer = ret->writer;
+  writer->capacity = 0;
+
+  body = valent_packet_get_body (packet);
+
+  if (field == NULL)
+    {
+      JsonObjectIter iter;
+      const char *name;
+
+      json_object_iter_init (&iter, body);
+
+      while (json_object_iter_next (&iter, &name, &node))
+        valent_packet_stream_writer_push (writer, g_strdup (name), json_node_ref (node));
+    }
+  else if ((node = json_object_get_member (body, field)) != NULL)
+    {
+      if (JSON_NODE_HOLDS_ARRAY (node))
+        {
+          JsonArray *array = json_node_get_array (node);
+          unsigned int n_elements = json_array_get_length (array);
+
+          for (unsigned int i = 0; i < n_elements; i++)
+            {
+              valent_packet_stream_writer_push (writer,
+                                                NULL,
+                                                json_array_dup_element (array, i));
+            }
+        }
+      else if (JSON_NODE_HOLDS_OBJECT (node))
+        {
+          JsonObjectIter iter;
+          const char *name;
+          JsonNode *member;
+
+          json_object_iter_init (&iter, json_node_get_object (node));
+
+          while (json_object_iter_next (&iter, &name, &member))
+            valent_packet_stream_writer_push (writer, g_strdup (name), json_node_ref (member));
+        }
+    }
+
+  valent_packet_stream_writer_close (writer, NULL);
+
+  return ret;
+}
+
+/*< private >
+ * valent_packet_stream_ref_writer:
+ * @stream: a `ValentPacketStream`
+ *
+ * Get the producing end of @stream.
+ *
+ * Returns: (transfer full): a `ValentPacketStreamWriter`
+ */
+ValentPacketStreamWriter *
+valent_packet_stream_ref_writer (ValentPacketStream *stream)
+{
+  g_return_val_if_fail (VALENT_IS_PACKET_STREAM (stream), NULL);
+
+  return g_atomic_rc_box_acquire (stream->writer);
+}
+
+/**
+ * valent_packet_stream_get_field: (get-property field)
+ * @stream: a `ValentPacketStream`
+ *
+ * Get the name of the streamed field in the packet body.
+ *
+ * Returns: (nullable): a field name, or %NULL for the members of the body
+ *
+ * Since: 1.0
+ */
+const char *
+valent_packet_stream_get_field (ValentPacketStream *stream)
+{
+  g_return_val_if_fail (VALENT_IS_PACKET_STREAM (stream), NULL);
+
+  return stream->field;
+}
+
+/**
+ * valent_packet_stream_get_packet_type: (get-property packet-type)
+ * @stream: a `ValentPacketStream`
+ *
+ * Get the KDE Connect packet type of the stream.
+ *
+ * Returns: (not nullable): a packet type
+ *
+ * Since: 1.0
+ */
+const char *
+valent_packet_stream_get_packet_type (ValentPacketStream *stream)
+{
+  g_return_val_if_fail (VALENT_IS_PACKET_STREAM (stream), NULL);
+
+  return stream->packet_type;
+}
+
+/**
+ * valent_packet_stream_read:
+ * @stream: a `ValentPacketStream`
+ * @cancellable: (nullable): a `GCancellable`
+ * @callback: (scope async): a `GAsyncReadyCallback`
+ * @user_data: (closure): user supplied data
+ *
+ * Read the next element from @stream.
+ *
+ * Only one read may be pending at a time. The channel will not read more than
+ * a few elements ahead of the consumer, so elements should be read as soon as
+ * the previous one has been handled.
+ *
+ * Call [method@Valent.PacketStream.read_finish] to get the result.
+ *
+ * Since: 1.0
+ */
+void
+valent_packet_stream_read (ValentPacketStream  *stream,
+                           GCancellable        *cancellable,
+                           GAsyncReadyCallback  callback,
+                           gpointer             user_data)
+{
+  ValentPacketStreamWriter *writer;
+  g_autoptr (GTask) task = NULL;
+  StreamElement *element = NULL;
+
+  g_return_if_fail (VALENT_IS_PACKET_STREAM (stream));
+  g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+
+  task = g_task_new (stream, cancellable, callback, user_data);
+  g_task_set_source_tag (task, valent_packet_stream_read);
+
+  if (g_task_return_error_if_cancelled (task))
+    return;
+
+  writer = stream->writer;
+  g_mutex_lock (&writer->mutex);
+
+  if (writer->pending != NULL)
+    {
+      g_mutex_unlock (&writer->mutex);
+      g_task_return_new_error (task,
+                               G_IO_ERROR,
+                               G_IO_ERROR_PENDING,
+                               "Stream has outstanding operation");
+      return;
+    }
+
+  if (writer->closed)
+    {
+      g_mutex_unlock (&writer->mutex);
+      g_task_return_new_error (task,
+                               G_IO_ERROR,
+                               G_IO_ERROR_CLOSED,
+                               "Stream is closed");
+      return;
+    }
+
+  if ((element = g_queue_pop_head (&writer->elements)) != NULL)
+    {
+      g_cond_signal (&writer->cond);
+      g_mutex_unlock (&writer->mutex);
+      g_task_return_pointer (task, element, stream_element_free);
+      return;
+    }
+
+  if (writer->finished)
+    {
+      g_mutex_unlock (&writer->mutex);
+
+      if (writer->error != NULL)
+        g_task_return_error (task, g_error_copy (writer->error));
+      else
+        g_task_return_pointer (task, NULL, NULL);
+      return;
+    }
+
+  writer->pending = g_steal_pointer (&task);
+  g_mutex_unlock (&writer->mutex);
+}
+
+/**
+ * valent_packet_stream_read_finish:
+ * @stream: a `ValentPacketStream`
+ * @result: a `GAsyncResult`
+ * @name: (out) (optional) (nullable): the member name, if streaming an object
+ * @error: (nullable): a `GError`
+ *
+ * Finish an operation started by [method@Valent.PacketStream.read].
+ *
+ * If the end of the stream was reached, %NULL is returned without setting
+ * @error. If the packet was malformed or truncated, %NULL is returned with
+ * @error set.
+ *
+ * Returns: (transfer full) (nullable): a `JsonNode`
+ *
+ * Since: 1.0
+ */
+JsonNode *
+valent_packet_stream_read_finish (ValentPacketStream  *stream,
+                                  GAsyncResult        *result,
+                                  char               **name,
+                                  GError             **error)
+{
+  StreamElement *element;
+  JsonNode *ret;
+
+  g_return_val_if_fail (VALENT_IS_PACKET_STREAM (stream), NULL);
+  g_return_val_if_fail (g_task_is_valid (result, stream), NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  if ((element = g_task_propagate_pointer (G_TASK (result), error)) == NULL)
+    return NULL;
+
+  if (name != NULL)
+    *name = g_steal_pointer (&element->name);
+
+  ret = g_steal_pointer (&element->node);
+  stream_element_free (element);
+
+  return ret;
+}
+
+/**
+ * valent_packet_stream_close:
+ * @stream: a `ValentPacketStream`
+ *
+ * Close @stream, discarding any elements that have not been read.
+ *
+ * Any pending read will fail with %G_IO_ERROR_CLOSED. This is called
+ * automatically when the stream is finalized.
+ *
+ * Since: 1.0
+ */
+void
+valent_packet_stream_close (ValentPacketStream *stream)
+{
+  ValentPacketStreamWriter *writer;
+  GTask *task = NULL;
+
+  g_return_if_fail (VALENT_IS_PACKET_STREAM (stream));
+
+  writer = stream->writer;
+  g_mutex_lock (&writer->mutex);
+  writer->closed = TRUE;
+  g_queue_clear_full (&writer->elements, stream_element_free);
+  task = g_steal_pointer (&writer->pending);
+  g_cond_broadcast (&writer->cond);
+  g_mutex_unlock (&writer->mutex);
+
+  if (task != NULL)
+    {
+      g_task_return_new_error (task,
+                               G_IO_ERROR,
+                               G_IO_ERROR_CLOSED,
+                               "Stream is closed");
+      g_object_unref (task);
+    }
+}
+
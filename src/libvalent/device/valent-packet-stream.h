@@ -0,0 +1,40 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#pragma once
+
+#if !defined (VALENT_INSIDE) && !defined (VALENT_COMPILATION)
+# error "Only <valent.h> can be included directly."
+#endif
+
+#include <gio/gio.h>
+#include <json-glib/json-glib.h>
+
+#include "../core/valent-version.h"
+
+G_BEGIN_DECLS
+
+#define VALENT_TYPE_PACKET_STREAM (valent_packet_stream_get_type())
+
+VALENT_AVAILABLE_IN_1_0
+G_DECLARE_FINAL_TYPE (ValentPacketStream, valent_packet_stream, VALENT, PACKET_STREAM, GObject)
+
+VALENT_AVAILABLE_IN_1_0
+const char * valent_packet_stream_get_field       (ValentPacketStream   *stream);
+VALENT_AVAILABLE_IN_1_0
+const char * valent_packet_stream_get_packet_type (ValentPacketStream   *stream);
+VALENT_AVAILABLE_IN_1_0
+void         valent_packet_stream_read            (ValentPacketStream   *stream,
+                                                   GCancellable         *cancellable,
+                                                   GAsyncReadyCallback   callback,
+                                                   gpointer              user_data);
+VALENT_AVAILABLE_IN_1_0
+JsonNode   * valent_packet_stream_read_finish     (ValentPacketStream   *stream,
+                                                   GAsyncResult         *result,
+                                                   char                **name,
+                                                   GError              **error);
+VALENT_AVAILABLE_IN_1_0
+void         valent_packet_stream_close           (ValentPacketStream   *stream);
+
+G_END_DECLS
+
@@ -0,0 +1,1124 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#define G_LOG_DOMAIN "valent-packet-view"
+
+#include "config.h"
+
+#include <json-glib/json-glib.h>
+
+#include "valent-packet.h"
+#include "valent-packet-view.h"
+
+/* Nesting beyond this depth is rejected, since the parser is recursive */
+#define VIEW_MAX_DEPTH   (128)
+#define VIEW_MAX_LENGTH  ((1U << 28) - 1)
+
+
+/*< private >
+ * ValentPacketView:
+ *
+ * A compact, read-only view of a KDE Connect packet.
+ *
+ * A view owns the line it was parsed from. Strings are decoded in place and
+ * terminated in the buffer, so member names and string values are never
+ * copied. Every other value is described by a fixed-size token, in document
+ * order, with the index of the following value so that a subtree can be
+ * skipped without walking it.
+ *
+ * A `JsonNode` tree costs several allocations for each value, while a view
+ * costs one token, so a packet holding thousands of messages or contacts can
+ * be routed and inspected for a fraction of the heap. Consumers that require
+ * a `JsonNode` can call valent_packet_view_to_node().
+ */
+typedef enum
+{
+  VIEW_NULL,
+  VIEW_FALSE,
+  VIEW_TRUE,
+  VIEW_INT,
+  VIEW_DOUBLE,
+  VIEW_STRING,
+  VIEW_ARRAY,
+  VIEW_OBJECT,
+} ViewKind;
+
+typedef struct
+{
+  uint32_t kind : 4;
+  uint32_t length : 28;
+  uint32_t offset;
+  uint32_t next;
+} ViewToken;
+
+struct _ValentPacketView
+{
+  char         *json;
+  size_t        json_len;
+  ViewToken    *tokens;
+  unsigned int  n_tokens;
+
+  /* Root members */
+  unsigned int  body;
+  const char   *type;
+  int64_t       id;
+  gboolean      has_payload;
+};
+
+typedef struct
+{
+  char         *json;
+  size_t        len;
+  size_t        pos;
+  ViewToken    *tokens;
+  unsigned int  n_tokens;
+  unsigned int  n_allocated;
+} ViewParser;
+
+
+/*
+ * Parser
+ */
+static inline void
+view_parser_skip_whitespace (ViewParser *parser)
+{
+  while (parser->pos < parser->len)
+    {
+      char c = parser->json[parser->pos];
+
+      if (c != ' ' && c != '\t' && c != '\n' && c != '\r')
+        break;
+
+      parser->pos++;
+    }
+}
+
+static inline char
+view_parser_peek (ViewParser *parser)
+{
+  return parser->pos < parser->len ? parser->json[parser->pos] : '\0';
+}
+
+static unsigned int
+view_parser_push (ViewParser *parser,
+                  ViewKind    kind,
+                  size_t      offset)
+{
+  ViewToken *token;
+
+  if G_UNLIKELY (parser->n_tokens == parser->n_allocated)
+    {
+      parser->n_allocated = MAX (parser->n_allocated * 2, 64);
+      parser->tokens = g_renew (ViewToken, parser->tokens, parser->n_allocated);
+    }
+
+  token = &parser->tokens[parser->n_tokens];
+  token->kind = kind;
+  token->length = 0;
+  token->offset = (uint32_t)offset;
+  token->next = parser->n_tokens + 1;
+
+  return parser->n_tokens++;
+}
+
+static gboolean
+view_parser_error (ViewParser       *parser,
+                   JsonParserError   code,
+                   const char       *message,
+                   GError          **error)
+{
+  g_set_error (error,
+               JSON_PARSER_ERROR,
+               code,
+               "%s at offset %" G_GSIZE_FORMAT,
+               message,
+               parser->pos);
+
+  return FALSE;
+}
+
+static gboolean
+view_parser_parse_literal (ViewParser  *parser,
+                           const char  *literal,
+                           size_t       literal_len,
+                           ViewKind     kind,
+                           GError     **error)
+{
+  if (parser->len - parser->pos < literal_len ||
+      memcmp (parser->json + parser->pos, literal, literal_len) != 0)
+    {
+      return view_parser_error (parser,
+                                JSON_PARSER_ERROR_INVALID_BAREWORD,
+                                "Invalid bareword",
+                                error);
+    }
+
+  view_parser_push (parser, kind, parser->pos);
+  parser->pos += literal_len;
+
+  return TRUE;
+}
+
+static gboolean
+view_parser_parse_number (ViewParser  *parser,
+                          GError     **error)
+{
+  const char *json = parser->json;
+  size_t start = parser->pos;
+  ViewKind kind = VIEW_INT;
+
+  if (view_parser_peek (parser) == '-')
+    parser->pos++;
+
+  if (!g_ascii_isdigit (view_parser_peek (parser)))
+    goto invalid;
+
+  if (json[parser->pos] == '0')
+    parser->pos++;
+  else
+    while (g_ascii_isdigit (view_parser_peek (parser)))
+      parser->pos++;
+
+  if (view_parser_peek (parser) == '.')
+    {
+      kind = VIEW_DOUBLE;
+      parser->pos++;
+
+      if (!g_ascii_isdigit (view_parser_peek (parser)))
+        goto invalid;
+
+      while (g_ascii_isdigit (view_parser_peek (parser)))
+        parser->pos++;
+    }
+
+  if (view_parser_peek (parser) == 'e' || view_parser_peek (parser) == 'E')
+    {
+      kind = VIEW_DOUBLE;
+      parser->pos++;
+
+      if (view_parser_peek (parser) == '+' || view_parser_peek (parser) == '-')
+        parser->pos++;
+
+      if (!g_ascii_isdigit (view_parser_peek (parser)))
+        goto invalid;
+
+      while (g_ascii_isdigit (view_parser_peek (parser)))
+        parser->pos++;
+    }
+
+  view_parser_push (parser, kind, start);
+
+  return TRUE;
+
+invalid:
+  return view_parser_error (parser,
+                            JSON_PARSER_ERROR_INVALID_DATA,
+                            "Invalid number",
+                            error);
+}
+
+static inline gboolean
+view_parser_parse_hex (ViewParser *parser,
+                       gunichar   *value)
+{
+  *value = 0;
+
+  if (parser->len - parser->pos < 4)
+    return FALSE;
+
+  for (unsigned int i = 0; i < 4; i++)
+    {
+      int digit = g_ascii_xdigit_value (parser->json[parser->pos++]);
+
+      if (digit < 0)
+        return FALSE;
+
+      *value = (*value << 4) | digit;
+    }
+
+  return TRUE;
+}
+
+/*
+ * Strings are decoded in place. An escape sequence is never shorter than the
+ * character it encodes, so the output never overtakes the input and the
+ * closing quote always leaves room for the terminator.
+ */
+static gboolean
+view_parser_parse_string (ViewParser  *parser,
+                          GError     **error)
+{
+  char *out;
+
+  parser->pos++;
+  view_parser_push (parser, VIEW_STRING, parser->pos);
+  out = parser->json + parser->pos;
+
+  while (parser->pos < parser->len)
+    {
+      char c = parser->json[parser->pos];
+
+      if (c == '"')
+        {
+          *out = '\0';
+          parser->pos++;
+          return TRUE;
+        }
+
+      if G_UNLIKELY ((unsigned char)c < 0x20)
+        {
+          return view_parser_error (parser,
+                                    JSON_PARSER_ERROR_INVALID_DATA,
+                                    "Unescaped control character in string",
+                                    error);
+        }
+
+      if (c != '\\')
+        {
+          *out++ = c;
+          parser->pos++;
+          continue;
+        }
+
+      parser->pos++;
+
+      switch (view_parser_peek (parser))
+        {
+        case '"':
+        case '\\':
+        case '/':
+          *out++ = parser->json[parser->pos++];
+          break;
+
+        case 'b':
+          *out++ = '\b';
+          parser->pos++;
+          break;
+
+        case 'f':
+          *out++ = '\f';
+          parser->pos++;
+          break;
+
+        case 'n':
+          *out++ = '\n';
+          parser->pos++;
+          break;
+
+        case 'r':
+          *out++ = '\r';
+          parser->pos++;
+          break;
+
+        case 't':
+          *out++ = '\t';
+          parser->pos++;
+          break;
+
+        case 'u':
+          {
+            gunichar ch, low;
+
+            parser->pos++;
+
+            if (!view_parser_parse_hex (parser, &ch))
+              goto invalid;
+
+            /* Combine UTF-16 surrogate pairs */
+            if (ch >= 0xd800 && ch <= 0xdbff)
+              {
+                if (parser->len - parser->pos < 2 ||
+                    parser->json[parser->pos++] != '\\' ||
+                    parser->json[parser->pos++] != 'u' ||
+                    !view_parser_parse_hex (parser, &low) ||
+                    low < 0xdc00 || low > 0xdfff)
+                  goto invalid;
+
+                ch = 0x10000 + ((ch - 0xd800) << 10) + (low - 0xdc00);
+              }
+            else if (ch == 0 || (ch >= 0xdc00 && ch <= 0xdfff))
+              {
+                goto invalid;
+              }
+
+            out += g_unichar_to_utf8 (ch, out);
+          }
+          break;
+
+        default:
+          goto invalid;
+        }
+    }
+
+  return view_parser_error (parser,
+                            JSON_PARSER_ERROR_PARSE,
+                            "Unterminated string",
+                            error);
+
+invalid:
+  return view_parser_error (parser,
+                            JSON_PARSER_ERROR_INVALID_DATA,
+                            "Invalid escape sequence",
+                            error);
+}
+
+static gboolean view_parser_parse_value (ViewParser    *parser,
+                                         unsigned int   depth,
+                                         GError       **error);
+
+static gboolean
+view_parser_parse_array (ViewParser    *parser,
+                         unsigned int   depth,
+                         GError       **error)
+{
+  unsigned int index;
+  unsigned int length = 0;
+
+  index = view_parser_push (parser, VIEW_ARRAY, parser->pos);
+  parser->pos++;
+  view_parser_skip_whitespace (parser);
+
+  if (view_parser_peek (parser) != ']')
+    {
+      while (TRUE)
+        {
+          if (!view_parser_parse_value (parser, depth + 1, error))
+            return FALSE;
+
+          if G_UNLIKELY (++length > VIEW_MAX_LENGTH)
+            return view_parser_error (parser,
+                                      JSON_PARSER_ERROR_PARSE,
+                                      "Too many elements",
+                                      error);
+
+          view_parser_skip_whitespace (parser);
+
+          if (view_parser_peek (parser) == ']')
+            break;
+
+          if (view_parser_peek (parser) != ',')
+            return view_parser_error (parser,
+                                      JSON_PARSER_ERROR_MISSING_COMMA,
+                                      "Expected ',' or ']'",
+                                      error);
+
+          parser->pos++;
+          view_parser_skip_whitespace (parser);
+
+          if (view_parser_peek (parser) == ']')
+            return view_parser_error (parser,
+                                      JSON_PARSER_ERROR_TRAILING_COMMA,
+                                      "Trailing comma",
+                                      error);
+        }
+    }
+
+  parser->pos++;
+  parser->tokens[index].length = length;
+  parser->tokens[index].next = parser->n_tokens;
+
+  return TRUE;
+}
+
+static gboolean
+view_parser_parse_object (ViewParser    *parser,
+                          unsigned int   depth,
+                          GError       **error)
+{
+  unsigned int index;
+  unsigned int length = 0;
+
+  index = view_parser_push (parser, VIEW_OBJECT, parser->pos);
+  parser->pos++;
+  view_parser_skip_whitespace (parser);
+
+  if (view_parser_peek (parser) != '}')
+    {
+      while (TRUE)
+        {
+          if (view_parser_peek (parser) != '"')
+            return view_parser_error (parser,
+                                      JSON_PARSER_ERROR_INVALID_BAREWORD,
+                                      "Expected a member name",
+                                      error);
+
+          if (!view_parser_parse_string (parser, error))
+            return FALSE;
+
+          view_parser_skip_whitespace (parser);
+
+          if (view_parser_peek (parser) != ':')
+            return view_parser_error (parser,
+                                      JSON_PARSER_ERROR_MISSING_COLON,
+                                      "Expected ':'",
+                                      error);
+
+          parser->pos++;
+          view_parser_skip_whitespace (parser);
+
+          if (!view_parser_parse_value (parser, depth + 1, error))
+            return FALSE;
+
+          if G_UNLIKELY (++length > VIEW_MAX_LENGTH)
+            return view_parser_error (parser,
+                                      JSON_PARSER_ERROR_PARSE,
+                                      "Too many members",
+                                      error);
+
+          view_parser_skip_whitespace (parser);
+
+          if (view_parser_peek (parser) == '}')
+            break;
+
+          if (view_parser_peek (parser) != ',')
+            return view_parser_error (parser,
+                                      JSON_PARSER_ERROR_MISSING_COMMA,
+                                      "Expected ',' or '}'",
+                                      error);
+
+          parser->pos++;
+          view_parser_skip_whitespace (parser);
+
+          if (view_parser_peek (parser) == '}')
+            return view_parser_error (parser,
+                                      JSON_PARSER_ERROR_TRAILING_COMMA,
+                                      "Trailing comma",
+                                      error);
+        }
+    }
+
+  parser->pos++;
+  parser->tokens[index].length = length;
+  parser->tokens[index].next = parser->n_tokens;
+
+  return TRUE;
+}
+
+static gboolean
+view_parser_parse_value (ViewParser    *parser,
+                         unsigned int   depth,
+                         GError       **error)
+{
+  if G_UNLIKELY (depth > VIEW_MAX_DEPTH)
+    return view_parser_error (parser,
+                              JSON_PARSER_ERROR_PARSE,
+                              "Maximum nesting depth exceeded",
+                              error);
+
+  switch (view_parser_peek (parser))
+    {
+    case '{':
+      return view_parser_parse_object (parser, depth, error);
+
+    case '[':
+      return view_parser_parse_array (parser, depth, error);
+
+    case '"':
+      return view_parser_parse_string (parser, error);
+
+    case 't':
+      return view_parser_parse_literal (parser, "true", 4, VIEW_TRUE, error);
+
+    case 'f':
+      return view_parser_parse_literal (parser, "false", 5, VIEW_FALSE, error);
+
+    case 'n':
+      return view_parser_parse_literal (parser, "null", 4, VIEW_NULL, error);
+
+    case '-':
+    case '0': case '1': case '2': case '3': case '4':
+    case '5': case '6': case '7': case '8': case '9':
+      return view_parser_parse_number (parser, error);
+
+    default:
+      return view_parser_error (parser,
+                                JSON_PARSER_ERROR_INVALID_BAREWORD,
+                                "Invalid bareword",
+                                error);
+    }
+}
+
+
+/*
+ * Lookup
+ */
+static inline ViewKind
+view_token_kind (ValentPacketView *self,
+                 unsigned int      index)
+{
+  return (ViewKind)self->tokens[index].kind;
+}
+
+static inline const char *
+view_token_value (ValentPacketView *self,
+                  unsigned int      index)
+{
+  return self->json + self->tokens[index].offset;
+}
+
+/*
+ * Find the value of the member @name in the object at @index. The root can
+ * never be a member, so `0` is returned if @name is not found. As with
+ * `JsonObject`, the last of any duplicate members wins.
+ */
+static unsigned int
+view_object_get_member (ValentPacketView *self,
+                        unsigned int      index,
+                        const char       *name)
+{
+  unsigned int length = self->tokens[index].length;
+  unsigned int member = index + 1;
+  unsigned int ret = 0;
+
+  for (unsigned int i = 0; i < length; i++)
+    {
+      if (g_str_equal (view_token_value (self, member), name))
+        ret = member + 1;
+
+      member = self->tokens[member + 1].next;
+    }
+
+  return ret;
+}
+
+static gboolean
+view_validate (ValentPacketView  *self,
+               GError           **error)
+{
+  unsigned int node;
+
+  if G_UNLIKELY (view_token_kind (self, 0) != VIEW_OBJECT)
+    {
+      g_set_error_literal (error,
+                           VALENT_PACKET_ERROR,
+                           VALENT_PACKET_ERROR_MALFORMED,
+                           "expected the root element to be an object");
+      return FALSE;
+    }
+
+  /* TODO: kdeconnect-kde stringifies this in identity packets
+   *       https://invent.kde.org/network/kdeconnect-kde/-/merge_requests/380 */
+  if G_UNLIKELY ((node = view_object_get_member (self, 0, "id")) == 0 ||
+                 (view_token_kind (self, node) != VIEW_INT &&
+                  view_token_kind (self, node) != VIEW_STRING))
+    {
+      g_set_error_literal (error,
+                           VALENT_PACKET_ERROR,
+                           node == 0
+                             ? VALENT_PACKET_ERROR_MISSING_FIELD
+                             : VALENT_PACKET_ERROR_INVALID_FIELD,
+                           "expected \"id\" field holding an integer or string");
+      return FALSE;
+    }
+
+  if (view_token_kind (self, node) == VIEW_INT)
+    self->id = g_ascii_strtoll (view_token_value (self, node), NULL, 10);
+
+  if G_UNLIKELY ((node = view_object_get_member (self, 0, "type")) == 0 ||
+                 view_token_kind (self, node) != VIEW_STRING)
+    {
+      g_set_error_literal (error,
+                           VALENT_PACKET_ERROR,
+                           node == 0
+                             ? VALENT_PACKET_ERROR_MISSING_FIELD
+                             : VALENT_PACKET_ERROR_INVALID_FIELD,
+                           "expected \"type\" field holding a string");
+      return FALSE;
+    }
+
+  self->type = view_token_value (self, node);
+
+  if G_UNLIKELY ((node = view_object_get_member (self, 0, "body")) == 0 ||
+                 view_token_kind (self, node) != VIEW_OBJECT)
+    {
+      g_set_error_literal (error,
+                           VALENT_PACKET_ERROR,
+                           node == 0
+                             ? VALENT_PACKET_ERROR_MISSING_FIELD
+                             : VALENT_PACKET_ERROR_INVALID_FIELD,
+                           "expected \"body\" field holding an object");
+      return FALSE;
+    }
+
+  self->body = node;
+
+  /* These two are optional, but have defined value types */
+  if G_UNLIKELY ((node = view_object_get_member (self, 0, "payloadSize")) != 0 &&
+                 view_token_kind (self, node) != VIEW_INT)
+    {
+      g_set_error_literal (error,
+                           VALENT_PACKET_ERROR,
+                           VALENT_PACKET_ERROR_INVALID_FIELD,
+                           "expected \"payloadSize\" field to hold an integer");
+      return FALSE;
+    }
+
+  if G_UNLIKELY ((node = view_object_get_member (self, 0, "payloadTransferInfo")) != 0 &&
+                 view_token_kind (self, node) != VIEW_OBJECT)
+    {
+      g_set_error_literal (error,
+                           VALENT_PACKET_ERROR,
+                           VALENT_PACKET_ERROR_INVALID_FIELD,
+                           "expected \"payloadTransferInfo\" field to hold an object");
+      return FALSE;
+    }
+
+  self->has_payload = (node != 0);
+
+  return TRUE;
+}
+
+static void
+valent_packet_view_clear (gpointer data)
+{
+  ValentPacketView *self = data;
+
+  g_clear_pointer (&self->json, g_free);
+  g_clear_pointer (&self->tokens, g_free);
+}
+
+static gboolean
+view_parse (ViewParser  *parser,
+            char        *json,
+            size_t       json_len,
+            GError     **error)
+{
+  if G_UNLIKELY (json_len == 0 || json_len > G_MAXUINT32)
+    {
+      g_set_error_literal (error,
+                           VALENT_PACKET_ERROR,
+                           VALENT_PACKET_ERROR_INVALID_DATA,
+                           json_len == 0 ? "packet is empty" : "packet is too large");
+      return FALSE;
+    }
+
+  if G_UNLIKELY (!g_utf8_validate_len (json, json_len, NULL))
+    {
+      g_set_error_literal (error,
+                           JSON_PARSER_ERROR,
+                           JSON_PARSER_ERROR_INVALID_DATA,
+                           "Invalid UTF-8");
+      return FALSE;
+    }
+
+  parser->json = json;
+  parser->len = json_len;
+
+  view_parser_skip_whitespace (parser);
+
+  if (!view_parser_parse_value (parser, 0, error))
+    {
+      g_clear_pointer (&parser->tokens, g_free);
+      return FALSE;
+    }
+
+  view_parser_skip_whitespace (parser);
+
+  if G_UNLIKELY (parser->pos != parser->len)
+    {
+      view_parser_error (parser,
+                         JSON_PARSER_ERROR_PARSE,
+                         "Unexpected data after the root element",
+                         error);
+      g_clear_pointer (&parser->tokens, g_free);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/**
+ * valent_packet_view_new:
+ * @json: (transfer full): a nul-terminated, UTF-8 encoded KDE Connect packet
+ * @json_len: the length of @json, in bytes
+ * @error: (nullable): a #GError
+ *
+ * Parse and validate a KDE Connect packet, taking ownership of @json.
+ *
+ * The buffer is modified in place and freed with the view. If parsing or
+ * validation fails, @json is freed, %NULL is returned and @error is set with
+ * the same domain and code as valent_packet_deserialize().
+ *
+ * Returns: (transfer full) (nullable): a `ValentPacketView`
+ */
+ValentPacketView *
+valent_packet_view_new (char    *json,
+                        size_t   json_len,
+                        GError **error)
+{
+  g_autofree char *buffer = g_steal_pointer (&json);
+  ViewParser parser = { 0, };
+  ValentPacketView *self;
+
+  g_return_val_if_fail (buffer != NULL, NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  if (!view_parse (&parser, buffer, json_len, error))
+    return NULL;
+
+  self = g_atomic_rc_box_new0 (ValentPacketView);
+  self->json = g_steal_pointer (&buffer);
+  self->json_len = json_len;
+  self->tokens = g_renew (ViewToken, parser.tokens, parser.n_tokens);
+  self->n_tokens = parser.n_tokens;
+
+  if (!view_validate (self, error))
+    {
+      g_clear_pointer (&self, valent_packet_view_unref);
+      return NULL;
+    }
+
+  return self;
+}
+
+/**
+ * valent_packet_view_ref:
+ * @view: a `ValentPacketView`
+ *
+ * Acquire a reference on @view.
+ *
+ * Returns: (transfer full): @view
+ */
+ValentPacketView *
+valent_packet_view_ref (ValentPacketView *view)
+{
+  g_return_val_if_fail (view != NULL, NULL);
+
+  return g_atomic_rc_box_acquire (view);
+}
+
+/**
+ * valent_packet_view_unref:
+ * @view: (transfer full): a `ValentPacketView`
+ *
+ * Release a reference on @view.
+ */
+void
+valent_packet_view_unref (ValentPacketView *view)
+{
+  g_return_if_fail (view != NULL);
+
+  g_atomic_rc_box_release_full (view, valent_packet_view_clear);
+}
+
+/**
+ * valent_packet_view_get_id:
+ * @view: a `ValentPacketView`
+ *
+ * Get the timestamp of the packet.
+ *
+ * Returns: a UNIX epoch timestamp, or `0` if the field was a string
+ */
+int64_t
+valent_packet_view_get_id (ValentPacketView *view)
+{
+  g_return_val_if_fail (view != NULL, 0);
+
+  return view->id;
+}
+
+/**
+ * valent_packet_view_get_type:
+ * @view: a `ValentPacketView`
+ *
+ * Get the capability type of the packet.
+ *
+ * Returns: (transfer none): a KDE Connect capability
+ */
+const char *
+valent_packet_view_get_type (ValentPacketView *view)
+{
+  g_return_val_if_fail (view != NULL, NULL);
+
+  return view->type;
+}
+
+/**
+ * valent_packet_view_has_payload:
+ * @view: a `ValentPacketView`
+ *
+ * Check if the packet holds transfer information, as with
+ * valent_packet_has_payload().
+ *
+ * Returns: %TRUE if the packet has a payload
+ */
+gboolean
+valent_packet_view_has_payload (ValentPacketView *view)
+{
+  g_return_val_if_fail (view != NULL, FALSE);
+
+  return view->has_payload;
+}
+
+/**
+ * valent_packet_view_get_size:
+ * @view: a `ValentPacketView`
+ *
+ * Get the number of bytes of heap held by @view.
+ *
+ * Returns: a size in bytes
+ */
+size_t
+valent_packet_view_get_size (ValentPacketView *view)
+{
+  g_return_val_if_fail (view != NULL, 0);
+
+  return sizeof (ValentPacketView) +
+         view->json_len + 1 +
+         view->n_tokens * sizeof (ViewToken);
+}
+
+/**
+ * valent_packet_view_get_boolean:
+ * @view: a `ValentPacketView`
+ * @field: (not nullable): field name
+ * @value: (out) (nullable): a boolean
+ *
+ * Lookup @field in the body of the packet, as with valent_packet_get_boolean().
+ *
+ * Returns: %TRUE, or %FALSE on failure
+ */
+gboolean
+valent_packet_view_get_boolean (ValentPacketView *view,
+                                const char       *field,
+                                gboolean         *value)
+{
+  unsigned int node;
+
+  g_return_val_if_fail (view != NULL, FALSE);
+  g_return_val_if_fail (field != NULL && *field != '\0', FALSE);
+
+  if G_UNLIKELY ((node = view_object_get_member (view, view->body, field)) == 0 ||
+                 (view_token_kind (view, node) != VIEW_TRUE &&
+                  view_token_kind (view, node) != VIEW_FALSE))
+    return FALSE;
+
+  if (value)
+    *value = view_token_kind (view, node) == VIEW_TRUE;
+
+  return TRUE;
+}
+
+/**
+ * valent_packet_view_get_double:
+ * @view: a `ValentPacketView`
+ * @field: (not nullable): field name
+ * @value: (out) (nullable): a double
+ *
+ * Lookup @field in the body of the packet, as with valent_packet_get_double().
+ *
+ * Returns: %TRUE, or %FALSE on failure
+ */
+gboolean
+valent_packet_view_get_double (ValentPacketView *view,
+                               const char       *field,
+                               double           *value)
+{
+  unsigned int node;
+
+  g_return_val_if_fail (view != NULL, FALSE);
+  g_return_val_if_fail (field != NULL && *field != '\0', FALSE);
+
+  if G_UNLIKELY ((node = view_object_get_member (view, view->body, field)) == 0 ||
+                 view_token_kind (view, node) != VIEW_DOUBLE)
+    return FALSE;
+
+  if (value)
+    *value = g_ascii_strtod (view_token_value (view, node), NULL);
+
+  return TRUE;
+}
+
+/**
+ * valent_packet_view_get_int:
+ * @view: a `ValentPacketView`
+ * @field: (not nullable): field name
+ * @value: (out) (nullable): an int64
+ *
+ * Lookup @field in the body of the packet, as with valent_packet_get_int().
+ *
+ * Returns: %TRUE, or %FALSE on failure
+ */
+gboolean
+valent_packet_view_get_int (ValentPacketView *view,
+                            const char       *field,
+                            int64_t          *value)
+{
+  unsigned int node;
+
+  g_return_val_if_fail (view != NULL, FALSE);
+  g_return_val_if_fail (field != NULL && *field != '\0', FALSE);
+
+  if G_UNLIKELY ((node = view_object_get_member (view, view->body, field)) == 0 ||
+                 view_token_kind (view, node) != VIEW_INT)
+    return FALSE;
+
+  if (value)
+    *value = g_ascii_strtoll (view_token_value (view, node), NULL, 10);
+
+  return TRUE;
+}
+
+/**
+ * valent_packet_view_get_string:
+ * @view: a `ValentPacketView`
+ * @field: (not nullable): field name
+ * @value: (out) (nullable): a string
+ *
+ * Lookup @field in the body of the packet, as with valent_packet_get_string().
+ *
+ * Returns: %TRUE, or %FALSE on failure
+ */
+gboolean
+valent_packet_view_get_string (ValentPacketView  *view,
+                               const char        *field,
+                               const char       **value)
+{
+  unsigned int node;
+  const char *string;
+
+  g_return_val_if_fail (view != NULL, FALSE);
+  g_return_val_if_fail (field != NULL && *field != '\0', FALSE);
+
+  if G_UNLIKELY ((node = view_object_get_member (view, view->body, field)) == 0 ||
+                 view_token_kind (view, node) != VIEW_STRING)
+    return FALSE;
+
+  string = view_token_value (view, node);
+
+  if G_UNLIKELY (*string == '\0')
+    return FALSE;
+
+  if (value)
+    *value = string;
+
+  return TRUE;
+}
+
+static JsonNode *
+view_token_to_node (ValentPacketView *self,
+                    unsigned int      index)
+{
+  const ViewToken *token = &self->tokens[index];
+  const char *value = self->json + token->offset;
+  JsonNode *node = NULL;
+
+  switch ((ViewKind)token->kind)
+    {
+    case VIEW_NULL:
+      node = json_node_new (JSON_NODE_NULL);
+      break;
+
+    case VIEW_FALSE:
+    case VIEW_TRUE:
+      node = json_node_init_boolean (json_node_alloc (),
+                                     token->kind == VIEW_TRUE);
+      break;
+
+    case VIEW_INT:
+      node = json_node_init_int (json_node_alloc (),
+                                 g_ascii_strtoll (value, NULL, 10));
+      break;
+
+    case VIEW_DOUBLE:
+      node = json_node_init_double (json_node_alloc (),
+                                    g_ascii_strtod (value, NULL));
+      break;
+
+    case VIEW_STRING:
+      node = json_node_init_string (json_node_alloc (), value);
+      break;
+
+    case VIEW_ARRAY:
+      {
+        JsonArray *array = json_array_sized_new (token->length);
+
+        for (unsigned int i = index + 1; i < token->next; i = self->tokens[i].next)
+          json_array_add_element (array, view_token_to_node (self, i));
+
+        node = json_node_new (JSON_NODE_ARRAY);
+        json_node_take_array (node, array);
+      }
+      break;
+
+    case VIEW_OBJECT:
+      {
+        JsonObject *object = json_object_new ();
+
+        for (unsigned int i = index + 1; i < token->next; i = self->tokens[i + 1].next)
+          json_object_set_member (object,
+                                  view_token_value (self, i),
+                                  view_token_to_node (self, i + 1));
+
+        node = json_node_new (JSON_NODE_OBJECT);
+        json_node_take_object (node, object);
+      }
+      break;
+    }
+
+  return node;
+}
+
+/**
+ * valent_packet_view_to_node:
+ * @view: a `ValentPacketView`
+ *
+ * Build a `JsonNode` tree from @view.
+ *
+ * The result is sealed, like a packet returned by valent_packet_deserialize(),
+ * and holds no references to @view.
+ *
+ * Returns: (transfer full): a KDE Connect packet
+ */
+JsonNode *
+valent_packet_view_to_node (ValentPacketView *view)
+{
+  JsonNode *packet;
+
+  g_return_val_if_fail (view != NULL, NULL);
+
+  packet = view_token_to_node (view, 0);
+  json_node_seal (packet);
+
+  return packet;
+}
+
+/**
+ * valent_packet_view_parse_value:
+ * @json: a nul-terminated, UTF-8 encoded JSON value
+ * @json_len: the length of @json, in bytes
+ * @error: (nullable): a #GError
+ *
+ * Parse a single JSON value of any kind, such as an element of a packet being
+ * streamed, with the same parser as valent_packet_view_new().
+ *
+ * The buffer is modified in place, but remains owned by the caller.
+ *
+ * Returns: (transfer full) (nullable): a sealed `JsonNode`
+ */
+JsonNode *
+valent_packet_view_parse_value (char    *json,
+                                size_t   json_len,
+                                GError **error)
+{
+  ViewParser parser = { 0, };
+  ValentPacketView view = { 0, };
+  JsonNode *node;
+
+  g_return_val_if_fail (json != NULL, NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  if (!view_parse (&parser, json, json_len, error))
+    return NULL;
+
+  view.json = json;
+  view.json_len = json_len;
+  view.tokens = parser.tokens;
+  view.n_tokens = parser.n_tokens;
+
+  node = view_token_to_node (&view, 0);
+  json_node_seal (node);
+  g_free (parser.tokens);
+
+  return node;
+}
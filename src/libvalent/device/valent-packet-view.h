@@ -0,0 +1,56 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#pragma once
+
+#include <json-glib/json-glib.h>
+
+#include "../core/valent-version.h"
+
+G_BEGIN_DECLS
+
+typedef struct _ValentPacketView ValentPacketView;
+
+_VALENT_EXTERN
+ValentPacketView * valent_packet_view_new         (char              *json,
+                                                   size_t             json_len,
+                                                   GError           **error);
+_VALENT_EXTERN
+ValentPacketView * valent_packet_view_ref         (ValentPacketView  *view);
+_VALENT_EXTERN
+void               valent_packet_view_unref       (ValentPacketView  *view);
+_VALENT_EXTERN
+int64_t            valent_packet_view_get_id      (ValentPacketView  *view);
+_VALENT_EXTERN
+const char       * valent_packet_view_get_type    (ValentPacketView  *view);
+_VALENT_EXTERN
+gboolean           valent_packet_view_has_payload (ValentPacketView  *view);
+_VALENT_EXTERN
+size_t             valent_packet_view_get_size    (ValentPacketView  *view);
+_VALENT_EXTERN
+gboolean           valent_packet_view_get_boolean (ValentPacketView  *view,
+                                                   const char        *field,
+                                                   gboolean          *value);
+_VALENT_EXTERN
+gboolean           valent_packet_view_get_double  (ValentPacketView  *view,
+                                                   const char        *field,
+                                                   double            *value);
+_VALENT_EXTERN
+gboolean           valent_packet_view_get_int     (ValentPacketView  *view,
+                                                   const char        *field,
+                                                   int64_t           *value);
+_VALENT_EXTERN
+gboolean           valent_packet_view_get_string  (ValentPacketView  *view,
+                                                   const char        *field,
+                                                   const char       **value);
+_VALENT_EXTERN
+JsonNode         * valent_packet_view_to_node     (ValentPacketView  *view);
+_VALENT_EXTERN
+JsonNode         * valent_packet_view_parse_value (char              *json,
+                                                   size_t             json_len,
+                                                   GError           **error);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (ValentPacketView, valent_packet_view_unref)
+
+G_END_DECLS
+
@@ -175,6 +175,33 @@ valent_packet_get_type (JsonNode *packet)
   return json_node_get_string (node);
 }
 
+/**
+ * valent_packet_get_type_quark:
+ * @packet: a KDE Connect packet
+ *
+ * Get the capability type of a KDE Connect packet as a [alias@GLib.Quark].
+ *
+ * Types are never interned by this function, since they are supplied by the
+ * remote device. If no quark has been registered for the type, such as by a
+ * plugin handling it, `0` will be returned.
+ *
+ * Returns: a `GQuark`, or `0` if unknown
+ *
+ * Since: 1.0
+ */
+GQuark
+valent_packet_get_type_quark (JsonNode *packet)
+{
+  const char *type;
+
+  g_return_val_if_fail (JSON_NODE_HOLDS_OBJECT (packet), 0);
+
+  if G_UNLIKELY ((type = valent_packet_get_type (packet)) == NULL)
+    return 0;
+
+  return g_quark_try_string (type);
+}
+
 /**
  * valent_packet_get_body:
  * @packet: a KDE Connect packet
@@ -103,6 +103,8 @@ int64_t      valent_packet_get_id           (JsonNode       *packet);
 VALENT_AVAILABLE_IN_1_0
 const char * valent_packet_get_type         (JsonNode       *packet);
 VALENT_AVAILABLE_IN_1_0
+GQuark       valent_packet_get_type_quark   (JsonNode       *packet);
+VALENT_AVAILABLE_IN_1_0
 JsonObject * valent_packet_get_body         (JsonNode       *packet);
 VALENT_AVAILABLE_IN_1_0
 gboolean     valent_packet_has_payload      (JsonNode       *packet);
@@ -0,0 +1,995 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#define G_LOG_DOMAIN "valent-transfer-scheduler"
+
+#include "config.h"
+
+#include <gio/gio.h>
+#include <libvalent-core.h>
+
+#include "valent-device-metrics.h"
+#include "valent-transfer-scheduler.h"
+
+/* The most bytes read or written by a shaped stream in one call, so transfers
+ * from different devices are interleaved at a fine granularity. */
+#define TRANSFER_SLICE_SIZE    (64 * 1024)
+
+/* The longest a waiting transfer sleeps before checking for cancellation. */
+#define TRANSFER_POLL_INTERVAL (100 * G_TIME_SPAN_MILLISECOND)
+
+/* The longest a bulk transfer stays paused before it fails, so a transfer
+ * started on a metered network does not hold a thread indefinitely. */
+#define TRANSFER_PAUSE_TIMEOUT (10 * G_TIME_SPAN_MINUTE)
+
+
+/**
+ * ValentTransferScheduler:
+ *
+ * A scheduler for payload transfers.
+ *
+ * `ValentTransferScheduler` coordinates the payload streams opened by
+ * [method@Valent.Channel.download] and [method@Valent.Channel.upload], so that
+ * one large transfer does not starve the link shared with other transfers and
+ * the control channels of every device.
+ *
+ * Each device may have a rate limit, and there may be a global rate limit for
+ * all devices, both enforced with token buckets. While transfers are waiting
+ * for tokens, the devices they belong to take turns, so a device with many
+ * transfers receives the same share as a device with one.
+ *
+ * Transfers are marked as bulk if they are large or of an unknown size. When
+ * the network is metered and pausing is enabled, bulk transfers are paused
+ * until the network is no longer metered; small transfers like notification
+ * icons and album art continue. A bulk transfer that stays paused for ten
+ * minutes fails with %G_IO_ERROR_TIMED_OUT.
+ *
+ * All methods are thread-safe. Transfers run in threads and block in
+ * valent_transfer_scheduler_acquire() until they may continue.
+ */
+
+/*< private >
+ * TokenBucket:
+ * @rate: the rate in bytes per second, or `0` for unlimited
+ * @tokens: the available bytes, which may be negative
+ * @updated: the monotonic time @tokens was last refilled
+ *
+ * A token bucket holding up to one second of tokens. A request is granted
+ * whenever the bucket is not in debt, so a request larger than the bucket
+ * leaves it in debt until it has been paid back at @rate.
+ */
+typedef struct
+{
+  uint64_t rate;
+  double   tokens;
+  int64_t  updated;
+} TokenBucket;
+
+/*< private >
+ * DeviceQueue:
+ * @id: the device ID
+ * @bucket: the token bucket for the device
+ * @waiters: the transfers waiting to be granted tokens
+ * @link: the link in the round-robin queue of devices with waiters
+ */
+typedef struct
+{
+  char        *id;
+  TokenBucket  bucket;
+  GQueue       waiters;
+  GList        link;
+} DeviceQueue;
+
+typedef struct
+{
+  DeviceQueue *device;
+  size_t       n_bytes;
+  gboolean     bulk;
+  int64_t      paused_time;
+} Waiter;
+
+struct _ValentTransferScheduler
+{
+  GObject          parent_instance;
+
+  GMutex           mutex;
+  GCond            cond;
+  TokenBucket      global;
+  GHashTable      *devices;
+  GQueue           active;
+
+  GNetworkMonitor *monitor;
+  gboolean         metered;
+  gboolean         pause_metered;
+
+  /* A time set with valent_transfer_scheduler_set_time(), or `-1` */
+  int64_t          time;
+};
+
+G_DEFINE_FINAL_TYPE (ValentTransferScheduler, valent_transfer_scheduler, G_TYPE_OBJECT)
+
+enum {
+  PROP_0,
+  PROP_MONITOR,
+  N_PROPERTIES
+};
+
+static GParamSpec *properties[N_PROPERTIES] = { NULL, };
+
+
+/*
+ * TokenBucket
+ */
+static inline void
+token_bucket_refill (TokenBucket *bucket,
+                     int64_t      now)
+{
+  if (bucket->rate == 0)
+    return;
+
+  bucket->tokens += (double)(now - bucket->updated) * bucket->rate / G_USEC_PER_SEC;
+  bucket->tokens = MIN (bucket->tokens, (double)bucket->rate);
+  bucket->updated = now;
+}
+
+static inline gboolean
+token_bucket_ready (TokenBucket *bucket,
+                    int64_t      now,
+                    int64_t     *ready_time)
+{
+  if (bucket->rate == 0 || bucket->tokens >= 0.0)
+    return TRUE;
+
+  *ready_time = MIN (*ready_time,
+                     now + (int64_t)(-bucket->tokens * G_USEC_PER_SEC / bucket->rate) + 1);
+  return FALSE;
+}
+
+static inline void
+token_bucket_consume (TokenBucket *bucket,
+                      size_t       n_bytes)
+{
+  if (bucket->rate > 0)
+    bucket->tokens -= (double)n_bytes;
+}
+
+static inline void
+token_bucket_set_rate (TokenBucket *bucket,
+                       uint64_t     rate,
+                       int64_t      now)
+{
+  bucket->rate = rate;
+  bucket->tokens = MIN (bucket->tokens, (double)rate);
+  bucket->updated = now;
+}
+
+static void
+device_queue_free (gpointer data)
+{
+  DeviceQueue *device = data;
+
+  g_assert (g_queue_is_empty (&device->waiters));
+
+  g_clear_pointer (&device->id, g_free);
+  g_free (device);
+}
+
+
+/*
+ * ValentTransferScheduler
+ */
+static inline gboolean
+valent_transfer_scheduler_is_paused (ValentTransferScheduler *self)
+{
+  return self->metered && self->pause_metered;
+}
+
+/*
+ * Called with the scheduler lock held.
+ */
+static inline int64_t
+valent_transfer_scheduler_now (ValentTransferScheduler *self)
+{
+  return self->time >= 0 ? self->time : g_get_monotonic_time ();
+}
+
+/*
+ * Find the next waiter to grant tokens to, in round-robin order by device. If
+ * no waiter is ready, @ready_time is set to the time one might be.
+ *
+ * Called with the scheduler lock held.
+ */
+static Waiter *
+valent_transfer_scheduler_next (ValentTransferScheduler *self,
+                                int64_t                  now,
+                                int64_t                 *ready_time)
+{
+  gboolean paused = valent_transfer_scheduler_is_paused (self);
+
+  token_bucket_refill (&self->global, now);
+
+  if (!token_bucket_ready (&self->global, now, ready_time))
+    return NULL;
+
+  for (const GList *iter = self->active.head; iter; iter = iter->next)
+    {
+      DeviceQueue *device = iter->data;
+      Waiter *waiter = NULL;
+
+      /* Each device's transfers are granted in order, except for paused bulk
+       * transfers, which are passed over */
+      for (const GList *link = device->waiters.head; link; link = link->next)
+        {
+          if (!paused || !((Waiter *)link->data)->bulk)
+            {
+              waiter = link->data;
+              break;
+            }
+        }
+
+      if (waiter == NULL)
+        continue;
+
+      token_bucket_refill (&device->bucket, now);
+
+      if (token_bucket_ready (&device->bucket, now, ready_time))
+        return waiter;
+    }
+
+  return NULL;
+}
+
+/*
+ * Remove @waiter from its device, removing the device from the round-robin
+ * queue if it has no other waiters. If @waiter was granted tokens, the device
+ * is moved to the end of the queue so the other devices take their turn.
+ *
+ * Called with the scheduler lock held.
+ */
+static void
+valent_transfer_scheduler_remove (ValentTransferScheduler *self,
+                                  Waiter                  *waiter,
+                                  gboolean                 granted)
+{
+  DeviceQueue *device = waiter->device;
+
+  g_queue_remove (&device->waiters, waiter);
+
+  if (g_queue_is_empty (&device->waiters))
+    {
+      g_queue_unlink (&self->active, &device->link);
+    }
+  else if (granted)
+    {
+      g_queue_unlink (&self->active, &device->link);
+      g_queue_push_tail_link (&self->active, &device->link);
+    }
+
+  g_cond_broadcast (&self->cond);
+}
+
+static DeviceQueue *
+valent_transfer_scheduler_lookup_device (ValentTransferScheduler *self,
+                                         const char              *device_id)
+{
+  DeviceQueue *device;
+
+  if ((device = g_hash_table_lookup (self->devices, device_id)) == NULL)
+    {
+      device = g_new0 (DeviceQueue, 1);
+      device->id = g_strdup (device_id);
+      device->link.data = device;
+      g_queue_init (&device->waiters);
+      g_hash_table_replace (self->devices, device->id, device);
+    }
+
+  return device;
+}
+
+static void
+on_network_metered (GNetworkMonitor         *monitor,
+                    GParamSpec              *pspec,
+                    ValentTransferScheduler *self)
+{
+  valent_transfer_scheduler_set_metered (self,
+                                         g_network_monitor_get_network_metered (monitor));
+}
+
+
+/*
+ * GObject
+ */
+static void
+valent_transfer_scheduler_constructed (GObject *object)
+{
+  ValentTransferScheduler *self = VALENT_TRANSFER_SCHEDULER (object);
+
+  G_OBJECT_CLASS (valent_transfer_scheduler_parent_class)->constructed (object);
+
+  if (self->monitor != NULL)
+    {
+      g_signal_connect_object (self->monitor,
+                               "notify::network-metered",
+                               G_CALLBACK (on_network_metered),
+                               self, 0);
+      on_network_metered (self->monitor, NULL, self);
+    }
+}
+
+static void
+valent_transfer_scheduler_finalize (GObject *object)
+{
+  ValentTransferScheduler *self = VALENT_TRANSFER_SCHEDULER (object);
+
+  g_clear_object (&self->monitor);
+  g_clear_pointer (&self->devices, g_hash_table_unref);
+  g_cond_clear (&self->cond);
+  g_mutex_clear (&self->mutex);
+
+  G_OBJECT_CLASS (valent_transfer_scheduler_parent_class)->finalize (object);
+}
+
+static void
+valent_transfer_scheduler_set_property (GObject      *object,
+                                        guint         prop_id,
+                                        const GValue *value,
+                                        GParamSpec   *pspec)
+{
+  ValentTransferScheduler *self = VALENT_TRANSFER_SCHEDULER (object);
+
+  switch (prop_id)
+    {
+    case PROP_MONITOR:
+      self->monitor = g_value_dup_object (value);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+valent_transfer_scheduler_class_init (ValentTransferSchedulerClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->constructed = valent_transfer_scheduler_constructed;
+  object_class->finalize = valent_transfer_scheduler_finalize;
+  object_class->set_property = valent_transfer_scheduler_set_property;
+
+  /**
+   * ValentTransferScheduler:monitor:
+   *
+   * The [iface@Gio.NetworkMonitor] used to detect metered networks.
+   */
+  properties [PROP_MONITOR] =
+    g_param_spec_object ("monitor", NULL, NULL,
+                         G_TYPE_NETWORK_MONITOR,
+                         (G_PARAM_WRITABLE |
+                          G_PARAM_CONSTRUCT_ONLY |
+                          G_PARAM_EXPLICIT_NOTIFY |
+                          G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_properties (object_class, N_PROPERTIES, properties);
+}
+
+static void
+valent_transfer_scheduler_init (ValentTransferScheduler *self)
+{
+  g_mutex_init (&self->mutex);
+  g_cond_init (&self->cond);
+  g_queue_init (&self->active);
+  self->devices = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                         NULL, device_queue_free);
+  self->time = -1;
+}
+
+/**
+ * valent_transfer_scheduler_get_default:
+ *
+ * Get the default transfer scheduler, which watches the default
+ * [iface@Gio.NetworkMonitor].
+ *
+ * Returns: (transfer none) (not nullable): a `ValentTransferScheduler`
+ */
+ValentTransferScheduler *
+valent_transfer_scheduler_get_default (void)
+{
+  static ValentTransferScheduler *default_scheduler = NULL;
+
+  if (g_once_init_enter (&default_scheduler))
+    {
+      g_once_init_leave (&default_scheduler,
+                         valent_transfer_scheduler_new (g_network_monitor_get_default ()));
+    }
+
+  return default_scheduler;
+}
+
+/**
+ * valent_transfer_scheduler_new:
+ * @monitor: (nullable): a `GNetworkMonitor`
+ *
+ * Create a new transfer scheduler.
+ *
+ * If @monitor is %NULL, the network is considered metered only if set with
+ * valent_transfer_scheduler_set_metered().
+ *
+ * Returns: (transfer full): a new `ValentTransferScheduler`
+ */
+ValentTransferScheduler *
+valent_transfer_scheduler_new (GNetworkMonitor *monitor)
+{
+  g_return_val_if_fail (monitor == NULL || G_IS_NETWORK_MONITOR (monitor), NULL);
+
+  return g_object_new (VALENT_TYPE_TRANSFER_SCHEDULER,
+                       "monitor", monitor,
+                       NULL);
+}
+
+/**
+ * valent_transfer_scheduler_set_rate_limit:
+ * @scheduler: a `ValentTransferScheduler`
+ * @device_id: (nullable): a device ID
+ * @rate: the rate in bytes per second, or `0` for unlimited
+ *
+ * Set the rate limit for transfers of @device_id, or for all transfers if
+ * @device_id is %NULL.
+ */
+void
+valent_transfer_scheduler_set_rate_limit (ValentTransferScheduler *scheduler,
+                                          const char              *device_id,
+                                          uint64_t                 rate)
+{
+  int64_t now;
+
+  g_return_if_fail (VALENT_IS_TRANSFER_SCHEDULER (scheduler));
+
+  g_mutex_lock (&scheduler->mutex);
+  now = valent_transfer_scheduler_now (scheduler);
+
+  if (device_id == NULL)
+    {
+      token_bucket_set_rate (&scheduler->global, rate, now);
+    }
+  else if (rate > 0)
+    {
+      DeviceQueue *device;
+
+      device = valent_transfer_scheduler_lookup_device (scheduler, device_id);
+      token_bucket_set_rate (&device->bucket, rate, now);
+    }
+  else
+    {
+      DeviceQueue *device;
+
+      /* Drop devices without limits, unless they have transfers waiting */
+      if ((device = g_hash_table_lookup (scheduler->devices, device_id)) != NULL)
+        {
+          token_bucket_set_rate (&device->bucket, 0, now);
+
+          if (g_queue_is_empty (&device->waiters))
+            g_hash_table_remove (scheduler->devices, device_id);
+        }
+    }
+  g_cond_broadcast (&scheduler->cond);
+  g_mutex_unlock (&scheduler->mutex);
+}
+
+/**
+ * valent_transfer_scheduler_set_pause_metered:
+ * @scheduler: a `ValentTransferScheduler`
+ * @pause: whether to pause bulk transfers
+ *
+ * Set whether bulk transfers are paused while the network is metered.
+ *
+ * Bulk transfers are not paused by default.
+ */
+void
+valent_transfer_scheduler_set_pause_metered (ValentTransferScheduler *scheduler,
+                                             gboolean                 pause)
+{
+  g_return_if_fail (VALENT_IS_TRANSFER_SCHEDULER (scheduler));
+
+  g_mutex_lock (&scheduler->mutex);
+  scheduler->pause_metered = !!pause;
+  g_cond_broadcast (&scheduler->cond);
+  g_mutex_unlock (&scheduler->mutex);
+}
+
+/**
+ * valent_transfer_scheduler_set_metered:
+ * @scheduler: a `ValentTransferScheduler`
+ * @metered: whether the network is metered
+ *
+ * Set whether the network is metered.
+ *
+ * This is usually called when the [iface@Gio.NetworkMonitor] for @scheduler
+ * reports a change.
+ */
+void
+valent_transfer_scheduler_set_metered (ValentTransferScheduler *scheduler,
+                                       gboolean                 metered)
+{
+  g_return_if_fail (VALENT_IS_TRANSFER_SCHEDULER (scheduler));
+
+  g_mutex_lock (&scheduler->mutex);
+  if (scheduler->metered != !!metered)
+    {
+      scheduler->metered = !!metered;
+      g_debug ("%s(): network is %s", G_STRFUNC,
+               scheduler->metered ? "metered" : "not metered");
+    }
+  g_cond_broadcast (&scheduler->cond);
+  g_mutex_unlock (&scheduler->mutex);
+}
+
+/**
+ * valent_transfer_scheduler_get_n_waiting:
+ * @scheduler: a `ValentTransferScheduler`
+ * @n_paused: (out) (optional): the number of paused bulk transfers
+ *
+ * Get the number of transfers waiting to continue.
+ *
+ * Returns: the number of waiting transfers, including paused transfers
+ */
+unsigned int
+valent_transfer_scheduler_get_n_waiting (ValentTransferScheduler *scheduler,
+                                          unsigned int            *n_paused)
+{
+  unsigned int n_waiting = 0;
+  unsigned int paused = 0;
+
+  g_return_val_if_fail (VALENT_IS_TRANSFER_SCHEDULER (scheduler), 0);
+
+  g_mutex_lock (&scheduler->mutex);
+  for (const GList *iter = scheduler->active.head; iter; iter = iter->next)
+    {
+      DeviceQueue *device = iter->data;
+
+      for (const GList *link = device->waiters.head; link; link = link->next)
+        {
+          if (((Waiter *)link->data)->paused_time >= 0)
+            paused++;
+        }
+
+      n_waiting += device->waiters.length;
+    }
+  g_mutex_unlock (&scheduler->mutex);
+
+  if (n_paused != NULL)
+    *n_paused = paused;
+
+  return n_waiting;
+}
+
+/*< private >
+ * valent_transfer_scheduler_set_time:
+ * @scheduler: a `ValentTransferScheduler`
+ * @time: a monotonic time, in microseconds
+ *
+ * Set the time used by @scheduler, instead of the monotonic clock.
+ *
+ * Once set, rate limits and pauses only progress when the time is set again.
+ * This is intended for tests.
+ */
+void
+valent_transfer_scheduler_set_time (ValentTransferScheduler *scheduler,
+                                    int64_t                  time)
+{
+  g_return_if_fail (VALENT_IS_TRANSFER_SCHEDULER (scheduler));
+  g_return_if_fail (time >= 0);
+
+  g_mutex_lock (&scheduler->mutex);
+  scheduler->time = time;
+  g_cond_broadcast (&scheduler->cond);
+  g_mutex_unlock (&scheduler->mutex);
+}
+
+/**
+ * valent_transfer_scheduler_acquire:
+ * @scheduler: a `ValentTransferScheduler`
+ * @device_id: a device ID
+ * @n_bytes: the number of bytes to transfer
+ * @bulk: whether the transfer is bulk
+ * @cancellable: (nullable): a `GCancellable`
+ * @error: (nullable): a `GError`
+ *
+ * Wait until @n_bytes may be transferred for @device_id.
+ *
+ * This method blocks the calling thread until the rate limits for @device_id
+ * and all devices allow the transfer, other devices waiting have had their
+ * turn, and, if @bulk is %TRUE, bulk transfers are not paused. If a bulk
+ * transfer is paused for too long, this fails with %G_IO_ERROR_TIMED_OUT.
+ *
+ * Returns: %TRUE if successful, or %FALSE with @error set
+ */
+gboolean
+valent_transfer_scheduler_acquire (ValentTransferScheduler  *scheduler,
+                                   const char               *device_id,
+                                   size_t                    n_bytes,
+                                   gboolean                  bulk,
+                                   GCancellable             *cancellable,
+                                   GError                  **error)
+{
+  DeviceQueue *device;
+  Waiter waiter = { NULL, n_bytes, bulk, -1 };
+
+  g_return_val_if_fail (VALENT_IS_TRANSFER_SCHEDULER (scheduler), FALSE);
+  g_return_val_if_fail (device_id != NULL, FALSE);
+  g_return_val_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable), FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  g_mutex_lock (&scheduler->mutex);
+
+  /* Without any limits or other transfers waiting, there is nothing to do */
+  if (scheduler->global.rate == 0 &&
+      g_queue_is_empty (&scheduler->active) &&
+      !(bulk && valent_transfer_scheduler_is_paused (scheduler)) &&
+      ((device = g_hash_table_lookup (scheduler->devices, device_id)) == NULL ||
+       device->bucket.rate == 0))
+    {
+      g_mutex_unlock (&scheduler->mutex);
+      return TRUE;
+    }
+
+  device = valent_transfer_scheduler_lookup_device (scheduler, device_id);
+  waiter.device = device;
+  g_queue_push_tail (&device->waiters, &waiter);
+
+  if (device->waiters.length == 1)
+    g_queue_push_tail_link (&scheduler->active, &device->link);
+
+  while (TRUE)
+    {
+      int64_t now = valent_transfer_scheduler_now (scheduler);
+      int64_t ready_time = now + TRANSFER_POLL_INTERVAL;
+
+      if (g_cancellable_set_error_if_cancelled (cancellable, error))
+        {
+          valent_transfer_scheduler_remove (scheduler, &waiter, FALSE);
+          g_mutex_unlock (&scheduler->mutex);
+          return FALSE;
+        }
+
+      if (bulk && valent_transfer_scheduler_is_paused (scheduler))
+        {
+          if (waiter.paused_time < 0)
+            waiter.paused_time = now;
+
+          if (now - waiter.paused_time >= TRANSFER_PAUSE_TIMEOUT)
+            {
+              valent_transfer_scheduler_remove (scheduler, &waiter, FALSE);
+              g_mutex_unlock (&scheduler->mutex);
+              g_set_error_literal (error,
+                                   G_IO_ERROR,
+                                   G_IO_ERROR_TIMED_OUT,
+                                   "Transfer paused on a metered network");
+              return FALSE;
+            }
+        }
+      else
+        {
+          waiter.paused_time = -1;
+        }
+
+      if (valent_transfer_scheduler_next (scheduler, now, &ready_time) == &waiter)
+        break;
+
+      /* With a fixed time, only poll for cancellation and changes */
+      if (scheduler->time >= 0)
+        ready_time = g_get_monotonic_time () + TRANSFER_POLL_INTERVAL;
+
+      g_cond_wait_until (&scheduler->cond, &scheduler->mutex, ready_time);
+    }
+
+  token_bucket_consume (&scheduler->global, n_bytes);
+  token_bucket_consume (&device->bucket, n_bytes);
+  valent_transfer_scheduler_remove (scheduler, &waiter, TRUE);
+  g_mutex_unlock (&scheduler->mutex);
+
+  return TRUE;
+}
+
+
+/*
+ * Shaped Streams
+ *
+ * The payload streams opened by a channel are wrapped, so every read and write
+ * waits for the scheduler, whichever code performs the transfer.
+ */
+typedef struct
+{
+  ValentTransferScheduler *scheduler;
+  char                    *device_id;
+  gboolean                 bulk;
+  ValentDeviceMetrics     *metrics;
+} StreamShape;
+
+static void
+stream_shape_clear (gpointer data)
+{
+  StreamShape *shape = data;
+
+  g_clear_object (&shape->scheduler);
+  g_clear_pointer (&shape->device_id, g_free);
+  g_clear_pointer (&shape->metrics, valent_device_metrics_unref);
+}
+
+static void
+stream_shape_unref (gpointer data)
+{
+  g_atomic_rc_box_release_full (data, stream_shape_clear);
+}
+
+static gboolean
+stream_shape_acquire (StreamShape   *shape,
+                      size_t         n_bytes,
+                      GCancellable  *cancellable,
+                      GError       **error)
+{
+  int64_t begin_time = g_get_monotonic_time ();
+  gboolean ret;
+
+  ret = valent_transfer_scheduler_acquire (shape->scheduler,
+                                           shape->device_id,
+                                           n_bytes,
+                                           shape->bulk,
+                                           cancellable,
+                                           error);
+
+  if (shape->metrics != NULL)
+    {
+      valent_device_metrics_add_throttle (shape->metrics,
+                                          g_get_monotonic_time () - begin_time);
+    }
+
+  return ret;
+}
+
+#define VALENT_TYPE_SHAPED_INPUT_STREAM (valent_shaped_input_stream_get_type ())
+G_DECLARE_FINAL_TYPE (ValentShapedInputStream, valent_shaped_input_stream, VALENT, SHAPED_INPUT_STREAM, GFilterInputStream)
+
+struct _ValentShapedInputStream
+{
+  GFilterInputStream  parent_instance;
+
+  StreamShape        *shape;
+};
+
+G_DEFINE_FINAL_TYPE (ValentShapedInputStream, valent_shaped_input_stream, G_TYPE_FILTER_INPUT_STREAM)
+
+static gssize
+valent_shaped_input_stream_read (GInputStream  *stream,
+                                 void          *buffer,
+                                 size_t         count,
+                                 GCancellable  *cancellable,
+                                 GError       **error)
+{
+  ValentShapedInputStream *self = VALENT_SHAPED_INPUT_STREAM (stream);
+  GInputStream *base_stream;
+  gssize n_read;
+
+  /* Reads are counted after the fact, since a read may return less than was
+   * requested; the next read then waits for the tokens that were used. */
+  base_stream = g_filter_input_stream_get_base_stream (G_FILTER_INPUT_STREAM (stream));
+  n_read = g_input_stream_read (base_stream,
+                                buffer,
+                                MIN (count, TRANSFER_SLICE_SIZE),
+                                cancellable,
+                                error);
+
+  if (n_read > 0 && !stream_shape_acquire (self->shape, n_read, cancellable, error))
+    return -1;
+
+  return n_read;
+}
+
+static void
+valent_shaped_input_stream_finalize (GObject *object)
+{
+  ValentShapedInputStream *self = VALENT_SHAPED_INPUT_STREAM (object);
+
+  g_clear_pointer (&self->shape, stream_shape_unref);
+
+  G_OBJECT_CLASS (valent_shaped_input_stream_parent_class)->finalize (object);
+}
+
+static void
+valent_shaped_input_stream_class_init (ValentShapedInputStreamClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GInputStreamClass *stream_class = G_INPUT_STREAM_CLASS (klass);
+
+  object_class->finalize = valent_shaped_input_stream_finalize;
+
+  stream_class->read_fn = valent_shaped_input_stream_read;
+}
+
+static void
+valent_shaped_input_stream_init (ValentShapedInputStream *self)
+{
+}
+
+#define VALENT_TYPE_SHAPED_OUTPUT_STREAM (valent_shaped_output_stream_get_type ())
+G_DECLARE_FINAL_TYPE (ValentShapedOutputStream, valent_shaped_output_stream, VALENT, SHAPED_OUTPUT_STREAM, GFilterOutputStream)
+
+struct _ValentShapedOutputStream
+{
+  GFilterOutputStream  parent_instance;
+
+  StreamShape         *shape;
+};
+
+G_DEFINE_FINAL_TYPE (ValentShapedOutputStream, valent_shaped_output_stream, G_TYPE_FILTER_OUTPUT_STREAM)
+
+static gssize
+valent_shaped_output_stream_write (GOutputStream  *stream,
+                                   const void     *buffer,
+                                   size_t          count,
+                                   GCancellable   *cancellable,
+                                   GError        **error)
+{
+  ValentShapedOutputStream *self = VALENT_SHAPED_OUTPUT_STREAM (stream);
+  GOutputStream *base_stream;
+
+  count = MIN (count, TRANSFER_SLICE_SIZE);
+
+  if (!stream_shape_acquire (self->shape, count, cancellable, error))
+    return -1;
+
+  base_stream = g_filter_output_stream_get_base_stream (G_FILTER_OUTPUT_STREAM (stream));
+
+  return g_output_stream_write (base_stream, buffer, count, cancellable, error);
+}
+
+static void
+valent_shaped_output_stream_finalize (GObject *object)
+{
+  ValentShapedOutputStream *self = VALENT_SHAPED_OUTPUT_STREAM (object);
+
+  g_clear_pointer (&self->shape, stream_shape_unref);
+
+  G_OBJECT_CLASS (valent_shaped_output_stream_parent_class)->finalize (object);
+}
+
+static void
+valent_shaped_output_stream_class_init (ValentShapedOutputStreamClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GOutputStreamClass *stream_class = G_OUTPUT_STREAM_CLASS (klass);
+
+  object_class->finalize = valent_shaped_output_stream_finalize;
+
+  stream_class->write_fn = valent_shaped_output_stream_write;
+}
+
+static void
+valent_shaped_output_stream_init (ValentShapedOutputStream *self)
+{
+}
+
+#define VALENT_TYPE_SHAPED_IO_STREAM (valent_shaped_io_stream_get_type ())
+G_DECLARE_FINAL_TYPE (ValentShapedIOStream, valent_shaped_io_stream, VALENT, SHAPED_IO_STREAM, GIOStream)
+
+struct _ValentShapedIOStream
+{
+  GIOStream      parent_instance;
+
+  GIOStream     *base_stream;
+  GInputStream  *input_stream;
+  GOutputStream *output_stream;
+};
+
+G_DEFINE_FINAL_TYPE (ValentShapedIOStream, valent_shaped_io_stream, G_TYPE_IO_STREAM)
+
+static GInputStream *
+valent_shaped_io_stream_get_input_stream (GIOStream *stream)
+{
+  return VALENT_SHAPED_IO_STREAM (stream)->input_stream;
+}
+
+static GOutputStream *
+valent_shaped_io_stream_get_output_stream (GIOStream *stream)
+{
+  return VALENT_SHAPED_IO_STREAM (stream)->output_stream;
+}
+
+static gboolean
+valent_shaped_io_stream_close (GIOStream     *stream,
+                               GCancellable  *cancellable,
+                               GError       **error)
+{
+  ValentShapedIOStream *self = VALENT_SHAPED_IO_STREAM (stream);
+
+  return g_io_stream_close (self->base_stream, cancellable, error);
+}
+
+static void
+valent_shaped_io_stream_finalize (GObject *object)
+{
+  ValentShapedIOStream *self = VALENT_SHAPED_IO_STREAM (object);
+
+  g_clear_object (&self->input_stream);
+  g_clear_object (&self->output_stream);
+  g_clear_object (&self->base_stream);
+
+  G_OBJECT_CLASS (valent_shaped_io_stream_parent_class)->finalize (object);
+}
+
+static void
+valent_shaped_io_stream_class_init (ValentShapedIOStreamClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GIOStreamClass *stream_class = G_IO_STREAM_CLASS (klass);
+
+  object_class->finalize = valent_shaped_io_stream_finalize;
+
+  stream_class->get_input_stream = valent_shaped_io_stream_get_input_stream;
+  stream_class->get_output_stream = valent_shaped_io_stream_get_output_stream;
+  stream_class->close_fn = valent_shaped_io_stream_close;
+}
+
+static void
+valent_shaped_io_stream_init (ValentShapedIOStream *self)
+{
+}
+
+/**
+ * valent_transfer_scheduler_wrap_stream:
+ * @scheduler: a `ValentTransferScheduler`
+ * @base_stream: a `GIOStream`
+ * @device_id: a device ID
+ * @bulk: whether the transfer is bulk
+ * @metrics: (nullable): a `ValentDeviceMetrics`
+ *
+ * Wrap @base_stream, so that reads and writes wait for @scheduler.
+ *
+ * If @metrics is not %NULL, the time spent waiting is counted in it. Closing
+ * the result closes @base_stream.
+ *
+ * Returns: (transfer full): a `GIOStream`
+ */
+GIOStream *
+valent_transfer_scheduler_wrap_stream (ValentTransferScheduler *scheduler,
+                                       GIOStream               *base_stream,
+                                       const char              *device_id,
+                                       gboolean                 bulk,
+                                       ValentDeviceMetrics     *metrics)
+{
+  ValentShapedIOStream *ret;
+  ValentShapedInputStream *input_stream;
+  ValentShapedOutputStream *output_stream;
+  StreamShape *shape;
+
+  g_return_val_if_fail (VALENT_IS_TRANSFER_SCHEDULER (scheduler), NULL);
+  g_return_val_if_fail (G_IS_IO_STREAM (base_stream), NULL);
+  g_return_val_if_fail (device_id != NULL, NULL);
+
+  shape = g_atomic_rc_box_new0 (StreamShape);
+  shape->scheduler = g_object_ref (scheduler);
+  shape->device_id = g_strdup (device_id);
+  shape->bulk = bulk;
+  if (metrics != NULL)
+    shape->metrics = valent_device_metrics_ref (metrics);
+
+  input_stream = g_object_new (VALENT_TYPE_SHAPED_INPUT_STREAM,
+                               "base-stream", g_io_stream_get_input_stream (base_stream),
+                               NULL);
+  input_stream->shape = g_atomic_rc_box_acquire (shape);
+
+  output_stream = g_object_new (VALENT_TYPE_SHAPED_OUTPUT_STREAM,
+                                "base-stream", g_io_stream_get_output_stream (base_stream),
+                                NULL);
+  output_stream->shape = g_atomic_rc_box_acquire (shape);
+
+  ret = g_object_new (VALENT_TYPE_SHAPED_IO_STREAM, NULL);
+  ret->base_stream = g_object_ref (base_stream);
+  ret->input_stream = G_INPUT_STREAM (input_stream);
+  ret->output_stream = G_OUTPUT_STREAM (output_stream);
+
+  stream_shape_unref (shape);
+
+  return G_IO_STREAM (ret);
+}
+
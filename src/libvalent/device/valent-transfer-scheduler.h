@@ -0,0 +1,53 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#pragma once
+
+#include <gio/gio.h>
+
+#include "../core/valent-version.h"
+#include "valent-device-metrics.h"
+
+G_BEGIN_DECLS
+
+#define VALENT_TYPE_TRANSFER_SCHEDULER (valent_transfer_scheduler_get_type())
+
+_VALENT_EXTERN
+G_DECLARE_FINAL_TYPE (ValentTransferScheduler, valent_transfer_scheduler, VALENT, TRANSFER_SCHEDULER, GObject)
+
+_VALENT_EXTERN
+ValentTransferScheduler * valent_transfer_scheduler_get_default       (void);
+_VALENT_EXTERN
+ValentTransferScheduler * valent_transfer_scheduler_new               (GNetworkMonitor          *monitor);
+_VALENT_EXTERN
+void                      valent_transfer_scheduler_set_rate_limit    (ValentTransferScheduler  *scheduler,
+                                                                       const char               *device_id,
+                                                                       uint64_t                  rate);
+_VALENT_EXTERN
+void                      valent_transfer_scheduler_set_pause_metered (ValentTransferScheduler  *scheduler,
+                                                                       gboolean                  pause);
+_VALENT_EXTERN
+void                      valent_transfer_scheduler_set_metered       (ValentTransferScheduler  *scheduler,
+                                                                       gboolean                  metered);
+_VALENT_EXTERN
+unsigned int              valent_transfer_scheduler_get_n_waiting     (ValentTransferScheduler  *scheduler,
+                                                                       unsigned int             *n_paused);
+_VALENT_EXTERN
+void                      valent_transfer_scheduler_set_time          (ValentTransferScheduler  *scheduler,
+                                                                       int64_t                   time);
+_VALENT_EXTERN
+gboolean                  valent_transfer_scheduler_acquire           (ValentTransferScheduler  *scheduler,
+                                                                       const char               *device_id,
+                                                                       size_t                    n_bytes,
+                                                                       gboolean                  bulk,
+                                                                       GCancellable             *cancellable,
+                                                                       GError                  **error);
+_VALENT_EXTERN
+GIOStream               * valent_transfer_scheduler_wrap_stream       (ValentTransferScheduler  *scheduler,
+                                                                       GIOStream                *base_stream,
+                                                                       const char               *device_id,
+                                                                       gboolean                  bulk,
+                                                                       ValentDeviceMetrics      *metrics);
+
+G_END_DECLS
+
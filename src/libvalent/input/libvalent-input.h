@@ -7,6 +7,7 @@ G_BEGIN_DECLS
 
 #include "valent-input.h"
 #include "valent-input-adapter.h"
+#include "valent-input-enums.h"
 #include "valent-input-keydef.h"
 
 G_END_DECLS
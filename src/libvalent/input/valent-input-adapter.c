@@ -45,6 +45,7 @@ G_DEFINE_ABSTRACT_TYPE_WITH_PRIVATE (ValentInputAdapter, valent_input_adapter, V
  * @pointer_axis: the virtual function pointer for valent_input_adapter_pointer_axis()
  * @pointer_button: the virtual function pointer for valent_input_adapter_pointer_button()
  * @pointer_motion: the virtual function pointer for valent_input_adapter_pointer_motion()
+ * @submit_events: the virtual function pointer for valent_input_adapter_submit_events()
  *
  * The virtual function table for #ValentInputAdapter.
  */
@@ -80,6 +81,48 @@ valent_input_adapter_real_pointer_motion (ValentInputAdapter *adapter,
 }
 /* LCOV_EXCL_STOP */
 
+static void
+valent_input_adapter_real_submit_events (ValentInputAdapter     *adapter,
+                                         const ValentInputEvent *events,
+                                         unsigned int            n_events)
+{
+  ValentInputAdapterClass *klass = VALENT_INPUT_ADAPTER_GET_CLASS (adapter);
+
+  for (unsigned int i = 0; i < n_events; i++)
+    {
+      const ValentInputEvent *event = &events[i];
+
+      switch (event->type)
+        {
+        case VALENT_INPUT_EVENT_KEYSYM:
+          klass->keyboard_keysym (adapter, event->code, event->state);
+          break;
+
+        case VALENT_INPUT_EVENT_POINTER_AXIS:
+          klass->pointer_axis (adapter, event->dx, event->dy);
+          break;
+
+        case VALENT_INPUT_EVENT_POINTER_BUTTON:
+          klass->pointer_button (adapter, event->code, event->state);
+          break;
+
+        case VALENT_INPUT_EVENT_POINTER_MOTION:
+          klass->pointer_motion (adapter, event->dx, event->dy);
+          break;
+
+        default:
+          g_assert_not_reached ();
+        }
+    }
+}
+
+static inline gboolean
+is_zero_delta (double dx,
+               double dy)
+{
+  return G_APPROX_VALUE (dx, 0.0, 0.01) && G_APPROX_VALUE (dy, 0.0, 0.01);
+}
+
 /*
  * GObject
  */
@@ -90,6 +133,7 @@ valent_input_adapter_class_init (ValentInputAdapterClass *klass)
   klass->pointer_axis = valent_input_adapter_real_pointer_axis;
   klass->pointer_button = valent_input_adapter_real_pointer_button;
   klass->pointer_motion = valent_input_adapter_real_pointer_motion;
+  klass->submit_events = valent_input_adapter_real_submit_events;
 }
 
 static void
@@ -214,3 +258,90 @@ valent_input_adapter_pointer_motion (ValentInputAdapter *adapter,
   VALENT_EXIT;
 }
 
+/**
+ * valent_input_adapter_submit_events:
+ * @adapter: a #ValentInputAdapter
+ * @events: (array length=n_events): an array of input events
+ * @n_events: the number of events in @events
+ *
+ * Submit a batch of input events, in order.
+ *
+ * Consecutive motion events are coalesced into a single motion, as are
+ * consecutive axis events, and empty keysyms and 0-delta motion are dropped.
+ * Implementations may then submit the whole batch at once, instead of
+ * paying the cost of each event separately.
+ *
+ * Since: 1.0
+ */
+void
+valent_input_adapter_submit_events (ValentInputAdapter     *adapter,
+                                    const ValentInputEvent *events,
+                                    unsigned int            n_events)
+{
+  g_autofree ValentInputEvent *batch = NULL;
+  unsigned int n_batch = 0;
+  unsigned int n_submit = 0;
+
+  VALENT_ENTRY;
+
+  g_return_if_fail (VALENT_IS_INPUT_ADAPTER (adapter));
+  g_return_if_fail (events != NULL || n_events == 0);
+
+  if G_UNLIKELY (n_events == 0)
+    VALENT_EXIT;
+
+  batch = g_new (ValentInputEvent, n_events);
+
+  for (unsigned int i = 0; i < n_events; i++)
+    {
+      const ValentInputEvent *event = &events[i];
+      ValentInputEvent *last = n_batch > 0 ? &batch[n_batch - 1] : NULL;
+
+      switch (event->type)
+        {
+        case VALENT_INPUT_EVENT_KEYSYM:
+          /* Silently ignore empty symbols */
+          if G_UNLIKELY (event->code == 0)
+            continue;
+          break;
+
+        case VALENT_INPUT_EVENT_POINTER_AXIS:
+        case VALENT_INPUT_EVENT_POINTER_MOTION:
+          if (last != NULL && last->type == event->type)
+            {
+              last->dx += event->dx;
+              last->dy += event->dy;
+              continue;
+            }
+          break;
+
+        case VALENT_INPUT_EVENT_POINTER_BUTTON:
+          break;
+
+        default:
+          g_return_if_reached ();
+        }
+
+      batch[n_batch++] = *event;
+    }
+
+  /* Drop any motion that coalesced to nothing */
+  for (unsigned int i = 0; i < n_batch; i++)
+    {
+      if ((batch[i].type == VALENT_INPUT_EVENT_POINTER_AXIS ||
+           batch[i].type == VALENT_INPUT_EVENT_POINTER_MOTION) &&
+          is_zero_delta (batch[i].dx, batch[i].dy))
+        continue;
+
+      batch[n_submit++] = batch[i];
+    }
+
+  if (n_submit > 0)
+    {
+      VALENT_INPUT_ADAPTER_GET_CLASS (adapter)->submit_events (adapter,
+                                                               batch,
+                                                               n_submit);
+    }
+
+  VALENT_EXIT;
+}
@@ -11,6 +11,46 @@
 
 G_BEGIN_DECLS
 
+/**
+ * ValentInputEventType:
+ * @VALENT_INPUT_EVENT_KEYSYM: A keysym was pressed or released
+ * @VALENT_INPUT_EVENT_POINTER_AXIS: The surface under the pointer was scrolled
+ * @VALENT_INPUT_EVENT_POINTER_BUTTON: A pointer button was pressed or released
+ * @VALENT_INPUT_EVENT_POINTER_MOTION: The pointer was moved
+ *
+ * Enumeration of input event types.
+ *
+ * Since: 1.0
+ */
+typedef enum
+{
+  VALENT_INPUT_EVENT_KEYSYM,
+  VALENT_INPUT_EVENT_POINTER_AXIS,
+  VALENT_INPUT_EVENT_POINTER_BUTTON,
+  VALENT_INPUT_EVENT_POINTER_MOTION,
+} ValentInputEventType;
+
+/**
+ * ValentInputEvent:
+ * @type: the event type
+ * @code: a keysym or button, for key and button events
+ * @state: %TRUE to press, or %FALSE to release, for key and button events
+ * @dx: movement on x-axis, for axis and motion events
+ * @dy: movement on y-axis, for axis and motion events
+ *
+ * A single input event, for use with [method@Valent.InputAdapter.submit_events].
+ *
+ * Since: 1.0
+ */
+typedef struct
+{
+  ValentInputEventType type;
+  uint32_t             code;
+  gboolean             state;
+  double               dx;
+  double               dy;
+} ValentInputEvent;
+
 #define VALENT_TYPE_INPUT_ADAPTER (valent_input_adapter_get_type())
 
 VALENT_AVAILABLE_IN_1_0
@@ -33,9 +73,12 @@ struct _ValentInputAdapterClass
   void                   (*pointer_motion)  (ValentInputAdapter *adapter,
                                              double              dx,
                                              double              dy);
+  void                   (*submit_events)   (ValentInputAdapter     *adapter,
+                                             const ValentInputEvent *events,
+                                             unsigned int            n_events);
 
   /*< private >*/
-  gpointer               padding[8];
+  gpointer               padding[7];
 };
 
 VALENT_AVAILABLE_IN_1_0
@@ -54,6 +97,10 @@ VALENT_AVAILABLE_IN_1_0
 void   valent_input_adapter_pointer_motion  (ValentInputAdapter *adapter,
                                              double              dx,
                                              double              dy);
+VALENT_AVAILABLE_IN_1_0
+void   valent_input_adapter_submit_events   (ValentInputAdapter     *adapter,
+                                             const ValentInputEvent *events,
+                                             unsigned int            n_events);
 
 G_END_DECLS
 
@@ -5,6 +5,8 @@
 
 #include "config.h"
 
+#include <math.h>
+
 #include <glib-object.h>
 #include <libpeas/peas.h>
 #include <libvalent-core.h>
@@ -24,17 +26,63 @@
  * Plugins can implement [class@Valent.InputAdapter] to provide an interface to
  * control the pointer and keyboard.
  *
+ * ## Pointer Motion
+ *
+ * Relative pointer motion passed to [method@Valent.Input.pointer_motion] is
+ * not forwarded immediately. Deltas are queued with a presentation time and
+ * flushed to the adapter once per [property@Valent.Input:motion-interval],
+ * with the sub-pixel remainder carried over to the next flush.
+ *
+ * Remote devices tend to send motion in bursts, so the presentation time of
+ * each delta is spread out by the average interval between arrivals, up to a
+ * small bound. This smooths over network jitter at the cost of a few
+ * milliseconds of latency. Any other event flushes pending motion first, so
+ * the order of events is always preserved.
+ *
  * Since: 1.0
  */
 
+/* The maximum time a delta may be held back to smooth over jitter, and the
+ * arrival interval above which the stream is considered to have restarted.
+ */
+#define MOTION_MAX_DELAY_USEC (25 * G_TIME_SPAN_MILLISECOND)
+#define MOTION_IDLE_USEC      (100 * G_TIME_SPAN_MILLISECOND)
+
+/* Velocity (px/ms) at which acceleration stops increasing the gain.
+ */
+#define MOTION_MAX_VELOCITY   (4.0)
+
+typedef struct
+{
+  int64_t  arrival;
+  int64_t  present;
+  double   dx;
+  double   dy;
+} MotionSample;
+
 struct _ValentInput
 {
   ValentComponent     parent_instance;
 
+  GSettings          *settings;
   ValentInputAdapter *default_adapter;
   GPtrArray          *adapters; /* complete list of adapters */
   GListModel         *exports;  /* adapters marked for export */
   GPtrArray          *items;    /* adapters exposed by GListModel */
+
+  /* pointer motion */
+  GArray             *motion;   /* MotionSample */
+  unsigned int        motion_id;
+  unsigned int        motion_interval;
+  double              acceleration;
+  double              remainder_x;
+  double              remainder_y;
+  int64_t             last_arrival;
+  int64_t             last_present;
+  int64_t             last_flush;
+  double              arrival_interval;
+  uint64_t            n_motion_in;
+  uint64_t            n_motion_out;
 };
 
 static void   g_list_model_iface_init (GListModelInterface *iface);
@@ -43,9 +91,167 @@ G_DEFINE_FINAL_TYPE_WITH_CODE (ValentInput, valent_input, VALENT_TYPE_COMPONENT,
                                G_IMPLEMENT_INTERFACE (G_TYPE_LIST_MODEL, g_list_model_iface_init))
 
 
+enum {
+  PROP_0,
+  PROP_MOTION_INTERVAL,
+  PROP_POINTER_ACCELERATION,
+  N_PROPERTIES
+};
+
+static GParamSpec *properties[N_PROPERTIES] = { NULL, };
+
 static ValentInput *default_input = NULL;
 
 
+/*
+ * Pointer Motion
+ */
+static void
+valent_input_flush_motion (ValentInput *self,
+                           gboolean     force)
+{
+  int64_t now = g_get_monotonic_time ();
+  int64_t first_arrival = 0;
+  double dx = 0.0, dy = 0.0;
+  double dt, gain;
+  unsigned int n_samples = 0;
+
+  g_assert (VALENT_IS_INPUT (self));
+
+  for (unsigned int i = 0; i < self->motion->len; i++)
+    {
+      const MotionSample *sample = &g_array_index (self->motion, MotionSample, i);
+
+      if (!force && sample->present > now)
+        break;
+
+      if (n_samples == 0)
+        first_arrival = sample->arrival;
+
+      dx += sample->dx;
+      dy += sample->dy;
+      n_samples++;
+    }
+
+  if (n_samples == 0)
+    return;
+
+  g_array_remove_range (self->motion, 0, n_samples);
+
+  /* Scale by the velocity of this frame, bounded by the tick interval so that
+   * a burst after an idle period isn't treated as a slow movement.
+   */
+  dt = (double)(now - self->last_flush) / G_TIME_SPAN_MILLISECOND;
+  dt = CLAMP (dt, MAX (self->motion_interval, 1), MOTION_IDLE_USEC / G_TIME_SPAN_MILLISECOND);
+  gain = 1.0 + self->acceleration * MIN (hypot (dx, dy) / dt, MOTION_MAX_VELOCITY);
+  self->last_flush = now;
+
+  /* Only whole pixels are sent, with the remainder carried forward
+   */
+  dx = (dx * gain) + self->remainder_x;
+  dy = (dy * gain) + self->remainder_y;
+  self->remainder_x = dx - round (dx);
+  self->remainder_y = dy - round (dy);
+  dx = round (dx);
+  dy = round (dy);
+
+  if (dx == 0.0 && dy == 0.0)
+    return;
+
+  if G_LIKELY (self->default_adapter != NULL)
+    valent_input_adapter_pointer_motion (self->default_adapter, dx, dy);
+
+  self->n_motion_out++;
+
+  VALENT_TRACE_EVENT (VALENT_TRACE_FUNCTION, NULL, first_arrival, n_samples);
+  VALENT_NOTE ("%u samples in %.3fms (%"G_GUINT64_FORMAT"/%"G_GUINT64_FORMAT")",
+               n_samples,
+               (double)(now - first_arrival) / G_TIME_SPAN_MILLISECOND,
+               self->n_motion_out,
+               self->n_motion_in);
+}
+
+static gboolean
+valent_input_motion_tick (gpointer data)
+{
+  ValentInput *self = VALENT_INPUT (data);
+
+  valent_input_flush_motion (self, FALSE);
+
+  if (self->motion->len > 0)
+    return G_SOURCE_CONTINUE;
+
+  self->motion_id = 0;
+  return G_SOURCE_REMOVE;
+}
+
+static inline void
+valent_input_push_motion (ValentInput *self,
+                          double       dx,
+                          double       dy)
+{
+  MotionSample sample;
+  int64_t now = g_get_monotonic_time ();
+  int64_t interval = now - self->last_arrival;
+
+  self->n_motion_in++;
+
+  if (self->motion_interval == 0)
+    {
+      sample = (MotionSample){ now, now, dx, dy };
+      g_array_append_val (self->motion, sample);
+      valent_input_flush_motion (self, TRUE);
+      return;
+    }
+
+  /* Track the average arrival interval, resetting when the stream restarts
+   */
+  if (interval >= MOTION_IDLE_USEC)
+    {
+      self->arrival_interval = 0.0;
+      self->last_present = 0;
+    }
+  else if (self->arrival_interval > 0.0)
+    {
+      self->arrival_interval = (self->arrival_interval * 0.875) +
+                               (interval * 0.125);
+    }
+  else
+    {
+      self->arrival_interval = interval;
+    }
+
+  /* Spread the presentation of each delta by the average interval, so that
+   * a burst of deltas is played back at the rate they were produced.
+   */
+  sample.arrival = now;
+  sample.present = now;
+  sample.dx = dx;
+  sample.dy = dy;
+
+  if (self->last_present > 0)
+    {
+      int64_t present = self->last_present + (int64_t)self->arrival_interval;
+
+      sample.present = CLAMP (present, now, now + MOTION_MAX_DELAY_USEC);
+    }
+
+  self->last_arrival = now;
+  self->last_present = sample.present;
+  g_array_append_val (self->motion, sample);
+
+  if (self->motion_id == 0)
+    {
+      self->last_flush = now;
+      self->motion_id = g_timeout_add_full (G_PRIORITY_HIGH_IDLE,
+                                            self->motion_interval,
+                                            valent_input_motion_tick,
+                                            self, NULL);
+      g_source_set_name_by_id (self->motion_id, "valent_input_motion_tick");
+    }
+}
+
+
 static void
 on_items_changed (GListModel   *list,
                   unsigned int  position,
@@ -154,6 +360,7 @@ valent_input_bind_preferred (ValentComponent *component,
   g_assert (VALENT_IS_INPUT (self));
   g_assert (adapter == NULL || VALENT_IS_INPUT_ADAPTER (adapter));
 
+  valent_input_flush_motion (self, TRUE);
   self->default_adapter = adapter;
 
   VALENT_EXIT;
@@ -167,6 +374,7 @@ valent_input_destroy (ValentObject *object)
 {
   ValentInput *self = VALENT_INPUT (object);
 
+  g_clear_handle_id (&self->motion_id, g_source_remove);
   g_list_store_remove_all (G_LIST_STORE (self->exports));
 
   VALENT_OBJECT_CLASS (valent_input_parent_class)->destroy (object);
@@ -180,13 +388,71 @@ valent_input_finalize (GObject *object)
 {
   ValentInput *self = VALENT_INPUT (object);
 
+  g_clear_object (&self->settings);
   g_clear_object (&self->exports);
   g_clear_pointer (&self->adapters, g_ptr_array_unref);
   g_clear_pointer (&self->items, g_ptr_array_unref);
+  g_clear_pointer (&self->motion, g_array_unref);
 
   G_OBJECT_CLASS (valent_input_parent_class)->finalize (object);
 }
 
+static void
+valent_input_get_property (GObject    *object,
+                           guint       prop_id,
+                           GValue     *value,
+                           GParamSpec *pspec)
+{
+  ValentInput *self = VALENT_INPUT (object);
+
+  switch (prop_id)
+    {
+    case PROP_MOTION_INTERVAL:
+      g_value_set_uint (value, self->motion_interval);
+      break;
+
+    case PROP_POINTER_ACCELERATION:
+      g_value_set_double (value, self->acceleration);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+valent_input_set_property (GObject      *object,
+                           guint         prop_id,
+                           const GValue *value,
+                           GParamSpec   *pspec)
+{
+  ValentInput *self = VALENT_INPUT (object);
+
+  switch (prop_id)
+    {
+    case PROP_MOTION_INTERVAL:
+      if (self->motion_interval != g_value_get_uint (value))
+        {
+          valent_input_flush_motion (self, TRUE);
+          g_clear_handle_id (&self->motion_id, g_source_remove);
+          self->motion_interval = g_value_get_uint (value);
+          g_object_notify_by_pspec (object, pspec);
+        }
+      break;
+
+    case PROP_POINTER_ACCELERATION:
+      if (!G_APPROX_VALUE (self->acceleration, g_value_get_double (value), 0.001))
+        {
+          self->acceleration = g_value_get_double (value);
+          g_object_notify_by_pspec (object, pspec);
+        }
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
 static void
 valent_input_class_init (ValentInputClass *klass)
 {
@@ -195,10 +461,54 @@ valent_input_class_init (ValentInputClass *klass)
   ValentComponentClass *component_class = VALENT_COMPONENT_CLASS (klass);
 
   object_class->finalize = valent_input_finalize;
+  object_class->get_property = valent_input_get_property;
+  object_class->set_property = valent_input_set_property;
 
   vobject_class->destroy = valent_input_destroy;
 
   component_class->bind_preferred = valent_input_bind_preferred;
+
+  /**
+   * ValentInput:motion-interval:
+   *
+   * The interval pointer motion is flushed at, in milliseconds.
+   *
+   * Relative motion is accumulated and sent to the adapter once per interval,
+   * which should be about the duration of a display frame. If `0`, motion is
+   * sent immediately.
+   *
+   * Since: 1.0
+   */
+  properties [PROP_MOTION_INTERVAL] =
+    g_param_spec_uint ("motion-interval", NULL, NULL,
+                       0, 1000,
+                       8,
+                       (G_PARAM_READWRITE |
+                        G_PARAM_EXPLICIT_NOTIFY |
+                        G_PARAM_STATIC_STRINGS));
+
+  /**
+   * ValentInput:pointer-acceleration:
+   *
+   * The pointer acceleration factor.
+   *
+   * Motion is scaled by `1 + (acceleration × velocity)`, with the velocity in
+   * pixels per millisecond and bounded to a maximum. If `0`, motion is not
+   * accelerated.
+   *
+   * This property follows the `pointer-acceleration` setting.
+   *
+   * Since: 1.0
+   */
+  properties [PROP_POINTER_ACCELERATION] =
+    g_param_spec_double ("pointer-acceleration", NULL, NULL,
+                         0.0, 1.0,
+                         0.0,
+                         (G_PARAM_READWRITE |
+                          G_PARAM_EXPLICIT_NOTIFY |
+                          G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_properties (object_class, N_PROPERTIES, properties);
 }
 
 static void
@@ -206,6 +516,8 @@ valent_input_init (ValentInput *self)
 {
   self->adapters = g_ptr_array_new_with_free_func (g_object_unref);
   self->items = g_ptr_array_new_with_free_func (g_object_unref);
+  self->motion = g_array_new (FALSE, FALSE, sizeof (MotionSample));
+  self->motion_interval = 8;
 
   self->exports = G_LIST_MODEL (g_list_store_new (VALENT_TYPE_INPUT_ADAPTER));
   g_signal_connect_object (self->exports,
@@ -213,6 +525,11 @@ valent_input_init (ValentInput *self)
                            G_CALLBACK (on_items_changed),
                            self, 0);
   g_ptr_array_add (self->adapters, g_object_ref (self->exports));
+
+  self->settings = g_settings_new ("ca.andyholmes.Valent");
+  g_settings_bind (self->settings, "pointer-acceleration",
+                   self,           "pointer-acceleration",
+                   G_SETTINGS_BIND_GET);
 }
 
 /**
@@ -316,6 +633,8 @@ valent_input_keyboard_keysym (ValentInput  *input,
 
   g_return_if_fail (VALENT_IS_INPUT (input));
 
+  valent_input_flush_motion (input, TRUE);
+
   if G_LIKELY (input->default_adapter != NULL)
     valent_input_adapter_keyboard_keysym (input->default_adapter, keysym, state);
 
@@ -342,6 +661,8 @@ valent_input_pointer_axis (ValentInput *input,
 
   g_return_if_fail (VALENT_IS_INPUT (input));
 
+  valent_input_flush_motion (input, TRUE);
+
   if G_LIKELY (input->default_adapter != NULL)
     valent_input_adapter_pointer_axis (input->default_adapter, dx, dy);
 
@@ -367,6 +688,8 @@ valent_input_pointer_button (ValentInput  *input,
 
   g_return_if_fail (VALENT_IS_INPUT (input));
 
+  valent_input_flush_motion (input, TRUE);
+
   if G_LIKELY (input->default_adapter != NULL)
     valent_input_adapter_pointer_button (input->default_adapter, button, state);
 
@@ -381,6 +704,9 @@ valent_input_pointer_button (ValentInput  *input,
  *
  * Move the pointer (@dx, @dy), relative to its current position.
  *
+ * The motion is accelerated according to [property@Valent.Input:pointer-acceleration]
+ * and may be delayed until the next [property@Valent.Input:motion-interval].
+ *
  * Since: 1.0
  */
 void
@@ -392,9 +718,39 @@ valent_input_pointer_motion (ValentInput *input,
 
   g_return_if_fail (VALENT_IS_INPUT (input));
 
-  if G_LIKELY (input->default_adapter != NULL)
-    valent_input_adapter_pointer_motion (input->default_adapter, dx, dy);
+  if (dx != 0.0 || dy != 0.0)
+    valent_input_push_motion (input, dx, dy);
 
   VALENT_EXIT;
 }
 
+/**
+ * valent_input_submit_events:
+ * @input: a #ValentInput
+ * @events: (array length=n_events): an array of input events
+ * @n_events: the number of events in @events
+ *
+ * Submit a batch of input events, in order.
+ *
+ * This should be preferred over calling the individual methods in a loop, such
+ * as when typing a string, since the adapter may submit the batch at once.
+ *
+ * Since: 1.0
+ */
+void
+valent_input_submit_events (ValentInput            *input,
+                            const ValentInputEvent *events,
+                            unsigned int            n_events)
+{
+  VALENT_ENTRY;
+
+  g_return_if_fail (VALENT_IS_INPUT (input));
+  g_return_if_fail (events != NULL || n_events == 0);
+
+  valent_input_flush_motion (input, TRUE);
+
+  if G_LIKELY (input->default_adapter != NULL)
+    valent_input_adapter_submit_events (input->default_adapter, events, n_events);
+
+  VALENT_EXIT;
+}
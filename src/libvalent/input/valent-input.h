@@ -41,6 +41,10 @@ VALENT_AVAILABLE_IN_1_0
 void          valent_input_pointer_motion   (ValentInput        *input,
                                              double              dx,
                                              double              dy);
+VALENT_AVAILABLE_IN_1_0
+void          valent_input_submit_events    (ValentInput            *input,
+                                             const ValentInputEvent *events,
+                                             unsigned int            n_events);
 
 G_END_DECLS
 
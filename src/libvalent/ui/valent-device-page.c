@@ -10,6 +10,7 @@
 #include <libvalent-core.h>
 #include <libvalent-device.h>
 
+#include "../device/valent-device-private.h"
 #include "valent-device-gadget.h"
 #include "valent-device-page.h"
 #include "valent-device-preferences-window.h"
@@ -24,6 +25,7 @@ struct _ValentDevicePage
   ValentDevice    *device;
   GHashTable      *plugins;
   GtkWindow       *preferences;
+  gboolean         held;
 
   /* template */
   AdwWindowTitle  *title;
@@ -236,6 +238,38 @@ page_unpair_action (GtkWidget  *widget,
   g_action_group_activate_action (G_ACTION_GROUP (self->device), "unpair", NULL);
 }
 
+/*
+ * GtkWidget
+ */
+static void
+valent_device_page_map (GtkWidget *widget)
+{
+  ValentDevicePage *self = VALENT_DEVICE_PAGE (widget);
+
+  GTK_WIDGET_CLASS (valent_device_page_parent_class)->map (widget);
+
+  /* Keep the device plugins active while the page is shown */
+  if (!self->held)
+    {
+      valent_device_hold (self->device);
+      self->held = TRUE;
+    }
+}
+
+static void
+valent_device_page_unmap (GtkWidget *widget)
+{
+  ValentDevicePage *self = VALENT_DEVICE_PAGE (widget);
+
+  if (self->held)
+    {
+      valent_device_release (self->device);
+      self->held = FALSE;
+    }
+
+  GTK_WIDGET_CLASS (valent_device_page_parent_class)->unmap (widget);
+}
+
 /*
  * GObject
  */
@@ -279,7 +313,14 @@ valent_device_page_dispose (GObject *object)
 {
   ValentDevicePage *self = VALENT_DEVICE_PAGE (object);
 
+  if (self->held)
+    {
+      valent_device_release (self->device);
+      self->held = FALSE;
+    }
+
   g_clear_object (&self->device);
+
   g_clear_pointer (&self->plugins, g_hash_table_unref);
   g_clear_pointer (&self->preferences, gtk_window_destroy);
 
@@ -337,6 +378,9 @@ valent_device_page_class_init (ValentDevicePageClass *klass)
   object_class->get_property = valent_device_page_get_property;
   object_class->set_property = valent_device_page_set_property;
 
+  widget_class->map = valent_device_page_map;
+  widget_class->unmap = valent_device_page_unmap;
+
   /* template */
   gtk_widget_class_set_template_from_resource (widget_class, "/ca/andyholmes/Valent/ui/valent-device-page.ui");
   gtk_widget_class_bind_template_child (widget_class, ValentDevicePage, title);
@@ -11,9 +11,12 @@
 #include <libvalent-core.h>
 #include <libvalent-device.h>
 
+#include "../device/valent-device-private.h"
 #include "valent-device-preferences-group.h"
 #include "valent-device-preferences-window.h"
 
+#define TRAFFIC_UPDATE_INTERVAL (1)
+
 
 struct _ValentDevicePreferencesWindow
 {
@@ -21,6 +24,8 @@ struct _ValentDevicePreferencesWindow
 
   ValentDevice         *device;
   GHashTable           *plugins;
+  GHashTable           *handler_rows;
+  unsigned int          traffic_id;
 
   /* template */
   AdwPreferencesPage   *status_page;
@@ -29,6 +34,11 @@ struct _ValentDevicePreferencesWindow
   AdwPreferencesPage   *plugin_page;
   AdwPreferencesGroup  *plugin_group;
   GtkListBox           *plugin_list;
+  AdwActionRow         *rx_row;
+  AdwActionRow         *tx_row;
+  AdwActionRow         *queue_row;
+  AdwActionRow         *transfer_row;
+  AdwExpanderRow       *handler_row;
 };
 
 G_DEFINE_FINAL_TYPE (ValentDevicePreferencesWindow, valent_device_preferences_window, ADW_TYPE_PREFERENCES_WINDOW)
@@ -217,6 +227,149 @@ on_plugins_changed (ValentDevice                  *device,
     }
 }
 
+/*
+ * Traffic
+ */
+static char *
+format_packets (uint64_t n_packets,
+                uint64_t n_bytes)
+{
+  g_autofree char *packets_str = NULL;
+  g_autofree char *bytes_str = NULL;
+
+  packets_str = g_strdup_printf ("%"G_GUINT64_FORMAT, n_packets);
+  bytes_str = g_format_size (n_bytes);
+
+  /* TRANSLATORS: the number of packets, followed by the total size */
+  return g_strdup_printf (ngettext ("%1$s packet, %2$s",
+                                    "%1$s packets, %2$s",
+                                    (unsigned long)n_packets),
+                          packets_str, bytes_str);
+}
+
+static char *
+format_transfers (GVariant *downloads,
+                  GVariant *uploads)
+{
+  uint64_t n_down = 0, down_bytes = 0, down_time = 0;
+  uint64_t n_up = 0, up_bytes = 0, up_time = 0;
+  g_autofree char *down_str = NULL;
+  g_autofree char *down_rate = NULL;
+  g_autofree char *up_str = NULL;
+  g_autofree char *up_rate = NULL;
+
+  if (downloads != NULL)
+    g_variant_get (downloads, "(ttt)", &n_down, &down_bytes, &down_time);
+
+  if (uploads != NULL)
+    g_variant_get (uploads, "(ttt)", &n_up, &up_bytes, &up_time);
+
+  if (n_down == 0 && n_up == 0)
+    return g_strdup (_("None"));
+
+  down_str = g_format_size (down_bytes);
+  down_rate = g_format_size (down_time > 0
+                             ? down_bytes * G_USEC_PER_SEC / down_time
+                             : 0);
+  up_str = g_format_size (up_bytes);
+  up_rate = g_format_size (up_time > 0
+                           ? up_bytes * G_USEC_PER_SEC / up_time
+                           : 0);
+
+  /* TRANSLATORS: the size and average rate of received files, then sent files;
+   * for example "1.2 MB received at 800 kB/s, 0 bytes sent at 0 bytes/s" */
+  return g_strdup_printf (_("%1$s received at %2$s/s, %3$s sent at %4$s/s"),
+                          down_str, down_rate, up_str, up_rate);
+}
+
+static void
+valent_device_preferences_window_update_handlers (ValentDevicePreferencesWindow *self,
+                                                  GVariant                      *handlers)
+{
+  GVariantIter iter;
+  const char *name;
+  uint64_t n_calls, total_time, max_time;
+
+  g_variant_iter_init (&iter, handlers);
+
+  while (g_variant_iter_next (&iter, "{&s(ttt@at)}",
+                              &name, &n_calls, &total_time, &max_time, NULL))
+    {
+      g_autofree char *calls_str = NULL;
+      g_autofree char *subtitle = NULL;
+      GtkWidget *row;
+
+      if ((row = g_hash_table_lookup (self->handler_rows, name)) == NULL)
+        {
+          row = g_object_new (ADW_TYPE_ACTION_ROW,
+                              "title",      name,
+                              "selectable", FALSE,
+                              NULL);
+          adw_expander_row_add_row (self->handler_row, row);
+          g_hash_table_insert (self->handler_rows, g_strdup (name), row);
+        }
+
+      calls_str = g_strdup_printf ("%"G_GUINT64_FORMAT, n_calls);
+
+      /* TRANSLATORS: the number of packets handled by a plugin, followed by the
+       * average and maximum time spent handling each packet */
+      subtitle = g_strdup_printf (ngettext ("%1$s packet, %2$.2f ms average, %3$.2f ms maximum",
+                                            "%1$s packets, %2$.2f ms average, %3$.2f ms maximum",
+                                            (unsigned long)n_calls),
+                                  calls_str,
+                                  n_calls > 0 ? (double)total_time / n_calls / 1000.0 : 0.0,
+                                  (double)max_time / 1000.0);
+      adw_action_row_set_subtitle (ADW_ACTION_ROW (row), subtitle);
+    }
+}
+
+static gboolean
+valent_device_preferences_window_update_traffic (gpointer data)
+{
+  ValentDevicePreferencesWindow *self = VALENT_DEVICE_PREFERENCES_WINDOW (data);
+  g_autoptr (GVariant) metrics = NULL;
+  g_autoptr (GVariant) downloads = NULL;
+  g_autoptr (GVariant) uploads = NULL;
+  g_autoptr (GVariant) handlers = NULL;
+  g_autofree char *rx_str = NULL;
+  g_autofree char *tx_str = NULL;
+  g_autofree char *queue_str = NULL;
+  g_autofree char *transfer_str = NULL;
+  uint64_t rx_packets = 0, rx_bytes = 0;
+  uint64_t tx_packets = 0, tx_bytes = 0;
+  unsigned int depth = 0, max_depth = 0;
+
+  metrics = g_variant_ref_sink (valent_device_dup_metrics (self->device));
+
+  g_variant_lookup (metrics, "rx-packets", "t", &rx_packets);
+  g_variant_lookup (metrics, "rx-bytes", "t", &rx_bytes);
+  rx_str = format_packets (rx_packets, rx_bytes);
+  adw_action_row_set_subtitle (self->rx_row, rx_str);
+
+  g_variant_lookup (metrics, "tx-packets", "t", &tx_packets);
+  g_variant_lookup (metrics, "tx-bytes", "t", &tx_bytes);
+  tx_str = format_packets (tx_packets, tx_bytes);
+  adw_action_row_set_subtitle (self->tx_row, tx_str);
+
+  g_variant_lookup (metrics, "queue-depth", "u", &depth);
+  g_variant_lookup (metrics, "queue-depth-max", "u", &max_depth);
+  /* TRANSLATORS: the number of packets waiting to be sent, followed by the
+   * most that have been waiting at once */
+  queue_str = g_strdup_printf (_("%1$u waiting, %2$u at most"), depth, max_depth);
+  adw_action_row_set_subtitle (self->queue_row, queue_str);
+
+  downloads = g_variant_lookup_value (metrics, "downloads", G_VARIANT_TYPE ("(ttt)"));
+  uploads = g_variant_lookup_value (metrics, "uploads", G_VARIANT_TYPE ("(ttt)"));
+  transfer_str = format_transfers (downloads, uploads);
+  adw_action_row_set_subtitle (self->transfer_row, transfer_str);
+
+  handlers = g_variant_lookup_value (metrics, "handlers", G_VARIANT_TYPE ("a{s(tttat)}"));
+  if (handlers != NULL)
+    valent_device_preferences_window_update_handlers (self, handlers);
+
+  return G_SOURCE_CONTINUE;
+}
+
 /*
  * GObject
  */
@@ -241,6 +394,14 @@ valent_device_preferences_window_constructed (GObject *object)
                            self, 0);
   on_plugins_changed (self->device, NULL, self);
 
+  /* Traffic */
+  valent_device_preferences_window_update_traffic (self);
+  self->traffic_id = g_timeout_add_seconds (TRAFFIC_UPDATE_INTERVAL,
+                                            valent_device_preferences_window_update_traffic,
+                                            self);
+  g_source_set_name_by_id (self->traffic_id,
+                           "[valent] valent_device_preferences_window_update_traffic");
+
   G_OBJECT_CLASS (valent_device_preferences_window_parent_class)->constructed (object);
 }
 
@@ -249,8 +410,10 @@ valent_device_preferences_window_dispose (GObject *object)
 {
   ValentDevicePreferencesWindow *self = VALENT_DEVICE_PREFERENCES_WINDOW (object);
 
+  g_clear_handle_id (&self->traffic_id, g_source_remove);
   g_clear_object (&self->device);
   g_clear_pointer (&self->plugins, g_hash_table_unref);
+  g_clear_pointer (&self->handler_rows, g_hash_table_unref);
 
   gtk_widget_dispose_template (GTK_WIDGET (object),
                                VALENT_TYPE_DEVICE_PREFERENCES_WINDOW);
@@ -314,6 +477,11 @@ valent_device_preferences_window_class_init (ValentDevicePreferencesWindowClass
   gtk_widget_class_bind_template_child (widget_class, ValentDevicePreferencesWindow, plugin_page);
   gtk_widget_class_bind_template_child (widget_class, ValentDevicePreferencesWindow, plugin_group);
   gtk_widget_class_bind_template_child (widget_class, ValentDevicePreferencesWindow, plugin_list);
+  gtk_widget_class_bind_template_child (widget_class, ValentDevicePreferencesWindow, rx_row);
+  gtk_widget_class_bind_template_child (widget_class, ValentDevicePreferencesWindow, tx_row);
+  gtk_widget_class_bind_template_child (widget_class, ValentDevicePreferencesWindow, queue_row);
+  gtk_widget_class_bind_template_child (widget_class, ValentDevicePreferencesWindow, transfer_row);
+  gtk_widget_class_bind_template_child (widget_class, ValentDevicePreferencesWindow, handler_row);
 
   /**
    * ValentDevicePreferencesWindow:device:
@@ -341,5 +509,7 @@ valent_device_preferences_window_init (ValentDevicePreferencesWindow *self)
                                          g_str_equal,
                                          g_free,
                                          plugin_data_free);
+  self->handler_rows = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                              g_free, NULL);
 }
 
@@ -17,6 +17,10 @@
 
 #define CAPTURE_THRESHOLD_MS 50
 
+/* Velocity (px/ms) at which acceleration stops increasing the gain, matching
+ * the motion of ValentInput */
+#define ACCELERATION_MAX_VELOCITY (4.0)
+
 
 struct _ValentInputRemote
 {
@@ -24,6 +28,7 @@ struct _ValentInputRemote
 
   GListModel         *adapters;
   ValentInputAdapter *adapter;
+  GSettings          *settings;
 
   /* Pointer State */
   unsigned int        claimed : 1;
@@ -32,6 +37,7 @@ struct _ValentInputRemote
   double              last_x;
   double              last_y;
   double              last_v;
+  double              acceleration;
   int                 scale;
 
   /* template */
@@ -143,9 +149,7 @@ calculate_delta (ValentInputRemote *self,
   else
     self->last_v = v;
 
-  // TODO: acceleration setting
-  m = pow (self->last_v, 1.0);
-  m = fmin (4.0, fmax (m, 0.25));
+  m = 1.0 + self->acceleration * fmin (self->last_v, ACCELERATION_MAX_VELOCITY);
 
   *cx = round (dx * m);
   *cy = round (dy * m);
@@ -153,6 +157,16 @@ calculate_delta (ValentInputRemote *self,
   return dt >= CAPTURE_THRESHOLD_MS;
 }
 
+static void
+on_acceleration_changed (GSettings         *settings,
+                         const char        *key,
+                         ValentInputRemote *self)
+{
+  g_assert (VALENT_IS_INPUT_REMOTE (self));
+
+  self->acceleration = g_settings_get_double (settings, key);
+}
+
 static inline void
 valent_input_remote_pointer_reset (ValentInputRemote *self)
 {
@@ -434,6 +448,7 @@ valent_input_remote_dispose (GObject *object)
 
   g_clear_object (&self->adapter);
   g_clear_object (&self->adapters);
+  g_clear_object (&self->settings);
 
   gtk_widget_dispose_template (GTK_WIDGET (object), VALENT_TYPE_INPUT_REMOTE);
 
@@ -531,5 +546,12 @@ valent_input_remote_init (ValentInputRemote *self)
   gtk_gesture_group (self->touch_single, self->touch_triple);
 
   self->scale = gtk_widget_get_scale_factor (GTK_WIDGET (self));
+
+  self->settings = g_settings_new ("ca.andyholmes.Valent");
+  g_signal_connect_object (self->settings,
+                           "changed::pointer-acceleration",
+                           G_CALLBACK (on_acceleration_changed),
+                           self, 0);
+  on_acceleration_changed (self->settings, "pointer-acceleration", self);
 }
 
@@ -36,6 +36,7 @@ struct _ValentPreferencesWindow
 
   AdwPreferencesGroup  *general_group;
   AdwEntryRow          *name_entry;
+  GtkAdjustment        *acceleration_adjustment;
 
   AdwPreferencesGroup  *plugin_group;
   GtkListBox           *plugin_list;
@@ -298,6 +299,9 @@ valent_preferences_window_constructed (GObject *object)
                            self, 0);
   name = g_settings_get_string (self->settings, "name");
   gtk_editable_set_text (GTK_EDITABLE (self->name_entry), name);
+  g_settings_bind (self->settings,                "pointer-acceleration",
+                   self->acceleration_adjustment, "value",
+                   G_SETTINGS_BIND_DEFAULT);
 
   /* Application Plugins */
   plugins = peas_engine_get_plugin_list (engine);
@@ -365,6 +369,7 @@ valent_preferences_window_class_init (ValentPreferencesWindowClass *klass)
   gtk_widget_class_bind_template_child (widget_class, ValentPreferencesWindow, plugin_group);
   gtk_widget_class_bind_template_child (widget_class, ValentPreferencesWindow, plugin_list);
   gtk_widget_class_bind_template_child (widget_class, ValentPreferencesWindow, name_entry);
+  gtk_widget_class_bind_template_child (widget_class, ValentPreferencesWindow, acceleration_adjustment);
 
   gtk_widget_class_bind_template_callback (widget_class, on_name_apply);
 
@@ -6,6 +6,7 @@
 #include "config.h"
 
 #include <math.h>
+#include <string.h>
 
 #include <glib/gi18n.h>
 #include <gio/gio.h>
@@ -39,6 +40,16 @@ struct _ValentBatteryPlugin
   int64_t             timestamp;
 };
 
+/* The local battery state is the same for every device, so the packet is
+ * serialized once and shared by every instance of the plugin */
+static struct
+{
+  GBytes       *bytes;
+  int           current_charge;
+  gboolean      is_charging;
+  unsigned int  threshold_event;
+} local_state = { NULL, };
+
 static const char * valent_battery_plugin_get_icon_name (ValentBatteryPlugin *self);
 static void         valent_battery_plugin_send_state    (ValentBatteryPlugin *self);
 
@@ -114,19 +125,35 @@ valent_battery_plugin_send_state (ValentBatteryPlugin *self)
   is_charging = valent_battery_is_charging (self->battery);
   threshold_event = valent_battery_threshold_event (self->battery);
 
-  valent_packet_init (&builder, "kdeconnect.battery");
-  json_builder_set_member_name (builder, "currentCharge");
-  json_builder_add_int_value (builder, current_charge);
-  json_builder_set_member_name (builder, "isCharging");
-  json_builder_add_boolean_value (builder, is_charging);
-  json_builder_set_member_name (builder, "thresholdEvent");
-  json_builder_add_int_value (builder, threshold_event);
-  packet = valent_packet_end (&builder);
+  if (local_state.bytes == NULL ||
+      local_state.current_charge != current_charge ||
+      local_state.is_charging != is_charging ||
+      local_state.threshold_event != threshold_event)
+    {
+      char *data;
+
+      valent_packet_init (&builder, "kdeconnect.battery");
+      json_builder_set_member_name (builder, "currentCharge");
+      json_builder_add_int_value (builder, current_charge);
+      json_builder_set_member_name (builder, "isCharging");
+      json_builder_add_boolean_value (builder, is_charging);
+      json_builder_set_member_name (builder, "thresholdEvent");
+      json_builder_add_int_value (builder, threshold_event);
+      packet = valent_packet_end (&builder);
+
+      data = valent_packet_serialize (packet);
+      g_clear_pointer (&local_state.bytes, g_bytes_unref);
+      local_state.bytes = g_bytes_new_take (data, strlen (data));
+      local_state.current_charge = current_charge;
+      local_state.is_charging = is_charging;
+      local_state.threshold_event = threshold_event;
+    }
 
-  valent_device_plugin_queue_packet (VALENT_DEVICE_PLUGIN (self), packet);
+  valent_device_plugin_queue_bytes (VALENT_DEVICE_PLUGIN (self),
+                                    "kdeconnect.battery",
+                                    local_state.bytes);
 }
 
-
 /*
  * Remote Battery
  */
@@ -389,24 +416,6 @@ valent_battery_plugin_update_state (ValentDevicePlugin *plugin,
     }
 }
 
-static void
-valent_battery_plugin_handle_packet (ValentDevicePlugin *plugin,
-                                     const char         *type,
-                                     JsonNode           *packet)
-{
-  ValentBatteryPlugin *self = VALENT_BATTERY_PLUGIN (plugin);
-
-  g_assert (VALENT_IS_BATTERY_PLUGIN (self));
-  g_assert (type != NULL);
-  g_assert (VALENT_IS_PACKET (packet));
-
-  /* The remote battery state changed */
-  if (g_str_equal (type, "kdeconnect.battery"))
-    valent_battery_plugin_handle_battery (self, packet);
-  else
-    g_assert_not_reached ();
-}
-
 /*
  * ValentObject
  */
@@ -448,8 +457,11 @@ valent_battery_plugin_class_init (ValentBatteryPluginClass *klass)
 
   vobject_class->destroy = valent_battery_plugin_destroy;
 
-  plugin_class->handle_packet = valent_battery_plugin_handle_packet;
   plugin_class->update_state = valent_battery_plugin_update_state;
+
+  valent_device_plugin_class_install_packet_handler (plugin_class,
+                                                     "kdeconnect.battery",
+                                                     (ValentDevicePluginPacketFunc)valent_battery_plugin_handle_battery);
 }
 
 static void
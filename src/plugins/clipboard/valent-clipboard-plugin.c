@@ -5,12 +5,25 @@
 
 #include "config.h"
 
+#include <string.h>
+
 #include <gio/gio.h>
 #include <json-glib/json-glib.h>
 #include <valent.h>
 
 #include "valent-clipboard-plugin.h"
 
+/* The time in milliseconds to wait for the local clipboard to settle before
+ * reading it, so that a burst of changes results in a single read and packet.
+ */
+#define CLIPBOARD_DEBOUNCE_MS (250)
+
+/* The maximum length of text synchronized automatically. There is no way to
+ * transfer clipboard content as a payload, so it is always sent inline in the
+ * packet; larger content can still be sent explicitly with `clipboard.push`.
+ */
+#define CLIPBOARD_MAX_TEXT    (64 * 1024)
+
 
 struct _ValentClipboardPlugin
 {
@@ -18,7 +31,11 @@ struct _ValentClipboardPlugin
 
   ValentClipboard    *clipboard;
   unsigned long       changed_id;
+  unsigned int        debounce_id;
+  GCancellable       *read_cancellable;
 
+  char               *local_checksum;
+  char               *remote_checksum;
   char               *remote_text;
   int64_t             remote_timestamp;
   int64_t             local_timestamp;
@@ -28,6 +45,21 @@ struct _ValentClipboardPlugin
 
 G_DEFINE_FINAL_TYPE (ValentClipboardPlugin, valent_clipboard_plugin, VALENT_TYPE_DEVICE_PLUGIN)
 
+/* The local clipboard is the same for every device, so the packet is
+ * serialized once and shared by every instance of the plugin, keyed by the
+ * checksum of its content */
+static struct
+{
+  GBytes *bytes;
+  char   *checksum;
+} local_content = { NULL, };
+
+
+static inline char *
+valent_clipboard_plugin_checksum (const char *text)
+{
+  return g_compute_checksum_for_string (G_CHECKSUM_SHA256, text, -1);
+}
 
 /*
  * Local Clipboard
@@ -38,18 +70,31 @@ valent_clipboard_plugin_clipboard (ValentClipboardPlugin *self,
 {
   g_autoptr (JsonBuilder) builder = NULL;
   g_autoptr (JsonNode) packet = NULL;
+  char *data;
 
   g_return_if_fail (VALENT_IS_CLIPBOARD_PLUGIN (self));
+  g_return_if_fail (self->local_checksum != NULL);
 
   if (content == NULL)
     return;
 
-  valent_packet_init (&builder, "kdeconnect.clipboard");
-  json_builder_set_member_name (builder, "content");
-  json_builder_add_string_value (builder, content);
-  packet = valent_packet_end (&builder);
+  if (local_content.bytes == NULL ||
+      g_strcmp0 (local_content.checksum, self->local_checksum) != 0)
+    {
+      valent_packet_init (&builder, "kdeconnect.clipboard");
+      json_builder_set_member_name (builder, "content");
+      json_builder_add_string_value (builder, content);
+      packet = valent_packet_end (&builder);
+
+      data = valent_packet_serialize (packet);
+      g_clear_pointer (&local_content.bytes, g_bytes_unref);
+      local_content.bytes = g_bytes_new_take (data, strlen (data));
+      g_set_str (&local_content.checksum, self->local_checksum);
+    }
 
-  valent_device_plugin_queue_packet (VALENT_DEVICE_PLUGIN (self), packet);
+  valent_device_plugin_queue_bytes (VALENT_DEVICE_PLUGIN (self),
+                                    "kdeconnect.clipboard",
+                                    local_content.bytes);
 }
 
 static void
@@ -82,6 +127,7 @@ valent_clipboard_read_text_cb (ValentClipboard       *clipboard,
 {
   g_autoptr (GError) error = NULL;
   g_autofree char *text = NULL;
+  g_autofree char *checksum = NULL;
 
   g_assert (VALENT_IS_CLIPBOARD (clipboard));
   g_assert (VALENT_IS_CLIPBOARD_PLUGIN (self));
@@ -96,10 +142,56 @@ valent_clipboard_read_text_cb (ValentClipboard       *clipboard,
       return;
     }
 
-  /* Skip if the local clipboard is empty, or already synced with the device */
-  if (text == NULL || g_strcmp0 (self->remote_text, text) == 0)
+  if (text == NULL)
     return;
 
+  /* Skip content that would bloat the packet */
+  if (strlen (text) > CLIPBOARD_MAX_TEXT)
+    {
+      g_debug ("%s(): content exceeds %u bytes; not syncing",
+               G_STRFUNC, (unsigned int)CLIPBOARD_MAX_TEXT);
+      return;
+    }
+
+  /* Skip content that was received from the device, or already sent to it */
+  checksum = valent_clipboard_plugin_checksum (text);
+
+  if (g_strcmp0 (self->remote_checksum, checksum) == 0 ||
+      g_strcmp0 (self->local_checksum, checksum) == 0)
+    return;
+
+  g_clear_pointer (&self->local_checksum, g_free);
+  self->local_checksum = g_steal_pointer (&checksum);
+  valent_clipboard_plugin_clipboard (self, text);
+}
+
+static void
+valent_clipboard_read_text_push_cb (ValentClipboard       *clipboard,
+                                    GAsyncResult          *result,
+                                    ValentClipboardPlugin *self)
+{
+  g_autoptr (GError) error = NULL;
+  g_autofree char *text = NULL;
+
+  g_assert (VALENT_IS_CLIPBOARD (clipboard));
+  g_assert (VALENT_IS_CLIPBOARD_PLUGIN (self));
+
+  text = valent_clipboard_read_text_finish (clipboard, result, &error);
+
+  if (error != NULL)
+    {
+      if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        g_debug ("%s(): %s", G_STRFUNC, error->message);
+
+      return;
+    }
+
+  if (text == NULL)
+    return;
+
+  /* An explicit push is always sent, regardless of size or prior syncing */
+  g_clear_pointer (&self->local_checksum, g_free);
+  self->local_checksum = valent_clipboard_plugin_checksum (text);
   valent_clipboard_plugin_clipboard (self, text);
 }
 
@@ -124,9 +216,11 @@ valent_clipboard_read_text_connect_cb (ValentClipboard       *clipboard,
       return;
     }
 
-  if (text == NULL)
+  if (text == NULL || strlen (text) > CLIPBOARD_MAX_TEXT)
     return;
 
+  g_clear_pointer (&self->local_checksum, g_free);
+  self->local_checksum = valent_clipboard_plugin_checksum (text);
   valent_clipboard_plugin_clipboard_connect (self, text, self->local_timestamp);
 }
 
@@ -208,12 +302,32 @@ on_auto_push_changed (GSettings             *settings,
 
 }
 
+static gboolean
+valent_clipboard_plugin_debounce (gpointer data)
+{
+  ValentClipboardPlugin *self = VALENT_CLIPBOARD_PLUGIN (data);
+  g_autoptr (GCancellable) cancellable = NULL;
+
+  g_assert (VALENT_IS_CLIPBOARD_PLUGIN (self));
+
+  self->debounce_id = 0;
+
+  g_clear_object (&self->read_cancellable);
+  self->read_cancellable = g_cancellable_new ();
+  cancellable = valent_object_chain_cancellable (VALENT_OBJECT (self),
+                                                 self->read_cancellable);
+  valent_clipboard_read_text (self->clipboard,
+                              cancellable,
+                              (GAsyncReadyCallback)valent_clipboard_read_text_cb,
+                              self);
+
+  return G_SOURCE_REMOVE;
+}
+
 static void
 on_clipboard_changed (ValentClipboard       *clipboard,
                       ValentClipboardPlugin *self)
 {
-  g_autoptr (GCancellable) destroy = NULL;
-
   g_assert (VALENT_IS_CLIPBOARD (clipboard));
   g_assert (VALENT_IS_CLIPBOARD_PLUGIN (self));
 
@@ -222,11 +336,14 @@ on_clipboard_changed (ValentClipboard       *clipboard,
   if (!self->auto_push)
     return;
 
-  destroy = valent_object_ref_cancellable (VALENT_OBJECT (self));
-  valent_clipboard_read_text (clipboard,
-                              destroy,
-                              (GAsyncReadyCallback)valent_clipboard_read_text_cb,
-                              self);
+  /* Any content being read is already stale */
+  g_cancellable_cancel (self->read_cancellable);
+  g_clear_object (&self->read_cancellable);
+
+  g_clear_handle_id (&self->debounce_id, g_source_remove);
+  self->debounce_id = g_timeout_add (CLIPBOARD_DEBOUNCE_MS,
+                                     valent_clipboard_plugin_debounce,
+                                     self);
 }
 
 /*
@@ -255,6 +372,11 @@ valent_clipboard_plugin_handle_clipboard (ValentClipboardPlugin *self,
   self->remote_text = g_strdup (content);
   self->remote_timestamp = valent_timestamp_ms ();
 
+  /* The device's clipboard no longer holds what was last sent to it */
+  g_clear_pointer (&self->local_checksum, g_free);
+  g_clear_pointer (&self->remote_checksum, g_free);
+  self->remote_checksum = valent_clipboard_plugin_checksum (content);
+
   if (!self->auto_pull)
     return;
 
@@ -297,6 +419,10 @@ valent_clipboard_plugin_handle_clipboard_connect (ValentClipboardPlugin *self,
   self->remote_text = g_strdup (content);
   self->remote_timestamp = timestamp;
 
+  g_clear_pointer (&self->local_checksum, g_free);
+  g_clear_pointer (&self->remote_checksum, g_free);
+  self->remote_checksum = valent_clipboard_plugin_checksum (content);
+
   if (self->remote_timestamp <= self->local_timestamp)
     return;
 
@@ -351,7 +477,7 @@ clipboard_push_action (GSimpleAction *action,
   destroy = valent_object_ref_cancellable (VALENT_OBJECT (self));
   valent_clipboard_read_text (valent_clipboard_get_default (),
                               destroy,
-                              (GAsyncReadyCallback)valent_clipboard_read_text_cb,
+                              (GAsyncReadyCallback)valent_clipboard_read_text_push_cb,
                               self);
 }
 
@@ -399,31 +525,11 @@ valent_clipboard_plugin_update_state (ValentDevicePlugin *plugin,
   else
     {
       g_clear_signal_handler (&self->changed_id, self->clipboard);
+      g_clear_handle_id (&self->debounce_id, g_source_remove);
+      g_clear_pointer (&self->local_checksum, g_free);
     }
 }
 
-static void
-valent_clipboard_plugin_handle_packet (ValentDevicePlugin *plugin,
-                                       const char         *type,
-                                       JsonNode           *packet)
-{
-  ValentClipboardPlugin *self = VALENT_CLIPBOARD_PLUGIN (plugin);
-
-  g_assert (VALENT_IS_DEVICE_PLUGIN (plugin));
-  g_assert (type != NULL);
-  g_assert (VALENT_IS_PACKET (packet));
-
-  /* The remote clipboard content changed */
-  if (g_str_equal (type, "kdeconnect.clipboard"))
-    valent_clipboard_plugin_handle_clipboard (self, packet);
-
-  else if (g_str_equal (type, "kdeconnect.clipboard.connect"))
-    valent_clipboard_plugin_handle_clipboard_connect (self, packet);
-
-  else
-    g_assert_not_reached ();
-}
-
 /*
  * ValentObject
  */
@@ -433,6 +539,7 @@ valent_clipboard_plugin_destroy (ValentObject *object)
   ValentClipboardPlugin *self = VALENT_CLIPBOARD_PLUGIN (object);
 
   g_clear_signal_handler (&self->changed_id, self->clipboard);
+  g_clear_handle_id (&self->debounce_id, g_source_remove);
 
   VALENT_OBJECT_CLASS (valent_clipboard_plugin_parent_class)->destroy (object);
 }
@@ -476,6 +583,9 @@ valent_clipboard_plugin_finalize (GObject *object)
 {
   ValentClipboardPlugin *self = VALENT_CLIPBOARD_PLUGIN (object);
 
+  g_clear_object (&self->read_cancellable);
+  g_clear_pointer (&self->local_checksum, g_free);
+  g_clear_pointer (&self->remote_checksum, g_free);
   g_clear_pointer (&self->remote_text, g_free);
 
   G_OBJECT_CLASS (valent_clipboard_plugin_parent_class)->finalize (object);
@@ -493,8 +603,14 @@ valent_clipboard_plugin_class_init (ValentClipboardPluginClass *klass)
 
   vobject_class->destroy = valent_clipboard_plugin_destroy;
 
-  plugin_class->handle_packet = valent_clipboard_plugin_handle_packet;
   plugin_class->update_state = valent_clipboard_plugin_update_state;
+
+  valent_device_plugin_class_install_packet_handler (plugin_class,
+                                                     "kdeconnect.clipboard",
+                                                     (ValentDevicePluginPacketFunc)valent_clipboard_plugin_handle_clipboard);
+  valent_device_plugin_class_install_packet_handler (plugin_class,
+                                                     "kdeconnect.clipboard.connect",
+                                                     (ValentDevicePluginPacketFunc)valent_clipboard_plugin_handle_clipboard_connect);
 }
 
 static void
@@ -96,7 +96,6 @@ valent_connectivity_report_plugin_send_state (ValentConnectivityReportPlugin *se
   valent_device_plugin_queue_packet (VALENT_DEVICE_PLUGIN (self), packet);
 }
 
-
 /*
  * Remote Modems
  */
@@ -362,24 +361,6 @@ valent_connectivity_report_plugin_update_state (ValentDevicePlugin *plugin,
     }
 }
 
-static void
-valent_connectivity_report_plugin_handle_packet (ValentDevicePlugin *plugin,
-                                                 const char         *type,
-                                                 JsonNode           *packet)
-{
-  ValentConnectivityReportPlugin *self = VALENT_CONNECTIVITY_REPORT_PLUGIN (plugin);
-
-  g_assert (VALENT_IS_CONNECTIVITY_REPORT_PLUGIN (self));
-  g_assert (type != NULL);
-  g_assert (VALENT_IS_PACKET (packet));
-
-  /* A remote connectivity report */
-  if (g_str_equal (type, "kdeconnect.connectivity_report"))
-    valent_connectivity_report_plugin_handle_connectivity_report (self, packet);
-  else
-    g_assert_not_reached ();
-}
-
 /*
  * ValentObject
  */
@@ -420,8 +401,11 @@ valent_connectivity_report_plugin_class_init (ValentConnectivityReportPluginClas
 
   vobject_class->destroy = valent_connectivity_report_plugin_destroy;
 
-  plugin_class->handle_packet = valent_connectivity_report_plugin_handle_packet;
   plugin_class->update_state = valent_connectivity_report_plugin_update_state;
+
+  valent_device_plugin_class_install_packet_handler (plugin_class,
+                                                     "kdeconnect.connectivity_report",
+                                                     (ValentDevicePluginPacketFunc)valent_connectivity_report_plugin_handle_connectivity_report);
 }
 
 static void
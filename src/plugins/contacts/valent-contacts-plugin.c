@@ -11,6 +11,9 @@
 
 #include "valent-contacts-plugin.h"
 
+/* The number of contacts added to the store in each batch */
+#define CONTACTS_BATCH_SIZE (100)
+
 
 struct _ValentContactsPlugin
 {
@@ -278,45 +281,153 @@ valent_contact_store_add_contacts_cb (ValentContactStore *store,
     g_warning ("%s(): %s", G_STRFUNC, error->message);
 }
 
+/*
+ * vCards are read from the stream as they arrive and added to the store in
+ * batches, with the next batch read only once the previous one is committed.
+ */
+typedef struct
+{
+  ValentContactsPlugin *plugin;
+  ValentPacketStream   *stream;
+  GCancellable         *cancellable;
+  GSList               *batch;
+  unsigned int          n_batch;
+} VCardsState;
+
 static void
-valent_contact_plugin_handle_response_vcards (ValentContactsPlugin *self,
-                                              JsonNode             *packet)
+vcards_state_free (gpointer data)
 {
-  g_autoslist (EContact) contacts = NULL;
-  JsonObject *body;
-  JsonObjectIter iter;
-  const char *uid;
-  JsonNode *node;
+  VCardsState *state = data;
 
-  g_assert (VALENT_IS_CONTACTS_PLUGIN (self));
+  g_clear_object (&state->plugin);
+  g_clear_object (&state->stream);
+  g_clear_object (&state->cancellable);
+  g_slist_free_full (g_steal_pointer (&state->batch), g_object_unref);
+  g_free (state);
+}
 
-  body = valent_packet_get_body (packet);
-  json_object_iter_init (&iter, body);
+static void   valent_contact_plugin_read_vcards (VCardsState *state);
 
-  while (json_object_iter_next (&iter, &uid, &node))
+static void
+valent_contact_store_add_vcards_cb (ValentContactStore *store,
+                                    GAsyncResult       *result,
+                                    gpointer            user_data)
+{
+  VCardsState *state = user_data;
+  g_autoptr (GError) error = NULL;
+
+  if (!valent_contact_store_add_contacts_finish (store, result, &error))
     {
-      EContact *contact;
-      const char *vcard;
+      if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        g_warning ("%s(): %s", G_STRFUNC, error->message);
 
-      /* NOTE: This has the side-effect of ignoring `uids` array, which is fine
-       *       because the contact members are the ultimate source of truth. */
-      if G_UNLIKELY (json_node_get_value_type (node) != G_TYPE_STRING)
-        continue;
+      vcards_state_free (state);
+      return;
+    }
+
+  valent_contact_plugin_read_vcards (state);
+}
+
+static void
+valent_contact_plugin_flush_vcards (VCardsState *state,
+                                    gboolean     finished)
+{
+  g_autoslist (EContact) contacts = NULL;
 
-      vcard = json_node_get_string (node);
-      contact = e_contact_new_from_vcard_with_uid (vcard, uid);
+  contacts = g_slist_reverse (g_steal_pointer (&state->batch));
+  state->n_batch = 0;
 
-      contacts = g_slist_append (contacts, contact);
+  if (finished)
+    {
+      if (contacts != NULL)
+        {
+          valent_contact_store_add_contacts (state->plugin->remote_store,
+                                             contacts,
+                                             state->cancellable,
+                                             (GAsyncReadyCallback)valent_contact_store_add_contacts_cb,
+                                             NULL);
+        }
+
+      vcards_state_free (state);
+      return;
     }
 
-  if (contacts != NULL)
+  valent_contact_store_add_contacts (state->plugin->remote_store,
+                                     contacts,
+                                     state->cancellable,
+                                     (GAsyncReadyCallback)valent_contact_store_add_vcards_cb,
+                                     state);
+}
+
+static void
+valent_packet_stream_read_vcards_cb (ValentPacketStream *stream,
+                                     GAsyncResult       *result,
+                                     gpointer            user_data)
+{
+  VCardsState *state = user_data;
+  g_autoptr (JsonNode) node = NULL;
+  g_autofree char *uid = NULL;
+  g_autoptr (GError) error = NULL;
+
+  node = valent_packet_stream_read_finish (stream, result, &uid, &error);
+
+  if (error != NULL)
     {
-      valent_contact_store_add_contacts (self->remote_store,
-                                         contacts,
-                                         self->cancellable,
-                                         (GAsyncReadyCallback)valent_contact_store_add_contacts_cb,
-                                         NULL);
+      if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        g_debug ("%s(): %s", G_STRFUNC, error->message);
+
+      vcards_state_free (state);
+      return;
     }
+
+  if (node == NULL)
+    {
+      valent_contact_plugin_flush_vcards (state, TRUE);
+      return;
+    }
+
+  /* NOTE: This has the side-effect of ignoring `uids` array, which is fine
+   *       because the contact members are the ultimate source of truth. */
+  if G_LIKELY (json_node_get_value_type (node) == G_TYPE_STRING)
+    {
+      EContact *contact;
+
+      contact = e_contact_new_from_vcard_with_uid (json_node_get_string (node),
+                                                   uid);
+      state->batch = g_slist_prepend (state->batch, contact);
+      state->n_batch++;
+    }
+
+  if (state->n_batch >= CONTACTS_BATCH_SIZE)
+    valent_contact_plugin_flush_vcards (state, FALSE);
+  else
+    valent_contact_plugin_read_vcards (state);
+}
+
+static void
+valent_contact_plugin_read_vcards (VCardsState *state)
+{
+  valent_packet_stream_read (state->stream,
+                             state->cancellable,
+                             (GAsyncReadyCallback)valent_packet_stream_read_vcards_cb,
+                             state);
+}
+
+static void
+valent_contact_plugin_handle_response_vcards (ValentContactsPlugin *self,
+                                              ValentPacketStream   *stream)
+{
+  VCardsState *state;
+
+  g_assert (VALENT_IS_CONTACTS_PLUGIN (self));
+  g_assert (VALENT_IS_PACKET_STREAM (stream));
+
+  state = g_new0 (VCardsState, 1);
+  state->plugin = g_object_ref (self);
+  state->stream = g_object_ref (stream);
+  state->cancellable = g_object_ref (self->cancellable);
+
+  valent_contact_plugin_read_vcards (state);
 }
 
 static void
@@ -370,37 +481,6 @@ valent_contacts_plugin_update_state (ValentDevicePlugin *plugin,
     valent_contacts_plugin_request_all_uids_timestamps (self);
 }
 
-static void
-valent_contacts_plugin_handle_packet (ValentDevicePlugin *plugin,
-                                      const char         *type,
-                                      JsonNode           *packet)
-{
-  ValentContactsPlugin *self = VALENT_CONTACTS_PLUGIN (plugin);
-
-  g_assert (VALENT_IS_CONTACTS_PLUGIN (plugin));
-  g_assert (type != NULL);
-  g_assert (VALENT_IS_PACKET (packet));
-
-  /* A response to a request for a listing of contacts */
-  if (g_str_equal (type, "kdeconnect.contacts.response_uids_timestamps"))
-    valent_contact_plugin_handle_response_uids_timestamps (self, packet);
-
-  /* A response to a request for contacts */
-  else if (g_str_equal (type, "kdeconnect.contacts.response_vcards"))
-    valent_contact_plugin_handle_response_vcards (self, packet);
-
-  /* A request for a listing of contacts */
-  else if (g_str_equal (type, "kdeconnect.contacts.request_all_uids_timestamps"))
-    valent_contact_plugin_handle_request_all_uids_timestamps (self, packet);
-
-  /* A request for contacts */
-  else if (g_str_equal (type, "kdeconnect.contacts.request_vcards_by_uid"))
-    valent_contact_plugin_handle_request_vcards_by_uid (self, packet);
-
-  else
-    g_assert_not_reached ();
-}
-
 /*
  * ValentObject
  */
@@ -482,8 +562,28 @@ valent_contacts_plugin_class_init (ValentContactsPluginClass *klass)
 
   vobject_class->destroy = valent_contacts_plugin_destroy;
 
-  plugin_class->handle_packet = valent_contacts_plugin_handle_packet;
   plugin_class->update_state = valent_contacts_plugin_update_state;
+
+  /* A request for a listing of contacts */
+  valent_device_plugin_class_install_packet_handler (plugin_class,
+                                                     "kdeconnect.contacts.request_all_uids_timestamps",
+                                                     (ValentDevicePluginPacketFunc)valent_contact_plugin_handle_request_all_uids_timestamps);
+
+  /* A request for contacts */
+  valent_device_plugin_class_install_packet_handler (plugin_class,
+                                                     "kdeconnect.contacts.request_vcards_by_uid",
+                                                     (ValentDevicePluginPacketFunc)valent_contact_plugin_handle_request_vcards_by_uid);
+
+  /* A response to a request for a listing of contacts */
+  valent_device_plugin_class_install_packet_handler (plugin_class,
+                                                     "kdeconnect.contacts.response_uids_timestamps",
+                                                     (ValentDevicePluginPacketFunc)valent_contact_plugin_handle_response_uids_timestamps);
+
+  /* A response to a request for contacts, streamed by body member */
+  valent_device_plugin_class_install_stream_handler (plugin_class,
+                                                     "kdeconnect.contacts.response_vcards",
+                                                     NULL,
+                                                     (ValentDevicePluginStreamFunc)valent_contact_plugin_handle_response_vcards);
 }
 
 static void
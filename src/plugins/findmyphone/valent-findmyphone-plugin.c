@@ -26,9 +26,11 @@ G_DEFINE_FINAL_TYPE (ValentFindmyphonePlugin, valent_findmyphone_plugin, VALENT_
 
 
 static void
-valent_findmyphone_plugin_handle_findmyphone_request (ValentFindmyphonePlugin *self)
+valent_findmyphone_plugin_handle_findmyphone_request (ValentFindmyphonePlugin *self,
+                                                      JsonNode                *packet)
 {
   g_assert (VALENT_IS_FINDMYPHONE_PLUGIN (self));
+  g_assert (VALENT_IS_PACKET (packet));
 
   valent_session_set_locked (self->session, FALSE);
   valent_findmyphone_ringer_toggle (self->ringer, self);
@@ -77,23 +79,6 @@ valent_findmyphone_plugin_update_state (ValentDevicePlugin *plugin,
   valent_extension_toggle_actions (VALENT_EXTENSION (plugin), available);
 }
 
-static void
-valent_findmyphone_plugin_handle_packet (ValentDevicePlugin *plugin,
-                                         const char         *type,
-                                         JsonNode           *packet)
-{
-  ValentFindmyphonePlugin *self = VALENT_FINDMYPHONE_PLUGIN (plugin);
-
-  g_assert (VALENT_IS_FINDMYPHONE_PLUGIN (self));
-  g_assert (type != NULL);
-  g_assert (VALENT_IS_PACKET (packet));
-
-  if (g_str_equal (type, "kdeconnect.findmyphone.request"))
-    valent_findmyphone_plugin_handle_findmyphone_request (self);
-  else
-    g_assert_not_reached ();
-}
-
 /*
  * ValentObject
  */
@@ -149,8 +134,11 @@ valent_findmyphone_plugin_class_init (ValentFindmyphonePluginClass *klass)
 
   vobject_class->destroy = valent_findmyphone_plugin_destroy;
 
-  plugin_class->handle_packet = valent_findmyphone_plugin_handle_packet;
   plugin_class->update_state = valent_findmyphone_plugin_update_state;
+
+  valent_device_plugin_class_install_packet_handler (plugin_class,
+                                                     "kdeconnect.findmyphone.request",
+                                                     (ValentDevicePluginPacketFunc)valent_findmyphone_plugin_handle_findmyphone_request);
 }
 
 static void
@@ -118,7 +118,7 @@ g_input_stream_read_bytes_cb (GInputStream *stream,
   bytes = g_input_stream_read_bytes_finish (stream, result, &error);
 
   if (bytes == NULL)
-    g_task_return_error (task, g_steal_pointer (&error));
+    return g_task_return_error (task, g_steal_pointer (&error));
 
   g_task_return_pointer (task,
                          g_steal_pointer (&bytes),
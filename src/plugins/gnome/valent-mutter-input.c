@@ -424,6 +424,86 @@ valent_mutter_input_pointer_motion (ValentInputAdapter *adapter,
                      NULL, NULL, NULL);
 }
 
+static inline void
+session_send (ValentMutterInput *self,
+              GDBusConnection   *connection,
+              const char        *method_name,
+              GVariant          *parameters)
+{
+  g_autoptr (GDBusMessage) message = NULL;
+  g_autoptr (GError) error = NULL;
+
+  message = g_dbus_message_new_method_call (g_dbus_proxy_get_name (self->session),
+                                            g_dbus_proxy_get_object_path (self->session),
+                                            SESSION_IFACE,
+                                            method_name);
+  g_dbus_message_set_body (message, parameters);
+  g_dbus_message_set_flags (message, G_DBUS_MESSAGE_FLAGS_NO_REPLY_EXPECTED);
+
+  if (!g_dbus_connection_send_message (connection,
+                                       message,
+                                       G_DBUS_SEND_MESSAGE_FLAGS_NONE,
+                                       NULL,
+                                       &error))
+    g_debug ("%s(): %s", G_STRFUNC, error->message);
+}
+
+static void
+valent_mutter_input_submit_events (ValentInputAdapter     *adapter,
+                                   const ValentInputEvent *events,
+                                   unsigned int            n_events)
+{
+  ValentMutterInput *self = VALENT_MUTTER_INPUT (adapter);
+  GDBusConnection *connection;
+
+  g_assert (VALENT_IS_INPUT_ADAPTER (adapter));
+  g_assert (VALENT_IS_MUTTER_INPUT (self));
+
+  if G_UNLIKELY (!valent_mutter_input_check (self))
+    return;
+
+  /* The session has no batch method, so each event is sent as a message that
+   * expects no reply, queued back-to-back on the connection. */
+  connection = g_dbus_proxy_get_connection (self->session);
+
+  for (unsigned int i = 0; i < n_events; i++)
+    {
+      const ValentInputEvent *event = &events[i];
+
+      switch (event->type)
+        {
+        case VALENT_INPUT_EVENT_KEYSYM:
+          session_send (self, connection, "NotifyKeyboardKeysym",
+                        g_variant_new ("(ub)", event->code, event->state));
+          break;
+
+        case VALENT_INPUT_EVENT_POINTER_AXIS:
+          session_send (self, connection, "NotifyPointerAxis",
+                        g_variant_new ("(ddu)", event->dx, event->dy,
+                                       POINTER_AXIS_TOUCH));
+          session_send (self, connection, "NotifyPointerAxis",
+                        g_variant_new ("(ddu)", 0.0, 0.0,
+                                       POINTER_AXIS_FINISH));
+          break;
+
+        case VALENT_INPUT_EVENT_POINTER_BUTTON:
+          session_send (self, connection, "NotifyPointerButton",
+                        g_variant_new ("(ib)",
+                                       (int32_t)translate_to_evdev_button (event->code),
+                                       event->state));
+          break;
+
+        case VALENT_INPUT_EVENT_POINTER_MOTION:
+          session_send (self, connection, "NotifyPointerMotionRelative",
+                        g_variant_new ("(dd)", event->dx, event->dy));
+          break;
+
+        default:
+          g_assert_not_reached ();
+        }
+    }
+}
+
 /*
  * GAsyncInitable
  */
@@ -562,6 +642,7 @@ valent_mutter_input_class_init (ValentMutterInputClass *klass)
   adapter_class->pointer_axis = valent_mutter_input_pointer_axis;
   adapter_class->pointer_button = valent_mutter_input_pointer_button;
   adapter_class->pointer_motion = valent_mutter_input_pointer_motion;
+  adapter_class->submit_events = valent_mutter_input_submit_events;
 }
 
 static void
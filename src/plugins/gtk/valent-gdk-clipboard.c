@@ -90,8 +90,8 @@ gdk_clipboard_read_cb (GdkClipboard *clipboard,
     return g_task_return_error (task, g_steal_pointer (&error));
 
   g_input_stream_read_bytes_async (input,
-                                   G_PRIORITY_DEFAULT,
                                    CLIPBOARD_MAXSIZE,
+                                   G_PRIORITY_DEFAULT,
                                    cancellable,
                                    (GAsyncReadyCallback)g_input_stream_read_bytes_cb,
                                    g_steal_pointer (&task));
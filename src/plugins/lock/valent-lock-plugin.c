@@ -181,25 +181,6 @@ valent_lock_plugin_update_state (ValentDevicePlugin *plugin,
     }
 }
 
-static void
-valent_lock_plugin_handle_packet (ValentDevicePlugin *plugin,
-                                  const char         *type,
-                                  JsonNode           *packet)
-{
-  ValentLockPlugin *self = VALENT_LOCK_PLUGIN (plugin);
-
-  g_assert (VALENT_IS_LOCK_PLUGIN (self));
-  g_assert (type != NULL);
-  g_assert (VALENT_IS_PACKET (packet));
-
-  if (g_str_equal (type, "kdeconnect.lock"))
-    valent_lock_plugin_handle_lock (self, packet);
-  else if (g_str_equal (type, "kdeconnect.lock.request"))
-    valent_lock_plugin_handle_lock_request (self, packet);
-  else
-    g_assert_not_reached ();
-}
-
 /*
  * ValentObject
  */
@@ -243,8 +224,14 @@ valent_lock_plugin_class_init (ValentLockPluginClass *klass)
 
   vobject_class->destroy = valent_lock_plugin_destroy;
 
-  plugin_class->handle_packet = valent_lock_plugin_handle_packet;
   plugin_class->update_state = valent_lock_plugin_update_state;
+
+  valent_device_plugin_class_install_packet_handler (plugin_class,
+                                                     "kdeconnect.lock",
+                                                     (ValentDevicePluginPacketFunc)valent_lock_plugin_handle_lock);
+  valent_device_plugin_class_install_packet_handler (plugin_class,
+                                                     "kdeconnect.lock.request",
+                                                     (ValentDevicePluginPacketFunc)valent_lock_plugin_handle_lock_request);
 }
 
 static void
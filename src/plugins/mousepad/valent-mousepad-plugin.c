@@ -55,21 +55,35 @@ event_to_mask (JsonObject *body)
 }
 
 static inline void
-keyboard_mask (ValentInput  *input,
+keyboard_keysym (GArray   *events,
+                 uint32_t  keysym,
+                 gboolean  state)
+{
+  ValentInputEvent event = {
+    .type = VALENT_INPUT_EVENT_KEYSYM,
+    .code = keysym,
+    .state = state,
+  };
+
+  g_array_append_val (events, event);
+}
+
+static inline void
+keyboard_mask (GArray       *events,
                unsigned int  mask,
                gboolean      lock)
 {
   if (mask & GDK_ALT_MASK)
-    valent_input_keyboard_keysym (input, GDK_KEY_Alt_L, lock);
+    keyboard_keysym (events, GDK_KEY_Alt_L, lock);
 
   if (mask & GDK_CONTROL_MASK)
-    valent_input_keyboard_keysym (input, GDK_KEY_Control_L, lock);
+    keyboard_keysym (events, GDK_KEY_Control_L, lock);
 
   if (mask & GDK_SHIFT_MASK)
-    valent_input_keyboard_keysym (input, GDK_KEY_Shift_L, lock);
+    keyboard_keysym (events, GDK_KEY_Shift_L, lock);
 
   if (mask & GDK_SUPER_MASK)
-    valent_input_keyboard_keysym (input, GDK_KEY_Super_L, lock);
+    keyboard_keysym (events, GDK_KEY_Super_L, lock);
 }
 
 /*
@@ -105,13 +119,18 @@ valent_mousepad_plugin_handle_mousepad_request (ValentMousepadPlugin *self,
   /* Keyboard Event */
   else if (valent_packet_get_string (packet, "key", &key))
     {
+      g_autoptr (GArray) events = NULL;
       GdkModifierType mask;
       const char *next;
       gunichar codepoint;
 
+      /* The whole string is submitted as one batch */
+      events = g_array_sized_new (FALSE, FALSE, sizeof (ValentInputEvent),
+                                  2 * g_utf8_strlen (key, -1) + 8);
+
       /* Lock modifiers */
       if ((mask = event_to_mask (body)) != 0)
-        keyboard_mask (self->input, mask, TRUE);
+        keyboard_mask (events, mask, TRUE);
 
       /* Input each keysym */
       next = key;
@@ -121,15 +140,19 @@ valent_mousepad_plugin_handle_mousepad_request (ValentMousepadPlugin *self,
           uint32_t keysym;
 
           keysym = gdk_unicode_to_keyval (codepoint);
-          valent_input_keyboard_keysym (self->input, keysym, TRUE);
-          valent_input_keyboard_keysym (self->input, keysym, FALSE);
+          keyboard_keysym (events, keysym, TRUE);
+          keyboard_keysym (events, keysym, FALSE);
 
           next = g_utf8_next_char (next);
         }
 
       /* Unlock modifiers */
       if (mask != 0)
-        keyboard_mask (self->input, mask, FALSE);
+        keyboard_mask (events, mask, FALSE);
+
+      valent_input_submit_events (self->input,
+                                  &g_array_index (events, ValentInputEvent, 0),
+                                  events->len);
 
       /* Send ack, if requested */
       if (valent_packet_check_field (packet, "sendAck"))
@@ -137,6 +160,7 @@ valent_mousepad_plugin_handle_mousepad_request (ValentMousepadPlugin *self,
     }
   else if (valent_packet_get_int (packet, "specialKey", &keycode))
     {
+      g_autoptr (GArray) events = NULL;
       GdkModifierType mask;
       uint32_t keyval;
 
@@ -147,17 +171,23 @@ valent_mousepad_plugin_handle_mousepad_request (ValentMousepadPlugin *self,
           return;
         }
 
+      events = g_array_sized_new (FALSE, FALSE, sizeof (ValentInputEvent), 10);
+
       /* Lock modifiers */
       if ((mask = event_to_mask (body)) != 0)
-        keyboard_mask (self->input, mask, TRUE);
+        keyboard_mask (events, mask, TRUE);
 
       /* Input each keysym */
-      valent_input_keyboard_keysym (self->input, keyval, TRUE);
-      valent_input_keyboard_keysym (self->input, keyval, FALSE);
+      keyboard_keysym (events, keyval, TRUE);
+      keyboard_keysym (events, keyval, FALSE);
 
       /* Unlock modifiers */
       if (mask != 0)
-        keyboard_mask (self->input, mask, FALSE);
+        keyboard_mask (events, mask, FALSE);
+
+      valent_input_submit_events (self->input,
+                                  &g_array_index (events, ValentInputEvent, 0),
+                                  events->len);
 
       /* Send ack, if requested */
       if (valent_packet_check_field (packet, "sendAck"))
@@ -498,33 +528,6 @@ valent_mousepad_plugin_update_state (ValentDevicePlugin *plugin,
   valent_mousepad_plugin_toggle_actions (self, available);
 }
 
-static void
-valent_mousepad_plugin_handle_packet (ValentDevicePlugin *plugin,
-                                      const char         *type,
-                                      JsonNode           *packet)
-{
-  ValentMousepadPlugin *self = VALENT_MOUSEPAD_PLUGIN (plugin);
-
-  g_assert (VALENT_IS_MOUSEPAD_PLUGIN (self));
-  g_assert (type != NULL);
-  g_assert (VALENT_IS_PACKET (packet));
-
-  /* A request to simulate input */
-  if (g_str_equal (type, "kdeconnect.mousepad.request"))
-    valent_mousepad_plugin_handle_mousepad_request (self, packet);
-
-  /* A confirmation of input we requested */
-  else if (g_str_equal (type, "kdeconnect.mousepad.echo"))
-    valent_mousepad_plugin_handle_mousepad_echo (self, packet);
-
-  /* The remote keyboard is ready/not ready for input */
-  else if (g_str_equal (type, "kdeconnect.mousepad.keyboardstate"))
-    valent_mousepad_plugin_handle_mousepad_keyboardstate (self, packet);
-
-  else
-    g_assert_not_reached ();
-}
-
 /*
  * ValentObject
  */
@@ -570,8 +573,17 @@ valent_mousepad_plugin_class_init (ValentMousepadPluginClass *klass)
 
   vobject_class->destroy = valent_mousepad_plugin_destroy;
 
-  plugin_class->handle_packet = valent_mousepad_plugin_handle_packet;
   plugin_class->update_state = valent_mousepad_plugin_update_state;
+
+  valent_device_plugin_class_install_packet_handler (plugin_class,
+                                                     "kdeconnect.mousepad.request",
+                                                     (ValentDevicePluginPacketFunc)valent_mousepad_plugin_handle_mousepad_request);
+  valent_device_plugin_class_install_packet_handler (plugin_class,
+                                                     "kdeconnect.mousepad.echo",
+                                                     (ValentDevicePluginPacketFunc)valent_mousepad_plugin_handle_mousepad_echo);
+  valent_device_plugin_class_install_packet_handler (plugin_class,
+                                                     "kdeconnect.mousepad.keyboardstate",
+                                                     (ValentDevicePluginPacketFunc)valent_mousepad_plugin_handle_mousepad_keyboardstate);
 }
 
 static void
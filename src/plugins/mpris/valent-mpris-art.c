@@ -0,0 +1,433 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#define G_LOG_DOMAIN "valent-mpris-art"
+
+#include "config.h"
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <gio/gio.h>
+#include <valent.h>
+
+#include "valent-mpris-art.h"
+
+/* Album art is scaled to fit ART_SIZE before it is sent, and each cache is
+ * trimmed to its byte budget, evicting the least recently used files first.
+ */
+#define ART_SIZE            (512)
+#define ART_QUALITY         "90"
+#define LOCAL_CACHE_BUDGET  (16 * 1024 * 1024)
+#define REMOTE_CACHE_BUDGET (16 * 1024 * 1024)
+#define PREPARED_MAX        (256)
+
+G_LOCK_DEFINE_STATIC (prepared);
+static GHashTable *prepared = NULL;
+
+
+static ValentContext *
+valent_mpris_art_get_context (void)
+{
+  static ValentContext *context = NULL;
+
+  if (g_once_init_enter (&context))
+    g_once_init_leave (&context, valent_context_new (NULL, "plugin", "mpris"));
+
+  return context;
+}
+
+static int
+sort_by_modified (gconstpointer a,
+                  gconstpointer b)
+{
+  GFileInfo *info1 = *((GFileInfo **)a);
+  GFileInfo *info2 = *((GFileInfo **)b);
+  uint64_t time1, time2;
+
+  time1 = g_file_info_get_attribute_uint64 (info1, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+  time2 = g_file_info_get_attribute_uint64 (info2, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+
+  /* Most recently used first */
+  return (time1 < time2) - (time1 > time2);
+}
+
+static void
+valent_mpris_art_trim (GFile        *directory,
+                       goffset       budget,
+                       GCancellable *cancellable)
+{
+  g_autoptr (GFileEnumerator) iter = NULL;
+  g_autoptr (GPtrArray) infos = NULL;
+  g_autoptr (GError) error = NULL;
+  goffset total = 0;
+
+  iter = g_file_enumerate_children (directory,
+                                    G_FILE_ATTRIBUTE_STANDARD_NAME","
+                                    G_FILE_ATTRIBUTE_STANDARD_SIZE","
+                                    G_FILE_ATTRIBUTE_STANDARD_TYPE","
+                                    G_FILE_ATTRIBUTE_TIME_MODIFIED,
+                                    G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                    cancellable,
+                                    &error);
+
+  if (iter == NULL)
+    {
+      if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+        g_debug ("%s(): %s", G_STRFUNC, error->message);
+      return;
+    }
+
+  infos = g_ptr_array_new_with_free_func (g_object_unref);
+
+  while (TRUE)
+    {
+      GFileInfo *info = NULL;
+
+      if (!g_file_enumerator_iterate (iter, &info, NULL, cancellable, &error))
+        {
+          g_debug ("%s(): %s", G_STRFUNC, error->message);
+          return;
+        }
+
+      if (info == NULL)
+        break;
+
+      if (g_file_info_get_file_type (info) == G_FILE_TYPE_REGULAR)
+        g_ptr_array_add (infos, g_object_ref (info));
+    }
+
+  g_ptr_array_sort (infos, sort_by_modified);
+
+  for (unsigned int i = 0; i < infos->len; i++)
+    {
+      GFileInfo *info = g_ptr_array_index (infos, i);
+      g_autoptr (GFile) file = NULL;
+
+      total += g_file_info_get_size (info);
+
+      if (total <= budget)
+        continue;
+
+      file = g_file_get_child (directory, g_file_info_get_name (info));
+
+      if (!g_file_delete (file, cancellable, &error))
+        {
+          g_debug ("%s(): %s", G_STRFUNC, error->message);
+          g_clear_error (&error);
+        }
+    }
+}
+
+static void
+valent_mpris_art_touch (GFile *file)
+{
+  g_autoptr (GError) error = NULL;
+  uint64_t now = g_get_real_time () / G_TIME_SPAN_SECOND;
+
+  if (!g_file_set_attribute_uint64 (file,
+                                    G_FILE_ATTRIBUTE_TIME_MODIFIED,
+                                    now,
+                                    G_FILE_QUERY_INFO_NONE,
+                                    NULL,
+                                    &error))
+    g_debug ("%s(): %s", G_STRFUNC, error->message);
+}
+
+static void
+valent_mpris_art_remember (const char *uri,
+                           GFile      *file)
+{
+  G_LOCK (prepared);
+  if (prepared == NULL)
+    prepared = g_hash_table_new_full (g_str_hash,
+                                      g_str_equal,
+                                      g_free,
+                                      g_object_unref);
+
+  /* A playlist's worth of tracks is plenty; start over rather than track age */
+  if (g_hash_table_size (prepared) >= PREPARED_MAX)
+    g_hash_table_remove_all (prepared);
+
+  g_hash_table_replace (prepared, g_strdup (uri), g_object_ref (file));
+  G_UNLOCK (prepared);
+}
+
+static void
+on_size_prepared (GdkPixbufLoader *loader,
+                  int              width,
+                  int              height,
+                  gpointer         user_data)
+{
+  double scale;
+
+  if (width <= ART_SIZE && height <= ART_SIZE)
+    return;
+
+  scale = (double)ART_SIZE / MAX (width, height);
+  gdk_pixbuf_loader_set_size (loader,
+                              MAX (width * scale, 1),
+                              MAX (height * scale, 1));
+}
+
+static void
+valent_mpris_art_prepare_task (GTask        *task,
+                               gpointer      source_object,
+                               gpointer      task_data,
+                               GCancellable *cancellable)
+{
+  const char *uri = task_data;
+  g_autoptr (GFile) source = NULL;
+  g_autoptr (GBytes) bytes = NULL;
+  g_autoptr (GdkPixbufLoader) loader = NULL;
+  GdkPixbuf *pixbuf = NULL;
+  g_autofree char *data = NULL;
+  size_t size = 0;
+  const char *format;
+  g_autofree char *checksum = NULL;
+  g_autofree char *filename = NULL;
+  g_autoptr (GFile) file = NULL;
+  g_autoptr (GFile) directory = NULL;
+  GError *error = NULL;
+
+  if (g_task_return_error_if_cancelled (task))
+    return;
+
+  source = g_file_new_for_uri (uri);
+  bytes = g_file_load_bytes (source, cancellable, NULL, &error);
+
+  if (bytes == NULL)
+    {
+      if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        valent_mpris_art_remember (uri, source);
+
+      return g_task_return_error (task, error);
+    }
+
+  /* Decode, scaling down during the decode if necessary */
+  loader = gdk_pixbuf_loader_new ();
+  g_signal_connect (loader,
+                    "size-prepared",
+                    G_CALLBACK (on_size_prepared),
+                    NULL);
+
+  if (!gdk_pixbuf_loader_write_bytes (loader, bytes, &error) ||
+      !gdk_pixbuf_loader_close (loader, &error))
+    {
+      valent_mpris_art_remember (uri, source);
+      return g_task_return_error (task, error);
+    }
+
+  if ((pixbuf = gdk_pixbuf_loader_get_pixbuf (loader)) == NULL)
+    {
+      valent_mpris_art_remember (uri, source);
+      return g_task_return_new_error (task,
+                                      G_IO_ERROR,
+                                      G_IO_ERROR_INVALID_DATA,
+                                      "Failed to decode album art");
+    }
+
+  /* Re-encode, then store the result by its content hash */
+  if (gdk_pixbuf_get_has_alpha (pixbuf))
+    {
+      format = "png";
+      gdk_pixbuf_save_to_buffer (pixbuf, &data, &size, format, &error, NULL);
+    }
+  else
+    {
+      format = "jpeg";
+      gdk_pixbuf_save_to_buffer (pixbuf, &data, &size, format, &error,
+                                 "quality", ART_QUALITY,
+                                 NULL);
+    }
+
+  if (error != NULL)
+    {
+      valent_mpris_art_remember (uri, source);
+      return g_task_return_error (task, error);
+    }
+
+  checksum = g_compute_checksum_for_data (G_CHECKSUM_SHA256,
+                                          (const guchar *)data,
+                                          size);
+  filename = g_strdup_printf ("%s.%s", checksum, format);
+  file = valent_context_get_cache_file (valent_mpris_art_get_context (),
+                                        filename);
+
+  if (g_file_query_exists (file, cancellable))
+    {
+      valent_mpris_art_touch (file);
+    }
+  else if (!g_file_replace_contents (file,
+                                     data,
+                                     size,
+                                     NULL,
+                                     FALSE,
+                                     G_FILE_CREATE_REPLACE_DESTINATION,
+                                     NULL,
+                                     cancellable,
+                                     &error))
+    {
+      return g_task_return_error (task, error);
+    }
+
+  valent_mpris_art_remember (uri, file);
+
+  directory = g_file_get_parent (file);
+  valent_mpris_art_trim (directory, LOCAL_CACHE_BUDGET, cancellable);
+
+  g_task_return_pointer (task, g_steal_pointer (&file), g_object_unref);
+}
+
+/**
+ * valent_mpris_art_prepare:
+ * @uri: the URI of the album art
+ * @cancellable: (nullable): a `GCancellable`
+ * @callback: (scope async): a `GAsyncReadyCallback`
+ * @user_data: user supplied data
+ *
+ * Prepare the album art at @uri to be sent to a device.
+ *
+ * The image is decoded and scaled down in a thread, then saved to a shared
+ * cache file named by the hash of its content. Tracks that share album art
+ * will share the same file, and so the same URI when offered to a device.
+ *
+ * If the image can not be decoded, the original file is used instead.
+ */
+void
+valent_mpris_art_prepare (const char          *uri,
+                          GCancellable        *cancellable,
+                          GAsyncReadyCallback  callback,
+                          gpointer             user_data)
+{
+  g_autoptr (GTask) task = NULL;
+
+  g_return_if_fail (uri != NULL && *uri != '\0');
+  g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+
+  task = g_task_new (NULL, cancellable, callback, user_data);
+  g_task_set_source_tag (task, valent_mpris_art_prepare);
+  g_task_set_task_data (task, g_strdup (uri), g_free);
+  g_task_run_in_thread (task, valent_mpris_art_prepare_task);
+}
+
+/**
+ * valent_mpris_art_prepare_finish:
+ * @result: a `GAsyncResult`
+ * @error: (nullable): a `GError`
+ *
+ * Finish an operation started by [func@Valent.mpris_art_prepare].
+ *
+ * Returns: (transfer full) (nullable): the prepared file
+ */
+GFile *
+valent_mpris_art_prepare_finish (GAsyncResult  *result,
+                                 GError       **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, NULL), NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+/**
+ * valent_mpris_art_lookup:
+ * @uri: the URI of the album art
+ *
+ * Get the file prepared for the album art at @uri, if available.
+ *
+ * Returns: (transfer full) (nullable): a `GFile`
+ */
+GFile *
+valent_mpris_art_lookup (const char *uri)
+{
+  GFile *file = NULL;
+
+  g_return_val_if_fail (uri != NULL, NULL);
+
+  G_LOCK (prepared);
+  if (prepared != NULL && (file = g_hash_table_lookup (prepared, uri)) != NULL)
+    g_object_ref (file);
+  G_UNLOCK (prepared);
+
+  return file;
+}
+
+/**
+ * valent_mpris_art_get_cache_file:
+ * @device: a `ValentDevice`
+ * @url: the URL of the album art, as sent by @device
+ *
+ * Get the cache file for album art received from @device.
+ *
+ * Returns: (transfer full): a `GFile`
+ */
+GFile *
+valent_mpris_art_get_cache_file (ValentDevice *device,
+                                 const char   *url)
+{
+  g_autoptr (ValentContext) context = NULL;
+  g_autofree char *filename = NULL;
+
+  g_return_val_if_fail (VALENT_IS_DEVICE (device), NULL);
+  g_return_val_if_fail (url != NULL && *url != '\0', NULL);
+
+  context = valent_context_new (valent_device_get_context (device),
+                                "plugin",
+                                "mpris");
+  filename = g_compute_checksum_for_string (G_CHECKSUM_MD5, url, -1);
+
+  return valent_context_get_cache_file (context, filename);
+}
+
+/**
+ * valent_mpris_art_cache_lookup:
+ * @file: a `GFile`
+ *
+ * Check if @file is in the cache, and mark it as recently used if so.
+ *
+ * Returns: %TRUE if cached, or %FALSE if not
+ */
+gboolean
+valent_mpris_art_cache_lookup (GFile *file)
+{
+  g_return_val_if_fail (G_IS_FILE (file), FALSE);
+
+  if (!g_file_query_exists (file, NULL))
+    return FALSE;
+
+  valent_mpris_art_touch (file);
+
+  return TRUE;
+}
+
+static void
+valent_mpris_art_cache_add_task (GTask        *task,
+                                 gpointer      source_object,
+                                 gpointer      task_data,
+                                 GCancellable *cancellable)
+{
+  GFile *directory = G_FILE (task_data);
+
+  valent_mpris_art_trim (directory, REMOTE_CACHE_BUDGET, cancellable);
+  g_task_return_boolean (task, TRUE);
+}
+
+/**
+ * valent_mpris_art_cache_add:
+ * @file: a `GFile`
+ *
+ * Record that @file has been added to the cache. This may evict the least
+ * recently used files in the same directory, to keep it within its budget.
+ */
+void
+valent_mpris_art_cache_add (GFile *file)
+{
+  g_autoptr (GTask) task = NULL;
+
+  g_return_if_fail (G_IS_FILE (file));
+
+  task = g_task_new (NULL, NULL, NULL, NULL);
+  g_task_set_source_tag (task, valent_mpris_art_cache_add);
+  g_task_set_task_data (task, g_file_get_parent (file), g_object_unref);
+  g_task_run_in_thread (task, valent_mpris_art_cache_add_task);
+}
+
@@ -0,0 +1,24 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#pragma once
+
+#include <gio/gio.h>
+#include <valent.h>
+
+G_BEGIN_DECLS
+
+void     valent_mpris_art_prepare        (const char           *uri,
+                                          GCancellable         *cancellable,
+                                          GAsyncReadyCallback   callback,
+                                          gpointer              user_data);
+GFile  * valent_mpris_art_prepare_finish (GAsyncResult         *result,
+                                          GError              **error);
+GFile  * valent_mpris_art_lookup         (const char           *uri);
+GFile  * valent_mpris_art_get_cache_file (ValentDevice         *device,
+                                          const char           *url);
+gboolean valent_mpris_art_cache_lookup   (GFile                *file);
+void     valent_mpris_art_cache_add      (GFile                *file);
+
+G_END_DECLS
+
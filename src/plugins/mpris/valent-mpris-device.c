@@ -10,6 +10,7 @@
 #include <gio/gio.h>
 #include <valent.h>
 
+#include "valent-mpris-art.h"
 #include "valent-mpris-device.h"
 #include "valent-mpris-utils.h"
 
@@ -322,20 +323,16 @@ valent_mpris_device_request_album_art (ValentMprisDevice *self,
 {
   g_autoptr (JsonBuilder) builder = NULL;
   g_autoptr (JsonNode) packet = NULL;
-  ValentContext *context = NULL;
   g_autoptr (GFile) file = NULL;
-  g_autofree char *filename = NULL;
 
   g_assert (VALENT_IS_MPRIS_DEVICE (self));
   g_assert (url != NULL && *url != '\0');
   g_assert (metadata != NULL);
 
-  context = valent_device_get_context (self->device);
-  filename = g_compute_checksum_for_string (G_CHECKSUM_MD5, url, -1);
-  file = valent_context_get_cache_file (context, filename);
+  file = valent_mpris_art_get_cache_file (self->device, url);
 
   /* If the album art has been cached, update the metadata dictionary */
-  if (g_file_query_exists (file, NULL))
+  if (valent_mpris_art_cache_lookup (file))
     {
       g_autofree char *art_url = NULL;
 
@@ -606,6 +603,7 @@ void
 valent_mpris_device_handle_packet (ValentMprisDevice  *player,
                                    JsonNode           *packet)
 {
+  JsonObject *body;
   const char *url;
   ValentMediaActions flags = VALENT_MEDIA_ACTION_NONE;
   GVariantDict metadata;
@@ -616,51 +614,75 @@ valent_mpris_device_handle_packet (ValentMprisDevice  *player,
   gboolean is_playing;
   int64_t volume;
 
-  /* Flags (available actions) */
-  if (valent_packet_check_field (packet, "canGoNext"))
-    flags |= VALENT_MEDIA_ACTION_NEXT;
+  body = valent_packet_get_body (packet);
 
-  if (valent_packet_check_field (packet, "canGoPrevious"))
-    flags |= VALENT_MEDIA_ACTION_PREVIOUS;
+  /* Flags (available actions)
+   *
+   * Updates may only include the fields that changed, but flags are always
+   * sent together, so they are only rebuilt if any are present.
+   */
+  if (json_object_has_member (body, "canGoNext") ||
+      json_object_has_member (body, "canGoPrevious") ||
+      json_object_has_member (body, "canPause") ||
+      json_object_has_member (body, "canPlay") ||
+      json_object_has_member (body, "canSeek"))
+    {
+      if (valent_packet_check_field (packet, "canGoNext"))
+        flags |= VALENT_MEDIA_ACTION_NEXT;
 
-  if (valent_packet_check_field (packet, "canPause"))
-    flags |= VALENT_MEDIA_ACTION_PAUSE;
+      if (valent_packet_check_field (packet, "canGoPrevious"))
+        flags |= VALENT_MEDIA_ACTION_PREVIOUS;
 
-  if (valent_packet_check_field (packet, "canPlay"))
-    flags |= VALENT_MEDIA_ACTION_PLAY;
+      if (valent_packet_check_field (packet, "canPause"))
+        flags |= VALENT_MEDIA_ACTION_PAUSE;
 
-  if (valent_packet_check_field (packet, "canSeek"))
-    flags |= VALENT_MEDIA_ACTION_SEEK;
+      if (valent_packet_check_field (packet, "canPlay"))
+        flags |= VALENT_MEDIA_ACTION_PLAY;
 
-  valent_mpris_device_update_flags (player, flags);
+      if (valent_packet_check_field (packet, "canSeek"))
+        flags |= VALENT_MEDIA_ACTION_SEEK;
 
-  /* Metadata */
-  g_variant_dict_init (&metadata, NULL);
+      valent_mpris_device_update_flags (player, flags);
+    }
 
-  if (valent_packet_get_string (packet, "artist", &artist))
+  /* Metadata
+   *
+   * Like flags, metadata is sent as a group. Cleared fields are sent as empty
+   * strings, which are ignored when rebuilding the dictionary.
+   */
+  if (json_object_has_member (body, "artist") ||
+      json_object_has_member (body, "title") ||
+      json_object_has_member (body, "album") ||
+      json_object_has_member (body, "length") ||
+      json_object_has_member (body, "albumArtUrl"))
     {
-      g_auto (GStrv) artists = NULL;
-      GVariant *value;
+      g_variant_dict_init (&metadata, NULL);
 
-      artists = g_strsplit (artist, ",", -1);
-      value = g_variant_new_strv ((const char * const *)artists, -1);
-      g_variant_dict_insert_value (&metadata, "xesam:artist", value);
-    }
+      if (valent_packet_get_string (packet, "artist", &artist))
+        {
+          g_auto (GStrv) artists = NULL;
+          GVariant *value;
 
-  if (valent_packet_get_string (packet, "title", &title))
-    g_variant_dict_insert (&metadata, "xesam:title", "s", title);
+          artists = g_strsplit (artist, ",", -1);
+          value = g_variant_new_strv ((const char * const *)artists, -1);
+          g_variant_dict_insert_value (&metadata, "xesam:artist", value);
+        }
 
-  if (valent_packet_get_string (packet, "album", &album))
-    g_variant_dict_insert (&metadata, "xesam:album", "s", album);
+      if (valent_packet_get_string (packet, "title", &title))
+        g_variant_dict_insert (&metadata, "xesam:title", "s", title);
 
-  /* Convert milliseconds to microseconds */
-  if (valent_packet_get_int (packet, "length", &length))
-    g_variant_dict_insert (&metadata, "mpris:length", "x", length * 1000L);
+      if (valent_packet_get_string (packet, "album", &album))
+        g_variant_dict_insert (&metadata, "xesam:album", "s", album);
 
-  if (valent_packet_get_string (packet, "albumArtUrl", &url))
-    valent_mpris_device_request_album_art (player, url, &metadata);
+      /* Convert milliseconds to microseconds */
+      if (valent_packet_get_int (packet, "length", &length) && length > 0)
+        g_variant_dict_insert (&metadata, "mpris:length", "x", length * 1000L);
 
-  valent_mpris_device_update_metadata (player, g_variant_dict_end (&metadata));
+      if (valent_packet_get_string (packet, "albumArtUrl", &url))
+        valent_mpris_device_request_album_art (player, url, &metadata);
+
+      valent_mpris_device_update_metadata (player, g_variant_dict_end (&metadata));
+    }
 
   /* Playback Status */
   if (valent_packet_get_int (packet, "pos", &position))
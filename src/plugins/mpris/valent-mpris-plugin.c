@@ -6,16 +6,59 @@
 #include "config.h"
 
 #include <math.h>
+#include <string.h>
 
 #include <glib/gi18n.h>
 #include <gio/gio.h>
 #include <json-glib/json-glib.h>
 #include <valent.h>
 
+#include "valent-mpris-art.h"
 #include "valent-mpris-device.h"
 #include "valent-mpris-plugin.h"
 #include "valent-mpris-utils.h"
 
+/* Position updates are extrapolated by the remote device while playing, so
+ * they are only sent when the local position drifts from that estimate, and
+ * never more often than POSITION_INTERVAL unless accompanied by other state.
+ */
+#define POSITION_INTERVAL  (500 * G_TIME_SPAN_MILLISECOND)
+#define POSITION_TOLERANCE (250)
+
+
+typedef struct
+{
+  JsonObject *fields;
+  int64_t     position;
+  int64_t     position_time;
+  gboolean    playing;
+} PlayerState;
+
+static void
+player_state_free (gpointer data)
+{
+  PlayerState *state = data;
+
+  g_clear_pointer (&state->fields, json_object_unref);
+  g_free (state);
+}
+
+static const char * const flag_fields[] = {
+  "canPause",
+  "canPlay",
+  "canGoNext",
+  "canGoPrevious",
+  "canSeek",
+};
+
+static const char * const metadata_fields[] = {
+  "artist",
+  "title",
+  "album",
+  "length",
+  "albumArtUrl",
+};
+
 
 struct _ValentMprisPlugin
 {
@@ -26,17 +69,30 @@ struct _ValentMprisPlugin
 
   GPtrArray          *players;
   GHashTable         *transfers;
+  GHashTable         *preparing;
 
   GHashTable         *pending;
+  GHashTable         *states;
   unsigned int        flush_id;
 };
 
 G_DEFINE_FINAL_TYPE (ValentMprisPlugin, valent_mpris_plugin, VALENT_TYPE_DEVICE_PLUGIN)
 
+/* The list of local players is the same for every device, so the packet is
+ * serialized once and shared by every instance of the plugin */
+static struct
+{
+  GBytes  *bytes;
+  GStrv    names;
+} local_players = { NULL, };
+
 static void valent_mpris_plugin_send_player_info    (ValentMprisPlugin *self,
                                                      ValentMediaPlayer *player,
                                                      gboolean           now_playing,
                                                      gboolean           volume);
+static gboolean valent_mpris_plugin_send_player_delta (ValentMprisPlugin *self,
+                                                     ValentMediaPlayer *player,
+                                                     int64_t           *delay);
 static void valent_mpris_plugin_send_player_list    (ValentMprisPlugin *self);
 
 
@@ -62,7 +118,6 @@ _valent_media_lookup_player (ValentMedia *media,
   return NULL;
 }
 
-
 /*
  * Local Players
  */
@@ -112,11 +167,11 @@ valent_mpris_plugin_send_album_art (ValentMprisPlugin *self,
       return;
     }
 
-  /* Compare normalized URLs */
+  /* Compare normalized URLs, against the file prepared for the track */
   requested_file = g_file_new_for_uri (requested_uri);
-  real_file = g_file_new_for_uri (real_uri);
+  real_file = valent_mpris_art_lookup (real_uri);
 
-  if (!g_file_equal (requested_file, real_file))
+  if (real_file == NULL || !g_file_equal (requested_file, real_file))
     {
       g_warning ("Album art request \"%s\" doesn't match current track \"%s\"",
                  requested_uri, real_uri);
@@ -153,41 +208,26 @@ valent_mpris_plugin_flush (gpointer data)
   ValentMprisPlugin *self = VALENT_MPRIS_PLUGIN (data);
   GHashTableIter iter;
   ValentMediaPlayer *player;
+  int64_t delay = G_MAXINT64;
 
   g_hash_table_iter_init (&iter, self->pending);
   while (g_hash_table_iter_next (&iter, (void **)&player, NULL))
     {
-      valent_mpris_plugin_send_player_info (self, player, TRUE, TRUE);
-      g_hash_table_iter_remove (&iter);
+      /* A player is left pending if its position update was deferred */
+      if (valent_mpris_plugin_send_player_delta (self, player, &delay))
+        g_hash_table_iter_remove (&iter);
     }
 
   self->flush_id = 0;
 
-  return G_SOURCE_REMOVE;
-}
-
-static void
-on_player_seeked (ValentMediaPlayer *player,
-                  double             position,
-                  ValentMprisPlugin *self)
-{
-  const char *name;
-  g_autoptr (JsonBuilder) builder = NULL;
-  g_autoptr (JsonNode) packet = NULL;
-
-  g_assert (VALENT_IS_MPRIS_PLUGIN (self));
-
-  name = valent_media_player_get_name (player);
-
-  /* Convert seconds to milliseconds */
-  valent_packet_init (&builder, "kdeconnect.mpris");
-  json_builder_set_member_name (builder, "player");
-  json_builder_add_string_value (builder, name);
-  json_builder_set_member_name (builder, "pos");
-  json_builder_add_int_value (builder, position * 1000L);
-  packet = valent_packet_end (&builder);
+  if (g_hash_table_size (self->pending) > 0)
+    {
+      self->flush_id = g_timeout_add (MAX (delay / 1000, 1),
+                                      valent_mpris_plugin_flush,
+                                      self);
+    }
 
-  valent_device_plugin_queue_packet (VALENT_DEVICE_PLUGIN (self), packet);
+  return G_SOURCE_REMOVE;
 }
 
 static void
@@ -197,19 +237,13 @@ on_player_changed (ValentMediaPlayer *player,
 {
   g_assert (VALENT_IS_MPRIS_PLUGIN (self));
 
-  if (g_str_equal (pspec->name, "position"))
-    {
-      double position = 0.0;
+  g_hash_table_add (self->pending, player);
 
-      position = valent_media_player_get_position (player);
-      on_player_seeked (player, position, self);
-    }
-  else
+  /* Other state changes are not held back by a deferred position update */
+  if (self->flush_id == 0 || !g_str_equal (pspec->name, "position"))
     {
-      g_hash_table_add (self->pending, player);
-
-      if (self->flush_id == 0)
-        self->flush_id = g_idle_add (valent_mpris_plugin_flush, self);
+      g_clear_handle_id (&self->flush_id, g_source_remove);
+      self->flush_id = g_idle_add (valent_mpris_plugin_flush, self);
     }
 }
 
@@ -226,6 +260,7 @@ on_players_changed (ValentMedia       *media,
     {
       changed = TRUE;
       g_hash_table_remove_all (self->pending);
+      g_hash_table_remove_all (self->states);
     }
 
   for (unsigned int i = 0; i < added; i++)
@@ -359,68 +394,105 @@ valent_mpris_plugin_handle_mpris_request (ValentMprisPlugin *self,
 }
 
 static void
-valent_mpris_plugin_send_player_info (ValentMprisPlugin *self,
-                                      ValentMediaPlayer *player,
-                                      gboolean           request_now_playing,
-                                      gboolean           request_volume)
+valent_mpris_art_prepare_cb (GObject      *object,
+                             GAsyncResult *result,
+                             gpointer      user_data)
 {
-  const char *name;
-  g_autoptr (JsonBuilder) builder = NULL;
-  g_autoptr (JsonNode) response = NULL;
+  g_autoptr (ValentMprisPlugin) self = VALENT_MPRIS_PLUGIN (user_data);
+  g_autoptr (GFile) file = NULL;
+  g_autoptr (GError) error = NULL;
+  GHashTableIter iter;
+  ValentMediaPlayer *player;
 
-  g_assert (VALENT_IS_MPRIS_PLUGIN (self));
-  g_assert (VALENT_IS_MEDIA_PLAYER (player));
+  file = valent_mpris_art_prepare_finish (result, &error);
 
-  /* Start the packet */
-  valent_packet_init (&builder, "kdeconnect.mpris");
+  if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    return;
 
-  name = valent_media_player_get_name (player);
-  json_builder_set_member_name (builder, "player");
-  json_builder_add_string_value (builder, name);
+  if (error != NULL)
+    g_debug ("%s(): %s", G_STRFUNC, error->message);
+
+  g_hash_table_remove (self->preparing,
+                       g_task_get_task_data (G_TASK (result)));
+
+  /* Any player may be showing this art, so let the deltas sort it out */
+  g_hash_table_iter_init (&iter, self->states);
+  while (g_hash_table_iter_next (&iter, (void **)&player, NULL))
+    g_hash_table_add (self->pending, player);
+
+  if (self->flush_id == 0 && g_hash_table_size (self->pending) > 0)
+    self->flush_id = g_idle_add (valent_mpris_plugin_flush, self);
+}
+
+/*
+ * Get the URI to offer for the album art at @art_url. Art is offered once it
+ * has been scaled and cached by content, so that tracks sharing album art
+ * share a URI and the device only requests it once.
+ */
+static char *
+valent_mpris_plugin_get_album_art (ValentMprisPlugin *self,
+                                   const char        *art_url)
+{
+  g_autoptr (GFile) file = NULL;
+  g_autoptr (GCancellable) cancellable = NULL;
+
+  if ((file = valent_mpris_art_lookup (art_url)) != NULL)
+    return g_file_get_uri (file);
+
+  if (g_hash_table_contains (self->preparing, art_url))
+    return NULL;
+
+  g_hash_table_add (self->preparing, g_strdup (art_url));
+  cancellable = valent_object_ref_cancellable (VALENT_OBJECT (self));
+  valent_mpris_art_prepare (art_url,
+                            cancellable,
+                            valent_mpris_art_prepare_cb,
+                            g_object_ref (self));
+
+  return NULL;
+}
+
+static void
+valent_mpris_plugin_collect_state (ValentMprisPlugin *self,
+                                   ValentMediaPlayer *player,
+                                   JsonObject        *fields,
+                                   gboolean           now_playing,
+                                   gboolean           volume)
+{
+  g_assert (VALENT_IS_MPRIS_PLUGIN (self));
+  g_assert (VALENT_IS_MEDIA_PLAYER (player));
+  g_assert (fields != NULL);
 
   /* Player State & Metadata */
-  if (request_now_playing)
+  if (now_playing)
     {
       ValentMediaActions flags;
       ValentMediaRepeat repeat;
-      gboolean is_playing;
-      double position;
-      gboolean shuffle;
-      const char *loop_status = "None";
+      ValentMediaState state;
       g_autoptr (GVariant) metadata = NULL;
-      g_autofree char *artist = NULL;
-      const char *title = NULL;
 
       /* Player State */
       flags = valent_media_player_get_flags (player);
-      json_builder_set_member_name (builder, "canPause");
-      json_builder_add_boolean_value (builder, (flags & VALENT_MEDIA_ACTION_PAUSE) != 0);
-      json_builder_set_member_name (builder, "canPlay");
-      json_builder_add_boolean_value (builder, (flags & VALENT_MEDIA_ACTION_PLAY) != 0);
-      json_builder_set_member_name (builder, "canGoNext");
-      json_builder_add_boolean_value (builder, (flags & VALENT_MEDIA_ACTION_NEXT) != 0);
-      json_builder_set_member_name (builder, "canGoPrevious");
-      json_builder_add_boolean_value (builder,(flags & VALENT_MEDIA_ACTION_PREVIOUS) != 0);
-      json_builder_set_member_name (builder, "canSeek");
-      json_builder_add_boolean_value (builder, (flags & VALENT_MEDIA_ACTION_SEEK) != 0);
+      json_object_set_boolean_member (fields, "canPause",
+                                      (flags & VALENT_MEDIA_ACTION_PAUSE) != 0);
+      json_object_set_boolean_member (fields, "canPlay",
+                                      (flags & VALENT_MEDIA_ACTION_PLAY) != 0);
+      json_object_set_boolean_member (fields, "canGoNext",
+                                      (flags & VALENT_MEDIA_ACTION_NEXT) != 0);
+      json_object_set_boolean_member (fields, "canGoPrevious",
+                                      (flags & VALENT_MEDIA_ACTION_PREVIOUS) != 0);
+      json_object_set_boolean_member (fields, "canSeek",
+                                      (flags & VALENT_MEDIA_ACTION_SEEK) != 0);
 
       repeat = valent_media_player_get_repeat (player);
-      loop_status = valent_mpris_repeat_to_string (repeat);
-      json_builder_set_member_name (builder, "loopStatus");
-      json_builder_add_string_value (builder, loop_status);
-
-      shuffle = valent_media_player_get_shuffle (player);
-      json_builder_set_member_name (builder, "shuffle");
-      json_builder_add_boolean_value (builder, shuffle);
+      json_object_set_string_member (fields, "loopStatus",
+                                     valent_mpris_repeat_to_string (repeat));
+      json_object_set_boolean_member (fields, "shuffle",
+                                      valent_media_player_get_shuffle (player));
 
-      is_playing = valent_media_player_get_state (player) == VALENT_MEDIA_STATE_PLAYING;
-      json_builder_set_member_name (builder, "isPlaying");
-      json_builder_add_boolean_value (builder, is_playing);
-
-      /* Convert seconds to milliseconds */
-      position = valent_media_player_get_position (player);
-      json_builder_set_member_name (builder, "pos");
-      json_builder_add_int_value (builder, position * 1000L);
+      state = valent_media_player_get_state (player);
+      json_object_set_boolean_member (fields, "isPlaying",
+                                      state == VALENT_MEDIA_STATE_PLAYING);
 
       /* Track Metadata
        *
@@ -432,74 +504,304 @@ valent_mpris_plugin_send_player_info (ValentMprisPlugin *self,
           int64_t length_us;
           const char *art_url;
           const char *album;
+          const char *title;
 
           if (g_variant_lookup (metadata, "xesam:artist", "^a&s", &artists) &&
               artists[0] != NULL && *artists[0] != '\0')
             {
+              g_autofree char *artist = NULL;
+
               artist = g_strjoinv (", ", (char **)artists);
-              json_builder_set_member_name (builder, "artist");
-              json_builder_add_string_value (builder, artist);
+              json_object_set_string_member (fields, "artist", artist);
             }
 
           if (g_variant_lookup (metadata, "xesam:title", "&s", &title) &&
               *title != '\0')
-            {
-              json_builder_set_member_name (builder, "title");
-              json_builder_add_string_value (builder, title);
-            }
+            json_object_set_string_member (fields, "title", title);
 
           if (g_variant_lookup (metadata, "xesam:album", "&s", &album) &&
               *album != '\0')
-            {
-              json_builder_set_member_name (builder, "album");
-              json_builder_add_string_value (builder, album);
-            }
+            json_object_set_string_member (fields, "album", album);
 
           /* Convert microseconds to milliseconds */
           if (g_variant_lookup (metadata, "mpris:length", "x", &length_us))
-            {
-              json_builder_set_member_name (builder, "length");
-              json_builder_add_int_value (builder, length_us / 1000L);
-            }
+            json_object_set_int_member (fields, "length", length_us / 1000L);
 
-          if (g_variant_lookup (metadata, "mpris:artUrl", "&s", &art_url))
+          if (g_variant_lookup (metadata, "mpris:artUrl", "&s", &art_url) &&
+              *art_url != '\0')
             {
-              json_builder_set_member_name (builder, "albumArtUrl");
-              json_builder_add_string_value (builder, art_url);
+              g_autofree char *album_art = NULL;
+
+              album_art = valent_mpris_plugin_get_album_art (self, art_url);
+
+              if (album_art != NULL)
+                json_object_set_string_member (fields, "albumArtUrl", album_art);
             }
         }
     }
 
   /* Volume Level */
-  if (request_volume)
+  if (volume)
     {
       int64_t level;
 
       level = floor (valent_media_player_get_volume (player) * 100);
-      json_builder_set_member_name (builder, "volume");
-      json_builder_add_int_value (builder, level);
+      json_object_set_int_member (fields, "volume", level);
     }
+}
+
+static PlayerState *
+valent_mpris_plugin_lookup_state (ValentMprisPlugin *self,
+                                  ValentMediaPlayer *player)
+{
+  PlayerState *state;
 
-  /* Send Response */
-  response = valent_packet_end (&builder);
-  valent_device_plugin_queue_packet (VALENT_DEVICE_PLUGIN (self), response);
+  if ((state = g_hash_table_lookup (self->states, player)) == NULL)
+    {
+      state = g_new0 (PlayerState, 1);
+      state->fields = json_object_new ();
+      g_hash_table_insert (self->states, player, state);
+    }
+
+  return state;
 }
 
 static void
-valent_mpris_plugin_send_player_list (ValentMprisPlugin *self)
+valent_mpris_plugin_send_fields (ValentMprisPlugin *self,
+                                 ValentMediaPlayer *player,
+                                 JsonObject        *fields,
+                                 int64_t            position)
 {
   g_autoptr (JsonBuilder) builder = NULL;
   g_autoptr (JsonNode) packet = NULL;
-  unsigned int n_players = 0;
+  JsonObjectIter iter;
+  const char *name;
+  JsonNode *node;
+
+  valent_packet_init (&builder, "kdeconnect.mpris");
+  json_builder_set_member_name (builder, "player");
+  json_builder_add_string_value (builder, valent_media_player_get_name (player));
+
+  json_object_iter_init (&iter, fields);
+  while (json_object_iter_next (&iter, &name, &node))
+    {
+      json_builder_set_member_name (builder, name);
+      json_builder_add_value (builder, json_node_copy (node));
+    }
+
+  if (position >= 0)
+    {
+      json_builder_set_member_name (builder, "pos");
+      json_builder_add_int_value (builder, position);
+    }
+
+  packet = valent_packet_end (&builder);
+  valent_device_plugin_queue_packet (VALENT_DEVICE_PLUGIN (self), packet);
+}
+
+/*
+ * Send the complete state of @player, as requested by the remote device. This
+ * also resets the last-sent state that deltas are computed against.
+ */
+static void
+valent_mpris_plugin_send_player_info (ValentMprisPlugin *self,
+                                      ValentMediaPlayer *player,
+                                      gboolean           request_now_playing,
+                                      gboolean           request_volume)
+{
+  g_autoptr (JsonObject) fields = NULL;
+  PlayerState *state;
+  JsonObjectIter iter;
+  const char *name;
+  JsonNode *node;
+  int64_t position = -1;
 
   g_assert (VALENT_IS_MPRIS_PLUGIN (self));
+  g_assert (VALENT_IS_MEDIA_PLAYER (player));
 
-  valent_packet_init (&builder, "kdeconnect.mpris");
+  fields = json_object_new ();
+  valent_mpris_plugin_collect_state (self,
+                                     player,
+                                     fields,
+                                     request_now_playing,
+                                     request_volume);
+
+  state = valent_mpris_plugin_lookup_state (self, player);
+
+  if (request_now_playing)
+    {
+      /* Convert seconds to milliseconds */
+      position = valent_media_player_get_position (player) * 1000L;
+      state->position = position;
+      state->position_time = g_get_monotonic_time ();
+      state->playing = json_object_get_boolean_member (fields, "isPlaying");
+
+      for (size_t i = 0; i < G_N_ELEMENTS (metadata_fields); i++)
+        {
+          if (json_object_has_member (state->fields, metadata_fields[i]))
+            json_object_remove_member (state->fields, metadata_fields[i]);
+        }
+    }
+
+  json_object_iter_init (&iter, fields);
+  while (json_object_iter_next (&iter, &name, &node))
+    json_object_set_member (state->fields, name, json_node_copy (node));
+
+  valent_mpris_plugin_send_fields (self, player, fields, position);
+}
+
+/*
+ * Send the fields of @player that changed since the last update. Fields are
+ * sent in groups where the receiver treats them as a unit (flags, metadata),
+ * and cleared metadata is sent as an empty value.
+ *
+ * Returns %FALSE if a position-only update was deferred, with @delay set to
+ * the minimum time remaining until it may be sent.
+ */
+static gboolean
+valent_mpris_plugin_send_player_delta (ValentMprisPlugin *self,
+                                       ValentMediaPlayer *player,
+                                       int64_t           *delay)
+{
+  g_autoptr (JsonObject) fields = NULL;
+  g_autoptr (JsonObject) delta = NULL;
+  PlayerState *state;
+  JsonObjectIter iter;
+  const char *name;
+  JsonNode *node;
+  gboolean flags_changed = FALSE;
+  gboolean metadata_changed = FALSE;
+  gboolean playing;
+  int64_t now, elapsed;
+  int64_t position, expected;
+  gboolean send_position;
 
-  /* Player List */
-  json_builder_set_member_name (builder, "playerList");
-  json_builder_begin_array (builder);
+  g_assert (VALENT_IS_MPRIS_PLUGIN (self));
+  g_assert (VALENT_IS_MEDIA_PLAYER (player));
+
+  /* Without a baseline, the remote device gets the complete state */
+  if (!g_hash_table_contains (self->states, player))
+    {
+      valent_mpris_plugin_send_player_info (self, player, TRUE, TRUE);
+      return TRUE;
+    }
+
+  state = valent_mpris_plugin_lookup_state (self, player);
+  fields = json_object_new ();
+  delta = json_object_new ();
+  valent_mpris_plugin_collect_state (self, player, fields, TRUE, TRUE);
+
+  json_object_iter_init (&iter, fields);
+  while (json_object_iter_next (&iter, &name, &node))
+    {
+      JsonNode *last = json_object_get_member (state->fields, name);
+
+      if (last == NULL || !json_node_equal (node, last))
+        json_object_set_member (delta, name, json_node_copy (node));
+    }
 
+  for (size_t i = 0; i < G_N_ELEMENTS (flag_fields); i++)
+    flags_changed |= json_object_has_member (delta, flag_fields[i]);
+
+  for (size_t i = 0; i < G_N_ELEMENTS (metadata_fields); i++)
+    {
+      name = metadata_fields[i];
+
+      if (json_object_has_member (fields, name))
+        {
+          metadata_changed |= json_object_has_member (delta, name);
+        }
+      else if (json_object_has_member (state->fields, name))
+        {
+          if (g_str_equal (name, "length"))
+            json_object_set_int_member (delta, name, 0);
+          else
+            json_object_set_string_member (delta, name, "");
+
+          json_object_remove_member (state->fields, name);
+          metadata_changed = TRUE;
+        }
+    }
+
+  /* The receiver rebuilds flags and metadata from whichever members are
+   * present, so these are only ever sent as complete groups. */
+  if (flags_changed)
+    {
+      for (size_t i = 0; i < G_N_ELEMENTS (flag_fields); i++)
+        {
+          node = json_object_get_member (fields, flag_fields[i]);
+          json_object_set_member (delta, flag_fields[i], json_node_copy (node));
+        }
+    }
+
+  if (metadata_changed)
+    {
+      for (size_t i = 0; i < G_N_ELEMENTS (metadata_fields); i++)
+        {
+          if ((node = json_object_get_member (fields, metadata_fields[i])) != NULL)
+            json_object_set_member (delta, metadata_fields[i], json_node_copy (node));
+        }
+    }
+
+  /* Compare the position to what the remote device is extrapolating */
+  playing = json_object_get_boolean_member (fields, "isPlaying");
+  position = valent_media_player_get_position (player) * 1000L;
+  now = g_get_monotonic_time ();
+  elapsed = now - state->position_time;
+  expected = state->position;
+
+  if (state->playing)
+    expected += elapsed / 1000L;
+
+  send_position = playing != state->playing ||
+                  metadata_changed ||
+                  ABS (position - expected) > POSITION_TOLERANCE;
+
+  if (send_position && json_object_get_size (delta) == 0 &&
+      elapsed < POSITION_INTERVAL)
+    {
+      *delay = MIN (*delay, POSITION_INTERVAL - elapsed);
+      return FALSE;
+    }
+
+  if (!send_position && json_object_get_size (delta) == 0)
+    return TRUE;
+
+  json_object_iter_init (&iter, delta);
+  while (json_object_iter_next (&iter, &name, &node))
+    {
+      if (json_object_has_member (fields, name))
+        json_object_set_member (state->fields, name, json_node_copy (node));
+    }
+
+  if (send_position)
+    {
+      state->position = position;
+      state->position_time = now;
+      state->playing = playing;
+    }
+
+  valent_mpris_plugin_send_fields (self,
+                                   player,
+                                   delta,
+                                   send_position ? position : -1);
+
+  return TRUE;
+}
+
+static void
+valent_mpris_plugin_send_player_list (ValentMprisPlugin *self)
+{
+  g_autoptr (JsonBuilder) builder = NULL;
+  g_autoptr (JsonNode) packet = NULL;
+  g_autoptr (GStrvBuilder) names_builder = NULL;
+  g_auto (GStrv) names = NULL;
+  unsigned int n_players = 0;
+  char *data;
+
+  g_assert (VALENT_IS_MPRIS_PLUGIN (self));
+
+  names_builder = g_strv_builder_new ();
   n_players = g_list_model_get_n_items (G_LIST_MODEL (self->media));
 
   for (unsigned int i = 0; i < n_players; i++)
@@ -515,17 +817,42 @@ valent_mpris_plugin_send_player_list (ValentMprisPlugin *self)
       name = valent_media_player_get_name (player);
 
       if (name != NULL)
-        json_builder_add_string_value (builder, name);
+        g_strv_builder_add (names_builder, name);
     }
 
-  json_builder_end_array (builder);
+  names = g_strv_builder_end (names_builder);
 
-  /* Indicate that the remote device may send us album art payloads */
-  json_builder_set_member_name (builder, "supportAlbumArtPayload");
-  json_builder_add_boolean_value (builder, TRUE);
+  if (local_players.bytes == NULL ||
+      !g_strv_equal ((const char * const *)local_players.names,
+                     (const char * const *)names))
+    {
+      valent_packet_init (&builder, "kdeconnect.mpris");
 
-  packet = valent_packet_end (&builder);
-  valent_device_plugin_queue_packet (VALENT_DEVICE_PLUGIN (self), packet);
+      /* Player List */
+      json_builder_set_member_name (builder, "playerList");
+      json_builder_begin_array (builder);
+
+      for (unsigned int i = 0; names[i] != NULL; i++)
+        json_builder_add_string_value (builder, names[i]);
+
+      json_builder_end_array (builder);
+
+      /* Indicate that the remote device may send us album art payloads */
+      json_builder_set_member_name (builder, "supportAlbumArtPayload");
+      json_builder_add_boolean_value (builder, TRUE);
+
+      packet = valent_packet_end (&builder);
+
+      data = valent_packet_serialize (packet);
+      g_clear_pointer (&local_players.bytes, g_bytes_unref);
+      local_players.bytes = g_bytes_new_take (data, strlen (data));
+      g_clear_pointer (&local_players.names, g_strfreev);
+      local_players.names = g_steal_pointer (&names);
+    }
+
+  valent_device_plugin_queue_bytes (VALENT_DEVICE_PLUGIN (self),
+                                    "kdeconnect.mpris",
+                                    local_players.bytes);
 }
 
 static void
@@ -576,6 +903,8 @@ valent_mpris_plugin_watch_media (ValentMprisPlugin *self,
         }
 
       g_clear_handle_id (&self->flush_id, g_source_remove);
+      g_hash_table_remove_all (self->pending);
+      g_hash_table_remove_all (self->states);
       g_signal_handlers_disconnect_by_data (self->media, self);
       self->media_watch = FALSE;
     }
@@ -650,6 +979,8 @@ receive_art_cb (ValentTransfer    *transfer,
                 "packet", &packet,
                 NULL);
 
+  valent_mpris_art_cache_add (file);
+
   if (valent_packet_get_string (packet, "player", &name) &&
       valent_mpris_plugin_find_player (self, name, &player))
     valent_mpris_device_update_art (VALENT_MPRIS_DEVICE (player), file);
@@ -660,9 +991,7 @@ valent_mpris_plugin_receive_album_art (ValentMprisPlugin *self,
                                        JsonNode          *packet)
 {
   ValentDevice *device;
-  ValentContext *context = NULL;
   const char *url;
-  g_autofree char *filename = NULL;
   g_autoptr (GFile) file = NULL;
   g_autoptr (ValentTransfer) transfer = NULL;
 
@@ -674,9 +1003,7 @@ valent_mpris_plugin_receive_album_art (ValentMprisPlugin *self,
     }
 
   device = valent_extension_get_object (VALENT_EXTENSION (self));
-  context = valent_device_get_context (device);
-  filename = g_compute_checksum_for_string (G_CHECKSUM_MD5, url, -1);
-  file = valent_context_get_cache_file (context, filename);
+  file = valent_mpris_art_get_cache_file (device, url);
 
   transfer = valent_device_transfer_new (device, packet, file);
   valent_transfer_execute (transfer,
@@ -804,7 +1131,6 @@ valent_mpris_plugin_handle_mpris (ValentMprisPlugin *self,
     valent_mpris_plugin_handle_player_update (self, packet);
 }
 
-
 /*
  * ValentDevicePlugin
  */
@@ -833,27 +1159,6 @@ valent_mpris_plugin_update_state (ValentDevicePlugin *plugin,
     }
 }
 
-static void
-valent_mpris_plugin_handle_packet (ValentDevicePlugin *plugin,
-                                   const char         *type,
-                                   JsonNode           *packet)
-{
-  ValentMprisPlugin *self = VALENT_MPRIS_PLUGIN (plugin);
-
-  g_assert (VALENT_IS_MPRIS_PLUGIN (plugin));
-  g_assert (type != NULL);
-  g_assert (VALENT_IS_PACKET (packet));
-
-  if (g_str_equal (type, "kdeconnect.mpris"))
-    valent_mpris_plugin_handle_mpris (self, packet);
-
-  else if (g_str_equal (type, "kdeconnect.mpris.request"))
-    valent_mpris_plugin_handle_mpris_request (self, packet);
-
-  else
-    g_assert_not_reached ();
-}
-
 /*
  * ValentObject
  */
@@ -887,7 +1192,9 @@ valent_mpris_plugin_finalize (GObject *object)
   ValentMprisPlugin *self = VALENT_MPRIS_PLUGIN (object);
 
   g_clear_pointer (&self->pending, g_hash_table_unref);
+  g_clear_pointer (&self->states, g_hash_table_unref);
   g_clear_pointer (&self->players, g_ptr_array_unref);
+  g_clear_pointer (&self->preparing, g_hash_table_unref);
   g_clear_pointer (&self->transfers, g_hash_table_unref);
 
   G_OBJECT_CLASS (valent_mpris_plugin_parent_class)->finalize (object);
@@ -905,8 +1212,14 @@ valent_mpris_plugin_class_init (ValentMprisPluginClass *klass)
 
   vobject_class->destroy = valent_mpris_plugin_destroy;
 
-  plugin_class->handle_packet = valent_mpris_plugin_handle_packet;
   plugin_class->update_state = valent_mpris_plugin_update_state;
+
+  valent_device_plugin_class_install_packet_handler (plugin_class,
+                                                     "kdeconnect.mpris",
+                                                     (ValentDevicePluginPacketFunc)valent_mpris_plugin_handle_mpris);
+  valent_device_plugin_class_install_packet_handler (plugin_class,
+                                                     "kdeconnect.mpris.request",
+                                                     (ValentDevicePluginPacketFunc)valent_mpris_plugin_handle_mpris_request);
 }
 
 static void
@@ -918,5 +1231,7 @@ valent_mpris_plugin_init (ValentMprisPlugin *self)
                                            g_free,
                                            g_object_unref);
   self->pending = g_hash_table_new (NULL, NULL);
+  self->preparing = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  self->states = g_hash_table_new_full (NULL, NULL, NULL, player_state_free);
 }
 
@@ -952,33 +952,6 @@ valent_notification_plugin_update_state (ValentDevicePlugin *plugin,
     }
 }
 
-static void
-valent_notification_plugin_handle_packet (ValentDevicePlugin *plugin,
-                                          const char         *type,
-                                          JsonNode           *packet)
-{
-  ValentNotificationPlugin *self = VALENT_NOTIFICATION_PLUGIN (plugin);
-
-  g_assert (VALENT_IS_NOTIFICATION_PLUGIN (plugin));
-  g_assert (type != NULL);
-  g_assert (VALENT_IS_PACKET (packet));
-
-  if (g_str_equal (type, "kdeconnect.notification"))
-    valent_notification_plugin_handle_notification (self, packet);
-
-  else if (g_str_equal (type, "kdeconnect.notification.action"))
-    valent_notification_plugin_handle_notification_action (self, packet);
-
-  else if (g_str_equal (type, "kdeconnect.notification.reply"))
-    valent_notification_plugin_handle_notification_reply (self, packet);
-
-  else if (g_str_equal (type, "kdeconnect.notification.request"))
-    valent_notification_plugin_handle_notification_request (self, packet);
-
-  else
-    g_assert_not_reached ();
-}
-
 /*
  * ValentObject
  */
@@ -1041,8 +1014,20 @@ valent_notification_plugin_class_init (ValentNotificationPluginClass *klass)
 
   vobject_class->destroy = valent_notification_plugin_destroy;
 
-  plugin_class->handle_packet = valent_notification_plugin_handle_packet;
   plugin_class->update_state = valent_notification_plugin_update_state;
+
+  valent_device_plugin_class_install_packet_handler (plugin_class,
+                                                     "kdeconnect.notification",
+                                                     (ValentDevicePluginPacketFunc)valent_notification_plugin_handle_notification);
+  valent_device_plugin_class_install_packet_handler (plugin_class,
+                                                     "kdeconnect.notification.action",
+                                                     (ValentDevicePluginPacketFunc)valent_notification_plugin_handle_notification_action);
+  valent_device_plugin_class_install_packet_handler (plugin_class,
+                                                     "kdeconnect.notification.reply",
+                                                     (ValentDevicePluginPacketFunc)valent_notification_plugin_handle_notification_reply);
+  valent_device_plugin_class_install_packet_handler (plugin_class,
+                                                     "kdeconnect.notification.request",
+                                                     (ValentDevicePluginPacketFunc)valent_notification_plugin_handle_notification_request);
 }
 
 static void
@@ -150,27 +150,6 @@ valent_photo_plugin_update_state (ValentDevicePlugin *plugin,
   valent_extension_toggle_actions (VALENT_EXTENSION (plugin), available);
 }
 
-static void
-valent_photo_plugin_handle_packet (ValentDevicePlugin *plugin,
-                                   const char         *type,
-                                   JsonNode           *packet)
-{
-  ValentPhotoPlugin *self = VALENT_PHOTO_PLUGIN (plugin);
-
-  g_assert (VALENT_IS_PHOTO_PLUGIN (plugin));
-  g_assert (type != NULL);
-  g_assert (VALENT_IS_PACKET (packet));
-
-  if (g_str_equal (type, "kdeconnect.photo"))
-    valent_photo_plugin_handle_photo (self, packet);
-
-  else if (g_str_equal (type, "kdeconnect.photo.request"))
-    valent_photo_plugin_handle_photo_request (self, packet);
-
-  else
-    g_assert_not_reached ();
-}
-
 /*
  * ValentObject
  */
@@ -215,8 +194,14 @@ valent_photo_plugin_class_init (ValentPhotoPluginClass *klass)
 
   vobject_class->destroy = valent_photo_plugin_destroy;
 
-  plugin_class->handle_packet = valent_photo_plugin_handle_packet;
   plugin_class->update_state = valent_photo_plugin_update_state;
+
+  valent_device_plugin_class_install_packet_handler (plugin_class,
+                                                     "kdeconnect.photo",
+                                                     (ValentDevicePluginPacketFunc)valent_photo_plugin_handle_photo);
+  valent_device_plugin_class_install_packet_handler (plugin_class,
+                                                     "kdeconnect.photo.request",
+                                                     (ValentDevicePluginPacketFunc)valent_photo_plugin_handle_photo_request);
 }
 
 static void
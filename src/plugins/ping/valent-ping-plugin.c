@@ -108,23 +108,6 @@ valent_ping_plugin_update_state (ValentDevicePlugin *plugin,
   valent_extension_toggle_actions (VALENT_EXTENSION (plugin), available);
 }
 
-static void
-valent_ping_plugin_handle_packet (ValentDevicePlugin *plugin,
-                                  const char         *type,
-                                  JsonNode           *packet)
-{
-  ValentPingPlugin *self = VALENT_PING_PLUGIN (plugin);
-
-  g_assert (VALENT_IS_PING_PLUGIN (self));
-  g_assert (type != NULL);
-  g_assert (VALENT_IS_PACKET (packet));
-
-  if (g_str_equal (type, "kdeconnect.ping"))
-    valent_ping_plugin_handle_ping (self, packet);
-  else
-    g_assert_not_reached ();
-}
-
 /*
  * ValentObject
  */
@@ -169,8 +152,11 @@ valent_ping_plugin_class_init (ValentPingPluginClass *klass)
 
   vobject_class->destroy = valent_ping_plugin_destroy;
 
-  plugin_class->handle_packet = valent_ping_plugin_handle_packet;
   plugin_class->update_state = valent_ping_plugin_update_state;
+
+  valent_device_plugin_class_install_packet_handler (plugin_class,
+                                                     "kdeconnect.ping",
+                                                     (ValentDevicePluginPacketFunc)valent_ping_plugin_handle_ping);
 }
 
 static void
@@ -179,23 +179,6 @@ valent_presenter_plugin_update_state (ValentDevicePlugin *plugin,
   valent_presenter_plugin_toggle_actions (self, available);
 }
 
-static void
-valent_presenter_plugin_handle_packet (ValentDevicePlugin *plugin,
-                                       const char         *type,
-                                       JsonNode           *packet)
-{
-  ValentPresenterPlugin *self = VALENT_PRESENTER_PLUGIN (plugin);
-
-  g_assert (VALENT_IS_PRESENTER_PLUGIN (self));
-  g_assert (type != NULL);
-  g_assert (VALENT_IS_PACKET (packet));
-
-  if (g_str_equal (type, "kdeconnect.presenter"))
-    valent_presenter_plugin_handle_presenter (self, packet);
-  else
-    g_assert_not_reached ();
-}
-
 /*
  * ValentObject
  */
@@ -246,8 +229,11 @@ valent_presenter_plugin_class_init (ValentPresenterPluginClass *klass)
 
   vobject_class->destroy = valent_presenter_plugin_destroy;
 
-  plugin_class->handle_packet = valent_presenter_plugin_handle_packet;
   plugin_class->update_state = valent_presenter_plugin_update_state;
+
+  valent_device_plugin_class_install_packet_handler (plugin_class,
+                                                     "kdeconnect.presenter",
+                                                     (ValentDevicePluginPacketFunc)valent_presenter_plugin_handle_presenter);
 }
 
 static void
@@ -447,29 +447,6 @@ valent_runcommand_plugin_update_state (ValentDevicePlugin *plugin,
     launcher_clear (self);
 }
 
-static void
-valent_runcommand_plugin_handle_packet (ValentDevicePlugin *plugin,
-                                        const char         *type,
-                                        JsonNode           *packet)
-{
-  ValentRuncommandPlugin *self = VALENT_RUNCOMMAND_PLUGIN (plugin);
-
-  g_assert (VALENT_IS_DEVICE_PLUGIN (plugin));
-  g_assert (type != NULL);
-  g_assert (VALENT_IS_PACKET (packet));
-
-  /* A request for the local command list or local execution */
-  if (g_str_equal (type, "kdeconnect.runcommand.request"))
-    valent_runcommand_plugin_handle_runcommand_request (self, packet);
-
-  /* A response to a request for the remote command list */
-  else if (g_str_equal (type, "kdeconnect.runcommand"))
-    valent_runcommand_plugin_handle_runcommand (self, packet);
-
-  else
-    g_assert_not_reached ();
-}
-
 /*
  * ValentObject
  */
@@ -526,8 +503,14 @@ valent_runcommand_plugin_class_init (ValentRuncommandPluginClass *klass)
 
   vobject_class->destroy = valent_runcommand_plugin_destroy;
 
-  plugin_class->handle_packet = valent_runcommand_plugin_handle_packet;
   plugin_class->update_state = valent_runcommand_plugin_update_state;
+
+  valent_device_plugin_class_install_packet_handler (plugin_class,
+                                                     "kdeconnect.runcommand.request",
+                                                     (ValentDevicePluginPacketFunc)valent_runcommand_plugin_handle_runcommand_request);
+  valent_device_plugin_class_install_packet_handler (plugin_class,
+                                                     "kdeconnect.runcommand",
+                                                     (ValentDevicePluginPacketFunc)valent_runcommand_plugin_handle_runcommand);
 }
 
 static void
@@ -208,7 +208,6 @@ sftp_session_find (ValentSftpPlugin *self)
   return FALSE;
 }
 
-
 /*
  * GVolumeMonitor Callbacks
  */
@@ -422,7 +421,6 @@ sftp_session_begin (ValentSftpPlugin  *self,
                                  self);
 }
 
-
 /*
  * Packet Handlers
  */
@@ -619,27 +617,6 @@ valent_sftp_plugin_update_state (ValentDevicePlugin *plugin,
     }
 }
 
-static void
-valent_sftp_plugin_handle_packet (ValentDevicePlugin *plugin,
-                                  const char         *type,
-                                  JsonNode           *packet)
-{
-  ValentSftpPlugin *self = VALENT_SFTP_PLUGIN (plugin);
-
-  g_assert (VALENT_IS_SFTP_PLUGIN (self));
-  g_assert (type != NULL);
-  g_assert (VALENT_IS_PACKET (packet));
-
-  if (g_str_equal (type, "kdeconnect.sftp"))
-    valent_sftp_plugin_handle_sftp (self, packet);
-
-  else if (g_str_equal (type, "kdeconnect.sftp.request"))
-    valent_sftp_plugin_handle_request (self, packet);
-
-  else
-    g_warn_if_reached ();
-}
-
 /*
  * ValentObject
  */
@@ -705,8 +682,14 @@ valent_sftp_plugin_class_init (ValentSftpPluginClass *klass)
 
   vobject_class->destroy = valent_sftp_plugin_destroy;
 
-  plugin_class->handle_packet = valent_sftp_plugin_handle_packet;
   plugin_class->update_state = valent_sftp_plugin_update_state;
+
+  valent_device_plugin_class_install_packet_handler (plugin_class,
+                                                     "kdeconnect.sftp",
+                                                     (ValentDevicePluginPacketFunc)valent_sftp_plugin_handle_sftp);
+  valent_device_plugin_class_install_packet_handler (plugin_class,
+                                                     "kdeconnect.sftp.request",
+                                                     (ValentDevicePluginPacketFunc)valent_sftp_plugin_handle_request);
 }
 
 static void
@@ -17,6 +17,9 @@
  * reporting an error, while kdeconnect-kde has no wait period. */
 #define OPERATION_TIMEOUT_MS 1000
 
+/* The maximum number of payload connections open at once for a device. */
+#define MAX_CONCURRENT_ITEMS 4
+
 
 /**
  * ValentShareDownload:
@@ -25,22 +28,47 @@
  *
  * #ValentShareDownload is a class that supports multi-file downloads for
  * #ValentSharePlugin.
+ *
+ * Each file starts downloading as soon as it is added, with up to
+ * `MAX_CONCURRENT_ITEMS` payloads transferring at once for each device, shared
+ * by all the downloads from that device. The operation completes
+ * when the expected number of files have been received, or fails if no new
+ * file arrives within `OPERATION_TIMEOUT_MS` of the last one completing.
  */
 
+/* Payload connections are limited per-device, so concurrent downloads from the
+ * same device wait in turn for a free slot. All access is from the main thread.
+ */
+typedef struct
+{
+  char         *device_id;
+  unsigned int  n_active;
+  GQueue        waiting;
+} DeviceSlots;
+
+static GHashTable *device_slots = NULL;
+
 struct _ValentShareDownload
 {
   ValentTransfer  parent_instance;
 
   ValentDevice   *device;
   GPtrArray      *items;
+  DeviceSlots    *slots;
 
+  GTask          *task;
+  unsigned int    timeout_id;
   unsigned int    position;
+  unsigned int    n_active;
+  unsigned int    waiting : 1;
+  unsigned int    n_complete;
+  goffset         received;
   int64_t         number_of_files;
   goffset         payload_size;
 };
 
 static void       g_list_model_iface_init       (GListModelInterface *iface);
-static gboolean   valent_share_download_timeout (gpointer             data);
+static void       valent_share_download_pump    (ValentShareDownload *self);
 
 G_DEFINE_FINAL_TYPE_WITH_CODE (ValentShareDownload, valent_share_download, VALENT_TYPE_TRANSFER,
                                G_IMPLEMENT_INTERFACE (G_TYPE_LIST_MODEL, g_list_model_iface_init))
@@ -54,73 +82,239 @@ enum {
 static GParamSpec *properties[N_PROPERTIES] = { 0, };
 
 
+/*
+ * DeviceSlots
+ */
+static void
+device_slots_free (gpointer data)
+{
+  DeviceSlots *slots = data;
+
+  /* Each waiting download holds a reference, so the queue is empty */
+  g_assert (g_queue_is_empty (&slots->waiting));
+
+  g_hash_table_remove (device_slots, slots->device_id);
+  g_clear_pointer (&slots->device_id, g_free);
+}
+
+static DeviceSlots *
+device_slots_acquire (ValentDevice *device)
+{
+  const char *device_id = valent_device_get_id (device);
+  DeviceSlots *slots;
+
+  if (device_slots == NULL)
+    device_slots = g_hash_table_new (g_str_hash, g_str_equal);
+
+  slots = g_hash_table_lookup (device_slots, device_id);
+
+  if (slots != NULL)
+    return g_rc_box_acquire (slots);
+
+  slots = g_rc_box_new0 (DeviceSlots);
+  slots->device_id = g_strdup (device_id);
+  g_queue_init (&slots->waiting);
+  g_hash_table_insert (device_slots, slots->device_id, slots);
+
+  return slots;
+}
+
+static void
+device_slots_release (DeviceSlots *slots)
+{
+  g_rc_box_release_full (slots, device_slots_free);
+}
+
 /*
  * ValentTransfer
  */
+static void
+valent_share_download_discard_pending (ValentShareDownload *self)
+{
+  /* Items that never started still hold the empty file reserved for them by
+   * valent_get_user_file(), which would otherwise be left behind */
+  for (; self->position < self->items->len; self->position++)
+    {
+      ValentDeviceTransfer *item = g_ptr_array_index (self->items, self->position);
+      g_autoptr (GFile) file = NULL;
+      g_autoptr (GFileInfo) info = NULL;
+
+      file = valent_device_transfer_ref_file (item);
+      info = g_file_query_info (file,
+                                G_FILE_ATTRIBUTE_STANDARD_TYPE","
+                                G_FILE_ATTRIBUTE_STANDARD_SIZE,
+                                G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                NULL,
+                                NULL);
+
+      if (info != NULL &&
+          g_file_info_get_file_type (info) == G_FILE_TYPE_REGULAR &&
+          g_file_info_get_size (info) == 0)
+        g_file_delete (file, NULL, NULL);
+    }
+}
+
+static void
+valent_share_download_return (ValentShareDownload *self,
+                              GError              *error)
+{
+  g_autoptr (GTask) task = g_steal_pointer (&self->task);
+
+  g_clear_handle_id (&self->timeout_id, g_source_remove);
+
+  if (self->waiting)
+    {
+      self->waiting = FALSE;
+      g_queue_remove (&self->slots->waiting, self);
+      g_object_unref (self);
+    }
+
+  if (task == NULL)
+    {
+      g_clear_error (&error);
+      return;
+    }
+
+  if (error != NULL)
+    {
+      GCancellable *cancellable = g_task_get_cancellable (task);
+
+      valent_share_download_discard_pending (self);
+      g_task_return_error (task, error);
+
+      /* Stop any other items still in progress */
+      if (cancellable != NULL)
+        g_cancellable_cancel (cancellable);
+    }
+  else
+    {
+      g_task_return_boolean (task, TRUE);
+    }
+}
+
 static void
 valent_transfer_execute_cb (GObject      *object,
                             GAsyncResult *result,
                             gpointer      user_data)
 {
   ValentTransfer *transfer = VALENT_TRANSFER (object);
-  ValentShareDownload *self = g_task_get_source_object (G_TASK (user_data));
-  g_autoptr (GTask) task = G_TASK (user_data);
-  g_autoptr (GError) error = NULL;
+  g_autoptr (ValentShareDownload) self = VALENT_SHARE_DOWNLOAD (user_data);
+  g_autoptr (JsonNode) packet = NULL;
+  GError *error = NULL;
 
-  if (!valent_transfer_execute_finish (transfer, result, &error))
-    return g_task_return_error (task, g_steal_pointer (&error));
+  self->n_active--;
+  self->slots->n_active--;
 
-  if (self->position < self->items->len)
+  /* Hand the free slot to the downloads waiting for one, in turn */
+  while (self->slots->n_active < MAX_CONCURRENT_ITEMS)
     {
-      ValentTransfer *item = g_ptr_array_index (self->items, self->position++);
+      g_autoptr (ValentShareDownload) next = NULL;
 
-      valent_transfer_execute (item,
-                               g_task_get_cancellable (task),
-                               valent_transfer_execute_cb,
-                               g_object_ref (task));
+      if ((next = g_queue_pop_head (&self->slots->waiting)) == NULL)
+        break;
+
+      next->waiting = FALSE;
+      valent_share_download_pump (next);
     }
-  else if (self->position < self->number_of_files)
-    {
-      g_autoptr (GSource) source = NULL;
 
-      source = g_timeout_source_new (OPERATION_TIMEOUT_MS);
-      g_task_attach_source (task, source, valent_share_download_timeout);
+  if (!valent_transfer_execute_finish (transfer, result, &error))
+    {
+      valent_share_download_return (self, error);
+      return;
     }
-  else
+
+  packet = valent_device_transfer_ref_packet (VALENT_DEVICE_TRANSFER (transfer));
+  self->received += valent_packet_get_payload_size (packet);
+  self->n_complete++;
+
+  if (self->payload_size > 0)
     {
-      g_task_return_boolean (task, TRUE);
+      valent_transfer_set_progress (VALENT_TRANSFER (self),
+                                    CLAMP ((double)self->received /
+                                           (double)self->payload_size,
+                                           0.0, 1.0));
     }
+
+  valent_share_download_pump (self);
 }
 
 static gboolean
 valent_share_download_timeout (gpointer data)
 {
-  ValentShareDownload *self = g_task_get_source_object (G_TASK (data));
-  GTask *task = G_TASK (data);
+  ValentShareDownload *self = VALENT_SHARE_DOWNLOAD (data);
+
+  self->timeout_id = 0;
+  valent_share_download_return (self,
+                                g_error_new (G_IO_ERROR,
+                                             G_IO_ERROR_PARTIAL_INPUT,
+                                             "Failed to receive %u of %u files",
+                                             (unsigned int)self->number_of_files - self->n_complete,
+                                             (unsigned int)self->number_of_files));
+
+  return G_SOURCE_REMOVE;
+}
+
+/*
+ * Start as many pending items as the concurrency limit allows, then decide if
+ * the operation is complete or should wait for more items.
+ */
+static void
+valent_share_download_pump (ValentShareDownload *self)
+{
+  GCancellable *cancellable;
+
+  if (self->task == NULL)
+    return;
 
-  if (g_task_return_error_if_cancelled (task))
-    return G_SOURCE_REMOVE;
+  cancellable = g_task_get_cancellable (self->task);
 
-  if (self->position < self->items->len)
+  if (g_cancellable_is_cancelled (cancellable))
+    {
+      valent_share_download_return (self,
+                                    g_error_new_literal (G_IO_ERROR,
+                                                         G_IO_ERROR_CANCELLED,
+                                                         "Operation was cancelled"));
+      return;
+    }
+
+  if (self->slots == NULL)
+    self->slots = device_slots_acquire (self->device);
+
+  while (self->slots->n_active < MAX_CONCURRENT_ITEMS &&
+         self->position < self->items->len)
     {
       ValentTransfer *item = g_ptr_array_index (self->items, self->position++);
 
+      self->n_active++;
+      self->slots->n_active++;
       valent_transfer_execute (item,
-                               g_task_get_cancellable (task),
+                               cancellable,
                                valent_transfer_execute_cb,
-                               g_object_ref (task));
+                               g_object_ref (self));
     }
-  else if (self->position < self->number_of_files)
+
+  /* Wait for another download from the device to free a slot */
+  if (self->position < self->items->len && !self->waiting)
     {
-      g_task_return_new_error (task,
-                               G_IO_ERROR,
-                               G_IO_ERROR_PARTIAL_INPUT,
-                               "Failed to receive %u of %u files",
-                               (unsigned int)self->number_of_files - self->position,
-                               (unsigned int)self->number_of_files);
+      self->waiting = TRUE;
+      g_queue_push_tail (&self->slots->waiting, g_object_ref (self));
+    }
+  else if (self->position == self->items->len && self->waiting)
+    {
+      self->waiting = FALSE;
+      g_queue_remove (&self->slots->waiting, self);
+      g_object_unref (self);
     }
 
-  return G_SOURCE_REMOVE;
+  if (self->n_active > 0 || self->waiting)
+    return;
+
+  if (self->n_complete >= self->number_of_files)
+    valent_share_download_return (self, NULL);
+  else if (self->timeout_id == 0)
+    self->timeout_id = g_timeout_add (OPERATION_TIMEOUT_MS,
+                                      valent_share_download_timeout,
+                                      self);
 }
 
 static void
@@ -130,34 +324,15 @@ valent_share_download_execute (ValentTransfer      *transfer,
                                gpointer             user_data)
 {
   ValentShareDownload *self = VALENT_SHARE_DOWNLOAD (transfer);
-  g_autoptr (GTask) task = NULL;
 
   g_assert (VALENT_IS_SHARE_DOWNLOAD (self));
   g_assert (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+  g_assert (self->task == NULL);
 
-  task = g_task_new (self, cancellable, callback, user_data);
-  g_task_set_source_tag (task, valent_share_download_execute);
-
-  if (self->position < self->items->len)
-    {
-      ValentTransfer *item = g_ptr_array_index (self->items, self->position++);
+  self->task = g_task_new (self, cancellable, callback, user_data);
+  g_task_set_source_tag (self->task, valent_share_download_execute);
 
-      valent_transfer_execute (item,
-                               g_task_get_cancellable (task),
-                               valent_transfer_execute_cb,
-                               g_object_ref (task));
-    }
-  else if (self->position < self->number_of_files)
-    {
-      g_autoptr (GSource) source = NULL;
-
-      source = g_timeout_source_new (OPERATION_TIMEOUT_MS);
-      g_task_attach_source (task, source, valent_share_download_timeout);
-    }
-  else
-    {
-      g_task_return_boolean (task, TRUE);
-    }
+  valent_share_download_pump (self);
 }
 
 /*
@@ -213,8 +388,10 @@ valent_share_download_finalize (GObject *object)
 {
   ValentShareDownload *self = VALENT_SHARE_DOWNLOAD (object);
 
+  g_clear_handle_id (&self->timeout_id, g_source_remove);
   g_clear_object (&self->device);
   g_clear_pointer (&self->items, g_ptr_array_unref);
+  g_clear_pointer (&self->slots, device_slots_release);
 
   G_OBJECT_CLASS (valent_share_download_parent_class)->finalize (object);
 }
@@ -349,6 +526,10 @@ valent_share_download_add_file (ValentShareDownload *download,
   /* FIXME: this indicates the number of total transfers, not the number of
    *        items currently available in the list model. */
   g_list_model_items_changed (G_LIST_MODEL (download), position, 0, added);
+
+  /* Start the new item immediately, if the operation is running */
+  g_clear_handle_id (&download->timeout_id, g_source_remove);
+  valent_share_download_pump (download);
 }
 
 /**
@@ -378,5 +559,7 @@ valent_share_download_update (ValentShareDownload *self,
                G_STRFUNC);
       return;
     }
+
+  valent_share_download_pump (self);
 }
 
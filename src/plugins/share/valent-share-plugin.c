@@ -1065,7 +1065,10 @@ valent_share_plugin_handle_text_cb (GFile        *file,
   g_autoptr (GError) error = NULL;
 
   if (!g_file_replace_contents_finish (file, result, NULL, &error))
-    g_warning ("Saving \"%s\": %s", g_file_peek_path (file), error->message);
+    {
+      g_warning ("Saving \"%s\": %s", g_file_peek_path (file), error->message);
+      g_file_delete (file, NULL, NULL);
+    }
 }
 
 static void
@@ -1170,38 +1173,26 @@ valent_share_plugin_update_state (ValentDevicePlugin *plugin,
 }
 
 static void
-valent_share_plugin_handle_packet (ValentDevicePlugin *plugin,
-                                   const char         *type,
-                                   JsonNode           *packet)
+valent_share_plugin_handle_request (ValentSharePlugin *self,
+                                    JsonNode          *packet)
 {
-  ValentSharePlugin *self = VALENT_SHARE_PLUGIN (plugin);
   const char *text;
   const char *url;
 
   g_assert (VALENT_IS_SHARE_PLUGIN (self));
-  g_assert (type != NULL);
   g_assert (VALENT_IS_PACKET (packet));
 
-  if (g_str_equal (type, "kdeconnect.share.request"))
-    {
-      if (valent_packet_check_field (packet, "filename"))
-        valent_share_plugin_handle_file (self, packet);
+  if (valent_packet_check_field (packet, "filename"))
+    valent_share_plugin_handle_file (self, packet);
 
-      else if (valent_packet_get_string (packet, "text", &text))
-        valent_share_plugin_handle_text (self, text);
+  else if (valent_packet_get_string (packet, "text", &text))
+    valent_share_plugin_handle_text (self, text);
 
-      else if (valent_packet_get_string (packet, "url", &url))
-        valent_share_plugin_handle_url (self, url);
+  else if (valent_packet_get_string (packet, "url", &url))
+    valent_share_plugin_handle_url (self, url);
 
-      else
-        g_warning ("%s(): unsupported share request", G_STRFUNC);
-    }
-  else if (g_str_equal (type, "kdeconnect.share.request.update"))
-    {
-      valent_share_plugin_handle_file_update (self, packet);
-    }
   else
-    g_assert_not_reached ();
+    g_warning ("%s(): unsupported share request", G_STRFUNC);
 }
 
 /*
@@ -1279,8 +1270,14 @@ valent_share_plugin_class_init (ValentSharePluginClass *klass)
 
   vobject_class->destroy = valent_share_plugin_destroy;
 
-  plugin_class->handle_packet = valent_share_plugin_handle_packet;
   plugin_class->update_state = valent_share_plugin_update_state;
+
+  valent_device_plugin_class_install_packet_handler (plugin_class,
+                                                     "kdeconnect.share.request",
+                                                     (ValentDevicePluginPacketFunc)valent_share_plugin_handle_request);
+  valent_device_plugin_class_install_packet_handler (plugin_class,
+                                                     "kdeconnect.share.request.update",
+                                                     (ValentDevicePluginPacketFunc)valent_share_plugin_handle_file_update);
 }
 
 static void
@@ -17,7 +17,7 @@
 
 struct _ValentContactRow
 {
-  GtkListBoxRow  parent_instance;
+  GtkWidget      parent_instance;
 
   EContact      *contact;
 
@@ -28,7 +28,7 @@ struct _ValentContactRow
   GtkWidget     *address_type_label;
 };
 
-G_DEFINE_FINAL_TYPE (ValentContactRow, valent_contact_row, GTK_TYPE_LIST_BOX_ROW)
+G_DEFINE_FINAL_TYPE (ValentContactRow, valent_contact_row, GTK_TYPE_WIDGET)
 
 enum {
   PROP_0,
@@ -44,6 +44,16 @@ static GParamSpec *properties[N_PROPERTIES] = { NULL, };
 /*
  * GObject
  */
+static void
+valent_contact_row_dispose (GObject *object)
+{
+  ValentContactRow *self = VALENT_CONTACT_ROW (object);
+
+  g_clear_pointer (&self->grid, gtk_widget_unparent);
+
+  G_OBJECT_CLASS (valent_contact_row_parent_class)->dispose (object);
+}
+
 static void
 valent_contact_row_finalize (GObject *object)
 {
@@ -112,11 +122,15 @@ static void
 valent_contact_row_class_init (ValentContactRowClass *klass)
 {
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
 
+  object_class->dispose = valent_contact_row_dispose;
   object_class->finalize = valent_contact_row_finalize;
   object_class->get_property = valent_contact_row_get_property;
   object_class->set_property = valent_contact_row_set_property;
 
+  gtk_widget_class_set_layout_manager_type (widget_class, GTK_TYPE_BIN_LAYOUT);
+
   /**
    * ValentContactRow:contact
    *
@@ -173,7 +187,7 @@ valent_contact_row_init (ValentContactRow *self)
                              "margin-top",     6,
                              "margin-bottom",  6,
                              NULL);
-  gtk_list_box_row_set_child (GTK_LIST_BOX_ROW (self), self->grid);
+  gtk_widget_set_parent (self->grid, GTK_WIDGET (self));
 
   self->avatar = g_object_new (ADW_TYPE_AVATAR,
                                "size",    32,
@@ -222,9 +236,9 @@ valent_contact_row_init (ValentContactRow *self)
  * @before: (nullable): a #GtkListBoxRow
  * @user_data: (closure): user supplied data
  *
- * A #GtkListBoxHeaderFunc for #ValentContactRow widgets that takes care of
- * hiding or showing the avatar and name depending on whether the row is
- * grouped with other rows for the same contact.
+ * A #GtkListBoxHeaderFunc for rows holding #ValentContactRow widgets that
+ * takes care of hiding or showing the avatar and name depending on whether the
+ * row is grouped with other rows for the same contact.
  *
  * For example, if @before is not a #ValentContactRow or for a different #EContact
  * the avatar and name will be shown, otherwise it's considered a secondary row.
@@ -235,17 +249,21 @@ valent_contact_row_header_func (GtkListBoxRow *row,
                                 gpointer       user_data)
 {
   ValentContactRow *contact_row;
+  GtkWidget *before_child = NULL;
+
+  contact_row = (ValentContactRow *)gtk_list_box_row_get_child (row);
 
-  if G_UNLIKELY (!VALENT_IS_CONTACT_ROW (row))
+  if G_UNLIKELY (!VALENT_IS_CONTACT_ROW (contact_row))
     return;
 
-  contact_row = VALENT_CONTACT_ROW (row);
+  if (before != NULL)
+    before_child = gtk_list_box_row_get_child (before);
 
   if (before == NULL)
     {
       valent_contact_row_set_compact (contact_row, FALSE);
     }
-  else if (!VALENT_IS_CONTACT_ROW (before))
+  else if (!VALENT_IS_CONTACT_ROW (before_child))
     {
       GtkWidget *label;
 
@@ -268,7 +286,7 @@ valent_contact_row_header_func (GtkListBoxRow *row,
       EContact *before_contact;
 
       row_contact = valent_contact_row_get_contact (contact_row);
-      before_contact = valent_contact_row_get_contact (VALENT_CONTACT_ROW (before));
+      before_contact = valent_contact_row_get_contact (VALENT_CONTACT_ROW (before_child));
 
       if (g_strcmp0 (e_contact_get_const (row_contact, E_CONTACT_UID),
                      e_contact_get_const (before_contact, E_CONTACT_UID)) == 0)
@@ -284,7 +302,7 @@ valent_contact_row_header_func (GtkListBoxRow *row,
  * @contact: an #EContact
  *
  * A convenience for adding a #ValentContactRow to @list for each @contact
- * number.
+ * number. Each #ValentContactRow is the child of a #GtkListBoxRow.
  */
 void
 valent_list_add_contact (GtkListBox *list,
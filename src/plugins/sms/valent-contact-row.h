@@ -10,7 +10,7 @@ G_BEGIN_DECLS
 
 #define VALENT_TYPE_CONTACT_ROW (valent_contact_row_get_type())
 
-G_DECLARE_FINAL_TYPE (ValentContactRow, valent_contact_row, VALENT, CONTACT_ROW, GtkListBoxRow)
+G_DECLARE_FINAL_TYPE (ValentContactRow, valent_contact_row, VALENT, CONTACT_ROW, GtkWidget)
 
 void         valent_list_add_contact                (GtkListBox             *list,
                                                      EContact               *contact);
@@ -18,7 +18,7 @@
 
 struct _ValentMessageRow
 {
-  GtkListBoxRow  parent_instance;
+  GtkWidget      parent_instance;
 
   ValentMessage *message;
   EContact      *contact;
@@ -30,7 +30,7 @@ struct _ValentMessageRow
   GtkWidget     *body_label;
 };
 
-G_DEFINE_FINAL_TYPE (ValentMessageRow, valent_message_row, GTK_TYPE_LIST_BOX_ROW)
+G_DEFINE_FINAL_TYPE (ValentMessageRow, valent_message_row, GTK_TYPE_WIDGET)
 
 
 enum {
@@ -47,6 +47,16 @@ static GParamSpec *properties[N_PROPERTIES] = { NULL, };
 /*
  * GObject
  */
+static void
+valent_message_row_dispose (GObject *object)
+{
+  ValentMessageRow *self = VALENT_MESSAGE_ROW (object);
+
+  g_clear_pointer (&self->grid, gtk_widget_unparent);
+
+  G_OBJECT_CLASS (valent_message_row_parent_class)->dispose (object);
+}
+
 static void
 valent_message_row_finalize (GObject *object)
 {
@@ -112,11 +122,15 @@ static void
 valent_message_row_class_init (ValentMessageRowClass *klass)
 {
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
 
+  object_class->dispose = valent_message_row_dispose;
   object_class->finalize = valent_message_row_finalize;
   object_class->get_property = valent_message_row_get_property;
   object_class->set_property = valent_message_row_set_property;
 
+  gtk_widget_class_set_layout_manager_type (widget_class, GTK_TYPE_BIN_LAYOUT);
+
   /**
    * ValentMessageRow:contact
    *
@@ -171,7 +185,7 @@ valent_message_row_init (ValentMessageRow *self)
                              "margin-top",     6,
                              "margin-bottom",  6,
                              NULL);
-  gtk_list_box_row_set_child (GTK_LIST_BOX_ROW (self), self->grid);
+  gtk_widget_set_parent (self->grid, GTK_WIDGET (self));
 
   self->avatar = g_object_new (ADW_TYPE_AVATAR,
                                "size",    32,
@@ -264,7 +278,14 @@ valent_message_row_set_contact (ValentMessageRow *row,
     return;
 
   if (row->contact != NULL)
-    valent_sms_avatar_from_contact (ADW_AVATAR (row->avatar), contact);
+    {
+      valent_sms_avatar_from_contact (ADW_AVATAR (row->avatar), contact);
+    }
+  else
+    {
+      adw_avatar_set_custom_image (ADW_AVATAR (row->avatar), NULL);
+      adw_avatar_set_text (ADW_AVATAR (row->avatar), NULL);
+    }
 
   valent_message_row_update (row);
   g_object_notify_by_pspec (G_OBJECT (row), properties [PROP_CONTACT]);
@@ -337,8 +358,9 @@ valent_message_row_set_message (ValentMessageRow *row,
                                 row);
 
       valent_message_row_update (row);
-      g_object_notify_by_pspec (G_OBJECT (row), properties [PROP_MESSAGE]);
     }
+
+  g_object_notify_by_pspec (G_OBJECT (row), properties [PROP_MESSAGE]);
 }
 
 /**
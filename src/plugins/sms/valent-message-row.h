@@ -12,7 +12,7 @@ G_BEGIN_DECLS
 
 #define VALENT_TYPE_MESSAGE_ROW (valent_message_row_get_type())
 
-G_DECLARE_FINAL_TYPE (ValentMessageRow, valent_message_row, VALENT, MESSAGE_ROW, GtkListBoxRow)
+G_DECLARE_FINAL_TYPE (ValentMessageRow, valent_message_row, VALENT, MESSAGE_ROW, GtkWidget)
 
 GtkWidget     * valent_message_row_new           (ValentMessage    *message,
                                                   EContact         *contact);
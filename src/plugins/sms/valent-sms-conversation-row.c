@@ -10,6 +10,7 @@
 #include <pango/pango.h>
 #include <valent.h>
 
+#include "valent-date-label.h"
 #include "valent-message.h"
 #include "valent-sms-conversation-row.h"
 #include "valent-sms-utils.h"
@@ -17,19 +18,21 @@
 
 struct _ValentSmsConversationRow
 {
-  GtkListBoxRow  parent_instance;
+  GtkWidget      parent_instance;
 
   ValentMessage *message;
   EContact      *contact;
   unsigned int   incoming : 1;
 
+  GtkWidget     *layout;
+  GtkWidget     *date_label;
   GtkWidget     *grid;
   GtkWidget     *avatar;
   GtkWidget     *bubble;
   GtkWidget     *text_label;
 };
 
-G_DEFINE_FINAL_TYPE (ValentSmsConversationRow, valent_sms_conversation_row, GTK_TYPE_LIST_BOX_ROW)
+G_DEFINE_FINAL_TYPE (ValentSmsConversationRow, valent_sms_conversation_row, GTK_TYPE_WIDGET)
 
 
 enum {
@@ -72,6 +75,16 @@ valent_sms_conversation_row_activate_link (GtkLabel   *label,
 /*
  * GObject
  */
+static void
+valent_sms_conversation_row_dispose (GObject *object)
+{
+  ValentSmsConversationRow *self = VALENT_SMS_CONVERSATION_ROW (object);
+
+  g_clear_pointer (&self->layout, gtk_widget_unparent);
+
+  G_OBJECT_CLASS (valent_sms_conversation_row_parent_class)->dispose (object);
+}
+
 static void
 valent_sms_conversation_row_finalize (GObject *object)
 {
@@ -142,11 +155,15 @@ static void
 valent_sms_conversation_row_class_init (ValentSmsConversationRowClass *klass)
 {
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
 
+  object_class->dispose = valent_sms_conversation_row_dispose;
   object_class->finalize = valent_sms_conversation_row_finalize;
   object_class->get_property = valent_sms_conversation_row_get_property;
   object_class->set_property = valent_sms_conversation_row_set_property;
 
+  gtk_widget_class_set_layout_manager_type (widget_class, GTK_TYPE_BIN_LAYOUT);
+
   /**
    * ValentSmsConversationRow:contact
    *
@@ -194,6 +211,20 @@ valent_sms_conversation_row_init (ValentSmsConversationRow *self)
 {
   gtk_widget_add_css_class (GTK_WIDGET (self), "valent-sms-conversation-row");
 
+  self->layout = g_object_new (GTK_TYPE_BOX,
+                               "orientation", GTK_ORIENTATION_VERTICAL,
+                               NULL);
+  gtk_widget_set_parent (self->layout, GTK_WIDGET (self));
+
+  /* Date Header */
+  self->date_label = g_object_new (VALENT_TYPE_DATE_LABEL,
+                                   "halign",     GTK_ALIGN_CENTER,
+                                   "margin-top", 6,
+                                   "visible",    FALSE,
+                                   NULL);
+  gtk_widget_add_css_class (self->date_label, "dim-label");
+  gtk_box_append (GTK_BOX (self->layout), self->date_label);
+
   self->grid = g_object_new (GTK_TYPE_GRID,
                              "can-focus",      FALSE,
                              "column-spacing", 6,
@@ -203,7 +234,7 @@ valent_sms_conversation_row_init (ValentSmsConversationRow *self)
                              "margin-top",     6,
                              "margin-bottom",  6,
                              NULL);
-  gtk_list_box_row_set_child (GTK_LIST_BOX_ROW (self), self->grid);
+  gtk_box_append (GTK_BOX (self->layout), self->grid);
 
   /* Contact Avatar */
   self->avatar = g_object_new (ADW_TYPE_AVATAR,
@@ -291,7 +322,14 @@ valent_sms_conversation_row_set_contact (ValentSmsConversationRow *row,
     return;
 
   if (row->contact != NULL)
-    valent_sms_avatar_from_contact (ADW_AVATAR (row->avatar), contact);
+    {
+      valent_sms_avatar_from_contact (ADW_AVATAR (row->avatar), contact);
+    }
+  else
+    {
+      adw_avatar_set_custom_image (ADW_AVATAR (row->avatar), NULL);
+      adw_avatar_set_text (ADW_AVATAR (row->avatar), NULL);
+    }
 
   valent_sms_conversation_row_update (row);
   g_object_notify_by_pspec (G_OBJECT (row), properties [PROP_CONTACT]);
@@ -434,6 +472,29 @@ valent_sms_conversation_row_show_avatar (ValentSmsConversationRow *row,
   gtk_widget_set_visible (row->avatar, visible);
 }
 
+/**
+ * valent_sms_conversation_row_show_date:
+ * @row: a #ValentSmsConversationRow
+ * @visible: Whether to show the date
+ *
+ * Show or hide a date label above the message, for rows that begin a new
+ * span of conversation.
+ */
+void
+valent_sms_conversation_row_show_date (ValentSmsConversationRow *row,
+                                       gboolean                  visible)
+{
+  g_return_if_fail (VALENT_IS_SMS_CONVERSATION_ROW (row));
+
+  if (visible && row->message != NULL)
+    {
+      valent_date_label_set_date (VALENT_DATE_LABEL (row->date_label),
+                                  valent_message_get_date (row->message));
+    }
+
+  gtk_widget_set_visible (row->date_label, visible);
+}
+
 /**
  * valent_sms_conversation_row_update:
  * @row: a #ValentSmsConversationRow
@@ -481,7 +542,6 @@ valent_sms_conversation_row_update (ValentSmsConversationRow *row)
 
       gtk_widget_remove_css_class (row->bubble, "valent-sms-outgoing");
       gtk_widget_add_css_class (row->bubble, "valent-sms-incoming");
-      gtk_widget_set_halign (GTK_WIDGET (row), GTK_ALIGN_START);
     }
   else
     {
@@ -491,7 +551,6 @@ valent_sms_conversation_row_update (ValentSmsConversationRow *row)
 
       gtk_widget_remove_css_class (row->bubble, "valent-sms-incoming");
       gtk_widget_add_css_class (row->bubble, "valent-sms-outgoing");
-      gtk_widget_set_halign (GTK_WIDGET (row), GTK_ALIGN_END);
     }
 }
 
@@ -12,7 +12,7 @@ G_BEGIN_DECLS
 
 #define VALENT_TYPE_SMS_CONVERSATION_ROW (valent_sms_conversation_row_get_type())
 
-G_DECLARE_FINAL_TYPE (ValentSmsConversationRow, valent_sms_conversation_row, VALENT, SMS_CONVERSATION_ROW, GtkListBoxRow)
+G_DECLARE_FINAL_TYPE (ValentSmsConversationRow, valent_sms_conversation_row, VALENT, SMS_CONVERSATION_ROW, GtkWidget)
 
 GtkWidget     * valent_sms_conversation_row_new           (ValentMessage            *message,
                                                            EContact                 *contact);
@@ -31,6 +31,8 @@ gboolean        valent_sms_conversation_row_is_incoming   (ValentSmsConversation
 void            valent_sms_conversation_row_update        (ValentSmsConversationRow *row);
 void            valent_sms_conversation_row_show_avatar   (ValentSmsConversationRow *row,
                                                            gboolean                  visible);
+void            valent_sms_conversation_row_show_date     (ValentSmsConversationRow *row,
+                                                           gboolean                  visible);
 
 G_END_DECLS
 
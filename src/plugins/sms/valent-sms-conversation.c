@@ -24,23 +24,21 @@ struct _ValentSmsConversation
 
   /* template */
   GtkWidget          *message_view;
-  GtkListBox         *message_list;
+  GtkListView        *message_list;
   GtkWidget          *message_entry;
-  GtkListBoxRow      *pending;
 
-  /* Population */
-  guint               populate_id;
+  /* Scrolling */
   guint               update_id;
-  double              offset;
   GtkAdjustment      *vadjustment;
+  int64_t             scroll_date;
+  unsigned int        at_bottom : 1;
 
   /* Thread Resources */
   int64_t             loaded_id;
   int64_t             thread_id;
   ValentSmsStore     *message_store;
   GListModel         *thread;
-  unsigned int        position_upper;
-  unsigned int        position_lower;
+  GHashTable         *bound_items;
   ValentContactStore *contact_store;
   GHashTable         *participants;
 
@@ -85,7 +83,9 @@ phone_lookup_cb (ValentContactStore *store,
 
   if (contact == NULL)
     {
-      g_warning ("%s(): %s", G_STRFUNC, error->message);
+      if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        g_warning ("%s(): %s", G_STRFUNC, error->message);
+
       return;
     }
 
@@ -108,183 +108,132 @@ phone_lookup_cb (ValentContactStore *store,
     }
 }
 
-static void
-valent_sms_conversation_scroll_to_row (ValentSmsConversation *self,
-                                       GtkWidget             *widget)
+static EContact *
+valent_sms_conversation_lookup_participant (ValentSmsConversation *self,
+                                            const char            *sender)
 {
-  GtkScrolledWindow *scrolled = GTK_SCROLLED_WINDOW (self->message_view);
-  GtkWidget *viewport;
-  double upper, page_size;
-  double x, y;
+  GHashTableIter iter;
+  const char *address = NULL;
+  EContact *contact = NULL;
 
-  /* Get the scrolled window state */
-  upper = gtk_adjustment_get_upper (self->vadjustment);
-  page_size = gtk_adjustment_get_page_size (self->vadjustment);
+  g_hash_table_iter_init (&iter, self->participants);
 
-  /* Get the widget's position in the window */
-  viewport = gtk_scrolled_window_get_child (scrolled);
-  gtk_widget_translate_coordinates (widget, viewport, 0, 0, &x, &y);
+  while (g_hash_table_iter_next (&iter, (void **)&address, (void **)&contact))
+    {
+      if (valent_phone_number_equal (sender, address))
+        return contact;
+    }
 
-  /* Scroll to the position */
-  gtk_adjustment_set_value (self->vadjustment, CLAMP (y, page_size, upper));
+  return NULL;
 }
 
-static void
-message_list_header_func (GtkListBoxRow *row,
-                          GtkListBoxRow *before,
-                          gpointer       user_data)
+/*
+ * Message List
+ */
+static gboolean
+message_list_show_date (ValentSmsConversation *self,
+                        unsigned int           position)
 {
-  ValentSmsConversation *self = VALENT_SMS_CONVERSATION (user_data);
-  ValentSmsConversationRow *mrow = VALENT_SMS_CONVERSATION_ROW (row);
-  ValentSmsConversationRow *brow = VALENT_SMS_CONVERSATION_ROW (before);
-  int64_t row_date, before_date;
-  gboolean row_incoming, before_incoming;
+  g_autoptr (ValentMessage) message = NULL;
+  g_autoptr (ValentMessage) before = NULL;
 
-  g_assert (GTK_IS_LIST_BOX_ROW (row));
-  g_assert (before == NULL || GTK_IS_LIST_BOX_ROW (before));
+  if (position == 0)
+    return TRUE;
 
-  /* TODO Skip pending */
-  if G_UNLIKELY (row == self->pending)
-    return;
+  message = g_list_model_get_item (self->thread, position);
+  before = g_list_model_get_item (self->thread, position - 1);
 
-  row_incoming = valent_sms_conversation_row_is_incoming (mrow);
-
-  /* If this is the first row and it's incoming, show the avatar */
-  if (before == NULL)
-    {
-      if (row_incoming)
-        valent_sms_conversation_row_show_avatar (mrow, TRUE);
-      return;
-    }
-
-  /* Date header */
-  before_incoming = valent_sms_conversation_row_is_incoming (brow);
-  before_date = valent_sms_conversation_row_get_date (brow);
-  row_date = valent_sms_conversation_row_get_date (mrow);
+  if (message == NULL || before == NULL)
+    return TRUE;
 
   /* If it's been more than an hour between messages, show a date label */
-  if (row_date - before_date > G_TIME_SPAN_HOUR / 1000)
-    {
-      /* Show a human-readable time span label */
-      if G_UNLIKELY (gtk_list_box_row_get_header (row) == NULL)
-        {
-          GtkWidget *header;
-
-          header = valent_date_label_new (row_date);
-          gtk_widget_add_css_class (header, "dim-label");
-          gtk_list_box_row_set_header (row, header);
+  return (valent_message_get_date (message) - valent_message_get_date (before)
+          > G_TIME_SPAN_HOUR / 1000);
+}
 
-          /* If the row's message is incoming, show the avatar also */
-          if (row_incoming)
-            valent_sms_conversation_row_show_avatar (mrow, row_incoming);
-        }
-    }
-  else if (row_incoming)
-    {
-      valent_sms_conversation_row_show_avatar (mrow, TRUE);
+static void
+message_list_setup (GtkListItemFactory    *factory,
+                    GtkListItem           *list_item,
+                    ValentSmsConversation *self)
+{
+  GtkWidget *row;
 
-      /* If the previous row was incoming, hide its avatar */
-      if (before_incoming)
-        valent_sms_conversation_row_show_avatar (mrow, FALSE);
-    }
+  row = g_object_new (VALENT_TYPE_SMS_CONVERSATION_ROW, NULL);
+  gtk_list_item_set_child (list_item, row);
+  gtk_list_item_set_activatable (list_item, FALSE);
+  gtk_list_item_set_selectable (list_item, FALSE);
 }
 
-/**
- * valent_sms_conversation_insert_message:
- * @conversation: a #ValentSmsConversation
- * @message: a #ValentMessage
- * @position: position to insert the widget
- *
- * Create a new message row for @message and insert it into the message list at
- * @position.
- *
- * Returns: (transfer none): a #GtkWidget
- */
-static GtkWidget *
-valent_sms_conversation_insert_message (ValentSmsConversation *self,
-                                        ValentMessage         *message,
-                                        int                    position)
+static void
+message_list_bind (GtkListItemFactory    *factory,
+                   GtkListItem           *list_item,
+                   ValentSmsConversation *self)
 {
   ValentSmsConversationRow *row;
+  ValentMessage *message;
+  unsigned int position;
   const char *sender = NULL;
-  EContact *contact = NULL;
 
-  g_assert (VALENT_IS_SMS_CONVERSATION (self));
-  g_assert (VALENT_IS_MESSAGE (message));
+  row = VALENT_SMS_CONVERSATION_ROW (gtk_list_item_get_child (list_item));
+  message = VALENT_MESSAGE (gtk_list_item_get_item (list_item));
+  position = gtk_list_item_get_position (list_item);
 
-  /* Create the row */
-  row = g_object_new (VALENT_TYPE_SMS_CONVERSATION_ROW,
-                      "message",     message,
-                      "activatable", FALSE,
-                      "selectable",  FALSE,
-                      NULL);
+  valent_sms_conversation_row_set_message (row, message);
+  valent_sms_conversation_row_show_date (row, message_list_show_date (self, position));
+  g_hash_table_add (self->bound_items, list_item);
 
   /* If the message has a sender, try to lookup the contact */
   if ((sender = valent_message_get_sender (message)) != NULL)
     {
-      GHashTableIter iter;
-      const char *address = NULL;
+      EContact *contact;
 
-      g_hash_table_iter_init (&iter, self->participants);
+      contact = valent_sms_conversation_lookup_participant (self, sender);
 
-      while (g_hash_table_iter_next (&iter, (void **)&address, (void **)&contact))
+      if (contact != NULL)
         {
-          if (valent_phone_number_equal (sender, address))
-            {
-              valent_sms_conversation_row_set_contact (row, contact);
-              break;
-            }
-
-          contact = NULL;
+          valent_sms_conversation_row_set_contact (row, contact);
         }
-
-      if (contact == NULL)
+      else if (self->contact_store != NULL)
         {
+          g_autoptr (GCancellable) cancellable = NULL;
+
+          /* Cancelled if the row is recycled before the lookup completes */
+          cancellable = g_cancellable_new ();
+          g_object_set_data_full (G_OBJECT (list_item),
+                                  "valent-sms-cancellable",
+                                  g_object_ref (cancellable),
+                                  g_object_unref);
+
           valent_sms_contact_from_phone (self->contact_store,
                                          sender,
-                                         NULL,
+                                         cancellable,
                                          (GAsyncReadyCallback)phone_lookup_cb,
-                                         g_object_ref_sink (row));
+                                         g_object_ref (row));
         }
     }
-
-  /* Insert the row into the message list */
-  gtk_list_box_insert (self->message_list, GTK_WIDGET (row), position);
-
-  return GTK_WIDGET (row);
 }
 
-#if 0
-/**
- * valent_conversation_remove_message:
- * @conversation: a #ValentSmsConversation
- * @message: a #ValentMessage
- *
- * Remove a message from the conversation.
- */
 static void
-valent_sms_conversation_remove_message (ValentSmsConversation *conversation,
-                                        int64_t                message_id)
+message_list_unbind (GtkListItemFactory    *factory,
+                     GtkListItem           *list_item,
+                     ValentSmsConversation *self)
 {
-  GtkWidget *child;
+  ValentSmsConversationRow *row;
+  GCancellable *cancellable;
 
-  g_assert (VALENT_IS_SMS_CONVERSATION (conversation));
-  g_assert (message_id > 0);
+  row = VALENT_SMS_CONVERSATION_ROW (gtk_list_item_get_child (list_item));
+  cancellable = g_object_get_data (G_OBJECT (list_item), "valent-sms-cancellable");
 
-  for (child = gtk_widget_get_first_child (GTK_WIDGET (conversation->message_list));
-       child != NULL;
-       child = gtk_widget_get_next_sibling (child))
+  if (cancellable != NULL)
     {
-      ValentSmsConversationRow *row = VALENT_SMS_CONVERSATION_ROW (child);
-
-      if (valent_sms_conversation_row_get_id (row) == message_id)
-        {
-          gtk_list_box_remove (conversation->message_list, child);
-          break;
-        }
+      g_cancellable_cancel (cancellable);
+      g_object_set_data (G_OBJECT (list_item), "valent-sms-cancellable", NULL);
     }
+
+  valent_sms_conversation_row_set_message (row, NULL);
+  valent_sms_conversation_row_set_contact (row, NULL);
+  g_hash_table_remove (self->bound_items, list_item);
 }
-#endif
 
 /*
  * Message Entry Callbacks
@@ -318,106 +267,57 @@ on_entry_changed (GtkEntry              *entry,
 /*
  * Auto-scroll
  */
-static inline ValentMessage *
-valent_sms_conversation_pop_tail (ValentSmsConversation *self)
-{
-  if G_UNLIKELY (self->thread == NULL)
-    return NULL;
-
-  if (self->position_lower == 0)
-    return NULL;
-
-  self->position_lower -= 1;
-
-  return g_list_model_get_item (self->thread, self->position_lower);
-}
-
-#if 0
-static inline ValentMessage *
-valent_sms_conversation_pop_head (ValentSmsConversation *self)
+static unsigned int
+valent_sms_conversation_find_date (ValentSmsConversation *self,
+                                   int64_t                date)
 {
-  if G_UNLIKELY (self->thread == NULL)
-    return NULL;
-
-  if (self->position_upper == g_list_model_get_n_items (self->thread) - 1)
-    return NULL;
+  unsigned int lower = 0;
+  unsigned int upper;
 
-  self->position_upper += 1;
+  g_assert (self->thread != NULL);
 
-  return g_list_model_get_item (self->thread, self->position_upper);
-}
-#endif
+  upper = g_list_model_get_n_items (self->thread);
 
-static void
-valent_sms_conversation_populate_reverse (ValentSmsConversation *self)
-{
-  unsigned int count = 10;
-  unsigned int n_items;
-
-  if G_UNLIKELY (self->thread == NULL)
-    return;
-
-  if ((n_items = g_list_model_get_n_items (self->thread)) == 0)
-    return;
-
-  if (self->position_upper == self->position_lower)
-    {
-      self->position_lower = n_items;
-      self->position_upper = n_items - 1;
-    }
-
-  for (unsigned int i = 0; i < count; i++)
+  /* Messages are in ascending order by date, so find the last message that is
+   * equal or older than @date */
+  while (lower < upper)
     {
       g_autoptr (ValentMessage) message = NULL;
+      unsigned int mid = lower + (upper - lower) / 2;
 
-      if ((message = valent_sms_conversation_pop_tail (self)) == NULL)
-        break;
+      message = g_list_model_get_item (self->thread, mid);
 
-      valent_sms_conversation_insert_message (self, message, 0);
+      if (valent_message_get_date (message) <= date)
+        lower = mid + 1;
+      else
+        upper = mid;
     }
 
-  gtk_list_box_invalidate_headers (self->message_list);
+  return (lower > 0) ? lower - 1 : 0;
 }
 
-static gboolean
-valent_sms_conversation_populate (gpointer data)
-{
-  ValentSmsConversation *self = VALENT_SMS_CONVERSATION (data);
-  double upper, value;
-
-  upper = gtk_adjustment_get_upper (self->vadjustment);
-  value = gtk_adjustment_get_value (self->vadjustment);
-
-  self->offset = upper - value;
-  valent_sms_conversation_populate_reverse (self);
-  self->populate_id = 0;
-
-  return G_SOURCE_REMOVE;
-}
-
-static inline void
-valent_sms_conversation_queue_populate (ValentSmsConversation *self)
+static void
+valent_sms_conversation_scroll_to_position (ValentSmsConversation *self,
+                                            unsigned int           position)
 {
-  if (self->populate_id > 0)
-    return;
-
-  self->populate_id = g_idle_add_full (G_PRIORITY_LOW,
-                                       valent_sms_conversation_populate,
-                                       g_object_ref (self),
-                                       g_object_unref);
+  self->at_bottom = FALSE;
+  gtk_widget_activate_action (GTK_WIDGET (self->message_list),
+                              "list.scroll-to-item",
+                              "u",
+                              position);
 }
 
 static gboolean
 valent_sms_conversation_update (gpointer data)
 {
   ValentSmsConversation *self = VALENT_SMS_CONVERSATION (data);
-  double value;
+  double upper, page_size;
 
-  if (self->offset > 0)
+  if (self->at_bottom)
     {
-      value = gtk_adjustment_get_upper (self->vadjustment) - self->offset;
-      self->offset = 0;
-      gtk_adjustment_set_value (self->vadjustment, value);
+      upper = gtk_adjustment_get_upper (self->vadjustment);
+      page_size = gtk_adjustment_get_page_size (self->vadjustment);
+      gtk_adjustment_set_value (self->vadjustment, upper - page_size);
     }
 
   self->update_id = 0;
@@ -438,15 +338,18 @@ valent_sms_conversation_queue_update (ValentSmsConversation *self)
 }
 
 static void
-on_edge_overshot (GtkScrolledWindow     *scrolled_window,
-                  GtkPositionType        pos,
-                  ValentSmsConversation *self)
+on_scroll_notify_value (GtkAdjustment         *adjustment,
+                        GParamSpec            *pspec,
+                        ValentSmsConversation *self)
 {
-  if (pos == GTK_POS_TOP)
-    valent_sms_conversation_queue_populate (self);
+  double upper, page_size, value;
 
-  if (pos == GTK_POS_BOTTOM)
-    self->offset = 0;
+  upper = gtk_adjustment_get_upper (adjustment);
+  page_size = gtk_adjustment_get_page_size (adjustment);
+  value = gtk_adjustment_get_value (adjustment);
+
+  /* Follow new messages only when scrolled to the end of the conversation */
+  self->at_bottom = (value >= upper - page_size - 1.0);
 }
 
 static void
@@ -467,60 +370,51 @@ on_thread_items_changed (GListModel            *model,
                          unsigned int           added,
                          ValentSmsConversation *self)
 {
-  unsigned int position_upper, position_lower;
-  unsigned int position_real;
-  int diff;
-
   g_assert (VALENT_IS_MESSAGE_THREAD (model));
   g_assert (VALENT_IS_SMS_CONVERSATION (self));
 
-  position_upper = self->position_upper;
-  position_lower = self->position_lower;
-  position_real = position_lower + position;
-
-  /* First update the internal pointers */
-  diff = added - removed;
-
-  if (position <= position_lower)
-    self->position_lower += diff;
+  /* The message following the change has a new predecessor, so its date label
+   * may need to be shown or hidden */
+  if (position + added < g_list_model_get_n_items (model))
+    {
+      g_autoptr (ValentMessage) next = NULL;
+      GHashTableIter iter;
+      GtkListItem *list_item;
 
-  if (position <= position_upper)
-    self->position_upper += diff;
+      next = g_list_model_get_item (model, position + added);
 
-  /* If the upper and lower are equal and we're being notified of additions,
-   * then this must be the initial load */
-  if (self->position_lower == self->position_upper && added)
-    {
-      valent_sms_conversation_queue_populate (self);
-      return;
-    }
+      g_hash_table_iter_init (&iter, self->bound_items);
 
-  /* If the position is in between our pointers we have to handle them */
-  if (position >= position_lower && position <= position_upper)
-    {
-      /* Removals first */
-      for (unsigned int i = 0; i < removed; i++)
+      while (g_hash_table_iter_next (&iter, (void **)&list_item, NULL))
         {
-          GtkListBoxRow *row;
+          if (gtk_list_item_get_item (list_item) == (gpointer)next)
+            {
+              GtkWidget *row = gtk_list_item_get_child (list_item);
 
-          row = gtk_list_box_get_row_at_index (self->message_list, position_real);
-          gtk_list_box_remove (self->message_list, GTK_WIDGET (row));
+              valent_sms_conversation_row_show_date (VALENT_SMS_CONVERSATION_ROW (row),
+                                                     message_list_show_date (self, position + added));
+              break;
+            }
         }
+    }
 
-      /* Additions */
-      for (unsigned int i = 0; i < added; i++)
-        {
-          g_autoptr (ValentMessage) message = NULL;
+  /* The thread is loaded asynchronously, so scroll requests may be deferred
+   * until the first items arrive */
+  if (self->scroll_date > 0 && g_list_model_get_n_items (model) > 0)
+    {
+      unsigned int scroll_position;
 
-          message = g_list_model_get_item (self->thread, position + i);
-          valent_sms_conversation_insert_message (self, message, position_real + i);
-        }
+      scroll_position = valent_sms_conversation_find_date (self, self->scroll_date);
+      self->scroll_date = 0;
+      valent_sms_conversation_scroll_to_position (self, scroll_position);
     }
 }
 
 static void
 valent_sms_conversation_load (ValentSmsConversation *self)
 {
+  g_autoptr (GtkNoSelection) selection = NULL;
+
   if (self->message_store == NULL || self->thread_id == self->loaded_id)
     return;
 
@@ -534,6 +428,9 @@ valent_sms_conversation_load (ValentSmsConversation *self)
                     "items-changed",
                     G_CALLBACK (on_thread_items_changed),
                     self);
+
+  selection = gtk_no_selection_new (g_object_ref (self->thread));
+  gtk_list_view_set_model (self->message_list, GTK_SELECTION_MODEL (selection));
 }
 
 static void
@@ -638,6 +535,7 @@ valent_sms_conversation_finalize (GObject *object)
   g_clear_object (&self->message_store);
   g_clear_object (&self->contact_store);
   g_clear_pointer (&self->participants, g_hash_table_unref);
+  g_clear_pointer (&self->bound_items, g_hash_table_unref);
   g_clear_pointer (&self->title, g_free);
   g_clear_pointer (&self->subtitle, g_free);
 
@@ -715,9 +613,7 @@ valent_sms_conversation_class_init (ValentSmsConversationClass *klass)
   gtk_widget_class_bind_template_child (widget_class, ValentSmsConversation, message_list);
   gtk_widget_class_bind_template_child (widget_class, ValentSmsConversation, message_entry);
   gtk_widget_class_bind_template_child (widget_class, ValentSmsConversation, message_view);
-  gtk_widget_class_bind_template_child (widget_class, ValentSmsConversation, pending);
 
-  gtk_widget_class_bind_template_callback (widget_class, on_edge_overshot);
   gtk_widget_class_bind_template_callback (widget_class, on_entry_activated);
   gtk_widget_class_bind_template_callback (widget_class, on_entry_changed);
   gtk_widget_class_bind_template_callback (widget_class, on_entry_icon_release);
@@ -791,6 +687,7 @@ static void
 valent_sms_conversation_init (ValentSmsConversation *self)
 {
   GtkScrolledWindow *scrolled;
+  g_autoptr (GtkListItemFactory) factory = NULL;
 
   gtk_widget_init_template (GTK_WIDGET (self));
 
@@ -801,13 +698,34 @@ valent_sms_conversation_init (ValentSmsConversation *self)
                           "notify::upper",
                           G_CALLBACK (on_scroll_notify_upper),
                           self);
-
-  gtk_list_box_set_header_func (self->message_list,
-                                message_list_header_func,
-                                self, NULL);
+  g_signal_connect (self->vadjustment,
+                    "notify::value",
+                    G_CALLBACK (on_scroll_notify_value),
+                    self);
+  self->at_bottom = TRUE;
+
+  /* Rows are recycled as the view scrolls */
+  factory = gtk_signal_list_item_factory_new ();
+  g_signal_connect_object (factory,
+                           "setup",
+                           G_CALLBACK (message_list_setup),
+                           self,
+                           0);
+  g_signal_connect_object (factory,
+                           "bind",
+                           G_CALLBACK (message_list_bind),
+                           self,
+                           0);
+  g_signal_connect_object (factory,
+                           "unbind",
+                           G_CALLBACK (message_list_unbind),
+                           self,
+                           0);
+  gtk_list_view_set_factory (self->message_list, factory);
 
   self->participants = g_hash_table_new_full (g_str_hash, g_str_equal,
                                               g_free,     g_object_unref);
+  self->bound_items = g_hash_table_new (NULL, NULL);
 }
 
 GtkWidget *
@@ -847,9 +765,6 @@ void
 valent_sms_conversation_set_thread_id (ValentSmsConversation *conversation,
                                        int64_t                thread_id)
 {
-  GtkWidget *parent = GTK_WIDGET (conversation->message_list);
-  GtkWidget *child;
-
   g_return_if_fail (VALENT_IS_SMS_CONVERSATION (conversation));
   g_return_if_fail (thread_id >= 0);
 
@@ -863,8 +778,9 @@ valent_sms_conversation_set_thread_id (ValentSmsConversation *conversation,
       g_clear_object (&conversation->thread);
     }
 
-  while ((child = gtk_widget_get_first_child (parent)))
-    gtk_list_box_remove (conversation->message_list, child);
+  gtk_list_view_set_model (conversation->message_list, NULL);
+  conversation->at_bottom = TRUE;
+  conversation->scroll_date = 0;
 
   /* Notify before beginning the load task */
   conversation->thread_id = thread_id;
@@ -961,45 +877,21 @@ void
 valent_sms_conversation_scroll_to_date (ValentSmsConversation *conversation,
                                         int64_t                date)
 {
-  GtkWidget *row;
-  ValentMessage *message;
+  unsigned int position;
 
   g_return_if_fail (VALENT_IS_SMS_CONVERSATION (conversation));
   g_return_if_fail (date > 0);
 
-  /* First look through the list box */
-  for (row = gtk_widget_get_last_child (GTK_WIDGET (conversation->message_list));
-       row != NULL;
-       row = gtk_widget_get_prev_sibling (row))
+  /* If the thread hasn't loaded yet, scroll when it does */
+  if (conversation->thread == NULL ||
+      g_list_model_get_n_items (conversation->thread) == 0)
     {
-      if G_UNLIKELY (GTK_LIST_BOX_ROW (row) == conversation->pending)
-        continue;
-
-      /* If this message is equal or older than the target date, we're done */
-      if (valent_sms_conversation_row_get_date (VALENT_SMS_CONVERSATION_ROW (row)) <= date)
-        {
-          valent_sms_conversation_scroll_to_row (conversation, row);
-          return;
-        }
+      conversation->scroll_date = date;
+      return;
     }
 
-  /* If there are no more messages, we're done */
-  g_return_if_fail (VALENT_IS_MESSAGE_THREAD (conversation->thread));
-
-  /* Populate the list in reverse until we find the message */
-  while ((message = valent_sms_conversation_pop_tail (conversation)) != NULL)
-    {
-      /* Prepend the message */
-      row = valent_sms_conversation_insert_message (conversation, message, 0);
-      g_object_unref (message);
-
-      /* If this message is equal or older than the target date, we're done */
-      if (valent_message_get_date (message) <= date)
-        {
-          valent_sms_conversation_scroll_to_row (conversation, row);
-          return;
-        }
-   }
+  position = valent_sms_conversation_find_date (conversation, date);
+  valent_sms_conversation_scroll_to_position (conversation, position);
 }
 
 /**
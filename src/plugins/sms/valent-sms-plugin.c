@@ -15,6 +15,9 @@
 #include "valent-sms-store.h"
 #include "valent-sms-window.h"
 
+/* The number of messages added to the store in each transaction */
+#define MESSAGES_BATCH_SIZE (100)
+
 
 struct _ValentSmsPlugin
 {
@@ -165,108 +168,218 @@ valent_sms_plugin_deserialize_message (ValentSmsPlugin *self,
                        NULL);
 }
 
-/**
- * messages_is_thread:
- * @messages: a #JsonArray
- *
- * Check if @messages is a thread of messages, or a summary of threads.
+/*
+ * Messages are read from the stream as they arrive. A thread of messages is
+ * added to the store in batches, with the next batch read only once the
+ * previous one has been committed, while for a summary of threads each new
+ * thread is requested in turn.
  *
- * Returns: %TRUE if @messages is a conversation thread
+ * TODO: A thread with a single message can't be distinguished from a summary
+ *       with a single thread; in fact both could be true. If we assume the
+ *       latter is true exclusively, we will get caught in a loop requesting the
+ *       full thread.
  */
-static gboolean
-messages_is_thread (JsonArray *messages)
+typedef struct
+{
+  ValentSmsPlugin    *plugin;
+  ValentPacketStream *stream;
+  GCancellable       *cancellable;
+  GPtrArray          *batch;
+  JsonNode           *first;
+  unsigned int        n_messages;
+  gboolean            is_thread;
+} MessagesState;
+
+static void
+messages_state_free (gpointer data)
+{
+  MessagesState *state = data;
+
+  g_clear_object (&state->plugin);
+  g_clear_object (&state->stream);
+  g_clear_object (&state->cancellable);
+  g_clear_pointer (&state->batch, g_ptr_array_unref);
+  g_clear_pointer (&state->first, json_node_unref);
+  g_free (state);
+}
+
+static void   valent_sms_plugin_read_messages (MessagesState *state);
+
+static void
+valent_sms_plugin_handle_message (MessagesState *state,
+                                  JsonNode      *message)
 {
-  JsonObject *message;
-  int64_t first, second;
+  ValentSmsPlugin *self = state->plugin;
+  JsonObject *object;
+  int64_t thread_id;
+  int64_t thread_date;
+  int64_t cache_date;
 
-  /* TODO: A thread with a single message can't be distinguished from
-   *       a summary with a single thread; in fact both could be true.
-   *       If we assume the latter is true exclusively, we will get
-   *       caught in a loop requesting the full thread. */
-  if (json_array_get_length (messages) < 2)
-    return TRUE;
+  /* If this is a thread of messages we'll add them to the store */
+  if (state->is_thread)
+    {
+      g_ptr_array_add (state->batch,
+                       valent_sms_plugin_deserialize_message (self, message));
+      return;
+    }
 
-  message = json_array_get_object_element (messages, 0);
-  first = json_object_get_int_member (message, "thread_id");
+  /* If this is a summary of threads we'll request each new thread */
+  object = json_node_get_object (message);
+  thread_id = json_object_get_int_member (object, "thread_id");
+  thread_date = json_object_get_int_member (object, "date");
 
-  message = json_array_get_object_element (messages, 1);
-  second = json_object_get_int_member (message, "thread_id");
+  /* Get the last cached date and compare timestamps */
+  cache_date = valent_sms_store_get_thread_date (self->store, thread_id);
 
-  return first == second;
+  if (cache_date < thread_date)
+    valent_sms_plugin_request_conversation (self, thread_id, cache_date, 0);
 }
 
 static void
-valent_sms_plugin_handle_thread (ValentSmsPlugin *self,
-                                 JsonArray       *messages)
+valent_sms_store_add_messages_cb (ValentSmsStore *store,
+                                  GAsyncResult   *result,
+                                  gpointer        user_data)
 {
-  g_autoptr (GPtrArray) results = NULL;
-  unsigned int n_messages;
+  g_autoptr (GError) error = NULL;
+  MessagesState *state = user_data;
 
-  g_assert (VALENT_IS_SMS_PLUGIN (self));
-  g_assert (messages != NULL);
+  if (!valent_sms_store_add_messages_finish (store, result, &error) &&
+      !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    g_warning ("%s(): %s", G_STRFUNC, error->message);
+
+  if (state == NULL)
+    return;
+
+  if (error != NULL)
+    messages_state_free (state);
+  else
+    valent_sms_plugin_read_messages (state);
+}
 
-  /* Handle each message */
-  n_messages = json_array_get_length (messages);
-  results = g_ptr_array_new_with_free_func (g_object_unref);
+static void
+valent_sms_plugin_flush_messages (MessagesState *state,
+                                  gboolean       finished)
+{
+  g_autoptr (GPtrArray) batch = g_steal_pointer (&state->batch);
 
-  for (unsigned int i = 0; i < n_messages; i++)
+  /* While streaming, the next element is read once the batch is committed */
+  if (finished)
     {
-      JsonNode *message_node;
-      ValentMessage *message;
+      if (batch->len > 0)
+        {
+          valent_sms_store_add_messages (state->plugin->store,
+                                         batch,
+                                         NULL,
+                                         (GAsyncReadyCallback)valent_sms_store_add_messages_cb,
+                                         NULL);
+        }
 
-      message_node = json_array_get_element (messages, i);
-      message = valent_sms_plugin_deserialize_message (self, message_node);
-      g_ptr_array_add (results, message);
+      messages_state_free (state);
+      return;
     }
 
-  valent_sms_store_add_messages (self->store, results, NULL, NULL, NULL);
+  state->batch = g_ptr_array_new_with_free_func (g_object_unref);
+  valent_sms_store_add_messages (state->plugin->store,
+                                 batch,
+                                 state->cancellable,
+                                 (GAsyncReadyCallback)valent_sms_store_add_messages_cb,
+                                 state);
 }
 
 static void
-valent_sms_plugin_handle_messages (ValentSmsPlugin *self,
-                                   JsonNode        *packet)
+valent_packet_stream_read_messages_cb (ValentPacketStream *stream,
+                                       GAsyncResult       *result,
+                                       gpointer            user_data)
 {
-  JsonObject *body;
-  JsonArray *messages;
-  unsigned int n_messages;
+  MessagesState *state = user_data;
+  g_autoptr (JsonNode) message = NULL;
+  g_autoptr (GError) error = NULL;
 
-  g_assert (VALENT_IS_SMS_PLUGIN (self));
-  g_assert (VALENT_IS_PACKET (packet));
+  message = valent_packet_stream_read_finish (stream, result, NULL, &error);
 
-  body = valent_packet_get_body (packet);
-  messages = json_object_get_array_member (body, "messages");
-  n_messages = json_array_get_length (messages);
+  if (error != NULL)
+    {
+      if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        g_debug ("%s(): %s", G_STRFUNC, error->message);
 
-  /* This would typically mean "all threads have been deleted", but it's more
-   * reasonable to assume this was the result of an error. */
-  if (n_messages == 0)
-    return;
+      messages_state_free (state);
+      return;
+    }
 
-  /* If this is a thread of messages we'll add them to the store */
-  if (messages_is_thread (messages))
+  /* At the end of the stream, handle a lone message as a thread */
+  if (message == NULL)
     {
-      valent_sms_plugin_handle_thread (self, messages);
+      if (state->first != NULL)
+        {
+          state->is_thread = TRUE;
+          valent_sms_plugin_handle_message (state, state->first);
+        }
+
+      valent_sms_plugin_flush_messages (state, TRUE);
       return;
     }
 
-  /* If this is a summary of threads we'll request each new thread */
-  for (unsigned int i = 0; i < n_messages; i++)
+  if G_UNLIKELY (!JSON_NODE_HOLDS_OBJECT (message))
     {
-      JsonObject *message;
-      int64_t thread_id;
-      int64_t thread_date;
-      int64_t cache_date;
+      valent_sms_plugin_read_messages (state);
+      return;
+    }
 
-      message = json_array_get_object_element (messages, i);
-      thread_id = json_object_get_int_member (message, "thread_id");
-      thread_date = json_object_get_int_member (message, "date");
+  /* The first two messages decide if this is a thread or a summary */
+  if (++state->n_messages == 1)
+    {
+      state->first = g_steal_pointer (&message);
+    }
+  else if (state->n_messages == 2)
+    {
+      JsonObject *first = json_node_get_object (state->first);
+      JsonObject *second = json_node_get_object (message);
+
+      state->is_thread = json_object_get_int_member (first, "thread_id") ==
+                         json_object_get_int_member (second, "thread_id");
+      valent_sms_plugin_handle_message (state, state->first);
+      valent_sms_plugin_handle_message (state, message);
+      g_clear_pointer (&state->first, json_node_unref);
+    }
+  else
+    {
+      valent_sms_plugin_handle_message (state, message);
+    }
 
-      /* Get the last cached date and compare timestamps */
-      cache_date = valent_sms_store_get_thread_date (self->store, thread_id);
+  if (state->batch->len >= MESSAGES_BATCH_SIZE)
+    valent_sms_plugin_flush_messages (state, FALSE);
+  else
+    valent_sms_plugin_read_messages (state);
+}
 
-      if (cache_date < thread_date)
-        valent_sms_plugin_request_conversation (self, thread_id, cache_date, 0);
-    }
+static void
+valent_sms_plugin_read_messages (MessagesState *state)
+{
+  valent_packet_stream_read (state->stream,
+                             state->cancellable,
+                             (GAsyncReadyCallback)valent_packet_stream_read_messages_cb,
+                             state);
+}
+
+static void
+valent_sms_plugin_handle_messages (ValentSmsPlugin    *self,
+                                   ValentPacketStream *stream)
+{
+  MessagesState *state;
+
+  g_assert (VALENT_IS_SMS_PLUGIN (self));
+  g_assert (VALENT_IS_PACKET_STREAM (stream));
+
+  /* An empty list would typically mean "all threads have been deleted", but
+   * it's more reasonable to assume this was the result of an error, so
+   * nothing is done until a message has been read. */
+  state = g_new0 (MessagesState, 1);
+  state->plugin = g_object_ref (self);
+  state->stream = g_object_ref (stream);
+  state->cancellable = valent_object_ref_cancellable (VALENT_OBJECT (self));
+  state->batch = g_ptr_array_new_with_free_func (g_object_unref);
+
+  valent_sms_plugin_read_messages (state);
 }
 
 static void
@@ -459,23 +572,6 @@ valent_sms_plugin_update_state (ValentDevicePlugin *plugin,
     valent_sms_plugin_request_conversations (self);
 }
 
-static void
-valent_sms_plugin_handle_packet (ValentDevicePlugin *plugin,
-                                 const char         *type,
-                                 JsonNode           *packet)
-{
-  ValentSmsPlugin *self = VALENT_SMS_PLUGIN (plugin);
-
-  g_assert (VALENT_IS_SMS_PLUGIN (plugin));
-  g_assert (type != NULL);
-  g_assert (VALENT_IS_PACKET (packet));
-
-  if (g_str_equal (type, "kdeconnect.sms.messages"))
-    valent_sms_plugin_handle_messages (self, packet);
-  else
-    g_assert_not_reached ();
-}
-
 /*
  * ValentObject
  */
@@ -548,10 +644,14 @@ valent_sms_plugin_class_init (ValentSmsPluginClass *klass)
   object_class->finalize = valent_sms_plugin_finalize;
 
   object_class->constructed = valent_sms_plugin_constructed;
-  plugin_class->handle_packet = valent_sms_plugin_handle_packet;
   plugin_class->update_state = valent_sms_plugin_update_state;
 
   vobject_class->destroy = valent_sms_plugin_destroy;
+
+  valent_device_plugin_class_install_stream_handler (plugin_class,
+                                                     "kdeconnect.sms.messages",
+                                                     "messages",
+                                                     (ValentDevicePluginStreamFunc)valent_sms_plugin_handle_messages);
 }
 
 static void
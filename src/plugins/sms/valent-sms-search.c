@@ -0,0 +1,787 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#define G_LOG_DOMAIN "valent-sms-search"
+
+#include "config.h"
+
+#include <gio/gio.h>
+#include <valent.h>
+
+#include "valent-message.h"
+#include "valent-sms-search.h"
+#include "valent-sms-store.h"
+#include "valent-sms-store-private.h"
+
+/* The delay between the last change to the query and the search (ms) */
+#define SEARCH_DEBOUNCE_DELAY (150)
+
+/* The maximum number of threads to refine a previous result set with */
+#define SEARCH_REFINE_MAX     (1000)
+
+
+/**
+ * ValentSmsSearch:
+ *
+ * A search controller for messages and contacts.
+ *
+ * #ValentSmsSearch is a #GListModel of the results for a search query, with
+ * matching #EContact items followed by the latest matching #ValentMessage in
+ * each thread, in descending order by date.
+ *
+ * Changes to the query are debounced, and a search that is superseded by a
+ * new query is cancelled in both stores. Results are streamed into the model
+ * as they are found, updating items in place where possible. If the new query
+ * contains the previous query, the previous results are filtered immediately
+ * and only the threads they came from are searched again.
+ */
+struct _ValentSmsSearch
+{
+  GObject             parent_instance;
+
+  ValentContactStore *contact_store;
+  ValentSmsStore     *message_store;
+  char               *query;
+  unsigned int        debounce_id;
+
+  /* Running search */
+  GCancellable       *cancellable;
+  char               *pending_query;
+  GHashTable         *pending_threads;
+  unsigned int        pending_refine : 1;
+  unsigned int        n_pending;
+
+  /* Results */
+  char               *results_query;
+  GArray             *results_threads;
+  GListStore         *items;
+  unsigned int        n_contacts;
+};
+
+static void   g_list_model_iface_init (GListModelInterface *iface);
+
+G_DEFINE_FINAL_TYPE_WITH_CODE (ValentSmsSearch, valent_sms_search, G_TYPE_OBJECT,
+                               G_IMPLEMENT_INTERFACE (G_TYPE_LIST_MODEL, g_list_model_iface_init))
+
+enum {
+  PROP_0,
+  PROP_CONTACT_STORE,
+  PROP_LOADING,
+  PROP_MESSAGE_STORE,
+  PROP_QUERY,
+  N_PROPERTIES
+};
+
+static GParamSpec *properties[N_PROPERTIES] = { NULL, };
+
+
+typedef struct
+{
+  ValentSmsSearch *search;
+  GCancellable    *cancellable;
+} SearchClosure;
+
+static SearchClosure *
+search_closure_new (ValentSmsSearch *search)
+{
+  SearchClosure *closure;
+
+  closure = g_new0 (SearchClosure, 1);
+  closure->search = g_object_ref (search);
+  closure->cancellable = g_object_ref (search->cancellable);
+
+  if (search->n_pending++ == 0)
+    g_object_notify_by_pspec (G_OBJECT (search), properties [PROP_LOADING]);
+
+  return closure;
+}
+
+static void
+search_closure_free (gpointer data)
+{
+  SearchClosure *closure = data;
+
+  if (--closure->search->n_pending == 0)
+    {
+      g_object_notify_by_pspec (G_OBJECT (closure->search),
+                                properties [PROP_LOADING]);
+    }
+
+  g_clear_object (&closure->search);
+  g_clear_object (&closure->cancellable);
+  g_free (closure);
+}
+
+static inline gboolean
+message_matches (ValentMessage *message,
+                 const char    *query)
+{
+  const char *text = valent_message_get_text (message);
+  g_autofree char *text_down = NULL;
+
+  if (text == NULL)
+    return FALSE;
+
+  /* Match the store's `LIKE` pattern, which escapes wildcards and folds only
+   * ASCII case, so refining gives the same results as a new search */
+  text_down = g_ascii_strdown (text, -1);
+
+  return g_strstr_len (text_down, -1, query) != NULL;
+}
+
+/*
+ * Message Results
+ */
+static void
+valent_sms_search_filter_messages (ValentSmsSearch *self,
+                                   const char      *query)
+{
+  unsigned int n_items;
+
+  g_assert (VALENT_IS_SMS_SEARCH (self));
+
+  n_items = g_list_model_get_n_items (G_LIST_MODEL (self->items));
+
+  for (unsigned int i = n_items; i > self->n_contacts; i--)
+    {
+      g_autoptr (ValentMessage) message = NULL;
+
+      message = g_list_model_get_item (G_LIST_MODEL (self->items), i - 1);
+
+      if (!message_matches (message, query))
+        g_list_store_remove (self->items, i - 1);
+    }
+}
+
+static void
+on_messages_found (GPtrArray *messages,
+                   gpointer   user_data)
+{
+  SearchClosure *closure = user_data;
+  ValentSmsSearch *self = closure->search;
+  g_autoptr (GHashTable) batch = NULL;
+  g_autoptr (GPtrArray) additions = NULL;
+  unsigned int n_items;
+
+  g_assert (VALENT_IS_SMS_SEARCH (self));
+
+  if (g_cancellable_is_cancelled (closure->cancellable))
+    return;
+
+  n_items = g_list_model_get_n_items (G_LIST_MODEL (self->items));
+
+  /* A new search replaces the previous results with the first batch */
+  if (!self->pending_refine && g_hash_table_size (self->pending_threads) == 0)
+    {
+      g_list_store_splice (self->items,
+                           self->n_contacts,
+                           n_items - self->n_contacts,
+                           NULL, 0);
+      n_items = self->n_contacts;
+    }
+
+  batch = g_hash_table_new (g_int64_hash, g_int64_equal);
+  additions = g_ptr_array_new ();
+
+  for (unsigned int i = 0; i < messages->len; i++)
+    {
+      ValentMessage *message = g_ptr_array_index (messages, i);
+      int64_t *thread_id = g_new (int64_t, 1);
+
+      *thread_id = valent_message_get_thread_id (message);
+
+      if (!g_hash_table_add (self->pending_threads, thread_id))
+        continue;
+
+      g_hash_table_insert (batch, thread_id, message);
+      g_ptr_array_add (additions, message);
+    }
+
+  /* When refining, update the rows for threads still in the results */
+  if (self->pending_refine)
+    {
+      for (unsigned int i = self->n_contacts; i < n_items; i++)
+        {
+          g_autoptr (ValentMessage) item = NULL;
+          ValentMessage *message;
+          int64_t thread_id;
+
+          item = g_list_model_get_item (G_LIST_MODEL (self->items), i);
+          thread_id = valent_message_get_thread_id (item);
+
+          if ((message = g_hash_table_lookup (batch, &thread_id)) == NULL)
+            continue;
+
+          if (valent_message_get_id (message) != valent_message_get_id (item))
+            g_list_store_splice (self->items, i, 1, (gpointer *)&message, 1);
+
+          g_ptr_array_remove (additions, message);
+        }
+    }
+
+  g_list_store_splice (self->items,
+                       g_list_model_get_n_items (G_LIST_MODEL (self->items)),
+                       0,
+                       additions->pdata,
+                       additions->len);
+}
+
+static void
+find_messages_cb (ValentSmsStore *store,
+                  GAsyncResult   *result,
+                  gpointer        user_data)
+{
+  SearchClosure *closure = user_data;
+  ValentSmsSearch *self = closure->search;
+  g_autoptr (GPtrArray) messages = NULL;
+  g_autoptr (GError) error = NULL;
+  unsigned int n_items;
+
+  messages = valent_sms_store_find_messages_finish (store, result, &error);
+
+  if (messages == NULL || g_cancellable_is_cancelled (closure->cancellable))
+    {
+      if (error != NULL && !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        g_warning ("%s(): %s", G_STRFUNC, error->message);
+
+      g_clear_pointer (&closure, search_closure_free);
+      return;
+    }
+
+  /* Drop any rows that were not confirmed by the search */
+  n_items = g_list_model_get_n_items (G_LIST_MODEL (self->items));
+
+  for (unsigned int i = n_items; i > self->n_contacts; i--)
+    {
+      g_autoptr (ValentMessage) message = NULL;
+      int64_t thread_id;
+
+      message = g_list_model_get_item (G_LIST_MODEL (self->items), i - 1);
+      thread_id = valent_message_get_thread_id (message);
+
+      if (!g_hash_table_contains (self->pending_threads, &thread_id))
+        g_list_store_remove (self->items, i - 1);
+    }
+
+  /* Remember the result set, so a longer query can refine it */
+  g_clear_pointer (&self->results_threads, g_array_unref);
+  self->results_threads = g_array_sized_new (FALSE, FALSE,
+                                             sizeof (int64_t),
+                                             messages->len);
+
+  for (unsigned int i = 0; i < messages->len; i++)
+    {
+      ValentMessage *message = g_ptr_array_index (messages, i);
+      int64_t thread_id = valent_message_get_thread_id (message);
+
+      g_array_append_val (self->results_threads, thread_id);
+    }
+
+  g_clear_pointer (&self->results_query, g_free);
+  self->results_query = g_steal_pointer (&self->pending_query);
+
+  g_clear_pointer (&closure, search_closure_free);
+}
+
+/*
+ * Contact Results
+ */
+static void
+query_contacts_cb (ValentContactStore *store,
+                   GAsyncResult       *result,
+                   gpointer            user_data)
+{
+  SearchClosure *closure = user_data;
+  ValentSmsSearch *self = closure->search;
+  g_autoslist (GObject) contacts = NULL;
+  g_autoptr (GPtrArray) additions = NULL;
+  g_autoptr (GError) error = NULL;
+
+  contacts = valent_contact_store_query_finish (store, result, &error);
+
+  if (error != NULL || g_cancellable_is_cancelled (closure->cancellable))
+    {
+      if (error != NULL && !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        g_warning ("%s(): %s", G_STRFUNC, error->message);
+
+      g_clear_pointer (&closure, search_closure_free);
+      return;
+    }
+
+  additions = g_ptr_array_new ();
+
+  for (const GSList *iter = contacts; iter; iter = iter->next)
+    g_ptr_array_add (additions, iter->data);
+
+  g_list_store_splice (self->items,
+                       0,
+                       self->n_contacts,
+                       additions->pdata,
+                       additions->len);
+  self->n_contacts = additions->len;
+
+  g_clear_pointer (&closure, search_closure_free);
+}
+
+static void
+valent_sms_search_query_contacts (ValentSmsSearch *self)
+{
+  EBookQuery *queries[2];
+  g_autoptr (EBookQuery) query = NULL;
+  g_autofree char *sexp = NULL;
+
+  g_assert (VALENT_IS_SMS_SEARCH (self));
+
+  if (self->contact_store == NULL)
+    return;
+
+  queries[0] = e_book_query_field_test (E_CONTACT_FULL_NAME,
+                                        E_BOOK_QUERY_CONTAINS,
+                                        self->query);
+  queries[1] = e_book_query_field_test (E_CONTACT_TEL,
+                                        E_BOOK_QUERY_CONTAINS,
+                                        self->query);
+
+  query = e_book_query_or (G_N_ELEMENTS (queries), queries, TRUE);
+  sexp = e_book_query_to_string (query);
+
+  valent_contact_store_query (self->contact_store,
+                              sexp,
+                              self->cancellable,
+                              (GAsyncReadyCallback)query_contacts_cb,
+                              search_closure_new (self));
+}
+
+static void
+valent_sms_search_query_messages (ValentSmsSearch *self)
+{
+  GArray *threads = NULL;
+  SearchClosure *closure;
+
+  g_assert (VALENT_IS_SMS_SEARCH (self));
+
+  g_clear_pointer (&self->pending_query, g_free);
+  self->pending_query = g_ascii_strdown (self->query, -1);
+  g_hash_table_remove_all (self->pending_threads);
+
+  /* Any thread matching the new query must have matched the previous query,
+   * so the previous results can be filtered in place and their threads
+   * searched again, instead of the whole store. */
+  self->pending_refine = (self->results_query != NULL &&
+                          self->results_threads != NULL &&
+                          self->results_threads->len <= SEARCH_REFINE_MAX &&
+                          g_strstr_len (self->pending_query, -1, self->results_query) != NULL);
+
+  if (self->pending_refine)
+    {
+      valent_sms_search_filter_messages (self, self->pending_query);
+      threads = self->results_threads;
+    }
+
+  closure = search_closure_new (self);
+  valent_sms_store_find_messages_full (self->message_store,
+                                       self->query,
+                                       threads,
+                                       on_messages_found,
+                                       closure,
+                                       self->cancellable,
+                                       (GAsyncReadyCallback)find_messages_cb,
+                                       closure);
+}
+
+static void
+valent_sms_search_cancel (ValentSmsSearch *self)
+{
+  g_assert (VALENT_IS_SMS_SEARCH (self));
+
+  g_clear_handle_id (&self->debounce_id, g_source_remove);
+
+  if (self->cancellable != NULL)
+    {
+      g_cancellable_cancel (self->cancellable);
+      g_clear_object (&self->cancellable);
+    }
+}
+
+static gboolean
+valent_sms_search_run (gpointer data)
+{
+  ValentSmsSearch *self = VALENT_SMS_SEARCH (data);
+
+  g_assert (VALENT_IS_SMS_SEARCH (self));
+
+  self->debounce_id = 0;
+
+  /* An empty query clears the results */
+  if (self->query == NULL || *self->query == '\0')
+    {
+      unsigned int n_items;
+
+      n_items = g_list_model_get_n_items (G_LIST_MODEL (self->items));
+      self->n_contacts = 0;
+      g_list_store_remove_all (self->items);
+
+      g_clear_pointer (&self->results_query, g_free);
+      g_clear_pointer (&self->results_threads, g_array_unref);
+
+      if (n_items > 0)
+        VALENT_NOTE ("cleared %u results", n_items);
+
+      return G_SOURCE_REMOVE;
+    }
+
+  self->cancellable = g_cancellable_new ();
+  valent_sms_search_query_messages (self);
+  valent_sms_search_query_contacts (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+/*
+ * GListModel
+ */
+static gpointer
+valent_sms_search_get_item (GListModel   *model,
+                            unsigned int  position)
+{
+  ValentSmsSearch *self = VALENT_SMS_SEARCH (model);
+
+  return g_list_model_get_item (G_LIST_MODEL (self->items), position);
+}
+
+static GType
+valent_sms_search_get_item_type (GListModel *model)
+{
+  return G_TYPE_OBJECT;
+}
+
+static unsigned int
+valent_sms_search_get_n_items (GListModel *model)
+{
+  ValentSmsSearch *self = VALENT_SMS_SEARCH (model);
+
+  return g_list_model_get_n_items (G_LIST_MODEL (self->items));
+}
+
+static void
+g_list_model_iface_init (GListModelInterface *iface)
+{
+  iface->get_item = valent_sms_search_get_item;
+  iface->get_item_type = valent_sms_search_get_item_type;
+  iface->get_n_items = valent_sms_search_get_n_items;
+}
+
+
+/*
+ * GObject
+ */
+static void
+valent_sms_search_dispose (GObject *object)
+{
+  ValentSmsSearch *self = VALENT_SMS_SEARCH (object);
+
+  valent_sms_search_cancel (self);
+
+  G_OBJECT_CLASS (valent_sms_search_parent_class)->dispose (object);
+}
+
+static void
+valent_sms_search_finalize (GObject *object)
+{
+  ValentSmsSearch *self = VALENT_SMS_SEARCH (object);
+
+  g_clear_object (&self->contact_store);
+  g_clear_object (&self->message_store);
+  g_clear_pointer (&self->query, g_free);
+  g_clear_pointer (&self->pending_query, g_free);
+  g_clear_pointer (&self->pending_threads, g_hash_table_unref);
+  g_clear_pointer (&self->results_query, g_free);
+  g_clear_pointer (&self->results_threads, g_array_unref);
+  g_clear_object (&self->items);
+
+  G_OBJECT_CLASS (valent_sms_search_parent_class)->finalize (object);
+}
+
+static void
+valent_sms_search_get_property (GObject    *object,
+                                guint       prop_id,
+                                GValue     *value,
+                                GParamSpec *pspec)
+{
+  ValentSmsSearch *self = VALENT_SMS_SEARCH (object);
+
+  switch (prop_id)
+    {
+    case PROP_CONTACT_STORE:
+      g_value_set_object (value, self->contact_store);
+      break;
+
+    case PROP_LOADING:
+      g_value_set_boolean (value, valent_sms_search_get_loading (self));
+      break;
+
+    case PROP_MESSAGE_STORE:
+      g_value_set_object (value, self->message_store);
+      break;
+
+    case PROP_QUERY:
+      g_value_set_string (value, self->query);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+valent_sms_search_set_property (GObject      *object,
+                                guint         prop_id,
+                                const GValue *value,
+                                GParamSpec   *pspec)
+{
+  ValentSmsSearch *self = VALENT_SMS_SEARCH (object);
+
+  switch (prop_id)
+    {
+    case PROP_CONTACT_STORE:
+      valent_sms_search_set_contact_store (self, g_value_get_object (value));
+      break;
+
+    case PROP_MESSAGE_STORE:
+      self->message_store = g_value_dup_object (value);
+      break;
+
+    case PROP_QUERY:
+      valent_sms_search_set_query (self, g_value_get_string (value));
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+valent_sms_search_class_init (ValentSmsSearchClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->dispose = valent_sms_search_dispose;
+  object_class->finalize = valent_sms_search_finalize;
+  object_class->get_property = valent_sms_search_get_property;
+  object_class->set_property = valent_sms_search_set_property;
+
+  /**
+   * ValentSmsSearch:contact-store:
+   *
+   * The #ValentContactStore to search for contacts.
+   */
+  properties [PROP_CONTACT_STORE] =
+    g_param_spec_object ("contact-store", NULL, NULL,
+                         VALENT_TYPE_CONTACT_STORE,
+                         (G_PARAM_READWRITE |
+                          G_PARAM_EXPLICIT_NOTIFY |
+                          G_PARAM_STATIC_STRINGS));
+
+  /**
+   * ValentSmsSearch:loading:
+   *
+   * Whether a search is in progress.
+   */
+  properties [PROP_LOADING] =
+    g_param_spec_boolean ("loading", NULL, NULL,
+                          FALSE,
+                          (G_PARAM_READABLE |
+                           G_PARAM_EXPLICIT_NOTIFY |
+                           G_PARAM_STATIC_STRINGS));
+
+  /**
+   * ValentSmsSearch:message-store:
+   *
+   * The #ValentSmsStore to search for messages.
+   */
+  properties [PROP_MESSAGE_STORE] =
+    g_param_spec_object ("message-store", NULL, NULL,
+                         VALENT_TYPE_SMS_STORE,
+                         (G_PARAM_READWRITE |
+                          G_PARAM_CONSTRUCT_ONLY |
+                          G_PARAM_EXPLICIT_NOTIFY |
+                          G_PARAM_STATIC_STRINGS));
+
+  /**
+   * ValentSmsSearch:query:
+   *
+   * The search query.
+   */
+  properties [PROP_QUERY] =
+    g_param_spec_string ("query", NULL, NULL,
+                         NULL,
+                         (G_PARAM_READWRITE |
+                          G_PARAM_EXPLICIT_NOTIFY |
+                          G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_properties (object_class, N_PROPERTIES, properties);
+}
+
+static void
+valent_sms_search_init (ValentSmsSearch *self)
+{
+  self->items = g_list_store_new (G_TYPE_OBJECT);
+  g_signal_connect_object (self->items,
+                           "items-changed",
+                           G_CALLBACK (g_list_model_items_changed),
+                           self,
+                           G_CONNECT_SWAPPED);
+
+  self->pending_threads = g_hash_table_new_full (g_int64_hash,
+                                                 g_int64_equal,
+                                                 g_free,
+                                                 NULL);
+}
+
+/**
+ * valent_sms_search_new:
+ * @contacts: (nullable): a #ValentContactStore
+ * @messages: a #ValentSmsStore
+ *
+ * Create a new #ValentSmsSearch.
+ *
+ * Returns: (transfer full): a new #ValentSmsSearch
+ */
+ValentSmsSearch *
+valent_sms_search_new (ValentContactStore *contacts,
+                       ValentSmsStore     *messages)
+{
+  g_return_val_if_fail (contacts == NULL || VALENT_IS_CONTACT_STORE (contacts), NULL);
+  g_return_val_if_fail (VALENT_IS_SMS_STORE (messages), NULL);
+
+  return g_object_new (VALENT_TYPE_SMS_SEARCH,
+                       "contact-store", contacts,
+                       "message-store", messages,
+                       NULL);
+}
+
+/**
+ * valent_sms_search_get_contact_store:
+ * @search: a #ValentSmsSearch
+ *
+ * Get the #ValentContactStore searched by @search.
+ *
+ * Returns: (transfer none) (nullable): a #ValentContactStore
+ */
+ValentContactStore *
+valent_sms_search_get_contact_store (ValentSmsSearch *search)
+{
+  g_return_val_if_fail (VALENT_IS_SMS_SEARCH (search), NULL);
+
+  return search->contact_store;
+}
+
+/**
+ * valent_sms_search_set_contact_store:
+ * @search: a #ValentSmsSearch
+ * @store: (nullable): a #ValentContactStore
+ *
+ * Set the #ValentContactStore searched by @search.
+ */
+void
+valent_sms_search_set_contact_store (ValentSmsSearch    *search,
+                                     ValentContactStore *store)
+{
+  g_return_if_fail (VALENT_IS_SMS_SEARCH (search));
+  g_return_if_fail (store == NULL || VALENT_IS_CONTACT_STORE (store));
+
+  if (!g_set_object (&search->contact_store, store))
+    return;
+
+  g_object_notify_by_pspec (G_OBJECT (search), properties [PROP_CONTACT_STORE]);
+}
+
+/**
+ * valent_sms_search_get_message_store:
+ * @search: a #ValentSmsSearch
+ *
+ * Get the #ValentSmsStore searched by @search.
+ *
+ * Returns: (transfer none): a #ValentSmsStore
+ */
+ValentSmsStore *
+valent_sms_search_get_message_store (ValentSmsSearch *search)
+{
+  g_return_val_if_fail (VALENT_IS_SMS_SEARCH (search), NULL);
+
+  return search->message_store;
+}
+
+/**
+ * valent_sms_search_get_loading:
+ * @search: a #ValentSmsSearch
+ *
+ * Get whether a search is pending or in progress.
+ *
+ * Returns: %TRUE if loading, or %FALSE if not
+ */
+gboolean
+valent_sms_search_get_loading (ValentSmsSearch *search)
+{
+  g_return_val_if_fail (VALENT_IS_SMS_SEARCH (search), FALSE);
+
+  return search->debounce_id > 0 || search->n_pending > 0;
+}
+
+/**
+ * valent_sms_search_get_query:
+ * @search: a #ValentSmsSearch
+ *
+ * Get the search query.
+ *
+ * Returns: (transfer none) (nullable): the search query
+ */
+const char *
+valent_sms_search_get_query (ValentSmsSearch *search)
+{
+  g_return_val_if_fail (VALENT_IS_SMS_SEARCH (search), NULL);
+
+  return search->query;
+}
+
+/**
+ * valent_sms_search_set_query:
+ * @search: a #ValentSmsSearch
+ * @query: (nullable): a search query
+ *
+ * Set the search query for @search.
+ *
+ * Any search in progress will be cancelled immediately, while the new search
+ * will start after a short delay. If @query is %NULL or empty, the results
+ * will be cleared immediately.
+ */
+void
+valent_sms_search_set_query (ValentSmsSearch *search,
+                             const char      *query)
+{
+  gboolean loading;
+
+  g_return_if_fail (VALENT_IS_SMS_SEARCH (search));
+
+  if (g_strcmp0 (search->query, query) == 0)
+    return;
+
+  loading = valent_sms_search_get_loading (search);
+
+  g_clear_pointer (&search->query, g_free);
+  search->query = g_strdup (query);
+  valent_sms_search_cancel (search);
+
+  if (search->query == NULL || *search->query == '\0')
+    valent_sms_search_run (search);
+  else
+    search->debounce_id = g_timeout_add (SEARCH_DEBOUNCE_DELAY,
+                                         valent_sms_search_run,
+                                         search);
+
+  if (loading != valent_sms_search_get_loading (search))
+    g_object_notify_by_pspec (G_OBJECT (search), properties [PROP_LOADING]);
+
+  g_object_notify_by_pspec (G_OBJECT (search), properties [PROP_QUERY]);
+}
@@ -0,0 +1,28 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#pragma once
+
+#include <gio/gio.h>
+#include <valent.h>
+
+#include "valent-sms-store.h"
+
+G_BEGIN_DECLS
+
+#define VALENT_TYPE_SMS_SEARCH (valent_sms_search_get_type())
+
+G_DECLARE_FINAL_TYPE (ValentSmsSearch, valent_sms_search, VALENT, SMS_SEARCH, GObject)
+
+ValentSmsSearch    * valent_sms_search_new               (ValentContactStore *contacts,
+                                                          ValentSmsStore     *messages);
+ValentContactStore * valent_sms_search_get_contact_store (ValentSmsSearch    *search);
+void                 valent_sms_search_set_contact_store (ValentSmsSearch    *search,
+                                                          ValentContactStore *store);
+ValentSmsStore     * valent_sms_search_get_message_store (ValentSmsSearch    *search);
+gboolean             valent_sms_search_get_loading       (ValentSmsSearch    *search);
+const char         * valent_sms_search_get_query         (ValentSmsSearch    *search);
+void                 valent_sms_search_set_query         (ValentSmsSearch    *search,
+                                                          const char         *query);
+
+G_END_DECLS
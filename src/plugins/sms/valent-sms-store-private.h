@@ -9,11 +9,30 @@
 
 G_BEGIN_DECLS
 
-void   valent_sms_store_get_thread_items  (ValentSmsStore      *store,
-                                           int64_t              thread_id,
-                                           GCancellable        *cancellable,
-                                           GAsyncReadyCallback  callback,
-                                           gpointer             user_data);
+/**
+ * ValentSmsStoreFindFunc:
+ * @messages: (element-type Valent.Message): a batch of results
+ * @user_data: user supplied data
+ *
+ * A function called in the main thread for each batch of results found by
+ * valent_sms_store_find_messages_full(), before the operation completes.
+ */
+typedef void (*ValentSmsStoreFindFunc) (GPtrArray *messages,
+                                        gpointer   user_data);
+
+void   valent_sms_store_find_messages_full (ValentSmsStore         *store,
+                                            const char             *query,
+                                            GArray                 *threads,
+                                            ValentSmsStoreFindFunc  func,
+                                            gpointer                func_data,
+                                            GCancellable           *cancellable,
+                                            GAsyncReadyCallback     callback,
+                                            gpointer                user_data);
+void   valent_sms_store_get_thread_items   (ValentSmsStore         *store,
+                                            int64_t                 thread_id,
+                                            GCancellable           *cancellable,
+                                            GAsyncReadyCallback     callback,
+                                            gpointer                user_data);
 
 
 /**
@@ -88,14 +107,37 @@ void   valent_sms_store_get_thread_items  (ValentSmsStore      *store,
 /**
  * FIND_MESSAGES_SQL:
  *
- * Find the latest message in each thread matching the query.
+ * Find the latest message in each thread matching the query, descending by
+ * date. Wildcards in the query must be escaped with a backslash.
  */
 #define FIND_MESSAGES_SQL                      \
 "SELECT * FROM message"                        \
 "  WHERE (thread_id, date) IN ("               \
 "    SELECT thread_id, MAX(date) FROM message" \
-"      WHERE text LIKE ? GROUP BY thread_id"   \
-"  );"
+"      WHERE text LIKE ? ESCAPE '\\'"          \
+"      GROUP BY thread_id"                     \
+"  )"                                          \
+"  ORDER BY date DESC;"
+
+/**
+ * FIND_MESSAGES_IN_THREADS_SQL:
+ *
+ * Find the latest message in each thread matching the query, restricted to a
+ * list of thread IDs, descending by date.
+ *
+ * This is a format string, expecting a comma-separated list of integers to be
+ * substituted for the `%s`. Since the list is variable, the statement is not
+ * cached, but the `thread_id` index makes it far cheaper than a full scan.
+ */
+#define FIND_MESSAGES_IN_THREADS_SQL           \
+"SELECT * FROM message"                        \
+"  WHERE (thread_id, date) IN ("               \
+"    SELECT thread_id, MAX(date) FROM message" \
+"      WHERE thread_id IN (%s)"                \
+"        AND text LIKE ? ESCAPE '\\'"          \
+"      GROUP BY thread_id"                     \
+"  )"                                          \
+"  ORDER BY date DESC;"
 
 /**
  * GET_MESSAGE_SQL:
@@ -31,6 +31,11 @@ struct _ValentSmsStore
 
 G_DEFINE_FINAL_TYPE (ValentSmsStore, valent_sms_store, VALENT_TYPE_CONTEXT)
 
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (sqlite3_stmt, sqlite3_finalize)
+
+/* The number of search results delivered to the main thread at once */
+#define FIND_MESSAGES_BATCH_SIZE (50)
+
 enum {
   MESSAGE_ADDED,
   MESSAGE_CHANGED,
@@ -580,6 +585,102 @@ remove_thread_task (GTask        *task,
                                   G_STRFUNC, sqlite3_errstr (rc));
 }
 
+typedef struct
+{
+  char                   *query;
+  GArray                 *threads;
+  ValentSmsStoreFindFunc  func;
+  gpointer                func_data;
+} FindMessagesData;
+
+static void
+find_messages_data_free (gpointer data)
+{
+  FindMessagesData *find = data;
+
+  g_clear_pointer (&find->query, g_free);
+  g_clear_pointer (&find->threads, g_array_unref);
+  g_free (find);
+}
+
+typedef struct
+{
+  GTask     *task;
+  GPtrArray *messages;
+} FindMessagesBatch;
+
+static gboolean
+find_messages_batch_main (gpointer data)
+{
+  FindMessagesBatch *batch = data;
+  FindMessagesData *find = g_task_get_task_data (batch->task);
+
+  g_assert (VALENT_IS_MAIN_THREAD ());
+
+  if (!g_cancellable_is_cancelled (g_task_get_cancellable (batch->task)))
+    find->func (batch->messages, find->func_data);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+find_messages_batch_free (gpointer data)
+{
+  FindMessagesBatch *batch = data;
+
+  g_clear_object (&batch->task);
+  g_clear_pointer (&batch->messages, g_ptr_array_unref);
+  g_free (batch);
+}
+
+static inline void
+find_messages_batch_push (GTask      *task,
+                          GPtrArray **messages)
+{
+  FindMessagesBatch *batch;
+
+  if (*messages == NULL || (*messages)->len == 0)
+    return;
+
+  /* Batches are dispatched in order, ahead of the task result */
+  batch = g_new0 (FindMessagesBatch, 1);
+  batch->task = g_object_ref (task);
+  batch->messages = g_steal_pointer (messages);
+  g_main_context_invoke_full (g_task_get_context (task),
+                              g_task_get_priority (task),
+                              find_messages_batch_main,
+                              batch,
+                              find_messages_batch_free);
+}
+
+static int
+find_messages_progress (gpointer data)
+{
+  return g_cancellable_is_cancelled (G_CANCELLABLE (data));
+}
+
+/*
+ * Build a `LIKE` pattern matching @query anywhere in the text, escaping the
+ * wildcards in @query so it matches as a plain substring.
+ */
+static char *
+find_messages_pattern (const char *query)
+{
+  GString *pattern = g_string_new ("%");
+
+  for (const char *c = query; *c != '\0'; c++)
+    {
+      if (*c == '%' || *c == '_' || *c == '\\')
+        g_string_append_c (pattern, '\\');
+
+      g_string_append_c (pattern, *c);
+    }
+
+  g_string_append_c (pattern, '%');
+
+  return g_string_free (pattern, FALSE);
+}
+
 static void
 find_messages_task (GTask        *task,
                     gpointer      source_object,
@@ -587,9 +688,11 @@ find_messages_task (GTask        *task,
                     GCancellable *cancellable)
 {
   ValentSmsStore *self = VALENT_SMS_STORE (source_object);
-  const char *query = task_data;
+  FindMessagesData *find = task_data;
   sqlite3_stmt *stmt = self->stmts[STMT_FIND_MESSAGES];
+  g_autoptr (sqlite3_stmt) threads_stmt = NULL;
   g_autoptr (GPtrArray) messages = NULL;
+  g_autoptr (GPtrArray) batch = NULL;
   g_autofree char *query_param = NULL;
   ValentMessage *message;
   GError *error = NULL;
@@ -600,20 +703,87 @@ find_messages_task (GTask        *task,
   if (valent_sms_store_return_error_if_closed (task, self))
     return;
 
-  // NOTE: escaped percent signs (%%) are query wildcards (%)
-  query_param = g_strdup_printf ("%%%s%%", query);
+  /* A restricted search is prepared for each query, since the number of
+   * thread IDs is variable. */
+  if (find->threads != NULL)
+    {
+      g_autoptr (GString) ids = NULL;
+      g_autofree char *sql = NULL;
+      int rc;
+
+      ids = g_string_new ("");
+
+      for (unsigned int i = 0; i < find->threads->len; i++)
+        {
+          g_string_append_printf (ids,
+                                  "%s%"G_GINT64_FORMAT,
+                                  (i > 0) ? "," : "",
+                                  g_array_index (find->threads, int64_t, i));
+        }
+
+      sql = g_strdup_printf (FIND_MESSAGES_IN_THREADS_SQL, ids->str);
+      rc = sqlite3_prepare_v2 (self->connection, sql, -1, &threads_stmt, NULL);
+
+      if (rc != SQLITE_OK)
+        {
+          g_task_return_new_error (task,
+                                   G_IO_ERROR,
+                                   G_IO_ERROR_FAILED,
+                                   "sqlite3_prepare_v2(): [%i] %s",
+                                   rc, sqlite3_errstr (rc));
+          return;
+        }
+
+      stmt = threads_stmt;
+    }
+
+  query_param = find_messages_pattern (find->query);
   sqlite3_bind_text (stmt, 1, query_param, -1, NULL);
 
+  /* `LIKE` is a full scan, so allow cancellation to interrupt it */
+  if (cancellable != NULL)
+    {
+      sqlite3_progress_handler (self->connection,
+                                1000,
+                                find_messages_progress,
+                                cancellable);
+    }
+
   /* Collect the results */
   messages = g_ptr_array_new_with_free_func (g_object_unref);
 
   while ((message = valent_sms_store_get_message_step (stmt, &error)))
-    g_ptr_array_add (messages, message);
+    {
+      g_ptr_array_add (messages, message);
+
+      if (find->func == NULL)
+        continue;
+
+      if (batch == NULL)
+        batch = g_ptr_array_new_with_free_func (g_object_unref);
+
+      g_ptr_array_add (batch, g_object_ref (message));
+
+      if (batch->len >= FIND_MESSAGES_BATCH_SIZE)
+        find_messages_batch_push (task, &batch);
+    }
   sqlite3_reset (stmt);
 
+  if (cancellable != NULL)
+    sqlite3_progress_handler (self->connection, 0, NULL, NULL);
+
+  if (g_task_return_error_if_cancelled (task))
+    {
+      g_clear_error (&error);
+      return;
+    }
+
   if (error != NULL)
     return g_task_return_error (task, error);
 
+  if (find->func != NULL)
+    find_messages_batch_push (task, &batch);
+
   g_task_return_pointer (task,
                          g_steal_pointer (&messages),
                          (GDestroyNotify)g_ptr_array_unref);
@@ -1227,16 +1397,73 @@ valent_sms_store_find_messages (ValentSmsStore      *store,
                                 GCancellable        *cancellable,
                                 GAsyncReadyCallback  callback,
                                 gpointer             user_data)
+{
+  g_return_if_fail (VALENT_IS_SMS_STORE (store));
+  g_return_if_fail (query != NULL);
+  g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+
+  valent_sms_store_find_messages_full (store,
+                                       query,
+                                       NULL,
+                                       NULL,
+                                       NULL,
+                                       cancellable,
+                                       callback,
+                                       user_data);
+}
+
+/**
+ * valent_sms_store_find_messages_full:
+ * @store: a #ValentSmsStore
+ * @query: a string to search for
+ * @threads: (nullable) (element-type gint64): thread IDs to search in
+ * @func: (nullable) (scope call): a #ValentSmsStoreFindFunc
+ * @func_data: (closure func): user supplied data for @func
+ * @cancellable: (nullable): a #GCancellable
+ * @callback: (scope async): a #GAsyncReadyCallback
+ * @user_data: (closure): user supplied data
+ *
+ * Like valent_sms_store_find_messages(), but with the option to restrict the
+ * search to @threads and to receive results as they are found.
+ *
+ * If @threads is not %NULL, only messages in those threads will be searched.
+ * This is useful for refining the results of a previous query, since any
+ * thread matching a longer query must have matched a substring of it.
+ *
+ * If @func is not %NULL, it will be invoked in the main thread with batches of
+ * results as they are found. @func_data must remain valid until @callback is
+ * invoked. Batches are not delivered once @cancellable is triggered, and the
+ * running query will be interrupted.
+ *
+ * Call valent_sms_store_find_messages_finish() to get the result.
+ */
+void
+valent_sms_store_find_messages_full (ValentSmsStore         *store,
+                                     const char             *query,
+                                     GArray                 *threads,
+                                     ValentSmsStoreFindFunc  func,
+                                     gpointer                func_data,
+                                     GCancellable           *cancellable,
+                                     GAsyncReadyCallback     callback,
+                                     gpointer                user_data)
 {
   g_autoptr (GTask) task = NULL;
+  FindMessagesData *find;
 
   g_return_if_fail (VALENT_IS_SMS_STORE (store));
   g_return_if_fail (query != NULL);
+  g_return_if_fail (threads == NULL || g_array_get_element_size (threads) == sizeof (int64_t));
   g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
 
+  find = g_new0 (FindMessagesData, 1);
+  find->query = g_strdup (query);
+  find->threads = threads ? g_array_ref (threads) : NULL;
+  find->func = func;
+  find->func_data = func_data;
+
   task = g_task_new (store, cancellable, callback, user_data);
   g_task_set_source_tag (task, valent_sms_store_find_messages);
-  g_task_set_task_data (task, g_strdup (query), g_free);
+  g_task_set_task_data (task, find, find_messages_data_free);
   valent_sms_store_push (store, task, find_messages_task);
 }
 
@@ -13,6 +13,7 @@
 #include "valent-contact-row.h"
 #include "valent-message.h"
 #include "valent-sms-conversation.h"
+#include "valent-sms-search.h"
 #include "valent-sms-store.h"
 #include "valent-sms-utils.h"
 #include "valent-sms-window.h"
@@ -25,6 +26,10 @@ struct _ValentSmsWindow
 
   ValentContactStore   *contact_store;
   ValentSmsStore       *message_store;
+  ValentSmsSearch      *search;
+  GHashTable           *contacts;
+  GHashTable           *search_items;
+  int64_t               selected_thread;
 
   /* template */
   AdwLeaflet           *content_box;
@@ -33,12 +38,14 @@ struct _ValentSmsWindow
 
   GtkLabel             *content_title;
   GtkBox               *content_layout;
-  GtkListBox           *conversation_list;
+  GtkStack             *conversation_stack;
+  GtkListView          *conversation_list;
   GtkStack             *content;
 
   GtkWidget            *message_search;
   GtkWidget            *message_search_entry;
-  GtkListBox           *message_search_list;
+  GtkStack             *message_search_stack;
+  GtkListView          *message_search_list;
 
   GtkWidget            *contact_search;
   GtkWidget            *contact_search_entry;
@@ -65,91 +72,147 @@ enum {
 static guint signals[N_SIGNALS] = { 0, };
 
 
-/*
- * Generic callback for querying a contact for a widget
- */
-static void
-phone_lookup_cb (ValentContactStore *store,
-                 GAsyncResult       *result,
-                 ValentMessageRow   *row)
+static const char *
+message_get_address (ValentMessage *message)
 {
-  g_autoptr (GError) error = NULL;
-  g_autoptr (EContact) contact = NULL;
+  GVariant *metadata;
+  g_autoptr (GVariant) addresses = NULL;
+  g_autoptr (GVariant) participant = NULL;
+  const char *address = NULL;
 
-  contact = valent_sms_contact_from_phone_finish (store, result, &error);
+  if ((address = valent_message_get_sender (message)) != NULL)
+    return address;
 
-  if (contact == NULL)
-      g_warning ("%s(): %s", G_STRFUNC, error->message);
+  /* TODO: probably a failure of kdeconnect-android, but occasionally a message
+   *       will have no addresses */
+  if ((metadata = valent_message_get_metadata (message)) == NULL ||
+      !g_variant_lookup (metadata, "addresses", "@aa{sv}", &addresses) ||
+      g_variant_n_children (addresses) == 0)
+    return NULL;
 
-  valent_message_row_set_contact (row, contact);
+  /* The string is owned by @metadata, which is owned by @message */
+  participant = g_variant_get_child_value (addresses, 0);
+  g_variant_lookup (participant, "address", "&s", &address);
+
+  return address;
 }
 
-static void
-search_contacts_cb (ValentContactStore *model,
-                    GAsyncResult       *result,
-                    ValentSmsWindow    *window)
+/*
+ * Lazy contact resolution for message rows
+ */
+typedef struct
 {
-  g_autoptr (GError) error = NULL;
-  g_autoslist (GObject) contacts = NULL;
+  ValentSmsWindow *window;
+  GWeakRef         row;
+  GCancellable    *cancellable;
+  char            *address;
+} ContactLookup;
 
-  contacts = valent_contact_store_query_finish (model, result, &error);
-
-  for (const GSList *iter = contacts; iter; iter = iter->next)
-    valent_list_add_contact (window->contact_search_list, iter->data);
+static void
+contact_lookup_free (gpointer data)
+{
+  ContactLookup *lookup = data;
 
-  if (error != NULL)
-    g_warning ("%s(): %s", G_STRFUNC, error->message);
+  g_clear_object (&lookup->window);
+  g_weak_ref_clear (&lookup->row);
+  g_clear_object (&lookup->cancellable);
+  g_clear_pointer (&lookup->address, g_free);
+  g_free (lookup);
 }
 
 static void
-search_messages_cb (ValentSmsStore  *store,
-                    GAsyncResult    *result,
-                    ValentSmsWindow *window)
+phone_lookup_cb (ValentContactStore *store,
+                 GAsyncResult       *result,
+                 gpointer            user_data)
 {
+  ContactLookup *lookup = user_data;
+  g_autoptr (ValentMessageRow) row = NULL;
+  g_autoptr (EContact) contact = NULL;
   g_autoptr (GError) error = NULL;
-  g_autoptr (GPtrArray) messages = NULL;
 
-  messages = valent_sms_store_find_messages_finish (store, result, &error);
+  contact = valent_sms_contact_from_phone_finish (store, result, &error);
 
-  for (unsigned int i = 0; i < messages->len; i++)
+  if (contact != NULL)
+    {
+      g_hash_table_replace (lookup->window->contacts,
+                            g_strdup (lookup->address),
+                            g_object_ref (contact));
+
+      /* The row may have been recycled for another message, even if the
+       * lookup completed before it could be cancelled */
+      if (!g_cancellable_is_cancelled (lookup->cancellable) &&
+          (row = g_weak_ref_get (&lookup->row)) != NULL)
+        valent_message_row_set_contact (row, contact);
+    }
+  else if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
     {
-      ValentMessage *message;
-      GtkWidget *row;
-      const char *address;
+      g_warning ("%s(): %s", G_STRFUNC, error->message);
+    }
 
-      message = g_ptr_array_index (messages, i);
+  g_clear_pointer (&lookup, contact_lookup_free);
+}
 
-      row = g_object_new (VALENT_TYPE_MESSAGE_ROW,
-                          "message", message,
-                          NULL);
-      gtk_list_box_insert (window->message_search_list, row, -1);
+static void
+valent_sms_window_bind_message (ValentSmsWindow  *self,
+                                GtkListItem      *list_item,
+                                ValentMessageRow *row,
+                                ValentMessage    *message)
+{
+  g_autoptr (GCancellable) cancellable = NULL;
+  ContactLookup *lookup;
+  EContact *contact;
+  const char *address;
 
-      if ((address = valent_message_get_sender (message)) == NULL)
-        {
-          GVariant *metadata;
-          g_autoptr (GVariant) addresses = NULL;
-          g_autoptr (GVariant) address_dict = NULL;
+  valent_message_row_set_message (row, message);
 
-          metadata = valent_message_get_metadata (message);
+  if (self->contact_store == NULL ||
+      (address = message_get_address (message)) == NULL)
+    return;
 
-          if (!g_variant_lookup (metadata, "addresses", "@aa{sv}", &addresses))
-            continue;
+  if ((contact = g_hash_table_lookup (self->contacts, address)) != NULL)
+    {
+      valent_message_row_set_contact (row, contact);
+      return;
+    }
 
-          if (g_variant_n_children (addresses) == 0)
-            continue;
+  /* Only rows that are bound to a visible item are resolved, and the lookup
+   * is cancelled if the row is recycled before it completes */
+  cancellable = g_cancellable_new ();
+  g_object_set_data_full (G_OBJECT (list_item),
+                          "valent-sms-cancellable",
+                          g_object_ref (cancellable),
+                          g_object_unref);
+
+  lookup = g_new0 (ContactLookup, 1);
+  lookup->window = g_object_ref (self);
+  g_weak_ref_init (&lookup->row, row);
+  lookup->cancellable = g_object_ref (cancellable);
+  lookup->address = g_strdup (address);
+
+  valent_sms_contact_from_phone (self->contact_store,
+                                 address,
+                                 cancellable,
+                                 phone_lookup_cb,
+                                 lookup);
+}
 
-          address_dict = g_variant_get_child_value (addresses, 0);
+static void
+valent_sms_window_unbind_message (ValentSmsWindow  *self,
+                                  GtkListItem      *list_item,
+                                  ValentMessageRow *row)
+{
+  GCancellable *cancellable;
 
-          if (!g_variant_lookup (address_dict, "address", "&s", &address))
-            continue;
-        }
+  cancellable = g_object_get_data (G_OBJECT (list_item), "valent-sms-cancellable");
 
-      valent_sms_contact_from_phone (window->contact_store,
-                                     address,
-                                     NULL,
-                                     (GAsyncReadyCallback)phone_lookup_cb,
-                                     row);
+  if (cancellable != NULL)
+    {
+      g_cancellable_cancel (cancellable);
+      g_object_set_data (G_OBJECT (list_item), "valent-sms-cancellable", NULL);
     }
+
+  valent_message_row_set_message (row, NULL);
+  valent_message_row_set_contact (row, NULL);
 }
 
 /*
@@ -170,101 +233,189 @@ reset_search_cb (gpointer data)
 
 /*
  * Message Search
+ *
+ * Each item is a box holding a header, shown above the first message result,
+ * and a row for the contact or message.
  */
+static gboolean
+search_list_has_header (ValentSmsWindow *self,
+                        unsigned int     position)
+{
+  g_autoptr (GObject) item = NULL;
+  g_autoptr (GObject) before = NULL;
+
+  item = g_list_model_get_item (G_LIST_MODEL (self->search), position);
+
+  if (!VALENT_IS_MESSAGE (item))
+    return FALSE;
+
+  if (position == 0)
+    return TRUE;
+
+  before = g_list_model_get_item (G_LIST_MODEL (self->search), position - 1);
+
+  return !VALENT_IS_MESSAGE (before);
+}
+
 static void
-search_header_func (GtkListBoxRow *row,
-                    GtkListBoxRow *before,
-                    gpointer       user_data)
+search_list_setup (GtkListItemFactory *factory,
+                   GtkListItem        *list_item,
+                   ValentSmsWindow    *self)
 {
-  if (VALENT_IS_MESSAGE_ROW (row))
+  GtkWidget *box;
+  GtkWidget *header;
+
+  box = gtk_box_new (GTK_ORIENTATION_VERTICAL, 0);
+  header = g_object_new (GTK_TYPE_LABEL,
+                         "label",        _("Conversations"),
+                         "halign",       GTK_ALIGN_START,
+                         "margin-end",   6,
+                         "margin-start", 6,
+                         "margin-top",   6,
+                         "visible",      FALSE,
+                         NULL);
+  gtk_widget_add_css_class (header, "dim-label");
+  gtk_widget_add_css_class (header, "list-header-title");
+  gtk_box_append (GTK_BOX (box), header);
+
+  gtk_list_item_set_child (list_item, box);
+}
+
+static void
+search_list_bind (GtkListItemFactory *factory,
+                  GtkListItem        *list_item,
+                  ValentSmsWindow    *self)
+{
+  gpointer item = gtk_list_item_get_item (list_item);
+  GtkWidget *box = gtk_list_item_get_child (list_item);
+  GtkWidget *header = gtk_widget_get_first_child (box);
+  GtkWidget *row = gtk_widget_get_next_sibling (header);
+  gboolean has_header;
+
+  if (E_IS_CONTACT (item))
     {
-      if (before == NULL || !VALENT_IS_MESSAGE_ROW (before))
+      GList *numbers = NULL;
+
+      if (!VALENT_IS_CONTACT_ROW (row))
         {
-          GtkWidget *label;
-
-          label = g_object_new (GTK_TYPE_LABEL,
-                                "label",        _("Conversations"),
-                                "halign",       GTK_ALIGN_START,
-                                "margin-end",   6,
-                                "margin-start", 6,
-                                "margin-top",   6,
-                                NULL);
-          gtk_widget_add_css_class (label, "dim-label");
-          gtk_widget_add_css_class (label, "list-header-title");
-          gtk_list_box_row_set_header (row, label);
+          if (row != NULL)
+            gtk_box_remove (GTK_BOX (box), row);
+
+          row = g_object_new (VALENT_TYPE_CONTACT_ROW, NULL);
+          gtk_box_append (GTK_BOX (box), row);
         }
+
+      numbers = e_contact_get (item, E_CONTACT_TEL);
+      g_object_set (row,
+                    "contact",         item,
+                    "contact-address", numbers ? numbers->data : NULL,
+                    NULL);
+      g_list_free_full (numbers, g_free);
     }
+  else if (VALENT_IS_MESSAGE (item))
+    {
+      if (!VALENT_IS_MESSAGE_ROW (row))
+        {
+          if (row != NULL)
+            gtk_box_remove (GTK_BOX (box), row);
 
-  valent_contact_row_header_func (row, before, user_data);
+          row = g_object_new (VALENT_TYPE_MESSAGE_ROW, NULL);
+          gtk_box_append (GTK_BOX (box), row);
+        }
+
+      valent_sms_window_bind_message (self,
+                                      list_item,
+                                      VALENT_MESSAGE_ROW (row),
+                                      VALENT_MESSAGE (item));
+    }
+
+  has_header = search_list_has_header (self, gtk_list_item_get_position (list_item));
+  gtk_widget_set_visible (header, has_header);
+  g_hash_table_add (self->search_items, list_item);
 }
 
 static void
-on_message_search_changed (GtkSearchEntry  *entry,
-                           ValentSmsWindow *window)
+search_list_unbind (GtkListItemFactory *factory,
+                    GtkListItem        *list_item,
+                    ValentSmsWindow    *self)
 {
-  GtkWidget *child;
-  const char *query_str;
-  EBookQuery *queries[2];
-  g_autoptr (EBookQuery) query = NULL;
-  g_autofree char *sexp = NULL;
+  GtkWidget *box = gtk_list_item_get_child (list_item);
+  GtkWidget *row = gtk_widget_get_last_child (box);
 
-  query_str = gtk_editable_get_text (GTK_EDITABLE (entry));
+  if (VALENT_IS_MESSAGE_ROW (row))
+    valent_sms_window_unbind_message (self, list_item, VALENT_MESSAGE_ROW (row));
 
-  /* Clear previous results */
-  while ((child = gtk_widget_get_first_child (GTK_WIDGET (window->message_search_list))))
-    gtk_list_box_remove (window->message_search_list, child);
+  g_hash_table_remove (self->search_items, list_item);
+}
 
-  /* NULL query */
-  if (g_strcmp0 (query_str, "") == 0)
-    return;
+static void
+on_search_items_changed (GListModel      *model,
+                         unsigned int     position,
+                         unsigned int     removed,
+                         unsigned int     added,
+                         ValentSmsWindow *self)
+{
+  /* The item following the change may have gained or lost its header */
+  if (position + added < g_list_model_get_n_items (model))
+    {
+      g_autoptr (GObject) next = NULL;
+      GHashTableIter iter;
+      GtkListItem *list_item;
 
-  /* Search messages */
-  valent_sms_store_find_messages (window->message_store,
-                                  query_str,
-                                  NULL,
-                                  (GAsyncReadyCallback)search_messages_cb,
-                                  window);
-
-  /* Search contacts */
-  queries[0] = e_book_query_field_test (E_CONTACT_FULL_NAME,
-                                        E_BOOK_QUERY_CONTAINS,
-                                        query_str);
-  queries[1] = e_book_query_field_test (E_CONTACT_TEL,
-                                        E_BOOK_QUERY_CONTAINS,
-                                        query_str);
-
-  query = e_book_query_or (G_N_ELEMENTS (queries), queries, TRUE);
-  sexp = e_book_query_to_string (query);
+      next = g_list_model_get_item (model, position + added);
 
-  valent_contact_store_query (window->contact_store,
-                              sexp,
-                              NULL,
-                              (GAsyncReadyCallback)search_contacts_cb,
-                              window);
+      g_hash_table_iter_init (&iter, self->search_items);
+
+      while (g_hash_table_iter_next (&iter, (void **)&list_item, NULL))
+        {
+          if (gtk_list_item_get_item (list_item) == next)
+            {
+              GtkWidget *box = gtk_list_item_get_child (list_item);
+
+              gtk_widget_set_visible (gtk_widget_get_first_child (box),
+                                      search_list_has_header (self, position + added));
+              break;
+            }
+        }
+    }
+
+  if (g_list_model_get_n_items (model) > 0)
+    gtk_stack_set_visible_child_name (self->message_search_stack, "results");
+  else
+    gtk_stack_set_visible_child_name (self->message_search_stack, "placeholder");
 }
 
 static void
-on_message_selected (GtkListBox      *box,
-                     GtkListBoxRow   *row,
+on_message_search_changed (GtkSearchEntry  *entry,
+                           ValentSmsWindow *window)
+{
+  const char *query;
+
+  query = gtk_editable_get_text (GTK_EDITABLE (entry));
+  valent_sms_search_set_query (window->search, query);
+}
+
+static void
+on_message_selected (GtkListView     *view,
+                     unsigned int     position,
                      ValentSmsWindow *self)
 {
-  EContact *contact;
+  g_autoptr (GObject) item = NULL;
 
-  if (VALENT_IS_MESSAGE_ROW (row))
-    {
-      ValentMessage *message;
+  item = g_list_model_get_item (G_LIST_MODEL (self->search), position);
 
-      message = valent_message_row_get_message (VALENT_MESSAGE_ROW (row));
-      valent_sms_window_set_active_message (self, message);
+  if (VALENT_IS_MESSAGE (item))
+    {
+      valent_sms_window_set_active_message (self, VALENT_MESSAGE (item));
 
       /* Reset the search after the transition */
       g_timeout_add_seconds (1, reset_search_cb, self);
     }
-  else if (VALENT_IS_CONTACT_ROW (row))
+  else if (E_IS_CONTACT (item))
     {
-      contact = valent_contact_row_get_contact (VALENT_CONTACT_ROW (row));
       g_debug ("CONTACT ROW SELECTED %s",
-               (const char *)e_contact_get_const (contact, E_CONTACT_FULL_NAME));
+               (const char *)e_contact_get_const (E_CONTACT (item),
+                                                  E_CONTACT_FULL_NAME));
     }
 }
 
@@ -287,9 +438,10 @@ on_contact_selected (GtkListBox      *box,
                      GtkListBoxRow   *row,
                      ValentSmsWindow *self)
 {
+  GtkWidget *contact_row = gtk_list_box_row_get_child (row);
   const char *address;
 
-  address = valent_contact_row_get_contact_address (VALENT_CONTACT_ROW (row));
+  address = valent_contact_row_get_contact_address (VALENT_CONTACT_ROW (contact_row));
   g_debug ("NUMBER SELECTED: %s", address);
 }
 
@@ -353,7 +505,7 @@ on_contact_search_changed (GtkSearchEntry  *entry,
   else if (self->placeholder_contact != NULL)
     {
       gtk_list_box_remove (self->contact_search_list,
-                           self->placeholder_contact);
+                           gtk_widget_get_parent (self->placeholder_contact));
       self->placeholder_contact = NULL;
     }
 
@@ -363,9 +515,10 @@ on_contact_search_changed (GtkSearchEntry  *entry,
 }
 
 static gboolean
-contact_search_list_filter (ValentContactRow *row,
-                            ValentSmsWindow  *self)
+contact_search_list_filter (GtkListBoxRow   *list_row,
+                            ValentSmsWindow *self)
 {
+  ValentContactRow *row = VALENT_CONTACT_ROW (gtk_list_box_row_get_child (list_row));
   const char *query;
   g_autofree char *query_folded = NULL;
   g_autofree char *name = NULL;
@@ -405,14 +558,17 @@ contact_search_list_sort (GtkListBoxRow   *row1,
   const char *name1;
   const char *name2;
 
-  if G_UNLIKELY (GTK_WIDGET (row1) == self->placeholder_contact)
+  GtkWidget *child1 = gtk_list_box_row_get_child (row1);
+  GtkWidget *child2 = gtk_list_box_row_get_child (row2);
+
+  if G_UNLIKELY (child1 == self->placeholder_contact)
     return -1;
 
-  if G_UNLIKELY (GTK_WIDGET (row2) == self->placeholder_contact)
+  if G_UNLIKELY (child2 == self->placeholder_contact)
     return 1;
 
-  name1 = valent_contact_row_get_contact_name (VALENT_CONTACT_ROW (row1));
-  name2 = valent_contact_row_get_contact_name (VALENT_CONTACT_ROW (row2));
+  name1 = valent_contact_row_get_contact_name (VALENT_CONTACT_ROW (child1));
+  name2 = valent_contact_row_get_contact_name (VALENT_CONTACT_ROW (child2));
 
   return g_utf8_collate (name1, name2);
 }
@@ -480,57 +636,143 @@ on_send_message (GObject         *object,
 /*
  * Conversation List Callbacks
  */
-static GtkWidget *
-conversation_list_create (gpointer item,
-                          gpointer user_data)
+static void
+conversation_list_setup (GtkListItemFactory *factory,
+                         GtkListItem        *list_item,
+                         ValentSmsWindow    *self)
 {
-  ValentSmsWindow *window = VALENT_SMS_WINDOW (user_data);
-  ValentMessage *message = VALENT_MESSAGE (item);
-  GtkWidget *row;
-  GVariant *metadata;
-  g_autoptr (GVariant) addresses = NULL;
+  gtk_list_item_set_child (list_item, g_object_new (VALENT_TYPE_MESSAGE_ROW, NULL));
+}
 
-  row = g_object_new (VALENT_TYPE_MESSAGE_ROW,
-                      "message", message,
-                      NULL);
+static void
+conversation_list_bind (GtkListItemFactory *factory,
+                        GtkListItem        *list_item,
+                        ValentSmsWindow    *self)
+{
+  valent_sms_window_bind_message (self,
+                                  list_item,
+                                  VALENT_MESSAGE_ROW (gtk_list_item_get_child (list_item)),
+                                  VALENT_MESSAGE (gtk_list_item_get_item (list_item)));
+}
 
-  /* TODO: probably a failure of kdeconnect-android, but occasionally a message
-   *       will have no addresses */
-  if ((metadata = valent_message_get_metadata (message)) != NULL &&
-      g_variant_lookup (metadata, "addresses", "@aa{sv}", &addresses) &&
-      g_variant_n_children (addresses) > 0)
-    {
-      g_autoptr (GVariant) participant = NULL;
-      const char *address;
+static void
+conversation_list_unbind (GtkListItemFactory *factory,
+                          GtkListItem        *list_item,
+                          ValentSmsWindow    *self)
+{
+  valent_sms_window_unbind_message (self,
+                                    list_item,
+                                    VALENT_MESSAGE_ROW (gtk_list_item_get_child (list_item)));
+}
 
-      participant = g_variant_get_child_value (addresses, 0);
+static void
+on_conversation_items_changed (GListModel      *model,
+                               unsigned int     position,
+                               unsigned int     removed,
+                               unsigned int     added,
+                               ValentSmsWindow *self)
+{
+  if (g_list_model_get_n_items (model) > 0)
+    gtk_stack_set_visible_child_name (self->conversation_stack, "conversations");
+  else
+    gtk_stack_set_visible_child_name (self->conversation_stack, "placeholder");
+}
 
-      if (g_variant_lookup (participant, "address", "&s", &address))
-        {
-          valent_sms_contact_from_phone (window->contact_store,
-                                         address,
-                                         NULL,
-                                         (GAsyncReadyCallback)phone_lookup_cb,
-                                         row);
-        }
+static void
+valent_sms_window_open_thread (ValentSmsWindow *self,
+                               int64_t          thread_id)
+{
+  self->selected_thread = thread_id;
+  valent_sms_window_set_active_thread (self, thread_id);
+  adw_leaflet_navigate (self->content_box, ADW_NAVIGATION_DIRECTION_FORWARD);
+}
+
+static void
+on_conversation_selected (GtkSingleSelection *selection,
+                          GParamSpec         *pspec,
+                          ValentSmsWindow    *self)
+{
+  ValentMessage *message;
+  int64_t thread_id;
+
+  /* Deselect */
+  if ((message = gtk_single_selection_get_selected_item (selection)) == NULL)
+    {
+      self->search_items = g_hash_table_new (NULL, NULL);
+  self->selected_thread = -1;
+      return;
     }
 
-  return row;
+  /* The position of the selected thread changes as messages arrive */
+  thread_id = valent_message_get_thread_id (message);
+
+  if (self->selected_thread == thread_id)
+    return;
+
+  valent_sms_window_open_thread (self, thread_id);
+}
+
+static void
+valent_sms_window_unselect_conversation (ValentSmsWindow *self)
+{
+  GtkSelectionModel *selection;
+
+  selection = gtk_list_view_get_model (self->conversation_list);
+
+  if (selection != NULL)
+    {
+      gtk_single_selection_set_selected (GTK_SINGLE_SELECTION (selection),
+                                         GTK_INVALID_LIST_POSITION);
+    }
 }
 
 static void
 conversation_list_populate (ValentSmsWindow *window)
 {
-  g_autoptr (GListModel) threads = NULL;
+  g_autoptr (GtkListItemFactory) factory = NULL;
+  g_autoptr (GtkSingleSelection) selection = NULL;
+  GListModel *threads = NULL;
 
   g_assert (VALENT_IS_SMS_WINDOW (window));
 
+  factory = gtk_signal_list_item_factory_new ();
+  g_signal_connect_object (factory,
+                           "setup",
+                           G_CALLBACK (conversation_list_setup),
+                           window,
+                           0);
+  g_signal_connect_object (factory,
+                           "bind",
+                           G_CALLBACK (conversation_list_bind),
+                           window,
+                           0);
+  g_signal_connect_object (factory,
+                           "unbind",
+                           G_CALLBACK (conversation_list_unbind),
+                           window,
+                           0);
+
   threads = valent_sms_store_get_summary (window->message_store);
-  gtk_list_box_bind_model (window->conversation_list,
-                           threads,
-                           conversation_list_create,
+  g_signal_connect_object (threads,
+                           "items-changed",
+                           G_CALLBACK (on_conversation_items_changed),
                            window,
-                           NULL);
+                           0);
+  on_conversation_items_changed (threads, 0, 0, 0, window);
+
+  selection = gtk_single_selection_new (threads);
+  gtk_single_selection_set_autoselect (selection, FALSE);
+  gtk_single_selection_set_can_unselect (selection, TRUE);
+  gtk_single_selection_set_selected (selection, GTK_INVALID_LIST_POSITION);
+  g_signal_connect_object (selection,
+                           "notify::selected",
+                           G_CALLBACK (on_conversation_selected),
+                           window,
+                           0);
+
+  gtk_list_view_set_model (window->conversation_list,
+                           GTK_SELECTION_MODEL (selection));
+  gtk_list_view_set_factory (window->conversation_list, factory);
 }
 
 static GtkWidget *
@@ -567,22 +809,20 @@ valent_sms_window_ensure_conversation (ValentSmsWindow *window,
 }
 
 static void
-on_conversation_activated (GtkListBox      *box,
-                           GtkListBoxRow   *row,
+on_conversation_activated (GtkListView     *view,
+                           unsigned int     position,
                            ValentSmsWindow *self)
 {
-  ValentMessageRow *summary;
-  int64_t thread_id;
+  g_autoptr (ValentMessage) message = NULL;
+  GtkSelectionModel *selection;
 
-  /* Deselect */
-  if (row == NULL)
-    return;
+  selection = gtk_list_view_get_model (view);
+  message = g_list_model_get_item (G_LIST_MODEL (selection), position);
 
-  summary = VALENT_MESSAGE_ROW (row);
-  thread_id = valent_message_row_get_thread_id (summary);
+  if (message == NULL)
+    return;
 
-  valent_sms_window_set_active_thread (self, thread_id);
-  adw_leaflet_navigate (self->content_box, ADW_NAVIGATION_DIRECTION_FORWARD);
+  valent_sms_window_open_thread (self, valent_message_get_thread_id (message));
 }
 
 
@@ -598,7 +838,7 @@ new_action (GSimpleAction *action,
 
   g_assert (VALENT_IS_SMS_WINDOW (self));
 
-  gtk_list_box_select_row (self->conversation_list, NULL);
+  valent_sms_window_unselect_conversation (self);
   gtk_label_set_label (self->content_title, _("New Conversation"));
   gtk_stack_set_visible_child_name (self->content, "contacts");
   gtk_widget_grab_focus (self->contact_search_entry);
@@ -646,6 +886,8 @@ static void
 valent_sms_window_constructed (GObject *object)
 {
   ValentSmsWindow *self = VALENT_SMS_WINDOW (object);
+  g_autoptr (GtkListItemFactory) factory = NULL;
+  g_autoptr (GtkNoSelection) selection = NULL;
 
   g_assert (VALENT_IS_CONTACT_STORE (self->contact_store));
   g_assert (VALENT_IS_SMS_STORE (self->message_store));
@@ -653,14 +895,49 @@ valent_sms_window_constructed (GObject *object)
   /* Prepare conversation summaries */
   conversation_list_populate (self);
 
+  /* Prepare message search */
+  self->search = valent_sms_search_new (self->contact_store,
+                                        self->message_store);
+  g_signal_connect_object (self->search,
+                           "items-changed",
+                           G_CALLBACK (on_search_items_changed),
+                           self,
+                           0);
+
+  factory = gtk_signal_list_item_factory_new ();
+  g_signal_connect_object (factory,
+                           "setup",
+                           G_CALLBACK (search_list_setup),
+                           self,
+                           0);
+  g_signal_connect_object (factory,
+                           "bind",
+                           G_CALLBACK (search_list_bind),
+                           self,
+                           0);
+  g_signal_connect_object (factory,
+                           "unbind",
+                           G_CALLBACK (search_list_unbind),
+                           self,
+                           0);
+
+  selection = gtk_no_selection_new (g_object_ref (G_LIST_MODEL (self->search)));
+  gtk_list_view_set_model (self->message_search_list,
+                           GTK_SELECTION_MODEL (selection));
+  gtk_list_view_set_factory (self->message_search_list, factory);
+
   G_OBJECT_CLASS (valent_sms_window_parent_class)->constructed (object);
 }
 
 static void
 valent_sms_window_dispose (GObject *object)
 {
+  ValentSmsWindow *self = VALENT_SMS_WINDOW (object);
   GtkWidget *widget = GTK_WIDGET (object);
 
+  if (self->search != NULL)
+    valent_sms_search_set_query (self->search, NULL);
+
   gtk_widget_dispose_template (widget, VALENT_TYPE_SMS_WINDOW);
 
   G_OBJECT_CLASS (valent_sms_window_parent_class)->dispose (object);
@@ -673,6 +950,9 @@ valent_sms_window_finalize (GObject *object)
 
   g_clear_object (&self->contact_store);
   g_clear_object (&self->message_store);
+  g_clear_object (&self->search);
+  g_clear_pointer (&self->contacts, g_hash_table_unref);
+  g_clear_pointer (&self->search_items, g_hash_table_unref);
 
   G_OBJECT_CLASS (valent_sms_window_parent_class)->finalize (object);
 }
@@ -745,6 +1025,7 @@ valent_sms_window_class_init (ValentSmsWindowClass *klass)
   gtk_widget_class_bind_template_child (widget_class, ValentSmsWindow, content_layout);
 
 
+  gtk_widget_class_bind_template_child (widget_class, ValentSmsWindow, conversation_stack);
   gtk_widget_class_bind_template_child (widget_class, ValentSmsWindow, conversation_list);
   gtk_widget_class_bind_template_child (widget_class, ValentSmsWindow, content);
 
@@ -753,6 +1034,7 @@ valent_sms_window_class_init (ValentSmsWindowClass *klass)
   /* Message Search */
   gtk_widget_class_bind_template_child (widget_class, ValentSmsWindow, message_search);
   gtk_widget_class_bind_template_child (widget_class, ValentSmsWindow, message_search_entry);
+  gtk_widget_class_bind_template_child (widget_class, ValentSmsWindow, message_search_stack);
   gtk_widget_class_bind_template_child (widget_class, ValentSmsWindow, message_search_list);
   gtk_widget_class_bind_template_callback (widget_class, on_message_search_changed);
   gtk_widget_class_bind_template_callback (widget_class, on_message_selected);
@@ -824,15 +1106,15 @@ valent_sms_window_init (ValentSmsWindow *self)
 {
   gtk_widget_init_template (GTK_WIDGET (self));
 
+  self->contacts = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                          g_free,     g_object_unref);
+  self->selected_thread = -1;
+
   /* Window Actions */
   g_action_map_add_action_entries (G_ACTION_MAP (self),
                                    actions, G_N_ELEMENTS (actions),
                                    self);
 
-  gtk_list_box_set_header_func (self->message_search_list,
-                                search_header_func,
-                                self, NULL);
-
   /* Contacts */
   gtk_list_box_set_filter_func (self->contact_search_list,
                                 (GtkListBoxFilterFunc)contact_search_list_filter,
@@ -883,6 +1165,12 @@ valent_sms_window_set_contact_store (ValentSmsWindow    *window,
   if (!g_set_object (&window->contact_store, store))
     return;
 
+  if (window->search != NULL)
+    valent_sms_search_set_contact_store (window->search, store);
+
+  if (window->contacts != NULL)
+    g_hash_table_remove_all (window->contacts);
+
   valent_sms_window_refresh_contacts (window);
   g_object_notify_by_pspec (G_OBJECT (window), properties[PROP_CONTACT_STORE]);
 }
@@ -917,7 +1205,7 @@ valent_sms_window_search_contacts (ValentSmsWindow *window,
   g_return_if_fail (VALENT_IS_SMS_WINDOW (window));
   g_return_if_fail (query != NULL);
 
-  gtk_list_box_select_row (window->conversation_list, NULL);
+  valent_sms_window_unselect_conversation (window);
 
   gtk_label_set_label (window->content_title, _("New Conversation"));
   gtk_stack_set_visible_child_name (window->content, "contacts");
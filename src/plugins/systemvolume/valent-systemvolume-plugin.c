@@ -383,23 +383,6 @@ valent_systemvolume_plugin_update_state (ValentDevicePlugin *plugin,
     valent_systemvolume_plugin_watch_mixer (self, FALSE);
 }
 
-static void
-valent_systemvolume_plugin_handle_packet (ValentDevicePlugin *plugin,
-                                          const char         *type,
-                                          JsonNode           *packet)
-{
-  ValentSystemvolumePlugin *self = VALENT_SYSTEMVOLUME_PLUGIN (plugin);
-
-  g_assert (VALENT_IS_SYSTEMVOLUME_PLUGIN (self));
-  g_assert (type != NULL);
-  g_assert (VALENT_IS_PACKET (packet));
-
-  if (g_str_equal (type, "kdeconnect.systemvolume.request"))
-    valent_systemvolume_plugin_handle_request (self, packet);
-  else
-    g_assert_not_reached ();
-}
-
 /*
  * ValentObject
  */
@@ -438,8 +421,11 @@ valent_systemvolume_plugin_class_init (ValentSystemvolumePluginClass *klass)
 
   vobject_class->destroy = valent_systemvolume_plugin_destroy;
 
-  plugin_class->handle_packet = valent_systemvolume_plugin_handle_packet;
   plugin_class->update_state = valent_systemvolume_plugin_update_state;
+
+  valent_device_plugin_class_install_packet_handler (plugin_class,
+                                                     "kdeconnect.systemvolume.request",
+                                                     (ValentDevicePluginPacketFunc)valent_systemvolume_plugin_handle_request);
 }
 
 static void
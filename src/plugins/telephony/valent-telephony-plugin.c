@@ -380,23 +380,6 @@ valent_telephony_plugin_update_state (ValentDevicePlugin *plugin,
   valent_extension_toggle_actions (VALENT_EXTENSION (plugin), available);
 }
 
-static void
-valent_telephony_plugin_handle_packet (ValentDevicePlugin *plugin,
-                                       const char         *type,
-                                       JsonNode           *packet)
-{
-  ValentTelephonyPlugin *self = VALENT_TELEPHONY_PLUGIN (plugin);
-
-  g_assert (VALENT_IS_TELEPHONY_PLUGIN (plugin));
-  g_assert (type != NULL);
-  g_assert (VALENT_IS_PACKET (packet));
-
-  if (g_str_equal (type, "kdeconnect.telephony"))
-    valent_telephony_plugin_handle_telephony (self, packet);
-  else
-    g_assert_not_reached ();
-}
-
 /*
  * ValentObject
  */
@@ -438,8 +421,11 @@ valent_telephony_plugin_class_init (ValentTelephonyPluginClass *klass)
 
   vobject_class->destroy = valent_telephony_plugin_destroy;
 
-  plugin_class->handle_packet = valent_telephony_plugin_handle_packet;
   plugin_class->update_state = valent_telephony_plugin_update_state;
+
+  valent_device_plugin_class_install_packet_handler (plugin_class,
+                                                     "kdeconnect.telephony",
+                                                     (ValentDevicePluginPacketFunc)valent_telephony_plugin_handle_telephony);
 }
 
 static void
@@ -321,6 +321,50 @@ valent_xdp_input_pointer_motion (ValentInputAdapter *adapter,
   xdp_session_pointer_motion (self->session, dx, dy);
 }
 
+static void
+valent_xdp_input_submit_events (ValentInputAdapter     *adapter,
+                                const ValentInputEvent *events,
+                                unsigned int            n_events)
+{
+  ValentXdpInput *self = VALENT_XDP_INPUT (adapter);
+
+  g_assert (VALENT_IS_INPUT_ADAPTER (adapter));
+  g_assert (VALENT_IS_XDP_INPUT (self));
+
+  if G_UNLIKELY (!ensure_session (self))
+    return;
+
+  for (unsigned int i = 0; i < n_events; i++)
+    {
+      const ValentInputEvent *event = &events[i];
+
+      switch (event->type)
+        {
+        case VALENT_INPUT_EVENT_KEYSYM:
+          xdp_session_keyboard_key (self->session, TRUE, event->code, event->state);
+          break;
+
+        case VALENT_INPUT_EVENT_POINTER_AXIS:
+          /* The X11 workaround is handled by the single-event path */
+          valent_xdp_input_pointer_axis (adapter, event->dx, event->dy);
+          break;
+
+        case VALENT_INPUT_EVENT_POINTER_BUTTON:
+          xdp_session_pointer_button (self->session,
+                                      translate_to_evdev_button (event->code),
+                                      event->state);
+          break;
+
+        case VALENT_INPUT_EVENT_POINTER_MOTION:
+          xdp_session_pointer_motion (self->session, event->dx, event->dy);
+          break;
+
+        default:
+          g_assert_not_reached ();
+        }
+    }
+}
+
 
 /*
  * ValentObject
@@ -368,6 +412,7 @@ valent_xdp_input_class_init (ValentXdpInputClass *klass)
   adapter_class->pointer_axis = valent_xdp_input_pointer_axis;
   adapter_class->pointer_button = valent_xdp_input_pointer_button;
   adapter_class->pointer_motion = valent_xdp_input_pointer_motion;
+  adapter_class->submit_events = valent_xdp_input_submit_events;
 }
 
 static void
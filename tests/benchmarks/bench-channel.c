@@ -0,0 +1,267 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#include <gio/gio.h>
+#include <valent.h>
+#include <libvalent-test.h>
+
+#include "valent-bench.h"
+
+#define BENCH_N_ROUNDTRIPS (10000)
+#define BENCH_N_DISPATCH   (50000)
+#define BENCH_N_LATENCY    (1000)
+#define BENCH_BULK_VCARDS  (2000)
+#define BENCH_BULK_PENDING (4)
+
+
+typedef struct
+{
+  GPtrArray      *corpus;
+  unsigned int    index;
+
+  ValentChannel  *channel;
+  ValentChannel  *endpoint;
+  ValentDevice   *device;
+
+  JsonNode       *bulk;
+  JsonNode       *ping;
+  unsigned int    n_bulk;
+  gboolean        draining;
+} ChannelBench;
+
+static inline JsonNode *
+channel_bench_next (ChannelBench *bench)
+{
+  JsonNode *packet = g_ptr_array_index (bench->corpus, bench->index);
+
+  bench->index = (bench->index + 1) % bench->corpus->len;
+
+  return packet;
+}
+
+static void
+write_packet_cb (ValentChannel *channel,
+                 GAsyncResult  *result,
+                 gboolean      *done)
+{
+  g_autoptr (GError) error = NULL;
+
+  valent_channel_write_packet_finish (channel, result, &error);
+  g_assert_no_error (error);
+
+  *done = TRUE;
+}
+
+static void
+read_packet_cb (ValentChannel  *channel,
+                GAsyncResult   *result,
+                JsonNode      **packet)
+{
+  g_autoptr (GError) error = NULL;
+
+  *packet = valent_channel_read_packet_finish (channel, result, &error);
+  g_assert_no_error (error);
+}
+
+static void
+bench_channel_roundtrip (gpointer data)
+{
+  ChannelBench *bench = data;
+  g_autoptr (JsonNode) packet = NULL;
+  gboolean done = FALSE;
+
+  valent_channel_read_packet (bench->endpoint,
+                              NULL,
+                              (GAsyncReadyCallback)read_packet_cb,
+                              &packet);
+  valent_channel_write_packet (bench->channel,
+                               channel_bench_next (bench),
+                               NULL,
+                               (GAsyncReadyCallback)write_packet_cb,
+                               &done);
+  valent_test_await_boolean (&done);
+  valent_test_await_pointer (&packet);
+}
+
+static void
+write_bulk_cb (ValentChannel *channel,
+               GAsyncResult  *result,
+               ChannelBench  *bench)
+{
+  g_autoptr (GError) error = NULL;
+
+  valent_channel_write_packet_finish (channel, result, &error);
+  g_assert_no_error (error);
+
+  bench->n_bulk--;
+}
+
+static void
+drain_packet_cb (ValentChannel *channel,
+                 GAsyncResult  *result,
+                 ChannelBench  *bench)
+{
+  g_autoptr (JsonNode) packet = NULL;
+  g_autoptr (GError) error = NULL;
+
+  packet = valent_channel_read_packet_finish (channel, result, &error);
+
+  if (packet != NULL)
+    {
+      valent_channel_read_packet (channel,
+                                  NULL,
+                                  (GAsyncReadyCallback)drain_packet_cb,
+                                  bench);
+    }
+  else
+    {
+      bench->draining = FALSE;
+    }
+}
+
+/*
+ * Measure the time to write an interactive packet, while the channel is kept
+ * busy with bulk packets queued before it.
+ */
+static void
+bench_channel_interactive (gpointer data)
+{
+  ChannelBench *bench = data;
+  gboolean done = FALSE;
+
+  while (bench->n_bulk < BENCH_BULK_PENDING)
+    {
+      bench->n_bulk++;
+      valent_channel_write_packet (bench->channel,
+                                   bench->bulk,
+                                   NULL,
+                                   (GAsyncReadyCallback)write_bulk_cb,
+                                   bench);
+    }
+
+  valent_channel_write_packet (bench->channel,
+                               bench->ping,
+                               NULL,
+                               (GAsyncReadyCallback)write_packet_cb,
+                               &done);
+  valent_test_await_boolean (&done);
+}
+
+static JsonNode *
+bench_bulk_packet (void)
+{
+  g_autoptr (JsonBuilder) builder = NULL;
+
+  valent_packet_init (&builder, "kdeconnect.contacts.response_vcards");
+  json_builder_set_member_name (builder, "uids");
+  json_builder_begin_array (builder);
+  for (unsigned int i = 0; i < BENCH_BULK_VCARDS; i++)
+    {
+      g_autofree char *uid = g_strdup_printf ("%u", i);
+
+      json_builder_add_string_value (builder, uid);
+    }
+  json_builder_end_array (builder);
+
+  for (unsigned int i = 0; i < BENCH_BULK_VCARDS; i++)
+    {
+      g_autofree char *uid = g_strdup_printf ("%u", i);
+      g_autofree char *vcard = NULL;
+
+      vcard = g_strdup_printf ("BEGIN:VCARD\n"
+                               "VERSION:2.1\n"
+                               "FN:Contact %u\n"
+                               "TEL;CELL:+1-555-555-%04u\n"
+                               "X-KDECONNECT-ID-DEV-%u:%u\n"
+                               "END:VCARD",
+                               i, i, i, i);
+      json_builder_set_member_name (builder, uid);
+      json_builder_add_string_value (builder, vcard);
+    }
+
+  return valent_packet_end (&builder);
+}
+
+static void
+bench_device_dispatch (gpointer data)
+{
+  ChannelBench *bench = data;
+
+  valent_device_handle_packet (bench->device, channel_bench_next (bench));
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  ChannelBench bench = { 0, };
+  g_autoptr (JsonBuilder) builder = NULL;
+  g_autoptr (JsonNode) packets = NULL;
+  g_autofree ValentChannel **channels = NULL;
+  JsonNode *identity;
+  size_t bytes_per_op = 0;
+
+  valent_test_init (&argc, &argv, NULL);
+
+  bench.corpus = valent_bench_load_corpus ();
+
+  for (unsigned int i = 0; i < bench.corpus->len; i++)
+    {
+      g_autofree char *packet_str = NULL;
+
+      packet_str = valent_packet_serialize (g_ptr_array_index (bench.corpus, i));
+      bytes_per_op += strlen (packet_str);
+    }
+  bytes_per_op /= bench.corpus->len;
+
+  /* A socketpair-backed pair of mock channels */
+  packets = valent_test_load_json ("core.json");
+  identity = json_object_get_member (json_node_get_object (packets), "identity");
+  channels = valent_test_channel_pair (identity, identity);
+  bench.channel = g_steal_pointer (&channels[0]);
+  bench.endpoint = g_steal_pointer (&channels[1]);
+
+  valent_bench_run ("channel/roundtrip",
+                    BENCH_N_ROUNDTRIPS, bytes_per_op,
+                    bench_channel_roundtrip, &bench);
+
+  /* An interactive packet queued behind bulk packets, with the endpoint
+   * reading everything as it arrives */
+  bench.bulk = bench_bulk_packet ();
+  valent_packet_init (&builder, "kdeconnect.ping");
+  bench.ping = valent_packet_end (&builder);
+  bench.draining = TRUE;
+  valent_channel_read_packet (bench.endpoint,
+                              NULL,
+                              (GAsyncReadyCallback)drain_packet_cb,
+                              &bench);
+
+  valent_bench_run ("channel/interactive-latency",
+                    BENCH_N_LATENCY, 0,
+                    bench_channel_interactive, &bench);
+
+  while (bench.n_bulk > 0)
+    g_main_context_iteration (NULL, FALSE);
+
+  /* A paired device, dispatching to the plugins supporting the identity */
+  bench.index = 0;
+  bench.device = valent_device_new_full (identity, NULL);
+  valent_device_set_paired (bench.device, TRUE);
+
+  valent_bench_run ("device/dispatch",
+                    BENCH_N_DISPATCH, bytes_per_op,
+                    bench_device_dispatch, &bench);
+
+  valent_channel_close (bench.endpoint, NULL, NULL);
+  while (bench.draining)
+    g_main_context_iteration (NULL, FALSE);
+  v_await_finalize_object (bench.endpoint);
+  v_await_finalize_object (bench.device);
+  v_await_finalize_object (bench.channel);
+  g_clear_pointer (&bench.corpus, g_ptr_array_unref);
+  g_clear_pointer (&bench.bulk, json_node_unref);
+  g_clear_pointer (&bench.ping, json_node_unref);
+
+  return EXIT_SUCCESS;
+}
+
@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: GPL-3.0-or-later
+# SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+
+"""This script compares the results of two benchmark runs and flags
+regressions. Each file holds one JSON object per line, as written by the
+benchmarks when ``VALENT_BENCH_OUTPUT`` is set::
+
+    VALENT_BENCH_OUTPUT=base.jsonl meson test -C _build --benchmark
+    VALENT_BENCH_OUTPUT=head.jsonl meson test -C _build --benchmark
+    tests/benchmarks/bench-compare.py base.jsonl head.jsonl
+
+The exit status is ``1`` if any metric regressed by more than the threshold.
+"""
+
+
+import argparse
+import json
+import sys
+from typing import Dict, Optional
+
+
+# Metrics and whether a higher value is better
+METRICS = {
+    'ops_per_sec': True,
+    'p50_ns': False,
+    'p90_ns': False,
+    'p99_ns': False,
+    'first_p50_ns': False,
+    'first_p90_ns': False,
+    'allocs_per_op': False,
+    'peak_heap_bytes': False,
+}
+
+
+def load_results(path: str) -> Dict[str, dict]:
+    """Load the benchmark results from ``path``, keyed by name. If a benchmark
+    appears more than once, the last result is used.
+    """
+
+    results = {}
+
+    with open(path, encoding='utf-8') as file:
+        for line in file:
+            line = line.strip()
+
+            if not line.startswith('{'):
+                continue
+
+            result = json.loads(line)
+            results[result['benchmark']] = result
+
+    return results
+
+
+def relative_change(base: Optional[float],
+                    head: Optional[float],
+                    higher_is_better: bool) -> Optional[float]:
+    """Get the change from ``base`` to ``head`` as a fraction, where a positive
+    value is always an improvement.
+    """
+
+    if base is None or head is None or base == 0:
+        return None
+
+    change = (head - base) / base
+
+    return change if higher_is_better else -change
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__.split('\n', 1)[0])
+    parser.add_argument('base', help='results of the baseline build')
+    parser.add_argument('head', help='results of the build to compare')
+    parser.add_argument('--threshold', type=float, default=0.10,
+                        help='fractional change to flag (default: 0.10)')
+    args = parser.parse_args()
+
+    base_results = load_results(args.base)
+    head_results = load_results(args.head)
+    n_regressions = 0
+
+    for name in sorted(base_results.keys() | head_results.keys()):
+        base = base_results.get(name)
+        head = head_results.get(name)
+
+        if base is None or head is None:
+            print(f'{name}: only in {"head" if base is None else "base"}')
+            continue
+
+        for metric, higher_is_better in METRICS.items():
+            change = relative_change(base.get(metric), head.get(metric),
+                                     higher_is_better)
+
+            if change is None:
+                continue
+
+            if change < -args.threshold:
+                status = 'REGRESSION'
+                n_regressions += 1
+            elif change > args.threshold:
+                status = 'improved'
+            else:
+                status = 'ok'
+
+            print(f'{name:<24} {metric:<15} {base[metric]:>14.2f} '
+                  f'{head[metric]:>14.2f} {change:>+8.1%}  {status}')
+
+    if n_regressions > 0:
+        print(f'{n_regressions} regression(s) above {args.threshold:.0%}',
+              file=sys.stderr)
+        return 1
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,462 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#include <gio/gio.h>
+#include <valent.h>
+#include <libvalent-test.h>
+
+#include "valent-bench.h"
+#include "valent-packet-stream-private.h"
+#include "valent-packet-view.h"
+
+#define BENCH_N_OPS       (50000)
+#define BENCH_N_LARGE_OPS (100)
+#define BENCH_N_MESSAGES  (5000)
+#define BENCH_N_CONTACTS  (2000)
+
+
+typedef struct
+{
+  GPtrArray     *corpus;
+  unsigned int   index;
+
+  GInputStream  *input;
+  goffset        input_len;
+  GOutputStream *output;
+
+  /* Large packets, without the line terminator */
+  char          *large[2];
+  size_t         large_len[2];
+  unsigned int   large_index;
+
+  /* The streamed fields, as registered by the SMS and contacts plugins */
+  GHashTable    *fields;
+} PacketBench;
+
+static inline JsonNode *
+packet_bench_next (PacketBench *bench)
+{
+  JsonNode *packet = g_ptr_array_index (bench->corpus, bench->index);
+
+  bench->index = (bench->index + 1) % bench->corpus->len;
+
+  return packet;
+}
+
+static void
+bench_packet_serialize (gpointer data)
+{
+  PacketBench *bench = data;
+  g_autofree char *packet_str = NULL;
+
+  packet_str = valent_packet_serialize (packet_bench_next (bench));
+  g_assert_nonnull (packet_str);
+}
+
+static void
+bench_packet_from_stream (gpointer data)
+{
+  PacketBench *bench = data;
+  g_autoptr (JsonNode) packet = NULL;
+  g_autoptr (GError) error = NULL;
+
+  /* Rewind at the end of the corpus */
+  if (g_seekable_tell (G_SEEKABLE (bench->input)) >= bench->input_len)
+    g_seekable_seek (G_SEEKABLE (bench->input), 0, G_SEEK_SET, NULL, NULL);
+
+  packet = valent_packet_from_stream (bench->input, -1, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_nonnull (packet);
+}
+
+static void
+bench_packet_to_stream (gpointer data)
+{
+  PacketBench *bench = data;
+  g_autoptr (GError) error = NULL;
+
+  /* Rewind at the end of the corpus, to keep the buffer size bounded */
+  if (bench->index == 0)
+    g_seekable_seek (G_SEEKABLE (bench->output), 0, G_SEEK_SET, NULL, NULL);
+
+  valent_packet_to_stream (bench->output,
+                           packet_bench_next (bench),
+                           NULL,
+                           &error);
+  g_assert_no_error (error);
+}
+
+static inline unsigned int
+packet_bench_next_large (PacketBench *bench)
+{
+  unsigned int index = bench->large_index;
+
+  bench->large_index = (bench->large_index + 1) % G_N_ELEMENTS (bench->large);
+
+  return index;
+}
+
+/*
+ * A message history, similar to the response to a thread request
+ */
+static char *
+packet_bench_large_messages (void)
+{
+  g_autoptr (JsonBuilder) builder = NULL;
+  g_autoptr (JsonNode) packet = NULL;
+
+  valent_packet_init (&builder, "kdeconnect.sms.messages");
+  json_builder_set_member_name (builder, "messages");
+  json_builder_begin_array (builder);
+
+  for (unsigned int i = 0; i < BENCH_N_MESSAGES; i++)
+    {
+      g_autofree char *address = NULL;
+      g_autofree char *body = NULL;
+
+      address = g_strdup_printf ("+1-555-01%02u", i % 100);
+      body = g_strdup_printf ("Message %u, which is about as long as a "
+                              "typical text message tends to be", i);
+
+      json_builder_begin_object (builder);
+      json_builder_set_member_name (builder, "addresses");
+      json_builder_begin_array (builder);
+      json_builder_begin_object (builder);
+      json_builder_set_member_name (builder, "address");
+      json_builder_add_string_value (builder, address);
+      json_builder_end_object (builder);
+      json_builder_end_array (builder);
+      json_builder_set_member_name (builder, "body");
+      json_builder_add_string_value (builder, body);
+      json_builder_set_member_name (builder, "date");
+      json_builder_add_int_value (builder, 1700000000000 + i);
+      json_builder_set_member_name (builder, "type");
+      json_builder_add_int_value (builder, 1 + (i % 2));
+      json_builder_set_member_name (builder, "read");
+      json_builder_add_int_value (builder, 1);
+      json_builder_set_member_name (builder, "thread_id");
+      json_builder_add_int_value (builder, i % 100);
+      json_builder_set_member_name (builder, "_id");
+      json_builder_add_int_value (builder, i);
+      json_builder_set_member_name (builder, "sub_id");
+      json_builder_add_int_value (builder, -1);
+      json_builder_set_member_name (builder, "event");
+      json_builder_add_int_value (builder, 1);
+      json_builder_end_object (builder);
+    }
+
+  json_builder_end_array (builder);
+  json_builder_set_member_name (builder, "version");
+  json_builder_add_int_value (builder, 2);
+  packet = valent_packet_end (&builder);
+
+  return valent_packet_serialize (packet);
+}
+
+/*
+ * An address book, similar to the response to a vCard request
+ */
+static char *
+packet_bench_large_vcards (void)
+{
+  g_autoptr (JsonBuilder) builder = NULL;
+  g_autoptr (JsonNode) packet = NULL;
+
+  valent_packet_init (&builder, "kdeconnect.contacts.response_vcards");
+
+  for (unsigned int i = 0; i < BENCH_N_CONTACTS; i++)
+    {
+      g_autofree char *uid = NULL;
+      g_autofree char *vcard = NULL;
+
+      uid = g_strdup_printf ("contact-%u", i);
+      vcard = g_strdup_printf ("BEGIN:VCARD\n"
+                               "VERSION:2.1\n"
+                               "FN:Contact %u\n"
+                               "TEL;CELL:+1-555-01%02u\n"
+                               "X-KDECONNECT-ID-DEV-bench:%s\n"
+                               "X-KDECONNECT-TIMESTAMP:%u\n"
+                               "END:VCARD",
+                               i, i % 100, uid, 1700000000 + i);
+
+      json_builder_set_member_name (builder, uid);
+      json_builder_add_string_value (builder, vcard);
+    }
+
+  json_builder_set_member_name (builder, "uids");
+  json_builder_begin_array (builder);
+
+  for (unsigned int i = 0; i < BENCH_N_CONTACTS; i++)
+    {
+      g_autofree char *uid = g_strdup_printf ("contact-%u", i);
+
+      json_builder_add_string_value (builder, uid);
+    }
+
+  json_builder_end_array (builder);
+  packet = valent_packet_end (&builder);
+
+  return valent_packet_serialize (packet);
+}
+
+/*
+ * The large packet benchmarks copy the line first, since the channel hands a
+ * freshly read line to the parser, so the peak heap of each operation includes
+ * the line and everything built from it.
+ */
+static void
+bench_packet_large_deserialize (gpointer data)
+{
+  PacketBench *bench = data;
+  unsigned int index = packet_bench_next_large (bench);
+  g_autofree char *line = NULL;
+  g_autoptr (JsonNode) packet = NULL;
+  g_autoptr (GError) error = NULL;
+
+  line = g_strndup (bench->large[index], bench->large_len[index]);
+  packet = valent_packet_deserialize (line, &error);
+  g_assert_no_error (error);
+
+  /* The first element is only available once the whole packet is parsed */
+  valent_bench_mark_first ();
+}
+
+static void
+bench_packet_large_view (gpointer data)
+{
+  PacketBench *bench = data;
+  unsigned int index = packet_bench_next_large (bench);
+  g_autoptr (ValentPacketView) view = NULL;
+  g_autoptr (GError) error = NULL;
+
+  view = valent_packet_view_new (g_strndup (bench->large[index],
+                                            bench->large_len[index]),
+                                 bench->large_len[index],
+                                 &error);
+  g_assert_no_error (error);
+}
+
+static void
+bench_packet_large_view_to_node (gpointer data)
+{
+  PacketBench *bench = data;
+  unsigned int index = packet_bench_next_large (bench);
+  g_autoptr (ValentPacketView) view = NULL;
+  g_autoptr (JsonNode) packet = NULL;
+  g_autoptr (GError) error = NULL;
+
+  view = valent_packet_view_new (g_strndup (bench->large[index],
+                                            bench->large_len[index]),
+                                 bench->large_len[index],
+                                 &error);
+  g_assert_no_error (error);
+
+  packet = valent_packet_view_to_node (view);
+  g_assert_nonnull (packet);
+  valent_bench_mark_first ();
+}
+
+typedef struct
+{
+  GBufferedInputStream *input;
+  GHashTable           *fields;
+  ValentPacketStream   *stream;
+  JsonNode             *element;
+  gboolean              done;
+} StreamOp;
+
+static void
+stream_op_func (ValentPacketStream *stream,
+                gpointer            user_data)
+{
+  StreamOp *op = user_data;
+
+  g_atomic_pointer_set (&op->stream, g_object_ref (stream));
+}
+
+static void
+stream_op_read_line (GTask        *task,
+                     gpointer      source_object,
+                     gpointer      task_data,
+                     GCancellable *cancellable)
+{
+  StreamOp *op = task_data;
+  ValentPacketView *view = NULL;
+  size_t n_read = 0;
+  gboolean streamed = FALSE;
+  GError *error = NULL;
+
+  view = valent_packet_stream_read_line (op->input,
+                                         op->fields,
+                                         stream_op_func,
+                                         op,
+                                         &n_read,
+                                         &streamed,
+                                         cancellable,
+                                         &error);
+  if (view == NULL)
+    return g_task_return_error (task, error);
+
+  g_assert_true (streamed);
+  g_task_return_pointer (task, view, (GDestroyNotify)valent_packet_view_unref);
+}
+
+static void
+stream_op_read_cb (ValentPacketStream *stream,
+                   GAsyncResult       *result,
+                   gpointer            user_data)
+{
+  StreamOp *op = user_data;
+  g_autofree char *name = NULL;
+  GError *error = NULL;
+
+  op->element = valent_packet_stream_read_finish (stream, result, &name, &error);
+  g_assert_no_error (error);
+  op->done = TRUE;
+}
+
+/*
+ * Like the channel, the line is read in a thread while the elements are
+ * consumed on the main thread, and each element is dropped once it has been
+ * handled. The peak heap of each operation includes the reading thread.
+ */
+static void
+bench_packet_large_stream (gpointer data)
+{
+  PacketBench *bench = data;
+  unsigned int index = packet_bench_next_large (bench);
+  g_autoptr (GInputStream) base = NULL;
+  g_autoptr (GTask) task = NULL;
+  g_autoptr (ValentPacketView) view = NULL;
+  StreamOp op = { 0, };
+  unsigned int n_elements = 0;
+  g_autoptr (GError) error = NULL;
+
+  /* Include the line terminator */
+  base = g_memory_input_stream_new_from_data (bench->large[index],
+                                              bench->large_len[index] + 1,
+                                              NULL);
+  op.input = G_BUFFERED_INPUT_STREAM (g_buffered_input_stream_new (base));
+  op.fields = bench->fields;
+
+  task = g_task_new (NULL, NULL, NULL, NULL);
+  g_task_set_task_data (task, &op, NULL);
+  g_task_run_in_thread (task, stream_op_read_line);
+
+  while (g_atomic_pointer_get (&op.stream) == NULL)
+    g_main_context_iteration (NULL, FALSE);
+
+  do
+    {
+      g_clear_pointer (&op.element, json_node_unref);
+      op.done = FALSE;
+
+      valent_packet_stream_read (op.stream,
+                                 NULL,
+                                 (GAsyncReadyCallback)stream_op_read_cb,
+                                 &op);
+      valent_test_await_boolean (&op.done);
+
+      if (op.element != NULL && n_elements++ == 0)
+        valent_bench_mark_first ();
+    }
+  while (op.element != NULL);
+
+  while (!g_task_get_completed (task))
+    g_main_context_iteration (NULL, FALSE);
+
+  view = g_task_propagate_pointer (task, &error);
+  g_assert_no_error (error);
+  g_assert_cmpuint (n_elements, >, 0);
+
+  g_clear_object (&op.stream);
+  g_clear_object (&op.input);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  PacketBench bench = { 0, };
+  g_autoptr (GByteArray) buffer = NULL;
+  g_autoptr (GBytes) bytes = NULL;
+  size_t bytes_per_op;
+
+  valent_test_init (&argc, &argv, NULL);
+
+  bench.corpus = valent_bench_load_corpus ();
+
+  /* Prepare a stream of the serialized corpus */
+  buffer = g_byte_array_new ();
+
+  for (unsigned int i = 0; i < bench.corpus->len; i++)
+    {
+      g_autofree char *packet_str = NULL;
+
+      packet_str = valent_packet_serialize (g_ptr_array_index (bench.corpus, i));
+      g_byte_array_append (buffer, (uint8_t *)packet_str, strlen (packet_str));
+    }
+
+  bytes_per_op = buffer->len / bench.corpus->len;
+  bench.input_len = buffer->len;
+  bytes = g_byte_array_free_to_bytes (g_steal_pointer (&buffer));
+  bench.input = g_memory_input_stream_new_from_bytes (bytes);
+  bench.output = g_memory_output_stream_new_resizable ();
+
+  valent_bench_run ("packet/serialize",
+                    BENCH_N_OPS, bytes_per_op,
+                    bench_packet_serialize, &bench);
+
+  valent_bench_run ("packet/from-stream",
+                    BENCH_N_OPS, bytes_per_op,
+                    bench_packet_from_stream, &bench);
+
+  bench.index = 0;
+  valent_bench_run ("packet/to-stream",
+                    BENCH_N_OPS, bytes_per_op,
+                    bench_packet_to_stream, &bench);
+
+  /* Prepare the large packets */
+  bench.large[0] = packet_bench_large_messages ();
+  bench.large[1] = packet_bench_large_vcards ();
+  bytes_per_op = 0;
+
+  for (unsigned int i = 0; i < G_N_ELEMENTS (bench.large); i++)
+    {
+      bench.large_len[i] = strlen (bench.large[i]) - 1;
+      bytes_per_op += bench.large_len[i] / G_N_ELEMENTS (bench.large);
+    }
+
+  valent_bench_run ("packet/large-deserialize",
+                    BENCH_N_LARGE_OPS, bytes_per_op,
+                    bench_packet_large_deserialize, &bench);
+
+  bench.large_index = 0;
+  valent_bench_run ("packet/large-view",
+                    BENCH_N_LARGE_OPS, bytes_per_op,
+                    bench_packet_large_view, &bench);
+
+  bench.large_index = 0;
+  valent_bench_run ("packet/large-view-to-node",
+                    BENCH_N_LARGE_OPS, bytes_per_op,
+                    bench_packet_large_view_to_node, &bench);
+
+  bench.large_index = 0;
+  bench.fields = g_hash_table_new (g_str_hash, g_str_equal);
+  g_hash_table_insert (bench.fields, "kdeconnect.sms.messages", "messages");
+  g_hash_table_insert (bench.fields, "kdeconnect.contacts.response_vcards", NULL);
+  valent_bench_run ("packet/large-stream",
+                    BENCH_N_LARGE_OPS, bytes_per_op,
+                    bench_packet_large_stream, &bench);
+  g_clear_pointer (&bench.fields, g_hash_table_unref);
+
+  for (unsigned int i = 0; i < G_N_ELEMENTS (bench.large); i++)
+    g_clear_pointer (&bench.large[i], g_free);
+
+  g_clear_object (&bench.input);
+  g_clear_object (&bench.output);
+  g_clear_pointer (&bench.corpus, g_ptr_array_unref);
+
+  return EXIT_SUCCESS;
+}
+
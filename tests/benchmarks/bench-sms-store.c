@@ -0,0 +1,122 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#include <gio/gio.h>
+#include <valent.h>
+#include <libvalent-test.h>
+
+#include "valent-bench.h"
+#include "valent-message.h"
+#include "valent-sms-store.h"
+
+#define BENCH_N_OPS      (200)
+#define BENCH_BATCH_SIZE (100)
+#define BENCH_N_THREADS  (20)
+
+
+typedef struct
+{
+  ValentSmsStore *store;
+  GPtrArray      *batches;
+  unsigned int    index;
+} SmsBench;
+
+static void
+add_messages_cb (ValentSmsStore *store,
+                 GAsyncResult   *result,
+                 gboolean       *done)
+{
+  g_autoptr (GError) error = NULL;
+
+  valent_sms_store_add_messages_finish (store, result, &error);
+  g_assert_no_error (error);
+
+  *done = TRUE;
+}
+
+static void
+bench_sms_store_ingest (gpointer data)
+{
+  SmsBench *bench = data;
+  GPtrArray *messages;
+  gboolean done = FALSE;
+
+  messages = g_ptr_array_index (bench->batches, bench->index);
+  bench->index = (bench->index + 1) % bench->batches->len;
+
+  valent_sms_store_add_messages (bench->store,
+                                 messages,
+                                 NULL,
+                                 (GAsyncReadyCallback)add_messages_cb,
+                                 &done);
+  valent_test_await_boolean (&done);
+}
+
+static GPtrArray *
+create_batch (unsigned int batch)
+{
+  GPtrArray *messages;
+
+  messages = g_ptr_array_new_full (BENCH_BATCH_SIZE, g_object_unref);
+
+  for (unsigned int i = 0; i < BENCH_BATCH_SIZE; i++)
+    {
+      int64_t id = ((int64_t)batch * BENCH_BATCH_SIZE) + i + 1;
+      int64_t thread_id = (id % BENCH_N_THREADS) + 1;
+      g_autofree char *sender = NULL;
+      g_autofree char *text = NULL;
+      GVariant *metadata;
+
+      sender = g_strdup_printf ("+1-234-567-%04"G_GINT64_FORMAT, thread_id);
+      text = g_strdup_printf ("Thread %"G_GINT64_FORMAT", Message %"G_GINT64_FORMAT,
+                              thread_id, id);
+      metadata = g_variant_new_parsed ("{'addresses': <[{'address': <%s>}]>}",
+                                       sender);
+      g_ptr_array_add (messages,
+                       g_object_new (VALENT_TYPE_MESSAGE,
+                                     "box",       VALENT_MESSAGE_BOX_INBOX,
+                                     "date",      id,
+                                     "id",        id,
+                                     "metadata",  metadata,
+                                     "read",      FALSE,
+                                     "sender",    sender,
+                                     "text",      text,
+                                     "thread-id", thread_id,
+                                     NULL));
+    }
+
+  return messages;
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  SmsBench bench = { 0, };
+  g_autoptr (ValentContext) context = NULL;
+
+  valent_test_init (&argc, &argv, NULL);
+
+  context = g_object_new (VALENT_TYPE_CONTEXT,
+                          "domain", "device",
+                          "id",     "bench-device",
+                          NULL);
+  bench.store = valent_sms_store_new (context);
+
+  /* Each batch is unique, so that every operation inserts new messages
+   * instead of updating existing ones. The warm-up uses the first tenth. */
+  bench.batches = g_ptr_array_new_with_free_func ((GDestroyNotify)g_ptr_array_unref);
+
+  for (unsigned int i = 0; i < BENCH_N_OPS + (BENCH_N_OPS / 10); i++)
+    g_ptr_array_add (bench.batches, create_batch (i));
+
+  valent_bench_run ("sms-store/ingest",
+                    BENCH_N_OPS, 0,
+                    bench_sms_store_ingest, &bench);
+
+  v_await_finalize_object (bench.store);
+  g_clear_pointer (&bench.batches, g_ptr_array_unref);
+
+  return EXIT_SUCCESS;
+}
+
@@ -0,0 +1,413 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <valent.h>
+#include <libvalent-test.h>
+
+#include "valent-bench.h"
+
+
+/*
+ * Allocation Counting
+ *
+ * The allocator entry points are interposed to count calls and live heap
+ * bytes, which is only possible with glibc and when the build is not
+ * instrumented by a sanitizer.
+ */
+static unsigned long n_allocs = 0;
+static long          heap_live = 0;
+static long          heap_peak = 0;
+
+#ifdef VALENT_BENCH_COUNT_ALLOCS
+#include <malloc.h>
+
+extern void *__libc_malloc   (size_t size);
+extern void *__libc_calloc   (size_t nmemb,
+                              size_t size);
+extern void *__libc_realloc  (void  *ptr,
+                              size_t size);
+extern void *__libc_memalign (size_t alignment,
+                              size_t size);
+extern void  __libc_free     (void  *ptr);
+
+static inline void
+heap_add (void *ptr)
+{
+  long live, peak;
+
+  if (ptr == NULL)
+    return;
+
+  live = __atomic_add_fetch (&heap_live, malloc_usable_size (ptr), __ATOMIC_RELAXED);
+  peak = __atomic_load_n (&heap_peak, __ATOMIC_RELAXED);
+
+  while (live > peak &&
+         !__atomic_compare_exchange_n (&heap_peak, &peak, live, TRUE,
+                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    continue;
+}
+
+static inline void
+heap_remove (void *ptr)
+{
+  if (ptr != NULL)
+    __atomic_sub_fetch (&heap_live, malloc_usable_size (ptr), __ATOMIC_RELAXED);
+}
+
+void *
+malloc (size_t size)
+{
+  void *ret;
+
+  __atomic_fetch_add (&n_allocs, 1, __ATOMIC_RELAXED);
+  ret = __libc_malloc (size);
+  heap_add (ret);
+
+  return ret;
+}
+
+void *
+calloc (size_t nmemb,
+        size_t size)
+{
+  void *ret;
+
+  __atomic_fetch_add (&n_allocs, 1, __ATOMIC_RELAXED);
+  ret = __libc_calloc (nmemb, size);
+  heap_add (ret);
+
+  return ret;
+}
+
+void *
+realloc (void   *ptr,
+         size_t  size)
+{
+  void *ret;
+
+  __atomic_fetch_add (&n_allocs, 1, __ATOMIC_RELAXED);
+  heap_remove (ptr);
+  ret = __libc_realloc (ptr, size);
+  heap_add (ret != NULL || size == 0 ? ret : ptr);
+
+  return ret;
+}
+
+void *
+memalign (size_t alignment,
+          size_t size)
+{
+  void *ret;
+
+  __atomic_fetch_add (&n_allocs, 1, __ATOMIC_RELAXED);
+  ret = __libc_memalign (alignment, size);
+  heap_add (ret);
+
+  return ret;
+}
+
+void *
+aligned_alloc (size_t alignment,
+               size_t size)
+{
+  return memalign (alignment, size);
+}
+
+int
+posix_memalign (void   **memptr,
+                size_t   alignment,
+                size_t   size)
+{
+  void *ret;
+
+  if (alignment % sizeof (void *) != 0 || (alignment & (alignment - 1)) != 0)
+    return EINVAL;
+
+  if ((ret = memalign (alignment, size)) == NULL)
+    return ENOMEM;
+
+  *memptr = ret;
+
+  return 0;
+}
+
+void
+free (void *ptr)
+{
+  heap_remove (ptr);
+  __libc_free (ptr);
+}
+#endif /* VALENT_BENCH_COUNT_ALLOCS */
+
+static inline int64_t
+bench_time_nsec (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return ((int64_t)ts.tv_sec * 1000000000L) + ts.tv_nsec;
+}
+
+static int
+bench_compare_nsec (gconstpointer a,
+                    gconstpointer b)
+{
+  int64_t lhs = *(const int64_t *)a;
+  int64_t rhs = *(const int64_t *)b;
+
+  return (lhs > rhs) - (lhs < rhs);
+}
+
+static inline int64_t
+bench_percentile (const int64_t *samples,
+                  unsigned int   n_samples,
+                  double         percentile)
+{
+  unsigned int index = (unsigned int)(percentile * (n_samples - 1));
+
+  return samples[index];
+}
+
+/*
+ * Time To First Result
+ *
+ * Operations that produce results incrementally may mark the arrival of the
+ * first one, which is recorded relative to the start of the operation.
+ */
+static int64_t op_begin_nsec = 0;
+static int64_t op_first_nsec = -1;
+
+/**
+ * valent_bench_mark_first:
+ *
+ * Mark the first result of the current operation, such as the first element
+ * read from a stream.
+ *
+ * Only the first call during each operation is recorded. This must be called
+ * from the thread running the benchmark.
+ */
+void
+valent_bench_mark_first (void)
+{
+  if (op_first_nsec < 0)
+    op_first_nsec = bench_time_nsec () - op_begin_nsec;
+}
+
+static void
+bench_report (const char *line)
+{
+  const char *path = g_getenv ("VALENT_BENCH_OUTPUT");
+
+  g_print ("%s\n", line);
+
+  if (path != NULL && *path != '\0')
+    {
+      FILE *file = fopen (path, "a");
+
+      if (file == NULL)
+        {
+          g_warning ("%s(): %s: %s", G_STRFUNC, path, g_strerror (errno));
+          return;
+        }
+
+      fprintf (file, "%s\n", line);
+      fclose (file);
+    }
+}
+
+/**
+ * valent_bench_run:
+ * @name: a unique name for the benchmark
+ * @n_ops: the number of operations to measure
+ * @bytes_per_op: the number of bytes processed by each operation, or `0`
+ * @func: (scope call): the operation to measure
+ * @data: (closure): user supplied data
+ *
+ * Measure @n_ops calls to @func, after a short warm-up.
+ *
+ * The result is printed as a single line of JSON, including the throughput,
+ * mean and percentile latencies, allocations per operation and the largest
+ * growth of the heap during any one operation. If the operations call
+ * [func@valent_bench_mark_first], the percentile latencies of the first result
+ * are included. If the
+ * `VALENT_BENCH_OUTPUT` environment variable is set, the line is also appended
+ * to the named file, for comparison with `bench-compare.py`.
+ */
+void
+valent_bench_run (const char      *name,
+                  unsigned int     n_ops,
+                  size_t           bytes_per_op,
+                  ValentBenchFunc  func,
+                  gpointer         data)
+{
+  g_autofree int64_t *samples = NULL;
+  g_autofree int64_t *first_samples = NULL;
+  unsigned int n_first = 0;
+  g_autoptr (JsonBuilder) builder = NULL;
+  g_autoptr (JsonNode) result = NULL;
+  g_autofree char *line = NULL;
+  unsigned long allocs_begin;
+  unsigned long allocs_end;
+  long peak_bytes = 0;
+  int64_t total_nsec = 0;
+  double total_sec;
+
+  g_assert (name != NULL && *name != '\0');
+  g_assert (n_ops > 0);
+  g_assert (func != NULL);
+
+  /* Warm up caches, lazy type registration and allocator pools */
+  for (unsigned int i = 0; i < MAX (n_ops / 10, 1); i++)
+    func (data);
+
+  samples = g_new0 (int64_t, n_ops);
+  first_samples = g_new0 (int64_t, n_ops);
+  allocs_begin = __atomic_load_n (&n_allocs, __ATOMIC_RELAXED);
+
+  for (unsigned int i = 0; i < n_ops; i++)
+    {
+      long begin_bytes = __atomic_load_n (&heap_live, __ATOMIC_RELAXED);
+      int64_t begin_nsec;
+
+      __atomic_store_n (&heap_peak, begin_bytes, __ATOMIC_RELAXED);
+      begin_nsec = bench_time_nsec ();
+      op_begin_nsec = begin_nsec;
+      op_first_nsec = -1;
+
+      func (data);
+
+      samples[i] = bench_time_nsec () - begin_nsec;
+
+      if (op_first_nsec >= 0)
+        first_samples[n_first++] = op_first_nsec;
+
+      total_nsec += samples[i];
+      peak_bytes = MAX (peak_bytes,
+                        __atomic_load_n (&heap_peak, __ATOMIC_RELAXED) - begin_bytes);
+    }
+
+  allocs_end = __atomic_load_n (&n_allocs, __ATOMIC_RELAXED);
+  qsort (samples, n_ops, sizeof (int64_t), bench_compare_nsec);
+  qsort (first_samples, n_first, sizeof (int64_t), bench_compare_nsec);
+  total_sec = (double)total_nsec / G_NSEC_PER_SEC;
+
+  builder = json_builder_new ();
+  json_builder_begin_object (builder);
+  json_builder_set_member_name (builder, "benchmark");
+  json_builder_add_string_value (builder, name);
+  json_builder_set_member_name (builder, "ops");
+  json_builder_add_int_value (builder, n_ops);
+  json_builder_set_member_name (builder, "ops_per_sec");
+  json_builder_add_double_value (builder, n_ops / total_sec);
+  json_builder_set_member_name (builder, "bytes_per_sec");
+  json_builder_add_double_value (builder, (n_ops * bytes_per_op) / total_sec);
+  json_builder_set_member_name (builder, "mean_ns");
+  json_builder_add_double_value (builder, (double)total_nsec / n_ops);
+  json_builder_set_member_name (builder, "p50_ns");
+  json_builder_add_int_value (builder, bench_percentile (samples, n_ops, 0.50));
+  json_builder_set_member_name (builder, "p90_ns");
+  json_builder_add_int_value (builder, bench_percentile (samples, n_ops, 0.90));
+  json_builder_set_member_name (builder, "p99_ns");
+  json_builder_add_int_value (builder, bench_percentile (samples, n_ops, 0.99));
+
+  if (n_first > 0)
+    {
+      json_builder_set_member_name (builder, "first_p50_ns");
+      json_builder_add_int_value (builder, bench_percentile (first_samples, n_first, 0.50));
+      json_builder_set_member_name (builder, "first_p90_ns");
+      json_builder_add_int_value (builder, bench_percentile (first_samples, n_first, 0.90));
+      json_builder_set_member_name (builder, "first_p99_ns");
+      json_builder_add_int_value (builder, bench_percentile (first_samples, n_first, 0.99));
+    }
+
+  json_builder_set_member_name (builder, "allocs_per_op");
+#ifdef VALENT_BENCH_COUNT_ALLOCS
+  json_builder_add_double_value (builder, (double)(allocs_end - allocs_begin) / n_ops);
+  json_builder_set_member_name (builder, "peak_heap_bytes");
+  json_builder_add_int_value (builder, peak_bytes);
+#else
+  json_builder_add_null_value (builder);
+  json_builder_set_member_name (builder, "peak_heap_bytes");
+  json_builder_add_null_value (builder);
+  (void)allocs_begin;
+  (void)allocs_end;
+  (void)peak_bytes;
+#endif /* VALENT_BENCH_COUNT_ALLOCS */
+  json_builder_end_object (builder);
+
+  result = json_builder_get_root (builder);
+  line = json_to_string (result, FALSE);
+  bench_report (line);
+}
+
+
+/**
+ * valent_bench_load_corpus:
+ *
+ * Load the packet corpus from the test fixtures.
+ *
+ * This includes every packet in the `core-*.json` and `plugin-*.json` files,
+ * except those that would change the pair state of a device or are only
+ * understood by the mock plugin.
+ *
+ * Returns: (transfer full) (element-type Json.Node): a list of packets
+ */
+GPtrArray *
+valent_bench_load_corpus (void)
+{
+  g_autoptr (GPtrArray) corpus = NULL;
+  g_auto (GStrv) names = NULL;
+  g_autoptr (GError) error = NULL;
+
+  corpus = g_ptr_array_new_with_free_func ((GDestroyNotify)json_node_unref);
+  names = g_resources_enumerate_children ("/tests", 0, &error);
+  g_assert_no_error (error);
+
+  for (unsigned int i = 0; names[i] != NULL; i++)
+    {
+      g_autoptr (JsonNode) root = NULL;
+      JsonObjectIter iter;
+      JsonNode *packet;
+
+      if (!g_str_has_suffix (names[i], ".json") ||
+          (!g_str_has_prefix (names[i], "core") &&
+           !g_str_has_prefix (names[i], "plugin-")))
+        continue;
+
+      root = valent_test_load_json (names[i]);
+
+      if (!JSON_NODE_HOLDS_OBJECT (root))
+        continue;
+
+      json_object_iter_init (&iter, json_node_get_object (root));
+
+      while (json_object_iter_next (&iter, NULL, &packet))
+        {
+          const char *type;
+
+          if (!VALENT_IS_PACKET (packet))
+            continue;
+
+          type = valent_packet_get_type (packet);
+
+          if (g_str_equal (type, "kdeconnect.pair") ||
+              g_str_has_prefix (type, "kdeconnect.mock"))
+            continue;
+
+          g_ptr_array_add (corpus, json_node_ref (packet));
+        }
+    }
+
+  g_assert_cmpuint (corpus->len, >, 0);
+
+  return g_steal_pointer (&corpus);
+}
+
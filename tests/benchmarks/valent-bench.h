@@ -0,0 +1,27 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * ValentBenchFunc:
+ * @data: (closure): user supplied data
+ *
+ * A function that performs a single operation to be measured.
+ */
+typedef void (*ValentBenchFunc) (gpointer data);
+
+GPtrArray * valent_bench_load_corpus (void);
+void        valent_bench_mark_first  (void);
+void        valent_bench_run         (const char      *name,
+                                      unsigned int     n_ops,
+                                      size_t           bytes_per_op,
+                                      ValentBenchFunc  func,
+                                      gpointer         data);
+
+G_END_DECLS
+
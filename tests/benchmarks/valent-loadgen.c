@@ -0,0 +1,1335 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+/*
+ * valent-loadgen:
+ *
+ * A load generator for a running daemon. It simulates a number of devices
+ * connecting over the LAN protocol, each sending a weighted mix of packets and
+ * optionally disconnecting and reconnecting at random.
+ *
+ * While running, it periodically samples the CPU time, resident memory and
+ * thread count of the daemon from `/proc`, and the latency of a request that
+ * the daemon answers whether or not the device is paired. Each sample is
+ * written as a line of JSON:
+ *
+ *     valent-loadgen --devices=50 --rate=5 --churn=30 --duration=300 \
+ *                    --output=load.jsonl
+ *
+ * Devices are only dispatched to plugins once paired. Running with `--pair`
+ * sends a pair request from each device, which must be accepted once; the
+ * certificates are kept in `--state-dir`, so subsequent runs reuse the same
+ * device identities.
+ */
+
+#include <errno.h>
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <gio/gio.h>
+#include <glib-unix.h>
+#include <valent.h>
+
+#include "valent-lan-channel.h"
+#include "valent-lan-utils.h"
+
+#define LOADGEN_RECONNECT_DELAY (1000)
+
+
+typedef enum
+{
+  TRAFFIC_BATTERY,
+  TRAFFIC_MPRIS,
+  TRAFFIC_NOTIFICATION,
+  TRAFFIC_SMS,
+  TRAFFIC_SHARE,
+  N_TRAFFIC_KINDS,
+} TrafficKind;
+
+static const struct
+{
+  const char *name;
+  const char *capabilities[3];
+} traffic_kinds[N_TRAFFIC_KINDS] = {
+  [TRAFFIC_BATTERY] = {
+    "battery",
+    { "kdeconnect.battery", "kdeconnect.battery.request", NULL },
+  },
+  [TRAFFIC_MPRIS] = {
+    "mpris",
+    { "kdeconnect.mpris", "kdeconnect.mpris.request", NULL },
+  },
+  [TRAFFIC_NOTIFICATION] = {
+    "notification",
+    { "kdeconnect.notification", "kdeconnect.notification.request", NULL },
+  },
+  [TRAFFIC_SMS] = {
+    "sms",
+    { "kdeconnect.sms.messages", "kdeconnect.sms.request", NULL },
+  },
+  [TRAFFIC_SHARE] = {
+    "share",
+    { "kdeconnect.share.request", NULL, },
+  },
+};
+
+typedef struct _LoadGen LoadGen;
+
+typedef struct
+{
+  LoadGen         *loadgen;
+  unsigned int     index;
+  GTlsCertificate *certificate;
+  JsonNode        *identity;
+
+  ValentChannel   *channel;
+  GCancellable    *cancellable;
+  gboolean         paired;
+  unsigned int     serial;
+  int64_t          probe_time;
+
+  unsigned int     churn_id;
+  unsigned int     probe_id;
+  unsigned int     reconnect_id;
+  unsigned int     traffic_id;
+} LoadDevice;
+
+struct _LoadGen
+{
+  GMainLoop    *loop;
+  GPtrArray    *devices;
+  unsigned int  n_pending;
+  int64_t       start_time;
+  FILE         *output;
+
+  /* Traffic */
+  unsigned int  weights[N_TRAFFIC_KINDS];
+  unsigned int  total_weight;
+
+  /* Counters */
+  unsigned int  n_connected;
+  uint64_t      n_connects;
+  uint64_t      n_errors;
+  uint64_t      n_received;
+  uint64_t      n_sent;
+  uint64_t      n_sent_kind[N_TRAFFIC_KINDS];
+
+  /* Latency, in milliseconds */
+  GArray       *latency;
+  GArray       *latency_total;
+
+  /* Daemon */
+  GPid          pid;
+  uint64_t      cpu_ticks;
+  int64_t       cpu_time;
+};
+
+/* Options */
+static int       opt_devices = 10;
+static char     *opt_host = NULL;
+static int       opt_port = VALENT_LAN_PROTOCOL_PORT;
+static double    opt_rate = 1.0;
+static char     *opt_mix = NULL;
+static double    opt_churn = 0.0;
+static int       opt_duration = 0;
+static int       opt_interval = 1000;
+static int       opt_probe = 1000;
+static int       opt_pid = 0;
+static char     *opt_output = NULL;
+static char     *opt_state_dir = NULL;
+static gboolean  opt_pair = FALSE;
+static char     *opt_device_type = NULL;
+static char     *opt_name_prefix = NULL;
+static int       opt_sms_batch = 20;
+static int       opt_share_size = 64 * 1024;
+
+static GOptionEntry entries[] = {
+  { "devices", 'n', 0, G_OPTION_ARG_INT, &opt_devices,
+    "Number of simulated devices (default: 10)", "N" },
+  { "host", 0, 0, G_OPTION_ARG_STRING, &opt_host,
+    "Host the daemon is listening on (default: 127.0.0.1)", "HOST" },
+  { "port", 0, 0, G_OPTION_ARG_INT, &opt_port,
+    "Port the daemon is listening on (default: 1716)", "PORT" },
+  { "rate", 'r', 0, G_OPTION_ARG_DOUBLE, &opt_rate,
+    "Packets per second, per device (default: 1.0)", "RATE" },
+  { "mix", 'm', 0, G_OPTION_ARG_STRING, &opt_mix,
+    "Traffic weights (default: battery=1,mpris=2,notification=4,sms=2,share=0)",
+    "KIND=WEIGHT,..." },
+  { "churn", 'c', 0, G_OPTION_ARG_DOUBLE, &opt_churn,
+    "Mean seconds between reconnects, per device (default: 0, disabled)", "SECONDS" },
+  { "duration", 'd', 0, G_OPTION_ARG_INT, &opt_duration,
+    "Seconds to run for (default: 0, until interrupted)", "SECONDS" },
+  { "interval-ms", 'i', 0, G_OPTION_ARG_INT, &opt_interval,
+    "Milliseconds between samples (default: 1000)", "MS" },
+  { "probe-ms", 0, 0, G_OPTION_ARG_INT, &opt_probe,
+    "Milliseconds between latency probes, per device (default: 1000)", "MS" },
+  { "pid", 'p', 0, G_OPTION_ARG_INT, &opt_pid,
+    "Process ID of the daemon (default: found by name)", "PID" },
+  { "output", 'o', 0, G_OPTION_ARG_FILENAME, &opt_output,
+    "File to write samples to (default: standard output)", "FILE" },
+  { "state-dir", 0, 0, G_OPTION_ARG_FILENAME, &opt_state_dir,
+    "Directory for device certificates", "DIR" },
+  { "pair", 0, 0, G_OPTION_ARG_NONE, &opt_pair,
+    "Request pairing for each device", NULL },
+  { "device-type", 0, 0, G_OPTION_ARG_STRING, &opt_device_type,
+    "Device type to advertise (default: phone)", "TYPE" },
+  { "name-prefix", 0, 0, G_OPTION_ARG_STRING, &opt_name_prefix,
+    "Prefix for device names (default: Loadgen)", "NAME" },
+  { "sms-batch", 0, 0, G_OPTION_ARG_INT, &opt_sms_batch,
+    "Messages per SMS packet (default: 20)", "N" },
+  { "share-size", 0, 0, G_OPTION_ARG_INT, &opt_share_size,
+    "Bytes per shared file (default: 65536)", "BYTES" },
+  { NULL }
+};
+
+static void   load_device_connect    (LoadDevice *device);
+static void   load_device_disconnect (LoadDevice *device);
+
+
+/*
+ * Daemon metrics
+ */
+static GPid
+find_daemon_pid (void)
+{
+  g_autoptr (GDir) dir = NULL;
+  const char *name;
+
+  if ((dir = g_dir_open ("/proc", 0, NULL)) == NULL)
+    return 0;
+
+  while ((name = g_dir_read_name (dir)) != NULL)
+    {
+      g_autofree char *path = NULL;
+      g_autofree char *comm = NULL;
+      int64_t pid;
+
+      if (!g_ascii_string_to_signed (name, 10, 1, G_MAXINT, &pid, NULL))
+        continue;
+
+      path = g_build_filename ("/proc", name, "comm", NULL);
+
+      if (g_file_get_contents (path, &comm, NULL, NULL) &&
+          g_str_equal (g_strchomp (comm), "valent"))
+        return (GPid)pid;
+    }
+
+  return 0;
+}
+
+static gboolean
+read_daemon_cpu (GPid      pid,
+                 uint64_t *ticks)
+{
+  g_autofree char *path = NULL;
+  g_autofree char *contents = NULL;
+  unsigned long utime, stime;
+  const char *fields;
+
+  path = g_strdup_printf ("/proc/%d/stat", pid);
+
+  if (!g_file_get_contents (path, &contents, NULL, NULL))
+    return FALSE;
+
+  /* The command name may contain spaces, so skip past the closing paren */
+  if ((fields = strrchr (contents, ')')) == NULL)
+    return FALSE;
+
+  if (sscanf (fields + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+              &utime, &stime) != 2)
+    return FALSE;
+
+  *ticks = utime + stime;
+
+  return TRUE;
+}
+
+static gboolean
+read_daemon_status (GPid     pid,
+                    int64_t *rss_kb,
+                    int64_t *n_threads)
+{
+  g_autofree char *path = NULL;
+  g_autofree char *contents = NULL;
+  g_auto (GStrv) lines = NULL;
+
+  path = g_strdup_printf ("/proc/%d/status", pid);
+
+  if (!g_file_get_contents (path, &contents, NULL, NULL))
+    return FALSE;
+
+  lines = g_strsplit (contents, "\n", -1);
+
+  for (unsigned int i = 0; lines[i] != NULL; i++)
+    {
+      if (g_str_has_prefix (lines[i], "VmRSS:"))
+        *rss_kb = g_ascii_strtoll (lines[i] + strlen ("VmRSS:"), NULL, 10);
+      else if (g_str_has_prefix (lines[i], "Threads:"))
+        *n_threads = g_ascii_strtoll (lines[i] + strlen ("Threads:"), NULL, 10);
+    }
+
+  return TRUE;
+}
+
+static int
+double_cmp (gconstpointer a,
+            gconstpointer b)
+{
+  double lhs = *(const double *)a;
+  double rhs = *(const double *)b;
+
+  return (lhs > rhs) - (lhs < rhs);
+}
+
+static double
+latency_percentile (GArray *latency,
+                    double  percentile)
+{
+  unsigned int index;
+
+  index = (unsigned int)ceil (percentile * latency->len) - 1;
+
+  return g_array_index (latency, double, MIN (index, latency->len - 1));
+}
+
+static void
+loadgen_add_latency (JsonBuilder *builder,
+                     GArray      *latency)
+{
+  json_builder_set_member_name (builder, "probes");
+  json_builder_add_int_value (builder, latency->len);
+
+  if (latency->len == 0)
+    return;
+
+  g_array_sort (latency, double_cmp);
+  json_builder_set_member_name (builder, "latency_p50_ms");
+  json_builder_add_double_value (builder, latency_percentile (latency, 0.50));
+  json_builder_set_member_name (builder, "latency_p99_ms");
+  json_builder_add_double_value (builder, latency_percentile (latency, 0.99));
+  json_builder_set_member_name (builder, "latency_max_ms");
+  json_builder_add_double_value (builder,
+                                 g_array_index (latency, double, latency->len - 1));
+}
+
+static void
+loadgen_write_sample (LoadGen  *loadgen,
+                      gboolean  summary)
+{
+  g_autoptr (JsonBuilder) builder = NULL;
+  g_autoptr (JsonNode) node = NULL;
+  g_autofree char *line = NULL;
+  int64_t now = g_get_monotonic_time ();
+  uint64_t cpu_ticks = 0;
+  int64_t rss_kb = -1;
+  int64_t n_threads = -1;
+
+  builder = json_builder_new ();
+  json_builder_begin_object (builder);
+
+  json_builder_set_member_name (builder, summary ? "summary" : "sample");
+  json_builder_add_boolean_value (builder, TRUE);
+  json_builder_set_member_name (builder, "time_s");
+  json_builder_add_double_value (builder, (now - loadgen->start_time) / 1e6);
+  json_builder_set_member_name (builder, "devices_connected");
+  json_builder_add_int_value (builder, loadgen->n_connected);
+  json_builder_set_member_name (builder, "connects");
+  json_builder_add_int_value (builder, loadgen->n_connects);
+  json_builder_set_member_name (builder, "errors");
+  json_builder_add_int_value (builder, loadgen->n_errors);
+  json_builder_set_member_name (builder, "packets_sent");
+  json_builder_add_int_value (builder, loadgen->n_sent);
+  json_builder_set_member_name (builder, "packets_received");
+  json_builder_add_int_value (builder, loadgen->n_received);
+
+  if (summary)
+    {
+      json_builder_set_member_name (builder, "packets_sent_by_kind");
+      json_builder_begin_object (builder);
+      for (unsigned int i = 0; i < N_TRAFFIC_KINDS; i++)
+        {
+          json_builder_set_member_name (builder, traffic_kinds[i].name);
+          json_builder_add_int_value (builder, loadgen->n_sent_kind[i]);
+        }
+      json_builder_end_object (builder);
+
+      loadgen_add_latency (builder, loadgen->latency_total);
+    }
+  else
+    {
+      g_array_append_vals (loadgen->latency_total,
+                           loadgen->latency->data,
+                           loadgen->latency->len);
+      loadgen_add_latency (builder, loadgen->latency);
+      g_array_set_size (loadgen->latency, 0);
+    }
+
+  /* CPU usage is relative to a single core, over the sample interval */
+  if (loadgen->pid > 0 && read_daemon_cpu (loadgen->pid, &cpu_ticks))
+    {
+      if (!summary && loadgen->cpu_time > 0 && now > loadgen->cpu_time)
+        {
+          double seconds = (now - loadgen->cpu_time) / 1e6;
+          double cpu_seconds = (double)(cpu_ticks - loadgen->cpu_ticks) /
+                               sysconf (_SC_CLK_TCK);
+
+          json_builder_set_member_name (builder, "cpu_percent");
+          json_builder_add_double_value (builder, 100.0 * cpu_seconds / seconds);
+        }
+
+      loadgen->cpu_ticks = cpu_ticks;
+      loadgen->cpu_time = now;
+    }
+
+  if (loadgen->pid > 0 && read_daemon_status (loadgen->pid, &rss_kb, &n_threads))
+    {
+      json_builder_set_member_name (builder, "rss_kb");
+      json_builder_add_int_value (builder, rss_kb);
+      json_builder_set_member_name (builder, "threads");
+      json_builder_add_int_value (builder, n_threads);
+    }
+
+  json_builder_end_object (builder);
+
+  node = json_builder_get_root (builder);
+  line = json_to_string (node, FALSE);
+  fprintf (loadgen->output, "%s\n", line);
+  fflush (loadgen->output);
+}
+
+static gboolean
+loadgen_sample_cb (gpointer data)
+{
+  loadgen_write_sample ((LoadGen *)data, FALSE);
+
+  return G_SOURCE_CONTINUE;
+}
+
+
+/*
+ * Traffic
+ */
+static unsigned int
+random_delay (double rate)
+{
+  double uniform = g_random_double_range (DBL_EPSILON, 1.0);
+
+  /* Exponential inter-arrival times, so devices don't send in lockstep */
+  return (unsigned int)CLAMP (-log (uniform) / rate * 1000.0, 1.0, G_MAXINT);
+}
+
+static JsonNode *
+create_battery_packet (LoadDevice *device)
+{
+  g_autoptr (JsonBuilder) builder = NULL;
+
+  valent_packet_init (&builder, "kdeconnect.battery");
+  json_builder_set_member_name (builder, "currentCharge");
+  json_builder_add_int_value (builder, g_random_int_range (1, 101));
+  json_builder_set_member_name (builder, "isCharging");
+  json_builder_add_boolean_value (builder, g_random_boolean ());
+  json_builder_set_member_name (builder, "thresholdEvent");
+  json_builder_add_int_value (builder, 0);
+
+  return valent_packet_end (&builder);
+}
+
+static JsonNode *
+create_mpris_packet (LoadDevice *device)
+{
+  g_autoptr (JsonBuilder) builder = NULL;
+  g_autofree char *title = NULL;
+
+  title = g_strdup_printf ("Track %u", device->serial);
+
+  valent_packet_init (&builder, "kdeconnect.mpris");
+  json_builder_set_member_name (builder, "player");
+  json_builder_add_string_value (builder, "Loadgen");
+  json_builder_set_member_name (builder, "title");
+  json_builder_add_string_value (builder, title);
+  json_builder_set_member_name (builder, "artist");
+  json_builder_add_string_value (builder, "Loadgen");
+  json_builder_set_member_name (builder, "album");
+  json_builder_add_string_value (builder, "Loadgen");
+  json_builder_set_member_name (builder, "isPlaying");
+  json_builder_add_boolean_value (builder, TRUE);
+  json_builder_set_member_name (builder, "pos");
+  json_builder_add_int_value (builder, g_random_int_range (0, 240000));
+  json_builder_set_member_name (builder, "length");
+  json_builder_add_int_value (builder, 240000);
+  json_builder_set_member_name (builder, "canPause");
+  json_builder_add_boolean_value (builder, TRUE);
+  json_builder_set_member_name (builder, "canPlay");
+  json_builder_add_boolean_value (builder, TRUE);
+  json_builder_set_member_name (builder, "canGoNext");
+  json_builder_add_boolean_value (builder, TRUE);
+  json_builder_set_member_name (builder, "canGoPrevious");
+  json_builder_add_boolean_value (builder, TRUE);
+  json_builder_set_member_name (builder, "canSeek");
+  json_builder_add_boolean_value (builder, TRUE);
+  json_builder_set_member_name (builder, "volume");
+  json_builder_add_int_value (builder, 100);
+
+  return valent_packet_end (&builder);
+}
+
+static JsonNode *
+create_notification_packet (LoadDevice *device)
+{
+  g_autoptr (JsonBuilder) builder = NULL;
+  g_autofree char *id = NULL;
+  g_autofree char *text = NULL;
+  g_autofree char *ticker = NULL;
+  g_autofree char *time_str = NULL;
+
+  id = g_strdup_printf ("loadgen-%u", device->serial % 64);
+  text = g_strdup_printf ("Notification %u", device->serial);
+  ticker = g_strdup_printf ("Loadgen: %s", text);
+  time_str = g_strdup_printf ("%"G_GINT64_FORMAT, g_get_real_time () / 1000);
+
+  valent_packet_init (&builder, "kdeconnect.notification");
+  json_builder_set_member_name (builder, "id");
+  json_builder_add_string_value (builder, id);
+  json_builder_set_member_name (builder, "appName");
+  json_builder_add_string_value (builder, "Loadgen");
+  json_builder_set_member_name (builder, "title");
+  json_builder_add_string_value (builder, "Loadgen");
+  json_builder_set_member_name (builder, "text");
+  json_builder_add_string_value (builder, text);
+  json_builder_set_member_name (builder, "ticker");
+  json_builder_add_string_value (builder, ticker);
+  json_builder_set_member_name (builder, "isClearable");
+  json_builder_add_boolean_value (builder, TRUE);
+  json_builder_set_member_name (builder, "onlyOnce");
+  json_builder_add_boolean_value (builder, FALSE);
+  json_builder_set_member_name (builder, "time");
+  json_builder_add_string_value (builder, time_str);
+
+  return valent_packet_end (&builder);
+}
+
+static JsonNode *
+create_sms_packet (LoadDevice *device)
+{
+  g_autoptr (JsonBuilder) builder = NULL;
+  int64_t date = g_get_real_time () / 1000;
+
+  valent_packet_init (&builder, "kdeconnect.sms.messages");
+  json_builder_set_member_name (builder, "messages");
+  json_builder_begin_array (builder);
+
+  for (int i = 0; i < opt_sms_batch; i++)
+    {
+      int64_t id = ((int64_t)device->serial * opt_sms_batch) + i + 1;
+      int64_t thread_id = (id % 20) + 1;
+      g_autofree char *address = NULL;
+      g_autofree char *body = NULL;
+
+      address = g_strdup_printf ("+1-234-567-%04"G_GINT64_FORMAT, thread_id);
+      body = g_strdup_printf ("Thread %"G_GINT64_FORMAT", Message %"G_GINT64_FORMAT,
+                              thread_id, id);
+
+      json_builder_begin_object (builder);
+      json_builder_set_member_name (builder, "addresses");
+      json_builder_begin_array (builder);
+      json_builder_begin_object (builder);
+      json_builder_set_member_name (builder, "address");
+      json_builder_add_string_value (builder, address);
+      json_builder_end_object (builder);
+      json_builder_end_array (builder);
+      json_builder_set_member_name (builder, "body");
+      json_builder_add_string_value (builder, body);
+      json_builder_set_member_name (builder, "date");
+      json_builder_add_int_value (builder, date);
+      json_builder_set_member_name (builder, "type");
+      json_builder_add_int_value (builder, 1);
+      json_builder_set_member_name (builder, "read");
+      json_builder_add_int_value (builder, 0);
+      json_builder_set_member_name (builder, "thread_id");
+      json_builder_add_int_value (builder, thread_id);
+      json_builder_set_member_name (builder, "_id");
+      json_builder_add_int_value (builder, id);
+      json_builder_set_member_name (builder, "sub_id");
+      json_builder_add_int_value (builder, -1);
+      json_builder_set_member_name (builder, "event");
+      json_builder_add_int_value (builder, 1);
+      json_builder_end_object (builder);
+    }
+
+  json_builder_end_array (builder);
+
+  return valent_packet_end (&builder);
+}
+
+static JsonNode *
+create_share_packet (LoadDevice *device)
+{
+  g_autoptr (JsonBuilder) builder = NULL;
+  g_autofree char *filename = NULL;
+  JsonNode *packet;
+
+  filename = g_strdup_printf ("loadgen-%u-%u.bin", device->index, device->serial);
+
+  valent_packet_init (&builder, "kdeconnect.share.request");
+  json_builder_set_member_name (builder, "filename");
+  json_builder_add_string_value (builder, filename);
+  json_builder_set_member_name (builder, "numberOfFiles");
+  json_builder_add_int_value (builder, 1);
+  json_builder_set_member_name (builder, "totalPayloadSize");
+  json_builder_add_int_value (builder, opt_share_size);
+  packet = valent_packet_end (&builder);
+
+  valent_packet_set_payload_size (packet, opt_share_size);
+
+  return packet;
+}
+
+static void
+write_packet_cb (ValentChannel *channel,
+                 GAsyncResult  *result,
+                 LoadGen       *loadgen)
+{
+  g_autoptr (GError) error = NULL;
+
+  if (valent_channel_write_packet_finish (channel, result, &error))
+    loadgen->n_sent++;
+  else if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    loadgen->n_errors++;
+}
+
+static void
+load_device_send (LoadDevice *device,
+                  JsonNode   *packet)
+{
+  valent_channel_write_packet (device->channel,
+                               packet,
+                               device->cancellable,
+                               (GAsyncReadyCallback)write_packet_cb,
+                               device->loadgen);
+}
+
+static void
+upload_task (GTask        *task,
+             gpointer      source_object,
+             gpointer      task_data,
+             GCancellable *cancellable)
+{
+  ValentChannel *channel = VALENT_CHANNEL (source_object);
+  JsonNode *packet = task_data;
+  g_autoptr (GIOStream) stream = NULL;
+  g_autofree uint8_t *data = NULL;
+  GError *error = NULL;
+
+  stream = valent_channel_upload (channel, packet, cancellable, &error);
+
+  if (stream == NULL)
+    return g_task_return_error (task, error);
+
+  data = g_malloc0 (opt_share_size);
+
+  if (!g_output_stream_write_all (g_io_stream_get_output_stream (stream),
+                                  data,
+                                  opt_share_size,
+                                  NULL,
+                                  cancellable,
+                                  &error) ||
+      !g_io_stream_close (stream, cancellable, &error))
+    return g_task_return_error (task, error);
+
+  g_task_return_boolean (task, TRUE);
+}
+
+static void
+upload_cb (ValentChannel *channel,
+           GAsyncResult  *result,
+           LoadGen       *loadgen)
+{
+  g_autoptr (GError) error = NULL;
+
+  loadgen->n_pending--;
+
+  if (g_task_propagate_boolean (G_TASK (result), &error))
+    loadgen->n_sent++;
+  else if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    loadgen->n_errors++;
+}
+
+static gboolean
+load_device_traffic_cb (gpointer data)
+{
+  LoadDevice *device = data;
+  LoadGen *loadgen = device->loadgen;
+  g_autoptr (JsonNode) packet = NULL;
+  unsigned int choice;
+  TrafficKind kind;
+
+  device->traffic_id = g_timeout_add (random_delay (opt_rate),
+                                      load_device_traffic_cb,
+                                      device);
+  g_source_set_name_by_id (device->traffic_id, "load_device_traffic_cb");
+
+  choice = g_random_int_range (0, loadgen->total_weight);
+
+  for (kind = 0; kind < N_TRAFFIC_KINDS - 1; kind++)
+    {
+      if (choice < loadgen->weights[kind])
+        break;
+
+      choice -= loadgen->weights[kind];
+    }
+
+  device->serial++;
+  loadgen->n_sent_kind[kind]++;
+
+  switch (kind)
+    {
+    case TRAFFIC_BATTERY:
+      packet = create_battery_packet (device);
+      break;
+
+    case TRAFFIC_MPRIS:
+      packet = create_mpris_packet (device);
+      break;
+
+    case TRAFFIC_NOTIFICATION:
+      packet = create_notification_packet (device);
+      break;
+
+    case TRAFFIC_SMS:
+      packet = create_sms_packet (device);
+      break;
+
+    case TRAFFIC_SHARE:
+      /* An unpaired daemon never accepts the payload, which would block the
+       * upload until the device disconnects */
+      if (device->paired)
+        {
+          g_autoptr (GTask) task = NULL;
+
+          loadgen->n_pending++;
+
+          task = g_task_new (device->channel,
+                             device->cancellable,
+                             (GAsyncReadyCallback)upload_cb,
+                             loadgen);
+          g_task_set_source_tag (task, load_device_traffic_cb);
+          g_task_set_task_data (task,
+                                create_share_packet (device),
+                                (GDestroyNotify)json_node_unref);
+          g_task_run_in_thread (task, upload_task);
+        }
+      return G_SOURCE_REMOVE;
+
+    default:
+      g_assert_not_reached ();
+    }
+
+  load_device_send (device, packet);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+/*
+ * Latency
+ */
+static gboolean
+load_device_probe_cb (gpointer data)
+{
+  LoadDevice *device = data;
+  g_autoptr (JsonBuilder) builder = NULL;
+  g_autoptr (JsonNode) packet = NULL;
+
+  /* Only one probe is in flight at a time, so a slow response is measured
+   * once rather than masked by later probes */
+  if (device->probe_time > 0)
+    return G_SOURCE_CONTINUE;
+
+  /* A paired daemon responds with its player list, and an unpaired daemon
+   * responds with a pair packet */
+  valent_packet_init (&builder, "kdeconnect.mpris.request");
+  json_builder_set_member_name (builder, "requestPlayerList");
+  json_builder_add_boolean_value (builder, TRUE);
+  packet = valent_packet_end (&builder);
+
+  device->probe_time = g_get_monotonic_time ();
+  load_device_send (device, packet);
+
+  return G_SOURCE_CONTINUE;
+}
+
+static void
+load_device_handle_packet (LoadDevice *device,
+                           JsonNode   *packet)
+{
+  LoadGen *loadgen = device->loadgen;
+  const char *type = valent_packet_get_type (packet);
+  gboolean is_pair = g_str_equal (type, "kdeconnect.pair");
+
+  loadgen->n_received++;
+
+  if (device->probe_time > 0 &&
+      (is_pair || valent_packet_check_field (packet, "playerList")))
+    {
+      double latency;
+
+      latency = (g_get_monotonic_time () - device->probe_time) / 1000.0;
+      g_array_append_val (loadgen->latency, latency);
+      device->probe_time = 0;
+    }
+
+  /* The daemon only sends plugin packets to paired devices */
+  if (is_pair)
+    {
+      gboolean pair = FALSE;
+
+      valent_packet_get_boolean (packet, "pair", &pair);
+      device->paired = pair;
+    }
+  else
+    {
+      device->paired = TRUE;
+    }
+}
+
+
+/*
+ * Connection
+ */
+static void
+read_packet_cb (ValentChannel *channel,
+                GAsyncResult  *result,
+                LoadDevice    *device)
+{
+  g_autoptr (JsonNode) packet = NULL;
+  g_autoptr (GError) error = NULL;
+
+  device->loadgen->n_pending--;
+
+  packet = valent_channel_read_packet_finish (channel, result, &error);
+
+  if (packet == NULL)
+    {
+      if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        return;
+
+      g_debug ("%s(): device %u: %s", G_STRFUNC, device->index, error->message);
+
+      if (device->channel == channel)
+        load_device_disconnect (device);
+
+      return;
+    }
+
+  load_device_handle_packet (device, packet);
+
+  device->loadgen->n_pending++;
+  valent_channel_read_packet (channel,
+                              device->cancellable,
+                              (GAsyncReadyCallback)read_packet_cb,
+                              device);
+}
+
+static gboolean
+load_device_reconnect_cb (gpointer data)
+{
+  LoadDevice *device = data;
+
+  device->reconnect_id = 0;
+  load_device_connect (device);
+
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+load_device_churn_cb (gpointer data)
+{
+  LoadDevice *device = data;
+
+  device->churn_id = 0;
+  load_device_disconnect (device);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+load_device_disconnect (LoadDevice *device)
+{
+  g_clear_handle_id (&device->churn_id, g_source_remove);
+  g_clear_handle_id (&device->probe_id, g_source_remove);
+  g_clear_handle_id (&device->traffic_id, g_source_remove);
+
+  g_cancellable_cancel (device->cancellable);
+  g_clear_object (&device->cancellable);
+  device->probe_time = 0;
+
+  if (device->channel != NULL)
+    {
+      valent_channel_close (device->channel, NULL, NULL);
+      g_clear_object (&device->channel);
+      device->loadgen->n_connected--;
+    }
+
+  if (device->reconnect_id == 0 && g_main_loop_is_running (device->loadgen->loop))
+    {
+      device->reconnect_id = g_timeout_add (LOADGEN_RECONNECT_DELAY,
+                                            load_device_reconnect_cb,
+                                            device);
+      g_source_set_name_by_id (device->reconnect_id, "load_device_reconnect_cb");
+    }
+}
+
+static JsonNode *
+create_peer_identity (GTlsCertificate *peer_certificate)
+{
+  g_autoptr (JsonBuilder) builder = NULL;
+
+  /* The daemon doesn't send its identity to an outgoing connection, so the
+   * peer identity is derived from its certificate */
+  valent_packet_init (&builder, "kdeconnect.identity");
+  json_builder_set_member_name (builder, "deviceId");
+  json_builder_add_string_value (builder,
+                                 valent_certificate_get_common_name (peer_certificate));
+  json_builder_set_member_name (builder, "deviceName");
+  json_builder_add_string_value (builder, "Valent");
+  json_builder_set_member_name (builder, "protocolVersion");
+  json_builder_add_int_value (builder, 7);
+
+  return valent_packet_end (&builder);
+}
+
+static void
+connect_task (GTask        *task,
+              gpointer      source_object,
+              gpointer      task_data,
+              GCancellable *cancellable)
+{
+  LoadDevice *device = task_data;
+  g_autoptr (GSocketClient) client = NULL;
+  g_autoptr (GSocketConnection) connection = NULL;
+  g_autoptr (GIOStream) tls_stream = NULL;
+  g_autoptr (JsonNode) peer_identity = NULL;
+  GTlsCertificate *peer_certificate;
+  GOutputStream *output_stream;
+  ValentChannel *channel;
+  GError *error = NULL;
+
+  client = g_object_new (G_TYPE_SOCKET_CLIENT,
+                         "enable-proxy", FALSE,
+                         NULL);
+  connection = g_socket_client_connect_to_host (client,
+                                                opt_host,
+                                                opt_port,
+                                                cancellable,
+                                                &error);
+
+  if (connection == NULL)
+    return g_task_return_error (task, error);
+
+  /* Like any outgoing connection, send the identity then act as TLS server */
+  output_stream = g_io_stream_get_output_stream (G_IO_STREAM (connection));
+
+  if (!valent_packet_to_stream (output_stream, device->identity, cancellable, &error))
+    return g_task_return_error (task, error);
+
+  tls_stream = valent_lan_encrypt_server_connection (connection,
+                                                     device->certificate,
+                                                     cancellable,
+                                                     &error);
+
+  if (tls_stream == NULL)
+    return g_task_return_error (task, error);
+
+  peer_certificate = g_tls_connection_get_peer_certificate (G_TLS_CONNECTION (tls_stream));
+  peer_identity = create_peer_identity (peer_certificate);
+
+  channel = g_object_new (VALENT_TYPE_LAN_CHANNEL,
+                          "base-stream",   tls_stream,
+                          "host",          opt_host,
+                          "port",          (uint16_t)opt_port,
+                          "identity",      device->identity,
+                          "peer-identity", peer_identity,
+                          NULL);
+  g_task_return_pointer (task, channel, g_object_unref);
+}
+
+static void
+connect_cb (GObject      *object,
+            GAsyncResult *result,
+            gpointer      user_data)
+{
+  LoadDevice *device = user_data;
+  LoadGen *loadgen = device->loadgen;
+  g_autoptr (ValentChannel) channel = NULL;
+  g_autoptr (GError) error = NULL;
+
+  loadgen->n_pending--;
+
+  channel = g_task_propagate_pointer (G_TASK (result), &error);
+
+  if (channel == NULL)
+    {
+      if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        return;
+
+      g_debug ("%s(): device %u: %s", G_STRFUNC, device->index, error->message);
+      loadgen->n_errors++;
+      load_device_disconnect (device);
+      return;
+    }
+
+  device->channel = g_steal_pointer (&channel);
+  loadgen->n_connected++;
+  loadgen->n_connects++;
+
+  loadgen->n_pending++;
+  valent_channel_read_packet (device->channel,
+                              device->cancellable,
+                              (GAsyncReadyCallback)read_packet_cb,
+                              device);
+
+  if (opt_pair)
+    {
+      g_autoptr (JsonBuilder) builder = NULL;
+      g_autoptr (JsonNode) packet = NULL;
+
+      valent_packet_init (&builder, "kdeconnect.pair");
+      json_builder_set_member_name (builder, "pair");
+      json_builder_add_boolean_value (builder, TRUE);
+      packet = valent_packet_end (&builder);
+
+      load_device_send (device, packet);
+    }
+
+  if (loadgen->weights[TRAFFIC_MPRIS] > 0)
+    {
+      g_autoptr (JsonBuilder) builder = NULL;
+      g_autoptr (JsonNode) packet = NULL;
+
+      valent_packet_init (&builder, "kdeconnect.mpris");
+      json_builder_set_member_name (builder, "playerList");
+      json_builder_begin_array (builder);
+      json_builder_add_string_value (builder, "Loadgen");
+      json_builder_end_array (builder);
+      packet = valent_packet_end (&builder);
+
+      load_device_send (device, packet);
+    }
+
+  if (loadgen->total_weight > 0 && opt_rate > 0.0)
+    {
+      device->traffic_id = g_timeout_add (random_delay (opt_rate),
+                                          load_device_traffic_cb,
+                                          device);
+      g_source_set_name_by_id (device->traffic_id, "load_device_traffic_cb");
+    }
+
+  if (opt_probe > 0)
+    {
+      device->probe_id = g_timeout_add (opt_probe, load_device_probe_cb, device);
+      g_source_set_name_by_id (device->probe_id, "load_device_probe_cb");
+    }
+
+  if (opt_churn > 0.0)
+    {
+      device->churn_id = g_timeout_add (random_delay (1.0 / opt_churn),
+                                        load_device_churn_cb,
+                                        device);
+      g_source_set_name_by_id (device->churn_id, "load_device_churn_cb");
+    }
+}
+
+static void
+load_device_connect (LoadDevice *device)
+{
+  g_autoptr (GTask) task = NULL;
+
+  g_assert (device->channel == NULL);
+
+  device->cancellable = g_cancellable_new ();
+  device->loadgen->n_pending++;
+
+  task = g_task_new (NULL, device->cancellable, connect_cb, device);
+  g_task_set_source_tag (task, load_device_connect);
+  g_task_set_task_data (task, device, NULL);
+  g_task_run_in_thread (task, connect_task);
+}
+
+static JsonNode *
+create_identity (LoadGen         *loadgen,
+                 unsigned int     index,
+                 GTlsCertificate *certificate)
+{
+  g_autoptr (JsonBuilder) builder = NULL;
+  g_autofree char *name = NULL;
+
+  name = g_strdup_printf ("%s %u", opt_name_prefix, index);
+
+  valent_packet_init (&builder, "kdeconnect.identity");
+  json_builder_set_member_name (builder, "deviceId");
+  json_builder_add_string_value (builder,
+                                 valent_certificate_get_common_name (certificate));
+  json_builder_set_member_name (builder, "deviceName");
+  json_builder_add_string_value (builder, name);
+  json_builder_set_member_name (builder, "deviceType");
+  json_builder_add_string_value (builder, opt_device_type);
+  json_builder_set_member_name (builder, "protocolVersion");
+  json_builder_add_int_value (builder, 7);
+  json_builder_set_member_name (builder, "tcpPort");
+  json_builder_add_int_value (builder, VALENT_LAN_PROTOCOL_PORT);
+
+  /* Only the capabilities for the traffic mix are advertised, with MPRIS
+   * always included for the latency probe */
+  for (unsigned int n = 0; n < 2; n++)
+    {
+      json_builder_set_member_name (builder, n == 0
+                                             ? "incomingCapabilities"
+                                             : "outgoingCapabilities");
+      json_builder_begin_array (builder);
+
+      for (unsigned int i = 0; i < N_TRAFFIC_KINDS; i++)
+        {
+          if (loadgen->weights[i] == 0 && i != TRAFFIC_MPRIS)
+            continue;
+
+          for (unsigned int j = 0; traffic_kinds[i].capabilities[j] != NULL; j++)
+            json_builder_add_string_value (builder, traffic_kinds[i].capabilities[j]);
+        }
+
+      json_builder_end_array (builder);
+    }
+
+  return valent_packet_end (&builder);
+}
+
+static LoadDevice *
+load_device_new (LoadGen       *loadgen,
+                 unsigned int   index,
+                 GError       **error)
+{
+  LoadDevice *device;
+  g_autoptr (GTlsCertificate) certificate = NULL;
+  g_autofree char *path = NULL;
+  g_autofree char *dirname = NULL;
+
+  dirname = g_strdup_printf ("device-%03u", index);
+  path = g_build_filename (opt_state_dir, dirname, NULL);
+
+  if (g_mkdir_with_parents (path, 0700) != 0)
+    {
+      int errsv = errno;
+
+      g_set_error (error,
+                   G_IO_ERROR,
+                   g_io_error_from_errno (errsv),
+                   "Creating \"%s\": %s",
+                   path, g_strerror (errsv));
+      return NULL;
+    }
+
+  if ((certificate = valent_certificate_new_sync (path, error)) == NULL)
+    return NULL;
+
+  device = g_new0 (LoadDevice, 1);
+  device->loadgen = loadgen;
+  device->index = index;
+  device->certificate = g_steal_pointer (&certificate);
+  device->identity = create_identity (loadgen, index, device->certificate);
+
+  return device;
+}
+
+static void
+load_device_free (gpointer data)
+{
+  LoadDevice *device = data;
+
+  g_clear_handle_id (&device->reconnect_id, g_source_remove);
+  load_device_disconnect (device);
+
+  g_clear_object (&device->certificate);
+  g_clear_pointer (&device->identity, json_node_unref);
+  g_free (device);
+}
+
+
+/*
+ * Main
+ */
+static gboolean
+loadgen_parse_mix (LoadGen     *loadgen,
+                   const char  *mix,
+                   GError     **error)
+{
+  g_auto (GStrv) items = NULL;
+
+  memset (loadgen->weights, 0, sizeof (loadgen->weights));
+  items = g_strsplit (mix, ",", -1);
+
+  for (unsigned int i = 0; items[i] != NULL; i++)
+    {
+      g_auto (GStrv) pair = NULL;
+      uint64_t weight;
+      unsigned int kind;
+
+      pair = g_strsplit (g_strstrip (items[i]), "=", 2);
+
+      for (kind = 0; kind < N_TRAFFIC_KINDS; kind++)
+        {
+          if (g_strcmp0 (pair[0], traffic_kinds[kind].name) == 0)
+            break;
+        }
+
+      if (kind == N_TRAFFIC_KINDS || pair[1] == NULL ||
+          !g_ascii_string_to_unsigned (pair[1], 10, 0, 1000, &weight, NULL))
+        {
+          g_set_error (error,
+                       G_OPTION_ERROR,
+                       G_OPTION_ERROR_BAD_VALUE,
+                       "Invalid traffic weight \"%s\"",
+                       items[i]);
+          return FALSE;
+        }
+
+      loadgen->weights[kind] = (unsigned int)weight;
+    }
+
+  loadgen->total_weight = 0;
+
+  for (unsigned int i = 0; i < N_TRAFFIC_KINDS; i++)
+    loadgen->total_weight += loadgen->weights[i];
+
+  return TRUE;
+}
+
+static gboolean
+loadgen_quit_cb (gpointer data)
+{
+  g_main_loop_quit (((LoadGen *)data)->loop);
+
+  return G_SOURCE_REMOVE;
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  LoadGen loadgen = { 0, };
+  g_autoptr (GOptionContext) context = NULL;
+  g_autoptr (GError) error = NULL;
+  unsigned int sample_id;
+
+  context = g_option_context_new ("- generate load for a running daemon");
+  g_option_context_add_main_entries (context, entries, NULL);
+
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  if (opt_host == NULL)
+    opt_host = g_strdup ("127.0.0.1");
+
+  if (opt_mix == NULL)
+    opt_mix = g_strdup ("battery=1,mpris=2,notification=4,sms=2,share=0");
+
+  if (opt_state_dir == NULL)
+    opt_state_dir = g_build_filename (g_get_user_cache_dir (), "valent-loadgen", NULL);
+
+  if (opt_device_type == NULL)
+    opt_device_type = g_strdup ("phone");
+
+  if (opt_name_prefix == NULL)
+    opt_name_prefix = g_strdup ("Loadgen");
+
+  if (opt_devices < 1 || opt_rate < 0.0 || opt_churn < 0.0 ||
+      opt_interval < 1 || opt_sms_batch < 1 || opt_share_size < 0)
+    {
+      g_printerr ("Invalid option value\n");
+      return EXIT_FAILURE;
+    }
+
+  if (!loadgen_parse_mix (&loadgen, opt_mix, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  if (opt_output != NULL)
+    {
+      if ((loadgen.output = fopen (opt_output, "w")) == NULL)
+        {
+          g_printerr ("Opening \"%s\": %s\n", opt_output, g_strerror (errno));
+          return EXIT_FAILURE;
+        }
+    }
+  else
+    {
+      loadgen.output = stdout;
+    }
+
+  loadgen.pid = opt_pid > 0 ? (GPid)opt_pid : find_daemon_pid ();
+
+  if (loadgen.pid <= 0)
+    g_printerr ("Daemon not found; process metrics will not be recorded\n");
+
+  loadgen.loop = g_main_loop_new (NULL, FALSE);
+  loadgen.latency = g_array_new (FALSE, FALSE, sizeof (double));
+  loadgen.latency_total = g_array_new (FALSE, FALSE, sizeof (double));
+  loadgen.devices = g_ptr_array_new_with_free_func (load_device_free);
+
+  for (int i = 0; i < opt_devices; i++)
+    {
+      LoadDevice *device;
+
+      if ((device = load_device_new (&loadgen, i, &error)) == NULL)
+        {
+          g_printerr ("%s\n", error->message);
+          return EXIT_FAILURE;
+        }
+
+      g_ptr_array_add (loadgen.devices, device);
+    }
+
+  loadgen.start_time = g_get_monotonic_time ();
+  loadgen_write_sample (&loadgen, FALSE);
+
+  for (unsigned int i = 0; i < loadgen.devices->len; i++)
+    load_device_connect (g_ptr_array_index (loadgen.devices, i));
+
+  sample_id = g_timeout_add (opt_interval, loadgen_sample_cb, &loadgen);
+  g_source_set_name_by_id (sample_id, "loadgen_sample_cb");
+  g_unix_signal_add (SIGINT, loadgen_quit_cb, &loadgen);
+  g_unix_signal_add (SIGTERM, loadgen_quit_cb, &loadgen);
+
+  if (opt_duration > 0)
+    g_timeout_add_seconds (opt_duration, loadgen_quit_cb, &loadgen);
+
+  g_main_loop_run (loadgen.loop);
+
+  g_source_remove (sample_id);
+  loadgen_write_sample (&loadgen, FALSE);
+  loadgen_write_sample (&loadgen, TRUE);
+
+  /* Wait for any cancelled operations to return before freeing the devices */
+  for (unsigned int i = 0; i < loadgen.devices->len; i++)
+    load_device_disconnect (g_ptr_array_index (loadgen.devices, i));
+
+  while (loadgen.n_pending > 0)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_clear_pointer (&loadgen.devices, g_ptr_array_unref);
+  g_clear_pointer (&loadgen.latency, g_array_unref);
+  g_clear_pointer (&loadgen.latency_total, g_array_unref);
+  g_clear_pointer (&loadgen.loop, g_main_loop_unref);
+
+  if (loadgen.output != stdout)
+    fclose (loadgen.output);
+
+  return EXIT_SUCCESS;
+}
+
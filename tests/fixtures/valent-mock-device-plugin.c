@@ -9,6 +9,8 @@
 struct _ValentMockDevicePlugin
 {
   ValentDevicePlugin  parent_instance;
+
+  ValentPacketStream *stream;
 };
 
 G_DEFINE_FINAL_TYPE (ValentMockDevicePlugin, valent_mock_device_plugin, VALENT_TYPE_DEVICE_PLUGIN)
@@ -98,6 +100,18 @@ valent_mock_device_plugin_handle_transfer (ValentMockDevicePlugin *self,
                            self);
 }
 
+static void
+valent_mock_device_plugin_handle_stream (ValentMockDevicePlugin *self,
+                                         ValentPacketStream     *stream)
+{
+  g_assert (VALENT_IS_MOCK_DEVICE_PLUGIN (self));
+  g_assert (VALENT_IS_PACKET_STREAM (stream));
+
+  /* The stream is held without being read, so the channel blocks once it is
+   * full, until the plugin is destroyed. */
+  g_set_object (&self->stream, stream);
+}
+
 /*
  * GActions
  */
@@ -175,8 +189,10 @@ valent_mock_device_plugin_handle_packet (ValentDevicePlugin *plugin,
 static void
 valent_mock_device_plugin_destroy (ValentObject *object)
 {
+  ValentMockDevicePlugin *self = VALENT_MOCK_DEVICE_PLUGIN (object);
   ValentDevicePlugin *plugin = VALENT_DEVICE_PLUGIN (object);
 
+  g_clear_object (&self->stream);
   valent_device_plugin_set_menu_item (plugin, "device.mock.transfer", NULL);
 
   VALENT_OBJECT_CLASS (valent_mock_device_plugin_parent_class)->destroy (object);
@@ -215,6 +231,11 @@ valent_mock_device_plugin_class_init (ValentMockDevicePluginClass *klass)
 
   plugin_class->handle_packet = valent_mock_device_plugin_handle_packet;
   plugin_class->update_state = valent_mock_device_plugin_update_state;
+
+  valent_device_plugin_class_install_stream_handler (plugin_class,
+                                                     "kdeconnect.mock.stream",
+                                                     "items",
+                                                     (ValentDevicePluginStreamFunc)valent_mock_device_plugin_handle_stream);
 }
 
 static void
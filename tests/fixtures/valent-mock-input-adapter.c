@@ -81,6 +81,51 @@ valent_mock_input_adapter_pointer_motion (ValentInputAdapter *adapter,
   valent_test_event_push (event);
 }
 
+static void
+valent_mock_input_adapter_submit_events (ValentInputAdapter     *adapter,
+                                         const ValentInputEvent *events,
+                                         unsigned int            n_events)
+{
+  g_assert (VALENT_IS_INPUT_ADAPTER (adapter));
+  g_assert (VALENT_IS_MOCK_INPUT_ADAPTER (adapter));
+  g_assert (n_events > 0);
+
+  for (unsigned int i = 0; i < n_events; i++)
+    {
+      const ValentInputEvent *event = &events[i];
+
+      switch (event->type)
+        {
+        case VALENT_INPUT_EVENT_KEYSYM:
+          valent_mock_input_adapter_keyboard_keysym (adapter,
+                                                     event->code,
+                                                     event->state);
+          break;
+
+        case VALENT_INPUT_EVENT_POINTER_AXIS:
+          valent_mock_input_adapter_pointer_axis (adapter,
+                                                  event->dx,
+                                                  event->dy);
+          break;
+
+        case VALENT_INPUT_EVENT_POINTER_BUTTON:
+          valent_mock_input_adapter_pointer_button (adapter,
+                                                    event->code,
+                                                    event->state);
+          break;
+
+        case VALENT_INPUT_EVENT_POINTER_MOTION:
+          valent_mock_input_adapter_pointer_motion (adapter,
+                                                    event->dx,
+                                                    event->dy);
+          break;
+
+        default:
+          g_assert_not_reached ();
+        }
+    }
+}
+
 
 /*
  * GObject
@@ -94,6 +139,7 @@ valent_mock_input_adapter_class_init (ValentMockInputAdapterClass *klass)
   adapter_class->pointer_axis = valent_mock_input_adapter_pointer_axis;
   adapter_class->pointer_button = valent_mock_input_adapter_pointer_button;
   adapter_class->pointer_motion = valent_mock_input_adapter_pointer_motion;
+  adapter_class->submit_events = valent_mock_input_adapter_submit_events;
 }
 
 static void
@@ -3,10 +3,6 @@
 
 #include <valent.h>
 
-#ifdef HAVE_WALBOTTLE
-# include <libwalbottle/wbl-schema.h>
-#endif /* HAVE_WALBOTTLE */
-
 #include "valent-device-private.h"
 #include "valent-test-fixture.h"
 #include "valent-test-utils.h"
@@ -373,27 +369,15 @@ void
 valent_test_fixture_schema_fuzz (ValentTestFixture *fixture,
                                  const char        *path)
 {
-#ifdef HAVE_WALBOTTLE
   g_autoptr (JsonParser) parser = NULL;
-  g_autoptr (GBytes) data = NULL;
-  WblSchema *schema;
-  GPtrArray *instances;
-
-  data = g_resources_lookup_data (path, G_RESOURCE_LOOKUP_FLAGS_NONE, NULL);
-  schema = wbl_schema_new ();
-  wbl_schema_load_from_data (schema,
-                             g_bytes_get_data (data, NULL),
-                             g_bytes_get_size (data),
-                             NULL);
-  instances = wbl_schema_generate_instances (schema,
-                                             WBL_GENERATE_INSTANCE_NONE);
+  g_autoptr (GPtrArray) instances = NULL;
 
+  instances = valent_test_schema_instances (path);
   parser = json_parser_new ();
 
   for (unsigned int i = 0; i < instances->len; i++)
     {
-      WblGeneratedInstance *instance = g_ptr_array_index (instances, i);
-      const char *json = wbl_generated_instance_get_json (instance);
+      const char *json = g_ptr_array_index (instances, i);
       JsonNode *packet;
 
       json_parser_load_from_data (parser, json, -1, NULL);
@@ -403,9 +387,5 @@ valent_test_fixture_schema_fuzz (ValentTestFixture *fixture,
       if (VALENT_IS_PACKET (packet))
         valent_test_fixture_handle_packet (fixture, packet);
     }
-
-  g_ptr_array_unref (instances);
-  g_object_unref (schema);
-#endif /* HAVE_WALBOTTLE */
 }
 
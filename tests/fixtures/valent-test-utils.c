@@ -10,6 +10,10 @@
 #include <json-glib/json-glib.h>
 #include <valent.h>
 
+#ifdef HAVE_WALBOTTLE
+# include <libwalbottle/wbl-schema.h>
+#endif /* HAVE_WALBOTTLE */
+
 #include "valent-component-private.h"
 #include "valent-contact-cache-private.h"
 #include "valent-mock-channel.h"
@@ -238,6 +242,49 @@ valent_test_load_json (const char *path)
   return json_parser_steal_root (parser);
 }
 
+/**
+ * valent_test_schema_instances:
+ * @path: a resource path to a JSON Schema
+ *
+ * Generate test vectors for the JSON Schema at @path.
+ *
+ * The instances are JSON strings, which may or may not be valid KDE Connect
+ * packets. If the tests were built without walbottle, the array is empty.
+ *
+ * Returns: (transfer full) (element-type utf8): an array of JSON strings
+ */
+GPtrArray *
+valent_test_schema_instances (const char *path)
+{
+  GPtrArray *ret = g_ptr_array_new_with_free_func (g_free);
+#ifdef HAVE_WALBOTTLE
+  g_autoptr (GBytes) data = NULL;
+  WblSchema *schema;
+  GPtrArray *instances;
+
+  data = g_resources_lookup_data (path, G_RESOURCE_LOOKUP_FLAGS_NONE, NULL);
+  schema = wbl_schema_new ();
+  wbl_schema_load_from_data (schema,
+                             g_bytes_get_data (data, NULL),
+                             g_bytes_get_size (data),
+                             NULL);
+  instances = wbl_schema_generate_instances (schema,
+                                             WBL_GENERATE_INSTANCE_NONE);
+
+  for (unsigned int i = 0; i < instances->len; i++)
+    {
+      WblGeneratedInstance *instance = g_ptr_array_index (instances, i);
+
+      g_ptr_array_add (ret, g_strdup (wbl_generated_instance_get_json (instance)));
+    }
+
+  g_ptr_array_unref (instances);
+  g_object_unref (schema);
+#endif /* HAVE_WALBOTTLE */
+
+  return ret;
+}
+
 /**
  * valent_test_mock_settings:
  * @context: a context path
@@ -221,6 +221,61 @@ test_object_notify_thread (void)
   g_assert_null (g_thread_join (thread));
 }
 
+static void
+on_notify_count (ValentObject *object,
+                 GParamSpec   *pspec,
+                 unsigned int *n_notify)
+{
+  g_assert_true (VALENT_IS_MAIN_THREAD());
+
+  *n_notify += 1;
+}
+
+static gpointer
+notify_coalesce_thread_func (ValentObject *object)
+{
+  for (unsigned int i = 0; i < 100; i++)
+    valent_object_notify (object, "cancellable");
+
+  return NULL;
+}
+
+static void
+test_object_notify_coalesce (void)
+{
+  g_autoptr (ValentObject) object = NULL;
+  GThread *thread = NULL;
+  unsigned int n_notify = 0;
+
+  object = g_object_new (VALENT_TYPE_OBJECT, NULL);
+  g_signal_connect (object,
+                    "notify::cancellable",
+                    G_CALLBACK (on_notify_count),
+                    &n_notify);
+
+  VALENT_TEST_CHECK ("Notifications from a thread are coalesced");
+  thread = g_thread_new ("valent-object-notify",
+                         (GThreadFunc)notify_coalesce_thread_func,
+                         object);
+  g_assert_null (g_thread_join (thread));
+
+  valent_test_await_pending ();
+  g_assert_cmpuint (n_notify, ==, 1);
+
+  VALENT_TEST_CHECK ("Notifications from a thread respect frozen notification");
+  g_object_freeze_notify (G_OBJECT (object));
+  thread = g_thread_new ("valent-object-notify",
+                         (GThreadFunc)notify_coalesce_thread_func,
+                         object);
+  g_assert_null (g_thread_join (thread));
+
+  valent_test_await_pending ();
+  g_assert_cmpuint (n_notify, ==, 1);
+
+  g_object_thaw_notify (G_OBJECT (object));
+  g_assert_cmpuint (n_notify, ==, 2);
+}
+
 
 int
 main (int   argc,
@@ -243,5 +298,8 @@ main (int   argc,
   g_test_add_func ("/libvalent/core/object/notify-thread",
                    test_object_notify_thread);
 
+  g_test_add_func ("/libvalent/core/object/notify-coalesce",
+                   test_object_notify_coalesce);
+
   g_test_run ();
 }
@@ -23,6 +23,53 @@ test_utils_version (void)
   g_assert_false (valent_check_version (major, minor + 1));
 }
 
+static void
+test_utils_user_file (void)
+{
+  g_autofree char *dirname = NULL;
+  g_autoptr (GFile) directory = NULL;
+  g_autoptr (GFile) file1 = NULL;
+  g_autoptr (GFile) file2 = NULL;
+  g_autoptr (GFile) file3 = NULL;
+  g_autoptr (GFile) file4 = NULL;
+  g_autofree char *basename = NULL;
+  g_autoptr (GError) error = NULL;
+
+  dirname = g_dir_make_tmp ("valent-XXXXXX", &error);
+  g_assert_no_error (error);
+  directory = g_file_new_for_path (dirname);
+
+  VALENT_TEST_CHECK ("Unique files are reserved when allocated");
+  file1 = valent_get_user_file (dirname, "image.png", TRUE);
+  g_assert_true (g_file_query_exists (file1, NULL));
+
+  basename = g_file_get_basename (file1);
+  g_assert_cmpstr (basename, ==, "image.png");
+  g_clear_pointer (&basename, g_free);
+
+  VALENT_TEST_CHECK ("Unique files are numbered when the name is taken");
+  file2 = valent_get_user_file (dirname, "image.png", TRUE);
+  basename = g_file_get_basename (file2);
+  g_assert_cmpstr (basename, ==, "image.png (1)");
+  g_clear_pointer (&basename, g_free);
+
+  file3 = valent_get_user_file (dirname, "image.png", TRUE);
+  basename = g_file_get_basename (file3);
+  g_assert_cmpstr (basename, ==, "image.png (2)");
+  g_clear_pointer (&basename, g_free);
+
+  VALENT_TEST_CHECK ("Non-unique files are neither numbered nor created");
+  file4 = valent_get_user_file (dirname, "image.jpg", FALSE);
+  basename = g_file_get_basename (file4);
+  g_assert_cmpstr (basename, ==, "image.jpg");
+  g_assert_false (g_file_query_exists (file4, NULL));
+
+  g_file_delete (file1, NULL, NULL);
+  g_file_delete (file2, NULL, NULL);
+  g_file_delete (file3, NULL, NULL);
+  g_file_delete (directory, NULL, NULL);
+}
+
 int
 main (int   argc,
       char *argv[])
@@ -32,5 +79,8 @@ main (int   argc,
   g_test_add_func ("/libvalent/core/utils/version",
                    test_utils_version);
 
+  g_test_add_func ("/libvalent/core/utils/user-file",
+                   test_utils_user_file);
+
   g_test_run ();
 }
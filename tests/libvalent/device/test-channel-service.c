@@ -6,9 +6,14 @@
 #include <valent.h>
 #include <libvalent-test.h>
 
+#include "valent-channel-private.h"
 #include "valent-mock-channel.h"
 #include "valent-mock-channel-service.h"
 
+/* Large enough to fill the socket buffer, so the writer blocks */
+#define PRIORITY_BULK_SIZE    (4 * 1024 * 1024)
+#define PRIORITY_BULK_PACKETS (3)
+
 
 typedef struct
 {
@@ -403,6 +408,132 @@ test_channel_service_channel (ChannelServiceFixture *fixture,
   valent_object_destroy (VALENT_OBJECT (fixture->service));
 }
 
+static void
+priority_write_cb (ValentChannel *channel,
+                   GAsyncResult  *result,
+                   unsigned int  *n_pending)
+{
+  GError *error = NULL;
+
+  valent_channel_write_packet_finish (channel, result, &error);
+  g_assert_no_error (error);
+  *n_pending -= 1;
+}
+
+static void
+priority_read_cb (ValentChannel  *channel,
+                  GAsyncResult   *result,
+                  JsonNode      **packet)
+{
+  GError *error = NULL;
+
+  *packet = valent_channel_read_packet_finish (channel, result, &error);
+  g_assert_no_error (error);
+}
+
+static void
+test_channel_service_priority (ChannelServiceFixture *fixture,
+                               gconstpointer          user_data)
+{
+  g_autofree ValentChannel **channels = NULL;
+  g_autoptr (JsonBuilder) builder = NULL;
+  g_autoptr (JsonNode) ping = NULL;
+  g_autoptr (GPtrArray) bulk = NULL;
+  g_autofree char *vcard = NULL;
+  JsonNode *identity;
+  unsigned int n_pending = 0;
+  unsigned int depth, max_depth;
+  int ping_index = -1;
+  int64_t next_index = 0;
+
+  identity = json_object_get_member (json_node_get_object (fixture->packets),
+                                     "identity");
+  channels = valent_test_channel_pair (identity, identity);
+  fixture->channel = g_steal_pointer (&channels[0]);
+  fixture->endpoint = g_steal_pointer (&channels[1]);
+  g_object_add_weak_pointer (G_OBJECT (fixture->channel),
+                             (gpointer)&fixture->channel);
+  g_object_add_weak_pointer (G_OBJECT (fixture->endpoint),
+                             (gpointer)&fixture->endpoint);
+
+  vcard = g_strnfill (PRIORITY_BULK_SIZE, 'v');
+  bulk = g_ptr_array_new_with_free_func ((GDestroyNotify)json_node_unref);
+
+  for (unsigned int i = 0; i < PRIORITY_BULK_PACKETS; i++)
+    {
+      valent_packet_init (&builder, "kdeconnect.contacts.response_vcards");
+      json_builder_set_member_name (builder, "index");
+      json_builder_add_int_value (builder, i);
+      json_builder_set_member_name (builder, "contact");
+      json_builder_add_string_value (builder, vcard);
+      g_ptr_array_add (bulk, valent_packet_end (&builder));
+    }
+
+  valent_packet_init (&builder, "kdeconnect.ping");
+  ping = valent_packet_end (&builder);
+
+  /* Nothing is read until every packet is queued, so the writer blocks on the
+   * first bulk packet, at the latest */
+  VALENT_TEST_CHECK ("Channel queues bulk packets until they are written");
+  for (unsigned int i = 0; i < bulk->len; i++)
+    {
+      n_pending++;
+      valent_channel_write_packet (fixture->channel,
+                                   g_ptr_array_index (bulk, i),
+                                   NULL,
+                                   (GAsyncReadyCallback)priority_write_cb,
+                                   &n_pending);
+    }
+
+  n_pending++;
+  valent_channel_write_packet (fixture->channel,
+                               ping,
+                               NULL,
+                               (GAsyncReadyCallback)priority_write_cb,
+                               &n_pending);
+
+  depth = valent_channel_get_queue_depth (fixture->channel, NULL);
+  g_assert_cmpuint (depth, >=, PRIORITY_BULK_PACKETS - 1);
+
+  /* At most the first bulk packet is written before the ping, which may have
+   * already been in progress when the ping was queued */
+  VALENT_TEST_CHECK ("Channel writes interactive packets before bulk packets");
+  for (unsigned int i = 0; i < PRIORITY_BULK_PACKETS + 1; i++)
+    {
+      g_autoptr (JsonNode) packet = NULL;
+      int64_t index;
+
+      valent_channel_read_packet (fixture->endpoint,
+                                  NULL,
+                                  (GAsyncReadyCallback)priority_read_cb,
+                                  &packet);
+      valent_test_await_pointer (&packet);
+
+      if (g_str_equal (valent_packet_get_type (packet), "kdeconnect.ping"))
+        {
+          ping_index = i;
+          continue;
+        }
+
+      /* Bulk packets are written in the order they were queued */
+      g_assert_true (valent_packet_get_int (packet, "index", &index));
+      g_assert_cmpint (index, ==, next_index++);
+    }
+
+  g_assert_cmpint (ping_index, >=, 0);
+  g_assert_cmpint (ping_index, <=, 1);
+
+  while (n_pending > 0)
+    g_main_context_iteration (NULL, FALSE);
+
+  depth = valent_channel_get_queue_depth (fixture->channel, &max_depth);
+  g_assert_cmpuint (depth, ==, 0);
+  g_assert_cmpuint (max_depth, >=, PRIORITY_BULK_PACKETS - 1);
+
+  valent_channel_close (fixture->endpoint, NULL, NULL);
+  valent_channel_close (fixture->channel, NULL, NULL);
+}
+
 int
 main (int   argc,
       char *argv[])
@@ -427,5 +558,11 @@ main (int   argc,
               test_channel_service_channel,
               channel_service_fixture_tear_down);
 
+  g_test_add ("/libvalent/device/channel-service/priority",
+              ChannelServiceFixture, NULL,
+              channel_service_fixture_set_up,
+              test_channel_service_priority,
+              channel_service_fixture_tear_down);
+
   return g_test_run ();
 }
@@ -82,6 +82,58 @@ on_devices_changed (GListModel     *list,
     }
 }
 
+static void
+read_packet_cb (ValentChannel  *channel,
+                GAsyncResult   *result,
+                JsonNode      **packet)
+{
+  GError *error = NULL;
+
+  *packet = valent_channel_read_packet_finish (channel, result, &error);
+  g_assert_no_error (error);
+}
+
+/*
+ * Read packets from the remote end of the device's channel, skipping any sent
+ * by plugins, until one of @type is received.
+ */
+static JsonNode *
+expect_broadcast (const char *type)
+{
+  ValentChannel *endpoint = valent_mock_channel_service_get_endpoint ();
+
+  g_assert_true (VALENT_IS_CHANNEL (endpoint));
+
+  while (TRUE)
+    {
+      JsonNode *packet = NULL;
+
+      valent_channel_read_packet (endpoint,
+                                  NULL,
+                                  (GAsyncReadyCallback)read_packet_cb,
+                                  &packet);
+      valent_test_await_pointer (&packet);
+
+      g_assert_cmpstr (valent_packet_get_type (packet), !=, "kdeconnect.mock.unsupported");
+
+      if (g_str_equal (valent_packet_get_type (packet), type))
+        return packet;
+
+      json_node_unref (packet);
+    }
+}
+
+/*
+ * Remembered devices are loaded in a thread, so wait for them to be added.
+ */
+static void
+await_n_devices (ValentDeviceManager *manager,
+                 unsigned int         n_devices)
+{
+  while (g_list_model_get_n_items (G_LIST_MODEL (manager)) < n_devices)
+    g_main_context_iteration (NULL, FALSE);
+}
+
 static void
 test_manager_basic (ManagerFixture *fixture,
                     gconstpointer   user_data)
@@ -99,6 +151,7 @@ static void
 test_manager_management (ManagerFixture *fixture,
                          gconstpointer   user_data)
 {
+  JsonNode *packet = NULL;
   unsigned int n_devices = 0;
 
   g_signal_connect (fixture->manager,
@@ -128,6 +181,39 @@ test_manager_management (ManagerFixture *fixture,
   n_devices = g_list_model_get_n_items (G_LIST_MODEL (fixture->manager));
   g_assert_cmpuint (n_devices, ==, 1);
 
+  /* Broadcasts packets to devices that accept them */
+  VALENT_TEST_CHECK ("Broadcast packets are written to the device's channel");
+  packet = valent_packet_new ("kdeconnect.mock.echo");
+  json_object_set_string_member (valent_packet_get_body (packet),
+                                 "broadcast", "first");
+  g_assert_cmpuint (valent_device_manager_broadcast_packet (fixture->manager,
+                                                            packet), ==, 1);
+  g_clear_pointer (&packet, json_node_unref);
+
+  packet = expect_broadcast ("kdeconnect.mock.echo");
+  g_assert_cmpstr (json_object_get_string_member (valent_packet_get_body (packet),
+                                                  "broadcast"), ==, "first");
+  g_clear_pointer (&packet, json_node_unref);
+
+  /* Packets the device doesn't accept are not written; the next packet read
+   * after an unsupported broadcast is the following echo */
+  VALENT_TEST_CHECK ("Broadcast packets are only sent to devices that accept them");
+  packet = valent_packet_new ("kdeconnect.mock.unsupported");
+  g_assert_cmpuint (valent_device_manager_broadcast_packet (fixture->manager,
+                                                            packet), ==, 0);
+  g_clear_pointer (&packet, json_node_unref);
+
+  packet = valent_packet_new ("kdeconnect.mock.echo");
+  json_object_set_string_member (valent_packet_get_body (packet),
+                                 "broadcast", "second");
+  valent_device_manager_broadcast_packet (fixture->manager, packet);
+  g_clear_pointer (&packet, json_node_unref);
+
+  packet = expect_broadcast ("kdeconnect.mock.echo");
+  g_assert_cmpstr (json_object_get_string_member (valent_packet_get_body (packet),
+                                                  "broadcast"), ==, "second");
+  g_clear_pointer (&packet, json_node_unref);
+
   /* Retains paired devices that disconnect */
   g_object_notify (G_OBJECT (fixture->device), "state");
   g_assert_true (VALENT_IS_DEVICE (fixture->device));
@@ -308,6 +394,238 @@ test_manager_dispose (ManagerFixture *fixture,
     g_main_context_iteration (NULL, FALSE);
 }
 
+static void
+test_manager_load_state (ManagerFixture *fixture,
+                         gconstpointer   user_data)
+{
+  unsigned int n_remembered = GPOINTER_TO_UINT (user_data);
+  g_autoptr (ValentContext) context = NULL;
+  g_autoptr (GFile) file = NULL;
+  g_autoptr (JsonNode) template = NULL;
+  g_autoptr (JsonObject) state = NULL;
+  g_autoptr (JsonNode) state_node = NULL;
+  g_autofree char *state_json = NULL;
+  unsigned int n_devices = 0;
+  double startup, elapsed;
+
+  /* Write a state file with many remembered devices */
+  template = valent_test_load_json ("core-state.json");
+  state = json_object_new ();
+
+  for (unsigned int i = 0; i < n_remembered; i++)
+    {
+      g_autofree char *device_id = NULL;
+      JsonNode *identity;
+      JsonObject *body;
+
+      device_id = g_strdup_printf ("test-device-%u", i);
+      identity = json_object_dup_member (json_node_get_object (template),
+                                         "test-device");
+      body = json_object_get_object_member (json_node_get_object (identity),
+                                            "body");
+      json_object_set_string_member (body, "deviceId", device_id);
+      json_object_set_member (state, device_id, identity);
+    }
+
+  state_node = json_node_init_object (json_node_alloc (), state);
+  state_json = json_to_string (state_node, TRUE);
+
+  context = valent_context_new (NULL, NULL, NULL);
+  file = valent_context_get_cache_file (context, "devices.json");
+  g_file_set_contents (g_file_peek_path (file), state_json, -1, NULL);
+
+  VALENT_TEST_CHECK ("Remembered devices are loaded at startup");
+  g_test_timer_start ();
+  valent_application_plugin_startup (VALENT_APPLICATION_PLUGIN (fixture->manager));
+  startup = g_test_timer_elapsed ();
+  await_n_devices (fixture->manager, n_remembered);
+  elapsed = g_test_timer_elapsed ();
+
+  n_devices = g_list_model_get_n_items (G_LIST_MODEL (fixture->manager));
+  g_assert_cmpuint (n_devices, ==, n_remembered);
+
+  g_test_message ("Started in %.3fms, loaded %u remembered devices in %.3fms",
+                  startup * 1000.0,
+                  n_remembered,
+                  elapsed * 1000.0);
+
+  VALENT_TEST_CHECK ("The legacy state file is replaced by the log");
+  valent_application_plugin_shutdown (VALENT_APPLICATION_PLUGIN (fixture->manager));
+  g_assert_false (g_file_query_exists (file, NULL));
+  g_clear_object (&file);
+
+  file = valent_context_get_cache_file (context, "devices.log");
+  g_assert_true (g_file_query_exists (file, NULL));
+}
+
+/*
+ * Write a state log with @n_remembered devices, removing the legacy state file
+ * left by the fixture.
+ */
+static GFile *
+write_state_log (ValentContext *context,
+                 unsigned int   n_remembered,
+                 const char    *trailer)
+{
+  g_autoptr (GFile) legacy = NULL;
+  g_autoptr (JsonNode) template = NULL;
+  g_autoptr (GString) log = NULL;
+  GFile *file;
+
+  template = valent_test_load_json ("core-state.json");
+  log = g_string_new (NULL);
+
+  for (unsigned int i = 0; i < n_remembered; i++)
+    {
+      g_autoptr (JsonNode) identity = NULL;
+      g_autofree char *device_id = NULL;
+      g_autofree char *identity_json = NULL;
+      JsonObject *body;
+
+      device_id = g_strdup_printf ("test-device-%u", i);
+      identity = json_object_dup_member (json_node_get_object (template),
+                                         "test-device");
+      body = json_object_get_object_member (json_node_get_object (identity),
+                                            "body");
+      json_object_set_string_member (body, "deviceId", device_id);
+      identity_json = json_to_string (identity, FALSE);
+
+      g_string_append_printf (log,
+                              "{\"id\":\"%s\",\"identity\":%s}\n",
+                              device_id,
+                              identity_json);
+    }
+
+  if (trailer != NULL)
+    g_string_append (log, trailer);
+
+  legacy = valent_context_get_cache_file (context, "devices.json");
+  g_file_delete (legacy, NULL, NULL);
+
+  file = valent_context_get_cache_file (context, "devices.log");
+  g_file_set_contents (g_file_peek_path (file), log->str, log->len, NULL);
+
+  return file;
+}
+
+static void
+test_manager_load_log (ManagerFixture *fixture,
+                       gconstpointer   user_data)
+{
+  unsigned int n_remembered = GPOINTER_TO_UINT (user_data);
+  g_autoptr (ValentContext) context = NULL;
+  g_autoptr (GFile) file = NULL;
+  g_autofree char *contents = NULL;
+  size_t length = 0;
+  unsigned int n_devices = 0;
+  double startup, elapsed;
+
+  /* A tombstone for the first device and an interrupted final record */
+  context = valent_context_new (NULL, NULL, NULL);
+  file = write_state_log (context,
+                          n_remembered,
+                          "{\"id\":\"test-device-0\"}\n"
+                          "{\"id\":\"test-device-");
+
+  VALENT_TEST_CHECK ("Remembered devices are loaded from the log at startup");
+  g_test_timer_start ();
+  valent_application_plugin_startup (VALENT_APPLICATION_PLUGIN (fixture->manager));
+  startup = g_test_timer_elapsed ();
+  await_n_devices (fixture->manager, n_remembered - 1);
+  elapsed = g_test_timer_elapsed ();
+
+  n_devices = g_list_model_get_n_items (G_LIST_MODEL (fixture->manager));
+  g_assert_cmpuint (n_devices, ==, n_remembered - 1);
+
+  g_test_message ("Started in %.3fms, loaded %u remembered devices in %.3fms",
+                  startup * 1000.0,
+                  n_remembered - 1,
+                  elapsed * 1000.0);
+
+  VALENT_TEST_CHECK ("An interrupted record is removed from the log");
+  valent_application_plugin_shutdown (VALENT_APPLICATION_PLUGIN (fixture->manager));
+  g_file_load_contents (file, NULL, &contents, &length, NULL, NULL);
+  g_assert_cmpuint (length, >, 0);
+  g_assert_cmpint (contents[length - 1], ==, '\n');
+  g_assert_null (g_strstr_len (contents, length, "test-device-0\""));
+}
+
+static void
+test_manager_save_state (ManagerFixture *fixture,
+                         gconstpointer   user_data)
+{
+  unsigned int n_remembered = GPOINTER_TO_UINT (user_data);
+  g_autoptr (ValentContext) context = NULL;
+  g_autoptr (GFile) file = NULL;
+  g_autofree char *contents = NULL;
+  g_auto (GStrv) lines = NULL;
+  g_autoptr (GHashTable) remembered = NULL;
+  size_t length = 0;
+  double elapsed, flushed;
+
+  context = valent_context_new (NULL, NULL, NULL);
+  file = write_state_log (context, n_remembered, NULL);
+  valent_application_plugin_startup (VALENT_APPLICATION_PLUGIN (fixture->manager));
+  await_n_devices (fixture->manager, n_remembered);
+  g_assert_cmpuint (g_list_model_get_n_items (G_LIST_MODEL (fixture->manager)),
+                    ==, n_remembered);
+
+  /* Remembered devices that are unpaired and disconnected are forgotten, each
+   * appending a record to the log */
+  VALENT_TEST_CHECK ("Changes are saved without blocking the main thread");
+  g_test_timer_start ();
+
+  while (g_list_model_get_n_items (G_LIST_MODEL (fixture->manager)) > 0)
+    {
+      g_autoptr (ValentDevice) device = NULL;
+
+      device = g_list_model_get_item (G_LIST_MODEL (fixture->manager), 0);
+      g_object_notify (G_OBJECT (device), "state");
+    }
+
+  elapsed = g_test_timer_elapsed ();
+
+  /* Shutdown waits for the pending writes */
+  valent_application_plugin_shutdown (VALENT_APPLICATION_PLUGIN (fixture->manager));
+  flushed = g_test_timer_elapsed ();
+
+  g_test_minimized_result (elapsed * 1000.0 / n_remembered,
+                           "Saved %u changes in %.3fms (%.3fms per change), "
+                           "written in %.3fms",
+                           n_remembered,
+                           elapsed * 1000.0,
+                           elapsed * 1000.0 / n_remembered,
+                           flushed * 1000.0);
+
+  VALENT_TEST_CHECK ("The log replays to no remembered devices");
+  g_file_load_contents (file, NULL, &contents, &length, NULL, NULL);
+  lines = g_strsplit (contents, "\n", -1);
+  remembered = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  for (unsigned int i = 0; lines[i] != NULL; i++)
+    {
+      g_autoptr (JsonNode) record = NULL;
+      JsonObject *object;
+      const char *device_id;
+
+      if (*lines[i] == '\0')
+        continue;
+
+      record = json_from_string (lines[i], NULL);
+      g_assert_true (JSON_NODE_HOLDS_OBJECT (record));
+
+      object = json_node_get_object (record);
+      device_id = json_object_get_string_member (object, "id");
+
+      if (json_object_has_member (object, "identity"))
+        g_hash_table_add (remembered, g_strdup (device_id));
+      else
+        g_hash_table_remove (remembered, device_id);
+    }
+
+  g_assert_cmpuint (g_hash_table_size (remembered), ==, 0);
+}
+
 int
 main (int   argc,
       char *argv[])
@@ -338,6 +656,42 @@ main (int   argc,
               test_manager_dispose,
               manager_fixture_tear_down);
 
+  g_test_add ("/libvalent/device/device-manager/load-state/1",
+              ManagerFixture, GUINT_TO_POINTER (1),
+              manager_fixture_set_up,
+              test_manager_load_state,
+              manager_fixture_tear_down);
+
+  g_test_add ("/libvalent/device/device-manager/load-state/10",
+              ManagerFixture, GUINT_TO_POINTER (10),
+              manager_fixture_set_up,
+              test_manager_load_state,
+              manager_fixture_tear_down);
+
+  g_test_add ("/libvalent/device/device-manager/load-state/100",
+              ManagerFixture, GUINT_TO_POINTER (100),
+              manager_fixture_set_up,
+              test_manager_load_state,
+              manager_fixture_tear_down);
+
+  g_test_add ("/libvalent/device/device-manager/load-state/500",
+              ManagerFixture, GUINT_TO_POINTER (500),
+              manager_fixture_set_up,
+              test_manager_load_state,
+              manager_fixture_tear_down);
+
+  g_test_add ("/libvalent/device/device-manager/load-log/500",
+              ManagerFixture, GUINT_TO_POINTER (500),
+              manager_fixture_set_up,
+              test_manager_load_log,
+              manager_fixture_tear_down);
+
+  g_test_add ("/libvalent/device/device-manager/save-state/500",
+              ManagerFixture, GUINT_TO_POINTER (500),
+              manager_fixture_set_up,
+              test_manager_save_state,
+              manager_fixture_tear_down);
+
   return g_test_run ();
 }
 
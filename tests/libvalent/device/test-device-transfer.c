@@ -2,6 +2,7 @@
 // SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
 
 #include <math.h>
+#include <time.h>
 
 #include <gio/gio.h>
 #include <valent.h>
@@ -86,6 +87,160 @@ test_device_transfer (ValentTestFixture *fixture,
     }
 }
 
+static void
+cancelled_cb (ValentTransfer *transfer,
+              GAsyncResult   *result,
+              gboolean       *done)
+{
+  GError *error = NULL;
+
+  valent_transfer_execute_finish (transfer, result, &error);
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+  g_clear_error (&error);
+
+  *done = TRUE;
+}
+
+static void
+test_device_transfer_cancelled (ValentTestFixture *fixture,
+                                gconstpointer      user_data)
+{
+  g_autoptr (ValentTransfer) transfer = NULL;
+  g_autoptr (GCancellable) cancellable = NULL;
+  g_autoptr (GFile) file = NULL;
+  g_autoptr (JsonBuilder) builder = NULL;
+  g_autoptr (JsonNode) packet = NULL;
+  g_autoptr (JsonObject) info = NULL;
+  const char *dest_dir = NULL;
+  gboolean done = FALSE;
+
+  valent_test_fixture_connect (fixture, TRUE);
+
+  /* The name is reserved with an empty file */
+  dest_dir = valent_get_user_directory (G_USER_DIRECTORY_DOWNLOAD);
+  file = valent_get_user_file (dest_dir, "cancelled.bin", TRUE);
+  VALENT_TEST_CHECK ("The file name is reserved");
+  g_assert_true (g_file_query_exists (file, NULL));
+
+  valent_packet_init (&builder, "kdeconnect.mock.transfer");
+  packet = valent_packet_end (&builder);
+  info = json_object_new ();
+  json_object_set_int_member (info, "port", 1739);
+  valent_packet_set_payload_full (packet, json_object_ref (info), 1024);
+
+  VALENT_TEST_CHECK ("A failed download removes the reserved file");
+  cancellable = g_cancellable_new ();
+  g_cancellable_cancel (cancellable);
+
+  transfer = valent_device_transfer_new (fixture->device, packet, file);
+  valent_transfer_execute (transfer,
+                           cancellable,
+                           (GAsyncReadyCallback)cancelled_cb,
+                           &done);
+  valent_test_await_boolean (&done);
+
+  g_assert_false (g_file_query_exists (file, NULL));
+}
+
+#define PERF_FILE_SIZE (64 * 1024 * 1024)
+
+static void
+execute_cb (ValentTransfer *transfer,
+            GAsyncResult   *result,
+            gboolean       *done)
+{
+  GError *error = NULL;
+
+  valent_transfer_execute_finish (transfer, result, &error);
+  g_assert_no_error (error);
+
+  *done = TRUE;
+}
+
+static void
+test_device_transfer_perf (ValentTestFixture *fixture,
+                           gconstpointer      user_data)
+{
+  g_autoptr (ValentTransfer) transfer = NULL;
+  g_autoptr (GFile) file = NULL;
+  g_autoptr (GFileIOStream) file_stream = NULL;
+  g_autofree uint8_t *contents = NULL;
+  g_autoptr (JsonBuilder) builder = NULL;
+  g_autoptr (JsonNode) request = NULL;
+  JsonNode *packet = NULL;
+  gboolean done = FALSE;
+  int64_t begin_time, end_time;
+  clock_t begin_cpu, end_cpu;
+  double seconds, cpu_seconds;
+  double mbps, cpu_percent, cpu_per_gb;
+  GError *error = NULL;
+
+  if (!g_test_perf ())
+    {
+      g_test_skip ("Performance tests disabled");
+      return;
+    }
+
+  valent_test_fixture_connect (fixture, TRUE);
+
+  contents = g_malloc (PERF_FILE_SIZE);
+  for (size_t i = 0; i < PERF_FILE_SIZE; i++)
+    contents[i] = (uint8_t)g_test_rand_int ();
+
+  file = g_file_new_tmp ("valent-transfer-XXXXXX.bin", &file_stream, &error);
+  g_assert_no_error (error);
+  g_output_stream_write_all (g_io_stream_get_output_stream (G_IO_STREAM (file_stream)),
+                             contents,
+                             PERF_FILE_SIZE,
+                             NULL,
+                             NULL,
+                             &error);
+  g_assert_no_error (error);
+  g_io_stream_close (G_IO_STREAM (file_stream), NULL, &error);
+  g_assert_no_error (error);
+
+  valent_packet_init (&builder, "kdeconnect.mock.transfer");
+  request = valent_packet_end (&builder);
+
+  begin_time = g_get_monotonic_time ();
+  begin_cpu = clock ();
+
+  transfer = VALENT_TRANSFER (valent_device_transfer_new (fixture->device,
+                                                          request,
+                                                          file));
+  valent_transfer_execute (transfer,
+                           NULL,
+                           (GAsyncReadyCallback)execute_cb,
+                           &done);
+
+  packet = valent_test_fixture_expect_packet (fixture);
+  valent_test_fixture_download (fixture, packet, &error);
+  g_assert_no_error (error);
+  json_node_unref (packet);
+
+  valent_test_await_boolean (&done);
+
+  end_cpu = clock ();
+  end_time = g_get_monotonic_time ();
+
+  /* Both ends of the transfer run in this process, so the CPU time includes
+   * reading and writing the payload. The mock channel is a plain socket pair,
+   * so the cost of TLS is not included. */
+  seconds = (double)(end_time - begin_time) / G_USEC_PER_SEC;
+  cpu_seconds = (double)(end_cpu - begin_cpu) / CLOCKS_PER_SEC;
+  mbps = ((double)PERF_FILE_SIZE / (1024 * 1024)) / seconds;
+  cpu_percent = (cpu_seconds / seconds) * 100.0;
+  cpu_per_gb = cpu_seconds / ((double)PERF_FILE_SIZE / (1024 * 1024 * 1024));
+
+  g_test_maximized_result (mbps, "Upload throughput: %.1f MB/s", mbps);
+  g_test_minimized_result (cpu_per_gb,
+                           "CPU: %.1f%% (%.2f s/GB)",
+                           cpu_percent,
+                           cpu_per_gb);
+
+  g_file_delete (file, NULL, NULL);
+}
+
 int
 main (int   argc,
       char *argv[])
@@ -100,5 +255,17 @@ main (int   argc,
               test_device_transfer,
               valent_test_fixture_clear);
 
+  g_test_add ("/libvalent/device/device-transfer/cancelled",
+              ValentTestFixture, path,
+              valent_test_fixture_init,
+              test_device_transfer_cancelled,
+              valent_test_fixture_clear);
+
+  g_test_add ("/libvalent/device/device-transfer/perf",
+              ValentTestFixture, path,
+              valent_test_fixture_init,
+              test_device_transfer_perf,
+              valent_test_fixture_clear);
+
   return g_test_run ();
 }
@@ -1,6 +1,8 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 // SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
 
+#include <string.h>
+
 #include <gio/gio.h>
 #include <valent.h>
 #include <libvalent-test.h>
@@ -511,6 +513,90 @@ test_device_plugins (DeviceFixture *fixture,
   g_clear_pointer (&device_plugins, g_strfreev);
 }
 
+static void
+on_action_added_count (GActionGroup *action_group,
+                       const char   *action_name,
+                       unsigned int *n_added)
+{
+  if (n_added)
+    *n_added += 1;
+}
+
+static void
+test_device_dormant (DeviceFixture *fixture,
+                     gconstpointer  user_data)
+{
+  unsigned int n_added = 0;
+
+  valent_device_set_paired (fixture->device, FALSE);
+  g_signal_connect (fixture->device,
+                    "action-added",
+                    G_CALLBACK (on_action_added_count),
+                    &n_added);
+
+  VALENT_TEST_CHECK ("Plugins are dormant while disconnected or unpaired");
+  valent_device_set_channel (fixture->device, fixture->channel);
+  g_assert_cmpuint (n_added, ==, 0);
+
+  VALENT_TEST_CHECK ("Plugins are activated when connected and paired");
+  valent_device_set_paired (fixture->device, TRUE);
+  g_assert_cmpuint (n_added, >, 0);
+
+  valent_device_set_paired (fixture->device, FALSE);
+  valent_device_set_channel (fixture->device, NULL);
+  g_signal_handlers_disconnect_by_data (fixture->device, &n_added);
+}
+
+static void
+test_device_dormant_hold (DeviceFixture *fixture,
+                          gconstpointer  user_data)
+{
+  unsigned int n_added = 0;
+  gboolean has_action;
+
+  g_signal_connect (fixture->device,
+                    "action-added",
+                    G_CALLBACK (on_action_added_count),
+                    &n_added);
+
+  VALENT_TEST_CHECK ("Plugins are activated when held");
+  valent_device_hold (fixture->device);
+  g_assert_cmpuint (n_added, >, 0);
+  valent_device_release (fixture->device);
+  g_signal_handlers_disconnect_by_data (fixture->device, &n_added);
+
+  VALENT_TEST_CHECK ("Plugins remain active until idle");
+  has_action = g_action_group_has_action (G_ACTION_GROUP (fixture->device),
+                                          "packetless.action");
+  g_assert_true (has_action);
+}
+
+static void
+test_device_dormant_access (DeviceFixture *fixture,
+                            gconstpointer  user_data)
+{
+  gboolean has_action;
+  gboolean enabled = TRUE;
+
+  VALENT_TEST_CHECK ("Plugins are not activated when actions are queried");
+  has_action = g_action_group_query_action (G_ACTION_GROUP (fixture->device),
+                                            "packetless.action",
+                                            &enabled,
+                                            NULL, NULL, NULL, NULL);
+  g_assert_true (has_action);
+  g_assert_false (enabled);
+  g_assert_false (g_action_group_has_action (G_ACTION_GROUP (fixture->device),
+                                             "mock.state"));
+
+  VALENT_TEST_CHECK ("Plugins are activated when an action is activated");
+  g_action_group_activate_action (G_ACTION_GROUP (fixture->device),
+                                  "packetless.action",
+                                  NULL);
+  has_action = g_action_group_has_action (G_ACTION_GROUP (fixture->device),
+                                          "packetless.action");
+  g_assert_true (has_action);
+}
+
 /*
  * Packet Handling
  */
@@ -539,6 +625,92 @@ test_handle_packet (DeviceFixture *fixture,
   endpoint_expect_packet_pair (fixture, FALSE);
 }
 
+/*
+ * Dispatch Benchmark
+ */
+static GPtrArray *
+load_packet_corpus (void)
+{
+  g_autoptr (GPtrArray) corpus = NULL;
+  g_auto (GStrv) names = NULL;
+  g_autoptr (GError) error = NULL;
+
+  corpus = g_ptr_array_new_with_free_func ((GDestroyNotify)json_node_unref);
+  names = g_resources_enumerate_children ("/tests", 0, &error);
+  g_assert_no_error (error);
+
+  for (unsigned int i = 0; names[i] != NULL; i++)
+    {
+      g_autoptr (JsonNode) root = NULL;
+      JsonObjectIter iter;
+      JsonNode *packet;
+
+      if (!g_str_has_suffix (names[i], ".json") ||
+          (!g_str_has_prefix (names[i], "core") &&
+           !g_str_has_prefix (names[i], "plugin-")))
+        continue;
+
+      root = valent_test_load_json (names[i]);
+
+      if (!JSON_NODE_HOLDS_OBJECT (root))
+        continue;
+
+      json_object_iter_init (&iter, json_node_get_object (root));
+
+      while (json_object_iter_next (&iter, NULL, &packet))
+        {
+          const char *type;
+
+          if (!VALENT_IS_PACKET (packet))
+            continue;
+
+          /* Skip packets that would change the device state or expect a
+           * response over the channel */
+          type = valent_packet_get_type (packet);
+
+          if (g_str_equal (type, "kdeconnect.pair") ||
+              g_str_has_prefix (type, "kdeconnect.mock"))
+            continue;
+
+          g_ptr_array_add (corpus, json_node_ref (packet));
+        }
+    }
+
+  return g_steal_pointer (&corpus);
+}
+
+static void
+test_device_dispatch (DeviceFixture *fixture,
+                      gconstpointer  user_data)
+{
+  g_autoptr (GPtrArray) corpus = NULL;
+  unsigned int n_iterations = g_test_perf () ? 10000 : 10;
+  unsigned int n_packets = 0;
+  double elapsed;
+
+  corpus = load_packet_corpus ();
+  g_assert_cmpuint (corpus->len, >, 0);
+
+  valent_device_set_paired (fixture->device, TRUE);
+
+  VALENT_TEST_CHECK ("Device can dispatch the packet corpus");
+  g_test_timer_start ();
+
+  for (unsigned int i = 0; i < n_iterations; i++)
+    {
+      for (unsigned int j = 0; j < corpus->len; j++)
+        valent_device_handle_packet (fixture->device, g_ptr_array_index (corpus, j));
+
+      n_packets += corpus->len;
+    }
+
+  elapsed = g_test_timer_elapsed ();
+  g_test_minimized_result (elapsed * G_USEC_PER_SEC / n_packets,
+                           "%.3fµs per packet (%u packets)",
+                           elapsed * G_USEC_PER_SEC / n_packets,
+                           n_packets);
+}
+
 static void
 send_available_cb (ValentDevice  *device,
                    GAsyncResult  *result,
@@ -631,6 +803,246 @@ test_send_packet (DeviceFixture *fixture,
   g_assert_false (valent_device_get_connected (fixture->device));
 }
 
+static void
+test_device_metrics (DeviceFixture *fixture,
+                     gconstpointer  user_data)
+{
+  JsonNode *echo = get_packet (fixture, "test-echo");
+  JsonNode *pair = get_packet (fixture, "pair");
+  g_autoptr (GVariant) metrics = NULL;
+  g_autoptr (GVariant) packets = NULL;
+  g_autoptr (GVariant) handlers = NULL;
+  g_autoptr (GVariant) latency = NULL;
+  g_autofree char *echo_str = NULL;
+  g_autoptr (GBytes) echo_bytes = NULL;
+  uint64_t rx_packets, rx_bytes, tx_packets, tx_bytes;
+  uint64_t n_calls, total_time, max_time;
+  GVariantIter *buckets;
+  uint64_t n_bucketed = 0;
+  uint64_t bucket;
+  unsigned int depth;
+
+  valent_device_set_channel (fixture->device, fixture->channel);
+  valent_device_set_paired (fixture->device, TRUE);
+
+  VALENT_TEST_CHECK ("Device counts received packets and handler time");
+  valent_channel_write_packet (fixture->endpoint, echo, NULL, NULL, NULL);
+  endpoint_expect_packet_echo (fixture, echo);
+
+  VALENT_TEST_CHECK ("Device sends serialized packets through the channel queue");
+  echo_str = valent_packet_serialize (echo);
+  echo_bytes = g_bytes_new (echo_str, strlen (echo_str));
+  g_assert_true (valent_device_send_bytes (fixture->device,
+                                           "kdeconnect.mock.echo",
+                                           echo_bytes));
+  endpoint_expect_packet_echo (fixture, echo);
+
+  VALENT_TEST_CHECK ("Device counts sent packets");
+  valent_device_send_packet (fixture->device,
+                             pair,
+                             NULL,
+                             (GAsyncReadyCallback)send_available_cb,
+                             fixture);
+  g_main_loop_run (fixture->loop);
+  endpoint_expect_packet_pair (fixture, TRUE);
+
+  metrics = g_variant_ref_sink (valent_device_dup_metrics (fixture->device));
+  g_assert_true (g_variant_lookup (metrics, "rx-packets", "t", &rx_packets));
+  g_assert_cmpuint (rx_packets, ==, 1);
+  g_assert_true (g_variant_lookup (metrics, "rx-bytes", "t", &rx_bytes));
+  g_assert_cmpuint (rx_bytes, >, 0);
+  g_assert_true (g_variant_lookup (metrics, "tx-packets", "t", &tx_packets));
+  g_assert_cmpuint (tx_packets, >=, 1);
+  g_assert_true (g_variant_lookup (metrics, "queue-depth", "u", &depth));
+  g_assert_true (g_variant_lookup (metrics, "throttled", "t", &total_time));
+  g_assert_cmpuint (total_time, ==, 0);
+
+  packets = g_variant_lookup_value (metrics, "packets", G_VARIANT_TYPE ("a{s(tttt)}"));
+  g_assert_nonnull (packets);
+  g_assert_true (g_variant_lookup (packets, "kdeconnect.mock.echo", "(tttt)",
+                                   &rx_packets, &rx_bytes, NULL, NULL));
+  g_assert_cmpuint (rx_packets, ==, 1);
+  g_assert_true (g_variant_lookup (packets, "kdeconnect.pair", "(tttt)",
+                                   NULL, NULL, &tx_packets, &tx_bytes));
+  g_assert_cmpuint (tx_packets, >=, 1);
+  g_assert_cmpuint (tx_bytes, >, 0);
+
+  /* The device sent two echoes: the plugin's reply and the serialized packet.
+   * Both were written before the pair packet, by the same writer thread. */
+  g_assert_true (g_variant_lookup (packets, "kdeconnect.mock.echo", "(tttt)",
+                                   NULL, NULL, &tx_packets, &tx_bytes));
+  g_assert_cmpuint (tx_packets, ==, 2);
+  g_assert_cmpuint (tx_bytes, >, g_bytes_get_size (echo_bytes));
+
+  handlers = g_variant_lookup_value (metrics, "handlers", G_VARIANT_TYPE ("a{s(tttat)}"));
+  g_assert_nonnull (handlers);
+  g_assert_cmpuint (g_variant_n_children (handlers), >=, 1);
+  g_variant_get_child (handlers, 0, "{&s(tttat)}",
+                       NULL, &n_calls, &total_time, &max_time, &buckets);
+  g_assert_cmpuint (n_calls, >=, 1);
+  g_assert_cmpuint (max_time, <=, total_time);
+
+  while (g_variant_iter_next (buckets, "t", &bucket))
+    n_bucketed += bucket;
+  g_variant_iter_free (buckets);
+  g_assert_cmpuint (n_bucketed, ==, n_calls);
+
+  VALENT_TEST_CHECK ("Device counts the latency of sent packets by priority");
+  latency = g_variant_lookup_value (metrics, "latency", G_VARIANT_TYPE ("a{s(tttat)}"));
+  g_assert_nonnull (latency);
+  g_assert_true (g_variant_lookup (latency, "interactive", "(tttat)",
+                                   &n_calls, &total_time, &max_time, NULL));
+  g_assert_cmpuint (n_calls, >=, 1);
+  g_assert_cmpuint (max_time, <=, total_time);
+  g_assert_true (g_variant_lookup (latency, "state", "(tttat)",
+                                   &n_calls, NULL, NULL, NULL));
+  g_assert_cmpuint (n_calls, >=, 1);
+}
+
+#define STREAM_N_ITEMS (1000)
+
+static uint64_t
+device_get_handler_calls (ValentDevice *device,
+                          const char   *name)
+{
+  g_autoptr (GVariant) metrics = NULL;
+  g_autoptr (GVariant) handlers = NULL;
+  uint64_t n_calls = 0;
+
+  metrics = g_variant_ref_sink (valent_device_dup_metrics (device));
+  handlers = g_variant_lookup_value (metrics, "handlers", G_VARIANT_TYPE ("a{s(tttat)}"));
+
+  if (handlers != NULL)
+    g_variant_lookup (handlers, name, "(tttat)", &n_calls, NULL, NULL, NULL);
+
+  return n_calls;
+}
+
+static void
+test_device_stream_destroy (DeviceFixture *fixture,
+                            gconstpointer  user_data)
+{
+  GActionGroup *actions = G_ACTION_GROUP (fixture->device);
+  JsonNode *echo = get_packet (fixture, "test-echo");
+  g_autoptr (JsonBuilder) builder = NULL;
+  g_autoptr (JsonNode) packet = NULL;
+
+  valent_device_set_channel (fixture->device, fixture->channel);
+  valent_device_set_paired (fixture->device, TRUE);
+
+  /* The first read is queued before the plugins are active, so it is not
+   * streamed; the echo makes sure the next one is. */
+  valent_channel_write_packet (fixture->endpoint, echo, NULL, NULL, NULL);
+  endpoint_expect_packet_echo (fixture, echo);
+  g_assert_cmpuint (device_get_handler_calls (fixture->device, "ValentMockDevicePlugin"), ==, 1);
+
+  VALENT_TEST_CHECK ("Device passes streamed packets to the plugin");
+  valent_packet_init (&builder, "kdeconnect.mock.stream");
+  json_builder_set_member_name (builder, "items");
+  json_builder_begin_array (builder);
+  for (unsigned int i = 0; i < STREAM_N_ITEMS; i++)
+    json_builder_add_int_value (builder, i);
+  json_builder_end_array (builder);
+  packet = valent_packet_end (&builder);
+
+  valent_channel_write_packet (fixture->endpoint, packet, NULL, NULL, NULL);
+
+  while (device_get_handler_calls (fixture->device, "ValentMockDevicePlugin") < 2)
+    g_main_context_iteration (NULL, FALSE);
+
+  /* The plugin never reads from the stream, so the channel is now blocked
+   * mid-packet, until the plugin is destroyed. */
+  VALENT_TEST_CHECK ("Destroying a plugin mid-packet unblocks the channel");
+  toggle_plugin ("mock", fixture->device);
+
+  while (g_action_group_has_action (actions, "mock.state"))
+    g_main_context_iteration (NULL, FALSE);
+
+  toggle_plugin ("mock", fixture->device);
+
+  while (!g_action_group_has_action (actions, "mock.state"))
+    g_main_context_iteration (NULL, FALSE);
+
+  valent_channel_write_packet (fixture->endpoint, echo, NULL, NULL, NULL);
+  endpoint_expect_packet_echo (fixture, echo);
+
+  valent_device_set_channel (fixture->device, NULL);
+}
+
+#define PERF_N_DEVICES (500)
+#define PERF_N_RELOADS (100)
+
+static void
+test_device_plugins_perf (void)
+{
+  g_autoptr (JsonNode) packets = NULL;
+  g_autoptr (GPtrArray) devices = NULL;
+  g_autoptr (GPtrArray) channels = NULL;
+  g_autoptr (GPtrArray) endpoints = NULL;
+  ValentDevice *device;
+  JsonNode *identity;
+  int64_t begin_time, end_time;
+  double elapsed_ms;
+
+  if (!g_test_perf ())
+    {
+      g_test_skip ("Performance tests disabled");
+      return;
+    }
+
+  packets = valent_test_load_json ("core.json");
+  identity = json_object_get_member (json_node_get_object (packets), "identity");
+  devices = g_ptr_array_new_with_free_func (g_object_unref);
+
+  /* Each device checks every available plugin against its identity */
+  begin_time = g_get_monotonic_time ();
+
+  for (unsigned int i = 0; i < PERF_N_DEVICES; i++)
+    g_ptr_array_add (devices, valent_device_new_full (identity, NULL));
+
+  end_time = g_get_monotonic_time ();
+  elapsed_ms = (double)(end_time - begin_time) / 1000.0;
+
+  g_test_minimized_result (elapsed_ms / PERF_N_DEVICES,
+                           "Device construction: %.3f ms per device (%u devices)",
+                           elapsed_ms / PERF_N_DEVICES,
+                           PERF_N_DEVICES);
+
+  /* Each new channel makes the device handle the peer identity and recheck
+   * every plugin. The plugins are already loaded, so this isolates the
+   * eligibility checks from device construction and plugin loading. */
+  device = g_ptr_array_index (devices, 0);
+  channels = g_ptr_array_new_with_free_func (g_object_unref);
+  endpoints = g_ptr_array_new_with_free_func (g_object_unref);
+
+  for (unsigned int i = 0; i < PERF_N_RELOADS; i++)
+    {
+      g_autofree ValentChannel **pair = NULL;
+
+      pair = valent_test_channel_pair (identity, identity);
+      g_ptr_array_add (channels, g_steal_pointer (&pair[0]));
+      g_ptr_array_add (endpoints, g_steal_pointer (&pair[1]));
+    }
+
+  begin_time = g_get_monotonic_time ();
+
+  for (unsigned int i = 0; i < PERF_N_RELOADS; i++)
+    valent_device_set_channel (device, g_ptr_array_index (channels, i));
+
+  end_time = g_get_monotonic_time ();
+  elapsed_ms = (double)(end_time - begin_time) / 1000.0;
+
+  g_test_minimized_result (elapsed_ms / PERF_N_RELOADS,
+                           "Plugin reload: %.3f ms per identity (%u identities)",
+                           elapsed_ms / PERF_N_RELOADS,
+                           PERF_N_RELOADS);
+
+  valent_device_set_channel (device, NULL);
+
+  for (unsigned int i = 0; i < endpoints->len; i++)
+    valent_channel_close (g_ptr_array_index (endpoints, i), NULL, NULL);
+}
+
 int
 main (int   argc,
       char *argv[])
@@ -670,6 +1082,30 @@ main (int   argc,
               test_device_plugins,
               device_fixture_tear_down);
 
+  g_test_add ("/libvalent/device/device/dormant",
+              DeviceFixture, NULL,
+              device_fixture_set_up,
+              test_device_dormant,
+              device_fixture_tear_down);
+
+  g_test_add ("/libvalent/device/device/dormant-hold",
+              DeviceFixture, NULL,
+              device_fixture_set_up,
+              test_device_dormant_hold,
+              device_fixture_tear_down);
+
+  g_test_add ("/libvalent/device/device/dormant-access",
+              DeviceFixture, NULL,
+              device_fixture_set_up,
+              test_device_dormant_access,
+              device_fixture_tear_down);
+
+  g_test_add ("/libvalent/device/device/dispatch",
+              DeviceFixture, NULL,
+              device_fixture_set_up,
+              test_device_dispatch,
+              device_fixture_tear_down);
+
   g_test_add ("/libvalent/device/device/handle-packet",
               DeviceFixture, NULL,
               device_fixture_set_up,
@@ -682,6 +1118,21 @@ main (int   argc,
               test_send_packet,
               device_fixture_tear_down);
 
+  g_test_add ("/libvalent/device/device/metrics",
+              DeviceFixture, NULL,
+              device_fixture_set_up,
+              test_device_metrics,
+              device_fixture_tear_down);
+
+  g_test_add ("/libvalent/device/device/stream-destroy",
+              DeviceFixture, NULL,
+              device_fixture_set_up,
+              test_device_stream_destroy,
+              device_fixture_tear_down);
+
+  g_test_add_func ("/libvalent/device/device/plugins-perf",
+                   test_device_plugins_perf);
+
   return g_test_run ();
 }
 
@@ -1,9 +1,14 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 // SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
 
+#include <string.h>
+
 #include <valent.h>
 #include <libvalent-test.h>
 
+#include "valent-packet-stream-private.h"
+#include "valent-packet-view.h"
+
 
 static const char *corrupt_packet =
   "{"
@@ -65,6 +70,10 @@ test_packet_builder (void)
   type = valent_packet_get_type (packet);
   g_assert_cmpstr (type, ==, "kdeconnect.mock");
 
+  /* Packet types are only resolved if interned locally */
+  g_assert_cmpuint (valent_packet_get_type_quark (packet), ==,
+                    g_quark_try_string ("kdeconnect.mock"));
+
   body = valent_packet_get_body (packet);
   g_assert_nonnull (body);
 }
@@ -293,6 +302,935 @@ test_packet_streaming (PacketFixture *fixture,
   g_clear_error (&error);
 }
 
+static void
+test_packet_view (PacketFixture *fixture,
+                  gconstpointer  user_data)
+{
+  g_autoptr (JsonBuilder) builder = NULL;
+  g_autoptr (JsonNode) packet = NULL;
+  g_autoptr (ValentPacketView) view = NULL;
+  g_autoptr (JsonNode) packet_out = NULL;
+  g_autoptr (GError) error = NULL;
+  JsonObjectIter iter;
+  JsonNode *packet_in;
+  char *packet_str = NULL;
+  gboolean boolean_value = FALSE;
+  double double_value = 0.0;
+  int64_t int_value = 0;
+  const char *string_value;
+
+  /* Valid packets */
+  json_object_iter_init (&iter, fixture->packets);
+
+  while (json_object_iter_next (&iter, NULL, &packet_in))
+    {
+      packet_str = valent_packet_serialize (packet_in);
+      view = valent_packet_view_new (packet_str, strlen (packet_str), &error);
+      g_assert_no_error (error);
+
+      g_assert_cmpstr (valent_packet_view_get_type (view), ==,
+                       valent_packet_get_type (packet_in));
+      g_assert_cmpint (valent_packet_view_get_id (view), ==,
+                       valent_packet_get_id (packet_in));
+      g_assert_true (valent_packet_view_has_payload (view) ==
+                     valent_packet_has_payload (packet_in));
+
+      packet_out = valent_packet_view_to_node (view);
+      g_assert_true (json_node_is_immutable (packet_out));
+      g_assert_true (json_node_equal (packet_in, packet_out));
+
+      g_clear_pointer (&packet_out, json_node_unref);
+      g_clear_pointer (&view, valent_packet_view_unref);
+    }
+
+  /* Large packets */
+  packet_str = json_to_string (fixture->large_node, FALSE);
+  view = valent_packet_view_new (packet_str, strlen (packet_str), &error);
+  g_assert_no_error (error);
+
+  packet_out = valent_packet_view_to_node (view);
+  g_assert_true (json_node_equal (fixture->large_node, packet_out));
+  g_assert_cmpuint (valent_packet_view_get_size (view), >, 0);
+  g_clear_pointer (&packet_out, json_node_unref);
+  g_clear_pointer (&view, valent_packet_view_unref);
+
+  /* Invalid packets */
+  json_object_iter_init (&iter, fixture->invalid_packets);
+
+  while (json_object_iter_next (&iter, NULL, &packet_in))
+    {
+      packet_str = json_to_string (packet_in, FALSE);
+      view = valent_packet_view_new (packet_str, strlen (packet_str), &error);
+      g_assert_null (view);
+      g_assert_nonnull (error);
+      g_clear_error (&error);
+    }
+
+  view = valent_packet_view_new (g_strdup (corrupt_packet),
+                                 strlen (corrupt_packet),
+                                 &error);
+  g_assert_error (error, JSON_PARSER_ERROR, JSON_PARSER_ERROR_MISSING_COMMA);
+  g_assert_null (view);
+  g_clear_error (&error);
+
+  view = valent_packet_view_new (g_strdup (""), 0, &error);
+  g_assert_error (error, VALENT_PACKET_ERROR, VALENT_PACKET_ERROR_INVALID_DATA);
+  g_assert_null (view);
+  g_clear_error (&error);
+
+  /* Field helpers */
+  valent_packet_init (&builder, "kdeconnect.mock");
+  json_builder_set_member_name (builder, "boolean");
+  json_builder_add_boolean_value (builder, TRUE);
+  json_builder_set_member_name (builder, "double");
+  json_builder_add_double_value (builder, 3.14);
+  json_builder_set_member_name (builder, "int");
+  json_builder_add_int_value (builder, 42);
+  json_builder_set_member_name (builder, "string");
+  json_builder_add_string_value (builder, "\"string\"\n\u00e9");
+  json_builder_set_member_name (builder, "empty");
+  json_builder_add_string_value (builder, "");
+  packet = valent_packet_end (&builder);
+
+  packet_str = valent_packet_serialize (packet);
+  view = valent_packet_view_new (packet_str, strlen (packet_str), &error);
+  g_assert_no_error (error);
+
+  g_assert_true (valent_packet_view_get_boolean (view, "boolean", &boolean_value));
+  g_assert_true (boolean_value);
+
+  g_assert_true (valent_packet_view_get_double (view, "double", &double_value));
+  g_assert_cmpfloat (double_value, ==, 3.14);
+
+  g_assert_true (valent_packet_view_get_int (view, "int", &int_value));
+  g_assert_cmpint (int_value, ==, 42);
+
+  g_assert_true (valent_packet_view_get_string (view, "string", &string_value));
+  g_assert_cmpstr (string_value, ==, "\"string\"\n\u00e9");
+
+  g_assert_false (valent_packet_view_get_string (view, "empty", NULL));
+  g_assert_false (valent_packet_view_get_int (view, "double", NULL));
+  g_assert_false (valent_packet_view_get_boolean (view, "missing", NULL));
+}
+
+/*
+ * Parse @json with both valent_packet_deserialize() and the packet view, and
+ * check they agree on whether it is a valid packet and what it contains.
+ */
+static void
+check_view_equivalence (const char *json,
+                        size_t      json_len)
+{
+  g_autoptr (JsonNode) packet = NULL;
+  g_autoptr (ValentPacketView) view = NULL;
+  g_autoptr (JsonNode) view_node = NULL;
+  g_autoptr (GError) packet_error = NULL;
+  g_autoptr (GError) view_error = NULL;
+
+  packet = valent_packet_deserialize (json, &packet_error);
+  view = valent_packet_view_new (g_strndup (json, json_len), json_len, &view_error);
+
+  /* json-glib accepts a document with no root, which is not a packet */
+  if (packet == NULL && packet_error == NULL)
+    {
+      g_assert_null (view);
+      return;
+    }
+
+  if (packet == NULL)
+    {
+      g_assert_null (view);
+      g_assert_nonnull (view_error);
+
+      /* Syntax errors are reported at different positions, but packets that
+       * are well-formed JSON must be rejected for the same reason */
+      g_assert_cmpuint (view_error->domain, ==, packet_error->domain);
+
+      if (packet_error->domain == VALENT_PACKET_ERROR)
+        g_assert_cmpint (view_error->code, ==, packet_error->code);
+
+      return;
+    }
+
+  g_assert_no_error (view_error);
+  g_assert_nonnull (view);
+
+  g_assert_cmpstr (valent_packet_view_get_type (view), ==,
+                   valent_packet_get_type (packet));
+  g_assert_cmpint (valent_packet_view_get_id (view), ==,
+                   valent_packet_get_id (packet));
+  g_assert_true (valent_packet_view_has_payload (view) ==
+                 valent_packet_has_payload (packet));
+
+  view_node = valent_packet_view_to_node (view);
+  g_assert_true (json_node_equal (packet, view_node));
+}
+
+/* Bytes substituted at each position of a packet, chosen to break or change
+ * the structure of the JSON rather than just the content of a string.
+ *
+ * Control characters are omitted, since json-glib accepts them unescaped in
+ * strings while the packet view does not. */
+static const char view_mutations[] = {
+  '"', '\\', '{', '}', '[', ']', ',', ':', '0', '-', 'e', 'n', ' ',
+  (char)0xc3, (char)0xff,
+};
+
+static void
+test_packet_view_fuzz (PacketFixture *fixture,
+                       gconstpointer  user_data)
+{
+  g_auto (GStrv) schemas = NULL;
+  JsonObjectIter iter;
+  JsonNode *packet_in;
+
+  g_test_log_set_fatal_handler (valent_test_mute_fuzzing, NULL);
+
+  VALENT_TEST_CHECK ("Packet view agrees with json-glib for mutated packets");
+  json_object_iter_init (&iter, fixture->packets);
+
+  while (json_object_iter_next (&iter, NULL, &packet_in))
+    {
+      g_autofree char *packet_str = NULL;
+      size_t packet_len;
+
+      packet_str = json_to_string (packet_in, FALSE);
+      packet_len = strlen (packet_str);
+
+      for (size_t i = 1; i < packet_len; i++)
+        {
+          g_autofree char *truncated = g_strndup (packet_str, i);
+
+          check_view_equivalence (truncated, i);
+        }
+
+      for (size_t i = 0; i < packet_len; i++)
+        {
+          char original = packet_str[i];
+
+          for (size_t m = 0; m < G_N_ELEMENTS (view_mutations); m++)
+            {
+              packet_str[i] = view_mutations[m];
+              check_view_equivalence (packet_str, packet_len);
+            }
+
+          packet_str[i] = original;
+        }
+    }
+
+  VALENT_TEST_CHECK ("Packet view agrees with json-glib for generated packets");
+  schemas = g_resources_enumerate_children ("/tests/",
+                                            G_RESOURCE_LOOKUP_FLAGS_NONE,
+                                            NULL);
+
+  for (unsigned int s = 0; schemas != NULL && schemas[s] != NULL; s++)
+    {
+      g_autofree char *path = NULL;
+      g_autoptr (GPtrArray) instances = NULL;
+
+      if (!g_str_has_prefix (schemas[s], "kdeconnect.") ||
+          !g_str_has_suffix (schemas[s], ".json"))
+        continue;
+
+      path = g_strconcat ("/tests/", schemas[s], NULL);
+      instances = valent_test_schema_instances (path);
+
+      for (unsigned int i = 0; i < instances->len; i++)
+        {
+          const char *json = g_ptr_array_index (instances, i);
+
+          check_view_equivalence (json, strlen (json));
+        }
+    }
+}
+
+#define STREAM_N_ITEMS (200)
+
+typedef struct
+{
+  GBufferedInputStream *input;
+  GHashTable           *fields;
+  ValentPacketStream   *stream;
+  gboolean              streamed;
+} StreamData;
+
+static void
+stream_data_free (gpointer data)
+{
+  StreamData *stream_data = data;
+
+  g_clear_object (&stream_data->input);
+  g_clear_pointer (&stream_data->fields, g_hash_table_unref);
+  g_clear_object (&stream_data->stream);
+  g_free (stream_data);
+}
+
+static void
+stream_func (ValentPacketStream *stream,
+             gpointer            user_data)
+{
+  StreamData *stream_data = user_data;
+
+  g_assert_true (VALENT_IS_PACKET_STREAM (stream));
+  stream_data->stream = g_object_ref (stream);
+}
+
+static void
+read_line_task (GTask        *task,
+                gpointer      source_object,
+                gpointer      task_data,
+                GCancellable *cancellable)
+{
+  StreamData *stream_data = task_data;
+  ValentPacketView *view = NULL;
+  size_t n_read = 0;
+  GError *error = NULL;
+
+  view = valent_packet_stream_read_line (stream_data->input,
+                                         stream_data->fields,
+                                         stream_func,
+                                         stream_data,
+                                         &n_read,
+                                         &stream_data->streamed,
+                                         cancellable,
+                                         &error);
+  if (view == NULL)
+    return g_task_return_error (task, error);
+
+  g_assert_cmpuint (n_read, >, 0);
+  g_task_return_pointer (task, view, (GDestroyNotify)valent_packet_view_unref);
+}
+
+static void
+read_line_cb (GObject      *object,
+              GAsyncResult *result,
+              gpointer      user_data)
+{
+  ValentPacketView **view = user_data;
+  GError *error = NULL;
+
+  *view = g_task_propagate_pointer (G_TASK (result), &error);
+  g_assert_no_error (error);
+}
+
+static void
+stream_read_cb (ValentPacketStream *stream,
+                GAsyncResult       *result,
+                gpointer            user_data)
+{
+  GPtrArray *elements = user_data;
+  g_autofree char *name = NULL;
+  JsonNode *element = NULL;
+  GError *error = NULL;
+
+  element = valent_packet_stream_read_finish (stream, result, &name, &error);
+  g_assert_no_error (error);
+
+  if (element != NULL)
+    {
+      g_ptr_array_add (elements, g_steal_pointer (&name));
+      g_ptr_array_add (elements, element);
+    }
+  else
+    {
+      g_ptr_array_add (elements, NULL);
+      g_ptr_array_add (elements, NULL);
+    }
+}
+
+/*
+ * Read every element from @stream, returning an array of name/element pairs.
+ */
+static GPtrArray *
+stream_read_all (ValentPacketStream *stream)
+{
+  g_autoptr (GPtrArray) elements = NULL;
+
+  elements = g_ptr_array_new ();
+
+  while (elements->len == 0 || g_ptr_array_index (elements, elements->len - 1))
+    {
+      unsigned int len = elements->len;
+
+      valent_packet_stream_read (stream,
+                                 NULL,
+                                 (GAsyncReadyCallback)stream_read_cb,
+                                 elements);
+
+      while (elements->len == len)
+        g_main_context_iteration (NULL, FALSE);
+    }
+
+  /* Drop the terminating pair */
+  g_ptr_array_set_size (elements, elements->len - 2);
+
+  return g_steal_pointer (&elements);
+}
+
+static ValentPacketView *
+stream_read_line (const char          *line,
+                  GHashTable          *fields,
+                  ValentPacketStream **stream,
+                  GPtrArray          **elements,
+                  gboolean            *streamed)
+{
+  g_autoptr (GInputStream) base = NULL;
+  g_autoptr (GTask) task = NULL;
+  ValentPacketView *view = NULL;
+  StreamData *stream_data;
+
+  base = g_memory_input_stream_new_from_data (g_strdup (line), -1, g_free);
+
+  stream_data = g_new0 (StreamData, 1);
+  stream_data->input = G_BUFFERED_INPUT_STREAM (g_buffered_input_stream_new (base));
+  stream_data->fields = fields ? g_hash_table_ref (fields) : NULL;
+
+  task = g_task_new (NULL, NULL, read_line_cb, &view);
+  g_task_set_task_data (task, stream_data, stream_data_free);
+  g_task_run_in_thread (task, read_line_task);
+
+  /* The reading thread blocks once the stream is full, so the stream has to
+   * be drained before the line can be completed. */
+  if (stream != NULL)
+    {
+      valent_test_await_pointer (&stream_data->stream);
+      *stream = g_object_ref (stream_data->stream);
+      *elements = stream_read_all (*stream);
+    }
+
+  valent_test_await_pointer (&view);
+  *streamed = stream_data->streamed;
+
+  return view;
+}
+
+static void
+test_packet_stream (PacketFixture *fixture,
+                    gconstpointer  user_data)
+{
+  g_autoptr (JsonBuilder) builder = NULL;
+  g_autoptr (JsonNode) packet = NULL;
+  g_autoptr (JsonNode) packet_out = NULL;
+  g_autoptr (GHashTable) fields = NULL;
+  g_autoptr (ValentPacketStream) stream = NULL;
+  g_autoptr (GPtrArray) elements = NULL;
+  ValentPacketView *view = NULL;
+  g_autofree char *line = NULL;
+  gboolean streamed = FALSE;
+  gboolean tail = FALSE;
+  JsonObject *body;
+  JsonArray *items;
+
+  valent_packet_init (&builder, "kdeconnect.mock.stream");
+  json_builder_set_member_name (builder, "items");
+  json_builder_begin_array (builder);
+  for (unsigned int i = 0; i < STREAM_N_ITEMS; i++)
+    json_builder_add_int_value (builder, i);
+  json_builder_end_array (builder);
+  json_builder_set_member_name (builder, "tail");
+  json_builder_add_boolean_value (builder, TRUE);
+  packet = valent_packet_end (&builder);
+  line = valent_packet_serialize (packet);
+
+  fields = g_hash_table_new (g_str_hash, g_str_equal);
+  g_hash_table_insert (fields, "kdeconnect.mock.stream", "items");
+
+  /* Streamed array elements, beyond the capacity of the stream */
+  VALENT_TEST_CHECK ("Packets are streamed when the type is registered");
+  view = stream_read_line (line, fields, &stream, &elements, &streamed);
+  g_assert_true (streamed);
+  g_assert_cmpstr (valent_packet_stream_get_packet_type (stream), ==, "kdeconnect.mock.stream");
+  g_assert_cmpstr (valent_packet_stream_get_field (stream), ==, "items");
+  g_assert_true (valent_packet_view_get_boolean (view, "tail", &tail));
+  g_assert_true (tail);
+  g_clear_pointer (&view, valent_packet_view_unref);
+
+  g_assert_cmpuint (elements->len, ==, STREAM_N_ITEMS * 2);
+
+  for (unsigned int i = 0; i < STREAM_N_ITEMS; i++)
+    {
+      JsonNode *element = g_ptr_array_index (elements, i * 2 + 1);
+
+      g_assert_null (g_ptr_array_index (elements, i * 2));
+      g_assert_cmpint (json_node_get_int (element), ==, i);
+      json_node_unref (element);
+    }
+  g_clear_pointer (&elements, g_ptr_array_unref);
+  g_clear_object (&stream);
+
+  /* Unregistered packets are read whole */
+  VALENT_TEST_CHECK ("Packets are buffered when the type is not registered");
+  view = stream_read_line (line, NULL, NULL, NULL, &streamed);
+  g_assert_false (streamed);
+  packet_out = valent_packet_view_to_node (view);
+  g_assert_true (json_node_equal (packet, packet_out));
+  g_clear_pointer (&packet_out, json_node_unref);
+  g_clear_pointer (&view, valent_packet_view_unref);
+
+  /* Body members */
+  VALENT_TEST_CHECK ("Packet bodies are streamed when the field is unset");
+  g_hash_table_insert (fields, "kdeconnect.mock.stream", NULL);
+  view = stream_read_line (line, fields, &stream, &elements, &streamed);
+  g_assert_true (streamed);
+  g_assert_null (valent_packet_stream_get_field (stream));
+  g_assert_cmpstr (valent_packet_view_get_type (view), ==, "kdeconnect.mock.stream");
+  g_clear_pointer (&view, valent_packet_view_unref);
+
+  g_assert_cmpuint (elements->len, ==, 4);
+  g_assert_cmpstr (g_ptr_array_index (elements, 0), ==, "items");
+  items = json_node_get_array (g_ptr_array_index (elements, 1));
+  g_assert_cmpuint (json_array_get_length (items), ==, STREAM_N_ITEMS);
+  g_assert_cmpstr (g_ptr_array_index (elements, 2), ==, "tail");
+  g_assert_true (json_node_get_boolean (g_ptr_array_index (elements, 3)));
+  for (unsigned int i = 0; i < elements->len; i += 2)
+    {
+      g_free (g_ptr_array_index (elements, i));
+      json_node_unref (g_ptr_array_index (elements, i + 1));
+    }
+  g_clear_pointer (&elements, g_ptr_array_unref);
+  g_clear_object (&stream);
+
+  /* Buffered packets */
+  VALENT_TEST_CHECK ("Buffered packets can be streamed");
+  stream = valent_packet_stream_new_for_packet (packet, "items");
+  elements = stream_read_all (stream);
+  body = valent_packet_get_body (packet);
+  items = json_object_get_array_member (body, "items");
+  g_assert_cmpuint (elements->len, ==, json_array_get_length (items) * 2);
+
+  for (unsigned int i = 0; i < STREAM_N_ITEMS; i++)
+    {
+      JsonNode *element = g_ptr_array_index (elements, i * 2 + 1);
+
+      g_assert_true (json_node_equal (element, json_array_get_element (items, i)));
+      json_node_unref (element);
+    }
+  g_clear_pointer (&elements, g_ptr_array_unref);
+  g_clear_object (&stream);
+}
+
+static void
+stream_read_closed_cb (ValentPacketStream *stream,
+                       GAsyncResult       *result,
+                       gboolean           *done)
+{
+  g_autoptr (GError) error = NULL;
+  JsonNode *element = NULL;
+
+  element = valent_packet_stream_read_finish (stream, result, NULL, &error);
+  g_assert_null (element);
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CLOSED);
+
+  *done = TRUE;
+}
+
+/*
+ * Read @line in a thread, then close or finalize the stream after reading the
+ * first element, while the reading thread is blocked on the full stream.
+ */
+static ValentPacketView *
+stream_read_line_close (const char *line,
+                        GHashTable *fields,
+                        gboolean    finalize,
+                        gboolean   *streamed)
+{
+  g_autoptr (GInputStream) base = NULL;
+  g_autoptr (GTask) task = NULL;
+  g_autoptr (GPtrArray) elements = NULL;
+  ValentPacketView *view = NULL;
+  StreamData *stream_data;
+
+  base = g_memory_input_stream_new_from_data (g_strdup (line), -1, g_free);
+
+  stream_data = g_new0 (StreamData, 1);
+  stream_data->input = G_BUFFERED_INPUT_STREAM (g_buffered_input_stream_new (base));
+  stream_data->fields = g_hash_table_ref (fields);
+
+  task = g_task_new (NULL, NULL, read_line_cb, &view);
+  g_task_set_task_data (task, stream_data, stream_data_free);
+  g_task_run_in_thread (task, read_line_task);
+  valent_test_await_pointer (&stream_data->stream);
+
+  elements = g_ptr_array_new ();
+  valent_packet_stream_read (stream_data->stream,
+                             NULL,
+                             (GAsyncReadyCallback)stream_read_cb,
+                             elements);
+
+  while (elements->len == 0)
+    g_main_context_iteration (NULL, FALSE);
+
+  g_assert_cmpint (json_node_get_int (g_ptr_array_index (elements, 1)), ==, 0);
+  json_node_unref (g_ptr_array_index (elements, 1));
+
+  if (finalize)
+    {
+      ValentPacketStream *stream = g_steal_pointer (&stream_data->stream);
+
+      v_await_finalize_object (stream);
+    }
+  else
+    {
+      gboolean done = FALSE;
+
+      valent_packet_stream_close (stream_data->stream);
+      valent_packet_stream_read (stream_data->stream,
+                                 NULL,
+                                 (GAsyncReadyCallback)stream_read_closed_cb,
+                                 &done);
+      valent_test_await_boolean (&done);
+    }
+
+  valent_test_await_pointer (&view);
+  *streamed = stream_data->streamed;
+
+  return view;
+}
+
+static void
+test_packet_stream_close (PacketFixture *fixture,
+                          gconstpointer  user_data)
+{
+  g_autoptr (JsonBuilder) builder = NULL;
+  g_autoptr (JsonNode) packet = NULL;
+  g_autoptr (GHashTable) fields = NULL;
+  g_autofree char *line = NULL;
+  ValentPacketView *view = NULL;
+  gboolean streamed = FALSE;
+  gboolean tail = FALSE;
+
+  valent_packet_init (&builder, "kdeconnect.mock.stream");
+  json_builder_set_member_name (builder, "items");
+  json_builder_begin_array (builder);
+  for (unsigned int i = 0; i < STREAM_N_ITEMS; i++)
+    json_builder_add_int_value (builder, i);
+  json_builder_end_array (builder);
+  json_builder_set_member_name (builder, "tail");
+  json_builder_add_boolean_value (builder, TRUE);
+  packet = valent_packet_end (&builder);
+  line = valent_packet_serialize (packet);
+
+  fields = g_hash_table_new (g_str_hash, g_str_equal);
+  g_hash_table_insert (fields, "kdeconnect.mock.stream", "items");
+
+  VALENT_TEST_CHECK ("Closing a stream mid-packet unblocks the reader");
+  view = stream_read_line_close (line, fields, FALSE, &streamed);
+  g_assert_true (streamed);
+  g_assert_true (valent_packet_view_get_boolean (view, "tail", &tail));
+  g_assert_true (tail);
+  g_clear_pointer (&view, valent_packet_view_unref);
+
+  VALENT_TEST_CHECK ("Finalizing a stream mid-packet unblocks the reader");
+  tail = FALSE;
+  view = stream_read_line_close (line, fields, TRUE, &streamed);
+  g_assert_true (streamed);
+  g_assert_true (valent_packet_view_get_boolean (view, "tail", &tail));
+  g_assert_true (tail);
+  g_clear_pointer (&view, valent_packet_view_unref);
+}
+
+/*
+ * The reading thread blocks once the stream is full, so fuzzed lines are only
+ * read if every element is sure to fit in the stream without a consumer.
+ */
+#define STREAM_FUZZ_MAX_COMMAS (32)
+
+typedef struct
+{
+  GPtrArray *names;
+  GPtrArray *nodes;
+  GError    *error;
+  gboolean   pending;
+  gboolean   finished;
+} StreamDrain;
+
+static void
+stream_drain_cb (ValentPacketStream *stream,
+                 GAsyncResult       *result,
+                 gpointer            user_data)
+{
+  StreamDrain *drain = user_data;
+  g_autofree char *name = NULL;
+  JsonNode *element = NULL;
+
+  element = valent_packet_stream_read_finish (stream,
+                                              result,
+                                              &name,
+                                              &drain->error);
+
+  if (element != NULL)
+    {
+      g_ptr_array_add (drain->names, g_steal_pointer (&name));
+      g_ptr_array_add (drain->nodes, element);
+    }
+  else
+    {
+      drain->finished = TRUE;
+    }
+
+  drain->pending = FALSE;
+}
+
+static JsonNode *
+packet_thaw (JsonNode *node)
+{
+  g_autoptr (JsonParser) parser = NULL;
+  g_autofree char *json = NULL;
+  GError *error = NULL;
+
+  json = json_to_string (node, FALSE);
+  parser = json_parser_new ();
+  json_parser_load_from_data (parser, json, -1, &error);
+  g_assert_no_error (error);
+  json_node_unref (node);
+
+  return json_parser_steal_root (parser);
+}
+
+static void
+stream_fuzz_func (ValentPacketStream *stream,
+                  gpointer            user_data)
+{
+  ValentPacketStream **stream_out = user_data;
+
+  g_assert_null (*stream_out);
+  *stream_out = g_object_ref (stream);
+}
+
+/*
+ * Read @json with valent_packet_stream_read_line(), and check the result
+ * agrees with valent_packet_deserialize(): invalid packets must fail and end
+ * any stream with an error, while valid packets must be reassembled from the
+ * view and the streamed elements.
+ */
+static void
+check_stream_equivalence (const char *json,
+                          size_t      json_len,
+                          GHashTable *fields)
+{
+  g_autofree char *line = NULL;
+  g_autoptr (JsonNode) packet = NULL;
+  g_autoptr (GError) packet_error = NULL;
+  g_autoptr (GInputStream) base = NULL;
+  g_autoptr (GInputStream) input = NULL;
+  g_autoptr (ValentPacketStream) stream = NULL;
+  g_autoptr (ValentPacketView) view = NULL;
+  g_autoptr (JsonNode) packet_out = NULL;
+  g_autoptr (GError) error = NULL;
+  StreamDrain drain = { 0, };
+  size_t n_read = 0;
+  gboolean streamed = FALSE;
+  unsigned int n_commas = 0;
+
+  /* Lines end at a newline, which json-glib treats as whitespace */
+  for (size_t i = 0; i < json_len; i++)
+    {
+      if (json[i] == '\n')
+        return;
+
+      if (json[i] == ',')
+        n_commas++;
+    }
+
+  if (n_commas > STREAM_FUZZ_MAX_COMMAS)
+    return;
+
+  /* json-glib accepts a document with no root, which is not a packet */
+  line = g_strndup (json, json_len);
+  packet = valent_packet_deserialize (line, &packet_error);
+
+  if (packet == NULL && packet_error == NULL)
+    return;
+
+  base = g_memory_input_stream_new_from_data (g_steal_pointer (&line),
+                                              json_len,
+                                              g_free);
+  input = g_buffered_input_stream_new (base);
+  view = valent_packet_stream_read_line (G_BUFFERED_INPUT_STREAM (input),
+                                         fields,
+                                         stream_fuzz_func,
+                                         &stream,
+                                         &n_read,
+                                         &streamed,
+                                         NULL,
+                                         &error);
+  g_assert_true (streamed == (stream != NULL));
+
+  if (stream != NULL)
+    {
+      drain.names = g_ptr_array_new_with_free_func (g_free);
+      drain.nodes = g_ptr_array_new_with_free_func ((GDestroyNotify)json_node_unref);
+
+      while (!drain.finished)
+        {
+          drain.pending = TRUE;
+          valent_packet_stream_read (stream,
+                                     NULL,
+                                     (GAsyncReadyCallback)stream_drain_cb,
+                                     &drain);
+
+          while (drain.pending)
+            g_main_context_iteration (NULL, FALSE);
+        }
+    }
+
+  if (packet == NULL)
+    {
+      g_assert_null (view);
+      g_assert_nonnull (error);
+
+      if (stream != NULL)
+        g_assert_nonnull (drain.error);
+    }
+  else
+    {
+      g_assert_no_error (error);
+      g_assert_nonnull (view);
+      g_assert_cmpuint (n_read, ==, json_len);
+
+      packet_out = valent_packet_view_to_node (view);
+
+      if (stream != NULL)
+        {
+          const char *field = valent_packet_stream_get_field (stream);
+          JsonObject *body = NULL;
+          JsonNode *container = NULL;
+
+          g_assert_no_error (drain.error);
+
+          /* The view is sealed, so parse a copy that can be modified */
+          packet_out = packet_thaw (packet_out);
+          body = valent_packet_get_body (packet_out);
+
+          /* Put the streamed elements back where they were read from */
+          if (field != NULL)
+            container = json_object_get_member (body, field);
+
+          for (unsigned int i = 0; i < drain.nodes->len; i++)
+            {
+              const char *name = g_ptr_array_index (drain.names, i);
+              JsonNode *node = g_ptr_array_index (drain.nodes, i);
+
+              if (field == NULL)
+                json_object_set_member (body, name, json_node_ref (node));
+              else if (JSON_NODE_HOLDS_ARRAY (container))
+                json_array_add_element (json_node_get_array (container),
+                                        json_node_ref (node));
+              else if (JSON_NODE_HOLDS_OBJECT (container))
+                json_object_set_member (json_node_get_object (container),
+                                        name,
+                                        json_node_ref (node));
+              else
+                g_assert_not_reached ();
+            }
+        }
+
+      g_assert_true (json_node_equal (packet, packet_out));
+    }
+
+  g_clear_pointer (&drain.names, g_ptr_array_unref);
+  g_clear_pointer (&drain.nodes, g_ptr_array_unref);
+  g_clear_error (&drain.error);
+}
+
+static void
+test_packet_stream_fuzz (PacketFixture *fixture,
+                         gconstpointer  user_data)
+{
+  g_autoptr (JsonBuilder) builder = NULL;
+  g_autoptr (JsonNode) stream_packet = NULL;
+  g_autoptr (GHashTable) fields = NULL;
+  g_autoptr (GPtrArray) lines = NULL;
+  g_auto (GStrv) schemas = NULL;
+  JsonObjectIter iter;
+  JsonNode *packet_in;
+
+  g_test_log_set_fatal_handler (valent_test_mute_fuzzing, NULL);
+
+  /* Stream the body of every packet in the corpus, except the array field of
+   * a packet built for the purpose */
+  valent_packet_init (&builder, "kdeconnect.mock.stream");
+  json_builder_set_member_name (builder, "items");
+  json_builder_begin_array (builder);
+  for (unsigned int i = 0; i < 8; i++)
+    json_builder_add_int_value (builder, i);
+  json_builder_end_array (builder);
+  json_builder_set_member_name (builder, "tail");
+  json_builder_add_boolean_value (builder, TRUE);
+  stream_packet = valent_packet_end (&builder);
+
+  fields = g_hash_table_new (g_str_hash, g_str_equal);
+  g_hash_table_insert (fields, "kdeconnect.mock.stream", "items");
+
+  lines = g_ptr_array_new_with_free_func (g_free);
+  g_ptr_array_add (lines, json_to_string (stream_packet, FALSE));
+  json_object_iter_init (&iter, fixture->packets);
+
+  while (json_object_iter_next (&iter, NULL, &packet_in))
+    {
+      const char *type = valent_packet_get_type (packet_in);
+
+      if (!g_hash_table_contains (fields, type))
+        g_hash_table_insert (fields, (char *)type, NULL);
+
+      g_ptr_array_add (lines, json_to_string (packet_in, FALSE));
+    }
+
+  VALENT_TEST_CHECK ("Packet streams agree with json-glib for mutated packets");
+  for (unsigned int l = 0; l < lines->len; l++)
+    {
+      char *line = g_ptr_array_index (lines, l);
+      size_t line_len = strlen (line);
+
+      for (size_t i = 1; i < line_len; i++)
+        check_stream_equivalence (line, i, fields);
+
+      for (size_t i = 0; i < line_len; i++)
+        {
+          char original = line[i];
+
+          for (size_t m = 0; m < G_N_ELEMENTS (view_mutations); m++)
+            {
+              line[i] = view_mutations[m];
+              check_stream_equivalence (line, line_len, fields);
+            }
+
+          line[i] = original;
+        }
+    }
+
+  VALENT_TEST_CHECK ("Packet streams agree with json-glib for generated packets");
+  schemas = g_resources_enumerate_children ("/tests/",
+                                            G_RESOURCE_LOOKUP_FLAGS_NONE,
+                                            NULL);
+
+  for (unsigned int s = 0; schemas != NULL && schemas[s] != NULL; s++)
+    {
+      g_autoptr (GHashTable) schema_fields = NULL;
+      g_autofree char *path = NULL;
+      g_autofree char *type = NULL;
+      g_autoptr (GPtrArray) instances = NULL;
+
+      if (!g_str_has_prefix (schemas[s], "kdeconnect.") ||
+          !g_str_has_suffix (schemas[s], ".json"))
+        continue;
+
+      path = g_strconcat ("/tests/", schemas[s], NULL);
+      type = g_strndup (schemas[s], strlen (schemas[s]) - strlen (".json"));
+      instances = valent_test_schema_instances (path);
+
+      schema_fields = g_hash_table_new (g_str_hash, g_str_equal);
+      g_hash_table_insert (schema_fields, type, NULL);
+
+      for (unsigned int i = 0; i < instances->len; i++)
+        {
+          const char *json = g_ptr_array_index (instances, i);
+
+          check_stream_equivalence (json, strlen (json), schema_fields);
+        }
+    }
+}
+
 int
 main (int   argc,
       char *argv[])
@@ -326,5 +1264,35 @@ main (int   argc,
               test_packet_streaming,
               packet_fixture_tear_down);
 
+  g_test_add ("/libvalent/device/packet/view",
+              PacketFixture, NULL,
+              packet_fixture_set_up,
+              test_packet_view,
+              packet_fixture_tear_down);
+
+  g_test_add ("/libvalent/device/packet/view-fuzz",
+              PacketFixture, NULL,
+              packet_fixture_set_up,
+              test_packet_view_fuzz,
+              packet_fixture_tear_down);
+
+  g_test_add ("/libvalent/device/packet/stream",
+              PacketFixture, NULL,
+              packet_fixture_set_up,
+              test_packet_stream,
+              packet_fixture_tear_down);
+
+  g_test_add ("/libvalent/device/packet/stream-close",
+              PacketFixture, NULL,
+              packet_fixture_set_up,
+              test_packet_stream_close,
+              packet_fixture_tear_down);
+
+  g_test_add ("/libvalent/device/packet/stream-fuzz",
+              PacketFixture, NULL,
+              packet_fixture_set_up,
+              test_packet_stream_fuzz,
+              packet_fixture_tear_down);
+
   return g_test_run ();
 }
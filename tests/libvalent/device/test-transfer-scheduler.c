@@ -0,0 +1,390 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#include <gio/gio.h>
+#include <valent.h>
+#include <libvalent-test.h>
+
+#include "valent-transfer-scheduler.h"
+
+#define TEST_DEVICE_A "test-device-a"
+#define TEST_DEVICE_B "test-device-b"
+
+
+typedef struct
+{
+  ValentTransferScheduler *scheduler;
+  GCancellable            *cancellable;
+  const char              *device_id;
+  size_t                   n_bytes;
+  gboolean                 bulk;
+
+  GMutex                  *mutex;
+  GPtrArray               *order;
+  gboolean                 done;
+} AcquireData;
+
+static gpointer
+acquire_thread (gpointer user_data)
+{
+  AcquireData *data = user_data;
+  GError *error = NULL;
+  gboolean ret;
+
+  ret = valent_transfer_scheduler_acquire (data->scheduler,
+                                           data->device_id,
+                                           data->n_bytes,
+                                           data->bulk,
+                                           data->cancellable,
+                                           &error);
+
+  if (data->order != NULL)
+    {
+      g_mutex_lock (data->mutex);
+      g_ptr_array_add (data->order, data);
+      g_mutex_unlock (data->mutex);
+    }
+
+  g_atomic_int_set (&data->done, TRUE);
+
+  if (!ret)
+    return error;
+
+  return NULL;
+}
+
+/*
+ * Wait for the number of waiting and paused transfers, which only changes when
+ * a transfer starts waiting or continues.
+ */
+static void
+await_waiting (ValentTransferScheduler *scheduler,
+               unsigned int             n_waiting,
+               unsigned int             n_paused)
+{
+  unsigned int paused = 0;
+
+  while (valent_transfer_scheduler_get_n_waiting (scheduler, &paused) != n_waiting ||
+         paused != n_paused)
+    g_thread_yield ();
+}
+
+static void
+await_order (AcquireData *data,
+             unsigned int n_granted)
+{
+  unsigned int len = 0;
+
+  while (len < n_granted)
+    {
+      g_mutex_lock (data->mutex);
+      len = data->order->len;
+      g_mutex_unlock (data->mutex);
+      g_thread_yield ();
+    }
+}
+
+static void
+test_transfer_scheduler_rate_limit (void)
+{
+  g_autoptr (ValentTransferScheduler) scheduler = NULL;
+  g_autoptr (GError) error = NULL;
+  AcquireData data;
+  GThread *thread;
+  gboolean ret;
+
+  /* The time only advances when set, so each wait is exactly accounted for */
+  scheduler = valent_transfer_scheduler_new (NULL);
+  valent_transfer_scheduler_set_time (scheduler, 0);
+
+  VALENT_TEST_CHECK ("Transfers are granted immediately without a limit");
+  ret = valent_transfer_scheduler_acquire (scheduler, TEST_DEVICE_A,
+                                           4 * 1024 * 1024, FALSE,
+                                           NULL, &error);
+  g_assert_no_error (error);
+  g_assert_true (ret);
+  g_assert_cmpuint (valent_transfer_scheduler_get_n_waiting (scheduler, NULL), ==, 0);
+
+  VALENT_TEST_CHECK ("Transfers wait until the device's bucket is out of debt");
+  valent_transfer_scheduler_set_rate_limit (scheduler, TEST_DEVICE_A, 1024 * 1024);
+  ret = valent_transfer_scheduler_acquire (scheduler, TEST_DEVICE_A,
+                                           256 * 1024, FALSE,
+                                           NULL, &error);
+  g_assert_no_error (error);
+  g_assert_true (ret);
+
+  data = (AcquireData){
+    .scheduler = scheduler,
+    .device_id = TEST_DEVICE_A,
+    .n_bytes = 1,
+  };
+  thread = g_thread_new ("acquire", acquire_thread, &data);
+  await_waiting (scheduler, 1, 0);
+
+  /* 256KiB at 1MiB/s takes 250ms to pay back */
+  valent_transfer_scheduler_set_time (scheduler, 249 * G_TIME_SPAN_MILLISECOND);
+  g_assert_false (g_atomic_int_get (&data.done));
+  g_assert_cmpuint (valent_transfer_scheduler_get_n_waiting (scheduler, NULL), ==, 1);
+
+  valent_transfer_scheduler_set_time (scheduler, 250 * G_TIME_SPAN_MILLISECOND);
+  g_assert_null (g_thread_join (thread));
+  g_assert_true (data.done);
+
+  VALENT_TEST_CHECK ("The global limit applies to all devices");
+  valent_transfer_scheduler_set_rate_limit (scheduler, TEST_DEVICE_A, 0);
+  valent_transfer_scheduler_set_rate_limit (scheduler, NULL, 1024 * 1024);
+  ret = valent_transfer_scheduler_acquire (scheduler, TEST_DEVICE_A,
+                                           256 * 1024, FALSE,
+                                           NULL, &error);
+  g_assert_no_error (error);
+  g_assert_true (ret);
+
+  data = (AcquireData){
+    .scheduler = scheduler,
+    .device_id = TEST_DEVICE_B,
+    .n_bytes = 1,
+  };
+  thread = g_thread_new ("acquire", acquire_thread, &data);
+  await_waiting (scheduler, 1, 0);
+  g_assert_false (g_atomic_int_get (&data.done));
+
+  valent_transfer_scheduler_set_time (scheduler, 500 * G_TIME_SPAN_MILLISECOND);
+  g_assert_null (g_thread_join (thread));
+  g_assert_true (data.done);
+}
+
+static void
+test_transfer_scheduler_fairness (void)
+{
+  g_autoptr (ValentTransferScheduler) scheduler = NULL;
+  g_autoptr (GPtrArray) order = NULL;
+  GMutex mutex;
+  AcquireData data[3];
+  GThread *threads[3];
+  const char *device_ids[3] = { TEST_DEVICE_A, TEST_DEVICE_A, TEST_DEVICE_B };
+  int64_t now = 0;
+  g_autoptr (GError) error = NULL;
+  gboolean ret;
+
+  g_mutex_init (&mutex);
+  order = g_ptr_array_new ();
+  scheduler = valent_transfer_scheduler_new (NULL);
+  valent_transfer_scheduler_set_time (scheduler, now);
+  valent_transfer_scheduler_set_rate_limit (scheduler, NULL, 1024 * 1024);
+
+  /* Put the global bucket in debt, so the transfers below queue up */
+  ret = valent_transfer_scheduler_acquire (scheduler, TEST_DEVICE_A,
+                                           512 * 1024, FALSE,
+                                           NULL, &error);
+  g_assert_no_error (error);
+  g_assert_true (ret);
+
+  VALENT_TEST_CHECK ("Devices take turns, regardless of the order transfers are queued");
+  for (unsigned int i = 0; i < G_N_ELEMENTS (data); i++)
+    {
+      data[i] = (AcquireData){
+        .scheduler = scheduler,
+        .device_id = device_ids[i],
+        .n_bytes = 64 * 1024,
+        .mutex = &mutex,
+        .order = order,
+      };
+      threads[i] = g_thread_new ("acquire", acquire_thread, &data[i]);
+      await_waiting (scheduler, i + 1, 0);
+    }
+
+  /* The debt is paid back at 500ms, then each 64KiB transfer puts the bucket
+   * in debt for another 62.5ms, so exactly one transfer continues each step */
+  now += 500 * G_TIME_SPAN_MILLISECOND;
+
+  for (unsigned int i = 0; i < G_N_ELEMENTS (data); i++)
+    {
+      valent_transfer_scheduler_set_time (scheduler, now);
+      await_order (&data[0], i + 1);
+      g_assert_cmpuint (valent_transfer_scheduler_get_n_waiting (scheduler, NULL), ==,
+                        G_N_ELEMENTS (data) - (i + 1));
+      now += 62500;
+    }
+
+  for (unsigned int i = 0; i < G_N_ELEMENTS (threads); i++)
+    g_assert_null (g_thread_join (threads[i]));
+
+  g_assert_cmpuint (order->len, ==, 3);
+  g_assert_true (g_ptr_array_index (order, 0) == &data[0]);
+  g_assert_true (g_ptr_array_index (order, 1) == &data[2]);
+  g_assert_true (g_ptr_array_index (order, 2) == &data[1]);
+
+  g_mutex_clear (&mutex);
+}
+
+static void
+test_transfer_scheduler_metered (void)
+{
+  g_autoptr (ValentTransferScheduler) scheduler = NULL;
+  g_autoptr (GCancellable) cancellable = NULL;
+  g_autoptr (GError) error = NULL;
+  AcquireData data;
+  GThread *thread;
+  gboolean ret;
+
+  scheduler = valent_transfer_scheduler_new (NULL);
+  valent_transfer_scheduler_set_time (scheduler, 0);
+  valent_transfer_scheduler_set_metered (scheduler, TRUE);
+
+  VALENT_TEST_CHECK ("Transfers are not paused by default");
+  ret = valent_transfer_scheduler_acquire (scheduler, TEST_DEVICE_A,
+                                           1024, TRUE,
+                                           NULL, &error);
+  g_assert_no_error (error);
+  g_assert_true (ret);
+
+  VALENT_TEST_CHECK ("Small transfers continue on a metered network");
+  valent_transfer_scheduler_set_pause_metered (scheduler, TRUE);
+  ret = valent_transfer_scheduler_acquire (scheduler, TEST_DEVICE_A,
+                                           1024, FALSE,
+                                           NULL, &error);
+  g_assert_no_error (error);
+  g_assert_true (ret);
+
+  VALENT_TEST_CHECK ("Bulk transfers wait until the network is no longer metered");
+  data = (AcquireData){
+    .scheduler = scheduler,
+    .device_id = TEST_DEVICE_A,
+    .n_bytes = 1024,
+    .bulk = TRUE,
+  };
+  thread = g_thread_new ("acquire", acquire_thread, &data);
+  await_waiting (scheduler, 1, 1);
+  g_assert_false (g_atomic_int_get (&data.done));
+
+  ret = valent_transfer_scheduler_acquire (scheduler, TEST_DEVICE_A,
+                                           1024, FALSE,
+                                           NULL, &error);
+  g_assert_no_error (error);
+  g_assert_true (ret);
+  g_assert_false (g_atomic_int_get (&data.done));
+
+  valent_transfer_scheduler_set_metered (scheduler, FALSE);
+  g_assert_null (g_thread_join (thread));
+  g_assert_true (data.done);
+
+  VALENT_TEST_CHECK ("Paused bulk transfers may be cancelled");
+  valent_transfer_scheduler_set_metered (scheduler, TRUE);
+  cancellable = g_cancellable_new ();
+  data = (AcquireData){
+    .scheduler = scheduler,
+    .cancellable = cancellable,
+    .device_id = TEST_DEVICE_A,
+    .n_bytes = 1024,
+    .bulk = TRUE,
+  };
+  thread = g_thread_new ("acquire", acquire_thread, &data);
+  await_waiting (scheduler, 1, 1);
+  g_assert_false (g_atomic_int_get (&data.done));
+
+  g_cancellable_cancel (cancellable);
+  error = g_thread_join (thread);
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+  g_clear_error (&error);
+
+  VALENT_TEST_CHECK ("Paused bulk transfers time out");
+  data = (AcquireData){
+    .scheduler = scheduler,
+    .device_id = TEST_DEVICE_A,
+    .n_bytes = 1024,
+    .bulk = TRUE,
+  };
+  thread = g_thread_new ("acquire", acquire_thread, &data);
+  await_waiting (scheduler, 1, 1);
+
+  valent_transfer_scheduler_set_time (scheduler, 10 * G_TIME_SPAN_MINUTE);
+  error = g_thread_join (thread);
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT);
+  g_clear_error (&error);
+  g_assert_cmpuint (valent_transfer_scheduler_get_n_waiting (scheduler, NULL), ==, 0);
+
+  VALENT_TEST_CHECK ("Pausing may be disabled");
+  valent_transfer_scheduler_set_pause_metered (scheduler, FALSE);
+  ret = valent_transfer_scheduler_acquire (scheduler, TEST_DEVICE_A,
+                                           1024, TRUE,
+                                           NULL, &error);
+  g_assert_no_error (error);
+  g_assert_true (ret);
+}
+
+static void
+test_transfer_scheduler_stream (void)
+{
+  g_autoptr (ValentTransferScheduler) scheduler = NULL;
+  g_autoptr (GInputStream) input = NULL;
+  g_autoptr (GOutputStream) output = NULL;
+  g_autoptr (GIOStream) base_stream = NULL;
+  g_autoptr (GIOStream) stream = NULL;
+  g_autoptr (GBytes) bytes = NULL;
+  g_autofree char *data = NULL;
+  size_t n_written, n_read;
+  char buffer[1024];
+  g_autoptr (GError) error = NULL;
+  gboolean ret;
+
+  data = g_strnfill (256 * 1024, 'v');
+  input = g_memory_input_stream_new_from_data (data, 256 * 1024, NULL);
+  output = g_memory_output_stream_new_resizable ();
+  base_stream = g_simple_io_stream_new (input, output);
+
+  scheduler = valent_transfer_scheduler_new (NULL);
+  valent_transfer_scheduler_set_rate_limit (scheduler, TEST_DEVICE_A, 1024 * 1024);
+  stream = valent_transfer_scheduler_wrap_stream (scheduler,
+                                                  base_stream,
+                                                  TEST_DEVICE_A,
+                                                  TRUE,
+                                                  NULL);
+
+  VALENT_TEST_CHECK ("Writes are split into slices");
+  ret = g_output_stream_write_all (g_io_stream_get_output_stream (stream),
+                                   data, 256 * 1024,
+                                   &n_written,
+                                   NULL,
+                                   &error);
+  g_assert_no_error (error);
+  g_assert_true (ret);
+  g_assert_cmpuint (n_written, ==, 256 * 1024);
+
+  VALENT_TEST_CHECK ("Reads are passed through");
+  ret = g_input_stream_read_all (g_io_stream_get_input_stream (stream),
+                                 buffer, sizeof (buffer),
+                                 &n_read,
+                                 NULL,
+                                 &error);
+  g_assert_no_error (error);
+  g_assert_true (ret);
+  g_assert_cmpuint (n_read, ==, sizeof (buffer));
+  g_assert_cmpint (buffer[0], ==, 'v');
+
+  VALENT_TEST_CHECK ("Closing the stream closes the base stream");
+  ret = g_io_stream_close (stream, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_true (ret);
+  g_assert_true (g_io_stream_is_closed (base_stream));
+
+  bytes = g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (output));
+  g_assert_cmpuint (g_bytes_get_size (bytes), ==, 256 * 1024);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  valent_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/libvalent/device/transfer-scheduler/rate-limit",
+                   test_transfer_scheduler_rate_limit);
+  g_test_add_func ("/libvalent/device/transfer-scheduler/fairness",
+                   test_transfer_scheduler_fairness);
+  g_test_add_func ("/libvalent/device/transfer-scheduler/metered",
+                   test_transfer_scheduler_metered);
+  g_test_add_func ("/libvalent/device/transfer-scheduler/stream",
+                   test_transfer_scheduler_stream);
+
+  return g_test_run ();
+}
@@ -71,6 +71,7 @@ test_input_component_self (InputComponentFixture *fixture,
 {
   /* Pointer Motion (relative) */
   valent_input_pointer_motion (fixture->input, 1.0, 1.0);
+  valent_test_await_timeout (50);
   valent_test_event_cmpstr ("POINTER MOTION 1.0 1.0");
 
   /* Pointer Scroll */
@@ -90,6 +91,131 @@ test_input_component_self (InputComponentFixture *fixture,
   valent_test_event_cmpstr ("KEYSYM 97 0");
 }
 
+static void
+test_input_component_batch (InputComponentFixture *fixture,
+                            gconstpointer          user_data)
+{
+  const ValentInputEvent events[] = {
+    { VALENT_INPUT_EVENT_POINTER_MOTION, 0, FALSE, 1.0, 1.0 },
+    { VALENT_INPUT_EVENT_POINTER_MOTION, 0, FALSE, 0.5, 2.0 },
+    { VALENT_INPUT_EVENT_POINTER_AXIS,   0, FALSE, 0.0, 1.0 },
+    { VALENT_INPUT_EVENT_POINTER_AXIS,   0, FALSE, 0.0, -1.0 },
+    { VALENT_INPUT_EVENT_KEYSYM,         0, TRUE,  0.0, 0.0 },
+    { VALENT_INPUT_EVENT_KEYSYM,       'a', TRUE,  0.0, 0.0 },
+    { VALENT_INPUT_EVENT_KEYSYM,       'a', FALSE, 0.0, 0.0 },
+    { VALENT_INPUT_EVENT_POINTER_BUTTON, VALENT_POINTER_PRIMARY, TRUE,  0.0, 0.0 },
+    { VALENT_INPUT_EVENT_POINTER_MOTION, 0, FALSE, 1.0, 0.0 },
+    { VALENT_INPUT_EVENT_POINTER_BUTTON, VALENT_POINTER_PRIMARY, FALSE, 0.0, 0.0 },
+  };
+
+  VALENT_TEST_CHECK ("Batches are submitted in order");
+  VALENT_TEST_CHECK ("Consecutive motion is coalesced");
+  VALENT_TEST_CHECK ("Empty keysyms and 0-delta motion are dropped");
+  valent_input_submit_events (fixture->input, events, G_N_ELEMENTS (events));
+  valent_test_event_cmpstr ("POINTER MOTION 1.5 3.0");
+  valent_test_event_cmpstr ("KEYSYM 97 1");
+  valent_test_event_cmpstr ("KEYSYM 97 0");
+  valent_test_event_cmpstr ("POINTER BUTTON 1 1");
+  valent_test_event_cmpstr ("POINTER MOTION 1.0 0.0");
+  valent_test_event_cmpstr ("POINTER BUTTON 1 0");
+  valent_test_event_cmpstr (NULL);
+}
+
+static void
+test_input_component_motion (InputComponentFixture *fixture,
+                             gconstpointer          user_data)
+{
+  g_autoptr (GSettings) settings = NULL;
+  double acceleration = 0.0;
+
+  VALENT_TEST_CHECK ("Motion is flushed before other events");
+  valent_input_pointer_motion (fixture->input, 1.0, 0.0);
+  valent_input_pointer_button (fixture->input, VALENT_POINTER_PRIMARY, TRUE);
+  valent_test_event_cmpstr ("POINTER MOTION 1.0 0.0");
+  valent_test_event_cmpstr ("POINTER BUTTON 1 1");
+  valent_input_pointer_button (fixture->input, VALENT_POINTER_PRIMARY, FALSE);
+  valent_test_event_cmpstr ("POINTER BUTTON 1 0");
+
+  VALENT_TEST_CHECK ("Motion is coalesced until the next tick");
+  for (unsigned int i = 0; i < 4; i++)
+    valent_input_pointer_motion (fixture->input, 0.25, 0.5);
+  valent_test_event_cmpstr (NULL);
+  valent_test_await_timeout (50);
+  valent_test_event_cmpstr ("POINTER MOTION 1.0 2.0");
+  valent_test_event_cmpstr (NULL);
+
+  VALENT_TEST_CHECK ("Sub-pixel motion is accumulated");
+  valent_input_pointer_motion (fixture->input, 0.4, 0.0);
+  valent_test_await_timeout (50);
+  valent_test_event_cmpstr (NULL);
+  valent_input_pointer_motion (fixture->input, 0.4, 0.0);
+  valent_test_await_timeout (50);
+  valent_test_event_cmpstr ("POINTER MOTION 1.0 0.0");
+
+  VALENT_TEST_CHECK ("Motion is sent immediately without an interval");
+  g_object_set (fixture->input, "motion-interval", 0, NULL);
+  valent_input_pointer_motion (fixture->input, 2.0, 2.0);
+  valent_test_event_cmpstr ("POINTER MOTION 2.0 2.0");
+
+  VALENT_TEST_CHECK ("Motion is accelerated up to a maximum velocity");
+  g_object_set (fixture->input, "pointer-acceleration", 1.0, NULL);
+  valent_input_pointer_motion (fixture->input, 400.0, 0.0);
+  valent_test_event_cmpstr ("POINTER MOTION 2000.0 0.0");
+  valent_test_event_cmpstr (NULL);
+
+  VALENT_TEST_CHECK ("Acceleration follows the `pointer-acceleration` setting");
+  settings = g_settings_new ("ca.andyholmes.Valent");
+  g_settings_set_double (settings, "pointer-acceleration", 0.5);
+  g_object_get (fixture->input, "pointer-acceleration", &acceleration, NULL);
+  g_assert_cmpfloat_with_epsilon (acceleration, 0.5, 0.001);
+  g_settings_reset (settings, "pointer-acceleration");
+  g_object_get (fixture->input, "pointer-acceleration", &acceleration, NULL);
+  g_assert_cmpfloat_with_epsilon (acceleration, 0.0, 0.001);
+}
+
+#define PERF_N_KEYSYMS (10000)
+
+static void
+test_input_component_batch_perf (InputComponentFixture *fixture,
+                                 gconstpointer          user_data)
+{
+  g_autofree ValentInputEvent *events = NULL;
+  int64_t begin_time, end_time;
+  double single_us, batch_us;
+
+  if (!g_test_perf ())
+    {
+      g_test_skip ("Performance tests disabled");
+      return;
+    }
+
+  events = g_new0 (ValentInputEvent, PERF_N_KEYSYMS);
+
+  for (unsigned int i = 0; i < PERF_N_KEYSYMS; i++)
+    {
+      events[i].type = VALENT_INPUT_EVENT_KEYSYM;
+      events[i].code = 'a' + (i / 2) % 26;
+      events[i].state = (i % 2) == 0;
+    }
+
+  begin_time = g_get_monotonic_time ();
+  for (unsigned int i = 0; i < PERF_N_KEYSYMS; i++)
+    valent_input_keyboard_keysym (fixture->input, events[i].code, events[i].state);
+  end_time = g_get_monotonic_time ();
+  single_us = (double)(end_time - begin_time) / PERF_N_KEYSYMS;
+  valent_test_event_free (g_free);
+
+  begin_time = g_get_monotonic_time ();
+  valent_input_submit_events (fixture->input, events, PERF_N_KEYSYMS);
+  end_time = g_get_monotonic_time ();
+  batch_us = (double)(end_time - begin_time) / PERF_N_KEYSYMS;
+  valent_test_event_free (g_free);
+
+  g_test_message ("Per-event latency: %.3fµs (single), %.3fµs (batch)",
+                  single_us, batch_us);
+  g_test_minimized_result (batch_us, "Batched keysym latency: %.3fµs", batch_us);
+}
+
 int
 main (int   argc,
       char *argv[])
@@ -108,5 +234,23 @@ main (int   argc,
               test_input_component_self,
               input_component_fixture_tear_down);
 
+  g_test_add ("/libvalent/input/motion",
+              InputComponentFixture, NULL,
+              input_component_fixture_set_up,
+              test_input_component_motion,
+              input_component_fixture_tear_down);
+
+  g_test_add ("/libvalent/input/batch",
+              InputComponentFixture, NULL,
+              input_component_fixture_set_up,
+              test_input_component_batch,
+              input_component_fixture_tear_down);
+
+  g_test_add ("/libvalent/input/batch-perf",
+              InputComponentFixture, NULL,
+              input_component_fixture_set_up,
+              test_input_component_batch_perf,
+              input_component_fixture_tear_down);
+
   return g_test_run ();
 }
@@ -107,6 +107,7 @@ test_clipboard_plugin_send_content (ValentTestFixture *fixture,
                                     gconstpointer      user_data)
 {
   JsonNode *packet;
+  g_autofree char *large = NULL;
 
   g_settings_set_boolean (fixture->settings, "auto-pull", TRUE);
   g_settings_set_boolean (fixture->settings, "auto-push", TRUE);
@@ -129,6 +130,63 @@ test_clipboard_plugin_send_content (ValentTestFixture *fixture,
   v_assert_packet_type (packet, "kdeconnect.clipboard");
   v_assert_packet_cmpstr (packet, "content", ==, "send-content");
   json_node_unref (packet);
+
+  VALENT_TEST_CHECK ("Plugin sends only the last of several rapid changes");
+  valent_clipboard_write_text (valent_clipboard_get_default (),
+                               "send-content-1",
+                               NULL,
+                               NULL,
+                               NULL);
+  valent_clipboard_write_text (valent_clipboard_get_default (),
+                               "send-content-2",
+                               NULL,
+                               NULL,
+                               NULL);
+  valent_clipboard_write_text (valent_clipboard_get_default (),
+                               "send-content-3",
+                               NULL,
+                               NULL,
+                               NULL);
+
+  packet = valent_test_fixture_expect_packet (fixture);
+  v_assert_packet_type (packet, "kdeconnect.clipboard");
+  v_assert_packet_cmpstr (packet, "content", ==, "send-content-3");
+  json_node_unref (packet);
+
+  VALENT_TEST_CHECK ("Plugin does not resend content already sent");
+  valent_clipboard_write_text (valent_clipboard_get_default (),
+                               "send-content-3",
+                               NULL,
+                               NULL,
+                               NULL);
+  valent_test_await_timeout (500);
+
+  VALENT_TEST_CHECK ("Plugin does not send content received from the device");
+  packet = valent_test_fixture_lookup_packet (fixture, "clipboard-content");
+  valent_test_fixture_handle_packet (fixture, packet);
+  valent_test_await_timeout (500);
+
+  VALENT_TEST_CHECK ("Plugin does not automatically send oversized content");
+  large = g_strnfill (1024 * 1024, 'a');
+  valent_clipboard_write_text (valent_clipboard_get_default (),
+                               large,
+                               NULL,
+                               NULL,
+                               NULL);
+  valent_test_await_timeout (500);
+
+  /* The next packet received must be for this content, if nothing else was
+   * sent since the last packet was checked. */
+  valent_clipboard_write_text (valent_clipboard_get_default (),
+                               "send-content-4",
+                               NULL,
+                               NULL,
+                               NULL);
+
+  packet = valent_test_fixture_expect_packet (fixture);
+  v_assert_packet_type (packet, "kdeconnect.clipboard");
+  v_assert_packet_cmpstr (packet, "content", ==, "send-content-4");
+  json_node_unref (packet);
 }
 
 static void
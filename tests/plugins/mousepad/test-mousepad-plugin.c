@@ -7,6 +7,16 @@
 #include <libvalent-test.h>
 
 
+static void
+mousepad_plugin_fixture_set_up (ValentTestFixture *fixture,
+                                gconstpointer      user_data)
+{
+  valent_test_fixture_init (fixture, user_data);
+
+  /* Apply pointer motion immediately, rather than once per frame */
+  g_object_set (valent_input_get_default (), "motion-interval", 0, NULL);
+}
+
 static void
 mousepad_plugin_fixture_tear_down (ValentTestFixture *fixture,
                                    gconstpointer      user_data)
@@ -325,31 +335,31 @@ main (int   argc,
 
   g_test_add ("/plugins/mousepad/handle-echo",
               ValentTestFixture, path,
-              valent_test_fixture_init,
+              mousepad_plugin_fixture_set_up,
               test_mousepad_plugin_handle_echo,
               mousepad_plugin_fixture_tear_down);
 
   g_test_add ("/plugins/mousepad/handle-request",
               ValentTestFixture, path,
-              valent_test_fixture_init,
+              mousepad_plugin_fixture_set_up,
               test_mousepad_plugin_handle_request,
               mousepad_plugin_fixture_tear_down);
 
   g_test_add ("/plugins/mousepad/send-keyboard-request",
               ValentTestFixture, path,
-              valent_test_fixture_init,
+              mousepad_plugin_fixture_set_up,
               test_mousepad_plugin_send_keyboard_request,
               mousepad_plugin_fixture_tear_down);
 
   g_test_add ("/plugins/mousepad/send-pointer-request",
               ValentTestFixture, path,
-              valent_test_fixture_init,
+              mousepad_plugin_fixture_set_up,
               test_mousepad_plugin_send_pointer_request,
               mousepad_plugin_fixture_tear_down);
 
   g_test_add ("/plugins/mousepad/fuzz",
               ValentTestFixture, path,
-              valent_test_fixture_init,
+              mousepad_plugin_fixture_set_up,
               test_mousepad_plugin_fuzz,
               mousepad_plugin_fixture_tear_down);
 
@@ -1,6 +1,8 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 // SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
 
+#include <string.h>
+
 #include <gio/gio.h>
 #include <gtk/gtk.h>
 #include <valent.h>
@@ -10,6 +12,10 @@
 #include "valent-mpris-impl.h"
 #include "valent-mpris-player.h"
 
+#define SESSION_DURATION   (20 * G_TIME_SPAN_SECOND)
+#define SESSION_TICK       (100)
+#define SESSION_TRACK_TIME (5 * G_TIME_SPAN_SECOND)
+
 
 static void
 export_cb (ValentMPRISImpl   *impl,
@@ -54,8 +60,10 @@ test_mpris_plugin_handle_request (ValentTestFixture *fixture,
   g_autoptr (ValentMPRISImpl) impl = NULL;
   g_autoptr (GError) error = NULL;
   JsonNode *packet;
+  JsonNode *art_request;
   JsonArray *player_list;
   const char *player_name;
+  const char *art_url;
 
   /* Export a mock player that we can use to poke the plugin during testing */
   player = g_object_new (VALENT_TYPE_MOCK_MEDIA_PLAYER, NULL);
@@ -123,8 +131,12 @@ test_mpris_plugin_handle_request (ValentTestFixture *fixture,
   v_assert_packet_true (packet, "canGoNext");
   v_assert_packet_true (packet, "canSeek");
   v_assert_packet_true (packet, "isPlaying");
-  v_assert_packet_cmpstr (packet, "loopStatus", ==, "None");
-  v_assert_packet_false (packet, "shuffle");
+  v_assert_packet_field (packet, "pos");
+
+  VALENT_TEST_CHECK ("Plugin only sends fields that changed");
+  v_assert_packet_no_field (packet, "loopStatus");
+  v_assert_packet_no_field (packet, "shuffle");
+  v_assert_packet_no_field (packet, "volume");
 
   v_assert_packet_cmpstr (packet, "artist", ==, "Test Artist");
   v_assert_packet_cmpstr (packet, "title", ==, "Track 1");
@@ -145,9 +157,7 @@ test_mpris_plugin_handle_request (ValentTestFixture *fixture,
   v_assert_packet_true (packet, "canGoNext");
   v_assert_packet_true (packet, "canGoPrevious");
   v_assert_packet_true (packet, "canSeek");
-  v_assert_packet_true (packet, "isPlaying");
-  v_assert_packet_cmpstr (packet, "loopStatus", ==, "None");
-  v_assert_packet_false (packet, "shuffle");
+  v_assert_packet_no_field (packet, "isPlaying");
 
   v_assert_packet_cmpstr (packet, "artist", ==, "Test Artist");
   v_assert_packet_cmpstr (packet, "title", ==, "Track 2");
@@ -168,9 +178,7 @@ test_mpris_plugin_handle_request (ValentTestFixture *fixture,
   v_assert_packet_true (packet, "canGoNext");
   v_assert_packet_false (packet, "canGoPrevious");
   v_assert_packet_true (packet, "canSeek");
-  v_assert_packet_true (packet, "isPlaying");
-  v_assert_packet_cmpstr (packet, "loopStatus", ==, "None");
-  v_assert_packet_false (packet, "shuffle");
+  v_assert_packet_no_field (packet, "isPlaying");
 
   v_assert_packet_cmpstr (packet, "artist", ==, "Test Artist");
   v_assert_packet_cmpstr (packet, "title", ==, "Track 1");
@@ -191,13 +199,12 @@ test_mpris_plugin_handle_request (ValentTestFixture *fixture,
   v_assert_packet_true (packet, "canPlay");
   v_assert_packet_true (packet, "canSeek");
   v_assert_packet_false (packet, "isPlaying");
-  v_assert_packet_cmpstr (packet, "loopStatus", ==, "None");
-  v_assert_packet_false (packet, "shuffle");
+  v_assert_packet_field (packet, "pos");
 
-  v_assert_packet_cmpstr (packet, "artist", ==, "Test Artist");
-  v_assert_packet_cmpstr (packet, "title", ==, "Track 1");
-  v_assert_packet_cmpstr (packet, "album", ==, "Test Album");
-  v_assert_packet_cmpint (packet, "length", ==, 180000);
+  v_assert_packet_no_field (packet, "artist");
+  v_assert_packet_no_field (packet, "title");
+  v_assert_packet_no_field (packet, "album");
+  v_assert_packet_no_field (packet, "length");
   json_node_unref (packet);
 
   VALENT_TEST_CHECK ("Plugin responds to a request to Seek");
@@ -209,38 +216,54 @@ test_mpris_plugin_handle_request (ValentTestFixture *fixture,
   v_assert_packet_type (packet, "kdeconnect.mpris");
 
   v_assert_packet_cmpstr (packet, "player", ==, "Mock Player");
-  v_assert_packet_cmpint (packet, "pos", ==, 1000);
+  v_assert_packet_cmpint (packet, "pos", >=, 1000);
+  v_assert_packet_no_field (packet, "isPlaying");
   json_node_unref (packet);
 
+  VALENT_TEST_CHECK ("Plugin coalesces rapid position updates");
+  for (unsigned int i = 0; i < 5; i++)
+    {
+      packet = valent_test_fixture_lookup_packet (fixture, "request-seek");
+      valent_test_fixture_handle_packet (fixture, packet);
+    }
+
+  for (unsigned int n_packets = 1;; n_packets++)
+    {
+      int64_t position = 0;
+
+      g_assert_cmpuint (n_packets, <, 5);
+
+      packet = valent_test_fixture_expect_packet (fixture);
+      v_assert_packet_type (packet, "kdeconnect.mpris");
+      v_assert_packet_cmpstr (packet, "player", ==, "Mock Player");
+      g_assert_true (valent_packet_get_int (packet, "pos", &position));
+      json_node_unref (packet);
+
+      if (position >= 6000)
+        break;
+    }
+
   VALENT_TEST_CHECK ("Plugin responds to a request to Stop");
   packet = valent_test_fixture_lookup_packet (fixture, "request-stop");
   valent_test_fixture_handle_packet (fixture, packet);
 
-  VALENT_TEST_CHECK ("Plugin responds with an update that the position is reset");
-  packet = valent_test_fixture_expect_packet (fixture);
-  v_assert_packet_type (packet, "kdeconnect.mpris");
-  v_assert_packet_cmpstr (packet, "player", ==, "Mock Player");
-  v_assert_packet_cmpint (packet, "pos", ==, 0);
-  json_node_unref (packet);
-
   VALENT_TEST_CHECK ("Plugin responds with an update that the player is quiescent");
   packet = valent_test_fixture_expect_packet (fixture);
   v_assert_packet_type (packet, "kdeconnect.mpris");
 
   v_assert_packet_cmpstr (packet, "player", ==, "Mock Player");
+  v_assert_packet_cmpint (packet, "pos", ==, 0);
   v_assert_packet_false (packet, "canPause");
   v_assert_packet_true (packet, "canPlay");
   v_assert_packet_false (packet, "canGoNext");
   v_assert_packet_false (packet, "canGoPrevious");
   v_assert_packet_false (packet, "canSeek");
-  v_assert_packet_false (packet, "isPlaying");
-  v_assert_packet_cmpstr (packet, "loopStatus", ==, "None");
-  v_assert_packet_false (packet, "shuffle");
 
-  v_assert_packet_no_field (packet, "artist");
-  v_assert_packet_no_field (packet, "title");
-  v_assert_packet_no_field (packet, "album");
-  v_assert_packet_no_field (packet, "length");
+  VALENT_TEST_CHECK ("Plugin sends cleared metadata as empty fields");
+  v_assert_packet_cmpstr (packet, "artist", ==, "");
+  v_assert_packet_cmpstr (packet, "title", ==, "");
+  v_assert_packet_cmpstr (packet, "album", ==, "");
+  v_assert_packet_cmpint (packet, "length", ==, 0);
   json_node_unref (packet);
 
   VALENT_TEST_CHECK ("Plugin responds to a request to change Loop Status");
@@ -283,13 +306,17 @@ test_mpris_plugin_handle_request (ValentTestFixture *fixture,
   packet = valent_test_fixture_expect_packet (fixture);
   v_assert_packet_type (packet, "kdeconnect.mpris");
   v_assert_packet_cmpstr (packet, "player", ==, "Mock Player");
-  v_assert_packet_cmpstr (packet, "albumArtUrl", ==, "resource:///tests/image.png");
+  g_assert_true (valent_packet_get_string (packet, "albumArtUrl", &art_url));
+
+  VALENT_TEST_CHECK ("Plugin offers Album Art by its content, not its source");
+  g_assert_true (g_str_has_prefix (art_url, "file://"));
+  g_assert_true (g_str_has_suffix (art_url, ".jpeg"));
+  art_request = create_albumart_request (art_url);
   json_node_unref (packet);
 
   VALENT_TEST_CHECK ("Plugin responds to a request to transfer Album Art");
-  packet = create_albumart_request ("resource:///tests/image.png");
-  valent_test_fixture_handle_packet (fixture, packet);
-  json_node_unref (packet);
+  valent_test_fixture_handle_packet (fixture, art_request);
+  json_node_unref (art_request);
 
   packet = valent_test_fixture_expect_packet (fixture);
   v_assert_packet_type (packet, "kdeconnect.mpris");
@@ -551,6 +578,162 @@ test_mpris_plugin_fuzz (ValentTestFixture *fixture,
     valent_test_fixture_schema_fuzz (fixture, schemas[s]);
 }
 
+/*
+ * A simulated playback session, counting the packets sent to the remote device.
+ */
+typedef struct
+{
+  ValentMediaPlayer *player;
+  GCancellable      *cancellable;
+  int64_t            start;
+  int64_t            track_start;
+  unsigned int       n_tracks;
+  gboolean           seeked;
+  gboolean           done;
+
+  unsigned int       n_packets;
+  size_t             n_bytes;
+  gboolean           reading;
+} PlaybackSession;
+
+static void
+session_read_cb (ValentChannel   *channel,
+                 GAsyncResult    *result,
+                 PlaybackSession *session)
+{
+  g_autoptr (JsonNode) packet = NULL;
+  g_autofree char *packet_str = NULL;
+  g_autoptr (GError) error = NULL;
+
+  packet = valent_channel_read_packet_finish (channel, result, &error);
+
+  if (packet == NULL)
+    {
+      g_assert_true (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED));
+      session->reading = FALSE;
+      return;
+    }
+
+  session->n_packets += 1;
+  packet_str = json_to_string (packet, FALSE);
+  session->n_bytes += strlen (packet_str);
+
+  valent_channel_read_packet (channel,
+                              session->cancellable,
+                              (GAsyncReadyCallback)session_read_cb,
+                              session);
+}
+
+static gboolean
+session_tick_cb (gpointer data)
+{
+  PlaybackSession *session = data;
+  int64_t now = g_get_monotonic_time ();
+  double position;
+
+  if (now - session->start >= SESSION_DURATION)
+    {
+      session->done = TRUE;
+      return G_SOURCE_REMOVE;
+    }
+
+  /* Change tracks periodically, alternating direction */
+  if (now - session->track_start >= SESSION_TRACK_TIME)
+    {
+      if (session->n_tracks++ % 2 == 0)
+        valent_media_player_next (session->player);
+      else
+        valent_media_player_previous (session->player);
+
+      session->track_start = now;
+      session->seeked = FALSE;
+    }
+
+  /* The player reports its position as it advances, with some jitter */
+  position = (double)(now - session->track_start) / G_TIME_SPAN_SECOND;
+  position += g_test_rand_double_range (-0.05, 0.05);
+  valent_media_player_set_position (session->player, MAX (position, 0.0));
+
+  /* Halfway through a track, the user scrubs forward */
+  if (!session->seeked && now - session->track_start >= SESSION_TRACK_TIME / 2)
+    {
+      for (unsigned int i = 0; i < 5; i++)
+        valent_media_player_seek (session->player, 1.0);
+
+      session->track_start -= 5 * G_TIME_SPAN_SECOND;
+      session->seeked = TRUE;
+    }
+
+  return G_SOURCE_CONTINUE;
+}
+
+static void
+test_mpris_plugin_playback_perf (ValentTestFixture *fixture,
+                                 gconstpointer      user_data)
+{
+  g_autoptr (ValentMediaPlayer) player = NULL;
+  g_autoptr (ValentMPRISImpl) impl = NULL;
+  g_autoptr (GCancellable) cancellable = NULL;
+  PlaybackSession session = { 0, };
+  JsonNode *packet;
+  double minutes;
+
+  if (!g_test_perf ())
+    {
+      g_test_skip ("Performance tests disabled");
+      return;
+    }
+
+  player = g_object_new (VALENT_TYPE_MOCK_MEDIA_PLAYER, NULL);
+  impl = valent_mpris_impl_new (player);
+  valent_mpris_impl_export_full (impl,
+                                 "org.mpris.MediaPlayer2.Test",
+                                 NULL,
+                                 (GAsyncReadyCallback)export_cb,
+                                 fixture);
+  valent_test_await_signal (valent_media_get_default (), "items-changed");
+
+  valent_test_fixture_connect (fixture, TRUE);
+
+  packet = valent_test_fixture_expect_packet (fixture);
+  v_assert_packet_type (packet, "kdeconnect.mpris.request");
+  json_node_unref (packet);
+
+  packet = valent_test_fixture_expect_packet (fixture);
+  v_assert_packet_type (packet, "kdeconnect.mpris");
+  json_node_unref (packet);
+
+  VALENT_TEST_CHECK ("Plugin sends player updates during playback");
+  cancellable = g_cancellable_new ();
+  session.player = player;
+  session.cancellable = cancellable;
+  session.reading = TRUE;
+  valent_channel_read_packet (fixture->endpoint,
+                              cancellable,
+                              (GAsyncReadyCallback)session_read_cb,
+                              &session);
+
+  valent_media_player_play (player);
+  session.start = g_get_monotonic_time ();
+  session.track_start = session.start;
+  g_timeout_add (SESSION_TICK, session_tick_cb, &session);
+  valent_test_await_boolean (&session.done);
+
+  /* Let any pending update flush, then stop reading */
+  valent_test_await_timeout (1000);
+  g_cancellable_cancel (cancellable);
+  while (session.reading)
+    g_main_context_iteration (NULL, FALSE);
+
+  minutes = (double)SESSION_DURATION / (60 * G_TIME_SPAN_SECOND);
+  g_test_minimized_result (session.n_packets / minutes,
+                           "Playback: %.1f packets/min",
+                           session.n_packets / minutes);
+  g_test_minimized_result (session.n_bytes / minutes,
+                           "Playback: %.0f bytes/min",
+                           session.n_bytes / minutes);
+}
+
 int
 main (int   argc,
       char *argv[])
@@ -571,6 +754,12 @@ main (int   argc,
               test_mpris_plugin_handle_player,
               text_mpris_plugin_fixture_clear);
 
+  g_test_add ("/plugins/mpris/playback-perf",
+              ValentTestFixture, path,
+              valent_test_fixture_init,
+              test_mpris_plugin_playback_perf,
+              text_mpris_plugin_fixture_clear);
+
   g_test_add ("/plugins/mpris/fuzz",
               ValentTestFixture, path,
               valent_test_fixture_init,
@@ -6,6 +6,16 @@
 #include <libvalent-test.h>
 
 
+static void
+presenter_plugin_fixture_set_up (ValentTestFixture *fixture,
+                                 gconstpointer      user_data)
+{
+  valent_test_fixture_init (fixture, user_data);
+
+  /* Apply pointer motion immediately, rather than once per frame */
+  g_object_set (valent_input_get_default (), "motion-interval", 0, NULL);
+}
+
 static void
 test_presenter_plugin_basic (ValentTestFixture *fixture,
                              gconstpointer      user_data)
@@ -105,25 +115,25 @@ main (int   argc,
 
   g_test_add ("/plugins/presenter/basic",
               ValentTestFixture, path,
-              valent_test_fixture_init,
+              presenter_plugin_fixture_set_up,
               test_presenter_plugin_basic,
               valent_test_fixture_clear);
 
   g_test_add ("/plugins/presenter/handle-request",
               ValentTestFixture, path,
-              valent_test_fixture_init,
+              presenter_plugin_fixture_set_up,
               test_presenter_plugin_handle_request,
               valent_test_fixture_clear);
 
   g_test_add ("/plugins/presenter/send-request",
               ValentTestFixture, path,
-              valent_test_fixture_init,
+              presenter_plugin_fixture_set_up,
               test_presenter_plugin_send_request,
               valent_test_fixture_clear);
 
   g_test_add ("/plugins/presenter/fuzz",
               ValentTestFixture, path,
-              valent_test_fixture_init,
+              presenter_plugin_fixture_set_up,
               test_presenter_plugin_fuzz,
               valent_test_fixture_clear);
 
@@ -9,6 +9,9 @@
 
 static const char *test_file = "resource:///tests/image.png";
 
+#define TEST_FILE_SIZE  (882)
+#define N_MANY_FILES    (100)
+
 static void
 test_share_download_single (ValentTestFixture *fixture,
                             gconstpointer      user_data)
@@ -90,6 +93,75 @@ test_share_download_multiple (ValentTestFixture *fixture,
   g_clear_object (&dest);
 }
 
+static void
+test_share_download_many (ValentTestFixture *fixture,
+                          gconstpointer      user_data)
+{
+  g_autoptr (GFile) file = NULL;
+  const char *dest_dir = NULL;
+  GError *error = NULL;
+
+  valent_test_fixture_connect (fixture, TRUE);
+
+  /* Ensure the download directory is at it's default */
+  g_settings_reset (fixture->settings, "download-folder");
+
+  file = g_file_new_for_uri (test_file);
+
+  /* Each payload is uploaded as soon as the previous one is accepted */
+  for (unsigned int i = 0; i < N_MANY_FILES; i++)
+    {
+      g_autoptr (JsonBuilder) builder = NULL;
+      g_autoptr (JsonNode) packet = NULL;
+
+      valent_packet_init (&builder, "kdeconnect.share.request");
+      json_builder_set_member_name (builder, "filename");
+      json_builder_add_string_value (builder, "many.png");
+      json_builder_set_member_name (builder, "numberOfFiles");
+      json_builder_add_int_value (builder, N_MANY_FILES);
+      json_builder_set_member_name (builder, "totalPayloadSize");
+      json_builder_add_int_value (builder, N_MANY_FILES * TEST_FILE_SIZE);
+      packet = valent_packet_end (&builder);
+
+      valent_test_upload (fixture->endpoint, packet, file, &error);
+      g_assert_no_error (error);
+    }
+
+  /* Check the received files, allowing the last payloads to finish, since
+   * several may still be in progress when the final upload is accepted */
+  dest_dir = valent_get_user_directory (G_USER_DIRECTORY_DOWNLOAD);
+
+  for (unsigned int i = 0; i < N_MANY_FILES; i++)
+    {
+      g_autoptr (GFile) dest = NULL;
+      g_autofree char *name = NULL;
+      goffset size = -1;
+
+      if (i == 0)
+        name = g_strdup ("many.png");
+      else
+        name = g_strdup_printf ("many.png (%u)", i);
+
+      dest = valent_get_user_file (dest_dir, name, FALSE);
+
+      while (size != TEST_FILE_SIZE)
+        {
+          g_autoptr (GFileInfo) info = NULL;
+
+          valent_test_await_timeout (1);
+          info = g_file_query_info (dest,
+                                    G_FILE_ATTRIBUTE_STANDARD_SIZE,
+                                    G_FILE_QUERY_INFO_NONE,
+                                    NULL,
+                                    &error);
+          g_assert_no_error (error);
+
+          size = g_file_info_get_size (info);
+          g_assert_cmpint (size, <=, TEST_FILE_SIZE);
+        }
+    }
+}
+
 int
 main (int   argc,
       char *argv[])
@@ -110,5 +182,11 @@ main (int   argc,
               test_share_download_multiple,
               valent_test_fixture_clear);
 
+  g_test_add ("/plugins/share/download-many",
+              ValentTestFixture, path,
+              valent_test_fixture_init,
+              test_share_download_many,
+              valent_test_fixture_clear);
+
   return g_test_run ();
 }
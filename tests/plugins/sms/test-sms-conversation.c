@@ -55,6 +55,14 @@ test_sms_conversation (void)
   g_assert_cmpint (thread_id, ==, thread_id_out);
   g_assert_cmpint (thread_id, ==, valent_sms_conversation_get_thread_id (VALENT_SMS_CONVERSATION (conversation)));
 
+  VALENT_TEST_CHECK ("Widget can scroll to a message by date");
+  valent_sms_conversation_scroll_to_date (VALENT_SMS_CONVERSATION (conversation), 1);
+  valent_test_await_pending ();
+
+  VALENT_TEST_CHECK ("Widget can change threads");
+  valent_sms_conversation_set_thread_id (VALENT_SMS_CONVERSATION (conversation), 2);
+  valent_test_await_pending ();
+
   gtk_window_destroy (GTK_WINDOW (window));
   valent_test_await_nullptr (&window);
 }
@@ -0,0 +1,131 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#include <gdk/gdk.h>
+#include <valent.h>
+#include <libvalent-test.h>
+
+#include "test-sms-common.h"
+#include "valent-message.h"
+#include "valent-sms-search.h"
+
+
+static unsigned int
+count_messages (GListModel *model)
+{
+  unsigned int n_items = g_list_model_get_n_items (model);
+  unsigned int n_messages = 0;
+
+  for (unsigned int i = 0; i < n_items; i++)
+    {
+      g_autoptr (GObject) item = g_list_model_get_item (model, i);
+
+      if (VALENT_IS_MESSAGE (item))
+        n_messages++;
+    }
+
+  return n_messages;
+}
+
+static void
+await_search (ValentSmsSearch *search)
+{
+  while (valent_sms_search_get_loading (search))
+    g_main_context_iteration (NULL, FALSE);
+}
+
+static void
+test_sms_search (void)
+{
+  g_autoptr (ValentSmsStore) messages = NULL;
+  g_autoptr (ValentContactStore) contacts = NULL;
+  g_autoptr (ValentSmsSearch) search = NULL;
+  g_autoptr (ValentSmsStore) messages_out = NULL;
+  g_autoptr (ValentContactStore) contacts_out = NULL;
+  g_autofree char *query_out = NULL;
+
+  contacts = valent_test_contact_store_new ();
+  messages = valent_test_sms_store_new ();
+
+  VALENT_TEST_CHECK ("Search can be constructed");
+  search = valent_sms_search_new (contacts, messages);
+  g_assert_true (G_IS_LIST_MODEL (search));
+  g_assert_cmpuint (g_list_model_get_n_items (G_LIST_MODEL (search)), ==, 0);
+
+  VALENT_TEST_CHECK ("GObject properties function correctly");
+  valent_sms_search_set_query (search, "Thread");
+  g_object_get (search,
+                "contact-store", &contacts_out,
+                "message-store", &messages_out,
+                "query",         &query_out,
+                NULL);
+
+  g_assert_true (contacts == contacts_out);
+  g_assert_true (messages == messages_out);
+  g_assert_cmpstr (query_out, ==, "Thread");
+
+  VALENT_TEST_CHECK ("Search is debounced and reports loading");
+  g_assert_true (valent_sms_search_get_loading (search));
+  g_assert_cmpuint (g_list_model_get_n_items (G_LIST_MODEL (search)), ==, 0);
+
+  VALENT_TEST_CHECK ("Search returns the latest match in each thread");
+  await_search (search);
+  g_assert_cmpuint (count_messages (G_LIST_MODEL (search)), ==, 2);
+
+  VALENT_TEST_CHECK ("Search can refine the previous results");
+  valent_sms_search_set_query (search, "Thread 2");
+  await_search (search);
+  g_assert_cmpuint (count_messages (G_LIST_MODEL (search)), ==, 1);
+
+  VALENT_TEST_CHECK ("Search can widen the previous results");
+  valent_sms_search_set_query (search, "Message");
+  await_search (search);
+  g_assert_cmpuint (count_messages (G_LIST_MODEL (search)), ==, 2);
+
+  VALENT_TEST_CHECK ("Search ignores ASCII case, when searching and refining");
+  valent_sms_search_set_query (search, "thread");
+  await_search (search);
+  g_assert_cmpuint (count_messages (G_LIST_MODEL (search)), ==, 2);
+
+  valent_sms_search_set_query (search, "THREAD 2");
+  await_search (search);
+  g_assert_cmpuint (count_messages (G_LIST_MODEL (search)), ==, 1);
+
+  VALENT_TEST_CHECK ("Search matches wildcard characters literally");
+  valent_sms_search_set_query (search, "thread");
+  await_search (search);
+  valent_sms_search_set_query (search, "thread_2");
+  await_search (search);
+  g_assert_cmpuint (count_messages (G_LIST_MODEL (search)), ==, 0);
+
+  valent_sms_search_set_query (search, "%");
+  await_search (search);
+  g_assert_cmpuint (count_messages (G_LIST_MODEL (search)), ==, 0);
+
+  VALENT_TEST_CHECK ("Search cancels a superseded query");
+  valent_sms_search_set_query (search, "Thread 1");
+  valent_sms_search_set_query (search, "Thread 3");
+  await_search (search);
+  g_assert_cmpuint (count_messages (G_LIST_MODEL (search)), ==, 0);
+
+  VALENT_TEST_CHECK ("Search clears results for an empty query");
+  valent_sms_search_set_query (search, "Message");
+  await_search (search);
+  g_assert_cmpuint (count_messages (G_LIST_MODEL (search)), ==, 2);
+
+  valent_sms_search_set_query (search, "");
+  g_assert_false (valent_sms_search_get_loading (search));
+  g_assert_cmpuint (g_list_model_get_n_items (G_LIST_MODEL (search)), ==, 0);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  valent_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/plugins/sms/search",
+                   test_sms_search);
+
+  return g_test_run ();
+}
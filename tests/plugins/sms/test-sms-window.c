@@ -1,6 +1,9 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 // SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
 
+#include <stdio.h>
+#include <unistd.h>
+
 #include <gdk/gdk.h>
 #include <valent.h>
 #include <libvalent-test.h>
@@ -8,6 +11,9 @@
 #include "test-sms-common.h"
 #include "valent-sms-window.h"
 
+#define PERF_N_THREADS         (2000)
+#define PERF_N_THREAD_MESSAGES (20000)
+
 
 static void
 test_sms_window (void)
@@ -85,6 +91,165 @@ test_sms_window (void)
   valent_test_await_nullptr (&window);
 }
 
+static size_t
+get_resident_size (void)
+{
+  g_autofree char *contents = NULL;
+  unsigned long size = 0;
+  unsigned long resident = 0;
+
+  if (!g_file_get_contents ("/proc/self/statm", &contents, NULL, NULL))
+    return 0;
+
+  if (sscanf (contents, "%lu %lu", &size, &resident) != 2)
+    return 0;
+
+  return resident * (size_t)sysconf (_SC_PAGESIZE);
+}
+
+static void
+add_messages_cb (ValentSmsStore *store,
+                 GAsyncResult   *result,
+                 gboolean       *done)
+{
+  g_autoptr (GError) error = NULL;
+
+  valent_sms_store_add_messages_finish (store, result, &error);
+  g_assert_no_error (error);
+
+  *done = TRUE;
+}
+
+static ValentSmsStore *
+create_large_store (void)
+{
+  g_autoptr (ValentContext) context = NULL;
+  g_autoptr (ValentSmsStore) store = NULL;
+  g_autoptr (GPtrArray) messages = NULL;
+  unsigned int n_messages = PERF_N_THREADS + PERF_N_THREAD_MESSAGES;
+  gboolean done = FALSE;
+
+  context = g_object_new (VALENT_TYPE_CONTEXT,
+                          "domain", "device",
+                          "id",     "perf-device",
+                          NULL);
+  store = valent_sms_store_new (context);
+  messages = g_ptr_array_new_full (n_messages, g_object_unref);
+
+  /* One message in each of many threads, then one very long thread */
+  for (unsigned int i = 0; i < n_messages; i++)
+    {
+      int64_t id = i + 1;
+      int64_t thread_id = MIN (id, PERF_N_THREADS + 1);
+      g_autofree char *sender = NULL;
+      g_autofree char *text = NULL;
+      GVariant *metadata;
+
+      sender = g_strdup_printf ("+1-234-%07"G_GINT64_FORMAT, thread_id);
+      text = g_strdup_printf ("Thread %"G_GINT64_FORMAT", Message %"G_GINT64_FORMAT,
+                              thread_id, id);
+      metadata = g_variant_new_parsed ("{'addresses': <[{'address': <%s>}]>}",
+                                       sender);
+      g_ptr_array_add (messages,
+                       g_object_new (VALENT_TYPE_MESSAGE,
+                                     "box",       VALENT_MESSAGE_BOX_INBOX,
+                                     "date",      id,
+                                     "id",        id,
+                                     "metadata",  metadata,
+                                     "read",      TRUE,
+                                     "sender",    sender,
+                                     "text",      text,
+                                     "thread-id", thread_id,
+                                     NULL));
+    }
+
+  valent_sms_store_add_messages (store,
+                                 messages,
+                                 NULL,
+                                 (GAsyncReadyCallback)add_messages_cb,
+                                 &done);
+  valent_test_await_boolean (&done);
+
+  return g_steal_pointer (&store);
+}
+
+/*
+ * Measure the time and resident memory it takes to open the window and
+ * populate the conversation list, then to open the longest thread.
+ *
+ * Store tasks run in order on a single worker, so once a model requested after
+ * the window's own has been populated, the window's has been as well.
+ */
+static void
+test_sms_window_perf (void)
+{
+  g_autoptr (ValentSmsStore) messages = NULL;
+  g_autoptr (ValentContactStore) contacts = NULL;
+  g_autoptr (GListModel) summary = NULL;
+  g_autoptr (GListModel) thread = NULL;
+  ValentSmsWindow *window;
+  size_t rss_start, rss_list, rss_thread;
+  int64_t start;
+  double list_time, thread_time;
+
+  if (!g_test_perf ())
+    {
+      g_test_skip ("Performance tests disabled");
+      return;
+    }
+
+  contacts = valent_test_contact_store_new ();
+  messages = create_large_store ();
+  valent_test_await_pending ();
+
+  VALENT_TEST_CHECK ("Window opens with a large conversation list");
+  rss_start = get_resident_size ();
+  start = g_get_monotonic_time ();
+
+  window = g_object_new (VALENT_TYPE_SMS_WINDOW,
+                         "contact-store", contacts,
+                         "message-store", messages,
+                         NULL);
+  g_object_add_weak_pointer (G_OBJECT (window), (gpointer)&window);
+  gtk_window_present (GTK_WINDOW (window));
+
+  summary = valent_sms_store_get_summary (messages);
+  while (g_list_model_get_n_items (summary) < PERF_N_THREADS + 1)
+    g_main_context_iteration (NULL, FALSE);
+  valent_test_await_pending ();
+
+  list_time = (g_get_monotonic_time () - start) / (double)G_USEC_PER_SEC;
+  rss_list = get_resident_size ();
+
+  VALENT_TEST_CHECK ("Window opens a large conversation");
+  start = g_get_monotonic_time ();
+
+  valent_sms_window_set_active_thread (window, PERF_N_THREADS + 1);
+  thread = valent_sms_store_get_thread (messages, PERF_N_THREADS + 1);
+  while (g_list_model_get_n_items (thread) < PERF_N_THREAD_MESSAGES)
+    g_main_context_iteration (NULL, FALSE);
+  valent_test_await_pending ();
+
+  thread_time = (g_get_monotonic_time () - start) / (double)G_USEC_PER_SEC;
+  rss_thread = get_resident_size ();
+
+  g_test_minimized_result (list_time,
+                           "Conversation list open: %.3f s",
+                           list_time);
+  g_test_minimized_result (((double)rss_list - (double)rss_start) / 1024,
+                           "Conversation list RSS: %.0f KiB",
+                           ((double)rss_list - (double)rss_start) / 1024);
+  g_test_minimized_result (thread_time,
+                           "Thread open: %.3f s",
+                           thread_time);
+  g_test_minimized_result (((double)rss_thread - (double)rss_list) / 1024,
+                           "Thread RSS: %.0f KiB",
+                           ((double)rss_thread - (double)rss_list) / 1024);
+
+  gtk_window_destroy (GTK_WINDOW (window));
+  valent_test_await_nullptr (&window);
+}
+
 int
 main (int   argc,
       char *argv[])
@@ -94,6 +259,9 @@ main (int   argc,
   g_test_add_func ("/plugins/sms/window",
                    test_sms_window);
 
+  g_test_add_func ("/plugins/sms/window-perf",
+                   test_sms_window_perf);
+
   return g_test_run ();
 }
 